@@ -14,7 +14,9 @@
 static const QString msgGeneratorExit = " application exited with status ";
 static const QString msgCriticalErrorConfigFile = "Critical error handling config files. Aborting...";
 static const QString msgErrValueLoad ="Error loading values: ";
-static const QString msgErrSysCall = "Error during system() call.";
+static const QString msgErrSysCall = "Error starting the application.";
+static const QString msgGeneratorRunning = " application running...";
+static const QString msgRunQueued = "Run queued: it will start with the current parameters once the running one is over.";
 static const QString msgTemplateError = "Error choosing geometry template: ";
 static const QString msgParamReset = "Parameters reset.";
 static const QString msgErrParamTableAccess = "Unable to access parameter table: ";
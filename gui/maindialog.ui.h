@@ -49,6 +49,7 @@
  *   <ul>
  *     <li><b>*fh</b> An instance of the class that handles reading and writing to the configuration files.</li>
  *     <li><b>*settingsPopup</b> A popup menu containing the options to save and retrieve parameter settings from file</li>
+ *     <li><b>*generator</b> The background process of the simulation, created on the first run</li>
  *   </ul>
  *   </li>
  *   <li>Temporary configuration files
@@ -57,6 +58,7 @@
  *     <li><b>tmpSettings</b> The temporary file for the module options</li>
  *   </ul>
  *   </li>
+ *   <li><b>runQueued</b> Whether a run was asked for while the simulation was running, to be started once it is over</li>
  * </ul>
  */
 
@@ -72,6 +74,8 @@ void MainDialog::init()
 {
     /// Instantiate the file handler helper class
     fh = new FileHandler();
+    generator = NULL;
+    runQueued = false;
     
     /// Add the menu items to the settings popup menu and connect the widget to the main form
     settingsPopup = new QPopupMenu(settingsButton, "Settings");
@@ -216,6 +220,7 @@ void MainDialog::destroy()
 {
     if (settingsPopup) delete settingsPopup;
     if (resultsPopup) delete resultsPopup;
+    if (generator && generator->isRunning()) generator->kill();
     if (geometryPicker->selectedId() >= 0) {
 	fh->removeOutputDir(basePath + summaryExtension + outDirExtension);
 	QString rootfile = basePath + cRootDirExtension + "/";
@@ -232,10 +237,15 @@ void MainDialog::destroy()
  * This is the navigation function that moves focus from the parameter page back to the geometry selection page.
  * It is connected to the <i>Back</i> button on the parameter page.
  * It resets the content of the combo boxes to none so that they may be filled again for the next selected geometry.
- * It also empties the list boxes for layers and rings in the same way and removes the temporary config files.
+ * It also empties the list boxes for layers and rings in the same way and removes the temporary config files, stopping
+ * the simulation first if it is running on them.
  */
 void MainDialog::settingsToGeometry()
 {
+    if (generator && generator->isRunning()) {
+	runQueued = false;
+	generator->kill();
+    }
     barrelSelection->clear();
     layerSelection->clear();
     endcapSelection->clear();
@@ -310,53 +320,81 @@ void MainDialog::nextPage()
  * @fn void go()
  * The actual work is done by this function.
  * Or rather, it is delegated to the simulation executable with the appropriate config files in tow.
- * (Who said management was pointless? <i>*evil_grin*</i>) It then prepares the summary popup and displays it.
+ * (Who said management was pointless? <i>*evil_grin*</i>) The simulation runs in the background, so that the
+ * parameters can still be edited meanwhile: a run asked for while one is going on is queued, and started with the
+ * parameters of that time once the running one is over (the config files are in use until then).
  */
 void MainDialog::go()
 {
     if (validateInput()) {
 	readLineEdits();
-	QString command = basePath + "/" + cCommand + " ";
-	fh->configureTracker(tmpConfig, parameterTable.at(geometryPicker->selectedId()));
-	fh->writeSettingsToFile(tmpSettings, parameterTable.at(geometryPicker->selectedId()),
-				  summaryExtension.right(summaryExtension.length() - 1) + outDirExtension);
-	cmdLineStub = tmpConfig.name() + " " + tmpSettings.name();
-	command += cmdLineStub;
-	resultsPopup->summaryTextEdit->clear();
-	try  {
-	    int retstatus;	
-	    retstatus = generate(command);
-	    std::cout << cCommand << msgGeneratorExit << retstatus << "." << std::endl;
-	    resultsPopup->setResultsPath(basePath + summaryExtension + outDirExtension);
-	    resultsPopup->summaryTextEdit->mimeSourceFactory()->setFilePath(resultsPopup->getResultsPath());
-	    resultsPopup->setTrackerName(parameterTable.at(geometryPicker->selectedId()).trackerName);
-	    QFile workingFile(basePath + summaryExtension + outDirExtension + "/" + cSummaryIndex);
-	    if (workingFile.exists() && workingFile.open(IO_ReadOnly)) {
-		QTextStream instream(&workingFile);
-		resultsPopup->summaryTextEdit->setText(instream.read());
-	    }
-	    resultsPopup->statusBar->clear();
-	    resultsPopup->show();
-	}
-	catch (std::runtime_error re) {
-	    statusBar->setText(re.what());
+	if (generator && generator->isRunning()) {
+	    runQueued = true;
+	    statusBar->setText(msgRunQueued);
 	}
+	else startGenerator();
     }
 }
 
 /**
- * @fn int generate(const QString& command)
- * Control is transferred to the <i>TrackerGeom2</i> background application in here (by way of a horrible hack).
- * Once that exits, the function throws an exception if the attempt to run <i>TrackerGeom</i> was unsuccessful.
- * It returns normally otherwise.
- * @param command The command line string that will be passed through to the <i>system()</i> call
- * @return The exit code of the background application
+ * @fn void startGenerator()
+ * The config files are written from the current parameters and the <i>TrackerGeom2</i> application is started on them
+ * in the background. Its output goes to the terminal, as before; <i>generatorExited()</i> is called when it is over.
  */
-int MainDialog::generate(const QString& command)
+void MainDialog::startGenerator()
 {
-    int ret = system(command.ascii());
-    if (ret < 0) throw std::runtime_error("generate(): " + msgErrSysCall);
-    return ret;
+    runQueued = false;
+    fh->configureTracker(tmpConfig, parameterTable.at(geometryPicker->selectedId()));
+    fh->writeSettingsToFile(tmpSettings, parameterTable.at(geometryPicker->selectedId()),
+			      summaryExtension.right(summaryExtension.length() - 1) + outDirExtension);
+    cmdLineStub = tmpConfig.name() + " " + tmpSettings.name();
+    if (!generator) {
+	generator = new QProcess(this);
+	generator->setCommunication(0);
+	connect(generator, SIGNAL(processExited()), this, SLOT(generatorExited()));
+    }
+    generator->clearArguments();
+    generator->addArgument(basePath + "/" + cCommand.stripWhiteSpace());
+    generator->addArgument(tmpConfig.name());
+    generator->addArgument(tmpSettings.name());
+    if (generator->start()) statusBar->setText(cCommand.stripWhiteSpace() + msgGeneratorRunning);
+    else statusBar->setText("go(): " + msgErrSysCall);
+}
+
+/**
+ * @fn void generatorExited()
+ * This is the event handler for the end of the background application. The run that was queued meanwhile, if any, is
+ * started instead of showing results that are already out of date; otherwise the results are displayed, unless the
+ * application was stopped.
+ */
+void MainDialog::generatorExited()
+{
+    int retstatus = generator->normalExit() ? generator->exitStatus() : -1;
+    std::cout << cCommand << msgGeneratorExit << retstatus << "." << std::endl;
+    if (runQueued) startGenerator();
+    else if (generator->normalExit()) {
+	statusBar->clear();
+	showResults();
+    }
+}
+
+/**
+ * @fn void showResults()
+ * The summary popup is prepared from the output of the last run and displayed.
+ */
+void MainDialog::showResults()
+{
+    resultsPopup->summaryTextEdit->clear();
+    resultsPopup->setResultsPath(basePath + summaryExtension + outDirExtension);
+    resultsPopup->summaryTextEdit->mimeSourceFactory()->setFilePath(resultsPopup->getResultsPath());
+    resultsPopup->setTrackerName(parameterTable.at(geometryPicker->selectedId()).trackerName);
+    QFile workingFile(basePath + summaryExtension + outDirExtension + "/" + cSummaryIndex);
+    if (workingFile.exists() && workingFile.open(IO_ReadOnly)) {
+	QTextStream instream(&workingFile);
+	resultsPopup->summaryTextEdit->setText(instream.read());
+    }
+    resultsPopup->statusBar->clear();
+    resultsPopup->show();
 }
 
 /**
@@ -0,0 +1,59 @@
+/**
+ * @file AccumulatorSet.h
+ * @brief This is the header file for the set of results an analysis accumulates track by track
+ */
+
+#ifndef _ACCUMULATORSET_H
+#define _ACCUMULATORSET_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <TDirectory.h>
+#include <TGraph.h>
+#include <TH1.h>
+#include <TH1D.h>
+#include <MaterialMapTree.h>
+
+namespace insur {
+  /**
+   * @class AccumulatorSet
+   * @brief This class lists the ROOT objects an analysis fills track by track, so that they can be written and merged
+   * with the ones filled by the same analysis over other tracks.
+   *
+   * The histograms (including the 2D ones and the profiles, which keep the per-bin sums of the values and of their
+   * squares) are merged bin by bin; the graphs, which get one point per track, are merged by appending the points of
+   * each part in the order the parts are given; the histogram families are merged member by member, creating the
+   * members a part adds; the material map trees are merged cell by cell. All four merges are associative, so the tracks
+   * can be split in any number of contiguous parts analysed separately: merging the parts in track order gives what the
+   * analysis of all the tracks gives. What is computed from the accumulated objects (averages, calibrated maps,
+   * summaries) is left to the analysis, once merged.
+   * The objects stay owned by the analysis: the set only points to them, and has to be filled again when they change.
+   */
+  class AccumulatorSet {
+  public:
+    void clear();
+    void addHisto(TH1& histo);
+    void addGraph(TGraph& graph);
+    void addHistoFamily(const std::string& prefix, std::map<std::string, TH1D*>& histos, int bins, double min, double max);
+    void addMapTree(const std::string& name, MaterialMapTree& map);
+    void write(TDirectory& dir) const;
+    bool merge(TDirectory& part);
+    bool merge(const AccumulatorSet& part);
+  private:
+    struct HistoFamily {
+      std::string prefix;
+      std::map<std::string, TH1D*>* histos;
+      int bins;
+      double min, max;
+      TH1D*& member(const std::string& key);
+    };
+    std::vector<TH1*> histos_;
+    std::vector<TGraph*> graphs_;
+    std::vector<HistoFamily> families_;
+    std::vector<std::pair<std::string, MaterialMapTree*> > maps_;
+    static bool mergeHisto(TH1& histo, const TH1* part, const std::string& where);
+    static void appendGraph(TGraph& graph, const TGraph& part);
+  };
+}
+#endif /* _ACCUMULATORSET_H */
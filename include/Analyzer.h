@@ -20,12 +20,25 @@
 #include <vector>
 #include <set>
 #include <algorithm>
+#include <functional>
+#include <memory>
 #include <hit.hh>
 #include <ModuleCap.h>
 #include <InactiveElement.h>
 #include <InactiveSurfaces.h>
 #include <MaterialBudget.h>
+#include <ModuleHitIndex.h>
+#include <InactiveHitIndex.h>
+#include <HitPolySnapshot.h>
+#include <NodeReplicas.h>
+#include <HelixPropagator.h>
+#include <CounterRandom.h>
+#include <AccumulatorSet.h>
+#include <MaterialMapTree.h>
+#include <TrackHitCache.h>
+#include <TrackRecordWriter.h>
 #include <TCanvas.h>
+#include <TDirectory.h>
 #include <TProfile.h>
 #include <TGraph.h>
 #include <TMultiGraph.h>
@@ -42,6 +55,7 @@
 #include "SummaryTable.h"
 #include "TagMaker.h"
 
+class MaterialBillAnalyzer;
 
 namespace insur {
 
@@ -78,6 +92,47 @@ namespace insur {
   //typedef double TrackCollectionKey;
   typedef std::map<int, TrackCollection> TrackCollectionMap;
 
+  /**
+   * @struct MaterialTrackRecord
+   * @brief The histogram, material map, cell and graph fills produced by one material track analysed in a worker thread,
+   * kept aside until they can be applied in track order
+   */
+  struct MaterialTrackRecord {
+    struct Fill1D { TH1* histo; double x, w; };
+    struct Fill2D { TH2* histo; double x, y, w; bool weighted; };
+    struct MapFill { MaterialMapTree* map; double x, y, w; };
+    struct CellFill { double r, eta, theta; Material mat; };
+    struct GraphPoint { TGraph* graph; double x, y; };
+    std::vector<Fill1D> fills1D;
+    std::vector<Fill2D> fills2D;
+    std::vector<MapFill> mapFills;
+    std::vector<CellFill> cellFills;
+    std::vector<GraphPoint> graphPoints;
+    std::map<std::string, Material> sumComponentsRI;
+    double eta = 0;
+  };
+
+
+  /**
+   * @struct MaterialCrossing
+   * @brief An element crossed by a material track: its lengths entered the histograms of a group, scaled by the factor
+   */
+  struct MaterialCrossing {
+    enum Group { unassigned, activeBarrel, activeEndcap, servicesBarrel, servicesEndcap, supportsBarrel, supportsEndcap,
+                 supportsTube, supportsBarrelTube, supportsUserDefined, extraServices, extraSupports };
+    MaterialProperties* element;
+    double factor;
+    Group group;
+  };
+
+  /**
+   * @struct MaterialTrackCrossings
+   * @brief The elements crossed by one material track, in the order they were found
+   */
+  struct MaterialTrackCrossings {
+    double eta = 0;
+    std::vector<MaterialCrossing> crossings;
+  };
 
   class Analyzer {
   public:
@@ -139,7 +194,10 @@ namespace insur {
     TH1D& getSpacingTuningFrame() { return spacingTuningFrame; }
     const double& getTriggerRangeLowLimit(const std::string& typeName ) { return triggerRangeLowLimit[typeName] ; }
     const double& getTriggerRangeHighLimit(const std::string& typeName ) { return triggerRangeHighLimit[typeName] ; }
-    /*virtual*/ void analyzeMaterialBudget(MaterialBudget& mb, const std::vector<double>& momenta, int etaSteps = 50, MaterialBudget* pm = NULL);
+    /*virtual*/ bool analyzeMaterialBudget(MaterialBudget& mb, const std::vector<double>& momenta, int etaSteps = 50, MaterialBudget* pm = NULL, bool materialMaps = true);
+    void writeMaterialScan(TDirectory& dir);
+    void writeGeometryResults(TDirectory& dir) const;
+    bool mergeMaterialBudget(const std::vector<TDirectory*>& shards, int etaSteps, bool materialMaps);
     void computeTriggerProcessorsBandwidth(Tracker& tracker);
     void analyzeTaggedTracking(MaterialBudget& mb,
                                const std::vector<double>& momenta,
@@ -147,6 +205,7 @@ namespace insur {
                                const std::vector<double>& thresholdProbabilities,
                                int etaSteps = 50,
                                MaterialBudget* pm = NULL);
+    void analyzeFastResolution(MaterialBudget& mb, const std::vector<double>& momenta, int etaSteps = 50, MaterialBudget* pm = NULL);
     virtual void analyzeTriggerEfficiency(Tracker& tracker,
                                           const std::vector<double>& triggerMomenta,
                                           const std::vector<double>& thresholdProbabilities,
@@ -155,11 +214,14 @@ namespace insur {
     void analyzeGeometry(Tracker& tracker, int nTracks = 1000);
     void computeBandwidth(Tracker& tracker);
     void computeTriggerFrequency(Tracker& tracker);
+    void computeBandwidthAndTriggerFrequency(Tracker& tracker);
     void computeIrradiatedPowerConsumption(Tracker& tracker);
+    void computeIrradiatedPowerScan(Tracker& tracker, const std::map<std::string, std::vector<double> >& scan);
+    void computePileupScan(Tracker& tracker, const std::vector<double>& pileups);
+    void computeReadoutWhatIf(Tracker& tracker, const std::vector<ReadoutWhatIf::Variant>& variants);
     void analyzePower(Tracker& tracker);
     void createGeometryLite(Tracker& tracker);
     TH2D& getMapPhiEta() { return mapPhiEta; }
-    TCanvas& getEtaProfileCanvas() {return etaProfileCanvas; }
     TH1D& getHitDistribution() {return hitDistribution; }
     TProfile& getTotalEtaProfile() {return totalEtaProfile; }
     TProfile& getTotalEtaProfileSensors() {return totalEtaProfileSensors; }
@@ -171,7 +233,6 @@ namespace insur {
     std::map<std::string, TProfile>& getLayerEtaCoverageProfiles() {return layerEtaCoverageProfile;}
     std::map<std::string, TProfile>& getLayerEtaCoverageProfilesStubs() {return layerEtaCoverageProfileStubs; }
     std::map<std::string, std::map<std::string, TH1I*>>& getStubEfficiencyCoverageProfiles() { return stubEfficiencyCoverageProfiles_; } // map of maps: inner map has momenta as keys
-    std::vector<TObject> getSavingVector();
     TCanvas* getGeomLite() {if (geomLiteCreated) return geomLite; else return NULL; };
     TCanvas* getGeomLiteXY() {if (geomLiteXYCreated) return geomLiteXY; else return NULL; };
     TCanvas* getGeomLiteYZ() {if (geomLiteYZCreated) return geomLiteYZ; else return NULL; };
@@ -182,6 +243,7 @@ namespace insur {
     TH1I& getModuleConnectionsDistribution() { return moduleConnectionsDistribution; }
     const ModuleConnectionMap& getModuleConnectionMap() const { return moduleConnections_; }
     int getGeometryTracksUsed() {return geometryTracksUsed; }
+    double getGeometryTrackPrecision() const { return geometryTrackWorstError_; }
     int getMaterialTracksUsed() {return materialTracksUsed; }
     // Hadrons
     TGraph& getHadronTotalHitsGraph() {return hadronTotalHitsGraph;};
@@ -200,6 +262,53 @@ namespace insur {
     static const double OneHitRequired;
 
     void computeWeightSummary(MaterialBudget& mb);
+    void buildModuleHitIndex(MaterialBudget& mb, MaterialBudget* pm = NULL);
+    void buildInactiveHitIndex(MaterialBudget& mb, MaterialBudget* pm = NULL);
+    void shareHitIndices(const Analyzer& other) {
+      moduleHitLookup_ = other.moduleHitLookup_;
+      inactiveHitIndices_ = other.inactiveHitIndices_;
+      moduleHitReplicas_ = other.moduleHitReplicas_;
+      inactiveHitReplicas_ = other.inactiveHitReplicas_;
+    }
+    void useModuleHitIndex(bool use) { useModuleHitIndex_ = use; }
+    bool useModuleHitIndex() const { return useModuleHitIndex_; }
+    void singlePrecisionHits(bool use) {
+      singlePrecisionHits_ = use;
+      geometryTables_.hitPolys.useSinglePrecision(use);
+      if (!geometryReplicas_.empty()) geometryReplicas_.replicate(geometryTables_);
+      if (moduleHitLookup_) for (auto& layer : moduleHitLookup_->layerPolys) layer.second.polys.useSinglePrecision(use);
+      replicateHitIndices();
+    }
+    void numThreads(int n) { numThreads_ = MAX(1, n); }
+    int numThreads() const { return numThreads_; }
+    void randomSeed(unsigned int seed) { randomSeed_ = seed ? seed : TRandom3(0).Integer(kMaxUInt); }
+    void materialTrackShard(int shard, int shards) { materialTrackShard_ = shard; materialTrackShards_ = MAX(1, shards); }
+    void materialCheckpoint(const std::string& fileName, const std::string& key, double seconds, bool resume) {
+      materialCheckpointFile_ = fileName; materialCheckpointKey_ = key; materialCheckpointSeconds_ = seconds; resumeMaterialScan_ = resume;
+    }
+    void geometryTrackEtaRange(double minEta, double maxEta) { geometryTrackMinEta_ = minEta; geometryTrackMaxEta_ = maxEta; }
+    void geometryTrackPhiRange(double minPhi, double maxPhi) { geometryTrackMinPhi_ = minPhi; geometryTrackMaxPhi_ = maxPhi; }
+    void stratifyGeometryTrackEta(bool stratify) { stratifyGeometryTrackEta_ = stratify; }
+    void geometryTrackPrecision(double precision) { geometryTrackPrecision_ = precision; }
+    void geometryTrackSeconds(double seconds) { geometryTrackSeconds_ = MAX(0., seconds); }
+    void geometryTrackPt(double pt) { geometryTrackPt_ = MAX(0., pt); }
+    void quasiRandomTracks(bool quasiRandom) { quasiRandomTracks_ = quasiRandom; }
+    void recordMaterialCrossings(bool record) { recordMaterialCrossings_ = record; }
+    void shareMaterialTracks(bool share) { shareMaterialTracks_ = share; }
+    void trackHitCache(const std::string& fileName, const std::string& key, bool reuse) {
+      trackHitCacheFile_ = fileName; trackHitCacheKey_ = key; reuseTrackHitCache_ = reuse;
+    }
+    bool trackHitCacheMatches(MaterialBudget& mb, MaterialBudget* pm, int nTracks);
+    void recordTrackSamples(bool record) { recordTrackSamples_ = record; }
+    void writeTrackSamples(TDirectory& dir) const;
+    void writeTrackRecords(TrackRecordWriter* writer) { trackRecords_ = writer; }
+    void usePhiSymmetry(bool use) { usePhiSymmetry_ = use; }
+    void resolutionGraphBins(int bins) { resolutionGraphBins_ = bins; }
+    void geometryIndexGranularity(int zSlices, double granularity) { geometryIndexSlices_ = MAX(1, zSlices); geometryIndexGranularity_ = granularity; }
+    bool reweightMaterialBudget(const std::map<std::string, std::pair<double, double> >& materialLengths,
+                                const std::map<std::string, double>& componentScales);
+    int moduleHits(const Module* m) const;
+    const ModuleFluence* moduleFluence(const DetectorModule* m) const;
     std::map<std::string, SummaryTable>& getBarrelWeightSummary() { return barrelWeights;};
     std::map<std::string, SummaryTable>& getEndcapWeightSummary() { return endcapWeights;};
     std::map<std::string, SummaryTable>& getBarrelWeightComponentSummary() { return barrelComponentWeights;};
@@ -216,6 +325,10 @@ namespace insur {
     std::map<std::string, SummaryTable>& getTriggerPuritySummaries() { return triggerPuritySummaries_; }
     std::map<std::string, SummaryTable>& getTriggerDataBandwidthSummaries() { return triggerDataBandwidthSummaries_; }
     std::map<std::string, SummaryTable>& getIrradiatedPowerConsumptionSummaries() { return irradiatedPowerConsumptionSummaries_; }
+    std::vector<std::pair<PowerOperatingPoint, MultiSummaryTable> >& getIrradiatedPowerScanSummaries() { return irradiatedPowerScanSummaries_; }
+    std::vector<PileupScanPoint>& getPileupScanPoints() { return pileupScanPoints_; }
+    SummaryTable& getPileupScanBandwidthSummary() { return pileupScanBandwidthSummary_; }
+    SummaryTable& getReadoutWhatIfSummary() { return readoutWhatIfSummary_; }
     
     double getTriggerPetalCrossoverR() const { return triggerPetalCrossoverR_; }
     const std::pair<Circle, Circle>& getSampleTriggerPetal() const { return sampleTriggerPetal_; }
@@ -246,7 +359,7 @@ namespace insur {
 
     void simParms(SimParms* sp) { simParms_ = sp; }
     const SimParms& simParms() const { return *simParms_; }
-    const std::string & getBillOfMaterials() { return billOfMaterials_ ; }
+    void writeBillOfMaterials(std::ostream& output) const;
   protected:
     /**
      * @struct Cell
@@ -260,6 +373,7 @@ namespace insur {
      */
     struct Cell { double rlength; double ilength; double rmin; double rmax; double etamin; double etamax; };
     std::vector<std::vector<Cell> > cells;
+    double cellMinR_, cellStepR_, cellMinEta_, cellStepEta_; // the grid of the cells, as given to setCellBoundaries()
     TH1D ractivebarrel, ractiveendcap, rserfbarrel, rserfendcap, rlazybarrel, rlazyendcap, rlazybtube, rlazytube, rlazyuserdef;
     TH1D iactivebarrel, iactiveendcap, iserfbarrel, iserfendcap, ilazybarrel, ilazyendcap, ilazybtube, ilazytube, ilazyuserdef;
     TH1D rbarrelall, rendcapall, ractiveall, rserfall, rlazyall;
@@ -271,11 +385,9 @@ namespace insur {
     std::map<std::string, TH1D*> rComponents, iComponents;
 
     TH2D isor, isoi;
-    TH2D mapRadiation, mapInteraction;
-    TH2I mapRadiationCount, mapInteractionCount;
+    MaterialMapTree mapRadiation, mapInteraction;
     TH2D mapRadiationCalib, mapInteractionCalib;
     TH2D mapPhiEta;
-    TCanvas etaProfileCanvas;
     TCanvas* geomLite; bool geomLiteCreated;
     TCanvas* geomLiteXY; bool geomLiteXYCreated;
     TCanvas* geomLiteYZ; bool geomLiteYZCreated;
@@ -301,6 +413,12 @@ namespace insur {
     std::map<std::string, SummaryTable> triggerRateSummaries_, triggerEfficiencySummaries_, triggerPuritySummaries_;
     std::map<std::string, SummaryTable> triggerDataBandwidthSummaries_;
     std::map<std::string, SummaryTable> irradiatedPowerConsumptionSummaries_;
+    std::vector<std::pair<PowerOperatingPoint, MultiSummaryTable> > irradiatedPowerScanSummaries_;
+    std::vector<PileupScanPoint> pileupScanPoints_;
+    SummaryTable pileupScanBandwidthSummary_;
+    SummaryTable readoutWhatIfSummary_; // one row per variant
+    // The stub frequencies of the classes of identical modules, kept across the trigger visits and the readout variants
+    StubFrequencyCache stubFrequencies_;
 
     std::map<std::string, SummaryTable> stripOccupancySummaries_;
     std::map<std::string, SummaryTable> hitOccupancySummaries_;
@@ -347,24 +465,26 @@ namespace insur {
 
     std::map<std::string, std::map<std::string, TH1I*>> stubEfficiencyCoverageProfiles_;
 
-    std::vector<TObject> savingGeometryV; // Vector of ROOT objects to be saved
-    std::vector<TObject> savingMaterialV; // Vector of ROOT objects to be saved
 
     Material findAllHits(MaterialBudget& mb, MaterialBudget* pm, 
                          double& eta, double& theta, double& phi, Track& track);
 
 
-    void computeDetailedWeights(std::vector<std::vector<ModuleCap> >& tracker, std::map<std::string, SummaryTable>& weightTables, bool byMaterial);
-    virtual Material analyzeModules(std::vector<std::vector<ModuleCap> >& tr, double eta, double theta, double phi, Track& t, 
+    void computeDetailedWeights(std::vector<ModuleCaps>& tracker, std::map<std::string, SummaryTable>& weightTables, bool byMaterial);
+    virtual Material analyzeModules(std::vector<ModuleCaps>& tr, double eta, double theta, double phi, Track& t, 
                                     std::map<std::string, Material>& sumComponentsRI, bool isPixel = false);
 
     int findHitsModules(Tracker& tracker, double z0, double eta, double theta, double phi, Track& t);
 
-    virtual Material findHitsModules(std::vector<std::vector<ModuleCap> >& tr,
+    virtual Material findHitsModules(std::vector<ModuleCaps>& tr,
                                      double eta, double theta, double phi, Track& t, bool isPixel = false);
-    virtual Material findHitsModuleLayer(std::vector<ModuleCap>& layer, double eta, double theta, double phi, Track& t, bool isPixel = false);
+    virtual Material findHitsModuleLayer(ModuleCaps& layer, double eta, double theta, double phi, Track& t, bool isPixel = false);
 
-    virtual Material findModuleLayerRI(std::vector<ModuleCap>& layer, double eta, double theta, double phi, Track& t, 
+    const std::vector<int>* moduleHitCandidates(const ModuleCaps& layer, const XYZVector& direction) const;
+    void findLayerModuleHits(ModuleCaps& layer, const XYZVector& direction, std::vector<std::pair<ModuleCap*, std::pair<XYZVector, HitType> > >& hits) const;
+    const InactiveHitIndex* inactiveHitIndex(const std::vector<InactiveElement>& elements,
+                                             MaterialProperties::Category cat = MaterialProperties::no_cat) const;
+    virtual Material findModuleLayerRI(ModuleCaps& layer, double eta, double theta, double phi, Track& t, 
                                        std::map<std::string, Material>& sumComponentsRI, bool isPixel = false);
     virtual Material analyzeInactiveSurfaces(std::vector<InactiveElement>& elements, double eta, double theta, 
                                              Track& t, MaterialProperties::Category cat = MaterialProperties::no_cat, bool isPixel = false);
@@ -376,6 +496,7 @@ namespace insur {
                          const TrackCollection& aTrackCollection,
                          int graphAttributes,
                          const string& graphTag);
+    void calculateTaggedGraphs(std::map<std::string, TrackCollectionMap>& taggedTrackCollectionMap, int graphAttributes);
     void fillTriggerEfficiencyGraphs(const Tracker& tracker,
                                      const std::vector<double>& triggerMomenta,
                                      const std::vector<Track>& trackVector);
@@ -390,20 +511,150 @@ namespace insur {
     void setHistogramBinsBoundaries(int bins, double min, double max);
     void setCellBoundaries(int bins, double minr, double maxr, double minz, double maxz);
     void fillCell(double r, double eta, double theta, Material mat);
+    void fillHisto(TH1& histo, double x, double w);
+    void fillHisto(TH2& histo, double x, double y);
+    void fillHisto(TH2& histo, double x, double y, double w);
+    void addGraphPoint(TGraph& graph, double x, double y);
+    void fillMap(MaterialMapTree& map, double x, double y, double w);
     void fillMapRT(const double& r, const double& theta, const Material& mat);
     void fillMapRZ(const double& r, const double& z, const Material& mat);
     void transformEtaToZ();
     double findXThreshold(const TProfile& aProfile, const double& yThreshold, const bool& goForward );
     std::pair<double, double> computeMinMaxTracksEta(const Tracker& t) const;
   private:
-    // A random number generator
-    TRandom3 myDice; 
+    // The lookups of the modules and inactive elements crossed by the material tracks, built once over the outer tracker
+    // and the pixels together: they are keyed by layer and collection, so the analyzer of the pixels alone shares them
+    struct LayerHitPolys {
+      HitPolySnapshot polys;
+      std::vector<int> firstPoly; // the polygon of the inner sensor of each module of the layer, the outer one following it; -1 on the negative z side
+    };
+    struct ModuleHitLookup {
+      ModuleHitIndexMap indices; // the (eta, phi) lookup of the modules of each layer
+      std::map<const ModuleCaps*, LayerHitPolys> layerPolys; // the sensors of each layer, tested against a track all at once
+    };
+    std::shared_ptr<ModuleHitLookup> moduleHitLookup_;
+    // The eta lookup of the inactive elements crossed by the material tracks
+    std::shared_ptr<InactiveHitIndexMap> inactiveHitIndices_;
+    // Their copies on each NUMA node, the pointers to the layers and collections being the same in all of them
+    NodeReplicas<ModuleHitLookup> moduleHitReplicas_;
+    NodeReplicas<InactiveHitIndexMap> inactiveHitReplicas_;
+    void replicateHitIndices();
+    bool useModuleHitIndex_;
+    // Whether the sensor snapshots first test the tracks in single precision
+    bool singlePrecisionHits_;
+    // Whether the (z, r) material maps and isolines are binned and filled by the material budget scan
+    bool fillMaterialMaps_;
+    // The bins of the (z, r) material maps, a quarter of which is the finest cell of the trees they are flattened from,
+    // the cells of the trees kept below the bound, and the relative difference of the cells merged when flattening
+    static constexpr double materialMapBinWidth = 5.; // half a cm
+    static constexpr double materialMapCellsPerBin = 4.;
+    static constexpr size_t materialMapMaxCells = 1 << 19;
+    static constexpr double materialMapTolerance = 0.05;
+    // The number of threads the track scans are split across
+    int numThreads_;
+    // The first chunk of each track scan, then resized for a chunk to last about trackChunkSeconds, up to
+    // maxTrackChunkGrowth times the first one (the fills of a chunk are held until its tracks are done)
+    static constexpr int materialTracksPerThreadChunk = 256;
+    static constexpr int geometryTracksPerThreadChunk = 4096;
+    static constexpr int resolutionTracksPerThreadChunk = 32;
+    static constexpr int maxTrackChunkGrowth = 4;
+    static constexpr double trackChunkSeconds = 0.25;
+    // The seed the counter-based random streams of the tracks of every scan are keyed by (see CounterRandom)
+    unsigned int randomSeed_;
+    // The slice of the material tracks the scan is restricted to, as the shard (from 0) out of a number of them
+    int materialTrackShard_, materialTrackShards_;
+    // The file the material budget scan is checkpointed to (none if empty), what identifies the scan in it, the time
+    // between two checkpoints, and whether the scan resumes from the checkpoint of an interrupted run
+    std::string materialCheckpointFile_, materialCheckpointKey_;
+    double materialCheckpointSeconds_;
+    bool resumeMaterialScan_;
+    bool readMaterialCheckpoint(int firstTrack, int lastTrack, int& nextTrack);
+    bool writeMaterialCheckpoint(int firstTrack, int lastTrack, int nextTrack);
+    // The region the geometry tracks are shot in, within the eta range of the tracker, and whether each track of a row
+    // is shot in its own eta stratum, so that every stratum gets exactly one track per row
+    double geometryTrackMinEta_, geometryTrackMaxEta_;
+    double geometryTrackMinPhi_, geometryTrackMaxPhi_;
+    bool stratifyGeometryTrackEta_;
+    // The relative precision of every bin of the coverage profile at which no more geometry tracks are shot; 0 to shoot them all
+    double geometryTrackPrecision_;
+    // The wall time the geometry tracks are shot for, row after row, whatever their number; 0 for no time budget
+    double geometryTrackSeconds_;
+    // The relative error of the least precise bin of the coverage profile of the last geometry scan
+    double geometryTrackWorstError_;
+    // The transverse momentum of the geometry tracks, which then follow their helix (with alternating charges); 0 for straight tracks
+    double geometryTrackPt_;
+    // Whether the track directions (and the z of the geometry tracks) are taken from a Halton sequence instead of random streams
+    bool quasiRandomTracks_;
+    // Whether the material budget scan keeps the elements crossed by each track, so that the budget can be reweighted afterwards
+    bool recordMaterialCrossings_;
+    std::vector<MaterialTrackCrossings> materialCrossings_;
+    // Whether the material budget scan keeps its tracks, whose hits the resolution and trigger scans then take instead of
+    // looking for the hits of tracks of their own
+    bool shareMaterialTracks_;
+    std::vector<Track> materialTracks_;
+    bool sharedMaterialTracks(int nTracks) const;
+    // The file the hits of the resolution tracks are cached in (none if empty), what identifies the tracks in it, and
+    // whether the resolution scan takes its tracks from it, when it matches, instead of looking for their hits
+    std::string trackHitCacheFile_, trackHitCacheKey_;
+    bool reuseTrackHitCache_;
+    static TrackHitCache::ModuleTables trackHitCacheModules(MaterialBudget& mb, MaterialBudget* pm);
+    // Whether the geometry and material scans keep what each of their tracks found, in track order, for the comparison
+    // of layouts shooting the same tracks (see LayoutComparison); the geometry tracks are then shot over their eta
+    // region as it is given, rather than within the eta range of the tracker, for the tracks to be the same
+    bool recordTrackSamples_;
+    struct TrackSample { double eta, first, second; };
+    std::vector<TrackSample> geometrySamples_; // the hit modules and the stubs of each geometry track
+    std::vector<TrackSample> materialSamples_; // the radiation and interaction lengths of each material track
+    // The writer of a record per track of the material and resolution scans, if any, and the records of the chunk of
+    // material tracks being analysed, from its first track on, which the threads fill and the writer is given in turn
+    TrackRecordWriter* trackRecords_;
+    TrackRecordWriter::Batch materialRecords_;
+    int firstMaterialRecord_;
+    // Whether the material tracks are shot within the phi period of the modules only
+    bool usePhiSymmetry_;
+    // The number of eta bins the points of the resolution graphs are averaged in; 0 to keep a point per track
+    int resolutionGraphBins_;
+    double materialPhiPeriod(MaterialBudget& mb, MaterialBudget* pm);
+    // What the material budget scan fills track by track, to be written and merged with the scans of other tracks
+    AccumulatorSet materialScan_;
+    // The number of geometry tracks hitting each module, by module index, counted outside of the (concurrent) hit tests
+    std::vector<int> moduleHitCounts_;
+    // The read-only tables of the geometry analysis, copied to each NUMA node when the threads are pinned to them
+    struct GeometryTables {
+      HitPolySnapshot hitPolys; // the sensor hit polygons of the modules, two per module
+      std::vector<std::pair<double, double> > etaRanges;
+      FrozenModuleIndex moduleIndex; // the candidates of trackHit()
+    };
+    GeometryTables geometryTables_;
+    NodeReplicas<GeometryTables> geometryReplicas_;
+    int geometryIndexSlices_; // the number of z0 slices of the module index
+    double geometryIndexGranularity_; // its number of (eta, phi) bins per slice, relative to the number of modules
+    // The geometric part of the irradiated power of the modules, valid as long as the geometry epoch does not change
+    ModuleFluenceCache moduleFluences_;
+    unsigned int moduleFluencesEpoch_;
+    ModuleFluenceCache& moduleFluences();
+    void parallelFor(const std::string& stage, int first, int last, const std::function<void(int)>& task);
+    void storeTriggerFrequency(const TriggerFrequencyVisitor& v);
+    void analyzeMaterialTrack(MaterialBudget& mb, MaterialBudget* pm, int trackIndex, double eta, double phi, int nTracks);
+    void fillComponentsRI(const std::map<std::string, Material>& sumComponentsRI, double eta, int nTracks);
+    void createServicesSupportsHistos(int nTracks);
+    void prepareMaterialScan(int etaSteps, bool materialMaps);
+    void replayMaterialTrackRecord(const MaterialTrackRecord& record, int nTracks);
+    void recordMaterialCrossing(MaterialProperties& element, double factor, MaterialCrossing::Group group = MaterialCrossing::unassigned);
+    void assignMaterialCrossings(MaterialCrossing::Group group);
+    std::vector<TH1*> materialGroupHistos(MaterialCrossing::Group group, bool radiation);
+    void primeModuleCaches(std::vector<ModuleCaps>& layers);
     int findCellIndexR(double r);
     int findCellIndexEta(double eta);
+    static int cellIndexGuess(double x, double min, double step, int n);
     int createResetCounters(Tracker& tracker, std::map <std::string, int> &modTypes);
-    std::pair <XYZVector, double > shootDirection(double minEta, double maxEta);
-    std::vector<std::pair<Module*, HitType>> trackHit(const XYZVector& origin, const XYZVector& direction, Tracker::Modules& properModules);
-    void resetTypeCounter(std::map<std::string, int> &modTypes);
+    static double radicalInverse(unsigned int index, unsigned int base);
+    std::pair <XYZVector, double > shootDirection(double minEta, double spanEta, double uPhi, double uEta, double minPhi = 0, double spanPhi = 2*M_PI,
+                                                  int etaStratum = 0, int numEtaStrata = 1);
+    static double worstRelativeError(const TProfile& profile);
+    std::vector<std::pair<Module*, HitType>> trackHit(const XYZVector& origin, const XYZVector& direction, const Tracker::FrozenModules& moduleV, int* numCandidates = NULL);
+    std::vector<std::pair<Module*, HitType>> trackHelixHit(const HelixPropagator& helix, double maxRho, double maxZ, const XYZVector& origin,
+                                                           const Tracker::FrozenModules& moduleV, int* numCandidates = NULL);
     double diffclock(clock_t clock1, clock_t clock2);
     Color_t colorPicker(std::string);
     std::map<std::string, Color_t> colorPickMap;
@@ -431,7 +682,7 @@ namespace insur {
     static int bsCounter;
     
     SimParms* simParms_;
-    std::string billOfMaterials_;
+    std::shared_ptr<MaterialBillAnalyzer> billOfMaterials_; // the last one inspected, written when the site is
   };
 }
 #endif  /* _ANALYZER_H */
@@ -34,6 +34,8 @@
 #include "AnalyzerVisitors/Bandwidth.h"
 #include "AnalyzerVisitors/TriggerDistanceTuningPlots.h"
 #include "AnalyzerVisitors/TriggerFrequency.h"
+#include "AnalyzerVisitors/PileupScan.h"
+#include "AnalyzerVisitors/ReadoutWhatIf.h"
 
 using std::string;
 using std::map;
@@ -52,56 +54,72 @@ namespace AnalyzerHelpers {
 
 
 
-class TriggerEfficiencyMapVisitor : public ConstGeometryVisitor {
-  double myPt_;
-  TH2D& myMap_;
-  TH2D* counter_;
-public:
-  TriggerEfficiencyMapVisitor(TH2D& map, double pt) : myMap_(map), myPt_(pt) { counter_ = (TH2D*)map.Clone(); }
-
-  void visit(const DetectorModule& aModule) {
-    // CUIDADO needs to return immediately if module is not pt enabled!!!!
-    double myValue = PtErrorAdapter(aModule).getTriggerProbability(myPt_);
-    if (myValue>=0) AnalyzerHelpers::drawModuleOnMap(aModule, myValue, myMap_, *counter_);
+/**
+ * Fills the trigger efficiency maps (one per pt) and the pt threshold maps (one per efficiency) in a single pass over the
+ * modules. The values of a module only depend on its parameters: they are computed once per class of identical modules
+ * and looked up for all the other modules of the class.
+ */
+class TriggerPerformanceMapVisitor : public ConstGeometryVisitor {
+  struct MapEntry {
+    double key; // the pt of an efficiency map, the efficiency of a threshold map
+    TH2D* map;
+    TH2D* counter;
+  };
+  struct ModuleValues {
+    std::vector<double> efficiencies, thresholds; // in the order of the maps
+  };
+  std::vector<MapEntry> efficiencyMaps_, thresholdMaps_;
+  std::map<PtErrorAdapter::ModuleParameters, ModuleValues> moduleValues_;
+
+  static void addMaps(std::map<double, TH2D>& maps, std::vector<MapEntry>& entries) {
+    for (auto& keyMap : maps) {
+      keyMap.second.Reset();
+      entries.push_back(MapEntry{keyMap.first, &keyMap.second, (TH2D*)keyMap.second.Clone()});
+    }
   }
 
-  void postVisit() {
-    for (int i=1; i<=myMap_.GetNbinsX(); ++i)
-      for (int j=1; j<=myMap_.GetNbinsY(); ++j)
-        if (counter_->GetBinContent(i,j)!=0)
-          myMap_.SetBinContent(i,j, myMap_.GetBinContent(i,j) / counter_->GetBinContent(i,j));
-    // ... and get rid of the counter
+  static void normalize(std::vector<MapEntry>& entries) {
+    for (MapEntry& entry : entries) {
+      for (int i=1; i<=entry.map->GetNbinsX(); ++i)
+        for (int j=1; j<=entry.map->GetNbinsY(); ++j)
+          if (entry.counter->GetBinContent(i,j)!=0)
+            entry.map->SetBinContent(i,j, entry.map->GetBinContent(i,j) / entry.counter->GetBinContent(i,j));
+    }
   }
-
-  ~TriggerEfficiencyMapVisitor() { delete counter_; }
-};
-
-
-
-
-
-class PtThresholdMapVisitor : public ConstGeometryVisitor {
-  double myPt_;
-  TH2D& myMap_;
-  TH2D* counter_;
 public:
-  PtThresholdMapVisitor(TH2D& map, double pt) : myMap_(map), myPt_(pt) { counter_ = (TH2D*)map.Clone(); }
+  TriggerPerformanceMapVisitor(std::map<double, TH2D>& efficiencyMaps, std::map<double, TH2D>& thresholdMaps) {
+    addMaps(efficiencyMaps, efficiencyMaps_);
+    addMaps(thresholdMaps, thresholdMaps_);
+  }
 
   void visit(const DetectorModule& aModule) {
+    // CUIDADO needs to return immediately if module is not pt enabled!!!!
+    PtErrorAdapter pterr(aModule);
+    ModuleValues& values = moduleValues_[pterr.moduleParameters()];
+    if (values.efficiencies.empty()) {
+      for (const MapEntry& entry : efficiencyMaps_) values.efficiencies.push_back(pterr.getTriggerProbability(entry.key));
+    }
+    for (unsigned int i=0; i<efficiencyMaps_.size(); ++i) {
+      if (values.efficiencies[i]>=0) AnalyzerHelpers::drawModuleOnMap(aModule, values.efficiencies[i], *efficiencyMaps_[i].map, *efficiencyMaps_[i].counter);
+    }
     if (aModule.sensorLayout() != PT) return;
-    double myValue = PtErrorAdapter(aModule).getPtThreshold(myPt_);
-    if (myValue >= 0) AnalyzerHelpers::drawModuleOnMap(aModule, myValue, myMap_, *counter_);
+    if (values.thresholds.empty()) {
+      for (const MapEntry& entry : thresholdMaps_) values.thresholds.push_back(pterr.getPtThreshold(entry.key));
+    }
+    for (unsigned int i=0; i<thresholdMaps_.size(); ++i) {
+      if (values.thresholds[i]>=0) AnalyzerHelpers::drawModuleOnMap(aModule, values.thresholds[i], *thresholdMaps_[i].map, *thresholdMaps_[i].counter);
+    }
   }
 
   void postVisit() {
-    for (int i=1; i<=myMap_.GetNbinsX(); ++i)
-      for (int j=1; j<=myMap_.GetNbinsY(); ++j)
-        if (counter_->GetBinContent(i,j)!=0)
-          myMap_.SetBinContent(i,j, myMap_.GetBinContent(i,j) / counter_->GetBinContent(i,j));
-    // ... and get rid of the counter
+    normalize(efficiencyMaps_);
+    normalize(thresholdMaps_);
   }
 
-  ~PtThresholdMapVisitor() { delete counter_; }
+  ~TriggerPerformanceMapVisitor() {
+    for (MapEntry& entry : efficiencyMaps_) delete entry.counter;
+    for (MapEntry& entry : thresholdMaps_) delete entry.counter;
+  }
 };
 
 
@@ -14,18 +14,55 @@
 #include "Visitor.h"
 #include "SummaryTable.h"
 
-class BandwidthVisitor : public ConstGeometryVisitor {
+class BandwidthVisitor : public ForkableConstGeometryVisitor {
   TH1D &chanHitDistribution_, &bandwidthDistribution_, &bandwidthDistributionSparsified_;
 
   double nMB_;
+  int numSensors_;
+  double bandwidthSum_, sparsifiedBandwidthSum_; // the sums of the values filled, which the histograms only bin
+  bool ownsHistograms_; // the forks fill their own empty copies of the distributions, which are added up on merge
 public:
+  using ForkableConstGeometryVisitor::visit; // for Tracker::acceptModules()
+
   BandwidthVisitor(TH1D& chanHitDistribution, TH1D& bandwidthDistribution, TH1D& bandwidthDistributionSparsified) :
       chanHitDistribution_(chanHitDistribution),
       bandwidthDistribution_(bandwidthDistribution),
-      bandwidthDistributionSparsified_(bandwidthDistributionSparsified)
+      bandwidthDistributionSparsified_(bandwidthDistributionSparsified),
+      numSensors_(0), bandwidthSum_(0), sparsifiedBandwidthSum_(0),
+      ownsHistograms_(false)
   {}
 
+  ~BandwidthVisitor() {
+    if (ownsHistograms_) {
+      delete &chanHitDistribution_;
+      delete &bandwidthDistribution_;
+      delete &bandwidthDistributionSparsified_;
+    }
+  }
+
+  ForkableConstGeometryVisitor* fork() const {
+    BandwidthVisitor* forked = new BandwidthVisitor(*new TH1D(chanHitDistribution_), *new TH1D(bandwidthDistribution_), *new TH1D(bandwidthDistributionSparsified_));
+    forked->ownsHistograms_ = true;
+    forked->nMB_ = nMB_;
+    forked->chanHitDistribution_.Reset();
+    forked->bandwidthDistribution_.Reset();
+    forked->bandwidthDistributionSparsified_.Reset();
+    return forked;
+  }
+
+  void merge(ForkableConstGeometryVisitor& forked) {
+    BandwidthVisitor& other = static_cast<BandwidthVisitor&>(forked);
+    chanHitDistribution_.Add(&other.chanHitDistribution_);
+    bandwidthDistribution_.Add(&other.bandwidthDistribution_);
+    bandwidthDistributionSparsified_.Add(&other.bandwidthDistributionSparsified_);
+    numSensors_ += other.numSensors_;
+    bandwidthSum_ += other.bandwidthSum_;
+    sparsifiedBandwidthSum_ += other.sparsifiedBandwidthSum_;
+  }
+
   void preVisit() {
+    numSensors_ = 0;
+    bandwidthSum_ = sparsifiedBandwidthSum_ = 0;
     chanHitDistribution_.Reset();
     bandwidthDistribution_.Reset();
     bandwidthDistributionSparsified_.Reset();
@@ -52,15 +89,24 @@ public:
         int nChips = s.totalROCs();
 
         // Binary unsparsified (bps)
-        bandwidthDistribution_.Fill((16*nChips + s.numChannels())*100E3);
+        double bandwidth = (16*nChips + s.numChannels())*100E3;
+        bandwidthDistribution_.Fill(bandwidth);
 
         int spHdr = m.numSparsifiedHeaderBits();
         int spPay = m.numSparsifiedPayloadBits();      
 
-        bandwidthDistributionSparsified_.Fill(((spHdr*nChips)+(hitChannels*spPay))*100E3);
+        double sparsifiedBandwidth = ((spHdr*nChips)+(hitChannels*spPay))*100E3;
+        bandwidthDistributionSparsified_.Fill(sparsifiedBandwidth);
+        numSensors_++;
+        bandwidthSum_ += bandwidth;
+        sparsifiedBandwidthSum_ += sparsifiedBandwidth;
       }
     }
   }
+
+  // The average bandwidths of the strip sensors, in bps, including those out of the range of the histograms
+  double averageBandwidth() const { return numSensors_ ? bandwidthSum_ / numSensors_ : 0.; }
+  double averageSparsifiedBandwidth() const { return numSensors_ ? sparsifiedBandwidthSum_ / numSensors_ : 0.; }
 };
 
 
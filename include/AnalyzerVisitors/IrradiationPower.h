@@ -12,16 +12,85 @@
 #include "Visitor.h"
 #include "SummaryTable.h"
 
-class IrradiationPowerVisitor : public GeometryVisitor {
+/**
+ * The part of the irradiated power of a module which only depends on the geometry and on the irradiation maps: the worst
+ * irradiation (per fb^-1) over the center and the vertices of the module, and the volume of its sensors
+ */
+struct ModuleFluence {
+  double irradiation;
+  double volume;
+};
+
+typedef std::map<const DetectorModule*, ModuleFluence> ModuleFluenceCache;
+
+/**
+ * The operating conditions the irradiated power is computed for, in place of those of <i>SimParms</i>
+ */
+struct PowerOperatingPoint {
+  double timeIntegratedLumi;
+  double operatingTemp;
+  double chargeDepletionVoltage;
+};
+
+class IrradiationPowerVisitor : public ForkableGeometryVisitor {
+  ModuleFluenceCache& fluences_;
+  ModuleFluenceCache forkFluences_; // the fluences sampled by a fork, which only reads the shared cache until it is merged
+  bool forked_;
+  const PowerOperatingPoint* operatingPoint_;
   double numInvFemtobarns;
   double operatingTemp;
   double chargeDepletionVoltage;
   double alphaParam;
   double referenceTemp;
   const IrradiationMapsManager* irradiationMap_;
+
+  ModuleFluence sampleFluence(const DetectorModule& m) const {
+    double irrxy = 0;
+
+    //the center and the 4 vertices of the module in the (z, rho) plane
+    XYZVector centerVector = m.center();
+    const double pointsZ[] = { centerVector.Z(), m.minZ(), m.maxZ(), m.minZ(), m.maxZ() };
+    const double pointsRho[] = { centerVector.Rho(), m.minR(), m.minR(), m.maxR(), m.maxR() };
+    const size_t numPoints = sizeof(pointsZ) / sizeof(pointsZ[0]);
+    double irrPoints[numPoints];
+
+    //if (centerVector.Z() < 0) return;
+    double volume = 0.;
+    for (const auto& s : m.sensors()) volume += s.sensorThickness() * m.area() / 1000.0; // volume is in cm^3
+
+    //calculate irradiation in each vertex (and center) and take the worst
+    irradiationMap_->calculateIrradiationPower(pointsZ, pointsRho, irrPoints, numPoints);
+    for (size_t i = 0; i < numPoints; i++) {
+      if (irrPoints[i] > irrxy) irrxy = irrPoints[i];
+    }
+
+    return ModuleFluence{irrxy, volume};
+  }
 public:
+  using ForkableGeometryVisitor::visit; // for Tracker::acceptModules()
+
   MultiSummaryTable irradiatedPowerConsumptionSummaries;
 
+  /**
+   * @param fluences The fluences of the modules already visited, which are only sampled on the irradiation maps the first time
+   * @param operatingPoint If not <i>NULL</i>, the power is computed at this operating point and only filled in the summaries,
+   * the irradiation power of the modules being left as it is
+   */
+  IrradiationPowerVisitor(ModuleFluenceCache& fluences, const PowerOperatingPoint* operatingPoint = NULL) :
+    fluences_(fluences), forked_(false), operatingPoint_(operatingPoint) {}
+
+  ForkableGeometryVisitor* fork() const {
+    IrradiationPowerVisitor* forked = new IrradiationPowerVisitor(*this);
+    forked->forked_ = true;
+    return forked;
+  }
+
+  void merge(ForkableGeometryVisitor& forked) {
+    IrradiationPowerVisitor& other = static_cast<IrradiationPowerVisitor&>(forked);
+    fluences_.insert(other.forkFluences_.begin(), other.forkFluences_.end());
+    mergeSummaries(irradiatedPowerConsumptionSummaries, other.irradiatedPowerConsumptionSummaries);
+  }
+
   void preVisit() {
     irradiatedPowerConsumptionSummaries.clear();   
   }
@@ -33,6 +102,11 @@ public:
     alphaParam       = sp.alphaParm();
     referenceTemp    = sp.referenceTemp();
     irradiationMap_  = &sp.irradiationMapsManager();
+    if (operatingPoint_) {
+      numInvFemtobarns = operatingPoint_->timeIntegratedLumi;
+      operatingTemp    = operatingPoint_->operatingTemp;
+      chargeDepletionVoltage = operatingPoint_->chargeDepletionVoltage;
+    }
   }
 
   void visit(Barrel& b) {
@@ -50,46 +124,10 @@ public:
     // will visit also the modules with z<0, otherwise totals in the summaries will be wrong!
     // if (m.maxZ() < 0) return;
     // </Stefano Mersi>
-    double irrxy = 0;
-    double irrPoint = 0;
-    /*double irrPointCen = 0;
-    double irrPoint11 = 0;
-    double irrPoint12 = 0;
-    double irrPoint21 = 0;
-    double irrPoint22 = 0;*/
-
-    auto vertex11 = std::make_pair(m.minZ(), m.minR());
-    auto vertex12 = std::make_pair(m.maxZ(), m.minR());
-    auto vertex21 = std::make_pair(m.minZ(), m.maxR());
-    auto vertex22 = std::make_pair(m.maxZ(), m.maxR());
-    
-    XYZVector centerVector = m.center();
-    auto center = std::make_pair(centerVector.Z(), centerVector.Rho());
-
-    //if (centerVector.Z() < 0) return;
-    double volume = 0.;
-    for (const auto& s : m.sensors()) volume += s.sensorThickness() * m.area() / 1000.0; // volume is in cm^3
-
-    //calculate irradiation in each vertex (and center) and take the worst
-    irrPoint = irradiationMap_->calculateIrradiationPower(center);
-    //irrPointCen = irrPoint;
-    if(irrPoint > irrxy) irrxy = irrPoint;
-
-    irrPoint = irradiationMap_->calculateIrradiationPower(vertex11);
-    //irrPoint11 = irrPoint;
-    if(irrPoint > irrxy) irrxy = irrPoint;
-
-    irrPoint = irradiationMap_->calculateIrradiationPower(vertex12);
-    //irrPoint12 = irrPoint;
-    if(irrPoint > irrxy) irrxy = irrPoint;
-
-    irrPoint = irradiationMap_->calculateIrradiationPower(vertex21);
-    //irrPoint21 = irrPoint;
-    if(irrPoint > irrxy) irrxy = irrPoint;
-
-    irrPoint = irradiationMap_->calculateIrradiationPower(vertex22);
-    //irrPoint22 = irrPoint;
-    if(irrPoint > irrxy) irrxy = irrPoint;
+    auto cached = fluences_.find(&m);
+    if (cached == fluences_.end()) cached = (forked_ ? forkFluences_ : fluences_).insert(std::make_pair(&m, sampleFluence(m))).first;
+    double irrxy = cached->second.irradiation;
+    double volume = cached->second.volume;
 
     double fluence = irrxy * numInvFemtobarns; // fluence is in 1MeV-equiv-neutrons/cm^2
     //double fluence = irrxy * numInvFemtobarns * 1e15 * 80 * 1e-3; // fluence is in 1MeV-equiv-neutrons/cm^2
@@ -98,7 +136,7 @@ public:
     //cout << "mod irr: " << cntName << "," << module->getLayer() << "," << module->getRing() << ";  " << module->getThickness() << "," << center.Rho() << ";  " << volume << "," << fluence << "," << leakCurrentScaled << "," << irradiatedPowerConsumption << endl;
 
 //    modulePowerConsumptions_[&m] = irradiatedPowerConsumption; // CUIDADO CHECK WHERE IT IS NEEDED
-    m.irradiationPower(irradiatedPowerConsumption);
+    if (!operatingPoint_) m.irradiationPower(irradiatedPowerConsumption);
 
     TableRef tref = m.tableRef();
     irradiatedPowerConsumptionSummaries[tref.table].setCell(tref.row, tref.col, irradiatedPowerConsumption);
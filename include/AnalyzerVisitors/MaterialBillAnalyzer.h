@@ -4,6 +4,7 @@
 #include <string>
 #include <map>
 #include <vector>
+#include <ostream>
 
 #include "Tracker.h"
 #include "MaterialBudget.h"
@@ -14,10 +15,18 @@ namespace MaterialBillAnalyzerData {
   typedef std::map<std::string, double> MaterialMap;
   using namespace insur;
 
+  // The elements with the same position and the same masses are one entry, of their number
   class ServiceElement {
   public: 
     double zmin, zmax, rmin, rmax;
     MaterialMap materialMap;
+    bool operator<(const ServiceElement& other) const {
+      if (rmin != other.rmin) return rmin < other.rmin;
+      if (rmax != other.rmax) return rmax < other.rmax;
+      if (zmin != other.zmin) return zmin < other.zmin;
+      if (zmax != other.zmax) return zmax < other.zmax;
+      return materialMap < other.materialMap;
+    }
   };
 }
 
@@ -26,16 +35,17 @@ using namespace MaterialBillAnalyzerData;
 class MaterialBillAnalyzer {
  private:
   typedef std::map<std::string, MaterialMap> LayerMaterialMap;
-  typedef std::vector<ServiceElement> ServicesMaterialVector;
-  ServicesMaterialVector servicesMaterialVector_;
+  typedef std::map<ServiceElement, int> ServicesMaterialMap;
+  ServicesMaterialMap servicesMaterialMap_;
+  std::vector<ServicesMaterialMap::const_iterator> servicesOrder_; // the entries in the order of their first element
   LayerMaterialMap layerMaterialMap_;
   void inspectInactiveElements(const std::vector<InactiveElement>& inactiveElements);
-  void inspectModules(std::vector<std::vector<insur::ModuleCap> >& tracker);
+  void inspectModules(std::vector<insur::ModuleCaps>& tracker);
 
 
  public:
-  std::string outputTable;
   void inspectTracker(MaterialBudget&);
+  void write(std::ostream& output) const;
 
 };
 
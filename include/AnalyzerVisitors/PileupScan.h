@@ -0,0 +1,169 @@
+#ifndef PILEUPSCAN_H
+#define PILEUPSCAN_H
+
+#include <string>
+#include <map>
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+#include "PtErrorAdapter.h"
+#include "Tracker.h"
+#include "SimParms.h"
+
+#include "Visitor.h"
+#include "SummaryTable.h"
+
+/**
+ * The stub rates and the trigger data bandwidths at one pile-up (number of minimum bias events per bunch crossing)
+ */
+struct PileupScanPoint {
+  double numMinBiasEvents;
+  MultiSummaryTable triggerRateSummaries, triggerDataBandwidthSummaries;
+};
+
+/**
+ * @class PileupScanVisitor
+ * @brief Computes the bandwidth and trigger summaries of <i>BandwidthVisitor</i> and <i>TriggerFrequencyVisitor</i> for
+ * several pile-ups at once
+ *
+ * The pile-up only scales the per-event terms of the modules: the hit channels and the true and over-threshold stubs
+ * linearly, the combinatorial stubs quadratically. The terms of each module are computed once, for one minimum bias
+ * event, and the summaries of every pile-up are filled from them at the end of the visit.
+ */
+class PileupScanVisitor : public ForkableConstGeometryVisitor {
+  struct CellTerms { // the sums over the modules of a table cell, per minimum bias event
+    int modules;
+    double trueStubs, misfilteredStubs, combinatorialStubs; // the combinatorial stubs per squared event
+    int triggerDataHeaderBits, triggerDataPayloadBits;
+  };
+  struct SensorTerms { // the sparsified bandwidth of a strip sensor is headerBits + hitChannels * pile-up * payloadBits
+    double headerBits, hitChannels, payloadBits;
+  };
+  struct StubFrequencies { double trueStubs, misfilteredStubs; };
+
+  std::vector<double> pileups_;
+  double bunchSpacingNs_, interestingPt_;
+  std::map<std::string, std::map<std::pair<int, int>, CellTerms> > cells_;
+  std::vector<SensorTerms> sensors_;
+  std::map<PtErrorAdapter::ModuleParameters, StubFrequencies> stubFrequencies_;
+
+public:
+  using ForkableConstGeometryVisitor::visit; // for Tracker::acceptModules()
+
+  std::vector<PileupScanPoint> points;
+  SummaryTable bandwidthSummary; // one row per pile-up
+
+  PileupScanVisitor(const std::vector<double>& pileups) : pileups_(pileups), bunchSpacingNs_(0), interestingPt_(0) {}
+
+  ForkableConstGeometryVisitor* fork() const {
+    PileupScanVisitor* forked = new PileupScanVisitor(pileups_);
+    forked->bunchSpacingNs_ = bunchSpacingNs_;
+    forked->interestingPt_ = interestingPt_;
+    return forked;
+  }
+
+  void merge(ForkableConstGeometryVisitor& forked) {
+    PileupScanVisitor& other = static_cast<PileupScanVisitor&>(forked);
+    for (const auto& table : other.cells_) {
+      for (const auto& cell : table.second) {
+        CellTerms& terms = cells_[table.first].insert(std::make_pair(cell.first, CellTerms{0, 0., 0., 0., 0, 0})).first->second;
+        terms.modules += cell.second.modules;
+        terms.trueStubs += cell.second.trueStubs;
+        terms.misfilteredStubs += cell.second.misfilteredStubs;
+        terms.combinatorialStubs += cell.second.combinatorialStubs;
+        terms.triggerDataHeaderBits = cell.second.triggerDataHeaderBits;
+        terms.triggerDataPayloadBits = cell.second.triggerDataPayloadBits;
+      }
+    }
+    sensors_.insert(sensors_.end(), other.sensors_.begin(), other.sensors_.end());
+  }
+
+  void preVisit() {
+    cells_.clear();
+    sensors_.clear();
+    stubFrequencies_.clear();
+    points.clear();
+    bandwidthSummary.clear();
+  }
+
+  void visit(const SimParms& sp) {
+    bunchSpacingNs_ = sp.bunchSpacingNs();
+    interestingPt_ = sp.triggerPtCut();
+  }
+
+  void visit(const DetectorModule& module) {
+    if (module.sensors().back().type() == SensorType::Strip) { // as in BandwidthVisitor
+      for (const auto& s : module.sensors()) {
+        sensors_.push_back(SensorTerms{ double(module.numSparsifiedHeaderBits() * s.totalROCs()),
+                                        module.hitOccupancyPerEvent() * s.numChannels(),
+                                        double(module.numSparsifiedPayloadBits()) });
+      }
+    }
+
+    // as in TriggerFrequencyVisitor
+    if ((module.center().Z() < 0) || module.posRef().phi > 2 || (module.dsDistance() == 0.0)) return;
+    PtErrorAdapter pterr(module);
+    auto freqIt = stubFrequencies_.find(pterr.moduleParameters());
+    if (freqIt == stubFrequencies_.end()) {
+      StubFrequencies freqs = { pterr.getTriggerFrequencyTruePerEventAbove(interestingPt_),
+                                pterr.getTriggerFrequencyTruePerEventBelow(interestingPt_) };
+      freqIt = stubFrequencies_.insert(std::make_pair(pterr.moduleParameters(), freqs)).first;
+    }
+    TableRef ref = module.tableRef();
+    CellTerms& terms = cells_[ref.table].insert(std::make_pair(std::make_pair(ref.row, ref.col), CellTerms{0, 0., 0., 0., 0, 0})).first->second;
+    terms.modules++;
+    terms.trueStubs += freqIt->second.trueStubs;
+    terms.misfilteredStubs += freqIt->second.misfilteredStubs;
+    terms.combinatorialStubs += pterr.getTriggerFrequencyFakePerEvent();
+    terms.triggerDataHeaderBits = module.numTriggerDataHeaderBits();
+    terms.triggerDataPayloadBits = module.numTriggerDataPayloadBits();
+  }
+
+  void postVisit() {
+    bandwidthSummary.setHeader("Pile-up", "Strip sensors");
+    bandwidthSummary.setPrecision(3);
+    bandwidthSummary.setCell(0, 1, std::string("Hit channels per sensor"));
+    bandwidthSummary.setCell(0, 2, std::string("Average sparsified bandwidth (Mbps)"));
+    bandwidthSummary.setCell(0, 3, std::string("Maximum sparsified bandwidth (Mbps)"));
+
+    for (size_t i = 0; i < pileups_.size(); i++) {
+      double nMB = pileups_[i];
+      int row = i + 1;
+
+      double hitChannels = 0., bandwidth = 0., maxBandwidth = 0.;
+      for (const SensorTerms& s : sensors_) {
+        double sensorBandwidth = (s.headerBits + s.hitChannels * nMB * s.payloadBits) * 100E3;
+        hitChannels += s.hitChannels * nMB;
+        bandwidth += sensorBandwidth;
+        maxBandwidth = std::max(maxBandwidth, sensorBandwidth);
+      }
+      double numSensors = std::max<size_t>(sensors_.size(), 1);
+      bandwidthSummary.setCell(row, 0, any2str(nMB));
+      bandwidthSummary.setCell(row, 1, hitChannels / numSensors);
+      bandwidthSummary.setCell(row, 2, bandwidth / numSensors / 1E6);
+      bandwidthSummary.setCell(row, 3, maxBandwidth / 1E6);
+
+      PileupScanPoint point;
+      point.numMinBiasEvents = nMB;
+      for (const auto& table : cells_) {
+        SummaryTable& rateSummary = point.triggerRateSummaries[table.first];
+        SummaryTable& dataBandwidthSummary = point.triggerDataBandwidthSummaries[table.first];
+        rateSummary.setHeader("Layer", "Ring");
+        dataBandwidthSummary.setHeader("Layer", "Ring");
+        rateSummary.setPrecision(3);
+        dataBandwidthSummary.setPrecision(3);
+        for (const auto& cell : table.second) {
+          const CellTerms& terms = cell.second;
+          double total = (terms.trueStubs + terms.misfilteredStubs) / terms.modules * nMB + terms.combinatorialStubs / terms.modules * nMB * nMB;
+          rateSummary.setCell(cell.first.first, cell.first.second, total);
+          dataBandwidthSummary.setCell(cell.first.first, cell.first.second, (terms.triggerDataHeaderBits + total * terms.triggerDataPayloadBits) / bunchSpacingNs_); // GIGABIT/second
+        }
+      }
+      points.push_back(point);
+    }
+  }
+};
+
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef READOUTWHATIF_H
+#define READOUTWHATIF_H
+
+#include <string>
+#include <map>
+#include <vector>
+#include <utility>
+
+#include "Tracker.h"
+
+#include "Visitor.h"
+
+/**
+ * @class ReadoutWhatIf
+ * @brief Changes the readout properties of some module types of a built tracker, variant after variant, for the
+ * bandwidth and the trigger rates to be computed again without building the tracker again
+ *
+ * Only the properties of the modules that the bandwidth and trigger analyses read, and that set nothing else of the
+ * geometry, can be changed: the trigger window and the header and payload bits of the sparsified and trigger data.
+ * The sensor properties (strips, segments, ROCs) also set the pitch of the sensors and their occupancy, hence need the
+ * tracker to be built again. Each variant starts from the values of the configuration: the properties changed by the
+ * previous variant get their values back first, and all of them do when the what-if is done.
+ */
+class ReadoutWhatIf {
+public:
+  struct Change {
+    std::string moduleType, property;
+    double value;
+  };
+  struct Variant {
+    std::string name;
+    std::vector<Change> changes;
+  };
+
+  static bool knownProperty(const std::string& property);
+  static bool readFile(const std::string& fileName, std::vector<Variant>& variants);
+
+  ReadoutWhatIf(Tracker& tracker);
+  ~ReadoutWhatIf() { restore(); }
+  int apply(const Variant& variant);
+  void restore();
+
+private:
+  std::map<std::string, std::vector<DetectorModule*> > typeModules_; // the modules of each type
+  std::vector<std::pair<DetectorModule*, std::pair<int, double> > > originals_; // the property changed of a module, and its value before
+  static double get(const DetectorModule& m, int property);
+  static void set(DetectorModule& m, int property, double value);
+};
+
+#endif
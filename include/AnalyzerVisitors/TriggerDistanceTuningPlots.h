@@ -5,6 +5,9 @@
 #include <map>
 #include <vector>
 #include <utility>
+#include <algorithm>
+#include <cmath>
+#include <limits>
 
 #include "TH1.h"
 #include "TGraphErrors.h"
@@ -31,6 +34,24 @@ class TriggerDistanceTuningPlotsVisitor : public ConstGeometryVisitor {
   std::map<std::string, bool> preparedProfiles_;
   std::map<std::string, bool> preparedTurnOn_;
 
+  // Trigger probabilities of the scans below, computed once per class of modules with identical parameters
+  typedef std::map<PtErrorAdapter::ModuleParameters, std::vector<double> > ProbabilityCache;
+  ProbabilityCache tuningValues_, turnOnValues_;
+  std::map<int, ProbabilityCache> spacingScanValues_; // by window: the efficiencies at the spacings of spacingGrid_, NaN until evaluated
+
+  // The spacings of the spacing tuning, and where the bins of its profiles start among them
+  static const int spacingBins_ = 100;
+  std::vector<double> spacingGrid_;
+  std::vector<size_t> spacingBinStarts_; // by bin, 1 to spacingBins_, plus the end of the last bin
+  TAxis spacingAxis_;
+
+  // A class of identical modules of a type, with how many of them there are and their efficiencies over the spacings
+  struct SpacingScan {
+    PtErrorAdapter pterr;
+    int numModules;
+    std::vector<double>* values; // at 2*i the high momentum efficiency at the spacing i, at 2*i+1 the low momentum one
+  };
+
   
 
 
@@ -62,7 +83,72 @@ class TriggerDistanceTuningPlotsVisitor : public ConstGeometryVisitor {
       return 0;
     }
   }
- 
+
+
+  void buildSpacingGrid() {
+    spacingGrid_.clear();
+    for (double dist=0.5; dist<=6; dist+=0.02) spacingGrid_.push_back(dist); // the same sum as the scans it replaces, for the same spacings
+    spacingAxis_.Set(spacingBins_, 0.5, 6);
+    std::vector<int> bins;
+    for (double dist : spacingGrid_) bins.push_back(spacingAxis_.FindFixBin(dist));
+    spacingBinStarts_.assign(spacingBins_ + 2, 0);
+    for (int bin = 1; bin <= spacingBins_ + 1; bin++) spacingBinStarts_[bin] = std::lower_bound(bins.begin(), bins.end(), bin) - bins.begin();
+  }
+
+  // The efficiency (%) of a class of modules at a spacing of the grid, with the high (0) or low (1) momentum
+  double spacingEfficiency(SpacingScan& scan, size_t iSpacing, int momentum, const std::pair<double, double>& momenta, int windowSize) {
+    double& value = (*scan.values)[2*iSpacing + momentum];
+    if (std::isnan(value)) value = 100 * scan.pterr.getTriggerProbability(momentum == 0 ? momenta.second : momenta.first, spacingGrid_[iSpacing], windowSize);
+    return value;
+  }
+
+  // The content of a bin of the profile of the efficiency against the spacing of the modules of a type, as filling a
+  // TProfile with the efficiencies of all the modules at all the spacings of the bin would give
+  double spacingBinContent(std::vector<SpacingScan>& scans, int bin, int momentum, const std::pair<double, double>& momenta, int windowSize) {
+    double sum = 0., entries = 0.;
+    for (SpacingScan& scan : scans) {
+      for (size_t i = spacingBinStarts_[bin]; i < spacingBinStarts_[bin+1]; i++) {
+        double value = spacingEfficiency(scan, i, momentum, momenta, windowSize);
+        if ((value>=0) && (value<=100)) {
+          sum += scan.numModules * value;
+          entries += scan.numModules;
+        }
+      }
+    }
+    return entries > 0 ? sum / entries : 0.;
+  }
+
+  // Fill the tuning profiles for the windows actually set
+  void fillTuningProfiles(PtErrorAdapter& pterr, std::map<double, TProfile>& tuningProfiles) {
+    std::vector<double>& values = tuningValues_[pterr.moduleParameters()];
+    bool compute = values.empty();
+    unsigned int iValue = 0;
+    for (double dist=0.5; dist<=6; dist+=0.02) {
+      for (std::vector<double>::const_iterator it=triggerMomenta_.begin(); it!=triggerMomenta_.end(); ++it) {
+        double myPt = (*it);
+        if (compute) values.push_back(100 * pterr.getTriggerProbability(myPt, dist));
+        double myValue = values[iValue++];
+        if ((myValue>=0) && (myValue<=100))
+          tuningProfiles[myPt].Fill(dist, myValue);
+      }
+    }
+  }
+
+  // Fill the turnon curves profiles for the distance actually set
+  void fillTurnOnProfiles(PtErrorAdapter& pterr, double distance, std::map<double, TProfile>& turnonProfiles) {
+    std::vector<double>& values = turnOnValues_[pterr.moduleParameters()];
+    bool compute = values.empty();
+    unsigned int iValue = 0;
+    for (double myPt=0.5; myPt<=10; myPt+=0.02) {
+      for (unsigned int iWindow=0; iWindow<nWindows_; ++iWindow) {
+        double windowSize=iWindow*2+1;
+        if (compute) values.push_back(100 * pterr.getTriggerProbability(myPt, distance, int(windowSize)));
+        double myValue = values[iValue++];
+        if ((myValue>=0) && (myValue<=100))
+          turnonProfiles[windowSize].Fill(myPt, myValue);
+      }
+    }
+  }
 
 public:
   TH1D optimalSpacingDistribution, optimalSpacingDistributionAW;
@@ -150,26 +236,8 @@ public:
 
     PtErrorAdapter pterr(aModule);
 
-    // Fill the tuning profiles for the windows actually set
-    for (double dist=0.5; dist<=6; dist+=0.02) {
-      for (std::vector<double>::const_iterator it=triggerMomenta_.begin(); it!=triggerMomenta_.end(); ++it) {
-        double myPt = (*it);
-        double myValue = 100 * pterr.getTriggerProbability(myPt, dist);
-        if ((myValue>=0) && (myValue<=100))
-          tuningProfiles[myPt].Fill(dist, myValue);
-      }
-    }
-
-    // Fill the turnon curves profiles for the distance actually set
-    for (double myPt=0.5; myPt<=10; myPt+=0.02) {
-      for (unsigned int iWindow=0; iWindow<nWindows_; ++iWindow) {
-        double windowSize=iWindow*2+1;
-        double distance = aModule.dsDistance();
-        double myValue = 100 * pterr.getTriggerProbability(myPt, distance, int(windowSize));
-        if ((myValue>=0) && (myValue<=100))
-          turnonProfiles[windowSize].Fill(myPt, myValue);
-      }
-    }
+    fillTuningProfiles(pterr, tuningProfiles);
+    fillTurnOnProfiles(pterr, aModule.dsDistance(), turnonProfiles);
   }
 
 
@@ -222,26 +290,8 @@ public:
 
     PtErrorAdapter pterr(aModule);
 
-    // Fill the tuning profiles for the windows actually set
-    for (double dist=0.5; dist<=6; dist+=0.02) {
-      for (std::vector<double>::const_iterator it=triggerMomenta_.begin(); it!=triggerMomenta_.end(); ++it) {
-        double myPt = (*it);
-        double myValue = 100 * pterr.getTriggerProbability(myPt, dist);
-        if ((myValue>=0) && (myValue<=100))
-          tuningProfiles[myPt].Fill(dist, myValue);
-      }
-    }
-
-    // Fill the turnon curves profiles for the distance actually set
-    for (double myPt=0.5; myPt<=10; myPt+=0.02) {
-      for (unsigned int iWindow=0; iWindow<nWindows_; ++iWindow) {
-        double windowSize=iWindow*2+1;
-        double distance = aModule.dsDistance();
-        double myValue = 100 * pterr.getTriggerProbability(myPt, distance, int(windowSize));
-        if ((myValue>=0) && (myValue<=100))
-          turnonProfiles[windowSize].Fill(myPt, myValue);
-      }
-    }
+    fillTuningProfiles(pterr, tuningProfiles);
+    fillTurnOnProfiles(pterr, aModule.dsDistance(), turnonProfiles);
   }
 
   void postVisit() {
@@ -253,6 +303,7 @@ public:
       // Run once per possible position in the tracker
       
     std::vector<double> spacingOptions(foundSpacing_.begin(), foundSpacing_.end());
+    spacingScanValues_.clear();
     foundSpacing_.clear();    
      
     unsigned int nSpacingOptions = spacingOptions.size();             // TODO: keep this here!!
@@ -274,10 +325,7 @@ public:
     // Now loop over the selected modules and build the curves for the
     // hi-lo thingy (sensor spacing tuning)
     int windowSize;
-    XYZVector center;
-    double myPt;
-    TProfile tempProfileLow("tempProfileLow", "", 100, 0.5, 6); // TODO: these numbers should go into some kind of const
-    TProfile tempProfileHigh("tempProfileHigh", "", 100, 0.5, 6); // TODO: these numbers should go into some kind of const
+    buildSpacingGrid();
 
     // TODO: IMPORTANT!!!!!! clear the spacing tuning graphs and frame here
     spacingTuningFrame.SetBins(selectedModules_.size(), 0, selectedModules_.size());
@@ -295,61 +343,67 @@ public:
       const ModuleVector& myModules = itTypes->second;
       xAxis->SetBinLabel(iType+1, myName.c_str());
 
+      // The efficiencies fall with the spacing, so the thresholds are found by bisection, evaluating the efficiencies of
+      // only a few spacings for each class of identical modules, rather than scanning all of them
       // Loop over the possible search windows
       for (unsigned int iWindow = 0; iWindow<nWindows_; ++iWindow) {
         windowSize = 1 + iWindow * 2;
+        std::map<PtErrorAdapter::ModuleParameters, SpacingScan> typeScans;
         // Loop over the modules of type myName
         for (ModuleVector::const_iterator itModule = myModules.begin(); itModule!=myModules.end(); ++itModule) {
           const DetectorModule* aModule = (*itModule);
           PtErrorAdapter pterr(*aModule);
-          // Loop over the possible distances
-          double minDistBelow = 0.;
+          std::vector<double>& scanValues = spacingScanValues_[windowSize][pterr.moduleParameters()];
+          if (scanValues.empty()) scanValues.assign(2*spacingGrid_.size(), std::numeric_limits<double>::quiet_NaN());
+          SpacingScan& scan = typeScans.insert(std::make_pair(pterr.moduleParameters(), SpacingScan{pterr, 0, &scanValues})).first->second;
+          scan.numModules++;
           availableThinkness[aModule->dsDistance()] = true;
-          for (double dist=0.5; dist<=6; dist+=0.02) { // TODO: constant here
-            // First with the high momentum
-            myPt = (spacingTuningMomenta.second);
-            double myValue = 100 * pterr.getTriggerProbability(myPt, dist, windowSize);
-            if ((myValue>=0)&&(myValue<=100))
-              tempProfileHigh.Fill(dist, myValue);
-            // Then with low momentum
-            myPt = (spacingTuningMomenta.first);
-            myValue = 100 * pterr.getTriggerProbability(myPt, dist, windowSize);
-            if ((myValue>=0)&&(myValue<=100))
-              tempProfileLow.Fill(dist, myValue);
-            if (myValue>1) minDistBelow = dist;
+
+          // The largest spacing with an efficiency over 1% at low momentum
+          size_t firstBelow = 0, lastSpacing = spacingGrid_.size();
+          while (firstBelow < lastSpacing) {
+            size_t middle = (firstBelow + lastSpacing) / 2;
+            if (spacingEfficiency(scan, middle, 1, spacingTuningMomenta, windowSize) > 1) firstBelow = middle + 1;
+            else lastSpacing = middle;
           }
+          double minDistBelow = firstBelow > 0 ? spacingGrid_[firstBelow-1] : 0.;
           if (minDistBelow>=0) {
             if (windowSize==5) optimalSpacingDistribution.Fill(minDistBelow);
             if (windowSize==aModule->triggerWindow()) optimalSpacingDistributionAW.Fill(minDistBelow);
           }
 
-          /*if ((myName=="ENDCAP_D02R05")&&(windowSize==5)) { // debug
-            std::cout << myName << " - " << aModule->getTag() << " - minDistBelow = " << minDistBelow;
-            std::cout <<  ", so[0]=" << spacingOptions[0] << ", so[n-1]=" << spacingOptions[nSpacingOptions-1];
-            }*/
           if (minDistBelow<spacingOptions[0]) minDistBelow=spacingOptions[0];
           else if (minDistBelow>spacingOptions[nSpacingOptions-1]) minDistBelow=spacingOptions[nSpacingOptions-1];
           else {
             for (unsigned int iSpacing = 0; iSpacing < nSpacingOptions-1; ++iSpacing) {
-              /*if ((myName=="ENDCAP_D02R05")&&(windowSize==5)) {// debug
-                std::cout << " spacingOptions[" << iSpacing << "] = " << spacingOptions[iSpacing];
-                std::cout << " spacingOptions[" << iSpacing+1 << "] = " << spacingOptions[iSpacing+1];
-                }*/
               if ((minDistBelow>=spacingOptions[iSpacing]) && (minDistBelow<spacingOptions[iSpacing+1])) {
                 minDistBelow=spacingOptions[iSpacing+1];
-                /*if ((myName=="ENDCAP_D02R05")&&(windowSize==5)) // debug
-                  std::cout << " here it is: ";*/
                 break;
               }
             }
           }
-          /*if ((myName=="ENDCAP_D02R05")&&(windowSize==5)) // debug
-            std::cout << " - approx to " << minDistBelow << " for a window of " << windowSize << std::endl;*/
           moduleOptimalSpacings[aModule][windowSize] = minDistBelow;
         }
-        // Find the "high" and "low" points
-        double lowEdge = findXThreshold(tempProfileLow, 1, true);
-        double highEdge = findXThreshold(tempProfileHigh, 90, false);
+
+        std::vector<SpacingScan> scans;
+        for (auto& typeScan : typeScans) scans.push_back(typeScan.second);
+        // Find the "low" point: the first bin under 1% at low momentum (as findXThreshold(), which skips the empty bins)
+        int lowBin = 1, lastBin = spacingBins_ + 1;
+        while (lowBin < lastBin) {
+          int middle = (lowBin + lastBin) / 2;
+          if (spacingBinContent(scans, middle, 1, spacingTuningMomenta, windowSize) < 1) lastBin = middle;
+          else lowBin = middle + 1;
+        }
+        double lowEdge = (lowBin <= spacingBins_ && spacingBinContent(scans, lowBin, 1, spacingTuningMomenta, windowSize) != 0) ? spacingAxis_.GetBinCenter(lowBin) : 100;
+        // and the "high" one: the last bin over 90% at high momentum
+        int highBin = 1;
+        lastBin = spacingBins_ + 1;
+        while (highBin < lastBin) {
+          int middle = (highBin + lastBin) / 2;
+          if (spacingBinContent(scans, middle, 0, spacingTuningMomenta, windowSize) > 90) highBin = middle + 1;
+          else lastBin = middle;
+        }
+        double highEdge = highBin > 1 ? spacingAxis_.GetBinCenter(highBin-1) : 0;
         // std::cerr << myName << ": " << lowEdge << " -> " << highEdge << std::endl; // debug
         double centerX; double sizeX;
         centerX = iType+(double(iWindow)+0.5)/(double(nWindows_));
@@ -361,8 +415,6 @@ public:
           spacingTuningGraphsBad[iWindow].SetPoint(iType, centerX, (highEdge+lowEdge)/2.);
           spacingTuningGraphsBad[iWindow].SetPointError(iType, sizeX/2., (highEdge-lowEdge)/2.);
         }
-        tempProfileLow.Reset();
-        tempProfileHigh.Reset();
       }
       iType++;
     }
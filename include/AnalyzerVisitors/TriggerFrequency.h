@@ -5,17 +5,37 @@
 #include <map>
 #include <vector>
 #include <utility>
+#include <mutex>
+#include <algorithm>
 
 #include <TH1.h>
 
 #include "PtErrorAdapter.h"
+#include "PathCounters.h"
 #include "Tracker.h"
 #include "SimParms.h"
 
 #include "Visitor.h"
 #include "SummaryTable.h"
 
-class TriggerFrequencyVisitor : public ConstGeometryVisitor {
+/**
+ * The per-event frequencies of the particles above the interesting pt and of the true and misfiltered stubs, which do not
+ * depend on the module position in phi: they are integrated once per class of modules with identical parameters
+ */
+struct StubFrequencies { double highPtParticles, trueStubs, misfilteredStubs; };
+
+/**
+ * The stub frequencies of the classes of modules integrated so far, kept across the visits: the parameters of a class
+ * are all the module and type properties the integrals read, so a module type changed between two visits (see
+ * <i>ReadoutWhatIf</i>) only has the classes of its modules integrated again
+ */
+struct StubFrequencyCache {
+  double interestingPt; // the pt the frequencies are above and below of
+  std::map<PtErrorAdapter::ModuleParameters, StubFrequencies> frequencies;
+  StubFrequencyCache() : interestingPt(-1) {}
+};
+
+class TriggerFrequencyVisitor : public ForkableConstGeometryVisitor {
   typedef std::map<std::pair<std::string, int>, TH1D*> StubRateHistos;
 
   std::map<std::string, std::map<std::pair<int,int>, int>>   triggerFrequencyCounts_;
@@ -30,6 +50,26 @@ class TriggerFrequencyVisitor : public ConstGeometryVisitor {
   int nbins_;
   double bunchSpacingNs_, nMB_, interestingPt_;
 
+  StubFrequencyCache& stubFrequencies_;
+  std::map<PtErrorAdapter::ModuleParameters, StubFrequencies> forkFrequencies_; // those integrated by a fork, which only reads the shared cache until it is merged
+  bool forked_;
+  int evaluatedModules_; // the modules whose class was not in the cache
+
+  // The averages are taken over the modules with the same table reference, which all belong to the same layer or disk,
+  // hence the entries of a fork are only copied over those of the visitor
+  template<class Key, class Value> static void mergeEntries(std::map<Key, Value>& into, const std::map<Key, Value>& from) {
+    for (const auto& entry : from) into[entry.first] = entry.second;
+  }
+  template<class Key, class Value> static void mergeEntries(std::map<std::string, std::map<Key, Value> >& into, const std::map<std::string, std::map<Key, Value> >& from) {
+    for (const auto& entry : from) mergeEntries(into[entry.first], entry.second);
+  }
+
+  // The stub rate histograms can be created by several forks at the same time
+  static std::mutex& histogramMutex() {
+    static std::mutex mutex;
+    return mutex;
+  }
+
   void setupSummaries(const string& cntName) {
     triggerFrequencyTrueSummaries[cntName].setHeader("Layer", "Ring");
     triggerFrequencyFakeSummaries[cntName].setHeader("Layer", "Ring");
@@ -64,10 +104,53 @@ public:
                     stripOccupancySummaries,
                     hitOccupancySummaries;
 
+  /**
+   * @param stubFrequencies The stub frequencies of the classes of modules already integrated, filled with the others
+   */
+  TriggerFrequencyVisitor(StubFrequencyCache& stubFrequencies) : stubFrequencies_(stubFrequencies), forked_(false), evaluatedModules_(0) {}
+
+  ForkableConstGeometryVisitor* fork() const {
+    TriggerFrequencyVisitor* forked = new TriggerFrequencyVisitor(*this);
+    forked->forked_ = true;
+    forked->evaluatedModules_ = 0;
+    return forked;
+  }
+
+  void merge(ForkableConstGeometryVisitor& forked) {
+    TriggerFrequencyVisitor& other = static_cast<TriggerFrequencyVisitor&>(forked);
+    stubFrequencies_.frequencies.insert(other.forkFrequencies_.begin(), other.forkFrequencies_.end());
+    evaluatedModules_ += other.evaluatedModules_;
+    mergeEntries(triggerFrequencyCounts_, other.triggerFrequencyCounts_);
+    mergeEntries(triggerFrequencyAverageTrue_, other.triggerFrequencyAverageTrue_);
+    mergeEntries(triggerFrequencyInterestingParticleTrue_, other.triggerFrequencyInterestingParticleTrue_);
+    mergeEntries(triggerFrequencyAverageFake_, other.triggerFrequencyAverageFake_);
+    mergeEntries(triggerFrequencyAverageMisfiltered_, other.triggerFrequencyAverageMisfiltered_);
+    mergeEntries(triggerFrequencyAverageCombinatorial_, other.triggerFrequencyAverageCombinatorial_);
+    mergeEntries(triggerDataBandwidths_, other.triggerDataBandwidths_);
+    mergeEntries(triggerFrequenciesPerEvent, other.triggerFrequenciesPerEvent);
+    mergeEntries(totalStubRateHistos_, other.totalStubRateHistos_);
+    mergeEntries(trueStubRateHistos_, other.trueStubRateHistos_);
+    mergeSummaries(triggerFrequencyTrueSummaries, other.triggerFrequencyTrueSummaries);
+    mergeSummaries(triggerFrequencyFakeSummaries, other.triggerFrequencyFakeSummaries);
+    mergeSummaries(triggerFrequencyInterestingSummaries, other.triggerFrequencyInterestingSummaries);
+    mergeSummaries(triggerFrequencyMisfilteredSummaries, other.triggerFrequencyMisfilteredSummaries);
+    mergeSummaries(triggerFrequencyCombinatorialSummaries, other.triggerFrequencyCombinatorialSummaries);
+    mergeSummaries(triggerRateSummaries, other.triggerRateSummaries);
+    mergeSummaries(triggerEfficiencySummaries, other.triggerEfficiencySummaries);
+    mergeSummaries(triggerPuritySummaries, other.triggerPuritySummaries);
+    mergeSummaries(triggerDataBandwidthSummaries, other.triggerDataBandwidthSummaries);
+    mergeSummaries(stripOccupancySummaries, other.stripOccupancySummaries);
+    mergeSummaries(hitOccupancySummaries, other.hitOccupancySummaries);
+  }
+
   void visit(const SimParms& sp) {
     bunchSpacingNs_ = sp.bunchSpacingNs();
     nMB_ = sp.numMinBiasEvents();
     interestingPt_ = sp.triggerPtCut();
+    if (stubFrequencies_.interestingPt != interestingPt_) {
+      stubFrequencies_.frequencies.clear();
+      stubFrequencies_.interestingPt = interestingPt_;
+    }
   }
 
   void visit(const Barrel& b) { setupSummaries(b.myid()); }
@@ -87,6 +170,7 @@ public:
     XYZVector center = module.center();
     // TODO: check this too
     if ((center.Z()<0) || module.posRef().phi > 2/*(center.Phi()<0) || (center.Phi()>M_PI/2)*/ || (module.dsDistance()==0.0)) return;
+    countPathEvent("TriggerFrequencyVisitor modules visited");
 
     TH1D* currentTotalHisto;
     TH1D* currentTrueHisto;
@@ -97,15 +181,16 @@ public:
 
     PtErrorAdapter pterr(module);
 
-    if (totalStubRateHistos_.count(std::make_pair(table, row)) == 0) {
-      currentTotalHisto = new TH1D(("totalStubsPerEventHisto" + table + any2str(row)).c_str(), ";Modules;MHz/cm^2", nbins_, 0.5, nbins_+0.5);
-      currentTrueHisto = new TH1D(("trueStubsPerEventHisto" + table + any2str(row)).c_str(), ";Modules;MHz/cm^2", nbins_, 0.5, nbins_+0.5); 
-      totalStubRateHistos_[std::make_pair(table, row)] = currentTotalHisto; 
-      trueStubRateHistos_[std::make_pair(table, row)] = currentTrueHisto; 
-    } else {
-      currentTotalHisto = totalStubRateHistos_[std::make_pair(table, row)]; 
-      currentTrueHisto = trueStubRateHistos_[std::make_pair(table, row)]; 
+    // one lookup in each of the maps, which always have the same keys
+    auto totalHisto = totalStubRateHistos_.insert(std::make_pair(std::make_pair(table, row), (TH1D*)NULL)).first;
+    TH1D*& trueHisto = trueStubRateHistos_[totalHisto->first];
+    if (!totalHisto->second) {
+      std::lock_guard<std::mutex> lock(histogramMutex());
+      totalHisto->second = new TH1D(("totalStubsPerEventHisto" + table + any2str(row)).c_str(), ";Modules;MHz/cm^2", nbins_, 0.5, nbins_+0.5);
+      trueHisto = new TH1D(("trueStubsPerEventHisto" + table + any2str(row)).c_str(), ";Modules;MHz/cm^2", nbins_, 0.5, nbins_+0.5); 
     }
+    currentTotalHisto = totalHisto->second;
+    currentTrueHisto = trueHisto;
 
 
     int curCnt = triggerFrequencyCounts_[table][std::make_pair(row, col)]++;
@@ -118,9 +203,21 @@ public:
     //curAvgTrue  = curAvgTrue + (module->getTriggerFrequencyTruePerEvent()*tracker.getNMB() - curAvgTrue)/(curCnt+1);
     //curAvgFake  = curAvgFake + (module->getTriggerFrequencyFakePerEvent()*pow(tracker.getNMB(),2) - curAvgFake)/(curCnt+1); // triggerFrequencyFake scales with the square of Nmb!
 
-    double highPtParticlesRate = pterr.getParticleFrequencyPerEventAbove(interestingPt_)*nMB_;
-    double trueStubRate = pterr.getTriggerFrequencyTruePerEventAbove(interestingPt_)*nMB_; // highPtParticlesRate * triggerEfficiency
-    double misfilteredStubRate = pterr.getTriggerFrequencyTruePerEventBelow(interestingPt_)*nMB_; // low-Pt particles improperly considered to be high-pT, due to pT measurement errors, for which we form stubs
+    auto freqIt = stubFrequencies_.frequencies.find(pterr.moduleParameters());
+    if (freqIt == stubFrequencies_.frequencies.end()) {
+      std::map<PtErrorAdapter::ModuleParameters, StubFrequencies>& integrated = forked_ ? forkFrequencies_ : stubFrequencies_.frequencies;
+      freqIt = integrated.find(pterr.moduleParameters());
+      if (freqIt == integrated.end()) {
+        StubFrequencies freqs = { pterr.getParticleFrequencyPerEventAbove(interestingPt_),
+                                  pterr.getTriggerFrequencyTruePerEventAbove(interestingPt_),
+                                  pterr.getTriggerFrequencyTruePerEventBelow(interestingPt_) };
+        freqIt = integrated.insert(std::make_pair(pterr.moduleParameters(), freqs)).first;
+      }
+      evaluatedModules_++;
+    }
+    double highPtParticlesRate = freqIt->second.highPtParticles*nMB_;
+    double trueStubRate = freqIt->second.trueStubs*nMB_; // highPtParticlesRate * triggerEfficiency
+    double misfilteredStubRate = freqIt->second.misfilteredStubs*nMB_; // low-Pt particles improperly considered to be high-pT, due to pT measurement errors, for which we form stubs
     double combinatorialStubRate = pterr.getTriggerFrequencyFakePerEvent()*pow(nMB_,2); // stubs due to occupancy combinatorics - i.e. random pixels/strips turned on in the upper and lower sensors caused by separate tracks or secondaries which happen to fall within the trigger window
     double fakeStubRate = misfilteredStubRate + combinatorialStubRate; // combinatoricStubRate scales with the square of Nmb, while misfilteredStubRate scales linearly with Nmb
 
@@ -166,6 +263,18 @@ public:
 
   }
 
+  // The modules visited whose stub frequencies were not in the cache
+  int evaluatedModules() const { return evaluatedModules_; }
+
+  // The largest trigger data bandwidth of a table cell, in Gbps
+  double maxTriggerDataBandwidth() const {
+    double result = 0;
+    for (const auto& table : triggerDataBandwidths_) {
+      for (const auto& cell : table.second) result = std::max(result, cell.second);
+    }
+    return result;
+  }
+
 };
 
 
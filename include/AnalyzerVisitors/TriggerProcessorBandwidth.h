@@ -1,6 +1,7 @@
 #ifndef TRIGGERPROCESSORBANDWIDTH_H
 #define TRIGGERPROCESSORBANDWIDTH_H
 
+#include <cstdint>
 #include <string>
 #include <map>
 #include <vector>
@@ -31,7 +32,7 @@ namespace AnalyzerHelpers {
   bool isPointInCircle(const Point& p, const Circle& c);
   bool areClockwise(const Point& p1, const Point& p2);
 
-  double calculatePetalAreaMC(const Tracker& tracker, const SimParms& simParms, double crossoverR);
+  double calculatePetalAreaMC(const Tracker& tracker, const SimParms& simParms, double crossoverR, int numThreads = 1);
   double calculatePetalAreaModules(const Tracker& tracker, const SimParms& simParms, double crossoverR);
   double calculatePetalCrossover(const Tracker& tracker, const SimParms& simParms);
 
@@ -81,7 +82,36 @@ public:
     ModuleConnectionData() : phiCpuConnections_(0), etaCpuConnections_(0) {}
   };
   typedef map<const Module*,ModuleConnectionData> ModuleConnectionMap; 
-  typedef std::map<std::pair<int, int>, std::set<int> > TriggerSectorMap;
+
+  /**
+   * The modules of each trigger tower, by their sebified coordinates. The coordinates are added tower by tower while
+   * the modules are visited, then frozen into dense indices (the coordinates in increasing order) and one bitset of
+   * these indices per tower, so that the modules of a tower, or those two towers share, are read off whole words.
+   */
+  class TriggerSectorMap {
+    int numEta_ = 0, numPhi_ = 0;
+    std::vector<std::pair<int, int> > added_; // (tower, coordinates), until frozen
+    std::vector<int> moduleCoords_; // the coordinates of the dense index
+    size_t towerWords_ = 0;
+    std::vector<uint64_t> towerBits_; // towerWords_ words per tower
+    int tower(int eta, int phi) const { return (eta-1)*numPhi_ + phi-1; }
+    const uint64_t* bits(int eta, int phi) const { return towerBits_.data() + tower(eta, phi)*towerWords_; }
+  public:
+    void reset(int numEta, int numPhi);
+    void add(int eta, int phi, int sebCoords) { added_.push_back(std::make_pair(tower(eta, phi), sebCoords)); } // eta and phi from 1
+    void freeze();
+    int numEta() const { return numEta_; }
+    int numPhi() const { return numPhi_; }
+    bool empty(int eta, int phi) const;
+    int numSharedModules(int eta1, int phi1, int eta2, int phi2) const;
+    // Calls f with the coordinates of each module of the tower, in increasing order
+    template<class F> void forEachModule(int eta, int phi, F f) const {
+      const uint64_t* words = bits(eta, phi);
+      for (size_t w = 0; w < towerWords_; w++) {
+        for (uint64_t word = words[w]; word; word &= word - 1) f(moduleCoords_[w*64 + __builtin_ctzll(word)]);
+      }
+    }
+  };
 
   ModuleConnectionMap moduleConnections;
   TriggerSectorMap sectorMap;
@@ -4,6 +4,7 @@
 #include <map>
 #include <string>
 #include <set>
+#include <vector>
 
 #include <TProfile.h>
 #include <TGraph.h>
@@ -11,8 +12,25 @@
 
 using std::string;
 
+  /**
+   * @class GraphBag
+   * @brief A bag of graphs sorted by attribute (a bitmask of the quantity and the scope), tag and parameter (the
+   * momentum of the tracks, in MeV)
+   *
+   * The graphs are filled as series of points, which are plain arrays: the series of an attribute and a tag (a set)
+   * are looked up once, then a series is taken by its index within the set, and its points are appended to its
+   * arrays. The points are only made into TGraph objects, with the name and the title of their series, when the graphs
+   * of a set are handed out (see <i>getGraphs()</i> and <i>getTaggedGraphs()</i>), and again only if the series have
+   * been written to meanwhile.
+   */
   class GraphBag {
   public:
+    // The points of a graph, with its name and title
+    struct Series {
+      std::vector<double> x, y;
+      std::string name, title;
+      void addPoint(double px, double py) { x.push_back(px); y.push_back(py); }
+    };
     GraphBag();
     GraphBag(string parameter);
     const string& getParameterMeaning() const { return parameterMeaning_ ; }
@@ -29,9 +47,9 @@ using std::string;
     static const int TriggerGraph;
     static const int StandardGraph;
     std::map<int, TGraph>& getGraphs(const int& attribute);
-    TGraph& getGraph(const int& attribute, const int& parameter);
     std::map<int, TGraph>& getTaggedGraphs(int attribute, const string& tag);
-    TGraph& getTaggedGraph(const int& attribute, const string& tag, const int& parameter);
+    Series& getSeries(int attribute, const string& tag, int parameter);
+    void clearSeries(int attribute, const string& tag);
     const std::set<string>& getTagSet() const { return tagSet_; }
     const std::set<int> getParameterSet();
     int clearTriggerGraphs();
@@ -40,11 +58,19 @@ using std::string;
     //static std::pair<double, double> splitMomenta(double momentum);
     //static double joinMomenta(double momentum1, double momentum2);
   private:
-    std::map<int, std::map<int, TGraph> > graphMap_;
-    std::map<std::pair<int, string>, std::map<int, TGraph> > taggedGraphMap_;
+    // The series of an attribute and a tag (none for the untagged graphs), by parameter, and their graphs once made
+    struct SeriesSet {
+      SeriesSet() : graphsMade(false) {}
+      std::vector<int> parameters; // the parameter of each series, in increasing order
+      std::vector<Series> series;
+      std::map<int, TGraph> graphs;
+      bool graphsMade; // false once a series is written to, until the graphs are made again
+    };
+    std::map<std::pair<int, string>, SeriesSet> seriesSets_;
     std::set<string> tagSet_;
     std::string parameterMeaning_;
     int clearGraphs(const int& attributeMask);
+    std::map<int, TGraph>& makeGraphs(SeriesSet& set);
   };
 
   /**
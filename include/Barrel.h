@@ -65,9 +65,16 @@ class Barrel : public PropertyObject, public Buildable, public Identifiable<stri
   }
 
   void build(); 
+  void releaseBuildState() override {
+    PropertyObject::releaseBuildState();
+    layerNode.release();
+    supportNode.release();
+    for (auto& s : supportStructures_) s.releaseBuildState();
+  }
   void cutAtEta(double eta);
 
   const Container& layers() const { return layers_; }
+  Container& layers() { return layers_; }
 
   void accept(GeometryVisitor& v) { 
     v.visit(*this); 
@@ -0,0 +1,56 @@
+/**
+ * @file ColumnTable.h
+ * @brief This is the header file for a table of typed columns written in a binary form that can be memory-mapped
+ */
+
+#ifndef _COLUMNTABLE_H
+#define _COLUMNTABLE_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * @class ColumnTable
+ * @brief A table of typed columns of the same length (integers, reals, or categories such as the section or the module
+ * type), written as one block per column.
+ *
+ * The file starts with the magic "TKCOLTAB", then the version, the number of columns (uint32 each) and the number of rows
+ * (uint64). A directory follows with an entry per column: its name (NUL-padded to NameLength bytes), its type (uint32,
+ * see Type), a reserved uint32, the offset of its data and the offset of its dictionary (uint64 each, from the start of
+ * the file, 0 if the column has no dictionary). The data of a column are the values one after the other (int32 for
+ * the integers and the categories, float64 for the reals), starting on a multiple of 8 bytes, so that a reader can map
+ * the file and use each column as an array. The dictionary of a category column is the number of categories (uint32),
+ * then each category name as its length (uint32) and its characters: a value of the column is the index of its name.
+ * Everything is written in the byte order of the machine: a reader of the other byte order sees the version as 0x01000000.
+ */
+class ColumnTable {
+public:
+  enum Type { Integer = 0, Real = 1, Category = 2 };
+  static const size_t NameLength = 32;
+  static const uint32_t Version = 1;
+
+  void addIntegerColumn(const std::string& name, std::vector<int32_t> values);
+  void addRealColumn(const std::string& name, std::vector<double> values);
+  void addCategoryColumn(const std::string& name, const std::vector<std::string>& values);
+
+  size_t numRows() const { return numRows_; }
+  size_t numColumns() const { return columns_.size(); }
+
+  void write(std::ostream& output) const;
+private:
+  struct Column {
+    std::string name;
+    Type type;
+    std::vector<int32_t> integers; // the integers, or the category indices
+    std::vector<double> reals;
+    std::vector<std::string> categories;
+  };
+  std::vector<Column> columns_;
+  size_t numRows_ = 0;
+
+  Column& addColumn(const std::string& name, Type type, size_t numRows);
+};
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef COMPOSITEVISITOR_H
+#define COMPOSITEVISITOR_H
+
+#include <cstddef>
+#include <vector>
+#include <memory>
+
+#include "Visitor.h"
+
+/**
+ * @class CompositeVisitor
+ * @brief A visitor which passes each element it visits on to a list of visitors, so that they all run in a single traversal.
+ *
+ * The visitors are called in the order they were added, on each element in turn, and so are their <i>preVisit()</i> and
+ * <i>postVisit()</i>. Those which do not change the geometry are given the elements as const. The composite can be run
+ * by <i>Tracker::parallelAccept()</i>: its forks are made of the forks of its visitors.
+ */
+class CompositeVisitor : public ForkableGeometryVisitor {
+  struct Entry {
+    ForkableGeometryVisitor* visitor;
+    ForkableConstGeometryVisitor* constVisitor;
+  };
+  std::vector<Entry> visitors_;
+  std::vector<std::unique_ptr<ForkableGeometryVisitor> > ownedVisitors_;
+  std::vector<std::unique_ptr<ForkableConstGeometryVisitor> > ownedConstVisitors_;
+
+  template<class T> void dispatch(T& element) {
+    for (const auto& e : visitors_) {
+      if (e.visitor) e.visitor->visit(element);
+      else e.constVisitor->visit(static_cast<const T&>(element));
+    }
+  }
+public:
+  void add(ForkableGeometryVisitor& v) { visitors_.push_back(Entry{&v, NULL}); }
+  void add(ForkableConstGeometryVisitor& v) { visitors_.push_back(Entry{NULL, &v}); }
+
+  void preVisit() {
+    for (const auto& e : visitors_) {
+      if (e.visitor) e.visitor->preVisit();
+      else e.constVisitor->preVisit();
+    }
+  }
+
+  void postVisit() {
+    for (const auto& e : visitors_) {
+      if (e.visitor) e.visitor->postVisit();
+      else e.constVisitor->postVisit();
+    }
+  }
+
+  ForkableGeometryVisitor* fork() const {
+    CompositeVisitor* forked = new CompositeVisitor();
+    for (const auto& e : visitors_) {
+      if (e.visitor) {
+        forked->ownedVisitors_.emplace_back(e.visitor->fork());
+        forked->add(*forked->ownedVisitors_.back());
+      } else {
+        forked->ownedConstVisitors_.emplace_back(e.constVisitor->fork());
+        forked->add(*forked->ownedConstVisitors_.back());
+      }
+    }
+    return forked;
+  }
+
+  void merge(ForkableGeometryVisitor& forked) {
+    CompositeVisitor& other = static_cast<CompositeVisitor&>(forked);
+    for (size_t i = 0; i < visitors_.size(); i++) {
+      if (visitors_[i].visitor) visitors_[i].visitor->merge(*other.visitors_[i].visitor);
+      else visitors_[i].constVisitor->merge(*other.visitors_[i].constVisitor);
+    }
+  }
+
+  void visit(Tracker& t) { dispatch(t); }
+  void visit(Barrel& b) { dispatch(b); }
+  void visit(Endcap& e) { dispatch(e); }
+  void visit(Layer& l) { dispatch(l); }
+  void visit(Disk& d) { dispatch(d); }
+  void visit(Ring& r) { dispatch(r); }
+  void visit(RodPair& r) { dispatch(r); }
+  void visit(BarrelModule& m) { dispatch(m); }
+  void visit(EndcapModule& m) { dispatch(m); }
+  void visit(DetectorModule& m) { dispatch(m); }
+  void visit(RectangularModule& m) { dispatch(m); }
+  void visit(WedgeModule& m) { dispatch(m); }
+  void visit(GeometricModule& m) { dispatch(m); }
+  void visit(SimParms& sp) { dispatch(sp); }
+};
+
+#endif
@@ -52,6 +52,7 @@ namespace material {
     PropertyNodeUnique<std::string> conversionsNode_;
 
     void buildConversions();
+    void compileConversions();
 
     /*
     class Element : public PropertyObject {
@@ -95,7 +96,9 @@ namespace material {
 
       Conversion() :
         inputNode_ ("Input", parsedAndChecked()),
-        outputNode_ ("Output", parsedAndChecked()) {};
+        outputNode_ ("Output", parsedAndChecked()),
+        input (nullptr),
+        outputs (nullptr) {};
       virtual ~Conversion() {};
 
       void build();
@@ -105,6 +108,15 @@ namespace material {
     };
 
     std::vector<Conversion *> conversions;
+
+    // The conversions compiled once built, as the rows of a sparse matrix over the material keys: the conversions the
+    // elements of a material go through, each with the quantity and the unit of its input
+    struct CompiledConversion {
+      double inputQuantity;
+      const std::string* inputUnit;
+      const std::vector<MaterialObject::Element*>* outputs;
+    };
+    std::vector<std::vector<CompiledConversion> > conversionsByKey_;
   };
 
 } /* namespace material */
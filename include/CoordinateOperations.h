@@ -70,6 +70,31 @@ namespace CoordinateOperations {
     return maxget(polygon.begin(), polygon.end(), [](const XYZVector& v) { return v.Rho(); });
   }
 
+  /**
+   * The moves of a module placed (translations and rotations about the axes, in the order they are added) composed into
+   * one affine transform, x -> M x + t, for the vertices to be moved in one sweep. The angles of the rotations about
+   * each axis are summed as well, for the module to keep its tilt, skew and radial axis.
+   */
+  class Placement {
+    double m_[3][3];
+    XYZVector t_;
+    double yRotation_, zRotation_;
+    void rotate(const double r[3][3]);
+  public:
+    Placement();
+    Placement& translate(const XYZVector& vector) { t_ += vector; return *this; }
+    Placement& translateZ(double z) { return translate(XYZVector(0, 0, z)); }
+    Placement& rotateY(double angle);
+    Placement& rotateZ(double angle);
+    XYZVector operator()(const XYZVector& v) const {
+      return XYZVector(m_[0][0]*v.X() + m_[0][1]*v.Y() + m_[0][2]*v.Z() + t_.X(),
+                       m_[1][0]*v.X() + m_[1][1]*v.Y() + m_[1][2]*v.Z() + t_.Y(),
+                       m_[2][0]*v.X() + m_[2][1]*v.Y() + m_[2][2]*v.Z() + t_.Z());
+    }
+    double yRotation() const { return yRotation_; }
+    double zRotation() const { return zRotation_; }
+  };
+
 }
 
 
@@ -0,0 +1,76 @@
+/**
+ * @file CounterRandom.h
+ * @brief This is the header file for the counter-based random streams of the track scans
+ */
+
+#ifndef _COUNTERRANDOM_H
+#define _COUNTERRANDOM_H
+
+#include <cmath>
+#include <cstdint>
+
+namespace insur {
+  /**
+   * @class CounterRandom
+   * @brief This class draws the random numbers of one track of a scan as a pure function of the seed, of the scan
+   * (its stream) and of the index of the track.
+   *
+   * The numbers are the output of the Philox4x32-10 bijection (Salmon et al., SC'11) applied to a counter made of the
+   * track index and of the number of the draw, keyed by the seed and the stream. No state is carried from a track to
+   * the next: the tracks draw the same numbers whichever thread, shard or order they are analysed in.
+   */
+  class CounterRandom {
+  public:
+    enum Stream : uint32_t { GeometryTracks = 1, MaterialTracks = 2, MaterialEfficiency = 3, ResolutionTracks = 4, TriggerTracks = 5,
+                            ResolutionEfficiency = 6, TriggerEfficiency = 7 };
+
+    CounterRandom(uint32_t seed, uint32_t stream, uint64_t index) : block_(0), used_(4) {
+      key_[0] = seed;
+      key_[1] = stream;
+      index_[0] = uint32_t(index);
+      index_[1] = uint32_t(index >> 32);
+    }
+
+    // A uniform 32-bit integer
+    uint32_t integer() {
+      if (used_ == 4) nextBlock();
+      return output_[used_++];
+    }
+    // A uniform number in ]0, 1[
+    double uniform() { return (integer() + 0.5) * (1. / 4294967296.); }
+    // A normal number, from two uniform ones (Box-Muller)
+    double gaus(double mean = 0, double sigma = 1) {
+      double u1 = uniform(), u2 = uniform();
+      return mean + sigma * sqrt(-2 * log(u1)) * cos(2 * M_PI * u2);
+    }
+  private:
+    uint32_t key_[2], index_[2], output_[4];
+    uint32_t block_;
+    int used_;
+
+    static void multiply(uint32_t a, uint32_t b, uint32_t& high, uint32_t& low) {
+      uint64_t product = uint64_t(a) * b;
+      high = uint32_t(product >> 32);
+      low = uint32_t(product);
+    }
+
+    void nextBlock() {
+      uint32_t x[4] = { block_++, 0, index_[0], index_[1] };
+      uint32_t k0 = key_[0], k1 = key_[1];
+      for (int round = 0; round < 10; round++) {
+        uint32_t hi0, lo0, hi1, lo1;
+        multiply(0xD2511F53, x[0], hi0, lo0);
+        multiply(0xCD9E8D57, x[2], hi1, lo1);
+        x[0] = hi1 ^ x[1] ^ k0;
+        x[1] = lo1;
+        x[2] = hi0 ^ x[3] ^ k1;
+        x[3] = lo0;
+        k0 += 0x9E3779B9;
+        k1 += 0xBB67AE85;
+      }
+      for (int i = 0; i < 4; i++) output_[i] = x[i];
+      used_ = 0;
+    }
+  };
+}
+#endif /* _COUNTERRANDOM_H */
@@ -1,6 +1,8 @@
 #ifndef DETECTOR_MODULE_H
 #define DETECTOR_MODULE_H
 
+#include <cstdint>
+#include <functional>
 #include <boost/ptr_container/ptr_vector.hpp>
 
 #include "Sensor.h"
@@ -30,6 +32,38 @@ struct PosRef { int cnt, z, rho, phi; };
 struct TableRef { string table; int row, col; };
 struct UniRef { string cnt; int layer, ring, phi, side; };
 
+/**
+ * The identity of a module packed in 64 bits: from the most significant byte, the subdetector, the counter, the layer or
+ * disk, the ring and the side (as side + 1), then the rod or blade in the two least significant bytes. The keys order and
+ * hash as integers, so the modules can be grouped and looked up by them without building the string references, whose
+ * names are only formatted when written out. Masking the lower fields gives the key of a layer or of a table cell.
+ */
+struct ModuleKey {
+  uint64_t value;
+  ModuleKey() : value(0) {}
+  explicit ModuleKey(uint64_t v) : value(v) {}
+  ModuleKey(int subdet, int cnt, int layer, int ring, int phi, int side) :
+      value(uint64_t(uint8_t(subdet)) << 56 | uint64_t(uint8_t(cnt)) << 48 | uint64_t(uint8_t(layer)) << 40 |
+            uint64_t(uint8_t(ring)) << 32 | uint64_t(uint8_t(side + 1)) << 24 | uint64_t(uint16_t(phi))) {}
+  int subdet() const { return uint8_t(value >> 56); }
+  int cnt() const { return uint8_t(value >> 48); }
+  int layer() const { return uint8_t(value >> 40); }
+  int ring() const { return uint8_t(value >> 32); }
+  int side() const { return int(uint8_t(value >> 24)) - 1; }
+  int phi() const { return uint16_t(value); }
+  ModuleKey layerKey() const { return ModuleKey(value & ~((uint64_t(1) << 40) - 1)); } // the counter and layer or disk
+  ModuleKey cellKey() const { return ModuleKey(value & ~((uint64_t(1) << 32) - 1)); } // the cell of the tables, as tableRef()
+  bool operator==(const ModuleKey& other) const { return value == other.value; }
+  bool operator!=(const ModuleKey& other) const { return value != other.value; }
+  bool operator<(const ModuleKey& other) const { return value < other.value; }
+};
+
+namespace std {
+  template<> struct hash<ModuleKey> {
+    size_t operator()(const ModuleKey& key) const { return hash<uint64_t>()(key.value); }
+  };
+}
+
 namespace insur {
   class ModuleCap;
 }
@@ -47,18 +81,29 @@ protected:
   Sensors sensors_;
   std::string cntName_;
   int16_t cntId_;
+  int moduleIndex_ = -1;
   mutable double cachedZError_ = -1.;
   mutable std::pair<double,double> cachedMinMaxEtaWithError_;
+  double frozenPhiAperture_ = -1., frozenEtaAperture_ = -1., frozenStripOccupancy_ = -1.; // set by Tracker::freeze(), negative when not frozen
   XYZVector rAxis_;
   double tiltAngle_ = 0., skewAngle_ = 0.;
 
-  int numHits_ = 0;
-
-  void clearSensorPolys() { for (auto& s : sensors_) s.clearPolys(); }
-  ModuleCap* myModuleCap_ = NULL;
+  void clearGeometryCaches() { for (auto& s : sensors_) s.clearPolys(); frozenPhiAperture_ = frozenEtaAperture_ = frozenStripOccupancy_ = -1.; }
+  // The material of the module, created by the first consumer of the material and owned by the module: a copy of the
+  // module starts without one
+  struct OwnedModuleCap {
+    ModuleCap* cap = NULL;
+    OwnedModuleCap() {}
+    OwnedModuleCap(const OwnedModuleCap&) {}
+    OwnedModuleCap& operator=(const OwnedModuleCap&) { return *this; }
+    ~OwnedModuleCap();
+  } myModuleCap_;
 public:
-  void setModuleCap(ModuleCap* newCap) { myModuleCap_ = newCap ; }
-  ModuleCap* getModuleCap() { return myModuleCap_ ; }
+  void setModuleCap(ModuleCap* newCap); // the module takes the cap over, deleting the previous one
+  ModuleCap& moduleCap();
+  void releaseModuleCap() { setModuleCap(NULL); }
+  ModuleCap* getModuleCap() { return myModuleCap_.cap ; }
+  const ModuleCap* getModuleCap() const { return myModuleCap_.cap ; }
 
   Property<int16_t, AutoDefault> side;
   
@@ -101,6 +146,8 @@ public:
   int16_t cntId() const { return cntId_; }
   const std::string& cntName() const { return cntName_; }
   void cntNameId(const std::string& name, int id) { cntName_ = name; cntId_ = id; }
+  int moduleIndex() const { return moduleIndex_; } // the position in the module table of the tracker, -1 before it is built
+  void moduleIndex(int index) { moduleIndex_ = index; }
   
  DetectorModule(Decorated* decorated) : 
     Decorator<GeometricModule>(decorated),
@@ -137,6 +184,7 @@ public:
   virtual void setup();
 
   virtual void build();
+  void releaseBuildState() override;
 // Geometric module interface
   const Polygon3d<4>& basePoly() const { return decorated().basePoly(); }
 
@@ -160,33 +208,44 @@ public:
   double tiltAngle() const { return tiltAngle_; }
   double skewAngle() const { return skewAngle_; }
 
+  // The part of the equivalent resolutions which only depends on the module: the hits keep it, rather than going back
+  // to the module properties for every fit
+  struct ResolutionFactors {
+    double localX, localY;
+    double sinSkew, cosSkew, sinTilt, cosTilt;
+    double equivalentZ   (double hitRho, double trackR, double trackCotgTheta) const;
+    double equivalentRPhi(double hitRho, double trackR) const;
+  };
+  ResolutionFactors resolutionFactors() const;
   double resolutionEquivalentZ   (double hitRho, double trackR, double trackCotgTheta) const;
   double resolutionEquivalentRPhi(double hitRho, double trackR) const;
 
-  void translate(const XYZVector& vector) { decorated().translate(vector); clearSensorPolys(); }
-  void mirror(const XYZVector& vector) { decorated().mirror(vector); clearSensorPolys(); }
-  void translateZ(double z) { decorated().translate(XYZVector(0, 0, z)); clearSensorPolys(); }
+  void translate(const XYZVector& vector) { decorated().translate(vector); clearGeometryCaches(); }
+  void mirror(const XYZVector& vector) { decorated().mirror(vector); clearGeometryCaches(); }
+  void translateZ(double z) { decorated().translate(XYZVector(0, 0, z)); clearGeometryCaches(); }
   void translateR(double radius) { 
     XYZVector v = rAxis_.Unit()*radius;
     decorated().translate(v); 
-    clearSensorPolys();
+    clearGeometryCaches();
   }
   void mirrorZ() { 
     side(-side());
     double zTranslation = -center().Z();
     double zRotation = -center().Phi();
-    translateZ(zTranslation);
-    rotateZ(zRotation);
-    rotateY(M_PI);
-    translateZ(zTranslation);
-    rotateZ(-zRotation);
+    place(CoordinateOperations::Placement().translateZ(zTranslation).rotateZ(zRotation).rotateY(M_PI).translateZ(zTranslation).rotateZ(-zRotation));
     //decorated().mirror(XYZVector(1., 1., -1.));
-    clearSensorPolys();
   }
+  // the moves composed, the vertices moved and the caches cleared once
+  void place(const CoordinateOperations::Placement& placement) {
+    decorated().place(placement);
+    clearGeometryCaches();
+    rAxis_ = RotationZ(placement.zRotation())(rAxis_);
+  }
+  const XYZVector& rAxis() const { return rAxis_; }
 
-  void rotateX(double angle) { decorated().rotateX(angle); clearSensorPolys(); }
-  void rotateY(double angle) { decorated().rotateY(angle); clearSensorPolys(); }
-  void rotateZ(double angle) { decorated().rotateZ(angle); clearSensorPolys(); rAxis_ = RotationZ(angle)(rAxis_); }
+  void rotateX(double angle) { decorated().rotateX(angle); clearGeometryCaches(); }
+  void rotateY(double angle) { decorated().rotateY(angle); clearGeometryCaches(); }
+  void rotateZ(double angle) { decorated().rotateZ(angle); clearGeometryCaches(); rAxis_ = RotationZ(angle)(rAxis_); }
   void tilt(double angle) { rotateX(-angle); tiltAngle_ += angle; } // CUIDADO!!! tilt and skew can only be called BEFORE translating/rotating the module, or they won't work as expected!!
   void skew(double angle) { rotateY(-angle); skewAngle_ += angle; }
 
@@ -203,11 +262,11 @@ public:
   double planarMaxR() const { return CoordinateOperations::computeMaxR(basePoly()); }
   double planarMinR() const { return CoordinateOperations::computeMinR(basePoly()); }
 
-  double phiAperture() const { return maxPhi() - minPhi(); }
+  double phiAperture() const { return frozenPhiAperture_ >= 0. ? frozenPhiAperture_ : maxPhi() - minPhi(); }
 
   double maxEta() const { return MAX(basePoly().getVertex(0).Eta(), basePoly().getVertex(2).Eta()); }
   double minEta() const { return MIN(basePoly().getVertex(0).Eta(), basePoly().getVertex(2).Eta()); }
-  double etaAperture() const { return maxEta() - minEta(); }
+  double etaAperture() const { return frozenEtaAperture_ >= 0. ? frozenEtaAperture_ : maxEta() - minEta(); }
   double maxEtaWithError(double zError) const { return minMaxEtaWithError(zError).second; }
   double minEtaWithError(double zError) const { return minMaxEtaWithError(zError).first; }
   std::pair<double, double> minMaxEtaWithError(double zError) const;
@@ -236,8 +295,10 @@ public:
   int numStripsAcross() const { return sensors().front().numStripsAcross(); } // CUIDADO this assumes both sensors have the same number of sensing elements in the transversal direction - typically it is like that
   double sensorThickness() const { return sensors().front().sensorThickness(); } // CUIDADO this has to be fixed (called in Extractor.cc), sensor thickness can be different for different sensors
 
-  double stripOccupancyPerEvent() const;
+  double stripOccupancyPerEvent() const { return frozenStripOccupancy_ >= 0. ? frozenStripOccupancy_ : computeStripOccupancyPerEvent(); }
   double hitOccupancyPerEvent() const { return stripOccupancyPerEvent()/2.; }
+  double computeStripOccupancyPerEvent() const;
+  void freezeOccupancy(double phiAperture, double etaAperture, double stripOccupancy) { frozenPhiAperture_ = phiAperture; frozenEtaAperture_ = etaAperture; frozenStripOccupancy_ = stripOccupancy; }
   double geometricEfficiency() const;
   double effectiveDsDistance() const;
 
@@ -246,13 +307,14 @@ public:
   virtual PosRef posRef() const = 0;
   virtual TableRef tableRef() const = 0;
   virtual UniRef uniRef() const = 0;
+  virtual ModuleKey moduleKey() const = 0;
   virtual int16_t moduleRing() const { return -1; }
 
+  void primeCaches() const;
   bool couldHit(const XYZVector& direction, double zError) const;
   double trackCross(const XYZVector& PL, const XYZVector& PU) { return decorated().trackCross(PL, PU); }
-  std::pair<XYZVector, HitType> checkTrackHits(const XYZVector& trackOrig, const XYZVector& trackDir);
-  int numHits() const { return numHits_; }
-  void resetHits() { numHits_ = 0; }
+  std::pair<XYZVector, HitType> checkTrackHits(const XYZVector& trackOrig, const XYZVector& trackDir) const;
+  std::pair<XYZVector, HitType> classifyTrackHits(const std::pair<XYZVector, int>& inSegm, const std::pair<XYZVector, int>& outSegm) const;
 
 };
 
@@ -298,6 +360,7 @@ public:
   PosRef posRef() const { return (PosRef){ cntId(), (side() > 0 ? ring() : -ring()), layer(), rod() }; }
   TableRef tableRef() const { return (TableRef){ cntName(), layer(), ring() }; }
   UniRef uniRef() const { return UniRef{ cntName(), layer(), ring(), rod(), side() }; }
+  ModuleKey moduleKey() const { return ModuleKey(BARREL, cntId(), layer(), ring(), rod(), side()); }
 };
 
 
@@ -344,6 +407,7 @@ public:
   PosRef posRef() const { return (PosRef){ cntId(), (side() > 0 ? disk() : -disk()), ring(), blade() }; }
   TableRef tableRef() const { return (TableRef){ cntName(), disk(), ring() }; }
   UniRef uniRef() const { return UniRef{ cntName(), disk(), ring(), blade(), side() }; }
+  ModuleKey moduleKey() const { return ModuleKey(ENDCAP, cntId(), disk(), ring(), blade(), side()); }
 };
 
 
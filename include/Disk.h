@@ -84,6 +84,7 @@ public:
 
   void check() override;
   void build(const vector<double>& buildDsDistances);
+  void releaseBuildState() override { PropertyObject::releaseBuildState(); ringNode.release(); stationsNode.release(); materialObject_.releaseBuildState(); }
   void translateZ(double z);
   void mirrorZ();
   void cutAtEta(double eta);
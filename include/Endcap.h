@@ -47,9 +47,11 @@ public:
   }
 
   void build();
+  void releaseBuildState() override { PropertyObject::releaseBuildState(); diskNode.release(); }
   void cutAtEta(double eta);
 
   const Container& disks() const { return disks_; }
+  Container& disks() { return disks_; }
 
   void accept(GeometryVisitor& v) { 
     v.visit(*this); 
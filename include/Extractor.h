@@ -16,6 +16,8 @@
 #include <tk2CMSSW_datatypes.h>
 #include <tk2CMSSW_strings.h>
 #include <set>
+#include <map>
+#include <algorithm>
 #include <cmath>
 #include <sstream>
 #include <Tracker.h>
@@ -36,7 +38,7 @@ namespace insur {
     class LayerAggregator : public GeometryVisitor { // CUIDADO quick'n'dirty visitor-based adaptor to interface with legacy spaghetti code
       std::vector<Layer*> barrelLayers_;
       std::vector<Disk*> endcapLayers_;
-      std::vector<std::vector<ModuleCap> > layerCap_;
+      std::vector<ModuleCaps> layerCap_;
     public:
       void visit(Layer& l) { barrelLayers_.push_back(&l); }
       void visit(Disk& d) { endcapLayers_.push_back(&d); }
@@ -52,15 +54,15 @@ namespace insur {
       }
       std::vector<Layer*>* getBarrelLayers() { return &barrelLayers_; }
       std::vector<Disk*>* getEndcapLayers() { return &endcapLayers_; }
-      std::vector<std::vector<ModuleCap> >& getBarrelCap() {
+      std::vector<ModuleCaps>& getBarrelCap() {
         if (layerCap_.size()) return layerCap_;
         //std:cout << "Computing my layerCap_ for the first time" << std::endl;
         for (auto it : barrelLayers_ ) {
           class ModuleVisitor : public GeometryVisitor {
           public:
-             std::vector<ModuleCap> *myLayerModuleCaps_;
-             ModuleVisitor() { myLayerModuleCaps_ = new std::vector<ModuleCap>(); }
-             void visit(BarrelModule& bm) { myLayerModuleCaps_->push_back(*bm.getModuleCap()) ; }
+             ModuleCaps *myLayerModuleCaps_;
+             ModuleVisitor() { myLayerModuleCaps_ = new ModuleCaps(); }
+             void visit(BarrelModule& bm) { myLayerModuleCaps_->push_back(bm.getModuleCap()) ; }
           };
           ModuleVisitor mv;
           it->accept(mv);
@@ -75,7 +77,10 @@ namespace insur {
       }
     };
   public:
+    Extractor() : numThreads_(1) {}
     void analyse(MaterialTable& mt, MaterialBudget& mb, CMSSWBundle& d, bool wt = false);
+    void numThreads(int n) { numThreads_ = MAX(1, n); }
+    int numThreads() const { return numThreads_; }
   protected:
     void analyseElements(MaterialTable&mattab, std::vector<Element>& elems);
     void analyseBarrelContainer(Tracker& t, std::vector<std::pair<double, double> >& up,
@@ -85,9 +90,11 @@ namespace insur {
     void analyseLayers(MaterialTable& mt, Tracker& tr, std::vector<Composite>& c,
                        std::vector<LogicalInfo>& l, std::vector<ShapeInfo>& s, std::vector<PosInfo>& p, std::vector<AlgoInfo>& a,
                        std::vector<Rotation>& r, std::vector<SpecParInfo>& t, std::vector<RILengthInfo>& ri, bool wt = false);
-    void analyseDiscs(MaterialTable& mt, std::vector<std::vector<ModuleCap> >& ec, Tracker& tr, std::vector<Composite>& c,
+    void analyseDiscs(MaterialTable& mt, std::vector<ModuleCaps>& ec, Tracker& tr, std::vector<Composite>& c,
                       std::vector<LogicalInfo>& l, std::vector<ShapeInfo>& s, std::vector<PosInfo>& p, std::vector<AlgoInfo>& a,
                       std::vector<Rotation>& r, std::vector<SpecParInfo>& t, std::vector<RILengthInfo>& ri, bool wt = false);
+    void analyseLayer(LayerAggregator& lagg, ModuleCaps& caps, int layer, CMSSWBundle& d, bool wt);
+    void analyseDisc(LayerAggregator& lagg, ModuleCaps& caps, int layer, CMSSWBundle& d, bool wt);
     void analyseBarrelServices(InactiveSurfaces& is, std::vector<Composite>& c, std::vector<LogicalInfo>& l, std::vector<ShapeInfo>& s,
                                std::vector<PosInfo>& p, std::vector<SpecParInfo>& t, bool wt = false);
     void analyseEndcapServices(InactiveSurfaces& is, std::vector<Composite>& c, std::vector<LogicalInfo>& l, std::vector<ShapeInfo>& s,
@@ -95,9 +102,12 @@ namespace insur {
     void analyseSupports(InactiveSurfaces& is, std::vector<Composite>& c, std::vector<LogicalInfo>& l, std::vector<ShapeInfo>& s,
                          std::vector<PosInfo>& p, std::vector<SpecParInfo>& t, bool wt = false);
   private:
+    int numThreads_; // the layers and discs are extracted on this many threads
     Composite createComposite(std::string name, double density, MaterialProperties& mp, bool nosensors = false);
-    std::vector<ModuleCap>::iterator findPartnerModule(std::vector<ModuleCap>::iterator i,
-                                                       std::vector<ModuleCap>::iterator g, int ponrod, bool find_first = false);
+    typedef std::map<std::pair<int, int>, std::vector<int> > PartnerIndex; // (side of z=0, position on rod) -> ascending positions of the module caps
+    PartnerIndex indexPartnerModules(ModuleCaps& caps);
+    ModuleCaps::iterator findPartnerModule(ModuleCaps& caps, const PartnerIndex& index, ModuleCaps::iterator i,
+                                                       ModuleCaps::iterator g, int ponrod, bool find_first = false);
     double findDeltaR(std::vector<Module*>::iterator start, std::vector<Module*>::iterator stop, double middle);
     double findDeltaZ(std::vector<Module*>::iterator start, std::vector<Module*>::iterator stop, double middle);
     int findSpecParIndex(std::vector<SpecParInfo>& specs, std::string label);
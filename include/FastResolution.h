@@ -0,0 +1,52 @@
+/**
+ * @file FastResolution.h
+ * @brief This is the header file for the analytic estimate of the track parameter resolutions, for quick layout screening
+ */
+
+#ifndef _FASTRESOLUTION_H
+#define _FASTRESOLUTION_H
+
+#include <set>
+#include <string>
+#include <vector>
+#include <DetectorModule.h>
+#include <ModuleCap.h>
+#include <hit.hh>
+
+namespace insur {
+  /**
+   * @class FastResolution
+   * @brief This class estimates the resolutions of the track parameters from the radii and the z of the layers and disks
+   * alone, with the analytic formulas, instead of shooting tracks and fitting their hits.
+   *
+   * The modules are summed up in surfaces, one per ring of a barrel layer (a cylinder of the average radius of its
+   * modules and of their z extent) or of an endcap disk (a disk of the average z of its modules and of their r extent),
+   * on the positive z side, with the average material of their modules and the resolutions of their first module. A
+   * track from the origin is taken to hit each surface it crosses, whatever its phi. The resolution part of the errors
+   * is the weighted least squares fit of the measurements of a tag (a parabola in r-phi, a line in r-z, as Gluckstern
+   * with the actual radii and resolutions), and the multiple scattering part the usual estimates added in quadrature:
+   * the curvature from the material between the first and the last measurement, the impact parameters and the angles
+   * from the beam pipe and the material up to the first measurement. The inactive services are left out.
+   */
+  class FastResolution {
+  public:
+    void addLayers(std::vector<ModuleCaps>& layers);
+    std::set<std::string> tags() const;
+    bool errors(double theta, const std::string& tag, const std::vector<double>& momenta, bool material,
+                bool ipConstraint, double ipRError, double ipZError, std::vector<Track::Errors>& errors) const;
+  private:
+    struct Surface {
+      bool barrel;
+      double position;  // the radius of a barrel ring, the z of a disk ring
+      double low, high; // the extent along the other coordinate: z for a barrel ring, r for a disk ring
+      double radiation; // the average radiation length of the modules, across them
+      double tilt;      // the average tilt of the modules
+      DetectorModule::ResolutionFactors resolution; // of the first module
+      std::set<std::string> tags;
+    };
+    std::vector<Surface> surfaces_;
+    static constexpr double beamPipeRadius = 23.; // mm, as the beam pipe hit of the resolution tracks
+    static constexpr double beamPipeRadiation = 0.0023;
+  };
+}
+#endif /* _FASTRESOLUTION_H */
@@ -17,6 +17,7 @@
 
 #include "global_funcs.h"
 #include "Polygon3d.h"
+#include "CoordinateOperations.h"
 #include "Property.h"
 #include "ModuleBase.h"
 
@@ -34,7 +35,6 @@ enum ModuleShape { RECTANGULAR, WEDGE };
 
 class GeometricModule : public ModuleDecorable {
 protected:
-  int numHits_ = 0;
   int tiltAngle_ = 0., skewAngle_ = 0.;
   Polygon3d<4> basePoly_;
   double triangleCross(const XYZVector& P1, const XYZVector& P2, const XYZVector& P3, const XYZVector& PL, const XYZVector& PU);
@@ -67,14 +67,13 @@ public:
   void rotateX(double angle) { basePoly_.rotateX(angle); tiltAngle_ += angle; }
   void rotateY(double angle) { basePoly_.rotateY(angle); skewAngle_ += angle; }
   void rotateZ(double angle) { basePoly_.rotateZ(angle); }
+  void place(const CoordinateOperations::Placement& placement) { basePoly_.transform(placement); skewAngle_ += placement.yRotation(); }
 
   virtual void accept(GeometryVisitor& v) = 0;
   virtual void accept(ConstGeometryVisitor& v) const = 0;
   virtual void build() = 0;
 
   double trackCross(const XYZVector& PL, const XYZVector& PU);
-  int numHits() const { return numHits_; }
-  void resetHits() { numHits_ = 0; }
 
   virtual ModuleShape shape() const = 0;
 };
@@ -0,0 +1,100 @@
+#ifndef GEOMETRY_ARENA_H
+#define GEOMETRY_ARENA_H
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+
+/**
+ * @class GeometryArena
+ * @brief A monotonic arena the objects of a tracker are allocated from while it is built
+ *
+ * Each thread building a part of the tracker allocates from a lane of its own, in the order the objects are made, so
+ * that the objects of a subdetector lie next to each other in the order the analyses visit them. The objects are still
+ * destroyed one by one, but their memory only goes with the arena, all at once. Outside of the scope of an arena the
+ * objects are allocated from the heap as usual.
+ */
+class GeometryArena {
+  struct Lane {
+    std::vector<std::unique_ptr<char[]> > blocks;
+    char* next = nullptr;
+    char* end = nullptr;
+    std::size_t blockSize;
+    explicit Lane(std::size_t size) : blockSize(size) {}
+  };
+  // every allocation starts with a header telling whether it is in an arena, which keeps the objects aligned
+  static constexpr std::size_t headerSize = alignof(std::max_align_t) > sizeof(bool) ? alignof(std::max_align_t) : sizeof(bool);
+
+  std::size_t blockSize_;
+  std::mutex lanesMutex_;
+  std::vector<std::unique_ptr<Lane> > lanes_;
+
+  static Lane*& currentLane() {
+    static thread_local Lane* lane = nullptr;
+    return lane;
+  }
+  Lane* newLane() {
+    std::lock_guard<std::mutex> lock(lanesMutex_);
+    lanes_.emplace_back(new Lane(blockSize_));
+    return lanes_.back().get();
+  }
+  static char* allocateIn(Lane& lane, std::size_t size) {
+    size = (size + headerSize - 1) / headerSize * headerSize;
+    if (std::size_t(lane.end - lane.next) < size) {
+      std::size_t blockSize = std::max(lane.blockSize, size);
+      lane.blocks.emplace_back(new char[blockSize]);
+      lane.next = lane.blocks.back().get();
+      lane.end = lane.next + blockSize;
+    }
+    char* p = lane.next;
+    lane.next += size;
+    return p;
+  }
+public:
+  /**
+   * @class Scope
+   * @brief Makes an arena the one the objects are allocated from by this thread, in a lane of their own, until the
+   * scope ends
+   */
+  class Scope {
+    Lane* previous_;
+  public:
+    explicit Scope(GeometryArena& arena) : previous_(currentLane()) { currentLane() = arena.newLane(); }
+    ~Scope() { currentLane() = previous_; }
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+  };
+
+  explicit GeometryArena(std::size_t blockSize = 1 << 20) : blockSize_(blockSize) {}
+  GeometryArena(const GeometryArena&) = delete;
+  GeometryArena& operator=(const GeometryArena&) = delete;
+
+  /**
+   * Allocates an object from the arena of the thread's scope, or from the heap if there is none
+   * @param size The size of the object
+   * @return The memory of the object
+   */
+  static void* allocate(std::size_t size) {
+    Lane* lane = currentLane();
+    char* p;
+    if (lane) p = allocateIn(*lane, headerSize + size);
+    else p = static_cast<char*>(::operator new(headerSize + size));
+    *reinterpret_cast<bool*>(p) = lane != nullptr;
+    return p + headerSize;
+  }
+
+  /**
+   * Frees an object allocated by allocate(): the memory of an object of an arena is only freed with the arena
+   * @param object The memory of the object
+   */
+  static void release(void* object) {
+    if (!object) return;
+    char* p = static_cast<char*>(object) - headerSize;
+    if (!*reinterpret_cast<bool*>(p)) ::operator delete(p);
+  }
+};
+
+#endif
@@ -0,0 +1,75 @@
+/**
+ * @file GeometryImage.h
+ * @brief This is the header file for the frozen module table shared by the track simulation and the Hough jobs
+ */
+
+#ifndef _GEOMETRYIMAGE_H
+#define _GEOMETRYIMAGE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <TrackShooter.h>
+
+/**
+ * @class GeometryImage
+ * @brief This class holds the module table of the simulated tracker (the <i>ModuleData</i> of every module) as one
+ * binary file, which the jobs reading the simulated tracks map into memory and look the modules up in without copying
+ * them.
+ *
+ * The file is a header (the magic "tkgeom01", whose last two characters are the version of the format, the size of a
+ * record, the number of modules and a 64-bit FNV-1a hash of the records), the positional references of the modules as
+ * 32-bit keys in increasing order (padded to 8 bytes), and then the <i>ModuleData</i> records in the order of their
+ * keys, in the byte order and the layout of the writing machine. A key packs the counter, z, rho and phi indices of the
+ * reference, one byte each from the most significant one. The track simulation writes the image once per tracks
+ * directory and names its hash in each tracks file, for a job to check that the image is the one of its tracks.
+ */
+class GeometryImage {
+public:
+  GeometryImage() : mapped_(NULL), mappedSize_(0), keys_(NULL), modules_(NULL), numModules_(0), hash_(0) {}
+  ~GeometryImage() { close(); }
+
+  static std::string fileName(const std::string& directory) { return directory + "/geometry.tkgeo"; }
+  static bool write(const std::string& fileName, const std::vector<ModuleData>& modules, uint64_t& hash);
+
+  bool open(const std::string& fileName);
+  void adopt(const std::vector<ModuleData>& modules);
+  void close();
+  size_t size() const { return numModules_; }
+  uint64_t hash() const { return hash_; }
+  const ModuleData* find(char cnt, char z, char rho, char phi) const;
+
+private:
+  GeometryImage(const GeometryImage&) = delete;
+  GeometryImage& operator=(const GeometryImage&) = delete;
+
+  static const char magic[8];
+  struct Header {
+    char magic[8];
+    uint32_t recordSize;
+    uint32_t reserved;
+    uint64_t numModules;
+    uint64_t hash;
+  };
+  static uint32_t key(char cnt, char z, char rho, char phi) {
+    return uint32_t(uint8_t(cnt)) << 24 | uint32_t(uint8_t(z)) << 16 | uint32_t(uint8_t(rho)) << 8 | uint32_t(uint8_t(phi));
+  }
+  static size_t keySpace(size_t numModules) { return (numModules * sizeof(uint32_t) + 7) / 8 * 8; } // the records stay 8-byte aligned
+  static void sortByKey(const std::vector<ModuleData>& modules, std::vector<uint32_t>& keys, std::vector<ModuleData>& sorted);
+  static uint64_t hashRecords(const ModuleData* modules, size_t numModules);
+
+  // what is mapped after opening
+  void* mapped_;
+  size_t mappedSize_;
+  // what is adopted instead, from a module table read otherwise
+  std::vector<uint32_t> ownKeys_;
+  std::vector<ModuleData> ownModules_;
+  // the table looked up, mapped or adopted
+  const uint32_t* keys_;
+  const ModuleData* modules_;
+  size_t numModules_;
+  uint64_t hash_;
+};
+
+#endif /* _GEOMETRYIMAGE_H */
@@ -0,0 +1,56 @@
+/**
+ * @file HelixPropagator.h
+ * @brief This is the header file for the closed-form propagation of a charged track along its helix
+ */
+
+#ifndef _HELIXPROPAGATOR_H
+#define _HELIXPROPAGATOR_H
+
+#include <cmath>
+#include <Math/Vector3D.h>
+
+using ROOT::Math::XYZVector;
+
+namespace insur {
+  /**
+   * @class HelixPropagator
+   * @brief This class follows a track of given transverse momentum and charge, leaving the z axis, along its helix in
+   * the solenoid field.
+   *
+   * The helix is parametrised by its transverse path length s, from the origin of the track: the crossings with a
+   * cylinder around the z axis and with a plane of constant z are in closed form, and the crossing with any other plane
+   * (the plane of a sensor) takes a few Newton steps from a close guess. Only the outgoing half turn is followed, up to
+   * the largest radius the track reaches, 2R. The tangent to the helix at a crossing is the straight line the hit tests
+   * of the straight tracks take: it goes through the crossing point, so the hit found on a plane is exact.
+   */
+  class HelixPropagator {
+  public:
+    /**
+     * @param origin The origin of the track, on the z axis
+     * @param phi The phi of the direction of the track at its origin
+     * @param eta The eta of the track, which the helix keeps
+     * @param radius The radius of curvature, in mm
+     * @param charge The sign of the charge: the track turns clockwise (seen from z+) for a positive charge
+     */
+    HelixPropagator(const XYZVector& origin, double phi, double eta, double radius, int charge) :
+      z0_(origin.Z()), phi0_(phi), cotTheta_(sinh(eta)), radius_(radius), charge_(charge < 0 ? -1 : 1) {}
+
+    double radius() const { return radius_; }
+    double maxRho() const { return 2*radius_; }
+    double maxArc() const { return M_PI*radius_; }
+
+    XYZVector position(double s) const;
+    XYZVector direction(double s) const;
+    double positionPhi(double s) const { return phi0_ - charge_*s/(2*radius_); }
+    double positionEta(double s) const; // as seen from the origin of the track
+
+    double arcToRho(double rho) const; // -1 if the track does not reach rho
+    double arcToZ(double z) const; // -1 if the track does not reach z within its outgoing half turn
+    void arcsToRhos(const double* rhos, double* arcs, int n) const;
+    double arcToPlane(const XYZVector& normal, double d, double guess) const; // -1 if no crossing was found
+  private:
+    double z0_, phi0_, cotTheta_, radius_;
+    int charge_;
+  };
+}
+#endif /* _HELIXPROPAGATOR_H */
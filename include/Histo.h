@@ -7,6 +7,9 @@
 #include <map>
 #include <iostream>
 #include <algorithm>
+#include <utility>
+#include <cstring>
+#include <stdint.h>
 
 #include <TH1.h>
 #include <TH2.h>
@@ -79,6 +82,12 @@ public:
   size_t size() const { return N; }
   bool operator<(const BinKey<N, T>& other) const { return ArrayCompare<N, T>::less(BinKey<N, T>::elems_, other.elems_); }
   bool operator!=(const BinKey<N, T>& other) const { return !ArrayCompare<N, T>::equal(BinKey<N, T>::elems_, other.elems_); }
+  bool operator==(const BinKey<N, T>& other) const { return ArrayCompare<N, T>::equal(BinKey<N, T>::elems_, other.elems_); }
+  size_t hash() const {
+    uint64_t h = 0;
+    for (int i=0; i < N; i++) h = (h ^ uint64_t(elems_[i])) * 0x100000001b3ULL + 0x9e3779b97f4a7c15ULL;
+    return size_t(h ^ (h >> 29));
+  }
   bool underflow() const { return std::count(elems_, elems_+N, MinGetter()); } 
   bool overflow() const { return std::count(elems_, elems_+N, MaxGetter()); }
   static T min() { return MinGetter(); }
@@ -86,6 +95,87 @@ public:
 };
 
 
+/*
+ * The filled bins of a Histo, in an open-addressing hash table with linear probing: a fill or a lookup costs O(1)
+ * on average and the bins sit in one array, instead of one tree node each. The bins are in no particular order.
+ */
+template<class K, class T>
+class BinStore {
+public:
+  typedef std::pair<K, T> value_type;
+
+  class const_iterator {
+    const BinStore<K, T>* store_;
+    size_t i_;
+    void skip() { while (i_ < store_->used_.size() && !store_->used_[i_]) i_++; }
+  public:
+    const_iterator(const BinStore<K, T>* store, size_t i) : store_(store), i_(i) { skip(); }
+    const_iterator& operator++() { i_++; skip(); return *this; }
+    const value_type& operator*() const { return store_->slots_[i_]; }
+    const value_type* operator->() const { return &store_->slots_[i_]; }
+    bool operator==(const const_iterator& other) const { return i_ == other.i_; }
+    bool operator!=(const const_iterator& other) const { return i_ != other.i_; }
+  };
+
+  BinStore() : size_(0) {}
+  size_t size() const { return size_; }
+  const_iterator begin() const { return const_iterator(this, 0); }
+  const_iterator end() const { return const_iterator(this, used_.size()); }
+  void clear() { slots_.clear(); used_.clear(); size_ = 0; }
+
+  void reserve(size_t n) {
+    size_t capacity = 16;
+    while (capacity < 2*n) capacity *= 2;
+    if (capacity > used_.size()) rehash(capacity);
+  }
+
+  T& operator[](const K& key) { // a bin that was never filled is created with T()
+    if (2*(size_+1) > used_.size()) rehash(used_.empty() ? 16 : 2*used_.size());
+    size_t i = slot(key);
+    if (!used_[i]) {
+      used_[i] = true;
+      slots_[i] = value_type(key, T());
+      size_++;
+    }
+    return slots_[i].second;
+  }
+
+  template<class Predicate> void eraseIf(Predicate erase) { // the table is rebuilt, as linear probing has no tombstones
+    BinStore<K, T> kept;
+    kept.reserve(size_);
+    for (const_iterator it = begin(); it != end(); ++it) if (!erase(*it)) kept[it->first] = it->second;
+    slots_.swap(kept.slots_);
+    used_.swap(kept.used_);
+    size_ = kept.size_;
+  }
+
+private:
+  std::vector<value_type> slots_;
+  std::vector<char> used_;
+  size_t size_;
+
+  size_t slot(const K& key) const { // the capacity is a power of 2, and never more than half full
+    size_t mask = used_.size() - 1;
+    size_t i = key.hash() & mask;
+    while (used_[i] && slots_[i].first != key) i = (i + 1) & mask;
+    return i;
+  }
+
+  void rehash(size_t capacity) {
+    std::vector<value_type> slots(capacity);
+    std::vector<char> used(capacity, false);
+    slots.swap(slots_);
+    used.swap(used_);
+    for (size_t i = 0; i < used.size(); i++) {
+      if (!used[i]) continue;
+      size_t j = slot(slots[i].first);
+      used_[j] = true;
+      slots_[j] = slots[i];
+    }
+  }
+};
+
+
 template<int N, class T, class B = BinKey<N, unsigned> >
 class Histo {
 public:
@@ -96,7 +186,7 @@ public:
 
   typedef std::pair<ExportableBinKey, T> exportable_iterator_element;
   typedef std::pair<InternalBinKey, T> internal_iterator_element;
-  typedef typename std::map<InternalBinKey, T>::const_iterator internal_iterator;
+  typedef typename BinStore<InternalBinKey, T>::const_iterator internal_iterator;
 
   template<class U, class ExportableIteratorElement = typename U::exportable_iterator_element, class InternalIterator = typename U::internal_iterator>
   class ConstIterator : public std::iterator<std::input_iterator_tag, ExportableIteratorElement> { // this is by definition a const iterator
@@ -172,7 +262,7 @@ public:
 protected:
   friend class ConstIterator<Histo<N, T, B> >;
 
-  std::map<InternalBinKey, T> bins_;
+  BinStore<InternalBinKey, T> bins_;
   InternalBinKey currentBin_;
 
   int nbins_[N];
@@ -264,13 +354,13 @@ public:
     Histo<M, T, B>* folded = new Histo<M, T>();
     for (int i=0; i < M; i++) {
       int index = indices[i];
-      folded.setBinning(i, nbins_[index], lo_[index], hi_[index]);
+      folded->setBinning(i, nbins_[index], lo_[index], hi_[index]);
     }
 
-    for (typename std::map<InternalBinKey, T>::const_iterator it = bins_.begin(); it != bins_.end(); ++it) {
+    for (internal_iterator it = bins_.begin(); it != bins_.end(); ++it) {
       typename Histo<M, T>::InternalBinKey key;
       for (int i=0; i < M; i++) key.set(i, it->first.at(indices[i]));
-      folded.bins_[key] += it->second;
+      folded->bins_[key] += it->second;
     }
 
     return folded;
@@ -291,14 +381,14 @@ public:
 
   void clear() {
     bins_.clear();
-    min_ = std::numeric_limits<T>::max;
+    min_ = std::numeric_limits<T>::max();
     max_ = T(0);
   }
 
   void suppressZeros(const T& threshold = T(0)) {
-    for (typename std::map<InternalBinKey, T>::iterator it = bins_.begin(); it != bins_.end(); it++) {
-      if ((-threshold <= it->second && it->second <= threshold) || it->first.overflow() || it->first.underflow()) bins_.erase(it);
-    }
+    bins_.eraseIf([&threshold](const internal_iterator_element& bin) {
+      return (-threshold <= bin.second && bin.second <= threshold) || bin.first.overflow() || bin.first.underflow();
+    });
   }
 
   void serialize(ostream& out) {
@@ -307,19 +397,53 @@ public:
     for (int i=0; i<N; i++) out << hi_[i] << (i<N-1 ? " " : "\r\n");
     out << min_ << " " << max_ << std::endl;
     out << bins_.size() << std::endl;
-    for (typename std::map<InternalBinKey, T>::const_iterator it = bins_.begin(); it != bins_.end(); ++it) {
+    for (internal_iterator it = bins_.begin(); it != bins_.end(); ++it) {
       for (int i=0; i<N; i++) out << it->first.at(i) << " ";
       out << it->second << std::endl;
     }
   }
 
-  bool deserialize(istream& in) {
+  // The binary layout: the magic, the layout version, N, the sizes of a key element and of a bin, the binning, min and max,
+  // the number of bins and then the bins as fixed-size records (N key elements then the bin, unpadded), all in the native
+  // byte order, so that the records can be read in one block or mapped in place. Only for bins that are plain data.
+  static const char* binaryMagic() { return "HSTB"; }
+  enum { BinaryVersion = 1 };
+
+  void serializeBinary(ostream& out) const {
+    typedef typename InternalBinKey::ElemType KeyElem;
+    uint32_t header[4] = { BinaryVersion, N, sizeof(KeyElem), sizeof(T) };
+    uint64_t size = bins_.size();
+    out.write(binaryMagic(), 4);
+    out.write((const char*)header, sizeof(header));
+    out.write((const char*)nbins_, sizeof(nbins_));
+    out.write((const char*)lo_, sizeof(lo_));
+    out.write((const char*)hi_, sizeof(hi_));
+    out.write((const char*)&min_, sizeof(T));
+    out.write((const char*)&max_, sizeof(T));
+    out.write((const char*)&size, sizeof(size));
+    std::vector<char> record(N*sizeof(KeyElem) + sizeof(T));
+    for (internal_iterator it = bins_.begin(); it != bins_.end(); ++it) {
+      for (int i=0; i<N; i++) { KeyElem elem = it->first.at(i); memcpy(&record[i*sizeof(KeyElem)], &elem, sizeof(KeyElem)); }
+      memcpy(&record[N*sizeof(KeyElem)], &it->second, sizeof(T));
+      out.write(&record[0], record.size());
+    }
+  }
+
+  bool deserialize(istream& in) { // reads either layout, telling the binary one by its magic
+    bins_.clear();
+    char magic[4] = { 0, 0, 0, 0 };
+    if (in.peek() == binaryMagic()[0]) {
+      in.read(magic, 4);
+      if (!in || memcmp(magic, binaryMagic(), 4)) return false;
+      return deserializeBinary(in);
+    }
     for (int i=0; i<N; i++) in >> nbins_[i];
     for (int i=0; i<N; i++) in >> lo_[i];
     for (int i=0; i<N; i++) in >> hi_[i];
     in >> min_ >> max_;
     size_t size;
     in >> size;
+    bins_.reserve(size);
     size_t i = 0;
     for (; i < size && !in.eof(); i++) {
       InternalBinKey key;
@@ -331,7 +455,35 @@ public:
     return true;
   }
 
+protected:
+  bool deserializeBinary(istream& in) { // after the magic
+    typedef typename InternalBinKey::ElemType KeyElem;
+    uint32_t header[4];
+    uint64_t size;
+    in.read((char*)header, sizeof(header));
+    if (!in || header[0] != BinaryVersion || header[1] != N || header[2] != sizeof(KeyElem) || header[3] != sizeof(T)) return false;
+    in.read((char*)nbins_, sizeof(nbins_));
+    in.read((char*)lo_, sizeof(lo_));
+    in.read((char*)hi_, sizeof(hi_));
+    in.read((char*)&min_, sizeof(T));
+    in.read((char*)&max_, sizeof(T));
+    in.read((char*)&size, sizeof(size));
+    if (!in) return false;
+    size_t recordSize = N*sizeof(KeyElem) + sizeof(T);
+    std::vector<char> records(size*recordSize);
+    if (size) in.read(&records[0], records.size());
+    if (size_t(in.gcount()) != records.size() && size) return false;
+    bins_.reserve(size);
+    for (size_t i = 0; i < size; i++) {
+      const char* record = &records[i*recordSize];
+      InternalBinKey key;
+      for (int j=0; j<N; j++) { KeyElem elem; memcpy(&elem, record + j*sizeof(KeyElem), sizeof(KeyElem)); key.set(j, elem); }
+      memcpy(&bins_[key], record + N*sizeof(KeyElem), sizeof(T));
+    }
+    return true;
+  }
 
+public:
   Indexer<N-1, Histo<N,T,B> > operator[](double x) {
     InternalBinKey k; k.set(0, coordToKey(x,0));
     return Indexer<N-1, Histo<N,T,B> >(*this, k);
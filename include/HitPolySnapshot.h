@@ -0,0 +1,55 @@
+/**
+ * @file HitPolySnapshot.h
+ * @brief This is the header file for the structure-of-arrays copy of the sensor hit polygons used by the track hit tests
+ */
+
+#ifndef _HITPOLYSNAPSHOT_H
+#define _HITPOLYSNAPSHOT_H
+
+#include <vector>
+#include <utility>
+#include <Math/Vector3D.h>
+#include <Polygon3d.h>
+
+using ROOT::Math::XYZVector;
+
+namespace insur {
+  /**
+   * @class HitPolySnapshot
+   * @brief This class keeps the hit polygons of a set of sensors in contiguous arrays, one per coordinate.
+   *
+   * The polygons are tested against a track in blocks, with no branches within a block, so that the compiler can
+   * vectorise the test. The arithmetic is the same as that of <i>Sensor::checkHitSegment()</i>, operation by operation,
+   * hence the hits found are the same. The snapshot has to be rebuilt whenever the geometry changes.
+   *
+   * The polygons can first be tested in single precision, from a float copy of the arrays (twice the polygons per
+   * vector, half the memory read), with a tolerance that only rejects the polygons clearly missed: the others are then
+   * tested in double precision as above, hence the hits are still the same.
+   */
+  class HitPolySnapshot {
+  public:
+    static const int blockSize = 4;
+    static const int singlePrecisionBlockSize = 8;
+    HitPolySnapshot() : singlePrecision_(false) {}
+    void useSinglePrecision(bool use) { singlePrecision_ = use; }
+    void clear();
+    int add(const Polygon3d<4>& poly, double stripLength);
+    int size() const { return (int)nx_.size(); }
+    bool empty() const { return nx_.empty(); }
+    XYZVector normal(int poly) const { return XYZVector(nx_[poly], ny_[poly], nz_[poly]); }
+    double distance(int poly) const { return d_[poly]; } // of the plane of the polygon from the origin, along its normal
+    void checkHitSegments(const std::vector<int>& polys, const XYZVector& trackOrig, const XYZVector& trackDir,
+                          std::vector<std::pair<XYZVector, int> >& result) const;
+  private:
+    bool singlePrecision_;
+    // the single precision test rejects a polygon whose angle sum exceeds its double area by more than this fraction of it
+    static constexpr float singlePrecisionMargin = 1e-2f;
+    void checkHitSegmentsDouble(const std::vector<int>& polys, const XYZVector& trackOrig, const XYZVector& trackDir,
+                                std::vector<std::pair<XYZVector, int> >& result) const;
+    std::vector<double> nx_, ny_, nz_, d_, area_;   // plane and double area of the polygons
+    std::vector<double> vx_[4], vy_[4], vz_[4];     // vertices
+    std::vector<double> ux_, uy_, uz_, stripLength_; // direction and length of the strips, from the first vertex
+    std::vector<float> fnx_, fny_, fnz_, fd_, farea_, fvx_[4], fvy_[4], fvz_[4]; // the single precision copy of the planes and vertices
+  };
+}
+#endif /* _HITPOLYSNAPSHOT_H */
@@ -14,6 +14,7 @@
 
 #include <Histo.h>
 #include <TrackShooter.h>
+#include <GeometryImage.h>
 #include <ptError.h>
 #include <global_funcs.h>
 
@@ -98,7 +99,7 @@ struct SmartBin {
 
 class HoughTrack {
 
-  SparseMatrix<ModuleData, 4> mods_;
+  GeometryImage mods_; // mapped from the image of the tracks directory, or read from the geometry tree
   typedef Histo<4, SmartBin, BinKey<4, uint16_t> > HistoType;
   HistoType histo_;
 
@@ -108,6 +109,8 @@ class HoughTrack {
 
   double calcPhi0(double x, double y, double pt);
   double calcTheta(double x, double y, double z, double z0, double pt);
+  double calcArcLength(double x, double y, double pt);
+  double calcTheta(double arcLength, double z, double z0);
   void processHit(int evid, int hitid, double x, double y, double z, double pt, double ptError, double yres);
   void loadGeometryData(TFile* infile);
 
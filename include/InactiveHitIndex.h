@@ -0,0 +1,51 @@
+/**
+ * @file InactiveHitIndex.h
+ * @brief This is the header file for the eta binned lookup of the inactive elements a straight track can cross
+ */
+
+#ifndef _INACTIVEHITINDEX_H
+#define _INACTIVEHITINDEX_H
+
+#include <vector>
+#include <map>
+#include <InactiveElement.h>
+
+namespace insur {
+  /**
+   * @class InactiveHitIndex
+   * @brief This class bins a collection of <i>InactiveElement</i> in eta, as seen from the origin.
+   *
+   * The inactive volumes are symmetric around the z axis, so whether a track crosses one of them only depends on
+   * the eta of the track. Each bin lists, in their original order within the collection, the indices of the elements
+   * whose eta range overlaps it: a track only needs to be checked against the elements in the bin its eta falls in.
+   * The bins are computed from the same eta ranges the hit test uses, so no element which the track crosses is left out.
+   * An index can be restricted to the elements of one category, for the scans that only look at that category.
+   * Each bin keeps the eta ranges of its elements in arrays of their own, next to their indices: the hit test of a
+   * track runs over them in one loop without branches, neither recomputing the ranges nor reading the elements,
+   * which are only needed once the track is found to cross them.
+   */
+  class InactiveHitIndex {
+  public:
+    InactiveHitIndex() : etaMin_(0), etaMax_(0), etaBins_(0) {}
+    void build(std::vector<InactiveElement>& elements, MaterialProperties::Category cat = MaterialProperties::no_cat);
+    int crossings(double eta, std::vector<int>& crossed) const;
+    int numBins() const { return etaBins_; }
+    bool empty() const { return bins_.empty(); }
+  private:
+    static const int maxBins;
+    double etaMin_, etaMax_;
+    int etaBins_;
+    struct Bin {
+      std::vector<int> elements; // the indices within the collection
+      std::vector<double> etaMin, etaMax; // the eta range of each of the elements
+    };
+    std::vector<Bin> bins_;
+    int etaBin(double eta) const;
+  };
+
+  /**
+   * A collection of indices, keyed by the address of the collection of inactive elements and by the category the index is restricted to
+   */
+  typedef std::map<std::pair<const std::vector<InactiveElement>*, MaterialProperties::Category>, InactiveHitIndex> InactiveHitIndexMap;
+}
+#endif /* _INACTIVEHITINDEX_H */
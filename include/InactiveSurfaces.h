@@ -44,6 +44,7 @@ namespace insur {
     std::vector<InactiveElement>& getEndcapServices(); // may return empty vector
     // supports
     void addSupportPart(InactiveElement support);
+    void addSupportParts(const std::vector<InactiveElement*>& parts);
     InactiveElement& getSupportPart(int index); // throws exception
     std::vector<InactiveElement>::iterator removeSupportPart(int index);
     std::vector<InactiveElement>& getSupports(); // may return empty vector
@@ -35,7 +35,8 @@ public:
   IrradiationMap();
 
   /**
-   * Populate the map attributes reading the passed file
+   * Populate the map attributes reading the passed file, or the binary cache next to it if it was written from the
+   * file as it is now (the cache is written when the file is parsed)
    * @param irradiationMapFile is the path of the raw file for the irradiation map to be read
    */
   void ingest(std::string irradiationMapFile);
@@ -57,6 +58,7 @@ public:
    * @return True if the point is inside the map region, false otherwise
    */
   bool isInRegion(std::pair<double,double> coordinates) const;
+  bool isInRegion(double z, double rho) const;
 
   /**
    * Get the irradiation of the point
@@ -65,6 +67,15 @@ public:
    */
   double calculateIrradiation(std::pair<double,double> coordinates) const;
 
+  /**
+   * Get the irradiation of a batch of points
+   * @param z is the array of the Z coordinates of the points
+   * @param rho is the array of the Rho coordinates of the points
+   * @param out is the array the values of the irradiation are written to, 0 for the points outside the map
+   * @param n is the number of points
+   */
+  void calculateIrradiation(const double* z, const double* rho, double* out, size_t n) const;
+
 private:
   const std::string comp_rhoMin = "# R min: ";                  /**< Prefix of the line of the header of the feeded file that precedes the value of min rho*/
   const std::string comp_rhoMax = "# R max: ";                  /**< Prefix of the line of the header of the feeded file that precedes the value of max rho*/
@@ -86,7 +97,45 @@ private:
   long int zBinNum;     /**< The value of the number of bins in Z*/
   double invFemUnit;    /**< The value of the normalization value in fb^-1*/
 
-  std::vector< std::vector<double> > irradiation;       /**< The matrix (rho * Z) that contains the irradiation values for each bin of the map*/
+  std::vector<double> irradiationGrid;  /**< The matrix (rho * Z) that contains the irradiation values for each bin of the map, one rho row after the other*/
+  size_t gridWidth;                     /**< The number of Z bins in a row of the grid*/
+
+  /**
+   * Parse the raw file of the map
+   * @param irradiationMapFile is the path of the raw file
+   * @return True if the file was read and all the values were found, false otherwise
+   */
+  bool parse(const std::string& irradiationMapFile);
+
+  /**
+   * The binary cache of a map: the magic, the version, the size and modification time of the raw file it was written
+   * from, the values of the header (converted as after parsing), the grid width and size, then the grid in one block,
+   * all in the native byte order
+   */
+  static const char* cacheMagic() { return "IRMB"; }
+  enum { CacheVersion = 1 };
+  static std::string cacheFile(const std::string& irradiationMapFile) { return irradiationMapFile + ".cache"; }
+
+  /**
+   * Read the map from its binary cache
+   * @param irradiationMapFile is the path of the raw file of the map
+   * @return True if there is a cache written from the raw file as it is now and it was read, false otherwise
+   */
+  bool readCache(const std::string& irradiationMapFile);
+
+  /**
+   * Write the binary cache of the map next to its raw file, if the directory can be written to
+   * @param irradiationMapFile is the path of the raw file of the map
+   */
+  void writeCache(const std::string& irradiationMapFile) const;
+
+  /**
+   * Interpolate the irradiation between the 4 bin centers nearest to a point inside the map
+   * @param zCoordinate is the Z coordinate of the point
+   * @param rhoCoordinate is the Rho coordinate of the point
+   * @return the value of the irradiation of the point
+   */
+  double interpolate(double zCoordinate, double rhoCoordinate) const;
 };
 
 
@@ -36,6 +36,14 @@ public:
    */
   void addIrradiationMap(std::string newIrradiationMapFile);
 
+  /**
+   * Read a map file once per process: the managers adding it afterwards (as the
+   * layouts of a batch forked from this process) copy the parsed map
+   * @param irradiationMapFile is the path of the map file
+   * @return The parsed map
+   */
+  static const IrradiationMap& cachedIrradiationMap(const std::string& irradiationMapFile);
+
   /**
    * Get the irradiation of the point in the passed coordinates using the best
    * avaiable map that contains that point
@@ -44,6 +52,15 @@ public:
    */
   double calculateIrradiationPower(std::pair<double,double> coordinates) const;
 
+  /**
+   * Get the irradiation of a batch of points, each from the best avaiable map that contains it
+   * @param z is the array of the Z coordinates of the points
+   * @param rho is the array of the Rho coordinates of the points
+   * @param out is the array the values of the irradiation are written to
+   * @param n is the number of points
+   */
+  void calculateIrradiationPower(const double* z, const double* rho, double* out, size_t n) const;
+
 private:
 
   /**
@@ -105,6 +105,7 @@ public:
 
   void check() override;
   void build();
+  void releaseBuildState() override { PropertyObject::releaseBuildState(); ringNode.release(); stationsNode.release(); materialObject_.releaseBuildState(); }
 
   const Container& rods() const { return rods_; }
 
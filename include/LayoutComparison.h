@@ -0,0 +1,36 @@
+/**
+ * @file LayoutComparison.h
+ * @brief This is the header file for the comparison of layouts analysed with the same tracks
+ */
+
+#ifndef _LAYOUTCOMPARISON_H
+#define _LAYOUTCOMPARISON_H
+
+#include <ostream>
+#include <string>
+#include <TDirectory.h>
+#include <TNtupleD.h>
+
+namespace insur {
+  /**
+   * @class LayoutComparison
+   * @brief This class compares what the same tracks found in two layouts, from the track samples the analyses of each
+   * layout wrote (see <i>Analyzer::writeTrackSamples()</i>).
+   *
+   * When the layouts are analysed with the same random seed, their tracks have the same directions and origins (they
+   * draw them from counter-based streams): the tracks are paired by their index, and the difference between the layouts
+   * is averaged over the differences of the pairs. Since both tracks of a pair see mostly the same detector, their
+   * values are correlated, and the error of the mean difference (from the spread of the differences) is much smaller
+   * than the error of the difference of two independent samples, which is given alongside: their squared ratio is the
+   * factor more tracks two independent scans would need for the same precision.
+   */
+  class LayoutComparison {
+  public:
+    LayoutComparison(int etaBins = 40) : etaBins_(etaBins) {}
+    bool compare(const std::string& referenceFile, const std::string& layoutFile, const std::string& outputFile, std::ostream& summary) const;
+  private:
+    int etaBins_;
+    bool compareSamples(TNtupleD* reference, TNtupleD* layout, const std::string& name, TDirectory& output, std::ostream& summary) const;
+  };
+}
+#endif /* _LAYOUTCOMPARISON_H */
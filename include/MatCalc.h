@@ -17,8 +17,10 @@
 #include <boost/property_tree/xml_parser.hpp>
 
 #include <list>
+#include <map>
 #include <string>
 #include <stdexcept>
+#include <tuple>
 #include <ModuleCap.h>
 #include <MaterialTable.h>
 #include <InactiveElement.h>
@@ -76,12 +78,12 @@ namespace insur {
     bool typeRegistered(std::string type);
     unsigned int registeredTypes();
     MaterialTable& getMaterialTable();
-    virtual bool calculateBarrelMaterials(std::vector<std::vector<ModuleCap> >& barrelcaps);
-    virtual bool calculateEndcapMaterials(std::vector<std::vector<ModuleCap> >& endcapcaps);
-    virtual bool calculateBarrelServiceMaterials(std::vector<std::vector<ModuleCap> >& barrelcaps,
+    virtual bool calculateBarrelMaterials(std::vector<ModuleCaps>& barrelcaps);
+    virtual bool calculateEndcapMaterials(std::vector<ModuleCaps>& endcapcaps);
+    virtual bool calculateBarrelServiceMaterials(std::vector<ModuleCaps>& barrelcaps,
                                                  std::vector<InactiveElement>& barrelservices, std::vector<InactiveElement>& endcapservices);
     virtual bool calculateEndcapServiceMaterials(
-      std::vector<std::vector<ModuleCap> >& endcapcaps,
+      std::vector<ModuleCaps>& endcapcaps,
       std::vector<InactiveElement>& barrelservices, std::vector<InactiveElement>& endcapservices);
     virtual bool calculateSupportMaterials(std::vector<InactiveElement>& supports);
     void printInternals();
@@ -187,15 +189,41 @@ namespace insur {
     SingleSerExit& getSingleSer(std::string tag1, std::string tag2, Matunit u1, Matunit u2, bool local); // throws exception
     SingleSup& getSingleSup(std::string tag, Matunit uM, MaterialProperties::Category cM); // throws exception
   private:
+    /**
+     * @struct RingPart
+     * @brief One part of the recipe of the materials of a ring of modules: the materials of a module type, converted for
+     * the length and surface of the modules they come from; together, the parts identify modules whose materials are equal.
+     * @param type The module type
+     * @param travelling True for the materials travelling from an inner ring (the A and C components), false for the local ones (B and D)
+     * @param length The length the materials given per unit length are converted for
+     * @param surface The surface the materials given per unit surface or volume are converted for
+     * @param stripsegScalar The factor for the layout of chips and segments, applied to the A and B components
+     * @param multiplier The number of modules of the ring of origin, for the travelling materials of the endcaps
+     * @param divisor The number of modules of the ring receiving them
+     */
+    struct RingPart {
+      std::string type;
+      bool travelling;
+      double length, surface, stripsegScalar, multiplier, divisor;
+      RingPart(const std::string& t, bool tr, double l, double s, double scalar, double m = 1., double d = 1.) :
+        type(t), travelling(tr), length(l), surface(s), stripsegScalar(scalar), multiplier(m), divisor(d) {}
+      bool operator<(const RingPart& other) const {
+        return std::tie(type, travelling, length, surface, stripsegScalar, multiplier, divisor)
+          < std::tie(other.type, other.travelling, other.length, other.surface, other.stripsegScalar, other.multiplier, other.divisor);
+      }
+    };
+    void addRingMaterials(ModuleCap& cap, const std::vector<RingPart>& parts);
+    void assignRingMaterials(ModuleCaps& caps, const std::list<int>& ring, const std::vector<RingPart>& parts,
+                             std::map<std::vector<RingPart>, ModuleCap*>& ringMaterials);
     bool entryExists(std::string type);
     bool entryExists(std::string tag, std::string type, std::string comp, Matunit uA, Matunit uB, Matunit uC, Matunit uD, bool local);
     bool entryExists(std:: string tag, Matunit uQ);
     bool entryExists(std::string tag1, std::string tag2, Matunit uIn, Matunit uOut, bool local);
     bool entryExists(std::string tag, Matunit uM, MaterialProperties::Category cM);
-    int findBarrelRods(std::vector<std::vector<ModuleCap> >& caps, int layer);
-    int findEndcapRods(std::vector<std::vector<ModuleCap> >& caps, int layer);
+    int findBarrelRods(std::vector<ModuleCaps>& caps, int layer);
+    int findEndcapRods(std::vector<ModuleCaps>& caps, int layer);
     double convert(double value, Matunit unit, double densityorlength, double surface = 0); // throws exception
-    void adjacentDifferentCategory(std::vector<ModuleCap>& source, InactiveElement& dest, int r, double l, double s);
+    void adjacentDifferentCategory(ModuleCaps& source, InactiveElement& dest, int r, double l, double s);
     void adjacentSameCategory(InactiveElement& source, InactiveElement& dest);
   };
 }
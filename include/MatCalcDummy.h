@@ -29,13 +29,13 @@ namespace insur {
   public:
     MatCalcDummy();
     virtual ~MatCalcDummy() {}
-    virtual bool calculateBarrelMaterials(std::vector<std::vector<ModuleCap> >& barrelcaps);
-    virtual bool calculateEndcapMaterials(std::vector<std::vector<ModuleCap> >& endcapcaps);
+    virtual bool calculateBarrelMaterials(std::vector<ModuleCaps>& barrelcaps);
+    virtual bool calculateEndcapMaterials(std::vector<ModuleCaps>& endcapcaps);
     virtual bool calculateBarrelServiceMaterials(
-      std::vector<std::vector<ModuleCap> >& barrelcaps,
+      std::vector<ModuleCaps>& barrelcaps,
       std::vector<InactiveElement>& barrelservices, std::vector<InactiveElement>& endcapservices);
     virtual bool calculateEndcapServiceMaterials(
-      std::vector<std::vector<ModuleCap> >& endcapcaps,
+      std::vector<ModuleCaps>& endcapcaps,
       std::vector<InactiveElement>& barrelservices, std::vector<InactiveElement>& endcapservices);
     virtual bool calculateSupportMaterials(std::vector<InactiveElement>& supports);
   private:
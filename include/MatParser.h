@@ -20,6 +20,7 @@
 #include <MatCalc.h>
 #include <MaterialTable.h>
 #include <global_constants.h>
+#include <global_funcs.h>
 #include <boost/filesystem/exception.hpp>
 #include <boost/filesystem/operations.hpp>
 #include <boost/algorithm/string/trim.hpp>
@@ -96,14 +97,14 @@ namespace insur {
         bool readParameters(std::string configfile, MatCalc& calc);
         bool initMatCalc(std::string configfile, MatCalc& calc, std::string mattabdir );
     protected:
-        bool parseStripsSegs(std::ifstream& instream, std::string& strips, std::string& segs);
-        bool parseMLine(std::string line, std::string type, MatCalc& calc, std::string comp);
-        bool parseDLine(std::string line, MatCalc& calc);
-        bool parseSimpleLine(std::string line, MatCalc& calc, std::string marker);
+        bool parseStripsSegs(std::istream& instream, std::string& strips, std::string& segs);
+        bool parseMLine(const std::string& line, const std::string& type, MatCalc& calc, const std::string& comp);
+        bool parseDLine(const std::string& line, MatCalc& calc);
+        bool parseSimpleLine(const std::string& line, MatCalc& calc, const std::string& marker);
     private:
-        std::string readFromLine(std::string source, std::string paramname);
-        std::string getValue(std::string source, bool final_delim = true, std::string delimiter = name_value_delim);
-        MatCalc::Matunit getUnit(std::string source); // throws exception
+        std::string readFromLine(const std::string& source, const std::string& paramname);
+        std::string getValue(const std::string& source, bool final_delim = true, const std::string& delimiter = name_value_delim);
+        MatCalc::Matunit getUnit(const std::string& source); // throws exception
     };
 }
 #endif	/* _MATPARSER_H */
@@ -44,18 +44,18 @@ namespace insur {
     virtual ~MaterialBudget();
     Tracker& getTracker();
     InactiveSurfaces& getInactiveSurfaces();
-    std::vector<std::vector<ModuleCap> >& getBarrelModuleCaps();
-    std::vector<std::vector<ModuleCap> >& getEndcapModuleCaps();
+    std::vector<ModuleCaps>& getBarrelModuleCaps();
+    std::vector<ModuleCaps>& getEndcapModuleCaps();
     void materialsAll(MatCalc& calc);
     void print();
   protected:
     Tracker* tracker;
     InactiveSurfaces* inactive;
-    std::vector<std::vector<ModuleCap> > capsbarrelmods, capsendmods;
+    std::vector<ModuleCaps> capsbarrelmods, capsendmods;
     void materialsSupports(MatCalc& calc);
     void materialsServices(MatCalc& calc);
     void materialsModules(MatCalc& calc);
-    int onBoundary(std::vector<std::vector<ModuleCap> >& source, int layer); //throws exception
+    int onBoundary(std::vector<ModuleCaps>& source, int layer); //throws exception
   private:
     MaterialBudget();
     MaterialBudget(const MaterialBudget& budget);
@@ -0,0 +1,75 @@
+#ifndef MATERIALKEYS_H
+#define MATERIALKEYS_H
+
+#include <deque>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace material {
+
+  /**
+   * @class MaterialKeys
+   * @brief The symbol table of the material and component names, which gives each of them a dense integer key
+   *
+   * The keys are handed out in order of first request, starting from 0, and are never reused: an element resolves
+   * its names once and then fills the mass maps of the MaterialProperties by key. The names, and the component
+   * name before its first '_' (the one the masses by component are summed under), stay at the same address.
+   */
+  class MaterialKeys {
+    std::unordered_map<std::string, int> keys_;
+    std::deque<std::string> names_;
+    std::vector<const std::string*> subNames_;
+    std::mutex mutex_; // the names of independent objects may be resolved from different threads
+    MaterialKeys() {}
+
+    int makeKey(const std::string& name) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto found = keys_.find(name);
+      if (found != keys_.end()) return found->second;
+      return insert(name);
+    }
+
+    int insert(const std::string& name) {
+      int key = names_.size();
+      keys_[name] = key;
+      names_.push_back(name);
+      subNames_.push_back(&names_.back());
+      std::stringstream ss(name);
+      std::string subName;
+      std::getline(ss, subName, '_');
+      if (subName != name) {
+        auto found = keys_.find(subName);
+        subNames_[key] = &names_[found != keys_.end() ? found->second : insert(subName)];
+      }
+      return key;
+    }
+
+    const std::string& nameOf(int key) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      return names_.at(key);
+    }
+
+    const std::string& subNameOf(int key) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      return *subNames_.at(key);
+    }
+
+  public:
+    static const int noKey = -1;
+
+    static MaterialKeys& instance() {
+      static MaterialKeys mk;
+      return mk;
+    }
+
+    static int key(const std::string& name) { return instance().makeKey(name); }
+    static const std::string& name(int key) { return instance().nameOf(key); }
+    static const std::string& subName(int key) { return instance().subNameOf(key); }
+  };
+
+}
+
+#endif
@@ -0,0 +1,60 @@
+/**
+ * @file MaterialMapTree.h
+ * @brief This is the header file for the adaptive (z, r) map the material tracks accumulate their crossings into
+ */
+
+#ifndef _MATERIALMAPTREE_H
+#define _MATERIALMAPTREE_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <TDirectory.h>
+#include <TH2D.h>
+#include <TVectorD.h>
+
+namespace insur {
+  /**
+   * @class MaterialMapTree
+   * @brief This class accumulates the material found at points of a square region of the (z, r) plane, as the sum and
+   * the number of the values filled in each cell of a quadtree.
+   *
+   * Only the finest cells filled are stored, by the Morton code of their position (the bits of the two indices
+   * interleaved, so that the four children of a cell are consecutive codes): thin layers of material cost the cells
+   * they cross, not the whole region. When more cells than the bound are filled, the cells are replaced by their
+   * parents, one level at a time, as if they had been filled at that level from the start; the cells a set of values
+   * ends up in therefore does not depend on the order they were filled in, nor on how they were split in parts merged
+   * afterwards.
+   *
+   * The map is flattened onto a histogram by merging, from the finest level up, the four children of a cell whose
+   * averages agree within the tolerance: uniform material is averaged over large cells, while the cells along the edges
+   * of the material, or over a gradient, are kept as fine as they were filled. Each bin of the histogram then gets the
+   * average of the cells its center falls in, or of the cells smaller than a bin whose center it contains.
+   */
+  class MaterialMapTree {
+  public:
+    MaterialMapTree() : size_(0), depth_(0), maxCells_(0), tolerance_(0) {}
+    void reset(double size, double cellSize, size_t maxCells, double tolerance);
+    void fill(double x, double y, double w);
+    bool merge(const MaterialMapTree& part);
+    bool merge(const TVectorD& part);
+    void write(TDirectory& dir, const std::string& name) const;
+    void flatten(TH2D& map) const;
+    size_t numCells() const { return cells_.size(); }
+    int depth() const { return depth_; }
+  private:
+    struct Cell {
+      double sum, count;
+    };
+    double size_; // the side of the region, from 0 in both directions
+    int depth_; // the level of the finest cells, size_ / 2^depth_ wide
+    size_t maxCells_;
+    double tolerance_; // the largest relative difference of the averages of four cells merged when flattened
+    std::unordered_map<uint64_t, Cell> cells_; // by the Morton code of the finest cells
+    static uint64_t interleave(uint32_t x, uint32_t y);
+    static uint32_t deinterleave(uint64_t code);
+    void coarsen(int depth);
+    void bound();
+  };
+}
+#endif /* _MATERIALMAPTREE_H */
@@ -45,6 +45,7 @@ namespace material {
     double totalGrams(double length, double surface) const;
 
     virtual void build();
+    void releaseBuildState() override { PropertyObject::releaseBuildState(); materialsNode_.release(); }
     
     void deployMaterialTo(MaterialObject& outputObject, const std::vector<std::string>& unitsToDeploy, bool onlyServices = false, double gramsMultiplier = 1.) const;
     void addElement(const MaterialObject::Element* element);
@@ -139,10 +140,14 @@ namespace material {
       double scalingMultiplier() const;
       void populateMaterialProperties(MaterialProperties& materialProperties) const;
       void getLocalElements(ElementsVector& elementsList) const;
+      int materialKey() const { return materialKey_; }
+      int componentKey() const { return componentKey_; }
       std::map<int, int> sensorChannels_;
 
     private:
       const MaterialTab& materialTab_;
+      int materialKey_, componentKey_; /**< The keys of elementName and componentName in the MaterialKeys, set when built */
+      void resolveKeys();
       static const std::string msg_no_valid_unit;
       MaterialObject::Type& materialType_;
       //static const std::map<std::string, Materialway::Train::UnitType> unitTypeMap;
@@ -17,6 +17,10 @@
 #include <iostream>
 #include <sstream>
 #include <map>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 #include <MaterialTable.h>
 
 class RILength {
@@ -50,7 +54,10 @@ namespace insur {
      *  properties rather than set explicitly. Some of the access functions for individual materials may
      * throw exceptions if the requested material does not appear on the list.
      */
+    class MaterialLengthBatch;
+
     class MaterialProperties {
+        friend class MaterialLengthBatch;
     public:
         /**
          * @enum Category A list of logical categories within the detector geometry; a single element belongs to exactly one of them
@@ -70,36 +77,41 @@ namespace insur {
         const std::map<std::string, double>& getExitingMasses() const;
         const std::map<std::string, double>& getLocalMassesComp() const;
         const std::map<std::string, double>& getExitingMassesComp() const;
-        double getLocalMass(std::string tag); // throws exception
+        double getLocalMass(const std::string& tag); // throws exception
 //        double getLocalMass(int index); // throws exception
-        double getLocalMassComp(std::string tag); // throws exception
+        double getLocalMassComp(const std::string& tag); // throws exception
 //        double getLocalMassComp(int index); // throws exception
 //        std::string getLocalTag(int index);
 //        std::string getLocalTagComp(int index);
-        double getExitingMass(std::string tag); // throws exception
+        double getExitingMass(const std::string& tag); // throws exception
 //        double getExitingMass(int index); // throws exception
-        double getExitingMassComp(std::string tag); // throws exception
+        double getExitingMassComp(const std::string& tag); // throws exception
 //        double getExitingMassComp(int index); // throws exception
 //        std::string getExitingTag(int index);
 //        std::string getExitingTagComp(int index);
         //void setLocalMass(std::string tag, std::string comp, double ms);
-        void addLocalMass(std::string tag, std::string comp, double ms, int minZ = -777);
-        void addLocalMass(std::string tag, double ms);
+        void addLocalMass(const std::string& tag, const std::string& comp, double ms, int minZ = -777);
+        void addLocalMass(const std::string& tag, double ms);
+        void addLocalMass(int materialKey, int componentKey, double ms);
+        void addLocalMass(int materialKey, double ms);
         //void setExitingMass(std::string tag, std::string comp, double ms);
-        void addExitingMass(std::string tag, std::string comp, double ms);
-        void addExitingMass(std::string tag, double ms);
+        void addExitingMass(const std::string& tag, const std::string& comp, double ms);
+        void addExitingMass(const std::string& tag, double ms);
         unsigned int localMassCount();
         unsigned int exitingMassCount();
         unsigned int localMassCompCount();
         unsigned int exitingMassCompCount();
         void clearMassVectors();
         void copyMassVectors(MaterialProperties& mp);
+        void copyMaterialValues(MaterialProperties& mp) const;
+        bool sharesMasses(const MaterialProperties& mp) const;
+        static unsigned int shareIdenticalMasses(const std::vector<MaterialProperties*>& elements);
         // calculated output values
         double getTotalMass() const;
         double getLocalMass();
         double getExitingMass();
-        double getRadiationLength();
-        double getInteractionLength();
+        double getRadiationLength() const;
+        double getInteractionLength() const;
         RILength getMaterialLengths();
         const std::map<std::string, RILength>& getComponentsRI() const;
         // output calculations
@@ -121,17 +133,50 @@ namespace insur {
         bool msl_set, mse_set, trck;
         // geometry-dependent parameters
         Category cat;
-        std::map<std::string, double> localmasses, exitingmasses;
-        std::map<std::string, double> localmassesComp, exitingmassesComp;
-
-        std::map<std::string, std::map<std::string, double> > localCompMats, exitingCompMats; // format here is <component name string, <material name, mass> >
+        /**
+         * @struct Masses
+         * @brief The masses of an element, by material, by component and by both
+         *
+         * Elements with the same masses, like the modules of a ring, can hold the same payload: it is only copied
+         * when one of them adds to it (see <i>mutableMasses()</i>).
+         */
+        struct Masses {
+            std::map<std::string, double> localmasses, exitingmasses;
+            std::map<std::string, double> localmassesComp, exitingmassesComp;
+            std::map<std::string, std::map<std::string, double> > localCompMats, exitingCompMats; // format here is <component name string, <material name, mass> >
+            bool operator==(const Masses& other) const;
+        };
+        std::shared_ptr<Masses> masses_;
+        Masses& mutableMasses();
 
         std::map<std::string, RILength> componentsRI;  // component-by-component radiation and interaction lengths
+
+        /**
+         * @class MassSlots
+         * @brief The entries of a mass map already filled by key, to add to them without looking the names up again
+         *
+         * The entries point into the maps of the object they belong to, so a copy starts empty.
+         */
+        class MassSlots {
+        public:
+            MassSlots() {}
+            MassSlots(const MassSlots&) {}
+            MassSlots& operator=(const MassSlots&) { slots_.clear(); return *this; }
+            double* find(long key) const {
+                for (const auto& slot : slots_) if (slot.first == key) return slot.second;
+                return nullptr;
+            }
+            double* add(long key, double* mass) { slots_.push_back(std::make_pair(key, mass)); return mass; }
+            void clear() { slots_.clear(); }
+        private:
+            std::vector<std::pair<long, double*> > slots_;
+        };
+        MassSlots localMassSlots, localMassCompSlots, localCompMatSlots; // keyed by material, component and (component, material) key
         // complex parameters (OUTPUT)
         double total_mass, local_mass, exiting_mass, r_length, i_length;
         // internal help
-        std::string getSuperName(std::string name) const;
-        std::string getSubName(std::string name) const;
+        std::string getSuperName(const std::string& name) const;
+        std::string getSubName(const std::string& name) const;
 	// Masses by type
 //        void setLocalMass(std::pair<std::string, double> ms);
 //        void addLocalMass(std::pair<std::string, double> ms);
@@ -152,6 +197,53 @@ namespace insur {
 //        bool newExitingComp(std::string comp);
 
     };
+
+    /**
+     * @class MaterialLengthBatch
+     * @brief Computes the radiation and interaction lengths of many <i>MaterialProperties</i> at once, from the material tab
+     *
+     * Every mass entry of the collected objects becomes a term (material, mass, surface) of flat arrays, with the
+     * materials numbered densely within the batch; the lengths of the terms are then evaluated by a single loop over
+     * the arrays, free of virtual calls and map lookups, and summed into their objects in the same order as
+     * <i>calculateRadiationLength()</i> and <i>calculateInteractionLength()</i> do, so that they give the same values.
+     * The batch keeps pointers to the objects: they must not be moved, nor their masses changed, while it is used.
+     * It can be evaluated again after the table of lengths is updated, e.g. with <i>setLengths()</i>, or the masses of a
+     * component are scaled with <i>setComponentScale()</i>; the lengths can also be evaluated aside, leaving the objects alone.
+     */
+    class MaterialLengthBatch {
+    public:
+        void add(MaterialProperties& mp, double offset = 0.0);
+        void clear();
+        void resolveLengths();
+        void setLengths(const std::string& material, double rlength, double ilength);
+        void setComponentScale(const std::string& component, double scale);
+        void evaluate();
+        void evaluate(std::vector<RILength>& lengths);
+        const std::vector<MaterialProperties*>& objects() const { return owners; }
+        unsigned int termCount() const { return termMass.size(); }
+    private:
+        int materialIndex(const std::string& material);
+        int componentIndex(const std::string& component);
+        void resolveNewLengths();
+        void evaluateTerms();
+        std::vector<MaterialProperties*> owners;
+        std::vector<double> offsets;
+        // the terms, first those of the totals then those of the components of each owner
+        std::vector<int> termMaterial;
+        std::vector<double> termMass, termSurface;
+        std::vector<double> inverseRadiation, inverseInteraction;
+        std::vector<int> ownerTermsEnd, ownerTotalTermsEnd;
+        std::vector<RILength*> componentTarget;         // the entry of componentsRI of each component term
+        std::vector<std::pair<RILength*, RILength> > componentBaselines; // their values before the batch
+        std::vector<int> termComponent;                 // the component of each component term, -1 for the totals
+        // the materials of the batch
+        std::unordered_map<std::string, int> materialIndices;
+        std::vector<std::string> materialNames;
+        std::vector<double> rlengths, ilengths;
+        // the components of the batch, by the name their masses are summed under, and the factors their masses are scaled by
+        std::unordered_map<std::string, int> componentIndices;
+        std::vector<double> componentScales;
+    };
 }
 #endif	/* _MATERIALPROPERTIES_H */
 
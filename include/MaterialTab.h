@@ -24,9 +24,9 @@ namespace material {
     public:
       static const MaterialTab& instance();
 
-      double density(std::string material) const;
-      double radiationLength(std::string material) const;
-      double interactionLength(std::string material) const;
+      double density(const std::string& material) const;
+      double radiationLength(const std::string& material) const;
+      double interactionLength(const std::string& material) const;
     };
 } /* namespace material */
 
@@ -17,6 +17,7 @@
 #include <vector>
 #include <map>
 #include <set>
+#include <unordered_map>
 #include <iostream>
 #include <sstream>
 #include <stdexcept>
@@ -60,19 +61,21 @@ namespace insur {
     public:
         MaterialTable() {}
         virtual ~MaterialTable() {}
-        void addMaterial(MaterialRow mat);
-        void addMaterial(std::string tag, double density, double rlength, double ilength);
-        MaterialRow& getMaterial(std::string tag); // throws exception
+        void addMaterial(const MaterialRow& mat);
+        void addMaterial(const std::string& tag, double density, double rlength, double ilength);
+        void reserve(unsigned int rows) { materials.reserve(rows); indices.reserve(rows); }
+        MaterialRow& getMaterial(const std::string& tag); // throws exception
         MaterialRow& getMaterial(int index); // throws exception
-        bool replaceMaterial(std::string oldtag, MaterialRow newmat);
-        bool replaceMaterial(int index, MaterialRow newmat);
+        bool replaceMaterial(const std::string& oldtag, const MaterialRow& newmat);
+        bool replaceMaterial(int index, const MaterialRow& newmat);
         unsigned int rowCount();
         bool empty();
         void print();
     protected:
         std::vector<MaterialRow> materials;
     private:
-        int findIndex(std::string tag);
+        std::unordered_map<std::string, int> indices; // the index of the first row of each tag
+        int findIndex(const std::string& tag);
     };
 
 
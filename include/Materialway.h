@@ -13,6 +13,7 @@
 #include <utility>
 #include <set>
 #include <string>
+#include <unordered_map>
 #include "MaterialObject.h"
 //#include "global_constants.h"
 
@@ -117,6 +118,7 @@ namespace material {
       Section* nextSection() const;
       bool hasNextSection() const;
       MaterialObject& materialObject();
+      const std::vector<std::string>& unitsToPass() const;
       void inactiveElement(InactiveElement* inactiveElement);
       InactiveElement* inactiveElement() const;
       //Section* appendNewSection
@@ -201,6 +203,31 @@ namespace material {
 
     typedef std::set<Boundary*, BoundaryComparator> BoundariesSet;
 
+    /**
+     * @class CollisionIndex
+     * @brief Buckets the (z, r) rectangles of sections or boundaries in fixed-width bins, for the collision searches
+     *
+     * For a horizontal search only the rectangles whose rho range (widened by the margin the element's
+     * <i>isHit()</i> uses) covers the bin of the start rho can be hit, for a vertical search those whose z range covers the bin
+     * of the start z. The candidates are listed in the order they were inserted, so that ties are resolved as by
+     * a linear scan. A rectangle that shrinks after being inserted stays in its bins, which keeps the index conservative.
+     */
+    template<class Element> class CollisionIndex {
+    public:
+      CollisionIndex(int margin, int binWidth);
+      void clear();
+      size_t size() const { return size_; }
+      void insert(Element* element);
+      const std::vector<Element*>& candidates(int z, int r, Direction direction) const;
+    private:
+      int margin_, binWidth_;
+      size_t size_;
+      std::unordered_map<int, std::vector<Element*> > rBins_; /**< bins in rho, for the horizontal searches */
+      std::unordered_map<int, std::vector<Element*> > zBins_; /**< bins in z, for the vertical searches */
+      std::vector<Element*> noCandidates_;
+      int bin(int coordinate) const;
+    }; //class CollisionIndex
+
     /**
      * @class OuterUsher
      * @brief Is the core of the functionality that builds sections across boundaries
@@ -215,7 +242,10 @@ namespace material {
     private:
       SectionVector& sectionsList_;
       BoundariesSet& boundariesList_;
+      CollisionIndex<Section> sectionIndex_;
+      CollisionIndex<Boundary> boundaryIndex_;
 
+      void updateIndices();
       bool findBoundaryCollision(int& collision, int& border, int startZ, int startR, const Tracker& tracker, Direction direction);
       bool findSectionCollision(std::pair<int,Section*>& sectionCollision, int startZ, int startR, int end, Direction direction);
       bool buildSection(Section*& firstSection, Section*& lastSection, int& startZ, int& startR, int end, Direction direction);
@@ -264,12 +294,41 @@ namespace material {
       void go(Tracker& tracker);
     }; //class ModuleUsher
 
+    /**
+     * @class ServiceRouting
+     * @brief Collects the service deposits requested along the routing, to make them afterwards on several threads
+     *
+     * A chain of sections is followed up to its first station, which deposits into its conversion station;
+     * several chains can end in the same conversion station. The deposits are therefore grouped by the
+     * material object they go into, each group keeping the order they were requested in, and the
+     * groups are run concurrently: every material object receives the same elements, in the same order,
+     * as when the chains are followed one after the other.
+     */
+    class ServiceRouting {
+    public:
+      void deploy(const MaterialObject& source, Section* section, const std::vector<std::string>& units, bool onlyServices = false, double gramsMultiplier = 1.);
+      void pass(const MaterialObject& source, Section* section, const std::vector<std::string>& units);
+      void pass(const MaterialObject& source, Section* section);
+      void run(int numThreads);
+    private:
+      struct Deposit {
+        const MaterialObject* source;
+        const std::vector<std::string>* units;
+        bool onlyServices;
+        double gramsMultiplier;
+      };
+      void add(MaterialObject& target, const Deposit& deposit);
+      std::map<MaterialObject*, size_t> targetIndex_;                      /**< Position of each target in targets_ */
+      std::vector<std::pair<MaterialObject*, std::vector<Deposit> > > targets_; /**< The targets, in order of first deposit */
+    }; //class ServiceRouting
+
 
   public:
     Materialway();
     virtual ~Materialway();
 
     bool build(Tracker& tracker, InactiveSurfaces& inactiveSurface, WeightDistributionGrid& weightDistribution);
+    void numThreads(int numThreads) { numThreads_ = numThreads; }
 
     static const double gridFactor;                                     /**< the conversion factor for using integers in the algorithm (helps finding collisions),
                                                                             actually transforms millimiters in microns */
@@ -290,6 +349,7 @@ namespace material {
     static const int sectionTolerance;
     static const int layerStationLenght;
     static const int layerStationWidth;
+    static const int collisionIndexBinWidth;
 
     static int discretize(double input);
     static double undiscretize(int input);
@@ -302,6 +362,7 @@ namespace material {
 
     OuterUsher outerUsher;
     InnerUsher innerUsher;
+    int numThreads_;                     /**< The number of threads the services are routed on */
 
     bool buildBoundaries(const Tracker& tracker);             /**< build the boundaries around barrels and endcaps */
     void buildExternalSections(const Tracker& tracker);       /**< build the sections outside the boundaries */
@@ -312,7 +373,7 @@ namespace material {
     //void routeRodMaterials();
     void firstStepConversions();
     void secondStepConversions();
-    void createModuleCaps(Tracker& tracker);
+    void releaseModuleCaps(Tracker& tracker);
     void duplicateSections();
     void populateAllMaterialProperties(Tracker& tracker, WeightDistributionGrid& weightDistribution);
     //void calculateMaterialValues(Tracker& tracker);
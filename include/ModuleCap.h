@@ -17,6 +17,7 @@
 #include "Module.h"
 #include <MaterialProperties.h>
 #include <global_constants.h>
+#include <boost/ptr_container/ptr_vector.hpp>
 
 namespace insur {
     /**
@@ -39,6 +40,12 @@ namespace insur {
     protected:
         Module* module;
     };
+
+    /**
+     * The caps of the modules of a layer or disk: the caps are owned by their modules, the vector only points to them,
+     * and gives them as references when it is indexed or iterated over
+     */
+    typedef boost::ptr_vector<ModuleCap, boost::view_clone_allocator> ModuleCaps;
 }
 #endif	/* _MODULECAP_H */
 
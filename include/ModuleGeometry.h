@@ -0,0 +1,28 @@
+#ifndef MODULEGEOMETRY_H
+#define MODULEGEOMETRY_H
+
+#include "Module.h"
+
+/**
+ * @struct ModuleGeometry
+ * @brief A flat copy of the geometry of a module, taken once the tracker is built.
+ *
+ * Reading these values does not go through the decorator chain nor the property getters of <i>DetectorModule</i>,
+ * so a pass over all the modules of a tracker touches a single contiguous array. The values are those the module
+ * getters return at the time the tracker is frozen: if the geometry is changed afterwards, the tracker has to be frozen again.
+ */
+struct ModuleGeometry {
+  Module* module;
+  double centerX, centerY, centerZ;
+  double normalX, normalY, normalZ;
+  double minR, maxR;
+  double minZ, maxZ;
+  double minPhi, maxPhi;
+  double phiAperture, etaAperture;
+  double stripOccupancyPerEvent; // for one minimum bias event: the pile-up scans scale it
+  ModuleSubdetector subdet;
+  ModuleKey key;
+  int typeId; // index in Tracker::frozenModuleTypes()
+};
+
+#endif
@@ -0,0 +1,101 @@
+/**
+ * @file ModuleHitIndex.h
+ * @brief This is the header file for the (eta, phi) binned lookup of the modules a straight track can cross
+ */
+
+#ifndef _MODULEHITINDEX_H
+#define _MODULEHITINDEX_H
+
+#include <cmath>
+#include <vector>
+#include <map>
+#include <Math/Vector3D.h>
+#include <ModuleCap.h>
+#include <ModuleGeometry.h>
+
+using ROOT::Math::XYZVector;
+
+namespace insur {
+  /**
+   * @class ModuleHitIndex
+   * @brief This class bins the modules of one layer of <i>ModuleCap</i> in (eta, phi) as seen from the origin.
+   *
+   * Each bin lists, in their original order within the layer, the indices of all the modules whose sensors overlap it,
+   * so that a track leaving the origin only needs to be checked against the modules in the bin its direction falls in.
+   * The bounds used for the binning are conservative (they are computed on the sensor hit polygons and widened by
+   * a safety margin), so the modules found via the index and those found by testing the whole layer are the same.
+   *
+   * A barrel layer is binned along the z where the track crosses the average radius of the layer instead of eta, and
+   * in two phi bins per rod: the bin of a track then follows in closed form from its crossing point, and holds the
+   * module of the rod and ring it crosses plus the neighbours which overlap it. The row bins are cut at the edges of the
+   * (r, z) envelopes of the rings, so that a bin only lists the rings which actually reach it: this holds for the
+   * tilted rings of a tilted layer as well, whose envelopes span a wider z at the average radius than the flat ones.
+   * The phi bins follow the periodicity of the rods, one bin centred on each rod and one on each gap between two rods,
+   * so that a bin lists one module, or the two which overlap across the gap. Likewise a disk is binned along the radius
+   * where the track crosses the average z of the disk, cut at the envelopes of its rings, and in two phi bins per
+   * module of its largest ring.
+   */
+  class ModuleHitIndex {
+  public:
+    ModuleHitIndex() : rowMin_(0), rowMax_(0), radius_(0), z_(0), phiStart_(-M_PI), rowBins_(0), phiBins_(0) {}
+    bool build(ModuleCaps& layer);
+    const std::vector<int>& candidates(const XYZVector& direction) const;
+    int numBins() const { return rowBins_ * phiBins_; }
+    bool empty() const { return bins_.empty(); }
+  private:
+    static const double etaMargin, phiMargin;
+    double rowMin_, rowMax_; // the range of the row coordinate: eta, the z at the radius of a barrel layer or the radius at the z of a disk
+    double radius_; // the average radius of a barrel layer, 0 for the other layers
+    double z_; // the average z of a disk, 0 for the other layers
+    double phiStart_; // the lower edge of the first phi bin
+    int rowBins_, phiBins_;
+    std::vector<double> rowEdges_; // the edges of the row bins, rowBins_ + 1 of them
+    std::vector<std::vector<int> > bins_;
+    std::vector<int> noCandidates_;
+    double row(double eta) const { return radius_ > 0 ? radius_ * sinh(eta) : z_ > 0 ? z_ / sinh(eta) : eta; }
+    int rowBin(double row) const;
+    int lastRowBin(double row) const;
+    int phiBin(double phi) const;
+  };
+
+  /**
+   * A collection of indices, one per layer of <i>ModuleCap</i>, keyed by the address of the layer vector
+   */
+  typedef std::map<const ModuleCaps*, ModuleHitIndex> ModuleHitIndexMap;
+
+  /**
+   * @class FrozenModuleIndex
+   * @brief This class bins all the modules of a frozen tracker in (z0, eta, phi), where z0 is the z of the origin of the track.
+   *
+   * Each bin lists, in ascending order, the indices of the modules a straight track could cross when it leaves the
+   * z axis within the z0 slice of the bin along a direction within its (eta, phi) bin: a track only needs to be tested
+   * against the modules of its bin. The bounds are computed on the frozen r and z extents of the modules and widened
+   * by a safety margin, so no module the track crosses is left out. The z0 slices narrow the eta range of each module
+   * down to what can be seen from the slice; the granularity scales the number of (eta, phi) bins of a slice, which is
+   * by default roughly the number of modules.
+   */
+  class FrozenModuleIndex {
+  public:
+    FrozenModuleIndex() : zMin_(0), zMax_(0), etaBins_(0), phiBins_(0) {}
+    void build(const std::vector<ModuleGeometry>& modules, double zMin, double zMax, int zSlices = 1, double granularity = 1);
+    const std::vector<int>& candidates(double eta, double phi, double z0) const;
+    void clear() { slices_.clear(); etaBins_ = phiBins_ = 0; }
+    int numBins() const { return slices_.size() * etaBins_ * phiBins_; }
+    long numEntries() const;
+    double etaBinWidth(double z0) const;
+    double phiBinWidth() const { return phiBins_ ? 2*M_PI / phiBins_ : 2*M_PI; }
+  private:
+    static const double etaMargin;
+    struct Slice {
+      double etaMin, etaMax;
+      std::vector<std::vector<int> > bins;
+    };
+    double zMin_, zMax_;
+    int etaBins_, phiBins_;
+    std::vector<Slice> slices_;
+    std::vector<int> noCandidates_;
+    int etaBin(const Slice& slice, double eta) const;
+    int phiBin(double phi) const;
+  };
+}
+#endif /* _MODULEHITINDEX_H */
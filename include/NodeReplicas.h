@@ -0,0 +1,40 @@
+#ifndef NodeReplicas_h
+#define NodeReplicas_h
+
+#include <memory>
+#include <vector>
+#include <TaskPool.h>
+
+/**
+ * @class NodeReplicas
+ * @brief This class keeps a copy of a read-only table in the memory of each NUMA node the threads of the pool are
+ * pinned to, for the threads of a node to read their own copy rather than the memory of another socket
+ *
+ * Each copy is made by a thread pinned to its node, so that the kernel places its pages there as they are first
+ * written. While the threads are not pinned (see <i>TaskPool::setNumaPinning()</i>) there are no copies and the
+ * original is read. The copies are taken when the table is complete and have to be taken again if it changes. Copying
+ * the replicas shares the copies, which are never written.
+ */
+template<class T> class NodeReplicas {
+ public:
+  void replicate(const T& original) {
+    replicas_.clear();
+    if (!TaskPool::instance()->numaPinning() || TaskPool::numaNodes().size() < 2) return;
+    replicas_.resize(TaskPool::numaNodes().size());
+    for (unsigned int node = 0; node < replicas_.size(); node++) {
+      TaskPool::runOnNode(node, [&]() { replicas_[node] = std::make_shared<const T>(original); });
+    }
+  }
+  // The copy of the node of the calling thread, or the original when there is none
+  const T& local(const T& original) const {
+    if (replicas_.empty()) return original;
+    unsigned int node = TaskPool::currentNode();
+    return node < replicas_.size() ? *replicas_[node] : original;
+  }
+  void clear() { replicas_.clear(); }
+  bool empty() const { return replicas_.empty(); }
+ private:
+  std::vector<std::shared_ptr<const T> > replicas_;
+};
+
+#endif
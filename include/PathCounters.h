@@ -0,0 +1,91 @@
+#ifndef PathCounters_h
+#define PathCounters_h
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * @class PathCounters
+ * @brief This class keeps named counters and scoped timers for the hot paths of the analysis
+ *
+ * The counters are updated through the macros below, which compile to nothing unless the
+ * program is built with TKLAYOUT_COUNTERS defined (make COUNTERS=1). Each call site looks its
+ * counter up once, after which an update is a couple of relaxed atomic additions, so the
+ * counters can be used from the worker threads too. A counter holds the number of updates and
+ * the sum of their values (the nanoseconds spent, for a timer). When tracing is switched on,
+ * every timed scope is also recorded as a complete event, to be written in the Chrome
+ * trace-event format (chrome://tracing, Perfetto).
+ */
+class PathCounters {
+ public:
+  struct Counter {
+    Counter() : count(0), sum(0) {}
+    void add(long value) { count.fetch_add(1, std::memory_order_relaxed); sum.fetch_add(value, std::memory_order_relaxed); }
+    std::atomic<long> count;
+    std::atomic<long> sum;
+  };
+  typedef std::chrono::steady_clock Clock;
+  static PathCounters* instance();
+  static bool compiledIn();
+  Counter& counter(const std::string& name);
+  void setTracing(bool trace) { tracing_ = trace; }
+  bool tracing() const { return tracing_; }
+  void addTraceEvent(const char* name, const Clock::time_point& start, const Clock::time_point& stop);
+  std::string report() const;
+  bool writeTrace(const std::string& fileName) const;
+ private:
+  struct TraceEvent {
+    const char* name;
+    long startUs, durationUs;
+    size_t thread;
+  };
+  static const size_t maxTraceEvents = 4000000;
+  PathCounters();
+  std::map<std::string, Counter> counters_;
+  std::vector<TraceEvent> traceEvents_;
+  long droppedTraceEvents_;
+  Clock::time_point origin_;
+  std::atomic<bool> tracing_;
+  mutable std::mutex mutex_;
+};
+
+/**
+ * @class ScopedPathTimer
+ * @brief Adds the time spent in a scope to a counter of <i>PathCounters</i>
+ */
+class ScopedPathTimer {
+ public:
+  ScopedPathTimer(const char* name, PathCounters::Counter& counter) : name_(name), counter_(counter), start_(PathCounters::Clock::now()) {}
+  ~ScopedPathTimer() {
+    PathCounters::Clock::time_point stop = PathCounters::Clock::now();
+    counter_.add(std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start_).count());
+    if (PathCounters::instance()->tracing()) PathCounters::instance()->addTraceEvent(name_, start_, stop);
+  }
+ private:
+  const char* name_;
+  PathCounters::Counter& counter_;
+  PathCounters::Clock::time_point start_;
+};
+
+#define PATHCOUNTERS_CONCAT_(a, b) a##b
+#define PATHCOUNTERS_CONCAT(a, b) PATHCOUNTERS_CONCAT_(a, b)
+
+#ifdef TKLAYOUT_COUNTERS
+#define countPathValue(name, value) do { \
+    static PathCounters::Counter& pathCounter_ = PathCounters::instance()->counter(name); \
+    pathCounter_.add(value); \
+  } while (0)
+#define timePathScope(name) \
+  static PathCounters::Counter& PATHCOUNTERS_CONCAT(pathTimerCounter_, __LINE__) = PathCounters::instance()->counter(std::string(name) + " [ns]"); \
+  ScopedPathTimer PATHCOUNTERS_CONCAT(pathTimer_, __LINE__)(name, PATHCOUNTERS_CONCAT(pathTimerCounter_, __LINE__))
+#else
+#define countPathValue(name, value) do {} while (0)
+#define timePathScope(name) do {} while (0)
+#endif
+#define countPathEvent(name) countPathValue(name, 1)
+
+#endif
@@ -11,6 +11,7 @@
 #include <TList.h>
 #include <TH2D.h>
 #include <TH2C.h>
+#include <TMath.h>
 #include <TText.h>
 #include <TLatex.h>
 #include <TLine.h>
@@ -126,6 +127,7 @@ public:
   }
   double getMinValue() const { return minValue_; }
   double getMaxValue() const { return maxValue_; }
+  bool hasFramePalette() const { return framePalette_ != NULL; }
 
   void setFramePalette(TPaletteAxis* framePalette) { 
     framePalette_ = framePalette; 
@@ -217,18 +219,25 @@ struct YZFull : public YZ {
 
 TPolyLine* drawMod();
 
+/// LineGetter gives the outline of a module in the CoordType projection and keeps the extent of the outlines it gave.
+/// The outlines only depend on the module and on the projection, so each of them is computed once per program run
+/// and shared by all the plots: the caller must neither delete the TPolyLine nor draw it directly, only copies of it
+/// (DrawPolyLine), as its colours are set anew by each plot.
 template<class CoordType> class LineGetter {
   typedef typename CoordType::first_type CoordTypeX; 
   typedef typename CoordType::first_type CoordTypeY;
-  CoordTypeX maxx_, minx_;
-  CoordTypeY maxy_, miny_;
-public:
-  LineGetter() : maxx_(std::numeric_limits<CoordTypeX>::min()), minx_(std::numeric_limits<CoordTypeX>::max()), maxy_(std::numeric_limits<CoordTypeY>::min()), miny_(std::numeric_limits<CoordTypeY>::max()) {}
-  CoordTypeX maxx() const { return maxx_; }
-  CoordTypeX minx() const { return minx_; }
-  CoordTypeY maxy() const { return maxy_; }
-  CoordTypeY miny() const { return miny_; }
-  TPolyLine* operator()(const Module& m) {
+  struct Outline {
+    TPolyLine* line;
+    CoordTypeX maxx, minx;
+    CoordTypeY maxy, miny;
+  };
+  // The modules are never freed before the end of the program, nor are their outlines
+  static std::map<const Module*, Outline>& outlines() {
+    static std::map<const Module*, Outline>* myOutlines = new std::map<const Module*, Outline>;
+    return *myOutlines;
+  }
+  static Outline makeOutline(const Module& m) {
+    Outline outline = { NULL, std::numeric_limits<CoordTypeX>::min(), std::numeric_limits<CoordTypeX>::max(), std::numeric_limits<CoordTypeY>::min(), std::numeric_limits<CoordTypeY>::max() };
     std::set<CoordType> xy; // duplicate detection
     double x[] = {0., 0., 0., 0., 0.}, y[] = {0., 0., 0., 0., 0.};
     int j=0;
@@ -238,16 +247,35 @@ public:
         x[j] = c.first;
         y[j++] = c.second;
       } 
-      maxx_ = MAX(c.first, maxx_);
-      minx_ = MIN(c.first, minx_);
-      maxy_ = MAX(c.second, maxy_);
-      miny_ = MIN(c.second, miny_);
+      outline.maxx = MAX(c.first, outline.maxx);
+      outline.minx = MIN(c.first, outline.minx);
+      outline.maxy = MAX(c.second, outline.maxy);
+      outline.miny = MIN(c.second, outline.miny);
     }
     if (j==4) { // close the poly line in case it's made of 4 distinct points, to get the closing line drawn
       x[j] = x[0]; 
       y[j++] = y[0];
     }
-    return !g ? new TPolyLine(j, x, y) : drawMod();
+    outline.line = !g ? new TPolyLine(j, x, y) : drawMod();
+    return outline;
+  }
+  CoordTypeX maxx_, minx_;
+  CoordTypeY maxy_, miny_;
+public:
+  LineGetter() : maxx_(std::numeric_limits<CoordTypeX>::min()), minx_(std::numeric_limits<CoordTypeX>::max()), maxy_(std::numeric_limits<CoordTypeY>::min()), miny_(std::numeric_limits<CoordTypeY>::max()) {}
+  CoordTypeX maxx() const { return maxx_; }
+  CoordTypeX minx() const { return minx_; }
+  CoordTypeY maxy() const { return maxy_; }
+  CoordTypeY miny() const { return miny_; }
+  TPolyLine* operator()(const Module& m) {
+    typename std::map<const Module*, Outline>::iterator found = outlines().find(&m);
+    if (found == outlines().end()) found = outlines().insert(std::make_pair(&m, makeOutline(m))).first;
+    const Outline& outline = found->second;
+    maxx_ = MAX(outline.maxx, maxx_);
+    minx_ = MIN(outline.minx, minx_);
+    maxy_ = MAX(outline.maxy, maxy_);
+    miny_ = MIN(outline.miny, miny_);
+    return outline.line;
   }
 };
 
@@ -306,6 +334,22 @@ struct HistogramFrameStyle {
 };
 
 
+/// MapRaster decides when the modules of a map are drawn as a raster instead of one polyline each, and draws them.
+/// The raster is a TH2D of nBins x nBins bins over the frame, painted with the palette of the frame, so it only stands
+/// in for maps colouring the modules by value (HistogramFrameStyle); the maps with explicit colours keep their polylines.
+/// The modules are then drawn filled, whatever the draw style, while the size of the plot no longer grows with their number.
+struct MapRaster {
+  enum Mode { AUTO, ALWAYS, NEVER };
+  static Mode mode;
+  static const size_t autoThreshold; // the number of module outlines above which AUTO draws a raster
+  static const int nBins;
+  static bool use(size_t numLines, const DrawerPalette& palette) {
+    return palette.hasFramePalette() && (mode == ALWAYS || (mode == AUTO && numLines > autoThreshold));
+  }
+  static void fill(TH2D& raster, TPolyLine& line, double value);
+};
+
+
 // ===============================================================================================
 // Here be PLOTDRAWER MAIN CLASS
 // Do not touch please
@@ -335,6 +379,7 @@ struct HistogramFrameStyle {
 ///   - DrawStyleType is the style of module drawing. The predefined classes are ContourStyle (which only draws the contours of modules) and FillStyle (which draws solid modules).
 ///   - canvas is the TCanvas to draw on. cd() is called automatically by the PlotDrawer
 ///   - drawStyle is the instance of a DrawStyleType class, which can be used in case of custom draw styles. Default is DrawStyleType<CoordType>()
+///   - past MapRaster::autoThreshold module outlines, the maps of values are drawn as a raster instead (see MapRaster)
 
 template<class CoordType, class ValueGetterType, class StatType = NoStat >
 class PlotDrawer {
@@ -347,12 +392,15 @@ class PlotDrawer {
   LineGetter<CoordType> getLine;
 
   DrawerPalette palette_;
+  TH2C* frame_;
 
   std::map<CoordType, StatType*> bins_;
-  std::map<CoordType, TPolyLine*> lines_;
+  std::map<CoordType, TPolyLine*> lines_; // owned by LineGetter
+
+  void drawRaster(TCanvas& canvas);
 
 public: 
-  PlotDrawer(CoordTypeX viewportMaxX = 0, CoordTypeY viewportMaxY = 0, const ValueGetterType& valueGetter = ValueGetterType()) : viewportMaxX_(viewportMaxX), viewportMaxY_(viewportMaxY), getValue(valueGetter) {}
+  PlotDrawer(CoordTypeX viewportMaxX = 0, CoordTypeY viewportMaxY = 0, const ValueGetterType& valueGetter = ValueGetterType()) : viewportMaxX_(viewportMaxX), viewportMaxY_(viewportMaxY), getValue(valueGetter), frame_(NULL) {}
 
   ~PlotDrawer();
 
@@ -369,7 +417,6 @@ public:
 template<class CoordType, class ValueGetterType, class StatType> PlotDrawer<CoordType, ValueGetterType, StatType>::~PlotDrawer() {
   for (typename std::map<CoordType, StatType*>::iterator it = bins_.begin(); it != bins_.end(); ++it) {
     delete it->second;
-    delete lines_[it->first];
   }
   bins_.clear();
   lines_.clear();
@@ -390,8 +437,8 @@ void PlotDrawer<CoordType, ValueGetterType, StatType>::drawFrame(TCanvas& canvas
   canvas.cd();
   viewportMaxX_ = viewportMaxX_ == 0 ? getLine.maxx()*1.1 : viewportMaxX_;  // in case the viewport coord is 0, auto-viewport mode is used and getLine is queried for the farthest X or Y it has registered
   viewportMaxY_ = viewportMaxY_ == 0 ? getLine.maxy()*1.1 : viewportMaxY_;
-  TH2C* frame = getFrame(viewportMaxX_, viewportMaxY_);
-  frameStyle(*frame, canvas, palette_);
+  frame_ = getFrame(viewportMaxX_, viewportMaxY_);
+  frameStyle(*frame_, canvas, palette_);
 }
 
 
@@ -399,6 +446,10 @@ void PlotDrawer<CoordType, ValueGetterType, StatType>::drawFrame(TCanvas& canvas
 template<class CoordType, class ValueGetterType, class StatType>
 template<class DrawStyleType>
 void PlotDrawer<CoordType, ValueGetterType, StatType>::drawModules(TCanvas& canvas, const DrawStyleType& drawStyle) {
+  if (frame_ && MapRaster::use(lines_.size(), palette_)) {
+    drawRaster(canvas);
+    return;
+  }
   canvas.cd();
   for (typename std::map<CoordType, StatType*>::const_iterator it = bins_.begin(); it != bins_.end(); ++it) {
     StatType* bin = it->second;
@@ -407,6 +458,21 @@ void PlotDrawer<CoordType, ValueGetterType, StatType>::drawModules(TCanvas& canv
   }
 }
 
+template<class CoordType, class ValueGetterType, class StatType>
+void PlotDrawer<CoordType, ValueGetterType, StatType>::drawRaster(TCanvas& canvas) {
+  canvas.cd();
+  std::string name = std::string("raster") + IdMaker().nextString();
+  TH2D* raster = new TH2D(name.c_str(), "", MapRaster::nBins, frame_->GetXaxis()->GetXmin(), frame_->GetXaxis()->GetXmax(),
+                          MapRaster::nBins, frame_->GetYaxis()->GetXmin(), frame_->GetYaxis()->GetXmax());
+  for (typename std::map<CoordType, StatType*>::const_iterator it = bins_.begin(); it != bins_.end(); ++it) {
+    MapRaster::fill(*raster, *lines_.at(it->first), it->second->get());
+  }
+  raster->SetMinimum(palette_.getMinValue());
+  raster->SetMaximum(palette_.getMaxValue());
+  if (frame_->GetContour() > 0) raster->SetContour(frame_->GetContour()); // the same colour levels as the palette of the frame
+  raster->Draw("col same");
+}
+
 template<class CoordType, class ValueGetterType, class StatType>
 void PlotDrawer<CoordType, ValueGetterType, StatType>::add(const Module& m) {
   CoordType c(m);
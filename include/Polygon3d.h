@@ -95,6 +95,7 @@ public:
   AbstractPolygon<NumSides, Coords, Random, FloatType>& rotateX(FloatType angle);
   AbstractPolygon<NumSides, Coords, Random, FloatType>& rotateY(FloatType angle);
   AbstractPolygon<NumSides, Coords, Random, FloatType>& rotateZ(FloatType angle);
+  template<class Transform> AbstractPolygon<NumSides, Coords, Random, FloatType>& transform(const Transform& move); // any callable mapping a vertex to its new position
 };
 
 template<int NumSides, class Coords, class Random, class FloatType> 
@@ -176,6 +177,14 @@ AbstractPolygon<NumSides, Coords, Random, FloatType>& AbstractPolygon<NumSides,
   return *this;
 }
 
+template<int NumSides, class Coords, class Random, class FloatType>
+template<class Transform>
+AbstractPolygon<NumSides, Coords, Random, FloatType>& AbstractPolygon<NumSides, Coords, Random, FloatType>::transform(const Transform& move) {
+  for (int i = 0; i < NumSides; i++) v_[i] = move(v_[i]);
+  setGeomDirty(true);
+  return *this;
+}
+
 template<int NumSides, class Coords, class Random, class FloatType> 
 AbstractPolygon<NumSides, Coords, Random, FloatType>& AbstractPolygon<NumSides, Coords, Random, FloatType>::operator<<(const Coords& vertex) {
   if (!isComplete()) v_[allocated_++] = vertex;
@@ -193,6 +202,24 @@ AbstractPolygon<NumSides, Coords, Random, FloatType>& AbstractPolygon<NumSides,
 
 
 
+/**
+ * The point-in-polygon test of a polygon of NumSides sides, with neither virtual calls nor temporary triangles: the
+ * point is inside if the triangles it makes with the sides add up to the area of the polygon, within 1e-4. Each
+ * triangle area is computed as Triangle3d computes it, hence the result is the same as with the triangles.
+ * @param v The vertices of the polygon
+ * @param doubleArea The double area of the polygon
+ * @param p The point, in the plane of the polygon
+ */
+template<int NumSides>
+inline bool isPointInsidePolygon(const XYZVector* v, double doubleArea, const XYZVector& p) {
+  double sum = 0;
+  for (int i = 0; i < NumSides; i++) {
+    sum += sqrt((v[i] - p).Cross(v[i + 1 < NumSides ? i + 1 : 0] - p).Mag2());
+    if (sum - doubleArea > 1e-4) return false;  // early quit if sum area is already bigger
+  }
+  return fabs(doubleArea - sum) < 1e-4;
+}
+
 template<int NumSides>
 class Polygon3d : public AbstractPolygon<NumSides, ROOT::Math::XYZVector, TRandom> { // no checks are made on the convexity, but the algorithms in the class only work for convex polygons, so beware!
 public:
@@ -225,16 +252,14 @@ typedef Polygon3d<3> Triangle3d;
 
 
 template<int NumSides>
-bool Polygon3d<NumSides>::isPointInside(const XYZVector& p) const {
-  double sum = 0;
-  const XYZVector *vbegin = &this->v_[0], *vend = &this->v_[NumSides];
-  for (const XYZVector* it = vbegin; it != vend; ++it) {
-    Triangle3d t;
-    t << p << *it << (it+1 < vend ? *(it+1) : *vbegin);
-    sum += t.getDoubleArea();
-    if (sum - this->getDoubleArea() > 1e-4) return false;  // early quit if sum area is already bigger
-  }
-  return fabs(this->getDoubleArea() - sum) < 1e-4;
+inline bool Polygon3d<NumSides>::isPointInside(const XYZVector& p) const {
+  return isPointInsidePolygon<NumSides>(this->v_, this->getDoubleArea(), p);
+}
+
+template<int NumSides>
+bool Polygon3d<NumSides>::isLineIntersecting(const XYZVector& orig, const XYZVector& dir) const {
+  XYZVector intersection;
+  return isLineIntersecting(orig, dir, intersection);
 }
 
 template<int NumSides>
@@ -244,7 +269,7 @@ bool Polygon3d<NumSides>::isLineIntersecting(const XYZVector& orig, const XYZVec
   double d = this->getCenter().Dot(this->getNormal());
   if (normDir < 1e-3) return false; // no fabs because if normDir < 0 we want to return false, as we're matching with the module in the opposite direction
   intersection = orig + (((d - normOrig)/normDir) * dir); // TODO: slightly inefficient here: we do not need to go 3D and then 2D again...
-  return isPointInside(intersection);
+  return isPointInsidePolygon<NumSides>(this->v_, this->getDoubleArea(), intersection); // not through the virtual isPointInside()
 }
 
 template<int NumSides>
@@ -283,15 +308,7 @@ inline void Triangle3d::computeProperties() {
 }
 
 inline bool Triangle3d::isPointInside(const XYZVector& p) const { // note: this is exactly the same as the non specialized case // inlined to avoid linker issues
-  double sum = 0;
-  const XYZVector *vbegin = &this->v_[0], *vend = &this->v_[3];
-  for (const XYZVector* it = vbegin; it != vend; ++it) {
-    Triangle3d t;
-    t << p << *it << (it+1 < vend ? *(it+1) : *vbegin);
-    sum += t.getDoubleArea();
-    if (sum - this->getDoubleArea() > 1e-4) return false;  // early quit if sum area is already bigger
-  }
-  return fabs(this->getDoubleArea() - sum) < 1e-4;
+  return isPointInsidePolygon<3>(this->v_, this->getDoubleArea(), p);
 }
 
 inline XYZVector Triangle3d::generateRandomPoint(TRandom* die) const {
@@ -0,0 +1,43 @@
+#ifndef ProgressMeter_h
+#define ProgressMeter_h
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+
+/**
+ * @class ProgressMeter
+ * @brief This class reports the progress of a long scan of tracks, every so often while it runs
+ *
+ * A meter is made for each scan and advanced as its tracks are done, from any thread. Once per
+ * interval (see <i>configure()</i>) it prints a line with the tracks done, the tracks per second,
+ * the time left and the resident memory of the process, and rewrites the status file, if any,
+ * with the same figures as JSON, for the batch monitoring to spot stalled or slow jobs. The
+ * status file is replaced at once, so that it is never read half written. Unless configured,
+ * the meters do nothing.
+ */
+class ProgressMeter {
+ public:
+  static void configure(double intervalSeconds, bool print, const std::string& statusFile);
+  static bool enabled();
+  ProgressMeter(const std::string& scan, long total);
+  ~ProgressMeter();
+  void advance(long tracks = 1);
+ private:
+  typedef std::chrono::steady_clock Clock;
+  void report(bool finished);
+  static long residentKb();
+  static double intervalSeconds_;
+  static bool print_;
+  static std::string statusFile_;
+  std::string scan_;
+  long total_;
+  bool active_;
+  std::atomic<long> done_;
+  std::atomic<long> nextReportNs_; // since the start of the scan
+  Clock::time_point start_;
+  std::mutex reportMutex_;
+};
+
+#endif
@@ -7,6 +7,7 @@
 #include <list>
 #include <set>
 #include <memory>
+#include <mutex>
 #include <functional>
 #include <algorithm>
 #include <stdexcept>
@@ -20,6 +21,7 @@
 #include "Decorator.h"
 #include "capabilities.h"
 #include "StringSet.h"
+#include "GeometryArena.h"
 
 using std::string;
 using std::vector;
@@ -105,23 +107,34 @@ public:
   void clear() { state_ = false; }
 };
 
+/**
+ * The geometry epoch. A Computable remembers the epoch its value was computed in and computes it again once the
+ * epoch has moved on, so bumping the epoch when the geometry is rebuilt invalidates all the computed values at once.
+ */
+struct ComputableEpoch {
+  static unsigned int current;
+  static void bump() { current++; }
+};
+
 template<typename T>
 class Computable : public PropertyBase<T> {
   typedef std::function<T()> Func;
   Func get;
   mutable T value_;
   mutable bool state_;
+  mutable unsigned int epoch_;
+  bool pinned_; // explicitly set values do not expire with the epoch
 public:
-  template<class U = Func> Computable(const U& getter /*= []()->T{ throw InvalidComputable(); }*/) : get(Func(getter)), state_(false) {} // default arg commented out due to bug in gcc 4.7.2-5
-  Computable() : get([]()->T{ throw InvalidComputable(); }), state_(false) {}
-  Computable(const Computable<T>& other) : Computable() { value_ = other.value_; state_ = other.state_; } // Func does not get copied!! needs to be manually setup() again to prevent issues with the captures (capture happens at point of declaration)
-  void operator()(const T& value) { value_ = value; state_ = true; }
+  template<class U = Func> Computable(const U& getter /*= []()->T{ throw InvalidComputable(); }*/) : get(Func(getter)), state_(false), epoch_(0), pinned_(false) {} // default arg commented out due to bug in gcc 4.7.2-5
+  Computable() : get([]()->T{ throw InvalidComputable(); }), state_(false), epoch_(0), pinned_(false) {}
+  Computable(const Computable<T>& other) : Computable() { value_ = other.value_; state_ = other.state_; epoch_ = other.epoch_; pinned_ = other.pinned_; } // Func does not get copied!! needs to be manually setup() again to prevent issues with the captures (capture happens at point of declaration)
+  void operator()(const T& value) { value_ = value; state_ = true; pinned_ = true; }
   const T& operator()() const {
-    if (!state_) { value_ = get(); state_ = true; }
+    if (!state_ || (epoch_ != ComputableEpoch::current && !pinned_)) { value_ = get(); state_ = true; epoch_ = ComputableEpoch::current; }
     return value_;
   }
-  bool state() const { return state_; }
-  void clear() { state_ = false; }
+  bool state() const { return state_ && (pinned_ || epoch_ == ComputableEpoch::current); }
+  void clear() { state_ = false; pinned_ = false; }
   template<class U = Func> void setup(const U& getter) { get = Func(getter); }
 };
 
@@ -264,6 +277,7 @@ public:
   PropertyNode(const string& name) : name_(StringSet::ref(name)) {}
   bool state() const { return !this->empty(); }
   void clear() { map<T, ptree>::clear(); }
+  void release() { clear(); } // frees the subtrees, once they have been handed to the objects they configure
   string name() const { return name_; }
   void fromPtree(const ptree& pt) { 
     bool weak = pt.data().front() == '_'; // a weak key doesn't cause insertion if a key with the same name is not already present (be mindful of the include order when using weak keys)
@@ -282,6 +296,7 @@ public:
   PropertyNode(const string& name) : name_(StringSet::ref(name)) {}
   bool state() const { return !this->empty(); }
   void clear() { map<int, ptree>::clear(); }
+  void release() { clear(); }
   string name() const { return name_; }
   void fromPtree(const ptree& pt) { 
     vector<int> keys;
@@ -308,6 +323,7 @@ public:
   PropertyNodeUnique(const string& name) : name_(StringSet::ref(name)) {}
   bool state() const { return !this->empty(); }
   void clear() { vector<pair<T, ptree> >::clear(); }
+  void release() { vector<pair<T, ptree> >().swap(*this); }
   string name() const { return name_; }
   void fromPtree(const ptree& pt) { this->push_back(make_pair(pt.data(), pt)); }
   void fromString(const string& s) { this->push_back(make_pair(str2any<T>(s), ptree())); }
@@ -334,15 +350,18 @@ class PropertyObject {
   PropertyTree pt_;
   static std::set<string> globalMatchedProperties_;
   static std::set<string> globalUnmatchedProperties_;
+  static std::mutex globalPropertiesMutex_;
 
-  void processProperties(PropertyMap& props) {
-    for (auto& propElem : props) {
-      auto childRange = pt_.equal_range(propElem.first);
-      std::for_each(childRange.first, childRange.second, [&propElem](const ptree::value_type& treeElem) {
-        propElem.second->fromPtree(treeElem.second); // takes care of duplicate entries (by overwriting the property value as many times as there are entries with the same key) and of node entries (in that case the PropertyNodes differentiates based on the value)
-      });
-      pt_.erase(propElem.first);
-    }
+  Parsable* findParsedProperty(const string& key) {
+    auto it = parsedCheckedProperties_.find(key);
+    if (it != parsedCheckedProperties_.end()) return it->second;
+    it = parsedProperties_.find(key);
+    return it != parsedProperties_.end() ? it->second : nullptr;
+  }
+  void bindChild(const ptree::value_type& treeElem, PropertyTree& unmatched) {
+    Parsable* prop = findParsedProperty(treeElem.first);
+    if (prop) prop->fromPtree(treeElem.second); // takes care of duplicate entries (by overwriting the property value as many times as there are entries with the same key) and of node entries (in that case the PropertyNodes differentiates based on the value)
+    else unmatched.push_back(treeElem);
   }
   void printAll(const PropertyTree& pt) {
     for (auto& p : pt) {
@@ -358,6 +377,7 @@ protected:
   PropertyMap& checkedOnly() { return checkedProperties_; }
 
   void recordMatchedProperties() {
+    std::lock_guard<std::mutex> lock(globalPropertiesMutex_);
     for (auto& mapel : parsedCheckedProperties_) globalMatchedProperties_.insert(mapel.first);
     for (auto& mapel : parsedProperties_) globalMatchedProperties_.insert(mapel.first);
     for (auto& mapel : checkedProperties_) globalMatchedProperties_.insert(mapel.first);
@@ -365,19 +385,24 @@ protected:
   }
 
 public:
+  // the objects built within the scope of a GeometryArena are allocated from it
+  static void* operator new(std::size_t size) { return GeometryArena::allocate(size); }
+  static void operator delete(void* p) { GeometryArena::release(p); }
+
   PropertyObject() {}
+  /**
+   * Parse a property tree into the registered properties. The children of the tree are bound to the properties in a single
+   * pass, each child being looked up by its key, and only those no property matched are copied into the tree of the object.
+   * The children left from the previous calls come first, so that the entries of the new tree overwrite them.
+   * @param newpt The tree to be parsed
+   */
   virtual void store(const PropertyTree& newpt) {
-    if (pt_.empty()) pt_ = newpt;
-    else { 
-      pt_.data() = newpt.data();
-      for (auto& propElem : newpt) { 
-        pt_.add_child(propElem.first, propElem.second); 
-      } // merging trees in a careless manner, appending children without ever checking if an entry with the same key is already present. the duplicates thus formed will be all grabbed at parsing time by the properties (each duplicate entry overwrites the previous)
-    }
+    PropertyTree unmatched(newpt.data());
+    for (auto& propElem : pt_) bindChild(propElem, unmatched);
+    for (auto& propElem : newpt) bindChild(propElem, unmatched); // merging trees in a careless manner, appending children without ever checking if an entry with the same key is already present. the duplicates thus formed will be all grabbed at parsing time by the properties (each duplicate entry overwrites the previous)
+    pt_.swap(unmatched);
 //    std::cout << "============ " << pt_.data() << " ===========" << std::endl;
 //    printAll(pt_);
-    processProperties(parsedCheckedProperties_);
-    processProperties(parsedProperties_);
     recordMatchedProperties();
   }
   virtual void check() {
@@ -396,8 +421,22 @@ public:
 
   virtual void cleanup() { pt_.clear(); parsedCheckedProperties_.clear(); parsedProperties_.clear(); }
   virtual void cleanupTree() { pt_.clear(); }
+  /**
+   * Frees what only the build of the object needed, once the geometry is final: its property tree and the lists of
+   * its properties, which can then be neither parsed nor checked again. The objects keeping subtrees in their nodes,
+   * or other objects built from the configuration, release those too.
+   */
+  virtual void releaseBuildState() {
+    PropertyTree().swap(pt_);
+    PropertyMap().swap(parsedCheckedProperties_);
+    PropertyMap().swap(checkedProperties_);
+    PropertyMap().swap(parsedProperties_);
+  }
+
+  static std::size_t contentHash(const PropertyTree& pt);
 
   static std::set<string> reportUnmatchedProperties() {
+    std::lock_guard<std::mutex> lock(globalPropertiesMutex_);
     std::set<string> unmatched;
     std::set_difference(globalUnmatchedProperties_.begin(), globalUnmatchedProperties_.end(),
                         globalMatchedProperties_.begin(), globalMatchedProperties_.end(),
@@ -1,6 +1,9 @@
 #ifndef PT_ERROR_ADAPTER_H
 #define PT_ERROR_ADAPTER_H
 
+#include <tuple>
+#include <vector>
+
 #include "global_constants.h"
 #include "ptError.h"
 #include "Module.h"
@@ -16,12 +19,38 @@ class PtErrorAdapter {
   static const double ptFitParamsMid[]; // 1 GeV to 4 GeV     Chi^2 / dof = 84.2299/71 = 1.18634
   static const double ptFitParamsHigh[]; // 4 GeV to 10 GeV    Chi^2 / dof = 102.736/135 = 0.76101
 
+public:
+  // The module quantities the parameterisation depends on. The trigger scans evaluate it thousands of times per module,
+  // so they are read from the module (through its properties and sensors) once, when the adapter is built.
+  // Modules with the same parameters get the same trigger probabilities and frequencies: the visitors use them as a key
+  // to evaluate these once per class of identical modules
+  struct ModuleParameters {
+    double dsDistance, effectiveDsDistance;
+    double pitch, stripLength;
+    double z, rho, theta;
+    double length, tilt;
+    double geometricEfficiency;
+    double phiAperture, etaAperture;
+    ZCorrelation zCorrelation;
+    ModuleSubdetector subdet;
+    int triggerWindow;
+    bool operator<(const ModuleParameters& other) const {
+      return std::tie(dsDistance, effectiveDsDistance, pitch, stripLength, z, rho, theta, length, tilt, geometricEfficiency, phiAperture, etaAperture, zCorrelation, subdet, triggerWindow)
+           < std::tie(other.dsDistance, other.effectiveDsDistance, other.pitch, other.stripLength, other.z, other.rho, other.theta, other.length, other.tilt,
+                      other.geometricEfficiency, other.phiAperture, other.etaAperture, other.zCorrelation, other.subdet, other.triggerWindow);
+    }
+  };
+private:
   ptError myPtError;
   const DetectorModule& mod_;
+  ModuleParameters params_;
 
+   void cacheModuleParameters();
    void setPterrorParameters();
+   void ptSpectrum(double myLowCut, double myHighCut, std::vector<double>& pts, std::vector<double>& weights) const;
 public:
-   PtErrorAdapter(const DetectorModule& m) : mod_(m) { setPterrorParameters(); }
+   PtErrorAdapter(const DetectorModule& m) : mod_(m) { cacheModuleParameters(); setPterrorParameters(); }
+   const ModuleParameters& moduleParameters() const { return params_; }
    double getTriggerProbability(const double& trackPt, const double& stereoDistance = 0, const int& triggerWindow = 0);
    double getTriggerFrequencyTruePerEventAbove(const double& myCut);
    double getParticleFrequencyPerEventAbove(const double& myCut);
@@ -29,6 +58,8 @@ public:
    double getTriggerFrequencyTruePerEventBetween(double myLowCut, double myHighCut);
    double getParticleFrequencyPerEventBetween(double myLowCut, double myHighCut);
    double getTriggerFrequencyFakePerEvent();
+   void getTriggerProbabilities(const std::vector<double>& trackPts, std::vector<double>& probabilities);
+   void getFrequenciesPerEvent(const std::vector<double>& cuts, std::vector<double>& particlesAbove, std::vector<double>& trueAbove, std::vector<double>& trueBelow);
    double getPtThreshold(const double& myEfficiency);
    double stripsToP(double strips) const;
    double pToStrips(double strips) const;
@@ -98,6 +98,7 @@ public:
   }
   
   void build();
+  void releaseBuildState() override { PropertyObject::releaseBuildState(); materialObject_.releaseBuildState(); }
   void check() override;
 
   void translateZ(double z);
@@ -50,6 +50,8 @@ public:
       beamSpotCover("beamSpotCover", parsedAndChecked(), true)
   {}
 
+  void releaseBuildState() override { PropertyObject::releaseBuildState(); materialObject_.releaseBuildState(); }
+
   void setup() {
     minAperture.setup([&]() { return minget2(zPlusModules_.begin(), zPlusModules_.end(), &Module::phiAperture); }); // CUIDADO not checking the zMinus modules, check if this could cause problems down the road
     maxAperture.setup([&]() { return maxget2(zPlusModules_.begin(), zPlusModules_.end(), &Module::phiAperture); });
@@ -131,6 +133,7 @@ public:
 
   
   void build(const RodTemplate& rodTemplate);
+  void releaseBuildState() override { RodPair::releaseBuildState(); ringNode.release(); }
 
   std::set<int> solveCollisionsZPlus();
   std::set<int> solveCollisionsZMinus();
@@ -0,0 +1,38 @@
+#ifndef RunEstimate_h
+#define RunEstimate_h
+
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * @class RunEstimate
+ * @brief This class projects the wall time, CPU time and peak memory of a run from a calibration on this machine
+ *
+ * The stages whose cost does not depend on the number of tracks (the builds) are run once, as the run would. The
+ * track scans are run with a small calibration number of tracks and with twice as many: the difference between the
+ * two gives the cost of a track, and what is left the fixed cost of the scan, so that the cost of the requested
+ * number of tracks is projected linearly. The resources are read from the tasks the <i>StopWatch</i> records.
+ */
+class RunEstimate {
+ public:
+  static int calibrationTracks(int tracks, int tracksPerThread);
+  bool measure(const std::string& stage, const std::function<bool()>& run);
+  bool measureScaling(const std::string& stage, int tracks, int calibrationTracks, const std::function<bool(int)>& run);
+  std::string report() const;
+ private:
+  struct Cost {
+    Cost() : wallSeconds(0), cpuSeconds(0), peakRssKb(0) {}
+    double wallSeconds, cpuSeconds;
+    double peakRssKb;
+  };
+  struct Stage {
+    std::string name;
+    int tracks, calibrationTracks; // 0 for a stage run as it is
+    Cost measured, projected;
+  };
+  std::vector<Stage> stages_;
+  static bool timed(const std::string& name, const std::function<bool()>& run, Cost& cost);
+};
+
+#endif
@@ -3,6 +3,7 @@
 
 #include <string>
 #include <exception>
+#include <memory>
 
 #include "global_funcs.h"
 #include "Polygon3d.h"
@@ -14,10 +15,22 @@ class DetectorModule;
 enum class SensorType { Pixel, Largepix, Strip, None };
 
 class Sensor : public PropertyObject, public Buildable, public Identifiable<int> {
+  // A polygon built on demand and owned by the sensor, or one of the polygons the tracker builds in bulk for all of its
+  // sensors (see Tracker::buildSensorPolys()). A copy, as made for every module of a cloned rod or ring, starts empty: the
+  // copies are then moved or rotated, and build their own polygon only if it is asked for
+  struct PolyCache {
+    std::unique_ptr<const Polygon3d<4>> owned;
+    const Polygon3d<4>* poly = nullptr;
+    PolyCache() {}
+    PolyCache(const PolyCache&) {}
+    PolyCache& operator=(const PolyCache&) { clear(); return *this; }
+    void clear() { owned.reset(); poly = nullptr; }
+  };
   const DetectorModule* parent_;
-  mutable const Polygon3d<4>* hitPoly_ = 0; 
-  mutable const Polygon3d<4>* envPoly_ = 0; 
-  Polygon3d<4>* buildOwnPoly(double polyOffset) const;
+  mutable PolyCache hitPoly_;
+  mutable PolyCache envPoly_;
+  Polygon3d<4> buildOwnPoly(double polyOffset) const;
+  double envelopeOffset() const;
 public:
   ReadonlyProperty<int, NoDefault> numSegments;
   ReadonlyProperty<int, NoDefault> numStripsAcross;
@@ -71,9 +84,13 @@ public:
 //  double minRVertex() const { double min = std::numeric_limits<double>::max(); for (auto v : *poly_) { min = MIN(min, v.Rho()); } return min; }
 //  double minZVertex() const { double min = std::numeric_limits<double>::max(); for (auto v : *poly_) { min = MIN(min, v.Z()); } return min; }
   
-  void clearPolys();
+  void clearPolys() const;
   const Polygon3d<4>& hitPoly() const;
   const Polygon3d<4>& envelopePoly() const;
+  Polygon3d<4> buildHitPoly() const { return buildOwnPoly(normalOffset()); }
+  Polygon3d<4> buildEnvelopePoly() const { return buildOwnPoly(envelopeOffset()); }
+  // Use polygons kept by the caller, until the sensor is moved or they are cleared
+  void attachPolys(const Polygon3d<4>* hit, const Polygon3d<4>* envelope) const { hitPoly_.clear(); hitPoly_.poly = hit; envPoly_.clear(); envPoly_.poly = envelope; }
 };
 
 #endif
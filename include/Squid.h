@@ -13,6 +13,10 @@
 #ifndef _SQUID_H
 #define	_SQUID_H
 
+#include <future>
+#include <map>
+#include <memory>
+#include <set>
 #include <string>
 #include <MatParser.h>
 #include <InactiveSurfaces.h>
@@ -26,6 +30,8 @@
 #include <boost/filesystem/operations.hpp>
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/info_parser.hpp>
+#include <boost/iostreams/stream.hpp>
+#include <boost/iostreams/device/array.hpp>
 #include <boost/program_options/variables_map.hpp>
 #include <rootweb.hh>
 #include <mainConfigHandler.h>
@@ -57,6 +63,7 @@ namespace insur {
   static const std::string err_no_inacsurf = "The collection of inactive surfaces does not exist. It must be created before calling this function";
   static const std::string err_no_matbudget = "The material budget does not exist. It must be created before calling this function.";
   static const std::string err_no_triggerSummary = "Could not report on the trigger performance.";
+  static const std::string err_no_tracksim = "The track simulation has not been ported to the current geometry model yet: no tracks were shot.";
   static const std::string warn_rootonly = "The collection of inactive surfaces does not exist. Only the .root file will be written.";
   static const std::string warn_custom_matfile = "A customized material file was used for the tracker";
   static const std::string warn_custom_matfile_pixel = "A customized material file was used for the pixel";
@@ -76,9 +83,24 @@ namespace insur {
    */
   class Squid {
   public:
+    /**
+     * The stages of the analysis of a layout. Each declares the stages it takes its inputs from and what it makes (see
+     * <i>stageDeclaration()</i>), so that the reports asked for only pull the stages they need, with their inputs.
+     */
+    enum Stage { TrackerStage, GeometryScanStage, BandwidthStage, PowerStage, MaterialsStage, MaterialBudgetStage,
+                 MaterialScanStage, ResolutionStage, TriggerStage };
+    struct StageDeclaration {
+      std::string name;
+      std::vector<Stage> inputs;
+      std::string outputs;
+    };
+    static const StageDeclaration& stageDeclaration(Stage stage);
+    static std::set<Stage> requiredStages(const std::set<Stage>& wanted);
+
     Squid();
     virtual ~Squid();
     bool buildTracker();
+    bool stageKeys(const std::string& geometryFile, std::map<std::string, std::size_t>& keys);
     //bool dressTracker();
     //bool buildTrackerSystem();
     //bool irradiateTracker();
@@ -92,8 +114,10 @@ namespace insur {
     // Functions using rootweb
     bool analyzeTriggerEfficiency(int tracks, bool detailed);
     bool pureAnalyzeGeometry(int tracks);
-    bool pureAnalyzeMaterialBudget(int tracks, bool trackingResolution);
+    bool pureAnalyzeMaterialBudget(int tracks, bool trackingResolution, bool materialReport = true, bool materialScan = true);
     bool reportGeometrySite();
+    bool pureAnalyzeBandwidth();
+    bool pureAnalyzePower();
     bool reportBandwidthSite();
     bool reportTriggerProcessorsSite();
     bool reportPowerSite();
@@ -105,14 +129,91 @@ namespace insur {
     bool makeSite(bool addLogPage = true);
     void setBasename(std::string newBaseName);
     void setGeometryFile(std::string geomFile);
+    void prefetchInputs();
+    static std::vector<std::future<void> > loadSharedInputs();
     void setHtmlDir(std::string htmlDir);
 
+    void useModuleHitIndex(bool use);
+    void useSinglePrecisionHits(bool use);
+    void setNumThreads(int n);
+    void setNumaPinning(bool pinned);
+    void setRandomSeed(int seed);
+    bool setPowerScan(const std::string& scan);
+    bool setPileupScan(const std::string& scan);
+    bool setReadoutWhatIf(const std::string& fileName);
+    bool setImageFormats(const std::string& formats, bool lazy);
+    void setPipelinedReports(bool pipelined);
+    bool setRasterMaps(const std::string& mode);
+    bool setGeometryTrackRegion(const std::string& region);
+    bool setGeometryIndex(const std::string& sizes);
+    void stratifyGeometryTracks(bool stratify);
+    void setGeometryTrackPrecision(double precision);
+    void setGeometryTrackPt(double pt);
+    bool setTimeBudget(const std::string& budget, const std::vector<std::string>& analyses);
+    void setQuasiRandomTracks(bool quasiRandom);
+    void setSinglePassScan(bool singlePass);
+    void setPhiSymmetry(bool phiSymmetry);
+    void setResolutionGraphBins(int bins);
+    void setFastResolution(bool fast);
+    bool setMaterialWhatIf(const std::string& fileName);
+    bool setMaterialTrackShard(const std::string& shard);
+    void setMaterialShardFiles(const std::vector<std::string>& fileNames);
+    bool writeMaterialShard(const std::string& fileName);
+    void setMaterialCheckpoint(const std::string& fileName, double minutes, bool resume);
+    void setTrackHitCache(const std::string& fileName, bool reuse);
+    void setWorkerProcesses(int n);
+    void recordTrackSamples(bool record);
+    bool writeTrackSamples(const std::string& fileName);
+    bool writeTrackRecords(const std::string& fileName);
+    bool closeTrackRecords();
+    bool setResultsCompression(const std::string& compression);
+    bool writeResults(const std::string& fileName);
+    bool writeResultsJson(const std::string& fileName);
     void simulateTracks(const po::variables_map& varmap, int seed);
     void setCommandLine(int argc, char* argv[]);
+    std::size_t configurationHash() const { return configurationHash_; }
+    const Tracker* tracker() const { return tr; }
+    const SimParms* simParms() const { return simParms_; }
+    Analyzer& analyzer() { return a; }
 
   private:
     //std::string g;
     Tracker* tr;
+    std::size_t trHash_, pxHash_; // key of the configuration and material file the trackers were built from
+    std::size_t configurationHash_; // hash of the whole preprocessed configuration and of the revision
+    std::size_t trMaterialsKey_, pxMaterialsKey_; // key of the tracker the materials were routed on, 0 if none
+    std::size_t trBudgetKey_, pxBudgetKey_; // key of the tracker the material budgets were made for, 0 if none
+    std::size_t trackerKey(const boost::property_tree::ptree& config, const std::string& baseName);
+    bool readConfiguration(const std::string& fileName, std::string& configuration, boost::property_tree::ptree& pt, std::set<std::string>* includes = NULL);
+    void dropMaterials(bool pixel);
+    std::map<std::string, std::string> inputs_; // the parameters the reports depend on, besides the configuration
+    std::string inputTag(const std::string& report, const std::vector<std::string>& inputNames);
+    std::string fileFingerprint(const std::string& fileName);
+    std::map<std::string, std::vector<double> > powerScan_; // the values of the operating parameters the irradiated power is scanned over
+    std::vector<double> pileupScan_; // the pile-ups the bandwidth and trigger rates are also computed for
+    std::vector<ReadoutWhatIf::Variant> readoutVariants_; // the readouts of the module types the bandwidth and trigger rates are also computed for
+    bool materialWhatIf_; // whether the material budget is reweighted with the lengths and component scales below after the scan
+    std::map<std::string, std::pair<double, double> > whatIfMaterialLengths_;
+    std::map<std::string, double> whatIfComponentScales_;
+    int materialShard_, materialShards_; // the slice of the material tracks scanned by this run, from 0, out of that many
+    std::vector<std::string> materialShardFiles_; // the scans of the shards merged instead of shooting the material tracks
+    std::string materialCheckpointFile_; // where the material scans are checkpointed every so many minutes, none if empty
+    double materialCheckpointMinutes_;
+    bool resumeMaterialScan_;
+    std::string trackHitCacheFile_; // where the hits of the resolution tracks are cached, none if empty
+    bool reuseTrackHitCache_; // whether the resolution scan takes its tracks from the cache when it matches
+    bool fastResolution_; // whether the resolutions are estimated analytically instead of from tracks
+    int materialScanTracks_; // the number of tracks and the maps of the last material scan, as recorded in its shards
+    bool materialScanMaps_;
+    int resultsCompression_; // the ROOT compression setting of the results file, as 100 * algorithm + level
+    TrackRecordWriter trackRecords_; // the records of the material and resolution tracks, written as the scans go
+    std::vector<std::future<void> > inputLoads_; // the shared inputs being loaded since prefetchInputs()
+    bool mergeMaterialShards(int tracks, bool materialMaps);
+    double geometrySeconds_, materialSeconds_; // the time budgets of the geometry and material scans, 0 for none
+    static constexpr int materialPilotTracks = 256; // the tracks per thread of the scan timed to size a budgeted material scan
+    bool analyzeMaterialBudgetOnce(int tracks, bool materialReport);
+    int workerProcesses_; // the number of processes the material tracks are shot in, 1 for this one only
+    bool analyzeMaterialBudgetInWorkers(int tracks, bool materialReport);
     SimParms* simParms_;
     InactiveSurfaces* is;
     MaterialBudget* mb;
@@ -122,13 +223,15 @@ namespace insur {
     MaterialBudget* pm;
     MatParser mp;
     Usher u;
-    Materialway materialwayTracker;
-    Materialway materialwayPixel;
+    std::unique_ptr<Materialway> materialwayTracker; // made afresh for each tracker the materials are routed on
+    std::unique_ptr<Materialway> materialwayPixel;
     MatCalc tkMaterialCalc;
     MatCalc pxMaterialCalc;
     Analyzer a;
     Analyzer pixelAnalyzer;
-    Vizard v;
+    std::unique_ptr<Vizard> v_; // made for the first report, so that a run without a website never makes one
+    std::string commandLine_;
+    Vizard& vizard();
     mainConfigHandler& mainConfiguration;
     tk2CMSSW t2c;
     bool fileExists(std::string filename);
@@ -156,6 +259,7 @@ namespace insur {
     WeightDistributionGrid weightDistributionPixel;
 
     bool prepareWebsite();
+    void renderReportPages();
     bool sitePrepared;
 
   };
@@ -2,42 +2,131 @@
 #define StopWatch_h
 
 #include <messageLogger.h>
-#include <ctime>
+#include <chrono>
 #include <string>
 #include <list>
+#include <vector>
+#include <thread>
+#include <typeinfo>
 
 #define startTaskClock(message) StopWatch::instance()->startCounter(message)
 #define addTaskInfo(message) StopWatch::instance()->addInfo(message)
 #define stopTaskClock() StopWatch::instance()->stopCounter()
+#define STOPWATCH_CONCAT_(a, b) a##b
+#define STOPWATCH_CONCAT(a, b) STOPWATCH_CONCAT_(a, b)
+#define scopeTaskClock(name) StopWatch::Scope STOPWATCH_CONCAT(taskScope_, __LINE__)(name)
 
 /**
  * @class StopWatch
- * @brief This class measures the CPU time used between two moments
+ * @brief This class measures the time and the resources used between two moments
  *
- * It uses the ctime library to call time(), which is measuring the
- * CPU time used by the process so far. It works nicely as long as the
- * counter does not flip over (which should happen every 72 minutes at
- * most in a 32 bit CPU) The stop watch is started by the constructyor
- * (and by restart()) and it gives the elapsed CPU time in seconds
- * when asked
+ * Each counter (task) records the elapsed wall clock time, taken from a steady clock, the CPU
+ * time used by the process (summed over all of its threads, so that the ratio of the two gives the
+ * parallel speedup), the peak resident memory at the end of the task and the number of
+ * heap allocations made meanwhile. Neither time flips over, however long the task.
+ * Counters can be nested: the finished tasks are kept in the order they were started,
+ * with their nesting depth and the time spent outside of their subtasks, and can be
+ * exported as CSV or JSON.
+ * The steps of the program are also timed by scopes (see Scope), which are not printed
+ * and sum up the consecutive runs of the same step in a single task.
+ * The heap memory is also accounted to the subsystem holding it: each allocation is charged
+ * to the memory account of the thread making it (see MemoryScope), and credited back to
+ * that account when it is freed, wherever that happens.
  */
 class StopWatch {
  public:
+  /**
+   * @struct Task
+   * @brief The resources used by one finished task
+   */
+  struct Task {
+    std::string name;
+    int depth;
+    double wallSeconds, cpuSeconds;
+    long peakRssKb;
+    long allocations;
+    bool finished;
+    int calls;          // the runs summed up in the task
+    double selfSeconds; // the wall clock time outside of the subtasks
+  };
+  /**
+   * The subsystems the heap memory is accounted to
+   */
+  enum MemoryAccount { OtherMemory, GeometryMemory, MaterialsMemory, MaterialwayMemory, AnalysisMemory, TrackMemory, SiteMemory, NumMemoryAccounts };
+  /**
+   * @struct MemoryUsage
+   * @brief The heap memory of one account: what it holds now, the most it held at any time and the allocations charged to it
+   */
+  struct MemoryUsage {
+    std::string account;
+    long liveBytes, peakBytes;
+    long allocations;
+  };
+  /**
+   * @class MemoryScope
+   * @brief Charges the allocations of the thread to an account until the scope ends
+   */
+  class MemoryScope {
+    MemoryAccount previous_;
+   public:
+    explicit MemoryScope(MemoryAccount account);
+    ~MemoryScope();
+    MemoryScope(const MemoryScope&) = delete;
+    MemoryScope& operator=(const MemoryScope&) = delete;
+  };
+  /**
+   * @class Scope
+   * @brief Times a step until the scope ends, quietly, as a task of its own; the scopes opened by the other threads than
+   * the one which made the stop watch are not timed, as the tasks are not shared between threads
+   */
+  class Scope {
+    bool active_;
+   public:
+    explicit Scope(const std::string& name);
+    ~Scope();
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+  };
   static StopWatch* instance();
-  void startCounter(std::string message);
+  void startCounter(std::string message, bool quiet = false);
   double stopCounter();
+  void addTask(const std::string& name, double wallSeconds, double cpuSeconds);
+  bool onOwnThread() const { return std::this_thread::get_id() == thread_; }
   void setVerbosity(unsigned int newVerbosity, bool newPerformance);
   void addInfo(std::string message);
+  const std::vector<Task>& tasks() const { return tasks_; }
+  std::string csvReport() const;
+  std::string jsonReport() const;
+  bool writeReport(const std::string& fileName) const;
+  static long allocationCount();
+  static MemoryAccount memoryAccount();
+  static std::vector<MemoryUsage> memoryUsage();
+  static std::string memoryReport();
   static void destroy();
+  static double threadCpuSeconds();
+  static std::string typeName(const std::type_info& type);
  private:
+  typedef std::chrono::steady_clock Clock;
+  struct OpenTask {
+    size_t index;
+    Clock::time_point wallStart;
+    double cpuStart;
+    long allocationStart;
+    bool quiet;
+    double childSeconds; // the wall clock time of the subtasks of this run
+  };
   StopWatch();
   ~StopWatch();
   static StopWatch* myInstance_;
-  std::list<clock_t> startTimes_;
-  double diffClock(const clock_t& stopTime, const clock_t& startTime);
+  std::list<OpenTask> startTimes_;
+  std::vector<Task> tasks_;
+  static double cpuSeconds();
+  static long peakRssKb();
   unsigned int verbosity_;
   unsigned int lastVerbosity_;
+  unsigned int printedTasks_; // the running tasks which are not quiet
   bool reportTime_;
+  std::thread::id thread_;
 };
 
 #endif
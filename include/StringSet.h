@@ -3,9 +3,11 @@
 
 #include <set>
 #include <string>
+#include <mutex>
 
 class StringSet {
   std::set<std::string> strings_;
+  std::mutex mutex_; // the properties of independent objects may be registered from different threads
   StringSet() {}
 public:
   static StringSet& instance() {
@@ -18,6 +20,7 @@ public:
   }
 
   const std::string& makeRef(const std::string& s) { 
+    std::lock_guard<std::mutex> lock(mutex_);
     return *strings_.insert(s).first;
   }
 
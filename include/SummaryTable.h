@@ -3,6 +3,8 @@
 
 #include <map>
 #include <string>
+#include <vector>
+#include <type_traits>
 
 #include "global_funcs.h"
 
@@ -10,39 +12,78 @@
 /**
  * @class SummaryTable
  * @brief A generic object to build summary tables
+ *
+ * The numbers are kept as numbers in the cells, with the precision they were set with, and are only converted to strings
+ * when the content of the table is requested for rendering: accumulating into a cell costs no conversion.
  */
 
 class SummaryTable {
 public:
+  typedef std::map<std::pair<int, int>, std::string> Content;
+
   SummaryTable() : numRows_(0), numColumns_(0), rowOffset_(0), columnOffset_(0), precision_(-1), summaryCellPosition_(0,0), summaryLabelPosition_(0,0) {};
   void setHeader(std::string rowHeader, std::string columnHeader, int rowOffset = 0, int columnOffset = 0) { // has to be called before filling the table with content or the row and column numbering will not be correctly set
     rowOffset_ = rowOffset; columnOffset_ = columnOffset;
-    summaryTable[std::make_pair(0,0)] = columnHeader + " &rarr;<br>" + rowHeader + " &darr;";
+    cell(0, 0).setText(columnHeader + " &rarr;<br>" + rowHeader + " &darr;");
   }
   void setPrecision(int precision) { precision_ = precision; } // has to be called before filling the table or conversions from floating point won't have the desired precision
 
-  template<typename T> void setCell(int row, int column, const T& content) { setCell(row, column, any2str(content, precision_)); }
-  template<typename T, typename BinaryOp> void setCell(int row, int column, const T& content, BinaryOp binop) { setCell(row, column, binop(hasCell(row, column) ? str2any<T>(getCell(row, column)) : T(), content)); }
+  template<typename T> void setCell(int row, int column, const T& content) { setTypedCell(row, column, content, IsNumber<T>()); }
+  template<typename T, typename BinaryOp> void setCell(int row, int column, const T& content, BinaryOp binop) { setCell(row, column, binop(hasCell(row, column) ? getCellValue<T>(row, column) : T(), content)); }
 
   template<typename T> void setSummaryCell(std::string label, const T& content) { setSummaryCell(label, any2str(content, precision_)); }
 
-  std::string getCell(int row, int column) { return summaryTable[std::make_pair(row,column)];} // this actually alters the map if the cell's not there = DANGEROUS
+  std::string getCell(int row, int column) const { return hasCell(row, column) ? cells_[row][column].str() : std::string(); }
+  template<typename T> T getCellValue(int row, int column) const { // a number is taken as is, a string is parsed
+    const Cell& c = cells_[row][column];
+    return c.kind == Cell::Text ? str2any<T>(c.text) : T(c.number);
+  }
 
-  bool hasCell(int row, int column) const { return summaryTable.count(std::make_pair(row,column)); }  // tests whether a cell has already been inserted = SAFE
+  bool hasCell(int row, int column) const { return row < (int)cells_.size() && column < (int)cells_[row].size() && cells_[row][column].kind != Cell::Empty; }  // tests whether a cell has already been inserted = SAFE
   bool hasSummaryCell() const { return summaryCellPosition_ > std::make_pair(0, 0); }
 
-  std::map<std::pair<int, int>, std::string>& getContent() { return summaryTable; }
+  const Content& getContent() const;
 
-  void clear() { summaryTable.clear(); }
+  void clear() { cells_.clear(); }
+  void merge(const SummaryTable& other);
 private:
-  std::map<std::pair<int, int>, std::string> summaryTable;
+  template<typename T> struct IsNumber : std::integral_constant<bool, std::is_arithmetic<T>::value && !std::is_same<T, bool>::value> {};
+
+  struct Cell {
+    enum Kind { Empty, Text, Integer, Real };
+    Kind kind;
+    int precision;
+    double number;
+    std::string text;
+    Cell() : kind(Empty), precision(-1), number(0) {}
+    void setText(const std::string& content) { kind = Text; text = content; }
+    void setNumber(double content, bool integer, int prec) { kind = integer ? Integer : Real; number = content; precision = prec; }
+    std::string str() const;
+  };
+
+  std::vector<std::vector<Cell> > cells_; // by row, then column, as many of them as the furthest cell set
+  mutable Content content_; // the cells as strings, made by getContent()
   int numRows_, numColumns_;
   int rowOffset_, columnOffset_; // from which number rows and columns headers should start
   int precision_; // precision to convert floating point numbers with
   std::pair<int, int> summaryCellPosition_, summaryLabelPosition_;
+
+  Cell& cell(int row, int column);
+  void setCellContent(int row, int column, const Cell& content);
+  template<typename T> void setTypedCell(int row, int column, const T& content, std::true_type) {
+    Cell c;
+    c.setNumber(double(content), std::is_integral<T>::value, precision_);
+    setCellContent(row, column, c);
+  }
+  template<typename T> void setTypedCell(int row, int column, const T& content, std::false_type) { setCell(row, column, any2str(content, precision_)); }
 };
 
+template<> void SummaryTable::setCell<std::string>(int row, int column, const std::string& content);
+template<> void SummaryTable::setSummaryCell<std::string>(std::string label, const std::string& content);
+
 
 typedef std::map<std::string, SummaryTable> MultiSummaryTable;
 
+void mergeSummaries(MultiSummaryTable& into, const MultiSummaryTable& from);
+
 #endif
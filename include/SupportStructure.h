@@ -55,6 +55,8 @@ namespace material {
     void buildInBarrel(Barrel& barrel);
 
     void updateInactiveSurfaces(InactiveSurfaces& inactiveSurfaces);
+    void collectInactiveElements(std::vector<InactiveElement*>& elements) const { elements.insert(elements.end(), inactiveElements.begin(), inactiveElements.end()); }
+    void releaseBuildState() override { PropertyObject::releaseBuildState(); componentsNode.release(); }
     
   private:
     const double inactiveElementWidth = insur::volume_width;
@@ -102,8 +104,10 @@ namespace material {
 
       double quantityInGrams(double length, double surface) const;
       void populateMaterialProperties(MaterialProperties& materialPropertie) const;
+      void resolveKeys();
     private:
       const MaterialTab& materialTab_;
+      int materialKey_, componentKey_; /**< The keys of elementName and componentName in the MaterialKeys, set when built */
       static const std::string msg_no_valid_unit;
     };
   };
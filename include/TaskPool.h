@@ -0,0 +1,109 @@
+#ifndef TaskPool_h
+#define TaskPool_h
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @class TaskPool
+ * @brief This class runs the parallel parts of all the stages (track scans, visitors, builds, service routing,
+ * extraction) on one set of threads for the whole process
+ *
+ * The pool is sized once (see <i>setNumThreads()</i>) and its threads wait between two jobs, so that the stages
+ * neither start threads of their own nor run more threads than there are CPUs. A job is a set of independent tasks
+ * given by their index: each thread taking part starts on an even share of the indices and, once it is done with it,
+ * steals half of what is left to the thread that has most, so that uneven tasks are balanced. The calling thread
+ * takes part too. A job submitted from within a task (or while another job runs) is run on the calling thread.
+ * The busy time, the steals and the cost of the tasks (their mean, spread and maximum) are added up for each stage, as
+ * well as the longest job, for the performance report: a stage splitting its work into chunks run one after the other
+ * is tuned from them. A process forked from this
+ * one (a layout of a batch) has none of the threads of the pool: it starts its own at its first job.
+ * On a machine of several NUMA nodes, the threads can be pinned to the nodes, in contiguous blocks of thread indices
+ * (see <i>setNumaPinning()</i>): the read-only tables of the scans are then copied to the memory of each node (see
+ * <i>NodeReplicas</i>), and the tasks run by the threads of each node are added up for the report.
+ */
+class TaskPool {
+ public:
+  static TaskPool* instance();
+  static int availableCpus();
+  void setNumThreads(int n);
+  int numThreads() const { return numThreads_; }
+  static const std::vector<std::vector<int> >& numaNodes();
+  void setNumaPinning(bool pinned);
+  bool numaPinning() const { return numaPinning_; }
+  int numNodes() const { return numaPinning_ ? numaNodes().size() : 1; }
+  static int currentNode();
+  static void runOnNode(int node, const std::function<void()>& task);
+  void run(const std::string& stage, int numTasks, const std::function<void(int)>& task, int maxThreads = 0);
+  std::string report() const;
+ private:
+  // The indices still to be run by a thread, from begin to end; the other threads steal from the end
+  struct Range {
+    std::mutex mutex;
+    int begin, end;
+  };
+  // The cost of the tasks run by a thread, in seconds
+  struct TaskCosts {
+    TaskCosts() : count(0), sum(0), squares(0), max(0) {}
+    void add(double seconds);
+    void add(const TaskCosts& other);
+    long count;
+    double sum, squares, max;
+  };
+  struct Job {
+    const std::function<void(int)>* task;
+    int numThreads;
+    std::unique_ptr<Range[]> ranges;
+    std::vector<std::exception_ptr> failures;
+    std::atomic<long> busyNs;
+    std::atomic<int> steals;
+    std::unique_ptr<TaskCosts[]> costs; // one per thread, each written by its thread only
+    std::unique_ptr<int[]> nodes; // the NUMA node of each thread, as it ran the job
+    int memoryAccount; // the one of the calling thread, which the allocations of the tasks are charged to
+  };
+  struct StageStats {
+    StageStats() : calls(0), tasks(0), steals(0), wallSeconds(0), busySeconds(0), threadSeconds(0), maxJobSeconds(0) {}
+    long calls, tasks, steals;
+    double wallSeconds, busySeconds, threadSeconds; // the utilisation is the busy time over the time of the threads taking part
+    double maxJobSeconds;
+    TaskCosts taskCosts;
+    std::vector<TaskCosts> nodeCosts; // by NUMA node, when the threads are pinned
+  };
+  // The threads and what they are synchronised with, which a forked process leaves behind as they are
+  struct Workers {
+    Workers() : job(NULL), generation(0), pending(0), stopping(false) {}
+    std::vector<std::thread> threads;
+    std::mutex runMutex; // one job at a time
+    std::mutex mutex;
+    std::condition_variable wakeUp, jobDone;
+    Job* job;
+    unsigned long generation;
+    int pending; // the threads taking part in the current job that are not done with it
+    bool stopping;
+  };
+  TaskPool();
+  static void forgetWorkersInChild();
+  void startWorkers();
+  void stopWorkers();
+  static void workerLoop(Workers* workers, int worker, int node);
+  int workerNode(int worker) const;
+  static bool pinToNode(int node);
+  static void work(Job& job, int thread);
+  static bool take(Job& job, int thread, int& index);
+  void record(const std::string& stage, int numTasks, int numThreads, double wallSeconds, const Job* job, const TaskCosts& serialCosts);
+  int numThreads_;
+  bool numaPinning_;
+  Workers* workers_;
+  std::map<std::string, StageStats> stats_;
+  mutable std::mutex statsMutex_;
+};
+
+#endif
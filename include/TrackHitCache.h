@@ -0,0 +1,82 @@
+/**
+ * @file TrackHitCache.h
+ * @brief This is the header file for the cache of the hits of the resolution tracks
+ */
+
+#ifndef _TRACKHITCACHE_H
+#define _TRACKHITCACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <hit.hh>
+#include <Tracker.h>
+
+namespace insur {
+  /**
+   * @class TrackHitCache
+   * @brief This class keeps the hits of the resolution tracks in a file, one compact record per hit, for a later run to
+   * compute the resolutions again without looking for the hits.
+   *
+   * The hits found by a scan are added track by track and written at the end: a header with the key of the scan, a
+   * record per track (its angles and the range of its hits) and a record per hit (its distance from the origin, which
+   * gives its radius and z along the track, its material, the resolution of a hit with no module, and the index of
+   * the module hit in the module table of its tracker, the outer tracker or the pixel one). The file is mapped into
+   * memory by the later run, which builds the tracks back from it, one at a time, with the modules of its trackers: the
+   * module resolutions are the ones of the modules, everything else is as cached. The key has to name what the hits
+   * depend on (the layouts, the tracks), not what they are analysed with afterwards (the momenta, the efficiency).
+   */
+  class TrackHitCache {
+  public:
+    typedef std::vector<const Tracker::Modules*> ModuleTables; // of the outer tracker, then of the pixel one if any
+
+    TrackHitCache() : mapped_(NULL), mappedSize_(0), tracks_(NULL), hits_(NULL), numTracks_(0), numHits_(0) {}
+    ~TrackHitCache() { close(); }
+
+    void addTrack(Track& track, const ModuleTables& modules);
+    bool write(const std::string& fileName, const std::string& key) const;
+
+    bool open(const std::string& fileName, const std::string& key, const ModuleTables& modules, bool quiet = false);
+    void close();
+    long numTracks() const { return numTracks_; }
+    void readTrack(long index, const ModuleTables& modules, Track& track) const;
+
+  private:
+    TrackHitCache(const TrackHitCache&) = delete;
+    TrackHitCache& operator=(const TrackHitCache&) = delete;
+
+    static const char magic[8];
+    struct Header {
+      char magic[8];
+      uint32_t keyLength;
+      uint32_t hitRecordSize;
+      uint64_t numTracks, numHits;
+    };
+    struct TrackRecord {
+      double theta, phi;
+      uint64_t firstHit, numHits;
+    };
+    struct HitRecord {
+      double distance; // from the origin, in 3D
+      double radiation, interaction;
+      double resolutionRphi, resolutionY; // only for the active hits with no module
+      int32_t module; // the index of the module in the module table of its tracker, -1 for none
+      int8_t tracker, orientation, objectKind, activeHitType;
+      uint8_t flags;
+    };
+    enum { PixelHit = 1, TriggerHit = 2, IPHit = 4 };
+    static size_t keySpace(size_t keyLength) { return (keyLength + 7) / 8 * 8; } // the records stay 8-byte aligned
+
+    // what is added before writing
+    std::vector<TrackRecord> trackRecords_;
+    std::vector<HitRecord> hitRecords_;
+    // what is mapped after opening
+    void* mapped_;
+    size_t mappedSize_;
+    const TrackRecord* tracks_;
+    const HitRecord* hits_;
+    long numTracks_, numHits_;
+  };
+}
+#endif /* _TRACKHITCACHE_H */
@@ -0,0 +1,71 @@
+/**
+ * @file TrackRecordWriter.h
+ * @brief This is the header file for the writer of the per-track records of the material and resolution scans
+ */
+
+#ifndef _TRACKRECORDWRITER_H
+#define _TRACKRECORDWRITER_H
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+class TFile;
+class TTree;
+
+namespace insur {
+  /**
+   * @class TrackRecordWriter
+   * @brief This class writes a record of each track of the material and resolution scans to a tree of a file, one tree
+   * per scan, on a thread of its own, so that a scan only waits for the disk when the queue is full.
+   *
+   * A scan starts its tree with <i>begin()</i>, which drops the records of an earlier scan of the same name, then
+   * pushes the records of its tracks one batch at a time, in track order: the scan threads fill the records of a chunk
+   * of tracks, and the chunk is pushed once it is done. Each field of the records is a branch, so that the trees are
+   * stored column by column and compressed as the file is (see <i>open()</i>). The records of the material scan have
+   * no tag and no resolutions; the resolution scan has a record per track and tag measuring it, with the errors at
+   * each transverse momentum. The trees are only complete once the writer is closed.
+   */
+  class TrackRecordWriter {
+  public:
+    struct Record {
+      double eta, phi, z0;              // of the track, from (0, 0, z0)
+      double radiation, interaction;    // the lengths crossed by the track, in units of radiation and interaction length
+      int hits;                         // the active hits of the track, or of its tag for the resolution scan
+      std::string tag;                  // the tag of the modules measuring the track, for the resolution scan
+      std::vector<double> pt, deltaRho, deltaPhi, deltaD, deltaCtgTheta, deltaZ0, deltaP; // by transverse momentum [GeV/c]
+    };
+    typedef std::vector<Record> Batch;
+
+    TrackRecordWriter(size_t capacity = 16);
+    ~TrackRecordWriter();
+
+    bool open(const std::string& fileName, int compression);
+    bool isOpen() const { return thread_.joinable(); }
+    void begin(const std::string& scan, bool resolutions);
+    void push(Batch& batch); // queues the records of the scan begun last, leaving the batch empty
+    bool close();            // returns once all the queued records are in the file, and the file is closed
+
+  private:
+    TrackRecordWriter(const TrackRecordWriter&) = delete;
+    TrackRecordWriter& operator=(const TrackRecordWriter&) = delete;
+
+    void writeLoop();
+    void drain() const;
+
+    std::unique_ptr<TFile> file_;
+    std::map<std::string, TTree*> trees_; // by scan, owned by the file
+    TTree* tree_;                         // the tree of the current scan, filled by the thread only
+    Record treeRecord_;                   // the holder the branches of every tree point to
+    const size_t capacity_;
+    std::unique_ptr<Batch[]> batches_; // a ring with a single producer and a single consumer: the slots and their records are reused
+    std::atomic<size_t> pushed_, written_;
+    std::atomic<bool> finished_;
+    std::thread thread_;
+  };
+}
+
+#endif
@@ -8,6 +8,8 @@
 #include <list>
 #include <vector>
 #include <memory>
+#include <atomic>
+#include <thread>
 
 
 #include <TRandom3.h>
@@ -34,14 +36,8 @@
 
 namespace po = boost::program_options;
 
-template<typename T> int getPointOctant(const T& x, const T& y, const T& z) {
-  return (int(x < T(0)) << 2) || (int(x < T(0)) << 1) || int(x < T(0));
-}
-
 typedef ROOT::Math::DisplacementVector2D<ROOT::Math::Cartesian2D<double>,ROOT::Math::DefaultCoordinateSystemTag> XYVector; // CUIDADO The version of ROOT tkLayout is linked with misses this typedef
 
-std::set<int> getModuleOctants(const Module* mod);
-
 
 class ParticleGenerator {
 public:
@@ -86,8 +82,13 @@ public:
     double z0;
   };
 
+  struct CachedParticle { // compact copy of one particle of the tree
+    Float_t pt, eta, phi;
+    Int_t charge, pdgId, status;
+  };
 
-  ParticleGenerator(TRandom& aDie);
+
+  ParticleGenerator(TRandom& aDie, const std::string& fileName = "MinBias12k_ppAt14TeV_rootuple.root");
   virtual ~ParticleGenerator();
   virtual Int_t    GetEntry(Long64_t entry);
   virtual Long64_t LoadTree(Long64_t entry);
@@ -95,7 +96,12 @@ public:
   virtual Bool_t   Notify();
 
   Particle getParticle();
+  Particle getParticle(TRandom& aDie) const; // only reads the cache, so generators on different threads can share it with their own dice
   Long64_t getNumEntries() const;
+private:
+  std::vector<CachedParticle> particles_; // the particles of all the entries, one entry after the other
+  std::vector<Long64_t> entryOffsets_;    // where each entry starts in particles_, plus the total at the end
+  void cacheParticles();
 };
 
 struct ModuleData {
@@ -140,6 +146,15 @@ struct Tracks { // holder struct for TTree export
     pt.push_back(pt_);
     nhits.push_back(nhits_);
   }
+  void swap(Tracks& other) { // exchanges the contents, not the names
+    eventn.swap(other.eventn);
+    trackn.swap(other.trackn);
+    eta.swap(other.eta);
+    phi0.swap(other.phi0);
+    z0.swap(other.z0);
+    pt.swap(other.pt);
+    nhits.swap(other.nhits);
+  }
   void setupBranches(TTree& tree) {
     tree.Branch((name + ".eventn").c_str(), &eventn);
     tree.Branch((name + ".trackn").c_str(), &trackn);
@@ -189,6 +204,13 @@ struct Hits { // holder struct for TTree export
 //    eta.push_back(eta_);
   }
   int size() const { return glox.size(); }
+  void swap(Hits& other) { // exchanges the contents, not the names
+    glox.swap(other.glox); gloy.swap(other.gloy); gloz.swap(other.gloz);
+    locx.swap(other.locx); locy.swap(other.locy);
+    pterr.swap(other.pterr); hitprob.swap(other.hitprob);
+    deltas.swap(other.deltas);
+    cnt.swap(other.cnt); z.swap(other.z); rho.swap(other.rho); phi.swap(other.phi);
+  }
 
   void setupBranches(TTree& tree) {
     tree.Branch((name + ".glox").c_str(), &glox);
@@ -290,6 +312,27 @@ std::auto_ptr<Value<T> > valueFromString(TRandom& die, const std::string& str) {
 }
 
 
+class TrackEntryWriter { // fills the track tree on a thread of its own, so that the simulation only waits for the disk when the queue is full
+  struct Entry {
+    Tracks tracks;
+    Hits hits;
+    Entry() : tracks("tracks"), hits("hits") {}
+  };
+  TTree& tree_;
+  Tracks& treeTracks_; // the holders the branches of the tree point to
+  Hits& treeHits_;
+  const size_t capacity_;
+  std::unique_ptr<Entry[]> entries_; // a ring with a single producer and a single consumer: the slots and their vectors are reused
+  std::atomic<size_t> pushed_, written_;
+  std::atomic<bool> finished_;
+  std::thread thread_;
+  void writeLoop();
+public:
+  TrackEntryWriter(TTree& tree, Tracks& treeTracks, Hits& treeHits, size_t capacity = 1024);
+  ~TrackEntryWriter() { finish(); }
+  void push(Tracks& tracks, Hits& hits); // queues an entry of the tree, leaving the holders empty
+  void finish();                         // returns once all the queued entries are in the tree
+};
 
 class TrackShooter {
   static const float HIGH_PT_THRESHOLD = 2.;
@@ -303,12 +346,14 @@ class TrackShooter {
   std::vector<Module*> allMods_;
   typedef std::list<BarrelModule*> BarrelModules;   // accessed sequentially. last step in hit localization
   typedef std::list<EndcapModule*> EndcapModules;
-  typedef std::vector<BarrelModules> BarrelOctants; // these vectors are accessed randomly when the octant of the hit is known (function of the radius/z discovered in the previous step)
-  typedef std::vector<EndcapModules> EndcapOctants;
-  typedef std::map<double, BarrelOctants> BarrelRadii; // first step in hit localization. we fix radius/z and we calculate the rest of the coordinates of a hit
-  typedef std::map<double, EndcapOctants> EndcapZs;
+  typedef std::vector<BarrelModules> BarrelSectors; // these vectors are accessed randomly when the phi sector of the hit is known (function of the radius/z discovered in the previous step)
+  typedef std::vector<EndcapModules> EndcapSectors;
+  typedef std::map<double, BarrelSectors> BarrelRadii; // first step in hit localization. we fix radius/z and we calculate the rest of the coordinates of a hit
+  typedef std::map<double, EndcapSectors> EndcapZs;
   BarrelRadii barrelModsByRadius_;
   EndcapZs endcapModsByZ_;
+  static const double SECTOR_PHI_MARGIN; // widens the phi span of the modules, as the hit sits on the module plane and not on the cylinder/disk of the layer
+  int numPhiSectors_;
 
   TRandom3 die_;
   std::auto_ptr<Value<double> > eta_, phi0_, z0_, pt_, invPt_;  // auto_ptr because I don't want to be bothered with deletion
@@ -318,14 +363,36 @@ class TrackShooter {
   long int numEvents_, numTracksEv_, eventOffset_;
   std::string instanceId_;
   std::string tracksDir_;
+  int compressionLevel_, basketSize_; // of the output tree; a basket size of 0 keeps the ROOT default
 
   int detectCollisionSlanted(const Helix& helix, const Polygon3d<4>& poly, std::vector<XYZVector>& collisions);
   int detectCollisionBarrel(const Helix& helix, const Polygon3d<4>& poly, std::vector<XYZVector>& collisions);
   int detectCollisionEndcap(const Helix& helix, const Polygon3d<4>& poly, std::vector<XYZVector>& collisions);
 
+  int getPointPhiSector(double x, double y) const;
+  std::set<int> getModulePhiSectors(const Module* mod) const;
+  void bucketModules();
+
   XYVector convertToLocalCoords(const XYZVector& globalHit, const BarrelModule* mod) const;
   XYVector convertToLocalCoords(const XYZVector& globalHit, const EndcapModule* mod) const;
 
+#ifdef FAKE_HITS
+  struct FakeHitSource { // what the fake hits of a module are made from, gathered once before shooting
+    Polygon3d<4> poly; // centered on the mean point of the module
+    XYZVector meanPoint;
+    double cosPhi, sinPhi; // of the rotation bringing the module to phi = 0
+    bool barrel;
+    int halfWindow;
+    ptError* ptErr;
+    PosRef posref;
+  };
+  std::vector<FakeHitSource> fakeSources_;
+  std::vector<double> fakeRates_; // cumulative fake hits per event, up to each module
+  std::vector<int> fakeCounts_;
+  void buildFakeHitSources();
+  void shootFakeHits(long int event, Tracks& tracks, Hits& hits);
+#endif
+
   void shootTracks();
 
   void setDefaultParameters();
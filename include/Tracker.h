@@ -5,6 +5,9 @@
 #include <string>
 #include <memory>
 #include <set>
+#include <map>
+#include <functional>
+#include <type_traits>
 
 #include <boost/ptr_container/ptr_vector.hpp>
 
@@ -15,20 +18,26 @@
 #include "Barrel.h"
 #include "Endcap.h"
 #include "SupportStructure.h"
+#include "ModuleGeometry.h"
 #include "Visitor.h"
 #include "Visitable.h"
+#include "TaskPool.h"
+#include "GeometryArena.h"
+#include "StopWatch.h"
 
 using std::set;
 using material::SupportStructure;
 
 class Tracker : public PropertyObject, public Buildable, public Identifiable<string>, Clonable<Tracker>, Visitable {
-  class ModuleSetVisitor : public GeometryVisitor {
+  // The modules in the order the geometry is walked (subdetector, layer or disk, rod or ring, position), each one numbered
+  // with its index in the table: the same on every run, and usable to index arrays parallel to the table
+  class ModuleTableVisitor : public GeometryVisitor {
   public:
-    typedef set<Module*> Modules;
+    typedef std::vector<Module*> Modules;
   private:
     Modules modules_;
   public:
-    void visit(Module& m) override { modules_.insert(&m); }
+    void visit(Module& m) override { m.moduleIndex(modules_.size()); modules_.push_back(&m); }
     Modules& modules() { return modules_; }
     const Modules& modules() const { return modules_; }
     Modules::iterator begin() { return modules_.begin(); }
@@ -41,7 +50,14 @@ public:
   typedef PtrVector<Barrel> Barrels;
   typedef PtrVector<Endcap> Endcaps;
   typedef PtrVector<SupportStructure> SupportStructures;
-  typedef ModuleSetVisitor::Modules Modules;
+  typedef ModuleTableVisitor::Modules Modules;
+  typedef std::vector<ModuleGeometry> FrozenModules;
+
+  // The global quantities the analyses derive from the whole geometry, computed when it is frozen
+  struct GeometrySummary {
+    double minModuleEta, maxModuleEta; // the extremes of the eta of the modules
+    double minTracksEta, maxTracksEta; // the eta range the tracks are shot over, unless the simulation parameters set it
+  };
 
   ReadonlyProperty<double, Computable> maxR, minR;
   ReadonlyProperty<double, Computable> maxZ;
@@ -51,11 +67,18 @@ public:
   ReadonlyProperty<bool, Default> skipAllSupports;
 
 private:
+  std::shared_ptr<GeometryArena> arena_; // declared first, as the objects built from it have to go before it does
   Barrels barrels_;
   Endcaps endcaps_;
   SupportStructures supportStructures_;
 
-  ModuleSetVisitor moduleSetVisitor_;
+  ModuleTableVisitor moduleTableVisitor_;
+  FrozenModules frozenModules_;
+  std::vector<string> frozenModuleTypes_;
+  std::vector<Polygon3d<4> > sensorPolys_; // the hit and envelope polygons of all the sensors, one after the other
+  mutable GeometrySummary summary_;
+  mutable unsigned int summaryEpoch_; // the geometry epoch the summary was computed in
+  void computeSummary() const;
 
   PropertyNode<string> barrelNode;
   PropertyNode<string> endcapNode;
@@ -63,6 +86,12 @@ private:
 
   MultiProperty<set<string>, ','> containsOnly;
 
+  int buildThreads_;
+  void buildSubdetectors(int numSubdetectors, const std::function<void(int)>& buildOne);
+
+  template<class TrackerType, class BarrelsType, class EndcapsType, class VisitorType>
+  static void acceptFrozenModules(TrackerType& tracker, BarrelsType& barrels, EndcapsType& endcaps, VisitorType& v, int numThreads);
+
   Tracker(const Tracker&) = default;
 public:
 
@@ -74,7 +103,9 @@ public:
       servicesForcedUp("servicesForcedUp", parsedOnly(), true),
       skipAllServices("skipAllServices", parsedOnly(), false),
       skipAllSupports("skipAllSupports", parsedOnly(), false),
-      containsOnly("containsOnly", parsedOnly())
+      containsOnly("containsOnly", parsedOnly()),
+      buildThreads_(1),
+      summaryEpoch_(ComputableEpoch::current - 1)
   {}
 
   void setup() {
@@ -99,24 +130,41 @@ public:
   }
 
   void build();
+  void releaseBuildState() override;
+  void buildThreads(int n) { buildThreads_ = MAX(1, n); } // the barrels, and then the endcaps, are built in parallel
 
   const Barrels& barrels() const { return barrels_; }
   const Endcaps& endcaps() const { return endcaps_; }
 
-  const Modules& modules() const { return moduleSetVisitor_.modules(); }
-  Modules& modules() { return moduleSetVisitor_.modules(); }
+  const Modules& modules() const { return moduleTableVisitor_.modules(); } // module m is modules()[m->moduleIndex()]
+  Modules& modules() { return moduleTableVisitor_.modules(); }
+
+  void freeze();
+  bool frozen() const { return !modules().empty() && frozenModules_.size() == modules().size(); }
+  const FrozenModules& frozenModules() const { return frozenModules_; } // in the same order as modules(), by module index
+  const std::vector<string>& frozenModuleTypes() const { return frozenModuleTypes_; }
+  void buildSensorPolys();
+  void releaseSensorPolys();
 
+  // the visits of the tracker are timed as tasks named after the visitor
   void accept(GeometryVisitor& v) { 
+    scopeTaskClock("Visit " + StopWatch::typeName(typeid(v)));
     v.visit(*this); 
     for (auto& b : barrels_) { b.accept(v); }
     for (auto& e : endcaps_) { e.accept(v); }
   }
   void accept(ConstGeometryVisitor& v) const {
+    scopeTaskClock("Visit " + StopWatch::typeName(typeid(v)));
     v.visit(*this); 
     for (const auto& b : barrels_) { b.accept(v); }
     for (const auto& e : endcaps_) { e.accept(v); }
   }
+  void parallelAccept(ForkableGeometryVisitor& v, int numThreads);
+  void parallelAccept(ForkableConstGeometryVisitor& v, int numThreads) const;
+  template<class VisitorType> void acceptModules(VisitorType& v, int numThreads) { acceptFrozenModules(*this, barrels_, endcaps_, v, numThreads); }
+  template<class VisitorType> void acceptModules(VisitorType& v, int numThreads) const { acceptFrozenModules(*this, barrels_, endcaps_, v, numThreads); }
 
+  const GeometrySummary& geometrySummary() const;
   std::pair<double, double> computeMinMaxEta() const; // pair.first = minEta, pair.second = maxEta (reversed with respect to the previous tkLayout geometry model)
 
   void createGeometry(bool) {}
@@ -128,5 +176,56 @@ public:
   SupportStructures& supportStructures() {return supportStructures_;}
 };
 
+/**
+ * Visit the tracker, its barrels and endcaps, and then the modules of the frozen table, with the <i>visit()</i> overloads
+ * of the visitor type called by name rather than through the virtual interface, so that they are inlined in the loop over
+ * the table. Each module gets the two visits <i>accept()</i> gives it, as a barrel or endcap module and as a detector
+ * module; the layers, disks, rods, rings and geometric modules are not visited, so this is only for the visitors which
+ * work module by module. The visitor has to bring the <i>visit()</i> overloads of its base in scope with a using-declaration,
+ * or those it does not override would be hidden and the module visits would all go to its <i>DetectorModule</i> overload.
+ * The table is split in one contiguous block of modules per thread, each visited by a fork merged back in the order of
+ * the blocks, as in <i>parallelAccept()</i>, to which the visit falls back if the tracker is not frozen.
+ * @param tracker The tracker to be visited
+ * @param barrels The barrels of the tracker
+ * @param endcaps The endcaps of the tracker
+ * @param v The visitor, which has to be forkable
+ * @param numThreads The number of threads
+ */
+template<class TrackerType, class BarrelsType, class EndcapsType, class VisitorType>
+void Tracker::acceptFrozenModules(TrackerType& tracker, BarrelsType& barrels, EndcapsType& endcaps, VisitorType& v, int numThreads) {
+  typedef typename std::conditional<std::is_const<TrackerType>::value, const BarrelModule, BarrelModule>::type BarrelModuleType;
+  typedef typename std::conditional<std::is_const<TrackerType>::value, const EndcapModule, EndcapModule>::type EndcapModuleType;
+  typedef typename std::conditional<std::is_const<TrackerType>::value, const DetectorModule, DetectorModule>::type DetectorModuleType;
+  if (!tracker.frozen()) {
+    tracker.parallelAccept(v, numThreads);
+    return;
+  }
+  scopeTaskClock("Visit " + StopWatch::typeName(typeid(v)));
+  v.VisitorType::visit(tracker);
+  for (auto& b : barrels) v.VisitorType::visit(b);
+  for (auto& e : endcaps) v.VisitorType::visit(e);
+
+  const FrozenModules& table = tracker.frozenModules();
+  auto visitBlock = [&table](VisitorType& visitor, size_t first, size_t last) {
+    for (size_t i = first; i < last; i++) {
+      DetectorModuleType& m = *table[i].module;
+      if (table[i].subdet == BARREL) visitor.VisitorType::visit(static_cast<BarrelModuleType&>(m));
+      else visitor.VisitorType::visit(static_cast<EndcapModuleType&>(m));
+      visitor.VisitorType::visit(m);
+    }
+  };
+  int numBlocks = MAX(1, MIN(numThreads, int(table.size())));
+  if (numBlocks == 1) {
+    visitBlock(v, 0, table.size());
+    return;
+  }
+  std::vector<std::unique_ptr<VisitorType> > forks;
+  for (int i = 0; i < numBlocks; i++) forks.emplace_back(static_cast<VisitorType*>(v.fork()));
+  TaskPool::instance()->run("Tracker module visit", numBlocks, [&](int i) {
+    visitBlock(*forks[i], table.size() * i / numBlocks, table.size() * (i + 1) / numBlocks);
+  }, numThreads);
+  for (auto& forked : forks) v.merge(*forked);
+}
+
 
 #endif
@@ -16,6 +16,7 @@
 #include <cmath>
 #include <list>
 #include <utility>
+#include <thread>
 #include <Tracker.h>
 #include <Support.h>
 #include <InactiveSurfaces.h>
@@ -53,4 +53,36 @@ public:
   virtual void visit(const SimParms&) {}
 };
 
+/**
+ * @class ForkableGeometryVisitor
+ * @brief A visitor which can be run on several threads by <i>Tracker::parallelAccept()</i>.
+ *
+ * The tracker, barrels and endcaps are visited by the visitor itself; each layer and disk, with all it contains, is visited
+ * by a fork of the visitor, taken once its barrel or endcap has been visited. The forks are visited concurrently, then merged
+ * back into the visitor one by one, in the order of the layers and disks in the tracker. A fork must only change its own
+ * state and the elements it visits, and must not create ROOT objects without holding a lock. <i>preVisit()</i> and
+ * <i>postVisit()</i> are only called on the visitor, before and after the whole visit.
+ */
+class ForkableGeometryVisitor : public GeometryVisitor {
+public:
+  virtual ~ForkableGeometryVisitor() {}
+  virtual ForkableGeometryVisitor* fork() const = 0;
+  virtual void merge(ForkableGeometryVisitor& forked) = 0;
+  virtual void preVisit() {}
+  virtual void postVisit() {}
+};
+
+/**
+ * @class ForkableConstGeometryVisitor
+ * @brief The same as <i>ForkableGeometryVisitor</i>, for the visitors which do not change the geometry
+ */
+class ForkableConstGeometryVisitor : public ConstGeometryVisitor {
+public:
+  virtual ~ForkableConstGeometryVisitor() {}
+  virtual ForkableConstGeometryVisitor* fork() const = 0;
+  virtual void merge(ForkableConstGeometryVisitor& forked) = 0;
+  virtual void preVisit() {}
+  virtual void postVisit() {}
+};
+
 #endif
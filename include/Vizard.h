@@ -47,6 +47,7 @@
 
 #include <InactiveSurfaces.h>
 #include <rootweb.hh>
+#include <ColumnTable.h>
 #include <vector>
 #include <set>
 #include <Palette.h>
@@ -250,7 +251,6 @@ namespace insur {
     std::string occupancyCsv_;
     std::string triggerSectorMapCsv_;
     std::string moduleConnectionsCsv_;
-    std::string barrelModulesCsv_, endcapModulesCsv_, allModulesCsv_;
     void setSummaryString(std::string);
     void addSummaryElement(std::string element, bool first = false);
     void setSummaryLabelString(std::string);
@@ -264,9 +264,10 @@ namespace insur {
 
     void createTriggerSectorMapCsv(const TriggerSectorMap& tsm);
     void createModuleConnectionsCsv(const ModuleConnectionMap& moduleConnections);
-    void createBarrelModulesCsv(const Tracker& t);
-    void createEndcapModulesCsv(const Tracker& t);
-    void createAllModulesCsv(const Tracker& t);
+    static void writeBarrelModulesCsv(const Tracker& t, std::ostream& output);
+    static void writeEndcapModulesCsv(const Tracker& t, std::ostream& output);
+    static void writeAllModulesCsv(const Tracker& t, std::ostream& output);
+    static void writeModuleTable(const Tracker& t, const Analyzer& a, const SimParms& simparms, std::ostream& output);
 
     TProfile* newProfile(TH1D* nn);
     TProfile& newProfile(const TGraph& sourceGraph, double xlow, double xup, int rebin = 1);
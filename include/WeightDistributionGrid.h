@@ -1,22 +1,39 @@
 #ifndef WEIGHTDISTRIBUTIONGRID_H
 #define WEIGHTDISTRIBUTIONGRID_H
 
-#include <map>
+#include <vector>
 
 namespace material {
 
   class MaterialObject;
-  
-  typedef std::map<std::pair<int, int>,double> WeightDistributionGridMapType;
 
-  class WeightDistributionGrid : public WeightDistributionGridMapType {
+  /**
+   * @class WeightDistributionGrid
+   * @brief The mass of the material in square (z, r) bins.
+   *
+   * The bins are stored densely over the rectangle of bins covered so far, which grows as the elements are added: an element
+   * is spread over the bins it overlaps with one pass over its rows, with the overlap along z and r computed once per
+   * column and per row.
+   */
+  class WeightDistributionGrid {
   public:
     WeightDistributionGrid(double binDimension);
     virtual ~WeightDistributionGrid() {};
     void addTotalGrams(double minZ, double minR, double maxZ, double maxR, double length, double surface, const MaterialObject& materialObject);
     double binDimension() const;
+    void clear();
+    bool empty() const { return grams_.empty(); }
+    int minBinZ() const { return minBinZ_; }
+    int minBinR() const { return minBinR_; }
+    int numBinsZ() const { return numBinsZ_; }
+    int numBinsR() const { return numBinsR_; }
+    double grams(int binZ, int binR) const; // 0 for the bins no element overlaps
   private:
     double binDimension_;
+    int minBinZ_, minBinR_, numBinsZ_, numBinsR_;
+    std::vector<double> grams_; // by r bin, then z bin
+    void cover(int firstBinZ, int lastBinZ, int firstBinR, int lastBinR);
+    std::vector<double> overlaps(double min, double max, int firstBin, int lastBin) const;
   };
 }
 
@@ -19,6 +19,7 @@
 #include <iostream>
 #include <sstream>
 #include <fstream>
+#include <unordered_map>
 
 namespace insur {
     /**
@@ -44,36 +45,38 @@ namespace insur {
         const std::string& getExtendedHeader() const { return extendedHeader_; }
         const std::string& getSimpleHeader() const { return simpleHeader_; }
     protected:
-        void trackerLogicalVolume(std::ostringstream& stream, std::istream& instream); // takes the stream containing the tracker logical volume template and outputs it to the outstream
-        void materialSection(std::string name, std::vector<Element>& e, std::vector<Composite>& c, std::ostringstream& stream);
-        void rotationSection(std::vector<Rotation>& r, std::string label, std::ostringstream& stream);
-        void logicalPartSection(std::vector<LogicalInfo>& l, std::string label,  std::ostringstream& stream, bool wt = false);
-        void solidSection(std::vector<ShapeInfo>& s, std::string label, std::ostringstream& stream, std::istream& trackerVolumeTemplate, bool notobtid, bool wt = false);
-        void posPartSection(std::vector<PosInfo>& p, std::vector<AlgoInfo>& a, std::string label, std::ostringstream& stream);
-        void specParSection(std::vector<SpecParInfo>& t, std::string label, std::ostringstream& stream);
-        void algorithm(std::string name, std::string parent, std::vector<std::string>& params, std::ostringstream& stream);
-        void elementaryMaterial(std::string tag, double density, int a_number, double a_weight, std::ostringstream& stream);
+        void trackerLogicalVolume(std::ostream& stream, std::istream& instream); // takes the stream containing the tracker logical volume template and outputs it to the outstream
+        void materialSection(std::string name, std::vector<Element>& e, std::vector<Composite>& c, std::ostream& stream);
+        void rotationSection(std::vector<Rotation>& r, std::string label, std::ostream& stream);
+        void logicalPartSection(std::vector<LogicalInfo>& l, std::string label,  std::ostream& stream, bool wt = false);
+        void solidSection(std::vector<ShapeInfo>& s, std::string label, std::ostream& stream, std::istream& trackerVolumeTemplate, bool notobtid, bool wt = false);
+        void posPartSection(std::vector<PosInfo>& p, std::vector<AlgoInfo>& a, std::string label, std::ostream& stream);
+        void specParSection(std::vector<SpecParInfo>& t, std::string label, std::ostream& stream);
+        void algorithm(const std::string& name, const std::string& parent, std::vector<std::string>& params, std::ostream& stream);
+        void elementaryMaterial(std::string tag, double density, int a_number, double a_weight, std::ostream& stream);
         void compositeMaterial(std::string name, double density, CompType method,
-                                               std::vector<std::pair<std::string, double> >& es, std::ostringstream& stream);
-        void logicalPart(std::string name, std::string solid, std::string material, std::ostringstream& stream);
-        void box(std::string name, double dx, double dy, double dz, std::ostringstream& stream);
-        void trapezoid(std::string name, double dx, double dxx, double dy, double dyy, double dz, std::ostringstream& stream);
-        void tubs(std::string name, double rmin, double rmax, double dz, std::ostringstream& stream);
+                                               std::vector<std::pair<std::string, double> >& es, std::ostream& stream);
+        void logicalPart(const std::string& name, const std::string& solid, const std::string& material, std::ostream& stream);
+        void box(std::string name, double dx, double dy, double dz, std::ostream& stream);
+        void trapezoid(std::string name, double dx, double dxx, double dy, double dyy, double dz, std::ostream& stream);
+        void tubs(std::string name, double rmin, double rmax, double dz, std::ostream& stream);
         void polycone(std::string name, std::vector<std::pair<double, double> >& rzu,
-                               std::vector<std::pair<double, double> >& rzd, std::ostringstream& stream);
-        void posPart(std::string parent, std::string child, std::string rotref, Translation& trans, int copy, std::ostringstream& stream);
+                               std::vector<std::pair<double, double> >& rzd, std::ostream& stream);
+        void posPart(const std::string& parent, const std::string& child, const std::string& rotref, Translation& trans, int copy, std::ostream& stream);
         void rotation(std::string name, double thetax, double phix, double thetay, double phiy,
-                                                          double thetaz, double phiz, std::ostringstream& stream);
-        void translation(double x, double y, double z, std::ostringstream& stream);
-        void specPar(std::string name, std::pair<std::string, std::string> param, std::vector<std::string>& partsel, std::ostringstream& stream);
-        void specPar1(std::string name, std::pair<std::string, std::string> param, std::vector<std::string>& partsel, std::ostringstream& stream);
-        void specParROC(std::vector<std::string>& partsel, std::vector<ModuleROCInfo>& minfo, std::pair<std::string, std::string> param, std::ofstream& stream);
+                                                          double thetaz, double phiz, std::ostream& stream);
+        void translation(double x, double y, double z, std::ostream& stream);
+        void specPar(const std::string& name, const std::pair<std::string, std::string>& param, std::vector<std::string>& partsel, std::ostream& stream);
+        void specPar1(std::string name, std::pair<std::string, std::string> param, std::vector<std::string>& partsel, std::ostream& stream);
+        void specParROC(std::vector<std::string>& partsel, std::vector<ModuleROCInfo>& minfo, std::pair<std::string, std::string> param, std::ostream& stream);
     private:
         std::vector<PathInfo>& buildPaths(std::vector<SpecParInfo>& specs, std::vector<PathInfo>& blocks, bool wt = false);
         bool endcapsInTopology(std::vector<SpecParInfo>& specs);
         int findNumericPrefixSize(std::string s);
-        int findEntry(std::vector<SpecParInfo>& specs, std::string name);
-        std::vector<PathInfo>::iterator findEntry(std::string name, std::vector<PathInfo>& data);
+        typedef std::unordered_map<std::string, int> EntryIndex; // block name -> index of its first entry in a collection
+        EntryIndex indexEntries(const std::vector<SpecParInfo>& specs);
+        int findEntry(const EntryIndex& index, const std::string& name);
+        std::vector<PathInfo>::iterator findEntry(const std::string& name, std::vector<PathInfo>& data, const EntryIndex& index);
         std::string extendedHeader_, simpleHeader_; // headers containing generation information which are inserted after the preamble
     };
 }
@@ -101,6 +101,23 @@ template<class T, class I> std::string join(I begin, I end, const std::string& s
 template<template<class> class T, class U> std::string join(const T<U>& vec, const std::string& sep) { return join<U>(vec.begin(), vec.end(), sep); }
 
 
+// A piece of a text read in one block, for the parsers to scan the text in place instead of copying its lines and words
+struct TextPiece {
+  const char* begin;
+  const char* end;
+  bool empty() const { return begin == end; }
+  size_t size() const { return end - begin; }
+  bool startsWith(const std::string& prefix) const { return size() >= prefix.size() && std::equal(prefix.begin(), prefix.end(), begin); }
+  std::string str() const { return std::string(begin, end); }
+};
+
+bool readText(const std::string& fileName, std::string& text); // the whole file in one read, false if it cannot be read
+void prefetchText(const std::string& fileName); // starts reading the whole file on a thread of its own, for readText() to take it
+void finishPrefetches(); // returns once the files being prefetched are read, e.g. before forking
+bool nextLine(TextPiece& text, TextPiece& line); // takes the next line (without its end of line) off the text, false at its end
+bool nextWord(TextPiece& line, TextPiece& word); // takes the next blank-separated word off the line, false at its end
+double wordToDouble(const TextPiece& word); // as atof, but not reading beyond the word
+
 std::string ltrim(std::string str);
 std::string rtrim(std::string str);
 std::string trim(std::string str);
@@ -10,6 +10,7 @@
 #include "Module.h"
 #include "PtErrorAdapter.h"
 #include <MaterialProperties.h>
+#include <CounterRandom.h>
 #include <cmath>
 #include <vector>
 #include <TMatrixT.h>
@@ -44,6 +45,7 @@ protected:
   int orientation_;   // orientation of the surface
   int objectKind_;    // kind of hit object
   Module* hitModule_; // Pointer to the hit module
+  Module::ResolutionFactors resolutionFactors_; // those of the hit module, taken when it is set
   //double trackTheta_; // Theta angle of the track
   //Material material_;
   // "Thickness" in terms of radiation_length and interaction_length
@@ -67,6 +69,8 @@ public:
   Module* getHitModule() { return hitModule_; };
   double getResolutionRphi(double trackR);
   double getResolutionZ(double trackR);
+  double measuredResolutionRphi(double trackR);
+  double measuredResolutionZ(double trackR);
   void setHitModule(Module* myModule);
   /**
    * @enum An enumeration of the category and orientation constants used within the object
@@ -121,6 +125,13 @@ protected:
   double phi_;
   double cotgTheta_, eta_; // calculated from theta and then cached
   std::vector<Hit*> hitV_;
+  // The hits are owned by the track and stored in blocks, so that adding one does not need a heap allocation of its own
+  static const unsigned int hitBlockSize = 32;
+  std::vector<std::vector<Hit> > hitBlocks_;
+  // The hits are added in runs sorted by distance, one per source of hits: the track knows whether they still are in order,
+  // so that sort() only merges the runs once and is free afterwards
+  bool sorted_;
+  void copyHits(const Track& t);
   // Track resolution as a function of momentum
   TMatrixTSym<double> correlations_;
   TMatrixT<double> covariances_;
@@ -132,20 +143,46 @@ protected:
   double deltaCtgTheta_;
   double deltaZ0_;
   double deltaP_;
+  // A hit as seen by the track fit: position along the track, scattering and resolution, derivatives wrt the track parameters
+  struct FitPoint { bool active; double position, scatteringSq, resolutionSq; double derivatives[3]; };
   void computeCorrelationMatrixRZ();
-  void computeCovarianceMatrixRZ();
+  void computeCovarianceMatrixRZ(const std::vector<FitPoint>& points);
   void computeCorrelationMatrix();
-  void computeCovarianceMatrix();
+  void computeCovarianceMatrix(const std::vector<FitPoint>& points);
+  struct HitSelection;
+  std::vector<FitPoint> fitGeometry(bool rz, const HitSelection& selection) const;
+  void fitMomentum(const std::vector<FitPoint>& geometry, bool rz, double pt, std::vector<FitPoint>& points) const;
+  static double multipleScatteringSq(double radiation, double pt);
+  static bool scatteringNormalMatrix(const std::vector<FitPoint>& points, int nPars, TMatrixT<double>& result);
   
   std::set<std::string> tags_;
   double transverseMomentum_;
 public:
+  /**
+   * The track parameter errors for a given transverse momentum
+   */
+  struct Errors {
+    double transverseMomentum;
+    double deltaRho, deltaPhi, deltaD, deltaCtgTheta, deltaZ0, deltaP;
+    TMatrixT<double> covariances, covariancesRZ;
+  };
+  /**
+   * A non-owning selection of the hits of a track, one flag per hit in the order of the hits: the errors can be computed
+   * as if only the selected hits were active, and optionally without any material, leaving the hits as they are
+   */
+  struct HitSelection {
+    std::vector<bool> active;
+    bool material;
+  };
   Track();
   Track(const Track& t);
+  Track(Track&& t) noexcept;
   ~Track();
   Track& operator=(const Track &t);
+  Track& operator=(Track&& t) noexcept;
   bool noHits() { return hitV_.empty(); }
   int nHits() { return hitV_.size(); }
+  Hit* getHit(int i) { return hitV_[i]; } // in the order of the hits, sorted or not
   double setTheta(double& newTheta);
   double getTheta() const {return theta_;}
   double getEta() const { return eta_; } // calculated when theta is set, then cached
@@ -161,19 +198,28 @@ public:
   const double& getDeltaZ0() const { return deltaZ0_; }
   const double& getDeltaP() const { return deltaP_; }
 
-  Hit* addHit(Hit* newHit);
+  Hit* addHit(const Hit& newHit);
   const std::set<std::string>& tags() const { return tags_; }
   void sort();
   void computeErrors();
+  std::vector<Errors> computeErrors(const std::vector<double>& transverseMomenta) const;
+  std::vector<Errors> computeErrors(const std::vector<double>& transverseMomenta, const HitSelection& selection) const;
+  void setErrors(const Errors& e);
   void printErrors();
   void print();
   void removeMaterial();
   int nActiveHits(bool usePixels = false, bool useIP = true) const;
   std::vector<double> hadronActiveHitsProbability(bool usePixels = false);
   double hadronActiveHitsProbability(int nHits, bool usePixels = false);
-  void addEfficiency(double efficiency, bool alsoPixel = false);
   void keepTriggerOnly();
   void keepTaggedOnly(const string& tag);
+  HitSelection selectActive() const;
+  HitSelection selectTrigger() const;
+  HitSelection selectTagged(const string& tag) const;
+  std::vector<bool> efficiencyMask(double efficiency, double pixelEfficiency, insur::CounterRandom& die) const;
+  void addEfficiency(HitSelection& selection, const std::vector<bool>& mask) const;
+  int nActiveHits(const HitSelection& selection, bool usePixels = false, bool useIP = true) const;
+  void keepSelected(const HitSelection& selection);
   void setTriggerResolution(bool isTrigger);
   // static bool debugRemoval; // debug
   double expectedTriggerPoints(const double& triggerMomentum) const;
@@ -185,6 +231,7 @@ public:
   void addIPConstraint(double dr, double dz);
   RILength getCorrectedMaterial();
   std::vector<std::pair<Module*, HitType>> getHitModules() const;
+  void getHitModules(std::vector<std::pair<Module*, HitType>>& hitModules) const;
 
   void setTransverseMomentum(const double newPt) { transverseMomentum_ = newPt; }
   double getTransverseMomentum() const { return transverseMomentum_; }
@@ -9,6 +9,9 @@
 #include <string>
 #include <vector>
 #include <set>
+#include <map>
+#include <ctime>
+#include <iosfwd>
 #include <global_constants.h>
 #include <global_funcs.h>
 
@@ -50,10 +53,26 @@ public:
   string getGeometriesDirectory();
   string getConfigFileName();
   std::set<string> preprocessConfiguration(istream& is, ostream& os, const string& istreamid);
+  std::set<string> preprocessConfiguration(istream& is, string& expanded, const string& istreamid);
+  std::set<string> preprocessText(const string& text, string& expanded, const string& textid);
   vector<double>& getMomenta();
   vector<double>& getTriggerMomenta();
   vector<double>& getThresholdProbabilities();
 private:
+  // An included file with all its own includes expanded, along with the modification times of the files it is made of
+  struct ExpandedInclude {
+    string text;
+    std::set<string> includes;
+    std::map<string, std::time_t> modTimes;
+    std::vector<string> warnings;
+  };
+  std::map<string, ExpandedInclude> includeCache_;
+  std::map<string, std::time_t> includeModTimes_; // the modification times checked while expanding the current configuration
+  const ExpandedInclude* expandedInclude(const string& filename);
+  void expandIncludes(const string& text, const string& textid, string& expanded, std::set<string>& includeSet, std::vector<string>& warnings);
+  string includedFileName(const string& line);
+  std::time_t includeModTime(const string& filename);
+  static void readWholeStream(istream& is, string& text);
   bool goodConfigurationRead_;
   //string styleDirectory_;
   string binDirectory_;
@@ -8,16 +8,26 @@
 #include <vector>
 #include <string>
 #include <sstream>
+#include <mutex>
+#include <atomic>
+#include <unordered_set>
 
-#define logERROR(message) MessageLogger::instance()->addMessage(__func__, message, MessageLogger::ERROR)
-#define logWARNING(message) MessageLogger::instance()->addMessage(__func__, message, MessageLogger::WARNING)
-#define logINFO(message) MessageLogger::instance()->addMessage(__func__, message, MessageLogger::INFO)
-#define logDEBUG(message) MessageLogger::instance()->addMessage(__func__, message, MessageLogger::DEBUG)
+// The message is only built if its call site has not reached its quota of messages (see LogSite)
+#define logMESSAGE(message, level, unique) \
+  do { \
+    static LogSite logSite_(__func__, level); \
+    if (logSite_.admit()) MessageLogger::instance()->addMessage(__func__, message, level, unique); \
+  } while (0)
 
-#define logUniqueERROR(message) MessageLogger::instance()->addMessage(__func__, message, MessageLogger::ERROR, MessageLogger::UNIQUE)
-#define logUniqueWARNING(message) MessageLogger::instance()->addMessage(__func__, message, MessageLogger::WARNING, MessageLogger::UNIQUE)
-#define logUniqueINFO(message) MessageLogger::instance()->addMessage(__func__, message, MessageLogger::INFO, MessageLogger::UNIQUE)
-#define logUniqueDEBUG(message) MessageLogger::instance()->addMessage(__func__, message, MessageLogger::DEBUG, MessageLogger::UNIQUE)
+#define logERROR(message) logMESSAGE(message, MessageLogger::ERROR, false)
+#define logWARNING(message) logMESSAGE(message, MessageLogger::WARNING, false)
+#define logINFO(message) logMESSAGE(message, MessageLogger::INFO, false)
+#define logDEBUG(message) logMESSAGE(message, MessageLogger::DEBUG, false)
+
+#define logUniqueERROR(message) logMESSAGE(message, MessageLogger::ERROR, MessageLogger::UNIQUE)
+#define logUniqueWARNING(message) logMESSAGE(message, MessageLogger::WARNING, MessageLogger::UNIQUE)
+#define logUniqueINFO(message) logMESSAGE(message, MessageLogger::INFO, MessageLogger::UNIQUE)
+#define logUniqueDEBUG(message) logMESSAGE(message, MessageLogger::DEBUG, MessageLogger::UNIQUE)
 
 using namespace std;
 
@@ -26,33 +36,59 @@ class LogMessage {
   LogMessage() {};
   ~LogMessage() {};
   int level;
+  unsigned long sequence; // the order the message was logged in, across the threads
   string message;
 };
 
+/**
+ * @class LogSite
+ * @brief A call site of the log macros, which lets through a quota of messages only: a message logged over and over in
+ * a loop is then neither built nor stored past the quota, and the log reports how many were held back.
+ * Letting a message through costs one atomic increment.
+ */
+class LogSite {
+ public:
+  LogSite(const char* function, int level) : function_(function), level_(level), count_(0), reported_(0) {}
+  bool admit();
+ private:
+  friend class MessageLogger;
+  const char* function_;
+  int level_;
+  std::atomic<unsigned long> count_;
+  unsigned long reported_; // how many of the messages held back were reported, under the lock of the logger
+};
+
 class MessageLogger {
  public:
   static MessageLogger* instance();
-  bool addMessage(string sourceFunction, string message, int level=UNKNOWN, bool unique=false);
-  bool addMessage(string sourceFunction, ostringstream& message, int level=UNKNOWN, bool unique=false);
+  bool addMessage(const char* sourceFunction, const string& message, int level=UNKNOWN, bool unique=false);
+  bool addMessage(const char* sourceFunction, const ostringstream& message, int level=UNKNOWN, bool unique=false);
   static string getLatestLog();
   static string getLatestLog(int level);
   // NumberOfLevels should always be the last here
   enum {UNKNOWN, ERROR, WARNING, INFO, DEBUG, NumberOfLevels};
   static const bool UNIQUE = true;
+  static const unsigned long MessagesPerSite = 100; // the quota of the messages logged by each call site
   static std::string shortLevelCode[];
   static string getLevelName(int level);
   static bool hasEmptyLog(int level);
   void setScreenLevel(int screenLevel) { screenLevel_ = screenLevel; }
  private:
+  friend class LogSite;
+  friend class LogBuffer;
   ~MessageLogger();
   MessageLogger();
   MessageLogger(MessageLogger const&){};
-  static MessageLogger* myInstance_;
+  static std::mutex mutex_; // guards the shared log, which the buffers of the threads are flushed into
   static std::vector<LogMessage> logMessageV;
   static int countInstances;
   static int messageCounter[];
+  static std::atomic<unsigned long> sequence_;
+  static std::vector<LogSite*> fullSites_; // the call sites that reached their quota
   int screenLevel_;
-  std::set<std::string> uniqueMessages;
+  std::unordered_set<size_t> uniqueMessages; // the hashes of the unique messages logged so far
+  static void flush(std::vector<LogMessage>& messages);
+  static void collect();
 };
 
 #endif
@@ -78,13 +78,17 @@ class ptError {
    RILength getMaterial() { return material ; }
 
    // Conversion between strips and p
-//   double stripsToP(double strips);
+   double stripsToP(double strips) const;
 //   double pToStrips(double p);
    // Error computation
    double computeErrorBE(double p); // CUIDADO only for testing, called by computeError after previously setting the correct parameters
    double computeError(double p);
    // Efficiency computation
    double probabilityInside(double cut, double value, double value_err);
+   static void probabilityInside(int n, const double* cut, const double* value, const double* value_err, double* result, bool fastErf = false);
+   static double fastErf(double x);
+   double geometricEfficiency() const;
+   double findPtAtProbability(double target, double ptCut, double efficiency);
 };
 
 #endif
@@ -7,13 +7,18 @@
 #include <boost/filesystem/exception.hpp>
 #include <boost/filesystem/operations.hpp>
 #include <fstream>
+#include <functional>
 #include <iomanip>
 #include <iostream>
 #include <map>
+#include <set>
 #include <sstream>
 #include <string>
+#include <sys/types.h>
 #include <TCanvas.h>
 #include <TError.h>
+#include <TFile.h>
+#include <TNamed.h>
 #include <time.h>
 #include <TView.h>
 #include <vector>
@@ -29,6 +34,12 @@ using namespace std;
 // The following is a list of allowed file etensions for TCanvas::SaveAs
 // It should be separated, start and end with '|'
 #define DEFAULTALLOWEDEXTENSIONS "|C|png|gif|svg|root|eps|pdf|ps|"
+// The file of the target directory where the canvases are kept when the image formats are
+// rendered on demand, and the name of the list of those formats in it
+#define LAZYCANVASFILE "canvases.root"
+#define LAZYFORMATSNAME "formats"
+// The file of the target directory listing the input key each page was last written with
+#define PAGEINPUTSFILE ".rootweb-inputs"
 
 class RootWItem {
 public:
@@ -80,18 +91,34 @@ public:
   void setContent(int row, int column, string content);
   void setContent(int row, int column, int number);
   void setContent(int row, int column, double number, int precision);
-  void setContent(const rootWTableContent& newContent) { tableContent_ = newContent; };
+  void setContent(const rootWTableContent& newContent);
   void setColor(int row, int column, int newColor);
+  void setTargetDirectory(string newTargetDirectory) { targetDirectory_ = newTargetDirectory; };
   ostream& dump(ostream& output);
   pair<int, int> addContent(string content);
   pair<int, int> addContent(int number);
   pair<int, int> addContent(double number, int precision);
   pair<int, int> newLine();
   bool isTable() {return true;};
+  // The tables longer than this many rows only show their first rows on the page and link their full content as CSV
+  static void setMaxInlineRows(int rows) { maxInlineRows_ = rows; };
 private:
-  rootWTableContent tableContent_;
-  rootWTableContentColor tableContentColor_;
+  // A cell of the table, stored densely row after row from row and column 0
+  struct Cell {
+    Cell() : color(0), filled(false) {};
+    string content;
+    int color;
+    bool filled;
+  };
+  Cell* cell(int row, int column);
+  void writeCsv(const string& fileName, int lastRow) const;
+  vector<vector<Cell> > cells_;
+  int minRow_, maxRow_, minCol_, maxCol_; // the range of the cells with a content, minRow_ > maxRow_ while there is none
   int serialRow_, serialCol_;
+  int tableNumber_;
+  string targetDirectory_;
+  static int tableCounter_;
+  static int maxInlineRows_;
 };
 
 typedef string RootWImageSize;
@@ -118,7 +145,40 @@ public:
   ostream& dump(ostream& output);
   bool isImage() {return true;};
   bool addExtension(string newExt);
+  static bool setDefaultFormats(const string& formats);
+  static void setLazyFormats(bool lazy) { lazyFormats_ = lazy; }
+  static bool lazyFormats() { return lazyFormats_; }
+  static bool renderQueued(int numProcesses);
+  static bool startRenderingQueued(int numProcesses);
+  static bool waitRendering();
+  static size_t queuedJobs() { return renderQueue_.size(); }
+  static void skipQueuedPrints(size_t firstJob);
 private:
+  /**
+   * @struct RenderJob
+   * @brief The files of one saveFiles() call, to be printed from the canvas when the render queue is drained
+   */
+  struct RenderJob {
+    RootWImage* image;
+    string canvasName;
+    int smallCanvasWidth, smallCanvasHeight;
+    int largeCanvasWidth, largeCanvasHeight;
+    string smallFileName;
+    vector<string> largeFileNames;
+    string lazyFileName; // where the canvas is written, if its formats other than PNG are rendered on demand
+    string lazyFormats;
+    bool skipPrint; // the files are up to date: only the canvas is written for the formats rendered on demand
+  };
+  void render(const RenderJob& job);
+  static bool writeLazyCanvases(const vector<RenderJob>& jobs);
+  static void forkRenderers(const vector<RenderJob>& jobs, int numProcesses, vector<pid_t>& workers);
+  static bool waitRenderers(const vector<pid_t>& workers);
+  static vector<RenderJob> renderQueue_;
+  static vector<pid_t> backgroundRenderers_; // rendering the images of the pages dumped ahead of the site
+  static std::set<string> lazyFilesStarted_; // the canvas files written earlier by this process, which are updated
+  static vector<string> defaultExtensions_;
+  static bool lazyFormats_;
+
   TCanvas* myCanvas_;
   int zoomedWidth_;
   int zoomedHeight_;
@@ -189,6 +249,18 @@ public:
   ostream& dump(ostream& output);
 };
 
+// A file written straight to its destination by the given function when the site is written, instead of being kept in memory
+// A text file gets a final end of line, as a RootWTextFile; a binary file is left as the function wrote it
+class RootWStreamFile : public RootWFile {
+private:
+  std::function<void(ostream&)> writer_;
+  bool binary_;
+public:
+  RootWStreamFile(string newFileName, string newDescription, std::function<void(ostream&)> writer, bool binary = false) : writer_(writer), binary_(binary) {setFileName(newFileName); setDescription(newDescription); };
+  ~RootWStreamFile() {};
+  ostream& dump(ostream& output);
+};
+
 class RootWBinaryFile : public RootWFile {
 private:
   string originalFileName_;
@@ -201,6 +273,7 @@ public:
     setFileName(newFileName); setDescription(newDescription); setOriginalFile(newOriginalFile);};
   void setOriginalFile(string newFile) {originalFileName_ = newFile ; };
   ostream& dump(ostream& output);
+  static void placeFile(const string& originalFileName, const string& destinationFileName);
 };
 
 class RootWBinaryFileList : public RootWFileList {
@@ -270,6 +343,13 @@ private:
   string revision_;
   string targetDirectory_;
   //string styleDirectory_;
+  int numThreads_;
+  string inputTag_;
+  bool renderAhead_;
+  vector<RootWPage*> newPages_; // the pages added since the last renderNewPages()
+  string structureKey();
+  bool prepareTargetDirectory();
+  void writePages(const vector<pair<string, string> >& pageFiles);
   static const int least_relevant = -1000;
 public:
   ~RootWSite();
@@ -291,6 +371,13 @@ public:
   void addAuthor(string newAuthor);
   void setTargetDirectory(string newTargetDirectory) {targetDirectory_ = newTargetDirectory; };
   //void setStyleDirectory(string newStyleDirectory) {styleDirectory_ = newStyleDirectory; } ;
+  void numThreads(int n) { numThreads_ = n > 1 ? n : 1; }
+  int numThreads() const { return numThreads_; }
+  void setInputTag(string newInputTag) { inputTag_ = newInputTag; }
+  string getInputTag() { return inputTag_; }
+  void setRenderAhead(bool renderAhead) { renderAhead_ = renderAhead; }
+  bool renderAhead() const { return renderAhead_; }
+  bool renderNewPages();
   bool makeSite(bool verbose);
 };
 
@@ -303,6 +390,7 @@ private:
   string targetDirectory_;
   double alert_;
   int relevance;
+  string inputTag_;
 public:
   ~RootWPage();
   RootWPage();
@@ -320,6 +408,8 @@ public:
   double getAlert();
   void setRelevance(int newRelevance);
   int getRelevance();
+  void setInputTag(string newInputTag) { inputTag_ = newInputTag; }
+  string getInputTag() { return inputTag_; }
 };
 
 class RootWItemCollection {
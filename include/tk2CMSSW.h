@@ -21,6 +21,7 @@
 #include <pwd.h>
 #include <iostream>
 #include <string>
+#include <map>
 #include <stdio.h>
 #include <time.h>
 #include <unistd.h>
@@ -54,12 +55,21 @@ namespace insur {
         void translate(MaterialTable& mt, MaterialBudget& mb, std::string outsubdir = "", bool wt = false);
         struct ConfigFile { std::string name, content; };
         void addConfigFile(const ConfigFile& file) { configFiles_.push_back(file); }
+        void clearConfigFiles() { configFiles_.clear(); }
+        void numThreads(int n) { ex.numThreads(n); }
+        void materialFingerprint(const std::string& fingerprint) { materialFingerprint_ = fingerprint; } // the material inputs besides the material table
     protected:
         CMSSWBundle data;
         Extractor ex;
         XMLWriter wr;
     private:
         std::vector<ConfigFile> configFiles_;
+        std::string materialFingerprint_;
+        typedef std::map<std::string, std::string> Manifest; // kind of input -> hash of its content
+        Manifest exportInputs(const std::string& xmlpath, bool wt) const;
+        Manifest readManifest(const std::string& fileName) const;
+        void writeManifest(const std::string& fileName, const Manifest& inputs) const;
+        static std::string fileFingerprint(const std::string& fileName);
         void print();
         void writeSimpleHeader(std::ostream& os);
         void writeExtendedHeader(std::ostream& os);
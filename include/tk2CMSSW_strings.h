@@ -13,6 +13,7 @@ namespace insur {
      * Numeric constants
      */
     static const int xml_prec = 3;
+    static const int xml_output_buffer_size = 1 << 20; // bytes buffered by the output file stream before each write
     static const int xml_roc_rows = 128;
     static const int xml_roc_cols = 1;
     static const int xml_reco_material_disc_offset = 3;
@@ -128,6 +129,7 @@ namespace insur {
     static const std::string xml_recomatfile = "trackerRecoMaterial.xml";
     static const std::string xml_newrecomatfile = "newTrackerRecoMaterial.xml";
     static const std::string xml_tmppath = "tmp";
+    static const std::string xml_manifest_suffix = ".inputs"; // next to an output directory, the hashes of the inputs it was written from
     /**
      * Naming conventions and variable names
      */
@@ -0,0 +1,182 @@
+/**
+ * @file AccumulatorSet.cpp
+ * @brief This is the implementation of the set of results an analysis accumulates track by track
+ */
+
+#include <AccumulatorSet.h>
+#include <TKey.h>
+#include <messageLogger.h>
+
+namespace insur {
+
+  /**
+   * Forget all the objects of the set (the objects themselves are left alone)
+   */
+  void AccumulatorSet::clear() {
+    histos_.clear();
+    graphs_.clear();
+    families_.clear();
+    maps_.clear();
+  }
+
+  /**
+   * Add a histogram to the set: it is written and merged under its name, which has to be unique within the set
+   * @param histo The histogram, which may be 2D or a profile
+   */
+  void AccumulatorSet::addHisto(TH1& histo) {
+    histos_.push_back(&histo);
+  }
+
+  /**
+   * Add a graph with one point per track to the set: it is written and merged under its name
+   * @param graph The graph
+   */
+  void AccumulatorSet::addGraph(TGraph& graph) {
+    graphs_.push_back(&graph);
+  }
+
+  /**
+   * Add a family of histograms, created by the analysis as it meets their keys, to the set: each member is written
+   * and merged under the prefix followed by its key
+   * @param prefix The prefix of the names of the members, which has to be unique within the set
+   * @param histos The members by key, which own their histograms
+   * @param bins The number of bins of the members merged in that do not exist yet
+   * @param min The low edge of those members
+   * @param max The high edge of those members
+   */
+  void AccumulatorSet::addHistoFamily(const std::string& prefix, std::map<std::string, TH1D*>& histos, int bins, double min, double max) {
+    families_.push_back(HistoFamily{prefix, &histos, bins, min, max});
+  }
+
+  /**
+   * Add a material map tree to the set: it is written and merged under the given name, which has to be unique within the set
+   * @param name The name of the map
+   * @param map The map
+   */
+  void AccumulatorSet::addMapTree(const std::string& name, MaterialMapTree& map) {
+    maps_.push_back(std::make_pair(name, &map));
+  }
+
+  /**
+   * The member of the family with a key, created empty (with the binning of the family) if it does not exist yet
+   */
+  TH1D*& AccumulatorSet::HistoFamily::member(const std::string& key) {
+    TH1D*& histo = (*histos)[key];
+    if (!histo) {
+      histo = new TH1D();
+      histo->SetBins(bins, min, max);
+    }
+    return histo;
+  }
+
+  /**
+   * Write all the objects of the set to a directory, by name
+   * @param dir The directory, where any object with the same name is overwritten
+   */
+  void AccumulatorSet::write(TDirectory& dir) const {
+    TDirectory* currentDirectory = gDirectory;
+    dir.cd();
+    for (TH1* histo : histos_) histo->Write(histo->GetName(), TObject::kOverwrite);
+    for (TGraph* graph : graphs_) graph->Write(graph->GetName(), TObject::kOverwrite);
+    for (const HistoFamily& family : families_) {
+      for (const auto& member : *family.histos) {
+        if (member.second) member.second->Write((family.prefix + member.first).c_str(), TObject::kOverwrite);
+      }
+    }
+    for (const auto& map : maps_) map.second->write(dir, map.first);
+    if (currentDirectory) currentDirectory->cd();
+  }
+
+  /**
+   * Add to a histogram of the set the same histogram of another part
+   * @param histo The histogram of the set
+   * @param part The histogram of the part, if it was found
+   * @param where Where the part comes from, for the error message
+   * @return True if the part was there, with the same binning, false otherwise
+   */
+  bool AccumulatorSet::mergeHisto(TH1& histo, const TH1* part, const std::string& where) {
+    if (!part || part->GetNbinsX() != histo.GetNbinsX() || part->GetNbinsY() != histo.GetNbinsY()) {
+      logERROR("The accumulators of " + where + " lack " + histo.GetName() + " or have another binning");
+      return false;
+    }
+    histo.Add(part);
+    return true;
+  }
+
+  /**
+   * Append the points of the same graph of another part to a graph of the set
+   */
+  void AccumulatorSet::appendGraph(TGraph& graph, const TGraph& part) {
+    for (int i = 0; i < part.GetN(); i++) graph.SetPoint(graph.GetN(), part.GetX()[i], part.GetY()[i]);
+  }
+
+  /**
+   * Merge into the objects of the set the ones written by <i>write()</i> for another part of the tracks
+   * @param part The directory the part was written to
+   * @return True if the part had all the histograms and graphs of the set, with the same binning, false otherwise
+   */
+  bool AccumulatorSet::merge(TDirectory& part) {
+    std::string where = part.GetPath();
+    for (TH1* histo : histos_) {
+      if (!mergeHisto(*histo, dynamic_cast<TH1*>(part.Get(histo->GetName())), where)) return false;
+    }
+    for (TGraph* graph : graphs_) {
+      TGraph* partGraph = dynamic_cast<TGraph*>(part.Get(graph->GetName()));
+      if (!partGraph) {
+        logERROR("The accumulators of " + where + " lack " + graph->GetName());
+        return false;
+      }
+      appendGraph(*graph, *partGraph);
+      delete partGraph;
+    }
+    TIter nextKey(part.GetListOfKeys());
+    while (TKey* key = (TKey*)nextKey()) {
+      std::string name = key->GetName();
+      for (HistoFamily& family : families_) {
+        if (name.compare(0, family.prefix.size(), family.prefix) != 0) continue;
+        TH1D*& histo = family.member(name.substr(family.prefix.size()));
+        if (!mergeHisto(*histo, dynamic_cast<TH1*>(part.Get(name.c_str())), where)) return false;
+        break;
+      }
+    }
+    for (const auto& map : maps_) {
+      TVectorD* partMap = dynamic_cast<TVectorD*>(part.Get(map.first.c_str()));
+      bool merged = partMap && map.second->merge(*partMap);
+      delete partMap;
+      if (!merged) {
+        logERROR("The accumulators of " + where + " lack " + map.first + " or have it over another region");
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /**
+   * Merge into the objects of the set the ones of another part of the tracks, kept in memory
+   * @param part The set of the part, whose objects were added in the same order as the ones of this set
+   * @return True if the part had the same objects, with the same binning, false otherwise
+   */
+  bool AccumulatorSet::merge(const AccumulatorSet& part) {
+    if (part.histos_.size() != histos_.size() || part.graphs_.size() != graphs_.size() || part.families_.size() != families_.size() ||
+        part.maps_.size() != maps_.size()) {
+      logERROR("The accumulators to merge do not have the same objects");
+      return false;
+    }
+    for (unsigned int i = 0; i < histos_.size(); i++) {
+      if (!mergeHisto(*histos_[i], part.histos_[i], "another part")) return false;
+    }
+    for (unsigned int i = 0; i < graphs_.size(); i++) appendGraph(*graphs_[i], *part.graphs_[i]);
+    for (unsigned int i = 0; i < families_.size(); i++) {
+      for (const auto& member : *part.families_[i].histos) {
+        if (member.second && !mergeHisto(*families_[i].member(member.first), member.second, "another part")) return false;
+      }
+    }
+    for (unsigned int i = 0; i < maps_.size(); i++) {
+      if (!maps_[i].second->merge(*part.maps_[i].second)) {
+        logERROR("The accumulators of another part have " + maps_[i].first + " over another region");
+        return false;
+      }
+    }
+    return true;
+  }
+}
@@ -4,12 +4,29 @@
  */
 #include <TH1D.h>
 #include <TH2D.h>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <tuple>
 #include <Analyzer.h>
+#include <FastResolution.h>
+#include <MaterialTab.h>
 #include <TProfile.h>
+#include <TFile.h>
+#include <TNtupleD.h>
 #include <TLegend.h>
 #include <Palette.h>
 
 #include "AnalyzerVisitors/MaterialBillAnalyzer.h"
+#include "CompositeVisitor.h"
+#include "PathCounters.h"
+#include "ProgressMeter.h"
+#include "StopWatch.h"
+#include "TaskPool.h"
 
 #undef MATERIAL_SHADOW
 
@@ -20,9 +37,66 @@ namespace insur {
 
   int Analyzer::bsCounter =0;
 
+  /**
+   * The fills of the material track being analysed by the current worker thread; NULL when the fills go straight into the histograms
+   */
+  static thread_local MaterialTrackRecord* currentMaterialTrackRecord = NULL;
+
+  /**
+   * The elements crossed by the material track being analysed by the current thread, when they are kept; NULL otherwise
+   */
+  static thread_local std::vector<MaterialCrossing>* currentMaterialCrossings = NULL;
+
+  static const double BoundaryEtaSafetyMargin = 5. ; // track origin shift in units of zError to compute boundaries
+
   const double Analyzer::ZeroHitsRequired = 0;
   const double Analyzer::OneHitRequired = 0.0001;
 
+  namespace {
+    /**
+     * Sizes the chunks a track scan is split into after the time taken by the tasks of the chunks before. Each chunk is
+     * run at once by the analysis threads, which then wait for each other. The cost of a track varies a lot with eta:
+     * the forward tracks cross disks, service cones and more material, and the central ones only barrel layers. With a
+     * fixed chunk size, the chunks of cheap tracks would be too short for that wait to be negligible, and those of
+     * costly tracks would last long between two progress updates or checkpoints. The chunks are sized to last a given
+     * time, from a running average of the cost of a task, within bounds; a target time of 0 keeps the first size, for
+     * a scan whose results depend on where its chunks end. The sizes and the costs are kept for a debug summary, to tune
+     * the bounds.
+     */
+    class ChunkSizer {
+    public:
+      ChunkSizer(int initial, int maximum, double targetSeconds) :
+        size_(MAX(1, initial)), minimum_(MAX(1, initial / 16)), maximum_(MAX(size_, maximum)), targetSeconds_(targetSeconds),
+        secondsPerTask_(0), chunks_(0), smallest_(0), largest_(0), tasks_(0), seconds_(0) {}
+      int size() const { return size_; }
+      void start() { start_ = std::chrono::steady_clock::now(); }
+      void done(int tasks) {
+        if (tasks <= 0) return;
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+        chunks_++;
+        smallest_ = chunks_ == 1 ? tasks : MIN(smallest_, tasks);
+        largest_ = MAX(largest_, tasks);
+        tasks_ += tasks;
+        seconds_ += seconds;
+        double perTask = seconds / tasks;
+        secondsPerTask_ = secondsPerTask_ > 0 ? (secondsPerTask_ + perTask) / 2 : perTask;
+        if (targetSeconds_ > 0) size_ = secondsPerTask_ > 0 ? (int)MAX(minimum_, MIN(maximum_, targetSeconds_ / secondsPerTask_)) : maximum_;
+      }
+      std::string summary(const std::string& stage) const {
+        return stage + ": " + any2str(tasks_) + " tasks in " + any2str(chunks_) + " chunks of " + any2str(smallest_) + " to " +
+               any2str(largest_) + " (sized between " + any2str(minimum_) + " and " + any2str(maximum_) + "), " +
+               any2str(tasks_ ? 1e3 * seconds_ / tasks_ : 0., 4) + " ms per task";
+      }
+    private:
+      int size_, minimum_, maximum_;
+      double targetSeconds_, secondsPerTask_;
+      std::chrono::steady_clock::time_point start_;
+      int chunks_, smallest_, largest_;
+      long tasks_;
+      double seconds_;
+    };
+  }
+
 
 
 
@@ -67,6 +141,37 @@ namespace insur {
     geomLiteEC = NULL; geomLiteECCreated=false;
     geometryTracksUsed = 0;
     materialTracksUsed = 0;
+    useModuleHitIndex_ = true;
+    singlePrecisionHits_ = false;
+    fillMaterialMaps_ = true;
+    cellMinR_ = cellStepR_ = cellMinEta_ = cellStepEta_ = 0;
+    numThreads_ = 1;
+    randomSeed_ = MY_RANDOM_SEED;
+    materialTrackShard_ = 0;
+    materialTrackShards_ = 1;
+    materialCheckpointSeconds_ = 0;
+    resumeMaterialScan_ = false;
+    reuseTrackHitCache_ = false;
+    geometryTrackMinEta_ = -std::numeric_limits<double>::infinity();
+    geometryTrackMaxEta_ = std::numeric_limits<double>::infinity();
+    geometryTrackMinPhi_ = 0;
+    geometryTrackMaxPhi_ = 2*M_PI;
+    stratifyGeometryTrackEta_ = false;
+    geometryTrackPrecision_ = 0;
+    geometryTrackSeconds_ = 0;
+    geometryTrackWorstError_ = 0;
+    geometryTrackPt_ = 0;
+    quasiRandomTracks_ = false;
+    recordMaterialCrossings_ = false;
+    shareMaterialTracks_ = false;
+    recordTrackSamples_ = false;
+    trackRecords_ = NULL;
+    firstMaterialRecord_ = 0;
+    usePhiSymmetry_ = false;
+    resolutionGraphBins_ = 0;
+    geometryIndexSlices_ = 1;
+    geometryIndexGranularity_ = 1;
+    moduleFluencesEpoch_ = ComputableEpoch::current;
 
     //etaMaxMaterial = 3.1;
     etaMaxGeometry = 2.6;
@@ -167,7 +272,7 @@ void Analyzer::analyzeTaggedTracking(MaterialBudget& mb,
   materialTracksUsed = etaSteps;
 
   int nTracks;
-  double etaStep, eta, theta, phi;
+  double etaStep;
 
   // prepare etaStep, phiStep, nTracks, nScans
   if (etaSteps > 1) etaStep = getEtaMaxTrigger() / (double)(etaSteps - 1);
@@ -181,97 +286,237 @@ void Analyzer::analyzeTaggedTracking(MaterialBudget& mb,
   //std::map<string, std::vector<Track>> tvIdeal;
   std::map<std::string, TrackCollectionMap> taggedTrackCollectionMap;
   std::map<std::string, TrackCollectionMap> taggedTrackCollectionMapIdeal;
+  std::unique_ptr<StopWatch::MemoryScope> trackMemory(new StopWatch::MemoryScope(StopWatch::TrackMemory)); // until the graphs are made
+
+  // the tracks are taken from the track hit cache when it is reused and matches, else their hits are cached for later runs
+  TrackHitCache::ModuleTables cacheModules = trackHitCacheModules(mb, pm);
+  TrackHitCache trackCache;
+  bool cached = !trackHitCacheFile_.empty() && reuseTrackHitCache_ && trackCache.open(trackHitCacheFile_, trackHitCacheKey_, cacheModules);
+  if (cached && trackCache.numTracks() != nTracks) {
+    logWARNING("The track cache " + trackHitCacheFile_ + " has " + any2str(trackCache.numTracks()) + " tracks instead of " + any2str(nTracks) + ": the hits of the resolution tracks are looked for again");
+    trackCache.close();
+    cached = false;
+  }
+  bool caching = !trackHitCacheFile_.empty() && !cached;
+
+  bool shared = !cached && sharedMaterialTracks(nTracks);
+  // Takes the track of an eta step, with its hits
+  auto takeTrack = [&](int i_eta, Track& track) {
+    if (cached) {
+      trackCache.readTrack(i_eta, cacheModules, track);
+    } else if (shared) {
+      // the material track already has all the hits, the one on the beam pipe included
+      track = materialTracks_[i_eta];
+    } else {
+      double phi = CounterRandom(randomSeed_, CounterRandom::ResolutionTracks, i_eta).uniform() * PI * 2.0;
+      double eta = i_eta * etaStep;
+      double theta = 2 * atan(exp(-eta));
+      track.setTheta(theta);      
+      track.setPhi(phi);
 
-  for (int i_eta = 0; i_eta < nTracks; i_eta++) {
-    phi = myDice.Rndm() * PI * 2.0;
-    Material tmp;
-    Track track;
-    eta = i_eta * etaStep;
-    theta = 2 * atan(exp(-eta));
-    track.setTheta(theta);      
-    track.setPhi(phi);
-
-    tmp = findAllHits(mb, pm, eta, theta, phi, track);
-
-    // Debug: material amount
-    // std::cerr << "eta = " << eta
-    //           << ", material.radiation = " << tmp.radiation
-    //           << ", material.interaction = " << tmp.interaction
-    //           << std::endl;
-
-    // TODO: add the beam pipe as a user material eveywhere!
-    // in a coherent way
-    // Add the hit on the beam pipe
-    Hit* hit = new Hit(23./sin(theta));
-    hit->setOrientation(Hit::Horizontal);
-    hit->setObjectKind(Hit::Inactive);
-    Material beamPipeMat;
-    beamPipeMat.radiation = 0.0023 / sin(theta);
-    beamPipeMat.interaction = 0.0019 / sin(theta);
-    hit->setCorrectedMaterial(beamPipeMat);
-    track.addHit(hit);
-
-    // <SMe>
-    // track.sort();
-    // track.print();
-    // </SMe>
-
-    if (!track.noHits()) {
-      for (string tag : track.tags()) {
-        track.keepTaggedOnly(tag);
-        if (simParms().useIPConstraint()) track.addIPConstraint(simParms().rError(), simParms().zErrorCollider());
-        track.sort();
-        track.setTriggerResolution(true); // TODO: remove this (?)
-
-        if (efficiency!=1) track.addEfficiency(efficiency, false);
-        if (track.nActiveHits(true)>2) { // At least 3 points are needed to measure the arrow
-          // For each transverse momentum
-          // compute the tracks error
-          for (const auto& ptit : momenta ) {
-            int parameter = ptit * 1000;       // <SMe> we store p or pT in MeV as int (key to the map) </SMe>
-            double transverseMomentum = ptit;  // <SMe> we assign the selected /transverse/ momentum to the track (in GeV) </SMe>
-            // parameter is pT in this case
-            track.setTransverseMomentum(transverseMomentum);
-            track.computeErrors();
-            TrackCollectionMap &myMap = taggedTrackCollectionMap[tag];
-            TrackCollection &myCollection = myMap[parameter];
-            myCollection.push_back(track);
-
-            Track idealTrack(track);
-            idealTrack.removeMaterial();
-            idealTrack.computeErrors();
-            TrackCollectionMap &myMapIdeal = taggedTrackCollectionMapIdeal[tag];
-            TrackCollection &myCollectionIdeal = myMapIdeal[parameter];
-            myCollectionIdeal.push_back(idealTrack);
+      findAllHits(mb, pm, eta, theta, phi, track);
+
+      // TODO: add the beam pipe as a user material eveywhere!
+      // in a coherent way
+      // Add the hit on the beam pipe
+      Hit hit(23./sin(theta));
+      hit.setOrientation(Hit::Horizontal);
+      hit.setObjectKind(Hit::Inactive);
+      Material beamPipeMat;
+      beamPipeMat.radiation = 0.0023 / sin(theta);
+      beamPipeMat.interaction = 0.0019 / sin(theta);
+      hit.setCorrectedMaterial(beamPipeMat);
+      track.addHit(hit);
+    }
+  };
+  // The errors of a track for each tag with enough hits, at every momentum, with and without the material
+  struct TaggedErrors {
+    std::string tag;
+    int hits;
+    std::vector<Track::Errors> errors, idealErrors;
+  };
+  struct ResolvedTrack {
+    Track track; // as taken, for the track hit cache
+    double theta, phi;
+    double radiation, interaction; // recorded only with the track records
+    std::vector<TaggedErrors> taggedErrors;
+  };
+  bool recording = trackRecords_ != NULL;
+  if (recording) trackRecords_->begin("resolution", true);
+  auto resolveTrack = [&](int i_eta, Track& track, ResolvedTrack& resolved) {
+    resolved.theta = track.getTheta();
+    resolved.phi = track.getPhi();
+    resolved.taggedErrors.clear();
+    resolved.radiation = resolved.interaction = 0;
+    if (track.noHits()) return;
+    if (recording) {
+      RILength trackMaterial = track.getCorrectedMaterial();
+      resolved.radiation = trackMaterial.radiation;
+      resolved.interaction = trackMaterial.interaction;
+    }
+    // The hits of each tag are selected on the track itself, which is neither copied nor changed per tag; the
+    // collections only keep the angles and the errors of the tracks, which is all the graphs are made of
+    if (simParms().useIPConstraint()) track.addIPConstraint(simParms().rError(), simParms().zErrorCollider());
+    track.sort();
+    // the hits lost are drawn once per track, from its own stream, and dropped from the selection of every tag
+    std::vector<bool> efficiencyMask;
+    if (efficiency!=1) {
+      CounterRandom efficiencyDice(randomSeed_, CounterRandom::ResolutionEfficiency, i_eta);
+      efficiencyMask = track.efficiencyMask(efficiency, 1, efficiencyDice);
+    }
+    for (string tag : track.tags()) {
+      Track::HitSelection selection = track.selectTagged(tag);
+      if (efficiency!=1) track.addEfficiency(selection, efficiencyMask);
+      int hits = track.nActiveHits(selection, true);
+      if (hits>2) { // At least 3 points are needed to measure the arrow
+        // For each transverse momentum
+        // compute the tracks error: the hit geometry is shared by all the momenta
+        // <SMe> we assign the selected /transverse/ momentum to the track (in GeV) </SMe>
+        TaggedErrors tagged;
+        tagged.tag = tag;
+        tagged.hits = hits;
+        tagged.errors = track.computeErrors(momenta, selection);
+        selection.material = false;
+        tagged.idealErrors = track.computeErrors(momenta, selection);
+        resolved.taggedErrors.push_back(std::move(tagged));
+      }
+    }
+  };
+
+  // The tracks are resolved one chunk at a time, concurrently with several threads, then added to the collections in
+  // track order. The hit efficiency draws from the counter stream of each track, whatever the thread.
+  bool concurrent = numThreads_ > 1;
+  if (concurrent && !cached && !shared) {
+    primeModuleCaches(mb.getBarrelModuleCaps());
+    primeModuleCaches(mb.getEndcapModuleCaps());
+    if (pm) {
+      primeModuleCaches(pm->getBarrelModuleCaps());
+      primeModuleCaches(pm->getEndcapModuleCaps());
+    }
+  }
+  ChunkSizer chunks(resolutionTracksPerThreadChunk * numThreads_, resolutionTracksPerThreadChunk * numThreads_ * maxTrackChunkGrowth, trackChunkSeconds);
+  std::vector<ResolvedTrack> resolvedTracks;
+  TrackRecordWriter::Batch records;
+  for (int first = 0, last; first < nTracks; first = last) {
+    last = MIN(nTracks, first + chunks.size());
+    chunks.start();
+    resolvedTracks.resize(last - first);
+    auto takeAndResolve = [&](int i_eta) {
+      ResolvedTrack& resolved = resolvedTracks[i_eta - first];
+      Track track;
+      takeTrack(i_eta, track);
+      if (caching) resolved.track = track;
+      resolveTrack(i_eta, track, resolved);
+    };
+    if (concurrent) parallelFor("Resolution tracks", first, last, takeAndResolve);
+    else for (int i_eta = first; i_eta < last; i_eta++) takeAndResolve(i_eta);
+
+    for (ResolvedTrack& resolved : resolvedTracks) {
+      if (caching) {
+        trackCache.addTrack(resolved.track, cacheModules);
+        resolved.track = Track();
+      }
+      Track resolvedTrack;
+      resolvedTrack.setTheta(resolved.theta);
+      resolvedTrack.setPhi(resolved.phi);
+      for (const TaggedErrors& tagged : resolved.taggedErrors) {
+        for (unsigned int iMomentum = 0; iMomentum < momenta.size(); iMomentum++) {
+          int parameter = momenta[iMomentum] * 1000;       // <SMe> we store p or pT in MeV as int (key to the map) </SMe>
+          // parameter is pT in this case
+          TrackCollectionMap &myMap = taggedTrackCollectionMap[tagged.tag];
+          TrackCollection &myCollection = myMap[parameter];
+          if (myCollection.empty()) myCollection.reserve(nTracks); // at most one track per eta step
+          myCollection.push_back(resolvedTrack);
+          myCollection.back().setErrors(tagged.errors[iMomentum]);
+
+          TrackCollectionMap &myMapIdeal = taggedTrackCollectionMapIdeal[tagged.tag];
+          TrackCollection &myCollectionIdeal = myMapIdeal[parameter];
+          if (myCollectionIdeal.empty()) myCollectionIdeal.reserve(nTracks);
+          myCollectionIdeal.push_back(resolvedTrack);
+          myCollectionIdeal.back().setErrors(tagged.idealErrors[iMomentum]);
+        }
+        if (recording) {
+          records.push_back(TrackRecordWriter::Record());
+          TrackRecordWriter::Record& record = records.back();
+          record.eta = -log(tan(resolved.theta / 2));
+          record.phi = resolved.phi;
+          record.z0 = 0;
+          record.radiation = resolved.radiation;
+          record.interaction = resolved.interaction;
+          record.hits = tagged.hits;
+          record.tag = tagged.tag;
+          for (const Track::Errors& errors : tagged.errors) {
+            record.pt.push_back(errors.transverseMomentum);
+            record.deltaRho.push_back(errors.deltaRho);
+            record.deltaPhi.push_back(errors.deltaPhi);
+            record.deltaD.push_back(errors.deltaD);
+            record.deltaCtgTheta.push_back(errors.deltaCtgTheta);
+            record.deltaZ0.push_back(errors.deltaZ0);
+            record.deltaP.push_back(errors.deltaP);
           }
-        }    
+        }
       }
     }
+    if (recording) trackRecords_->push(records);
+    chunks.done(last - first);
   }
+  logDEBUG(chunks.summary("Resolution tracks"));
   
-  // For each tracking system compute the resolution graphs // TODO: consts here
-  for (/*const*/ auto& ttcmIt : taggedTrackCollectionMap) {
-    const string& myTag = ttcmIt.first;
-    clearGraphs(GraphBag::RealGraph, myTag);
-    /*const*/ TrackCollectionMap& myTrackCollection = ttcmIt.second;
-    for (const auto& tcmIt : myTrackCollection) {
-      const int &parameter = tcmIt.first;
-      const TrackCollection& myCollection = tcmIt.second;
-      calculateGraphs(parameter, myCollection, GraphBag::RealGraph, myTag);
-    }
+  if (caching) trackCache.write(trackHitCacheFile_, trackHitCacheKey_);
+  trackMemory.reset();
+  // For each tracking system compute the resolution graphs
+  calculateTaggedGraphs(taggedTrackCollectionMap, GraphBag::RealGraph);
+  calculateTaggedGraphs(taggedTrackCollectionMapIdeal, GraphBag::IdealGraph);
+}
+
+/**
+ * Estimates the resolutions of the tracks of each tag analytically, from the layers and disks they cross, instead of
+ * shooting the tracks and fitting their hits (see <i>FastResolution</i>): the graphs are those of
+ * <i>analyzeTaggedTracking()</i>, with one point per eta step, in a fraction of the time, for screening layouts.
+ * @param mb The material budget, whose module caps give the layers, their resolutions and their material
+ * @param momenta The transverse momenta of the tracks
+ * @param etaSteps The number of tracks, evenly spaced in eta
+ * @param pm The material budget of the pixel detector, if any
+ */
+void Analyzer::analyzeFastResolution(MaterialBudget& mb, const std::vector<double>& momenta, int etaSteps, MaterialBudget* pm) {
+  materialTracksUsed = etaSteps;
+  double etaStep = etaSteps > 1 ? getEtaMaxTrigger() / (double)(etaSteps - 1) : getEtaMaxTrigger();
+
+  FastResolution fast;
+  fast.addLayers(mb.getBarrelModuleCaps());
+  fast.addLayers(mb.getEndcapModuleCaps());
+  if (pm) {
+    fast.addLayers(pm->getBarrelModuleCaps());
+    fast.addLayers(pm->getEndcapModuleCaps());
   }
 
-  for (/*const*/ auto& ttcmIt : taggedTrackCollectionMapIdeal) {
-    const string& myTag = ttcmIt.first;
-    clearGraphs(GraphBag::IdealGraph, myTag);
-    /*const*/ TrackCollectionMap& myTrackCollection = ttcmIt.second;
-    for (const auto& tcmIt : myTrackCollection) {
-      const int &parameter = tcmIt.first;
-      const TrackCollection& myCollection = tcmIt.second;
-      calculateGraphs(parameter, myCollection, GraphBag::IdealGraph, myTag);
+  bool ipConstraint = simParms().useIPConstraint();
+  double ipRError = ipConstraint ? simParms().rError() : 0.;
+  double ipZError = ipConstraint ? simParms().zErrorCollider() : 0.;
+  std::map<std::string, TrackCollectionMap> taggedTrackCollectionMap;
+  std::map<std::string, TrackCollectionMap> taggedTrackCollectionMapIdeal;
+  std::vector<Track::Errors> errors, idealErrors;
+  for (const std::string& tag : fast.tags()) {
+    for (int i_eta = 0; i_eta < etaSteps; i_eta++) {
+      double theta = 2 * atan(exp(-i_eta * etaStep));
+      if (!fast.errors(theta, tag, momenta, true, ipConstraint, ipRError, ipZError, errors)) continue;
+      fast.errors(theta, tag, momenta, false, ipConstraint, ipRError, ipZError, idealErrors);
+      Track track;
+      track.setTheta(theta);
+      track.setPhi(0);
+      for (unsigned int iMomentum = 0; iMomentum < momenta.size(); iMomentum++) {
+        int parameter = momenta[iMomentum] * 1000;
+        TrackCollection& myCollection = taggedTrackCollectionMap[tag][parameter];
+        myCollection.push_back(track);
+        myCollection.back().setErrors(errors[iMomentum]);
+        TrackCollection& myCollectionIdeal = taggedTrackCollectionMapIdeal[tag][parameter];
+        myCollectionIdeal.push_back(track);
+        myCollectionIdeal.back().setErrors(idealErrors[iMomentum]);
+      }
     }
   }
-
+  calculateTaggedGraphs(taggedTrackCollectionMap, GraphBag::RealGraph);
+  calculateTaggedGraphs(taggedTrackCollectionMapIdeal, GraphBag::IdealGraph);
 }
 
   /**
@@ -302,32 +547,46 @@ void Analyzer::analyzeTaggedTracking(MaterialBudget& mb,
 
     // reset the list of tracks
     std::vector<Track> tv;
+    bool shared = sharedMaterialTracks(nTracks);
+    ProgressMeter progress("Trigger tracks", nTracks);
 
     // Loop over nTracks (eta range [0, getEtaMaxTrigger()])
-    for (int i_eta = 0; i_eta < nTracks; i_eta++) {
-      phi = myDice.Rndm() * PI * 2.0;
-      z0 = myDice.Gaus(0, zError);
+    for (int i_eta = 0; i_eta < nTracks; i_eta++, progress.advance()) {
       int nHits;
       Track track;
-      eta = i_eta * etaStep;
-      theta = 2 * atan(exp(-eta));
-      track.setTheta(theta);      
-      track.setPhi(phi);
-
-      nHits = findHitsModules(tracker, z0, eta, theta, phi, track);
+      if (shared) {
+        // the hits of the material track, without their material as the trigger tracks have none
+        track = materialTracks_[i_eta];
+        track.removeMaterial();
+        nHits = track.nActiveHits();
+      } else {
+        CounterRandom dice(randomSeed_, CounterRandom::TriggerTracks, i_eta);
+        phi = dice.uniform() * PI * 2.0;
+        z0 = dice.gaus(0, zError);
+        eta = i_eta * etaStep;
+        theta = 2 * atan(exp(-eta));
+        track.setTheta(theta);      
+        track.setPhi(phi);
+
+        nHits = findHitsModules(tracker, z0, eta, theta, phi, track);
+      }
 
       if (nHits) {
-        // Keep only triggering hits
+        // Keep only triggering hits, and drop the ones lost to the efficiency in the same pass
         // std::cerr << "Material before = " << track.getCorrectedMaterial().radiation;
-        track.keepTriggerOnly();
         track.sort();
+        Track::HitSelection selection = track.selectTrigger();
+        if (efficiency!=1) {
+          CounterRandom efficiencyDice(randomSeed_, CounterRandom::TriggerEfficiency, i_eta);
+          track.addEfficiency(selection, track.efficiencyMask(efficiency, 1, efficiencyDice));
+        }
+        track.keepSelected(selection);
         track.setTriggerResolution(true);
 
         // std::cerr << " material after = " << track.getCorrectedMaterial().radiation << std::endl;
 
-        if (efficiency!=1) track.addEfficiency(efficiency, false);
         if (track.nActiveHits(true)>0) { // At least 3 points are needed to measure the arrow
-          tv.push_back(track);
+          tv.push_back(std::move(track));
         }    
       }
     }
@@ -400,6 +659,59 @@ void Analyzer::fillTriggerEfficiencyGraphs(const Tracker& tracker,
 
   double maxEta = 4.0; //getEtaMaxTrigger();
 
+  // The profiles of each momentum, and the layer of each module, resolved before the tracks are gone through: the stub
+  // efficiency histograms are then found by layer and momentum index, and only created when a first stub fills them
+  std::vector<TProfile*> momentumProfiles, momentumFractionProfiles, momentumPurityProfiles;
+  std::vector<std::string> momentumStrings;
+  for (double momentum : triggerMomenta) {
+    momentumProfiles.push_back(&trigProfiles[momentum]);
+    momentumFractionProfiles.push_back(&trigFractionProfiles[momentum]);
+    momentumPurityProfiles.push_back(&trigPurityProfiles[momentum]);
+    momentumStrings.push_back(any2str(momentum, 2));
+  }
+  std::unordered_map<ModuleKey, int> layerIds;
+  std::vector<std::string> layerNames;
+  std::vector<int> moduleLayerIds; // by module index
+  moduleLayerIds.reserve(tracker.modules().size());
+  for (const Module* m : tracker.modules()) {
+    auto layerId = layerIds.insert(std::make_pair(m->moduleKey().layerKey(), int(layerNames.size())));
+    if (layerId.second) layerNames.push_back(m->cntName() + "_" + any2str(layerId.first->first.layer()));
+    moduleLayerIds.push_back(layerId.first->second);
+  }
+  std::vector<TH1I*> stubEfficiencyHistos(layerNames.size() * triggerMomenta.size(), NULL); // by layer, then momentum
+  for (size_t l = 0; l < layerNames.size(); l++) {
+    auto layerHistos = stubEfficiencyCoverageProfiles.find(layerNames[l]);
+    if (layerHistos == stubEfficiencyCoverageProfiles.end()) continue;
+    for (size_t p = 0; p < triggerMomenta.size(); p++) {
+      auto histo = layerHistos->second.find(momentumStrings[p]);
+      if (histo != layerHistos->second.end()) stubEfficiencyHistos[l * triggerMomenta.size() + p] = histo->second;
+    }
+  }
+
+  // The trigger probabilities and stub frequencies of a module only depend on the momentum: they are evaluated for all
+  // the momenta in one batch, the first time a track hits the module
+  struct ModuleTriggerRates {
+    bool evaluated;
+    std::vector<double> triggerProbabilities, particlesAbove, trueAbove, trueBelow;
+    double fake;
+  };
+  std::vector<ModuleTriggerRates> moduleRates(tracker.modules().size(), ModuleTriggerRates{false, {}, {}, {}, {}, 0.});
+  auto rates = [&](Module* hitModule) -> const ModuleTriggerRates& {
+    ModuleTriggerRates& moduleRate = moduleRates[hitModule->moduleIndex()];
+    if (!moduleRate.evaluated) {
+      PtErrorAdapter pterr(*hitModule);
+      pterr.getTriggerProbabilities(triggerMomenta, moduleRate.triggerProbabilities);
+      pterr.getFrequenciesPerEvent(triggerMomenta, moduleRate.particlesAbove, moduleRate.trueAbove, moduleRate.trueBelow);
+      // Reduction of the combinatorial background for ptPS modules by turning off the appropriate pixels
+      double bgReductionFactor = hitModule->reduceCombinatorialBackground() ? hitModule->geometricEfficiency() : 1;
+      moduleRate.fake = pterr.getTriggerFrequencyFakePerEvent()*simParms().numMinBiasEvents() * bgReductionFactor;
+      moduleRate.evaluated = true;
+    }
+    return moduleRate;
+  };
+  std::vector<std::pair<Module*,HitType>> hitModules;
+  std::vector<double> expectedTriggerPoints(triggerMomenta.size());
+
   for (std::vector<Track>::const_iterator itTrack = trackVector.begin();
        itTrack != trackVector.end(); ++itTrack) {
     const Track& myTrack=(*itTrack);
@@ -407,46 +719,48 @@ void Analyzer::fillTriggerEfficiencyGraphs(const Tracker& tracker,
     double eta = myTrack.getEta();
     int nHits = myTrack.nActiveHits(false, false);
     totalProfile.Fill(eta, nHits);
-    std::vector<std::pair<Module*,HitType>> hitModules = myTrack.getHitModules();
-
-    for(std::vector<double>::const_iterator itMomentum = triggerMomenta.begin();
-        itMomentum!=triggerMomenta.end(); ++itMomentum) {
-      TProfile& myProfile = trigProfiles[(*itMomentum)];
-      TProfile& myFractionProfile = trigFractionProfiles[(*itMomentum)];
-      TProfile& myPurityProfile = trigPurityProfiles[(*itMomentum)];
-      double nExpectedTriggerPoints = myTrack.expectedTriggerPoints(*itMomentum);
+    myTrack.getHitModules(hitModules);
+    // the modules of the trigger hits are those Track::expectedTriggerPoints() sums the probabilities of
+    std::fill(expectedTriggerPoints.begin(), expectedTriggerPoints.end(), 0.);
+    for (const auto& modAndType : hitModules) {
+      const ModuleTriggerRates& moduleRate = rates(modAndType.first);
+      for (size_t p = 0; p < triggerMomenta.size(); p++) expectedTriggerPoints[p] += moduleRate.triggerProbabilities[p];
+    }
+
+    for (size_t p = 0; p < triggerMomenta.size(); p++) {
+      double nExpectedTriggerPoints = expectedTriggerPoints[p];
       if (nExpectedTriggerPoints>=0) { // sanity check (! nan)
-        myProfile.Fill(eta, nExpectedTriggerPoints);
+        momentumProfiles[p]->Fill(eta, nExpectedTriggerPoints);
         if (nHits>0) {
-          myFractionProfile.Fill(eta, nExpectedTriggerPoints*100/double(nHits));
+          momentumFractionProfiles[p]->Fill(eta, nExpectedTriggerPoints*100/double(nHits));
            double curAvgTrue=0;
            double curAvgInteresting=0;
            double curAvgFake=0;
-           double bgReductionFactor; // Reduction of the combinatorial background for ptPS modules by turning off the appropriate pixels
            for (const auto& modAndType : hitModules) {
              Module* hitModule = modAndType.first;
-             PtErrorAdapter pterr(*hitModule);
+             const ModuleTriggerRates& moduleRate = rates(hitModule);
              // Hits that we would like to have from tracks above this threshold
-             curAvgInteresting += pterr.getParticleFrequencyPerEventAbove(*itMomentum);
+             curAvgInteresting += moduleRate.particlesAbove[p];
              // ... out of which we only see these
-             curAvgTrue += pterr.getTriggerFrequencyTruePerEventAbove(*itMomentum);
+             curAvgTrue += moduleRate.trueAbove[p];
                
              // The background is given by the contamination from low pT tracks...
-             curAvgFake += pterr.getTriggerFrequencyTruePerEventBelow(*itMomentum);
+             curAvgFake += moduleRate.trueBelow[p];
              // ... plus the combinatorial background from occupancy (can be reduced using ptPS modules)
-             if (hitModule->reduceCombinatorialBackground()) bgReductionFactor = hitModule->geometricEfficiency(); else bgReductionFactor=1;
-             curAvgFake += pterr.getTriggerFrequencyFakePerEvent()*simParms().numMinBiasEvents() * bgReductionFactor;
+             curAvgFake += moduleRate.fake;
 
-             std::string layerName = hitModule->uniRef().cnt + "_" + any2str(hitModule->uniRef().layer);
              if (modAndType.second == HitType::STUB) {
-               std::string momentumString = any2str(*itMomentum, 2);
-               if (stubEfficiencyCoverageProfiles[layerName].count(momentumString) == 0) {
-                 stubEfficiencyCoverageProfiles[layerName][momentumString] = new TH1I(Form("stubEfficiencyCoverageProfile%s%s", layerName.c_str(), momentumString.c_str()), (layerName + ";#eta;Stubs").c_str(), trackVector.size(), 0.0, maxEta); 
+               int layerId = moduleLayerIds[hitModule->moduleIndex()];
+               TH1I*& stubEfficiencyHisto = stubEfficiencyHistos[layerId * triggerMomenta.size() + p];
+               if (!stubEfficiencyHisto) {
+                 const std::string& layerName = layerNames[layerId];
+                 stubEfficiencyHisto = new TH1I(Form("stubEfficiencyCoverageProfile%s%s", layerName.c_str(), momentumStrings[p].c_str()), (layerName + ";#eta;Stubs").c_str(), trackVector.size(), 0.0, maxEta); 
+                 stubEfficiencyCoverageProfiles[layerName][momentumStrings[p]] = stubEfficiencyHisto;
                }
-               stubEfficiencyCoverageProfiles[layerName][momentumString]->Fill(myTrack.getEta(), 1);
+               stubEfficiencyHisto->Fill(myTrack.getEta(), 1);
              } 
            }
-           myPurityProfile.Fill(eta, 100*curAvgTrue/(curAvgTrue+curAvgFake));
+           momentumPurityProfiles[p]->Fill(eta, 100*curAvgTrue/(curAvgTrue+curAvgFake));
         }
       }
     }
@@ -470,258 +784,89 @@ void Analyzer::fillTriggerEfficiencyGraphs(const Tracker& tracker,
  * @param momenta A list of momentum values for the tracks that are shot through the layout
  * @param etaSteps The number of wedges in the fan of tracks covered by the eta scan
  * @param A pointer to a second material budget associated to a pixel detector; may be <i>NULL</i>
+ * @param materialMaps Whether the (z, r) material maps and isolines are filled; they are only needed by the material report
+ * @return False if the scan was to resume from a checkpoint that could not be read or is for another scan
  */
-void Analyzer::analyzeMaterialBudget(MaterialBudget& mb, const std::vector<double>& momenta, int etaSteps,
-                                     MaterialBudget* pm) {
+bool Analyzer::analyzeMaterialBudget(MaterialBudget& mb, const std::vector<double>& momenta, int etaSteps,
+                                     MaterialBudget* pm, bool materialMaps) {
 
-  Tracker& tracker = mb.getTracker();
-  double efficiency = simParms().efficiency();
-  double pixelEfficiency = simParms().pixelEfficiency();
-  materialTracksUsed = etaSteps;
   int nTracks;
-  double etaStep, eta, theta, phi;
-  clearMaterialBudgetHistograms();
-  clearCells();
+  double etaStep;
   // prepare etaStep, phiStep, nTracks, nScans
   if (etaSteps > 1) etaStep = getEtaMaxMaterial() / (double)(etaSteps - 1);
   else etaStep = getEtaMaxMaterial();
   nTracks = etaSteps;
-  // reset the number of bins and the histogram boundaries (0.0 to getEtaMaxMaterial()) for all histograms, recalculate the cell boundaries
-  setHistogramBinsBoundaries(nTracks, 0.0, getEtaMaxMaterial());
-  setCellBoundaries(nTracks, 0.0, outer_radius + volume_width, 0.0, getEtaMaxMaterial());
+  prepareMaterialScan(etaSteps, materialMaps);
 
   // reset the list of tracks
   // std::vector<Track> tv;
   // std::vector<Track> tvIdeal;
 
-  for (int i_eta = 0; i_eta < nTracks; i_eta++) {
-    phi = myDice.Rndm() * PI * 2.0;
-    Material tmp;
-    Track track;
-    eta = i_eta * etaStep;
-    theta = 2 * atan(pow(E, -1 * eta)); // TODO: switch to exp() here
-    track.setTheta(theta);
-    track.setPhi(phi);
-    //      active volumes, barrel
-    std::map<std::string, Material> sumComponentsRI;
-    tmp = analyzeModules(mb.getBarrelModuleCaps(), eta, theta, phi, track, sumComponentsRI);
-    ractivebarrel.Fill(eta, tmp.radiation);
-    iactivebarrel.Fill(eta, tmp.interaction);
-    rbarrelall.Fill(eta, tmp.radiation);
-    ibarrelall.Fill(eta, tmp.interaction);
-    ractiveall.Fill(eta, tmp.radiation);
-    iactiveall.Fill(eta, tmp.interaction);
-    rglobal.Fill(eta, tmp.radiation);
-    iglobal.Fill(eta, tmp.interaction);
-
-    //      active volumes, endcap
-    tmp = analyzeModules(mb.getEndcapModuleCaps(), eta, theta, phi, track, sumComponentsRI);
-    ractiveendcap.Fill(eta, tmp.radiation);
-    iactiveendcap.Fill(eta, tmp.interaction);
-    rendcapall.Fill(eta, tmp.radiation);
-    iendcapall.Fill(eta, tmp.interaction);
-    ractiveall.Fill(eta, tmp.radiation);
-    iactiveall.Fill(eta, tmp.interaction);
-    rglobal.Fill(eta, tmp.radiation);
-    iglobal.Fill(eta, tmp.interaction);
-
-    for (std::map<std::string, Material>::iterator it = sumComponentsRI.begin(); it != sumComponentsRI.end(); ++it) {
-      if (rComponents[it->first]==NULL) { 
-        rComponents[it->first] = new TH1D();
-        rComponents[it->first]->SetBins(nTracks, 0.0, getEtaMaxMaterial()); 
-      }
-      rComponents[it->first]->Fill(eta, it->second.radiation);
-      if (iComponents[it->first]==NULL) {
-        iComponents[it->first] = new TH1D();
-        iComponents[it->first]->SetBins(nTracks, 0.0, getEtaMaxMaterial()); 
-      }
-      iComponents[it->first]->Fill(eta, it->second.interaction);
-    }
-
-
-    if (rComponents["Services"]==NULL) { 
-      rComponents["Services"] = new TH1D();
-      rComponents["Services"]->SetBins(nTracks, 0.0, getEtaMaxMaterial()); 
+  // every track draws its direction from a counter stream of its own, so that the results do not depend on the order
+  // the tracks are analysed in, nor on the analyses run before, nor on how the tracks are split into shards
+  std::vector<double> phis(nTracks);
+  // with the phi symmetry, the tracks are shot in the fundamental domain only: every track stands for all its images
+  double phiSpan = usePhiSymmetry_ ? materialPhiPeriod(mb, pm) : 2*PI;
+  for (int i_eta = 0; i_eta < nTracks; i_eta++) phis[i_eta] = (quasiRandomTracks_ ? radicalInverse(i_eta + 1, 2) : CounterRandom(randomSeed_, CounterRandom::MaterialTracks, i_eta).uniform()) * phiSpan;
+  materialCrossings_.assign(recordMaterialCrossings_ ? nTracks : 0, MaterialTrackCrossings());
+  materialTracks_.assign(shareMaterialTracks_ ? nTracks : 0, Track());
+  materialSamples_.assign(recordTrackSamples_ ? nTracks : 0, TrackSample());
+  // a shard only analyses its contiguous slice of tracks, whose fills are merged with the other slices afterwards
+  int firstTrack = (long long)nTracks * materialTrackShard_ / materialTrackShards_;
+  int lastTrack = (long long)nTracks * (materialTrackShard_ + 1) / materialTrackShards_;
+  // a resumed scan starts from the fills of the tracks before its checkpoint, as a shard merged with the ones before
+  int nextTrack = firstTrack;
+  if (!materialCheckpointFile_.empty() && resumeMaterialScan_ && !readMaterialCheckpoint(firstTrack, lastTrack, nextTrack)) return false;
+  if (trackRecords_) trackRecords_->begin("material", false);
+
+  if (numThreads_ > 1) {
+    primeModuleCaches(mb.getBarrelModuleCaps());
+    primeModuleCaches(mb.getEndcapModuleCaps());
+    if (pm) {
+      primeModuleCaches(pm->getBarrelModuleCaps());
+      primeModuleCaches(pm->getEndcapModuleCaps());
     }
-    if (iComponents["Services"]==NULL) { 
-      iComponents["Services"] = new TH1D();
-      iComponents["Services"]->SetBins(nTracks, 0.0, getEtaMaxMaterial()); 
-    }
-    if (rComponents["Supports"]==NULL) { 
-      rComponents["Supports"] = new TH1D();
-      rComponents["Supports"]->SetBins(nTracks, 0.0, getEtaMaxMaterial()); 
-    }
-    if (iComponents["Supports"]==NULL) { 
-      iComponents["Supports"] = new TH1D();
-      iComponents["Supports"]->SetBins(nTracks, 0.0, getEtaMaxMaterial()); 
+  }
+  // tracks are analysed one chunk at a time, concurrently with several threads (their fills being replayed in track
+  // order), and the scan is checkpointed between two chunks; the chunks are sized after the cost of their tracks
+  ChunkSizer chunks(materialTracksPerThreadChunk * numThreads_, materialTracksPerThreadChunk * numThreads_ * maxTrackChunkGrowth, trackChunkSeconds);
+  std::vector<MaterialTrackRecord> records;
+  ProgressMeter progress("Material tracks", lastTrack - nextTrack);
+  std::chrono::steady_clock::time_point lastCheckpoint = std::chrono::steady_clock::now();
+  for (int first = nextTrack, last; first < lastTrack; first = last) {
+    last = MIN(lastTrack, first + chunks.size());
+    chunks.start();
+    if (trackRecords_) {
+      materialRecords_.resize(last - first);
+      firstMaterialRecord_ = first;
     }
-    //      services, barrel
-    tmp = analyzeInactiveSurfaces(mb.getInactiveSurfaces().getBarrelServices(), eta, theta, track, MaterialProperties::no_cat);
-    rserfbarrel.Fill(eta, tmp.radiation);
-    iserfbarrel.Fill(eta, tmp.interaction);
-    rbarrelall.Fill(eta, tmp.radiation);
-    ibarrelall.Fill(eta, tmp.interaction);
-    /*
-    if (eta<0.03) {
-      std::cout << "eta = " << eta << std::endl;
-      track.sort();
-      track.print();
-    }
-    */
-    rserfall.Fill(eta, tmp.radiation);
-    iserfall.Fill(eta, tmp.interaction);
-    rglobal.Fill(eta, tmp.radiation);
-    iglobal.Fill(eta, tmp.interaction);
-    rComponents["Services"]->Fill(eta, tmp.radiation);
-    iComponents["Services"]->Fill(eta, tmp.interaction);
-    //      services, endcap
-    tmp = analyzeInactiveSurfaces(mb.getInactiveSurfaces().getEndcapServices(), eta, theta, track, MaterialProperties::no_cat);
-    rserfendcap.Fill(eta, tmp.radiation);
-    iserfendcap.Fill(eta, tmp.interaction);
-    rendcapall.Fill(eta, tmp.radiation);
-    iendcapall.Fill(eta, tmp.interaction);
-    rserfall.Fill(eta, tmp.radiation);
-    iserfall.Fill(eta, tmp.interaction);
-    rglobal.Fill(eta, tmp.radiation);
-    iglobal.Fill(eta, tmp.interaction);
-    rComponents["Services"]->Fill(eta, tmp.radiation);
-    iComponents["Services"]->Fill(eta, tmp.interaction);
-    //      supports, barrel
-    tmp = analyzeInactiveSurfaces(mb.getInactiveSurfaces().getSupports(), eta, theta, track, MaterialProperties::b_sup);
-    rlazybarrel.Fill(eta, tmp.radiation);
-    ilazybarrel.Fill(eta, tmp.interaction);
-    rbarrelall.Fill(eta, tmp.radiation);
-    ibarrelall.Fill(eta, tmp.interaction);
-    rlazyall.Fill(eta, tmp.radiation);
-    ilazyall.Fill(eta, tmp.interaction);
-    rglobal.Fill(eta, tmp.radiation);
-    iglobal.Fill(eta, tmp.interaction);
-    rComponents["Supports"]->Fill(eta, tmp.radiation);
-    iComponents["Supports"]->Fill(eta, tmp.interaction);
-    //      supports, endcap
-    tmp = analyzeInactiveSurfaces(mb.getInactiveSurfaces().getSupports(), eta, theta, track, MaterialProperties::e_sup);
-    rlazyendcap.Fill(eta, tmp.radiation);
-    ilazyendcap.Fill(eta, tmp.interaction);
-    rendcapall.Fill(eta, tmp.radiation);
-    iendcapall.Fill(eta, tmp.interaction);
-    rlazyall.Fill(eta, tmp.radiation);
-    ilazyall.Fill(eta, tmp.interaction);
-    rglobal.Fill(eta, tmp.radiation);
-    iglobal.Fill(eta, tmp.interaction);
-    rComponents["Supports"]->Fill(eta, tmp.radiation);
-    iComponents["Supports"]->Fill(eta, tmp.interaction);
-    //      supports, tubes
-    tmp = analyzeInactiveSurfaces(mb.getInactiveSurfaces().getSupports(), eta, theta, track, MaterialProperties::o_sup);
-    rlazytube.Fill(eta, tmp.radiation);
-    ilazytube.Fill(eta, tmp.interaction);
-    rlazyall.Fill(eta, tmp.radiation);
-    ilazyall.Fill(eta, tmp.interaction);
-    rglobal.Fill(eta, tmp.radiation);
-    iglobal.Fill(eta, tmp.interaction);
-    rComponents["Supports"]->Fill(eta, tmp.radiation);
-    iComponents["Supports"]->Fill(eta, tmp.interaction);
-    //      supports, barrel tubes
-    tmp = analyzeInactiveSurfaces(mb.getInactiveSurfaces().getSupports(), eta, theta, track, MaterialProperties::t_sup);
-    rlazybtube.Fill(eta, tmp.radiation);
-    ilazybtube.Fill(eta, tmp.interaction);
-    rlazyall.Fill(eta, tmp.radiation);
-    ilazyall.Fill(eta, tmp.interaction);
-    rglobal.Fill(eta, tmp.radiation);
-    iglobal.Fill(eta, tmp.interaction);
-    rComponents["Supports"]->Fill(eta, tmp.radiation);
-    iComponents["Supports"]->Fill(eta, tmp.interaction);
-    //      supports, user defined
-    tmp = analyzeInactiveSurfaces(mb.getInactiveSurfaces().getSupports(), eta, theta, track, MaterialProperties::u_sup);
-    rlazyuserdef.Fill(eta, tmp.radiation);
-    ilazyuserdef.Fill(eta, tmp.interaction);
-    rlazyall.Fill(eta, tmp.radiation);
-    ilazyall.Fill(eta, tmp.interaction);
-    rglobal.Fill(eta, tmp.radiation);
-    iglobal.Fill(eta, tmp.interaction);
-    rComponents["Supports"]->Fill(eta, tmp.radiation);
-    iComponents["Supports"]->Fill(eta, tmp.interaction);
-    //      pixels, if they exist
-    if (pm != NULL) {
-      std::map<std::string, Material> ignoredPixelSumComponentsRI;
-      analyzeModules(pm->getBarrelModuleCaps(), eta, theta, phi, track, ignoredPixelSumComponentsRI, true);
-      analyzeModules(pm->getEndcapModuleCaps(), eta, theta, phi, track, ignoredPixelSumComponentsRI, true);
-      analyzeInactiveSurfaces(pm->getInactiveSurfaces().getBarrelServices(), eta, theta, track, MaterialProperties::no_cat, true);
-      analyzeInactiveSurfaces(pm->getInactiveSurfaces().getEndcapServices(), eta, theta, track, MaterialProperties::no_cat, true);
-      analyzeInactiveSurfaces(pm->getInactiveSurfaces().getSupports(), eta, theta, track, MaterialProperties::no_cat, true);
-    }
-
-    // Add the hit on the beam pipe
-    Hit* hit = new Hit(23./sin(theta));
-    hit->setOrientation(Hit::Horizontal);
-    hit->setObjectKind(Hit::Inactive);
-    Material beamPipeMat;
-    beamPipeMat.radiation = 0.0023 / sin(theta);
-    beamPipeMat.interaction = 0.0019 / sin(theta);
-    hit->setCorrectedMaterial(beamPipeMat);
-    track.addHit(hit);
-    if (!track.noHits()) {
-      track.sort();
-      if (efficiency!=1) track.addEfficiency(efficiency, false);
-      if (pixelEfficiency!=1) track.addEfficiency(efficiency, true);
-
-      // @@ Hadrons
-      int nActive = track.nActiveHits();
-      if (nActive>0) {
-        hadronTotalHitsGraph.SetPoint(hadronTotalHitsGraph.GetN(),
-                                      eta,
-                                      nActive);
-        double probability;
-        std::vector<double> probabilities = track.hadronActiveHitsProbability();
-
-        double averageHits=0;
-        //double averageSquaredHits=0;
-        double exactProb=0;
-        double moreThanProb = 0;
-        for (int i=probabilities.size()-1;
-             i>=0;
-             --i) {
-          //if (nActive==10) { // debug
-          //  std::cerr << "probabilities.at(" 
-          //  << i << ")=" << probabilities.at(i)
-          //  << endl;
-          //}
-          exactProb=probabilities.at(i)-moreThanProb;
-          averageHits+=(i+1)*exactProb;
-          //averageSquaredHits+=((i+1)*(i+1))*exactProb;
-          moreThanProb+=exactProb;
-        }
-        hadronAverageHitsGraph.SetPoint(hadronAverageHitsGraph.GetN(),
-                                        eta,
-                                        averageHits);
-        //hadronAverageHitsGraph.SetPointError(hadronAverageHitsGraph.GetN()-1,
-        //                       0,
-        //                       sqrt( averageSquaredHits - averageHits*averageHits) );
-
-        unsigned int requiredHits;
-        for (unsigned int i = 0;
-             i<hadronNeededHitsFraction.size();
-             ++i) {
-          requiredHits = int(ceil(double(nActive) * hadronNeededHitsFraction.at(i)));
-          if (requiredHits==0)
-            probability=1;
-          else if (requiredHits>probabilities.size())
-            probability = 0;
-          else
-            probability = probabilities.at(requiredHits-1);
-          //if (probabilities.size()==10) { // debug
-          //  std::cerr << "required " << requiredHits
-          //              << " out of " << probabilities.size()
-          //              << " == " << nActive
-          //              << endl;
-          // std::cerr << "      PROBABILITY = " << probability << endl << endl;
-          //}
-          hadronGoodTracksFraction.at(i).SetPoint(hadronGoodTracksFraction.at(i).GetN(),
-                                                  eta,
-                                                  probability);
-        }
+    if (numThreads_ <= 1) {
+      for (int i_eta = first; i_eta < last; i_eta++) {
+        analyzeMaterialTrack(mb, pm, i_eta, i_eta * etaStep, phis[i_eta], nTracks);
+        progress.advance();
       }
+    } else {
+      records.assign(last - first, MaterialTrackRecord());
+      parallelFor("Material tracks", first, last, [&](int i_eta) {
+        timePathScope("Analyzer material track");
+        currentMaterialTrackRecord = &records[i_eta - first];
+        analyzeMaterialTrack(mb, pm, i_eta, i_eta * etaStep, phis[i_eta], nTracks);
+        currentMaterialTrackRecord = NULL;
+        progress.advance();
+      });
+      for (auto& record : records) replayMaterialTrackRecord(record, nTracks);
+    }
+    if (trackRecords_) trackRecords_->push(materialRecords_);
+    chunks.done(last - first);
+    if (!materialCheckpointFile_.empty() && last < lastTrack &&
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - lastCheckpoint).count() >= materialCheckpointSeconds_) {
+      writeMaterialCheckpoint(firstTrack, lastTrack, last);
+      lastCheckpoint = std::chrono::steady_clock::now();
     }
   }
+  // the finished scan is checkpointed too, for a run interrupted afterwards not to shoot its tracks again
+  if (!materialCheckpointFile_.empty() && nextTrack < lastTrack) writeMaterialCheckpoint(firstTrack, lastTrack, lastTrack);
+  logDEBUG(chunks.summary("Material tracks"));
 
 #ifdef MATERIAL_SHADOW       
   // integration over eta
@@ -735,6 +880,752 @@ void Analyzer::analyzeMaterialBudget(MaterialBudget& mb, const std::vector<doubl
   transformEtaToZ();
 #endif // MATERIAL_SHADOW
 
+  return true;
+}
+
+/**
+ * Fills the material budget scan from its checkpoint, if there is one, as written by <i>writeMaterialCheckpoint()</i>:
+ * the scan then goes on from the first track after the checkpoint, and ends as if it had not been interrupted.
+ * @param firstTrack The first track of the slice of the scan
+ * @param lastTrack The track after the last one of the slice of the scan
+ * @param nextTrack Set to the first track still to analyse; left as it is without a checkpoint
+ * @return False if the checkpoint could not be read or is for another scan
+ */
+bool Analyzer::readMaterialCheckpoint(int firstTrack, int lastTrack, int& nextTrack) {
+  if (!std::ifstream(materialCheckpointFile_.c_str())) {
+    logINFO("There is no checkpoint " + materialCheckpointFile_ + " to resume the material budget scan from: starting from its first track");
+    return true;
+  }
+  TDirectory* currentDirectory = gDirectory;
+  std::unique_ptr<TFile> file(TFile::Open(materialCheckpointFile_.c_str(), "READ"));
+  bool resumed = file && !file->IsZombie();
+  if (!resumed) logERROR("Could not open the checkpoint " + materialCheckpointFile_ + " of the material budget scan");
+  if (resumed) {
+    TNamed* key = dynamic_cast<TNamed*>(file->Get("key"));
+    TNamed* tracks = dynamic_cast<TNamed*>(file->Get("tracks"));
+    TNamed* next = dynamic_cast<TNamed*>(file->Get("next"));
+    TDirectory* scan = file->GetDirectory("scan");
+    int checkpointTrack = next ? str2any<int>(next->GetTitle()) : -1;
+    if (!key || key->GetTitle() != materialCheckpointKey_ || !tracks || tracks->GetTitle() != any2str(firstTrack) + ":" + any2str(lastTrack)) {
+      logERROR("The checkpoint " + materialCheckpointFile_ + " is not for this material budget scan");
+      resumed = false;
+    } else if (!scan || checkpointTrack < firstTrack || checkpointTrack > lastTrack) {
+      logERROR("The checkpoint " + materialCheckpointFile_ + " of the material budget scan is corrupted");
+      resumed = false;
+    } else if ((resumed = materialScan_.merge(*scan))) {
+      nextTrack = checkpointTrack;
+      logINFO("Resuming the material budget scan from its checkpoint, at track " + any2str(nextTrack - firstTrack) + " of " + any2str(lastTrack - firstTrack));
+    }
+    file->Close();
+  }
+  if (currentDirectory) currentDirectory->cd();
+  return resumed;
+}
+
+/**
+ * Writes what the material budget scan accumulated over its tracks so far, with what identifies the scan and the first
+ * track still to analyse, to its checkpoint file. The file is replaced at once, so that a run killed meanwhile leaves
+ * the previous checkpoint.
+ * @param firstTrack The first track of the slice of the scan
+ * @param lastTrack The track after the last one of the slice of the scan
+ * @param nextTrack The first track not analysed yet
+ * @return True if the checkpoint could be written
+ */
+bool Analyzer::writeMaterialCheckpoint(int firstTrack, int lastTrack, int nextTrack) {
+  std::string partFileName = materialCheckpointFile_ + ".part";
+  TDirectory* currentDirectory = gDirectory;
+  bool written;
+  {
+    TFile file(partFileName.c_str(), "RECREATE");
+    written = !file.IsZombie();
+    if (written) {
+      TNamed("key", materialCheckpointKey_.c_str()).Write();
+      TNamed("tracks", (any2str(firstTrack) + ":" + any2str(lastTrack)).c_str()).Write();
+      TNamed("next", any2str(nextTrack).c_str()).Write();
+      materialScan_.write(*file.mkdir("scan"));
+      file.Write();
+      written = file.IsOpen() && !file.TestBit(TFile::kWriteError);
+      file.Close();
+    }
+  }
+  if (currentDirectory) currentDirectory->cd();
+  if (written) written = std::rename(partFileName.c_str(), materialCheckpointFile_.c_str()) == 0;
+  if (!written) logWARNING("Could not write the checkpoint " + materialCheckpointFile_ + " of the material budget scan");
+  return written;
+}
+
+/**
+ * Resets the histograms, maps and graphs of the material budget scan, bins them for a number of tracks and lists them
+ * as the accumulators of the scan
+ * @param etaSteps The number of tracks of the eta scan
+ * @param materialMaps Whether the (z, r) material maps and isolines are filled
+ */
+void Analyzer::prepareMaterialScan(int etaSteps, bool materialMaps) {
+  materialTracksUsed = etaSteps;
+  fillMaterialMaps_ = materialMaps;
+  clearMaterialBudgetHistograms();
+  clearCells();
+  // reset the number of bins and the histogram boundaries (0.0 to getEtaMaxMaterial()) for all histograms, recalculate the cell boundaries
+  setHistogramBinsBoundaries(etaSteps, 0.0, getEtaMaxMaterial());
+  setCellBoundaries(etaSteps, 0.0, outer_radius + volume_width, 0.0, getEtaMaxMaterial());
+  createServicesSupportsHistos(etaSteps);
+
+  // the calibrated maps are left out: they are computed from the others when requested
+  materialScan_.clear();
+  for (TH1* histo : std::initializer_list<TH1*>{
+         &ractivebarrel, &ractiveendcap, &rserfbarrel, &rserfendcap, &rlazybarrel, &rlazyendcap, &rlazytube, &rlazyuserdef,
+         &iactivebarrel, &iactiveendcap, &iserfbarrel, &iserfendcap, &ilazybarrel, &ilazyendcap, &ilazytube, &ilazyuserdef,
+         &rbarrelall, &rendcapall, &ractiveall, &rserfall, &rlazyall, &ibarrelall, &iendcapall, &iactiveall, &iserfall, &ilazyall,
+         &rextraservices, &rextrasupports, &iextraservices, &iextrasupports, &rglobal, &iglobal }) materialScan_.addHisto(*histo);
+  materialScan_.addMapTree("mapRadiation", mapRadiation);
+  materialScan_.addMapTree("mapInteraction", mapInteraction);
+  materialScan_.addGraph(hadronTotalHitsGraph);
+  materialScan_.addGraph(hadronAverageHitsGraph);
+  for (TGraph& graph : hadronGoodTracksFraction) materialScan_.addGraph(graph);
+  materialScan_.addHistoFamily("rComponent_", rComponents, etaSteps, 0.0, getEtaMaxMaterial());
+  materialScan_.addHistoFamily("iComponent_", iComponents, etaSteps, 0.0, getEtaMaxMaterial());
+}
+
+/**
+ * Writes what the material budget scan accumulated, so that the scans of the shards of the tracks can be merged
+ * @param dir The directory the histograms and graphs are written to, by name
+ */
+void Analyzer::writeMaterialScan(TDirectory& dir) {
+  materialScan_.write(dir);
+}
+
+/**
+ * Writes the coverage results of the last geometry scan, each object in place: the (phi, eta) hit map, the total
+ * and per module type eta profiles and the distribution of the fraction of the tracks hitting a module
+ * @param dir The directory the histograms are written to, by name
+ */
+void Analyzer::writeGeometryResults(TDirectory& dir) const {
+  dir.WriteTObject(&mapPhiEta);
+  dir.WriteTObject(&totalEtaProfile);
+  dir.WriteTObject(&totalEtaProfileSensors);
+  dir.WriteTObject(&totalEtaProfileStubs);
+  for (const TProfile& profile : typeEtaProfile) dir.WriteTObject(&profile);
+  for (const TProfile& profile : typeEtaProfileSensors) dir.WriteTObject(&profile);
+  for (const TProfile& profile : typeEtaProfileStubs) dir.WriteTObject(&profile);
+  dir.WriteTObject(&hitDistribution);
+}
+
+/**
+ * Writes what each track of the last geometry and material scans found, in track order, as the ntuples "geometry"
+ * (eta:hits:stubs) and "material" (eta:radiation:interaction), if the samples were recorded
+ * @param dir The directory the ntuples are written to
+ */
+void Analyzer::writeTrackSamples(TDirectory& dir) const {
+  TDirectory* currentDirectory = gDirectory;
+  dir.cd();
+  TNtupleD geometry("geometry", "Geometry tracks", "eta:hits:stubs");
+  for (const TrackSample& sample : geometrySamples_) geometry.Fill(sample.eta, sample.first, sample.second);
+  geometry.Write();
+  TNtupleD material("material", "Material tracks", "eta:radiation:interaction");
+  for (const TrackSample& sample : materialSamples_) material.Fill(sample.eta, sample.first, sample.second);
+  material.Write();
+  if (currentDirectory) currentDirectory->cd();
+}
+
+/**
+ * Fills the material budget histograms and graphs from the scans of the shards of the tracks, written by
+ * <i>writeMaterialScan()</i>, instead of shooting the tracks: the result is the scan of all the tracks.
+ * @param shards The directories of the shards, in shard order
+ * @param etaSteps The number of tracks of the whole eta scan
+ * @param materialMaps Whether the (z, r) material maps and isolines were filled
+ * @return True if every shard had all the histograms and graphs, with the same binning
+ */
+bool Analyzer::mergeMaterialBudget(const std::vector<TDirectory*>& shards, int etaSteps, bool materialMaps) {
+  prepareMaterialScan(etaSteps, materialMaps);
+  materialCrossings_.clear();
+  for (TDirectory* shard : shards) {
+    if (!materialScan_.merge(*shard)) return false;
+  }
+  return true;
+}
+
+/**
+ * Sends a single track through the material budget and sorts the radiation and interaction lengths it collects
+ * into the material histograms. When called from a worker thread of the material budget scan, the histogram and
+ * graph fills are kept aside in the thread's <i>MaterialTrackRecord</i> instead.
+ * @param mb A reference to the instance of <i>MaterialBudget</i> that is to be analysed
+ * @param pm A pointer to a second material budget associated to a pixel detector; may be <i>NULL</i>
+ * @param trackIndex The position of the track in the eta scan, which also seeds the hit efficiency dice
+ * @param eta The pseudorapidity of the track
+ * @param phi The track angle in the xy-plane
+ * @param nTracks The total number of tracks of the eta scan
+ */
+void Analyzer::analyzeMaterialTrack(MaterialBudget& mb, MaterialBudget* pm, int trackIndex, double eta, double phi, int nTracks) {
+  double efficiency = simParms().efficiency();
+  double pixelEfficiency = simParms().pixelEfficiency();
+  CounterRandom efficiencyDice(randomSeed_, CounterRandom::MaterialEfficiency, trackIndex);
+  double theta;
+  Material tmp;
+  Track track;
+  theta = 2 * atan(pow(E, -1 * eta)); // TODO: switch to exp() here
+  track.setTheta(theta);
+  track.setPhi(phi);
+  if (recordMaterialCrossings_) {
+    materialCrossings_[trackIndex].eta = eta;
+    currentMaterialCrossings = &materialCrossings_[trackIndex].crossings;
+  }
+  //      active volumes, barrel
+  std::map<std::string, Material> sumComponentsRI;
+  tmp = analyzeModules(mb.getBarrelModuleCaps(), eta, theta, phi, track, sumComponentsRI);
+  assignMaterialCrossings(MaterialCrossing::activeBarrel);
+  fillHisto(ractivebarrel, eta, tmp.radiation);
+  fillHisto(iactivebarrel, eta, tmp.interaction);
+  fillHisto(rbarrelall, eta, tmp.radiation);
+  fillHisto(ibarrelall, eta, tmp.interaction);
+  fillHisto(ractiveall, eta, tmp.radiation);
+  fillHisto(iactiveall, eta, tmp.interaction);
+  fillHisto(rglobal, eta, tmp.radiation);
+  fillHisto(iglobal, eta, tmp.interaction);
+
+  //      active volumes, endcap
+  tmp = analyzeModules(mb.getEndcapModuleCaps(), eta, theta, phi, track, sumComponentsRI);
+  assignMaterialCrossings(MaterialCrossing::activeEndcap);
+  fillHisto(ractiveendcap, eta, tmp.radiation);
+  fillHisto(iactiveendcap, eta, tmp.interaction);
+  fillHisto(rendcapall, eta, tmp.radiation);
+  fillHisto(iendcapall, eta, tmp.interaction);
+  fillHisto(ractiveall, eta, tmp.radiation);
+  fillHisto(iactiveall, eta, tmp.interaction);
+  fillHisto(rglobal, eta, tmp.radiation);
+  fillHisto(iglobal, eta, tmp.interaction);
+
+  fillComponentsRI(sumComponentsRI, eta, nTracks);
+
+  //      services, barrel
+  tmp = analyzeInactiveSurfaces(mb.getInactiveSurfaces().getBarrelServices(), eta, theta, track, MaterialProperties::no_cat);
+  assignMaterialCrossings(MaterialCrossing::servicesBarrel);
+  fillHisto(rserfbarrel, eta, tmp.radiation);
+  fillHisto(iserfbarrel, eta, tmp.interaction);
+  fillHisto(rbarrelall, eta, tmp.radiation);
+  fillHisto(ibarrelall, eta, tmp.interaction);
+  /*
+  if (eta<0.03) {
+    std::cout << "eta = " << eta << std::endl;
+    track.sort();
+    track.print();
+  }
+  */
+  fillHisto(rserfall, eta, tmp.radiation);
+  fillHisto(iserfall, eta, tmp.interaction);
+  fillHisto(rglobal, eta, tmp.radiation);
+  fillHisto(iglobal, eta, tmp.interaction);
+  fillHisto(*rComponents.at("Services"), eta, tmp.radiation);
+  fillHisto(*iComponents.at("Services"), eta, tmp.interaction);
+  //      services, endcap
+  tmp = analyzeInactiveSurfaces(mb.getInactiveSurfaces().getEndcapServices(), eta, theta, track, MaterialProperties::no_cat);
+  assignMaterialCrossings(MaterialCrossing::servicesEndcap);
+  fillHisto(rserfendcap, eta, tmp.radiation);
+  fillHisto(iserfendcap, eta, tmp.interaction);
+  fillHisto(rendcapall, eta, tmp.radiation);
+  fillHisto(iendcapall, eta, tmp.interaction);
+  fillHisto(rserfall, eta, tmp.radiation);
+  fillHisto(iserfall, eta, tmp.interaction);
+  fillHisto(rglobal, eta, tmp.radiation);
+  fillHisto(iglobal, eta, tmp.interaction);
+  fillHisto(*rComponents.at("Services"), eta, tmp.radiation);
+  fillHisto(*iComponents.at("Services"), eta, tmp.interaction);
+  //      supports, barrel
+  tmp = analyzeInactiveSurfaces(mb.getInactiveSurfaces().getSupports(), eta, theta, track, MaterialProperties::b_sup);
+  assignMaterialCrossings(MaterialCrossing::supportsBarrel);
+  fillHisto(rlazybarrel, eta, tmp.radiation);
+  fillHisto(ilazybarrel, eta, tmp.interaction);
+  fillHisto(rbarrelall, eta, tmp.radiation);
+  fillHisto(ibarrelall, eta, tmp.interaction);
+  fillHisto(rlazyall, eta, tmp.radiation);
+  fillHisto(ilazyall, eta, tmp.interaction);
+  fillHisto(rglobal, eta, tmp.radiation);
+  fillHisto(iglobal, eta, tmp.interaction);
+  fillHisto(*rComponents.at("Supports"), eta, tmp.radiation);
+  fillHisto(*iComponents.at("Supports"), eta, tmp.interaction);
+  //      supports, endcap
+  tmp = analyzeInactiveSurfaces(mb.getInactiveSurfaces().getSupports(), eta, theta, track, MaterialProperties::e_sup);
+  assignMaterialCrossings(MaterialCrossing::supportsEndcap);
+  fillHisto(rlazyendcap, eta, tmp.radiation);
+  fillHisto(ilazyendcap, eta, tmp.interaction);
+  fillHisto(rendcapall, eta, tmp.radiation);
+  fillHisto(iendcapall, eta, tmp.interaction);
+  fillHisto(rlazyall, eta, tmp.radiation);
+  fillHisto(ilazyall, eta, tmp.interaction);
+  fillHisto(rglobal, eta, tmp.radiation);
+  fillHisto(iglobal, eta, tmp.interaction);
+  fillHisto(*rComponents.at("Supports"), eta, tmp.radiation);
+  fillHisto(*iComponents.at("Supports"), eta, tmp.interaction);
+  //      supports, tubes
+  tmp = analyzeInactiveSurfaces(mb.getInactiveSurfaces().getSupports(), eta, theta, track, MaterialProperties::o_sup);
+  assignMaterialCrossings(MaterialCrossing::supportsTube);
+  fillHisto(rlazytube, eta, tmp.radiation);
+  fillHisto(ilazytube, eta, tmp.interaction);
+  fillHisto(rlazyall, eta, tmp.radiation);
+  fillHisto(ilazyall, eta, tmp.interaction);
+  fillHisto(rglobal, eta, tmp.radiation);
+  fillHisto(iglobal, eta, tmp.interaction);
+  fillHisto(*rComponents.at("Supports"), eta, tmp.radiation);
+  fillHisto(*iComponents.at("Supports"), eta, tmp.interaction);
+  //      supports, barrel tubes
+  tmp = analyzeInactiveSurfaces(mb.getInactiveSurfaces().getSupports(), eta, theta, track, MaterialProperties::t_sup);
+  assignMaterialCrossings(MaterialCrossing::supportsBarrelTube);
+  fillHisto(rlazybtube, eta, tmp.radiation);
+  fillHisto(ilazybtube, eta, tmp.interaction);
+  fillHisto(rlazyall, eta, tmp.radiation);
+  fillHisto(ilazyall, eta, tmp.interaction);
+  fillHisto(rglobal, eta, tmp.radiation);
+  fillHisto(iglobal, eta, tmp.interaction);
+  fillHisto(*rComponents.at("Supports"), eta, tmp.radiation);
+  fillHisto(*iComponents.at("Supports"), eta, tmp.interaction);
+  //      supports, user defined
+  tmp = analyzeInactiveSurfaces(mb.getInactiveSurfaces().getSupports(), eta, theta, track, MaterialProperties::u_sup);
+  assignMaterialCrossings(MaterialCrossing::supportsUserDefined);
+  fillHisto(rlazyuserdef, eta, tmp.radiation);
+  fillHisto(ilazyuserdef, eta, tmp.interaction);
+  fillHisto(rlazyall, eta, tmp.radiation);
+  fillHisto(ilazyall, eta, tmp.interaction);
+  fillHisto(rglobal, eta, tmp.radiation);
+  fillHisto(iglobal, eta, tmp.interaction);
+  fillHisto(*rComponents.at("Supports"), eta, tmp.radiation);
+  fillHisto(*iComponents.at("Supports"), eta, tmp.interaction);
+  //      pixels, if they exist
+  if (pm != NULL) {
+    std::map<std::string, Material> ignoredPixelSumComponentsRI;
+    analyzeModules(pm->getBarrelModuleCaps(), eta, theta, phi, track, ignoredPixelSumComponentsRI, true);
+    analyzeModules(pm->getEndcapModuleCaps(), eta, theta, phi, track, ignoredPixelSumComponentsRI, true);
+    analyzeInactiveSurfaces(pm->getInactiveSurfaces().getBarrelServices(), eta, theta, track, MaterialProperties::no_cat, true);
+    analyzeInactiveSurfaces(pm->getInactiveSurfaces().getEndcapServices(), eta, theta, track, MaterialProperties::no_cat, true);
+    analyzeInactiveSurfaces(pm->getInactiveSurfaces().getSupports(), eta, theta, track, MaterialProperties::no_cat, true);
+  }
+  currentMaterialCrossings = NULL;
+
+  // Add the hit on the beam pipe
+  Hit hit(23./sin(theta));
+  hit.setOrientation(Hit::Horizontal);
+  hit.setObjectKind(Hit::Inactive);
+  Material beamPipeMat;
+  beamPipeMat.radiation = 0.0023 / sin(theta);
+  beamPipeMat.interaction = 0.0019 / sin(theta);
+  hit.setCorrectedMaterial(beamPipeMat);
+  track.addHit(hit);
+  if (!materialTracks_.empty()) { // before the efficiency, which the other scans apply their own way
+    StopWatch::MemoryScope memoryScope(StopWatch::TrackMemory);
+    materialTracks_[trackIndex] = track;
+  }
+  TrackRecordWriter::Record* record = materialRecords_.empty() ? NULL : &materialRecords_[trackIndex - firstMaterialRecord_];
+  if (!materialSamples_.empty() || record) {
+    RILength trackMaterial = track.getCorrectedMaterial();
+    if (!materialSamples_.empty()) materialSamples_[trackIndex] = { eta, trackMaterial.radiation, trackMaterial.interaction };
+    if (record) {
+      record->eta = eta;
+      record->phi = phi;
+      record->z0 = 0;
+      record->radiation = trackMaterial.radiation;
+      record->interaction = trackMaterial.interaction;
+      record->hits = 0;
+    }
+  }
+  if (!track.noHits()) {
+    track.sort();
+    if (efficiency!=1 || pixelEfficiency!=1) {
+      Track::HitSelection selection = track.selectActive();
+      track.addEfficiency(selection, track.efficiencyMask(efficiency, pixelEfficiency, efficiencyDice));
+      track.keepSelected(selection);
+    }
+
+    // @@ Hadrons
+    int nActive = track.nActiveHits();
+    if (record) record->hits = nActive;
+    if (nActive>0) {
+      addGraphPoint(hadronTotalHitsGraph,
+                                    eta,
+                                    nActive);
+      double probability;
+      std::vector<double> probabilities = track.hadronActiveHitsProbability();
+
+      double averageHits=0;
+      //double averageSquaredHits=0;
+      double exactProb=0;
+      double moreThanProb = 0;
+      for (int i=probabilities.size()-1;
+           i>=0;
+           --i) {
+        //if (nActive==10) { // debug
+        //  std::cerr << "probabilities.at(" 
+        //  << i << ")=" << probabilities.at(i)
+        //  << endl;
+        //}
+        exactProb=probabilities.at(i)-moreThanProb;
+        averageHits+=(i+1)*exactProb;
+        //averageSquaredHits+=((i+1)*(i+1))*exactProb;
+        moreThanProb+=exactProb;
+      }
+      addGraphPoint(hadronAverageHitsGraph,
+                                      eta,
+                                      averageHits);
+      //hadronAverageHitsGraph.SetPointError(hadronAverageHitsGraph.GetN()-1,
+      //                       0,
+      //                       sqrt( averageSquaredHits - averageHits*averageHits) );
+
+      unsigned int requiredHits;
+      for (unsigned int i = 0;
+           i<hadronNeededHitsFraction.size();
+           ++i) {
+        requiredHits = int(ceil(double(nActive) * hadronNeededHitsFraction.at(i)));
+        if (requiredHits==0)
+          probability=1;
+        else if (requiredHits>probabilities.size())
+          probability = 0;
+        else
+          probability = probabilities.at(requiredHits-1);
+        //if (probabilities.size()==10) { // debug
+        //  std::cerr << "required " << requiredHits
+        //              << " out of " << probabilities.size()
+        //              << " == " << nActive
+        //              << endl;
+        // std::cerr << "      PROBABILITY = " << probability << endl << endl;
+        //}
+        addGraphPoint(hadronGoodTracksFraction.at(i),
+                                                eta,
+                                                probability);
+      }
+    }
+  }
+}
+
+/**
+ * Fills the per-component material histograms, creating the ones that do not exist yet.
+ * @param sumComponentsRI The radiation and interaction lengths collected by a track, by component
+ * @param eta The pseudorapidity of the track
+ * @param nTracks The total number of tracks of the eta scan, which is also the number of bins of the histograms
+ */
+void Analyzer::fillComponentsRI(const std::map<std::string, Material>& sumComponentsRI, double eta, int nTracks) {
+  if (currentMaterialTrackRecord) {
+    currentMaterialTrackRecord->sumComponentsRI = sumComponentsRI;
+    currentMaterialTrackRecord->eta = eta;
+    return;
+  }
+  for (std::map<std::string, Material>::const_iterator it = sumComponentsRI.begin(); it != sumComponentsRI.end(); ++it) {
+    if (rComponents[it->first]==NULL) { 
+      rComponents[it->first] = new TH1D();
+      rComponents[it->first]->SetBins(nTracks, 0.0, getEtaMaxMaterial()); 
+    }
+    rComponents[it->first]->Fill(eta, it->second.radiation);
+    if (iComponents[it->first]==NULL) {
+      iComponents[it->first] = new TH1D();
+      iComponents[it->first]->SetBins(nTracks, 0.0, getEtaMaxMaterial()); 
+    }
+    iComponents[it->first]->Fill(eta, it->second.interaction);
+  }
+}
+
+/**
+ * Creates the histograms of the services and supports components, which are filled by every track.
+ * @param nTracks The total number of tracks of the eta scan, which is also the number of bins of the histograms
+ */
+void Analyzer::createServicesSupportsHistos(int nTracks) {
+  if (rComponents["Services"]==NULL) { 
+    rComponents["Services"] = new TH1D();
+    rComponents["Services"]->SetBins(nTracks, 0.0, getEtaMaxMaterial()); 
+  }
+  if (iComponents["Services"]==NULL) { 
+    iComponents["Services"] = new TH1D();
+    iComponents["Services"]->SetBins(nTracks, 0.0, getEtaMaxMaterial()); 
+  }
+  if (rComponents["Supports"]==NULL) { 
+    rComponents["Supports"] = new TH1D();
+    rComponents["Supports"]->SetBins(nTracks, 0.0, getEtaMaxMaterial()); 
+  }
+  if (iComponents["Supports"]==NULL) { 
+    iComponents["Supports"] = new TH1D();
+    iComponents["Supports"]->SetBins(nTracks, 0.0, getEtaMaxMaterial()); 
+  }
+}
+
+/**
+ * Applies the fills kept aside by a worker thread for one track, in the order they were produced.
+ * @param record The fills of the track
+ * @param nTracks The total number of tracks of the eta scan
+ */
+void Analyzer::replayMaterialTrackRecord(const MaterialTrackRecord& record, int nTracks) {
+  timePathScope("Analyzer material histogram fills");
+  fillComponentsRI(record.sumComponentsRI, record.eta, nTracks);
+  for (const auto& f : record.fills1D) f.histo->Fill(f.x, f.w);
+  for (const auto& f : record.fills2D) {
+    if (f.weighted) f.histo->Fill(f.x, f.y, f.w);
+    else f.histo->Fill(f.x, f.y);
+  }
+  for (const auto& f : record.mapFills) f.map->fill(f.x, f.y, f.w);
+  for (const auto& c : record.cellFills) fillCell(c.r, c.eta, c.theta, c.mat);
+  for (const auto& p : record.graphPoints) p.graph->SetPoint(p.graph->GetN(), p.x, p.y);
+}
+
+/**
+ * Keeps an element crossed by the current material track, if the crossings are being recorded.
+ * @param element The element
+ * @param factor The factor its radiation and interaction lengths were scaled by, for the path of the track through it
+ * @param group The histograms its lengths went to; when unassigned, they are given by the next <i>assignMaterialCrossings()</i>
+ */
+void Analyzer::recordMaterialCrossing(MaterialProperties& element, double factor, MaterialCrossing::Group group) {
+  if (currentMaterialCrossings) currentMaterialCrossings->push_back({&element, factor, group});
+}
+
+/**
+ * Assigns the crossings of the current material track found since the last call to a group of histograms.
+ * @param group The histograms the lengths of these crossings went to
+ */
+void Analyzer::assignMaterialCrossings(MaterialCrossing::Group group) {
+  if (!currentMaterialCrossings) return;
+  for (auto it = currentMaterialCrossings->rbegin(); it != currentMaterialCrossings->rend() && it->group == MaterialCrossing::unassigned; ++it) {
+    it->group = group;
+  }
+}
+
+/**
+ * Lists the material histograms the lengths of a group of crossings are summed into by the material budget scan.
+ * @param group The group of crossings
+ * @param radiation True for the radiation length histograms, false for the interaction length ones
+ * @return The histograms
+ */
+std::vector<TH1*> Analyzer::materialGroupHistos(MaterialCrossing::Group group, bool radiation) {
+  TH1* services = radiation ? rComponents.at("Services") : iComponents.at("Services");
+  TH1* supports = radiation ? rComponents.at("Supports") : iComponents.at("Supports");
+  TH1& global = radiation ? rglobal : iglobal;
+  TH1& barrelAll = radiation ? rbarrelall : ibarrelall;
+  TH1& endcapAll = radiation ? rendcapall : iendcapall;
+  TH1& lazyAll = radiation ? rlazyall : ilazyall;
+  switch (group) {
+  case MaterialCrossing::activeBarrel: return { radiation ? &ractivebarrel : &iactivebarrel, &barrelAll, radiation ? &ractiveall : &iactiveall, &global };
+  case MaterialCrossing::activeEndcap: return { radiation ? &ractiveendcap : &iactiveendcap, &endcapAll, radiation ? &ractiveall : &iactiveall, &global };
+  case MaterialCrossing::servicesBarrel: return { radiation ? &rserfbarrel : &iserfbarrel, &barrelAll, radiation ? &rserfall : &iserfall, &global, services };
+  case MaterialCrossing::servicesEndcap: return { radiation ? &rserfendcap : &iserfendcap, &endcapAll, radiation ? &rserfall : &iserfall, &global, services };
+  case MaterialCrossing::supportsBarrel: return { radiation ? &rlazybarrel : &ilazybarrel, &barrelAll, &lazyAll, &global, supports };
+  case MaterialCrossing::supportsEndcap: return { radiation ? &rlazyendcap : &ilazyendcap, &endcapAll, &lazyAll, &global, supports };
+  case MaterialCrossing::supportsTube: return { radiation ? &rlazytube : &ilazytube, &lazyAll, &global, supports };
+  case MaterialCrossing::supportsBarrelTube: return { radiation ? &rlazybtube : &ilazybtube, &lazyAll, &global, supports };
+  case MaterialCrossing::supportsUserDefined: return { radiation ? &rlazyuserdef : &ilazyuserdef, &lazyAll, &global, supports };
+  case MaterialCrossing::extraServices: return { radiation ? &rextraservices : &iextraservices };
+  case MaterialCrossing::extraSupports: return { radiation ? &rextrasupports : &iextrasupports };
+  default: return {};
+  }
+}
+
+/**
+ * Updates the material histograms of the last material budget scan for other material lengths or component masses,
+ * without sending the tracks again. The scan must have recorded the elements crossed by each track, with the factors
+ * their lengths were scaled by: as the lengths of an element are linear in the inverse lengths of its materials, the
+ * new lengths of the crossed elements are computed in one batch, and the difference they make, weighted by the same
+ * factors, is added to the bins of the tracks. The lengths by module component, the (r, z) maps and the hits of the
+ * tracks keep the materials of the scan.
+ * @param materialLengths The radiation and interaction lengths replacing those of the material tab, by material
+ * @param componentScales The factors the masses of some components are scaled by, by the name their masses are summed under
+ * @return True if the histograms could be updated, false if the crossings were not recorded
+ */
+bool Analyzer::reweightMaterialBudget(const std::map<std::string, std::pair<double, double> >& materialLengths,
+                                      const std::map<std::string, double>& componentScales) {
+  if (materialCrossings_.empty()) {
+    logERROR("The material budget cannot be reweighted: the elements crossed by the material tracks were not recorded");
+    return false;
+  }
+  // the lengths of the crossed elements, before and after the changes
+  MaterialLengthBatch lengths;
+  std::unordered_set<MaterialProperties*> seen;
+  for (const auto& track : materialCrossings_) {
+    for (const auto& c : track.crossings) {
+      if (seen.insert(c.element).second) lengths.add(*c.element);
+    }
+  }
+  std::vector<RILength> before, after;
+  lengths.evaluate(before);
+  const material::MaterialTab& materialTab = material::MaterialTab::instance();
+  for (const auto& m : materialLengths) {
+    if (materialTab.count(m.first)) lengths.setLengths(m.first, m.second.first, m.second.second);
+    else logWARNING("Material '" + m.first + "' is not in the material tab, so no element is made of it: its lengths are ignored");
+  }
+  for (const auto& c : componentScales) lengths.setComponentScale(c.first, c.second);
+  lengths.evaluate(after);
+  std::unordered_map<MaterialProperties*, RILength> changes;
+  for (size_t i = 0; i < lengths.objects().size(); i++) {
+    if (after[i].radiation != before[i].radiation || after[i].interaction != before[i].interaction) {
+      RILength& change = changes[lengths.objects()[i]];
+      change.radiation = after[i].radiation - before[i].radiation;
+      change.interaction = after[i].interaction - before[i].interaction;
+    }
+  }
+  // the tracks crossing changed elements get the difference, group by group
+  for (const auto& track : materialCrossings_) {
+    std::map<MaterialCrossing::Group, RILength> groupChanges;
+    for (const auto& c : track.crossings) {
+      auto change = changes.find(c.element);
+      if (change == changes.end()) continue;
+      RILength& groupChange = groupChanges[c.group];
+      groupChange.radiation += change->second.radiation * c.factor;
+      groupChange.interaction += change->second.interaction * c.factor;
+    }
+    for (const auto& g : groupChanges) {
+      for (TH1* histo : materialGroupHistos(g.first, true)) {
+        int bin = histo->FindBin(track.eta);
+        histo->SetBinContent(bin, histo->GetBinContent(bin) + g.second.radiation);
+      }
+      for (TH1* histo : materialGroupHistos(g.first, false)) {
+        int bin = histo->FindBin(track.eta);
+        histo->SetBinContent(bin, histo->GetBinContent(bin) + g.second.interaction);
+      }
+    }
+  }
+  return true;
+}
+
+/**
+ * Computes upfront all the lazily cached geometry of the modules, so that they can be safely
+ * checked for hits by several threads at once.
+ * @param layers A reference to the <i>ModuleCap</i> vector of vectors of the modules
+ */
+/**
+ * The smallest rotation around the z axis which maps the modules of a material budget (and of the pixels, if any) onto
+ * modules of the same type at the same r and z: the material seen by a straight track from the origin repeats with this
+ * period in phi. The inactive surfaces are volumes of revolution, hence the modules are the only ones to look at.
+ * @return The period, 2 PI if the modules have no rotational symmetry
+ */
+double Analyzer::materialPhiPeriod(MaterialBudget& mb, MaterialBudget* pm) {
+  static const double tolerance = 1e-3; // mm and rad
+  // the modules on the z+ side, grouped by ring: same type, r and z
+  std::map<std::tuple<std::string, long, long>, std::vector<double> > rings;
+  auto addModules = [&](std::vector<ModuleCaps>& layers) {
+    for (auto& layer : layers) {
+      for (auto& cap : layer) {
+        Module& m = cap.getModule();
+        if (m.maxZ() <= 0) continue;
+        XYZVector center = m.center();
+        rings[std::make_tuple(m.moduleType(), lround(center.Rho()/tolerance), lround(center.Z()/tolerance))].push_back(center.Phi());
+      }
+    }
+  };
+  addModules(mb.getBarrelModuleCaps());
+  addModules(mb.getEndcapModuleCaps());
+  if (pm) {
+    addModules(pm->getBarrelModuleCaps());
+    addModules(pm->getEndcapModuleCaps());
+  }
+  if (rings.empty()) return 2*PI;
+
+  // a ring of n modules can only repeat n/k times, hence the candidate symmetries divide the gcd of the ring sizes
+  int common = 0;
+  for (auto& ring : rings) {
+    std::sort(ring.second.begin(), ring.second.end());
+    for (int n = ring.second.size(); n; ) { int r = common % n; common = n; n = r; } // gcd(common, n)
+  }
+  auto contains = [](const std::vector<double>& phis, double phi) {
+    phi = phi - 2*PI*floor((phi + PI)/(2*PI)); // into [-PI, PI)
+    auto it = std::lower_bound(phis.begin(), phis.end(), phi - tolerance);
+    if (it != phis.end() && *it < phi + tolerance) return true;
+    // across PI
+    return (phi < -PI + tolerance && phis.back() > phi + 2*PI - tolerance) || (phi > PI - tolerance && phis.front() < phi - 2*PI + tolerance);
+  };
+  for (int order = common; order > 1; order--) {
+    if (common % order) continue;
+    bool symmetric = true;
+    for (auto ring = rings.begin(); symmetric && ring != rings.end(); ++ring) {
+      for (double phi : ring->second) {
+        if (!contains(ring->second, phi + 2*PI/order)) { symmetric = false; break; }
+      }
+    }
+    if (symmetric) {
+      logINFO("Material tracks: the modules repeat " + any2str(order) + " times in phi, the tracks are shot within 2PI/" + any2str(order));
+      return 2*PI/order;
+    }
+  }
+  return 2*PI;
+}
+
+/**
+ * Whether the last material budget scan kept all its tracks for the other scans (see <i>shareMaterialTracks()</i>)
+ * @param nTracks The number of tracks the other scan would shoot, which has to be the same
+ */
+bool Analyzer::sharedMaterialTracks(int nTracks) const {
+  return shareMaterialTracks_ && materialTrackShards_ == 1 && (int)materialTracks_.size() == nTracks;
+}
+
+/* The module tables of the trackers of the material budgets, which the modules of the cached hits are indexed in */
+TrackHitCache::ModuleTables Analyzer::trackHitCacheModules(MaterialBudget& mb, MaterialBudget* pm) {
+  TrackHitCache::ModuleTables modules = { &mb.getTracker().modules() };
+  if (pm) modules.push_back(&pm->getTracker().modules());
+  return modules;
+}
+
+/**
+ * Whether the resolution scan would take its tracks from the track hit cache (see <i>trackHitCache()</i>), so that the
+ * material budget does not need to be scanned for it
+ * @param mb The material budget of the outer tracker
+ * @param pm The material budget of the pixel tracker, if any
+ * @param nTracks The number of tracks of the resolution scan, which the cache must hold
+ */
+bool Analyzer::trackHitCacheMatches(MaterialBudget& mb, MaterialBudget* pm, int nTracks) {
+  if (trackHitCacheFile_.empty() || !reuseTrackHitCache_) return false;
+  TrackHitCache cache;
+  return cache.open(trackHitCacheFile_, trackHitCacheKey_, trackHitCacheModules(mb, pm), true) && cache.numTracks() == nTracks;
+}
+
+void Analyzer::primeModuleCaches(std::vector<ModuleCaps>& layers) {
+  for (auto& layer : layers) {
+    for (auto& cap : layer) cap.getModule().primeCaches();
+  }
+}
+
+/**
+ * Get the number of geometry coverage tracks that hit a module in the last geometry analysis.
+ * @param m A pointer to the module
+ * @return The number of tracks with at least one hit in the module
+ */
+int Analyzer::moduleHits(const Module* m) const {
+  int index = m->moduleIndex();
+  return index >= 0 && index < (int)moduleHitCounts_.size() ? moduleHitCounts_[index] : 0;
+}
+
+/**
+ * The fluence sampled for a module by the irradiated power analysis of the current geometry, NULL if it was not sampled
+ */
+const ModuleFluence* Analyzer::moduleFluence(const DetectorModule* m) const {
+  if (moduleFluencesEpoch_ != ComputableEpoch::current) return NULL;
+  auto found = moduleFluences_.find(m);
+  return found == moduleFluences_.end() ? NULL : &found->second;
+}
+
+/**
+ * Runs a task for every index of a range, sharing the indices among the analysis threads of the task pool.
+ * The calls are made in index order when running on a single thread.
+ * @param stage The name the tasks are accounted under in the report of the task pool
+ * @param first The first index of the range
+ * @param last One past the last index of the range
+ * @param task The function to be called with each index
+ */
+void Analyzer::parallelFor(const std::string& stage, int first, int last, const std::function<void(int)>& task) {
+  TaskPool::instance()->run(stage, last - first, [&](int i) { task(first + i); }, numThreads_);
+}
+
+void Analyzer::fillHisto(TH1& histo, double x, double w) {
+  if (currentMaterialTrackRecord) currentMaterialTrackRecord->fills1D.push_back({&histo, x, w});
+  else histo.Fill(x, w);
+}
+
+void Analyzer::fillHisto(TH2& histo, double x, double y) {
+  if (currentMaterialTrackRecord) currentMaterialTrackRecord->fills2D.push_back({&histo, x, y, 1., false});
+  else histo.Fill(x, y);
+}
+
+void Analyzer::fillHisto(TH2& histo, double x, double y, double w) {
+  if (currentMaterialTrackRecord) currentMaterialTrackRecord->fills2D.push_back({&histo, x, y, w, true});
+  else histo.Fill(x, y, w);
+}
+
+void Analyzer::addGraphPoint(TGraph& graph, double x, double y) {
+  if (currentMaterialTrackRecord) currentMaterialTrackRecord->graphPoints.push_back({&graph, x, y});
+  else graph.SetPoint(graph.GetN(), x, y);
+}
+
+void Analyzer::fillMap(MaterialMapTree& map, double x, double y, double w) {
+  if (currentMaterialTrackRecord) currentMaterialTrackRecord->mapFills.push_back({&map, x, y, w});
+  else map.fill(x, y, w);
 }
 
 
@@ -748,10 +1639,76 @@ void Analyzer::analyzePower(Tracker& tracker) {
 
 
 void Analyzer::computeTriggerFrequency(Tracker& tracker) {
-  TriggerFrequencyVisitor v; 
+  TriggerFrequencyVisitor v(stubFrequencies_);
   simParms_->accept(v);
-  tracker.accept(v);
+  tracker.parallelAccept(v, numThreads_);
+  storeTriggerFrequency(v);
+}
+
+/**
+ * Computes the bandwidth distributions and the trigger frequencies in a single traversal of the tracker
+ * @param tracker The tracker they are computed for
+ */
+void Analyzer::computeBandwidthAndTriggerFrequency(Tracker& tracker) {
+  BandwidthVisitor bv(chanHitDistribution, bandwidthDistribution, bandwidthDistributionSparsified);
+  TriggerFrequencyVisitor tfv(stubFrequencies_);
+  CompositeVisitor v;
+  v.add(bv);
+  v.add(tfv);
+  v.preVisit();
+  simParms_->accept(v);
+  tracker.parallelAccept(v, numThreads_);
+  v.postVisit();
+  storeTriggerFrequency(tfv);
+}
+
+/**
+ * Computes the bandwidth and the trigger rates of the modules again for each variant of the readout of the module types,
+ * in turn, and sums each variant up in a row of the what-if summary. The stub frequencies are only integrated for the
+ * modules whose trigger parameters a variant changes, the others taking those of the previous visits from the cache;
+ * the bandwidth of the modules, a few products, is computed again for all of them. The irradiated power reads none of
+ * the properties a variant changes, so it is not computed again. The module types get their values back at the end.
+ * @param tracker The tracker they are computed for
+ * @param variants The variants of the module types
+ */
+void Analyzer::computeReadoutWhatIf(Tracker& tracker, const std::vector<ReadoutWhatIf::Variant>& variants) {
+  readoutWhatIfSummary_.clear();
+  readoutWhatIfSummary_.setHeader("Variant", "Readout");
+  readoutWhatIfSummary_.setPrecision(3);
+  readoutWhatIfSummary_.setCell(0, 1, std::string("Modules changed"));
+  readoutWhatIfSummary_.setCell(0, 2, std::string("Modules integrated again"));
+  readoutWhatIfSummary_.setCell(0, 3, std::string("Average bandwidth (Mbps)"));
+  readoutWhatIfSummary_.setCell(0, 4, std::string("Average sparsified bandwidth (Mbps)"));
+  readoutWhatIfSummary_.setCell(0, 5, std::string("Largest trigger data bandwidth (Gbps)"));
+
+  ReadoutWhatIf whatIf(tracker);
+  for (size_t i = 0; i < variants.size(); i++) {
+    int changed = whatIf.apply(variants[i]);
+    TH1D chanHits, bandwidth, sparsifiedBandwidth;
+    BandwidthVisitor bv(chanHits, bandwidth, sparsifiedBandwidth);
+    TriggerFrequencyVisitor tfv(stubFrequencies_);
+    CompositeVisitor v;
+    v.add(bv);
+    v.add(tfv);
+    v.preVisit();
+    simParms_->accept(v);
+    tracker.parallelAccept(v, numThreads_);
+    v.postVisit();
+
+    int row = i + 1;
+    readoutWhatIfSummary_.setCell(row, 0, variants[i].name);
+    readoutWhatIfSummary_.setCell(row, 1, changed);
+    readoutWhatIfSummary_.setCell(row, 2, tfv.evaluatedModules());
+    readoutWhatIfSummary_.setCell(row, 3, bv.averageBandwidth() / 1E6);
+    readoutWhatIfSummary_.setCell(row, 4, bv.averageSparsifiedBandwidth() / 1E6);
+    readoutWhatIfSummary_.setCell(row, 5, tfv.maxTriggerDataBandwidth());
+    logINFO("Readout what-if " + variants[i].name + ": " + any2str(changed) + " modules changed, the stub frequencies of "
+            + any2str(tfv.evaluatedModules()) + " modules integrated again");
+  }
+  whatIf.restore();
+}
 
+void Analyzer::storeTriggerFrequency(const TriggerFrequencyVisitor& v) {
   triggerFrequencyTrueSummaries_ = v.triggerFrequencyTrueSummaries;
   triggerFrequencyFakeSummaries_ = v.triggerFrequencyFakeSummaries;
   triggerFrequencyMisfilteredSummaries_ = v.triggerFrequencyMisfilteredSummaries;
@@ -789,14 +1746,74 @@ void Analyzer::computeTriggerProcessorsBandwidth(Tracker& tracker) {
 }
 
 
+/**
+ * The cache of the module fluences, emptied if the geometry or the irradiation maps were rebuilt since it was filled
+ * @return The cache of the module fluences
+ */
+ModuleFluenceCache& Analyzer::moduleFluences() {
+  if (moduleFluencesEpoch_ != ComputableEpoch::current) {
+    moduleFluences_.clear();
+    moduleFluencesEpoch_ = ComputableEpoch::current;
+  }
+  return moduleFluences_;
+}
+
 void Analyzer::computeIrradiatedPowerConsumption(Tracker& tracker) {
-  IrradiationPowerVisitor v;
+  IrradiationPowerVisitor v(moduleFluences());
   simParms_->accept(v);
-  tracker.accept(v);
+  tracker.acceptModules(v, numThreads_);
 
   irradiatedPowerConsumptionSummaries_ = v.irradiatedPowerConsumptionSummaries;
 }
 
+/**
+ * Computes the irradiated power summaries over a grid of operating points. The parameters which are not scanned keep
+ * the values of the <i>SimParms</i>; the fluences of the modules are sampled once, for all the points.
+ * @param tracker The tracker the power is computed for
+ * @param scan The values of each scanned parameter, keyed by "lumi", "temp" or "voltage"
+ */
+void Analyzer::computeIrradiatedPowerScan(Tracker& tracker, const std::map<std::string, std::vector<double> >& scan) {
+  std::vector<PowerOperatingPoint> points(1, PowerOperatingPoint{simParms_->timeIntegratedLumi(), simParms_->operatingTemp(), simParms_->chargeDepletionVoltage()});
+  const std::pair<std::string, double PowerOperatingPoint::*> axes[] = { {"lumi", &PowerOperatingPoint::timeIntegratedLumi},
+                                                                        {"temp", &PowerOperatingPoint::operatingTemp},
+                                                                        {"voltage", &PowerOperatingPoint::chargeDepletionVoltage} };
+  for (const auto& axis : axes) {
+    auto values = scan.find(axis.first);
+    if (values == scan.end()) continue;
+    std::vector<PowerOperatingPoint> expanded;
+    for (const auto& point : points) {
+      for (double value : values->second) {
+        expanded.push_back(point);
+        expanded.back().*(axis.second) = value;
+      }
+    }
+    points.swap(expanded);
+  }
+
+  irradiatedPowerScanSummaries_.clear();
+  for (const auto& point : points) {
+    IrradiationPowerVisitor v(moduleFluences(), &point);
+    simParms_->accept(v);
+    tracker.acceptModules(v, numThreads_);
+    irradiatedPowerScanSummaries_.push_back(std::make_pair(point, v.irradiatedPowerConsumptionSummaries));
+  }
+}
+
+/**
+ * Computes the bandwidth, stub rate and trigger data bandwidth summaries for several pile-ups, in one visit of the modules
+ * @param tracker The tracker they are computed for
+ * @param pileups The numbers of minimum bias events per bunch crossing, in place of the one of the <i>SimParms</i>
+ */
+void Analyzer::computePileupScan(Tracker& tracker, const std::vector<double>& pileups) {
+  PileupScanVisitor v(pileups);
+  v.preVisit();
+  simParms_->accept(v);
+  tracker.acceptModules(v, numThreads_);
+  v.postVisit();
+  pileupScanPoints_ = v.points;
+  pileupScanBandwidthSummary_ = v.bandwidthSummary;
+}
+
 
 
 
@@ -804,113 +1821,91 @@ void Analyzer::computeIrradiatedPowerConsumption(Tracker& tracker) {
 /**
  * Looping on the layers, and picking only modules on the YZ section
  * For all these modules prepare a different table with materials
+ * The layers are gone through concurrently, each into lists of its own: the material tags of its modules on the YZ
+ * section and, by material, the tags and masses of all its modules. The first module of each table cell then gets a
+ * row of its local and exiting masses, indexed by material, and the tables are only written from these rows at the end.
  * @param tracker a reference to the <i>ModuleCap</i> vector of vectors that sits on top of the tracker modules
  * @param result a map of summary tables to be filled
  */
-void Analyzer::computeDetailedWeights(std::vector<std::vector<ModuleCap> >& tracker,std::map<std::string, SummaryTable>& result,
+void Analyzer::computeDetailedWeights(std::vector<ModuleCaps>& tracker,std::map<std::string, SummaryTable>& result,
                                       bool byMaterial) {
-  map<std::string, map<std::pair<int, int>, bool> > typeTaken;
-  map<std::string, map<std::pair<int, int>, bool> > typeWritten;
-
-  string tempString;
-  ostringstream tempSS;
-
-  std::vector<std::vector<ModuleCap> >::iterator layerIt;
-  //std::vector<std::vector<ModuleCap> >::iterator layerGuard;
-  std::vector<ModuleCap>::iterator moduleIt;
-  //std::vector<ModuleCap>::iterator moduleGuard;
-
-  ModuleCap* myModuleCap;
-  Module* myModule;
-
-  //  unsigned int nLocalMasses;
-  //  unsigned int nExitingMasses;
-
-  std::map<std::string, double>::const_iterator localmassesBegin;
-  std::map<std::string, double>::const_iterator localmassesEnd;
-
-  std::map<std::string, double>::const_iterator exitingmassesBegin;
-  std::map<std::string, double>::const_iterator exitingmassesEnd;
-
-  // First create a list of material used anywhere
-  std::vector<std::string> materialTagV;
-  std::vector<std::string>::iterator materialTagIt;
-
-  double localMaterial;
-  double exitingMaterial;
-  string materialTag;
-
-  // loop over layers
-  for (layerIt = tracker.begin(); layerIt != tracker.end(); ++layerIt) {
-    // Loop over modules
-    for (moduleIt = layerIt->begin(); moduleIt != layerIt->end(); ++moduleIt) {
-      // Check if the module is on the YZ section
-      myModuleCap = &(*moduleIt);
-      myModule = &(myModuleCap->getModule());
-      if (myModule->posRef().phi==1) {
-        pair<int, int> myIndex = make_pair(myModule->tableRef().row, myModule->tableRef().col);
-        tempString = myModule->cntName();
-        if (!typeTaken[tempString][myIndex]) {
-          typeTaken[tempString][myIndex]=true;
-          // TODO: put this in a better place
-          // (and make a better module typing)
-          struct Visitor : public ConstGeometryVisitor {
-            std::map<string, SummaryTable>& result;
-
-            Visitor(std::map<std::string, SummaryTable>& result_) : result(result_) {}
-            void visit(const BarrelModule& m) {
-              string s = m.cntName() + " (L" + any2str(m.layer()) + ")";
-              result[s].setCell(0, m.ring(), TagMaker::makePosTag(m));
-            }
-            void visit(const EndcapModule& m) {
-              string s = m.cntName() + " (D" + any2str(m.disk()) + ")";
-              result[s].setCell(0, m.ring(), TagMaker::makePosTag(m));
-            }
-          };
-          Visitor v(result);
-          myModule->accept(v);
-        }
-        if (byMaterial) { // sort by Material tag
-          //nLocalMasses = myModuleCap->localMassCount();
-          //nExitingMasses = myModuleCap->exitingMassCount();
-          localmassesBegin = myModuleCap->getLocalMasses().begin();
-          localmassesEnd = myModuleCap->getLocalMasses().end();
-          exitingmassesBegin = myModuleCap->getExitingMasses().begin();
-          exitingmassesEnd = myModuleCap->getExitingMasses().end();
-        } else { // sort by Component tag
-          //nLocalMasses = myModuleCap->localMassCompCount();
-          //nExitingMasses = myModuleCap->exitingMassCompCount();
-          localmassesBegin = myModuleCap->getLocalMassesComp().begin();
-          localmassesEnd = myModuleCap->getLocalMassesComp().end();
-          exitingmassesBegin = myModuleCap->getExitingMassesComp().begin();
-          exitingmassesEnd = myModuleCap->getExitingMassesComp().end();
-        }
-        for (std::map<std::string, double>::const_iterator it = localmassesBegin; it != localmassesEnd; ++it) {
-          // if (byMaterial) materialTag = myModuleCap->getLocalTag(iLocalMasses); // sort by Material tag
-          //  else materialTag = myModuleCap->getLocalTagComp(iLocalMasses);           // sort by Component tag
-          materialTag = it->first;
-          materialTagIt = find(materialTagV.begin(), materialTagV.end(), materialTag);
-          if (materialTagIt==materialTagV.end()) {
-            materialTagV.push_back(materialTag);
-          }
-        }
-        for (std::map<std::string, double>::const_iterator it = exitingmassesBegin; it != exitingmassesEnd; ++it) {
-          //  if (byMaterial) materialTag = myModuleCap->getExitingTag(iExitingMasses); // sort by Material tag
-          //  else materialTag = myModuleCap->getExitingTagComp(iExitingMasses);           // sort by Component tag
-          materialTag = it->first;
-          materialTagIt = find(materialTagV.begin(), materialTagV.end(), materialTag);
-          if (materialTagIt==materialTagV.end()) {
-            materialTagV.push_back(materialTag);
-          }
-        }
+  struct ModuleWeight { std::string posTag, sensorGeoTag; double localMass, exitingMass; };
+  struct LayerWeights {
+    std::set<std::string> materialTags; // of the modules on the YZ section
+    std::vector<ModuleWeight> moduleWeights; // of all the modules, in module order, when sorting by material
+  };
+  std::vector<LayerWeights> layerWeights(tracker.size());
+  parallelFor("Weight summary layers", 0, tracker.size(), [&](int i) {
+    LayerWeights& weights = layerWeights[i];
+    if (byMaterial) weights.moduleWeights.reserve(tracker[i].size());
+    for (ModuleCap& cap : tracker[i]) {
+      Module& module = cap.getModule();
+      if (byMaterial) {
+        TagMaker tmak(module);
+        weights.moduleWeights.push_back(ModuleWeight{tmak.posTag, tmak.sensorGeoTag, cap.getLocalMass(), cap.getExitingMass()});
+      }
+      if (module.posRef().phi == 1) {
+        for (const auto& mass : byMaterial ? cap.getLocalMasses() : cap.getLocalMassesComp()) weights.materialTags.insert(mass.first);
+        for (const auto& mass : byMaterial ? cap.getExitingMasses() : cap.getExitingMassesComp()) weights.materialTags.insert(mass.first);
       }
     }
+  });
+
+  // The weights are summed in module order, as they would be in a single pass
+  std::set<std::string> materialTagSet;
+  for (const LayerWeights& weights : layerWeights) {
+    materialTagSet.insert(weights.materialTags.begin(), weights.materialTags.end());
+    for (const ModuleWeight& w : weights.moduleWeights) {
+      typeWeight[w.posTag] += w.localMass;
+      typeWeight[w.posTag] += w.exitingMass;
+      tagWeight[w.sensorGeoTag] += w.localMass;
+      tagWeight[w.sensorGeoTag] += w.exitingMass;
+    }
+  }
+  // Alphabetically sorted materials, and their column index
+  std::vector<std::string> materialTagV(materialTagSet.begin(), materialTagSet.end());
+  std::map<std::string, int> materialIds;
+  for (size_t m = 0; m < materialTagV.size(); m++) materialIds[materialTagV[m]] = m;
+  size_t numMaterials = materialTagV.size();
+
+  // The first module on the YZ section of each table cell, with its masses by material
+  std::unordered_set<ModuleKey> typeTaken;
+  std::vector<ModuleCap*> shownCaps;
+  for (auto& layer : tracker) {
+    for (ModuleCap& cap : layer) {
+      Module& module = cap.getModule();
+      if (module.posRef().phi == 1 && typeTaken.insert(module.moduleKey().cellKey()).second) {
+        shownCaps.push_back(&cap);
+      }
+    }
+  }
+  std::vector<double> localMasses(shownCaps.size() * numMaterials, 0.), exitingMasses(shownCaps.size() * numMaterials, 0.);
+  for (size_t c = 0; c < shownCaps.size(); c++) {
+    ModuleCap& cap = *shownCaps[c];
+    for (const auto& mass : byMaterial ? cap.getLocalMasses() : cap.getLocalMassesComp()) localMasses[c * numMaterials + materialIds[mass.first]] = mass.second;
+    for (const auto& mass : byMaterial ? cap.getExitingMasses() : cap.getExitingMassesComp()) exitingMasses[c * numMaterials + materialIds[mass.first]] = mass.second;
   }
 
-  // Alphabetically sort materials
-  std::sort(materialTagV.begin(), materialTagV.end());
-
-  // Prepare the columns of the tables
+  // Now write the tables: their first row (the position of the modules), their first column (the materials), then the masses
+  for (ModuleCap* cap : shownCaps) {
+    // TODO: put this in a better place
+    // (and make a better module typing)
+    struct Visitor : public ConstGeometryVisitor {
+      std::map<string, SummaryTable>& result;
+
+      Visitor(std::map<std::string, SummaryTable>& result_) : result(result_) {}
+      void visit(const BarrelModule& m) {
+        string s = m.cntName() + " (L" + any2str(m.layer()) + ")";
+        result[s].setCell(0, m.ring(), TagMaker::makePosTag(m));
+      }
+      void visit(const EndcapModule& m) {
+        string s = m.cntName() + " (D" + any2str(m.disk()) + ")";
+        result[s].setCell(0, m.ring(), TagMaker::makePosTag(m));
+      }
+    };
+    Visitor v(result);
+    cap->getModule().accept(v);
+  }
   for (map<string, SummaryTable>::iterator it=result.begin();
        it!=result.end(); ++it) {
     for (unsigned int materialTag_i=0; materialTag_i<materialTagV.size(); ++materialTag_i) {
@@ -918,89 +1913,37 @@ void Analyzer::computeDetailedWeights(std::vector<std::vector<ModuleCap> >& trac
     }
     it->second.setCell(materialTagV.size()+1, 0, "Total");
   }
-
-  // Now fill the table
-  // loop over layers
-  for (layerIt = tracker.begin(); layerIt != tracker.end(); ++layerIt) { 
-    // Loop over modules
-    for (moduleIt = layerIt->begin(); moduleIt != layerIt->end(); ++moduleIt) { 
-      // Check if the module is on the YZ section
-      myModuleCap = &(*moduleIt);
-      myModule = &(myModuleCap->getModule());
-      TagMaker tmak(*myModule);
-
-      if (byMaterial) {
-        typeWeight[tmak.posTag]+=myModuleCap->getLocalMass();
-        typeWeight[tmak.posTag]+=myModuleCap->getExitingMass();
-        tagWeight[tmak.sensorGeoTag]+=myModuleCap->getLocalMass();
-        tagWeight[tmak.sensorGeoTag]+=myModuleCap->getExitingMass();
-      }
-      if (myModule->posRef().phi == 1) {
-        // If we did not write this module type yet
-        pair<int, int> myIndex = make_pair(myModule->tableRef().row/*+myModule->getDisk()*/, myModule->tableRef().col);
-        tempString = myModule->cntName();
-        if (!typeWritten[tempString][myIndex]) {
-          typeWritten[tempString][myIndex]=true;
-          if (tempString!="") {
-            // TODO: put this in a better place
-            // (and make a better module typing)
-            tempSS.str("");
-            if (myModule->subdet() == BARREL) {
-              tempSS << ((BarrelModule*)myModule)->layer();
-              tempString+=" (L"+tempSS.str()+")";
-            } else if (myModule->subdet() == ENDCAP) {
-              tempSS << ((EndcapModule*)myModule)->disk(); //getDisk();
-              tempString+=" (D"+tempSS.str()+")";
-            } else {
-              cerr << "ERROR in Analyzer::detailedWeights(): "
-                  << "I found a module which is neither endcap nor barrel!" << std::endl;
-            }
-            //      cout << "Here's a module: id = " << myModule->getId()
-            //           << ", tag = " << myModule->getTag()
-            //           << ", type = " << myModule->getType()
-            //           << ", ring = " << myModule->getRing()
-            //           << endl;
-            // std::cout << "Material\tLocal\texiting\n";
-
-            // Then we fill in the proper column
-            // Prepare the columns of the table
-            for (unsigned int materialTag_i=0; materialTag_i<materialTagV.size(); ++materialTag_i) {
-              materialTag = materialTagV[materialTag_i];
-              if (byMaterial) { // table by materials
-                try { localMaterial = myModuleCap->getLocalMass(materialTag); }
-                catch (exception e) { localMaterial = 0; }
-                try { exitingMaterial = myModuleCap->getExitingMass(materialTag); }
-                catch (exception e) { exitingMaterial = 0; }
-              } else { // table by components
-                try { localMaterial = myModuleCap->getLocalMassComp(materialTag); }
-                catch (exception e) { localMaterial = 0; }
-                try { exitingMaterial = myModuleCap->getExitingMassComp(materialTag); }
-                catch (exception e) { exitingMaterial = 0; }
-              }
-              //cout << materialTag << "\t"
-              //<< localMaterial << "\t"
-              //<< exitingMaterial << "\t" << endl;
-              tempSS.str("");
-              // TODO: move this to Vizard
-              tempSS << std::dec << std::fixed << std::setprecision(1) << localMaterial << "+"
-                << std::dec << std::fixed << std::setprecision(1) << exitingMaterial << "="
-                << std::dec << std::fixed << std::setprecision(1) << localMaterial+exitingMaterial;
-              result[tempString].setCell(materialTag_i+1, myModule->tableRef().col, tempSS.str());
-            }
-            localMaterial = myModuleCap->getLocalMass();
-            exitingMaterial = myModuleCap->getExitingMass();
-            tempSS.str("");
-            tempSS << std::dec << std::fixed << std::setprecision(1) << localMaterial << "+"
-              << std::dec << std::fixed << std::setprecision(1) << exitingMaterial << "="
-              << std::dec << std::fixed << std::setprecision(1) << localMaterial+exitingMaterial;
-            result[tempString].setCell(materialTagV.size()+1, myModule->tableRef().col, tempSS.str());
-          } else {
-            cerr << "ERROR in Analyzer::detailedWeights(): "
-                << "I found a module with no reference to the container name." << endl;
-          }
-        }
-      }
+  // TODO: move this to Vizard
+  auto massCell = [](double localMaterial, double exitingMaterial) {
+    std::ostringstream tempSS;
+    tempSS << std::dec << std::fixed << std::setprecision(1) << localMaterial << "+"
+      << std::dec << std::fixed << std::setprecision(1) << exitingMaterial << "="
+      << std::dec << std::fixed << std::setprecision(1) << localMaterial+exitingMaterial;
+    return tempSS.str();
+  };
+  for (size_t c = 0; c < shownCaps.size(); c++) {
+    ModuleCap& cap = *shownCaps[c];
+    Module* myModule = &cap.getModule();
+    std::string tempString = myModule->cntName();
+    if (tempString=="") {
+      cerr << "ERROR in Analyzer::detailedWeights(): "
+          << "I found a module with no reference to the container name." << endl;
+      continue;
+    }
+    if (myModule->subdet() == BARREL) {
+      tempString+=" (L"+any2str(((BarrelModule*)myModule)->layer())+")";
+    } else if (myModule->subdet() == ENDCAP) {
+      tempString+=" (D"+any2str(((EndcapModule*)myModule)->disk())+")";
+    } else {
+      cerr << "ERROR in Analyzer::detailedWeights(): "
+          << "I found a module which is neither endcap nor barrel!" << std::endl;
     }
+    SummaryTable& table = result[tempString];
+    int col = myModule->tableRef().col;
+    for (size_t m = 0; m < numMaterials; m++) {
+      table.setCell(m+1, col, massCell(localMasses[c * numMaterials + m], exitingMasses[c * numMaterials + m]));
+    }
+    table.setCell(numMaterials+1, col, massCell(cap.getLocalMass(), cap.getExitingMass()));
   }
 }
 
@@ -1022,9 +1965,172 @@ void Analyzer::computeWeightSummary(MaterialBudget& mb) {
   endcapComponentWeights.clear();
   computeDetailedWeights(mb.getEndcapModuleCaps(), endcapComponentWeights, false);
 
-  MaterialBillAnalyzer v;
-  v.inspectTracker(mb);
-  billOfMaterials_ = v.outputTable;
+  billOfMaterials_ = std::make_shared<MaterialBillAnalyzer>();
+  billOfMaterials_->inspectTracker(mb);
+}
+
+/**
+ * Write the bill of materials of the last material budget whose weights were summed up, if any
+ * @param output The stream the table is written to
+ */
+void Analyzer::writeBillOfMaterials(std::ostream& output) const {
+  if (billOfMaterials_) billOfMaterials_->write(output);
+}
+
+// public
+/**
+ * Builds the (eta, phi) lookup of the modules for every layer of the given material budgets, so that the material
+ * tracks are only checked against the modules they could actually cross. Layers which cannot be indexed are
+ * left out and keep being scanned module by module.
+ * @param mb A reference to the material budget of the tracker
+ * @param pm A pointer to a second material budget associated to a pixel detector; may be <i>NULL</i>
+ */
+void Analyzer::buildModuleHitIndex(MaterialBudget& mb, MaterialBudget* pm) {
+  // a new lookup, for the analyzers still sharing the former one to keep it
+  moduleHitLookup_ = std::make_shared<ModuleHitLookup>();
+  std::vector<std::vector<ModuleCaps>*> collections = { &mb.getBarrelModuleCaps(), &mb.getEndcapModuleCaps() };
+  if (pm) {
+    collections.push_back(&pm->getBarrelModuleCaps());
+    collections.push_back(&pm->getEndcapModuleCaps());
+  }
+  for (auto collection : collections) {
+    for (auto& layer : *collection) {
+      ModuleHitIndex index;
+      if (index.build(layer)) moduleHitLookup_->indices[&layer] = index;
+      // the tracks only go towards positive z: the modules on the other side are left out
+      LayerHitPolys& layerPolys = moduleHitLookup_->layerPolys[&layer];
+      layerPolys.polys.useSinglePrecision(singlePrecisionHits_);
+      for (auto& cap : layer) {
+        Module& m = cap.getModule();
+        if (m.maxZ() <= 0) {
+          layerPolys.firstPoly.push_back(-1);
+          continue;
+        }
+        layerPolys.firstPoly.push_back(layerPolys.polys.add(m.innerSensor().hitPoly(), m.innerSensor().stripLength()));
+        if (m.numSensors() > 1) layerPolys.polys.add(m.outerSensor().hitPoly(), m.outerSensor().stripLength());
+      }
+    }
+  }
+  moduleHitReplicas_.replicate(*moduleHitLookup_);
+}
+
+// protected
+/**
+ * Copies the module and inactive element lookups to each NUMA node, once they are built or changed; nothing is copied
+ * when the threads are not pinned to the nodes.
+ */
+void Analyzer::replicateHitIndices() {
+  if (moduleHitLookup_) moduleHitReplicas_.replicate(*moduleHitLookup_);
+  if (inactiveHitIndices_) inactiveHitReplicas_.replicate(*inactiveHitIndices_);
+}
+
+// protected
+/**
+ * Finds the modules of a layer that have to be checked for a hit by a track leaving the origin.
+ * @param layer A reference to the <i>ModuleCap</i> vector of the layer
+ * @param direction The direction of the track
+ * @return A pointer to the ordered indices of the candidate modules, or <i>NULL</i> if the whole layer has to be scanned
+ */
+const std::vector<int>* Analyzer::moduleHitCandidates(const ModuleCaps& layer, const XYZVector& direction) const {
+  if (!useModuleHitIndex_ || !moduleHitLookup_) return NULL;
+  const ModuleHitLookup& lookup = moduleHitReplicas_.local(*moduleHitLookup_);
+  ModuleHitIndexMap::const_iterator it = lookup.indices.find(&layer);
+  if (it == lookup.indices.end()) return NULL;
+  return &(it->second.candidates(direction));
+}
+
+// protected
+/**
+ * Finds the modules of a layer hit by a track leaving the origin towards positive z. The sensors of all the candidate
+ * modules are tested at once against the track, from the structure-of-arrays copy of the layer, with the arithmetic of
+ * <i>DetectorModule::checkTrackHits()</i>; the brute-force scan tests the modules one by one, as the reference.
+ * @param layer A reference to the <i>ModuleCap</i> vector of the layer
+ * @param direction The direction of the track
+ * @param hits Set to the modules hit, in the order of the candidates, with the global coordinates and the type of their hit
+ */
+void Analyzer::findLayerModuleHits(ModuleCaps& layer, const XYZVector& direction,
+                                   std::vector<std::pair<ModuleCap*, std::pair<XYZVector, HitType> > >& hits) const {
+  // the buffers of the tests of a thread, kept from a track to the next
+  static thread_local std::vector<int> modules, polys;
+  static thread_local std::vector<std::pair<XYZVector, int> > segments;
+  const XYZVector origin;
+  hits.clear();
+  const std::vector<int>* candidates = moduleHitCandidates(layer, direction);
+  int nCandidates = candidates ? candidates->size() : layer.size();
+  const LayerHitPolys* foundPolys = NULL;
+  if (useModuleHitIndex_ && moduleHitLookup_) {
+    const ModuleHitLookup& lookup = moduleHitReplicas_.local(*moduleHitLookup_);
+    std::map<const ModuleCaps*, LayerHitPolys>::const_iterator it = lookup.layerPolys.find(&layer);
+    if (it != lookup.layerPolys.end()) foundPolys = &it->second;
+  }
+  if (!foundPolys) {
+    for (int i = 0; i < nCandidates; i++) {
+      ModuleCap& cap = layer[candidates ? (*candidates)[i] : i];
+      if (cap.getModule().maxZ() <= 0) continue;
+      auto h = cap.getModule().checkTrackHits(origin, direction);
+      if (h.second != HitType::NONE) hits.push_back(std::make_pair(&cap, h));
+    }
+    return;
+  }
+  const LayerHitPolys& layerPolys = *foundPolys;
+  modules.clear();
+  polys.clear();
+  for (int i = 0; i < nCandidates; i++) {
+    int k = candidates ? (*candidates)[i] : i;
+    int first = layerPolys.firstPoly[k];
+    if (first < 0) continue;
+    modules.push_back(k);
+    polys.push_back(first);
+    polys.push_back(layer[k].getModule().numSensors() > 1 ? first + 1 : first); // the second test of a single sensor is ignored
+  }
+  layerPolys.polys.checkHitSegments(polys, origin, direction, segments);
+  for (unsigned int i = 0; i < modules.size(); i++) {
+    ModuleCap& cap = layer[modules[i]];
+    auto h = cap.getModule().classifyTrackHits(segments[2*i], segments[2*i + 1]);
+    if (h.second != HitType::NONE) hits.push_back(std::make_pair(&cap, h));
+  }
+  countPathValue("Analyzer::findLayerModuleHits modules tested per layer", modules.size());
+}
+
+// public
+/**
+ * Builds the eta lookup of the inactive elements for every collection of inactive surfaces of the given material budgets,
+ * so that the material tracks are only checked against the elements they could actually cross.
+ * @param mb A reference to the material budget of the tracker
+ * @param pm A pointer to a second material budget associated to a pixel detector; may be <i>NULL</i>
+ */
+void Analyzer::buildInactiveHitIndex(MaterialBudget& mb, MaterialBudget* pm) {
+  inactiveHitIndices_ = std::make_shared<InactiveHitIndexMap>();
+  std::vector<InactiveSurfaces*> surfaces = { &mb.getInactiveSurfaces() };
+  if (pm) surfaces.push_back(&pm->getInactiveSurfaces());
+  for (auto is : surfaces) {
+    for (auto collection : { &is->getBarrelServices(), &is->getEndcapServices(), &is->getSupports() }) {
+      (*inactiveHitIndices_)[std::make_pair(collection, MaterialProperties::no_cat)].build(*collection);
+    }
+    // the material budget scan looks at the supports one category at a time
+    for (auto cat : { MaterialProperties::b_sup, MaterialProperties::e_sup, MaterialProperties::o_sup,
+                      MaterialProperties::t_sup, MaterialProperties::u_sup }) {
+      (*inactiveHitIndices_)[std::make_pair(&is->getSupports(), cat)].build(is->getSupports(), cat);
+    }
+  }
+  inactiveHitReplicas_.replicate(*inactiveHitIndices_);
+}
+
+// protected
+/**
+ * Finds the index of the inactive elements of a collection, which gives the elements that have to be checked for a hit
+ * by a track leaving the origin and their eta ranges.
+ * @param elements A reference to the collection of inactive elements
+ * @param cat The category of the elements to be checked; all of them if <i>no_cat</i>
+ * @return A pointer to the index, or <i>NULL</i> if the whole collection has to be scanned
+ */
+const InactiveHitIndex* Analyzer::inactiveHitIndex(const std::vector<InactiveElement>& elements,
+                                                   MaterialProperties::Category cat) const {
+  if (!useModuleHitIndex_ || !inactiveHitIndices_) return NULL;
+  const InactiveHitIndexMap& indices = inactiveHitReplicas_.local(*inactiveHitIndices_);
+  InactiveHitIndexMap::const_iterator it = indices.find(std::make_pair(&elements, cat));
+  if (it == indices.end()) return NULL;
+  return &(it->second);
 }
 
 // protected
@@ -1039,12 +2145,12 @@ void Analyzer::computeWeightSummary(MaterialBudget& mb) {
  * @param A boolean flag to indicate which set of active surfaces is analysed: true if the belong to a pixel detector, false if they belong to the tracker
  * @return The summed up radiation and interaction lengths for the given track, bundled into a <i>std::pair</i>
  */
-Material Analyzer::analyzeModules(std::vector<std::vector<ModuleCap> >& tr,
+Material Analyzer::analyzeModules(std::vector<ModuleCaps>& tr,
                                   double eta, double theta, double phi, Track& t, 
                                   std::map<std::string, Material>& sumComponentsRI,
                                   bool isPixel) {
-  std::vector<std::vector<ModuleCap> >::iterator iter = tr.begin();
-  std::vector<std::vector<ModuleCap> >::iterator guard = tr.end();
+  std::vector<ModuleCaps>::iterator iter = tr.begin();
+  std::vector<ModuleCaps>::iterator guard = tr.end();
   Material res, tmp;
   res.radiation= 0.0;
   res.interaction = 0.0;
@@ -1074,14 +2180,12 @@ void printPosRefString(std::ostream& os, const Module& m, const string& delim =
  * @param A boolean flag to indicate which set of active surfaces is analysed: true if the belong to a pixel detector, false if they belong to the tracker
  * @return The scaled and summed up radiation and interaction lengths for the given layer and track, bundled into a <i>std::pair</i>
  */
-Material Analyzer::findModuleLayerRI(std::vector<ModuleCap>& layer,
+Material Analyzer::findModuleLayerRI(ModuleCaps& layer,
                                      double eta, double theta, double phi, Track& t, 
                                      std::map<std::string, Material>& sumComponentsRI,
                                      bool isPixel) {
-  std::vector<ModuleCap>::iterator iter = layer.begin();
-  std::vector<ModuleCap>::iterator guard = layer.end();
   Material res, tmp;
-  XYZVector origin, direction;
+  XYZVector direction;
   Polar3DVector dir;
   double distance, r;
   int hits = 0;
@@ -1090,62 +2194,58 @@ Material Analyzer::findModuleLayerRI(std::vector<ModuleCap>& layer,
   // set the track direction vector
   dir.SetCoordinates(1, theta, phi);
   direction = dir;
-  while (iter != guard) {
-    // collision detection: rays are in z+ only, so consider only modules that lie on that side
-    // only consider modules that have type BarrelModule or EndcapModule
-    if (iter->getModule().maxZ() > 0) {
-        // same method as in Tracker, same function used
-        // TODO: in case origin==0,0,0 and phi==0 just check if sectionYZ and minEta, maxEta
-        //distance = iter->getModule().trackCross(origin, direction);
-        auto h = iter->getModule().checkTrackHits(origin, direction);
-        if (h.second != HitType::NONE) {
-          distance = h.first.R();
-          HitType type = h.second;
-          // module was hit
-          hits++;
-          r = distance * sin(theta);
-          tmp.radiation = iter->getRadiationLength();
-          tmp.interaction = iter->getInteractionLength();
-
-          Module& m = iter->getModule();
-          double tiltAngle = m.tiltAngle();
-          // 2D material maps
-          fillMapRT(r, theta, tmp);
-          // radiation and interaction length scaling for barrels
-          if (iter->getModule().subdet() == BARREL) {
-            tmp.radiation = tmp.radiation / sin(theta + tiltAngle);
-            tmp.interaction = tmp.interaction / sin(theta + tiltAngle);
-          }
-          // radiation and interaction length scaling for endcaps
-          else {
-            tmp.radiation = tmp.radiation / cos(theta + tiltAngle - M_PI/2);
-            tmp.interaction = tmp.interaction / cos(theta + tiltAngle - M_PI/2);
-          }
+  // collision detection: rays are in z+ only, so only the modules that lie on that side are considered
+  static thread_local std::vector<std::pair<ModuleCap*, std::pair<XYZVector, HitType> > > moduleHits;
+  findLayerModuleHits(layer, direction, moduleHits);
+  for (const auto& moduleHit : moduleHits) {
+    ModuleCap* iter = moduleHit.first;
+    const auto& h = moduleHit.second;
+    distance = h.first.R();
+    HitType type = h.second;
+    // module was hit
+    hits++;
+    r = distance * sin(theta);
+    tmp.radiation = iter->getRadiationLength();
+    tmp.interaction = iter->getInteractionLength();
+
+    Module& m = iter->getModule();
+    double tiltAngle = m.tiltAngle();
+    // 2D material maps
+    fillMapRT(r, theta, tmp);
+    // radiation and interaction length scaling for barrels
+    if (iter->getModule().subdet() == BARREL) {
+      tmp.radiation = tmp.radiation / sin(theta + tiltAngle);
+      tmp.interaction = tmp.interaction / sin(theta + tiltAngle);
+      if (!isPixel) recordMaterialCrossing(*iter, 1. / sin(theta + tiltAngle));
+    }
+    // radiation and interaction length scaling for endcaps
+    else {
+      tmp.radiation = tmp.radiation / cos(theta + tiltAngle - M_PI/2);
+      tmp.interaction = tmp.interaction / cos(theta + tiltAngle - M_PI/2);
+      if (!isPixel) recordMaterialCrossing(*iter, 1. / cos(theta + tiltAngle - M_PI/2));
+    }
 
-          double tmpr = 0., tmpi = 0.;
+    double tmpr = 0., tmpi = 0.;
 
-          std::map<std::string, Material> moduleComponentsRI = iter->getComponentsRI();
-          for (std::map<std::string, Material>::iterator cit = moduleComponentsRI.begin(); cit != moduleComponentsRI.end(); ++cit) {
-            sumComponentsRI[cit->first].radiation += cit->second.radiation / (iter->getModule().subdet() == BARREL ? sin(theta + tiltAngle) : cos(theta + tiltAngle - M_PI/2));
-            //if (cit->first == "SupportMechanics") std::cout << eta << " " << distance << " " << cit->second.radiation / sin(theta + tiltAngle) << " " << cit->second.radiation << std::endl;
-            tmpr += sumComponentsRI[cit->first].radiation;
-            sumComponentsRI[cit->first].interaction += cit->second.interaction / (iter->getModule().subdet() == BARREL ? sin(theta + tiltAngle) : cos(theta + tiltAngle - M_PI/2));
-            tmpi += sumComponentsRI[cit->first].interaction;
-          }
-          // 2D plot and eta plot results
-          if (!isPixel) fillCell(r, eta, theta, tmp);
-          res += tmp;
-          // create Hit object with appropriate parameters, add to Track t
-          Hit* hit = new Hit(distance, &(iter->getModule()), type);
-          //if (iter->getModule().getSubdetectorType() == Module::Barrel) hit->setOrientation(Hit::Horizontal); // should not be necessary
-          //else if(iter->getModule().getSubdetectorType() == Module::Endcap) hit->setOrientation(Hit::Vertical); // should not be necessary
-          //hit->setObjectKind(Hit::Active); // should not be necessary
-          hit->setCorrectedMaterial(tmp);
-          hit->setPixel(isPixel);
-          t.addHit(hit);
-        }
+    const std::map<std::string, Material>& moduleComponentsRI = iter->getComponentsRI();
+    for (std::map<std::string, Material>::const_iterator cit = moduleComponentsRI.begin(); cit != moduleComponentsRI.end(); ++cit) {
+      sumComponentsRI[cit->first].radiation += cit->second.radiation / (iter->getModule().subdet() == BARREL ? sin(theta + tiltAngle) : cos(theta + tiltAngle - M_PI/2));
+      //if (cit->first == "SupportMechanics") std::cout << eta << " " << distance << " " << cit->second.radiation / sin(theta + tiltAngle) << " " << cit->second.radiation << std::endl;
+      tmpr += sumComponentsRI[cit->first].radiation;
+      sumComponentsRI[cit->first].interaction += cit->second.interaction / (iter->getModule().subdet() == BARREL ? sin(theta + tiltAngle) : cos(theta + tiltAngle - M_PI/2));
+      tmpi += sumComponentsRI[cit->first].interaction;
     }
-    iter++;
+    // 2D plot and eta plot results
+    if (!isPixel) fillCell(r, eta, theta, tmp);
+    res += tmp;
+    // create Hit object with appropriate parameters, add to Track t
+    Hit hit(distance, &(iter->getModule()), type);
+    //if (iter->getModule().getSubdetectorType() == Module::Barrel) hit.setOrientation(Hit::Horizontal); // should not be necessary
+    //else if(iter->getModule().getSubdetectorType() == Module::Endcap) hit.setOrientation(Hit::Vertical); // should not be necessary
+    //hit.setObjectKind(Hit::Active); // should not be necessary
+    hit.setCorrectedMaterial(tmp);
+    hit.setPixel(isPixel);
+    t.addHit(hit);
   }
   return res;
 }
@@ -1163,11 +2263,11 @@ Material Analyzer::findModuleLayerRI(std::vector<ModuleCap>& layer,
  * @param A boolean flag to indicate which set of active surfaces is analysed: true if the belong to a pixel detector, false if they belong to the tracker
  * @return The summed up radiation and interaction lengths for the given track, bundled into a <i>std::pair</i>
  */
-Material Analyzer::findHitsModules(std::vector<std::vector<ModuleCap> >& tr,
+Material Analyzer::findHitsModules(std::vector<ModuleCaps>& tr,
                                    // TODO: add z0 here and in the hit finder for inactive surfaces
                                    double eta, double theta, double phi, Track& t, bool isPixel) {
-  std::vector<std::vector<ModuleCap> >::iterator iter = tr.begin();
-  std::vector<std::vector<ModuleCap> >::iterator guard = tr.end();
+  std::vector<ModuleCaps>::iterator iter = tr.begin();
+  std::vector<ModuleCaps>::iterator guard = tr.end();
   Material res, tmp;
   res.radiation= 0.0;
   res.interaction = 0.0;
@@ -1211,8 +2311,8 @@ int Analyzer::findHitsModules(Tracker& tracker, double z0, double eta, double th
         hits++;
 
         // create Hit object with appropriate parameters, add to Track t
-        Hit* hit = new Hit(distance, aModule, ht.second);
-        hit->setCorrectedMaterial(emptyMaterial);
+        Hit hit(distance, aModule, ht.second);
+        hit.setCorrectedMaterial(emptyMaterial);
         t.addHit(hit);
       }
     }
@@ -1234,12 +2334,10 @@ int Analyzer::findHitsModules(Tracker& tracker, double z0, double eta, double th
  * @param A boolean flag to indicate which set of active surfaces is analysed: true if the belong to a pixel detector, false if they belong to the tracker
  * @return The scaled and summed up radiation and interaction lengths for the given layer and track, bundled into a <i>std::pair</i>
  */
-Material Analyzer::findHitsModuleLayer(std::vector<ModuleCap>& layer,
+Material Analyzer::findHitsModuleLayer(ModuleCaps& layer,
                                        double eta, double theta, double phi, Track& t, bool isPixel) {
-  std::vector<ModuleCap>::iterator iter = layer.begin();
-  std::vector<ModuleCap>::iterator guard = layer.end();
   Material res, tmp;
-  XYZVector origin, direction;
+  XYZVector direction;
   Polar3DVector dir;
   double distance;
   //double r;
@@ -1249,43 +2347,37 @@ Material Analyzer::findHitsModuleLayer(std::vector<ModuleCap>& layer,
   // set the track direction vector
   dir.SetCoordinates(1, theta, phi);
   direction = dir;
-  while (iter != guard) {
-    // collision detection: rays are in z+ only, so consider only modules that lie on that side
-    if (iter->getModule().maxZ() > 0) {
-        // same method as in Tracker, same function used
-        // TODO: in case origin==0,0,0 and phi==0 just check if sectionYZ and minEta, maxEta
-        //distance = iter->getModule().trackCross(origin, direction);
-        auto h = iter->getModule().checkTrackHits(origin, direction); 
-        if (h.second != HitType::NONE) {
-        //if (distance > 0) {
-          double distance = h.first.R();
-          // module was hit
-          hits++;
-          // r = distance * sin(theta);
-          tmp.radiation = iter->getRadiationLength();
-          tmp.interaction = iter->getInteractionLength();
-          // radiation and interaction length scaling for barrels
-          if (iter->getModule().subdet() == BARREL) {
-            tmp.radiation = tmp.radiation / sin(theta);
-            tmp.interaction = tmp.interaction / sin(theta);
-          }
-          // radiation and interaction length scaling for endcaps
-          else {
-            tmp.radiation = tmp.radiation / cos(theta);
-            tmp.interaction = tmp.interaction / cos(theta);
-          }
-          res += tmp;
-          // create Hit object with appropriate parameters, add to Track t
-          Hit* hit = new Hit(distance, &(iter->getModule()), h.second);
-          //if (iter->getModule().getSubdetectorType() == Module::Barrel) hit->setOrientation(Hit::Horizontal); // should not be necessary
-          //else if(iter->getModule().getSubdetectorType() == Module::Endcap) hit->setOrientation(Hit::Vertical); // should not be necessary
-          //hit->setObjectKind(Hit::Active); // should not be necessary
-          hit->setCorrectedMaterial(tmp);
-          hit->setPixel(isPixel);
-          t.addHit(hit);
-        }
+  // collision detection: rays are in z+ only, so only the modules that lie on that side are considered
+  static thread_local std::vector<std::pair<ModuleCap*, std::pair<XYZVector, HitType> > > moduleHits;
+  findLayerModuleHits(layer, direction, moduleHits);
+  for (const auto& moduleHit : moduleHits) {
+    ModuleCap* iter = moduleHit.first;
+    const auto& h = moduleHit.second;
+    double distance = h.first.R();
+    // module was hit
+    hits++;
+    // r = distance * sin(theta);
+    tmp.radiation = iter->getRadiationLength();
+    tmp.interaction = iter->getInteractionLength();
+    // radiation and interaction length scaling for barrels
+    if (iter->getModule().subdet() == BARREL) {
+      tmp.radiation = tmp.radiation / sin(theta);
+      tmp.interaction = tmp.interaction / sin(theta);
     }
-    iter++;
+    // radiation and interaction length scaling for endcaps
+    else {
+      tmp.radiation = tmp.radiation / cos(theta);
+      tmp.interaction = tmp.interaction / cos(theta);
+    }
+    res += tmp;
+    // create Hit object with appropriate parameters, add to Track t
+    Hit hit(distance, &(iter->getModule()), h.second);
+    //if (iter->getModule().getSubdetectorType() == Module::Barrel) hit.setOrientation(Hit::Horizontal); // should not be necessary
+    //else if(iter->getModule().getSubdetectorType() == Module::Endcap) hit.setOrientation(Hit::Vertical); // should not be necessary
+    //hit.setObjectKind(Hit::Active); // should not be necessary
+    hit.setCorrectedMaterial(tmp);
+    hit.setPixel(isPixel);
+    t.addHit(hit);
   }
   return res;
 }
@@ -1315,21 +2407,28 @@ Material Analyzer::analyzeInactiveSurfaces(std::vector<InactiveElement>& element
   }
   */
   
-  std::vector<InactiveElement>::iterator iter = elements.begin();
-  std::vector<InactiveElement>::iterator guard = elements.end();
+  // the buffer of the elements crossed, kept from a track to the next
+  static thread_local std::vector<int> crossed;
+  const InactiveHitIndex* index = inactiveHitIndex(elements, cat);
+  if (index) index->crossings(eta, crossed);
+  int nElements = index ? crossed.size() : elements.size();
   Material res, corr;
   std::pair<double, double> tmp;
   double s = 0.0;
-  while ((iter != guard)) {
+  for (int k = 0; k < nElements; k++) {
+    int i = index ? crossed[k] : k;
+    std::vector<InactiveElement>::iterator iter = elements.begin() + i;
     //if  ((iter->getInteractionLength() > 0) && (iter->getRadiationLength() > 0)) {
     // collision detection: rays are in z+ only, so only volumes in z+ need to be considered
     // only volumes of the requested category, or those without one (which should not exist) are examined
-    if (((iter->getZOffset() + iter->getZLength()) > 0)
-        && ((cat == MaterialProperties::no_cat) || (cat == iter->getCategory()))) {
+    // (the index only gives such volumes, those the track crosses: the element is only read if hit)
+    if (index
+        || (((iter->getZOffset() + iter->getZLength()) > 0)
+            && ((cat == MaterialProperties::no_cat) || (cat == iter->getCategory())))) {
       // collision detection: check eta range
-      tmp = iter->getEtaMinMax();
+      if (!index) tmp = iter->getEtaMinMax();
       // volume was hit
-      if ((tmp.first < eta) && (tmp.second > eta)) {
+      if (index || ((tmp.first < eta) && (tmp.second > eta))) {
         double r, z;
         /*
         if (eta<0.01) {
@@ -1357,6 +2456,7 @@ Material Analyzer::analyzeInactiveSurfaces(std::vector<InactiveElement>& element
               corr.radiation = iter->getRadiationLength() * s / iter->getZLength();
               corr.interaction = iter->getInteractionLength() * s / iter->getZLength();
               res += corr;
+              if (!isPixel) recordMaterialCrossing(*iter, s / iter->getZLength());
               if (!isPixel) {
                 Material thisLength;
                 thisLength.radiation = iter->getRadiationLength() * s / iter->getZLength();
@@ -1366,8 +2466,9 @@ Material Analyzer::analyzeInactiveSurfaces(std::vector<InactiveElement>& element
             }
             else {
               if (!isPixel) {
-                rextrasupports.Fill(eta, iter->getRadiationLength() * s / iter->getZLength());
-                iextrasupports.Fill(eta, iter->getInteractionLength() * s / iter->getZLength());
+                fillHisto(rextrasupports, eta, iter->getRadiationLength() * s / iter->getZLength());
+                recordMaterialCrossing(*iter, s / iter->getZLength(), MaterialCrossing::extraSupports);
+                fillHisto(iextrasupports, eta, iter->getInteractionLength() * s / iter->getZLength());
               }
             }
           }
@@ -1377,6 +2478,7 @@ Material Analyzer::analyzeInactiveSurfaces(std::vector<InactiveElement>& element
               corr.radiation = iter->getRadiationLength() / cos(theta);
               corr.interaction = iter->getInteractionLength() / cos(theta);
               res += corr;
+              if (!isPixel) recordMaterialCrossing(*iter, 1. / cos(theta));
               if (!isPixel) {
                 Material thisLength;
                 thisLength.radiation = iter->getRadiationLength() / cos(theta); 
@@ -1388,15 +2490,17 @@ Material Analyzer::analyzeInactiveSurfaces(std::vector<InactiveElement>& element
               if (!isPixel) {
                 if ((iter->getCategory() == MaterialProperties::b_ser)
                     || (iter->getCategory() == MaterialProperties::e_ser)) {
-                  rextraservices.Fill(eta, iter->getRadiationLength() / cos(theta));
-                  iextraservices.Fill(eta, iter->getInteractionLength() / cos(theta));
+                  fillHisto(rextraservices, eta, iter->getRadiationLength() / cos(theta));
+                  recordMaterialCrossing(*iter, 1. / cos(theta), MaterialCrossing::extraServices);
+                  fillHisto(iextraservices, eta, iter->getInteractionLength() / cos(theta));
                 }
                 else if ((iter->getCategory() == MaterialProperties::b_sup)
                          || (iter->getCategory() == MaterialProperties::e_sup)
                          || (iter->getCategory() == MaterialProperties::o_sup)
                          || (iter->getCategory() == MaterialProperties::t_sup)) {
-                  rextrasupports.Fill(eta, iter->getRadiationLength() / cos(theta));
-                  iextrasupports.Fill(eta, iter->getInteractionLength() / cos(theta));
+                  fillHisto(rextrasupports, eta, iter->getRadiationLength() / cos(theta));
+                  recordMaterialCrossing(*iter, 1. / cos(theta), MaterialCrossing::extraSupports);
+                  fillHisto(iextrasupports, eta, iter->getInteractionLength() / cos(theta));
                 }
               }
             }
@@ -1417,6 +2521,7 @@ Material Analyzer::analyzeInactiveSurfaces(std::vector<InactiveElement>& element
               corr.radiation = iter->getRadiationLength() * s / iter->getZLength();
               corr.interaction = iter->getInteractionLength() * s / iter->getZLength();
               res += corr;
+              if (!isPixel) recordMaterialCrossing(*iter, s / iter->getZLength());
               if (!isPixel) {
                 Material thisLength;
                 thisLength.radiation = iter->getRadiationLength() * s / iter->getZLength(); 
@@ -1426,8 +2531,9 @@ Material Analyzer::analyzeInactiveSurfaces(std::vector<InactiveElement>& element
             }
             else {
               if (!isPixel) {
-                rextrasupports.Fill(eta, iter->getRadiationLength() * s / iter->getZLength());
-                iextrasupports.Fill(eta, iter->getInteractionLength() * s / iter->getZLength());
+                fillHisto(rextrasupports, eta, iter->getRadiationLength() * s / iter->getZLength());
+                recordMaterialCrossing(*iter, s / iter->getZLength(), MaterialCrossing::extraSupports);
+                fillHisto(iextrasupports, eta, iter->getInteractionLength() * s / iter->getZLength());
               }
             }
           }
@@ -1437,6 +2543,7 @@ Material Analyzer::analyzeInactiveSurfaces(std::vector<InactiveElement>& element
               corr.radiation = iter->getRadiationLength() / sin(theta);
               corr.interaction = iter->getInteractionLength() / sin(theta);
               res += corr;
+              if (!isPixel) recordMaterialCrossing(*iter, 1. / sin(theta));
               if (!isPixel) {
                 Material thisLength;
                 thisLength.radiation = iter->getRadiationLength() / sin(theta);
@@ -1448,31 +2555,32 @@ Material Analyzer::analyzeInactiveSurfaces(std::vector<InactiveElement>& element
               if (!isPixel) {
                 if ((iter->getCategory() == MaterialProperties::b_ser)
                     || (iter->getCategory() == MaterialProperties::e_ser)) {
-                  rextraservices.Fill(eta, iter->getRadiationLength() / sin(theta));
-                  iextraservices.Fill(eta, iter->getInteractionLength() / sin(theta));
+                  fillHisto(rextraservices, eta, iter->getRadiationLength() / sin(theta));
+                  recordMaterialCrossing(*iter, 1. / sin(theta), MaterialCrossing::extraServices);
+                  fillHisto(iextraservices, eta, iter->getInteractionLength() / sin(theta));
                 }
                 else if ((iter->getCategory() == MaterialProperties::b_sup)
                          || (iter->getCategory() == MaterialProperties::e_sup)
                          || (iter->getCategory() == MaterialProperties::o_sup)
                          || (iter->getCategory() == MaterialProperties::t_sup)) {
-                  rextrasupports.Fill(eta, iter->getRadiationLength() / sin(theta));
-                  iextrasupports.Fill(eta, iter->getInteractionLength() / sin(theta));
+                  fillHisto(rextrasupports, eta, iter->getRadiationLength() / sin(theta));
+                  recordMaterialCrossing(*iter, 1. / sin(theta), MaterialCrossing::extraSupports);
+                  fillHisto(iextrasupports, eta, iter->getInteractionLength() / sin(theta));
                 }
               }
             }
           }
         }
         // create Hit object with appropriate parameters, add to Track t
-        Hit* hit = new Hit((theta == 0) ? r : (r / sin(theta)));
-        if (iter->isVertical()) hit->setOrientation(Hit::Vertical);
-        else hit->setOrientation(Hit::Horizontal);
-        hit->setObjectKind(Hit::Inactive);
-        hit->setCorrectedMaterial(corr);
-        hit->setPixel(isPixel);
+        Hit hit((theta == 0) ? r : (r / sin(theta)));
+        if (iter->isVertical()) hit.setOrientation(Hit::Vertical);
+        else hit.setOrientation(Hit::Horizontal);
+        hit.setObjectKind(Hit::Inactive);
+        hit.setCorrectedMaterial(corr);
+        hit.setPixel(isPixel);
         t.addHit(hit);
       }
     }
-    iter++;
     //}
   }
   return res;
@@ -1492,20 +2600,27 @@ Material Analyzer::analyzeInactiveSurfaces(std::vector<InactiveElement>& element
  */
 Material Analyzer::findHitsInactiveSurfaces(std::vector<InactiveElement>& elements, double eta,
                                             double theta, Track& t, bool isPixel) {
-  std::vector<InactiveElement>::iterator iter = elements.begin();
-  std::vector<InactiveElement>::iterator guard = elements.end();
+  // the buffer of the elements crossed, kept from a track to the next
+  static thread_local std::vector<int> crossed;
+  const InactiveHitIndex* index = inactiveHitIndex(elements);
+  int nTested = index ? index->crossings(eta, crossed) : elements.size();
+  int nElements = index ? crossed.size() : elements.size();
+  countPathValue("Analyzer::findHitsInactiveSurfaces elements tested per track", nTested);
   Material res, corr;
   std::pair<double, double> tmp;
   double s_normal = 0;
   double s_alternate = 0;
-  while (iter != guard) {
+  for (int k = 0; k < nElements; k++) {
+    int i = index ? crossed[k] : k;
+    std::vector<InactiveElement>::iterator iter = elements.begin() + i;
     // Collision detection: rays are in z+ only, so only volumes in z+ need to be considered
     // only volumes of the requested category, or those without one (which should not exist) are examined
-    if ((iter->getZOffset() + iter->getZLength()) > 0) {
+    // (the index only gives such volumes, those the track crosses: the element is only read if hit)
+    if (index || (iter->getZOffset() + iter->getZLength()) > 0) {
       // collision detection: check eta range
-      tmp = iter->getEtaMinMax();
+      if (!index) tmp = iter->getEtaMinMax();
       // Volume was hit if:
-      if ((tmp.first < eta) && (tmp.second > eta)) {
+      if (index || ((tmp.first < eta) && (tmp.second > eta))) {
         double r, z;
         // radiation and interaction lenth scaling for vertical volumes
         if (iter->isVertical()) { // Element is vertical
@@ -1551,36 +2666,24 @@ Material Analyzer::findHitsInactiveSurfaces(std::vector<InactiveElement>& elemen
           }
         }
         // create Hit object with appropriate parameters, add to Track t
-        Hit* hit = new Hit((theta == 0) ? r : (r / sin(theta)));
-        if (iter->isVertical()) hit->setOrientation(Hit::Vertical);
-        else hit->setOrientation(Hit::Horizontal);
-        hit->setObjectKind(Hit::Inactive);
-        hit->setCorrectedMaterial(corr);
-        hit->setPixel(isPixel);
+        Hit hit((theta == 0) ? r : (r / sin(theta)));
+        if (iter->isVertical()) hit.setOrientation(Hit::Vertical);
+        else hit.setOrientation(Hit::Horizontal);
+        hit.setObjectKind(Hit::Inactive);
+        hit.setCorrectedMaterial(corr);
+        hit.setPixel(isPixel);
         t.addHit(hit);
       }
     }
-    iter++;
   }
   return res;
 }
   
   
   void Analyzer::clearGraphs(int graphAttributes, const std::string& graphTag) {
-  std::map<int, TGraph>& thisRhoGraphs = graphTag.empty() ? myGraphBag.getGraphs(graphAttributes | GraphBag::RhoGraph ) : myGraphBag.getTaggedGraphs(graphAttributes | GraphBag::RhoGraph, graphTag);
-  std::map<int, TGraph>& thisPhiGraphs = graphTag.empty() ? myGraphBag.getGraphs(graphAttributes | GraphBag::PhiGraph ) : myGraphBag.getTaggedGraphs(graphAttributes | GraphBag::PhiGraph, graphTag);
-  std::map<int, TGraph>& thisDGraphs = graphTag.empty() ? myGraphBag.getGraphs(graphAttributes | GraphBag::DGraph ) : myGraphBag.getTaggedGraphs(graphAttributes | GraphBag::DGraph, graphTag);
-  std::map<int, TGraph>& thisCtgThetaGraphs = graphTag.empty() ? myGraphBag.getGraphs(graphAttributes | GraphBag::CtgthetaGraph ) : myGraphBag.getTaggedGraphs(graphAttributes | GraphBag::CtgthetaGraph, graphTag);
-  std::map<int, TGraph>& thisZ0Graphs = graphTag.empty() ? myGraphBag.getGraphs(graphAttributes | GraphBag::Z0Graph ) : myGraphBag.getTaggedGraphs(graphAttributes | GraphBag::Z0Graph, graphTag);
-  std::map<int, TGraph>& thisPGraphs = graphTag.empty() ? myGraphBag.getGraphs(graphAttributes | GraphBag::PGraph ) : myGraphBag.getTaggedGraphs(graphAttributes | GraphBag::PGraph, graphTag);
-  
-  thisRhoGraphs.clear();
-  thisPhiGraphs.clear();
-  thisDGraphs.clear();
-  thisCtgThetaGraphs.clear();
-  thisZ0Graphs.clear();
-  thisPGraphs.clear();
-  
+  for (int graph : { GraphBag::RhoGraph, GraphBag::PhiGraph, GraphBag::DGraph, GraphBag::CtgthetaGraph, GraphBag::Z0Graph, GraphBag::PGraph }) {
+    myGraphBag.clearSeries(graphAttributes | graph, graphTag);
+  }
 }
  
  
@@ -1589,17 +2692,31 @@ Material Analyzer::findHitsInactiveSurfaces(std::vector<InactiveElement>& elemen
  * and store them internally for later visualisation.
  * @param parameter The list of different momenta that the error graphs are calculated for
  */
+/**
+ * Replaces the resolution graphs of each tag by those of its tracks, at each momentum
+ * @param taggedTrackCollectionMap The tracks of each tag, by momentum in MeV/c
+ * @param graphAttributes The graphs filled, real or ideal
+ */
+void Analyzer::calculateTaggedGraphs(std::map<std::string, TrackCollectionMap>& taggedTrackCollectionMap, int graphAttributes) {
+  for (const auto& ttcmIt : taggedTrackCollectionMap) {
+    const string& myTag = ttcmIt.first;
+    clearGraphs(graphAttributes, myTag);
+    for (const auto& tcmIt : ttcmIt.second) calculateGraphs(tcmIt.first, tcmIt.second, graphAttributes, myTag);
+  }
+}
+
 void Analyzer::calculateGraphs(const int& parameter, 
                                const TrackCollection& aTrackCollection,
                                int graphAttributes, 
                                const string& graphTag) {
 
-  TGraph& thisRhoGraph       = graphTag.empty() ? myGraphBag.getGraph(graphAttributes | GraphBag::RhoGraph, parameter )      : myGraphBag.getTaggedGraph(graphAttributes | GraphBag::RhoGraph       , graphTag, parameter);
-  TGraph& thisPhiGraph       = graphTag.empty() ? myGraphBag.getGraph(graphAttributes | GraphBag::PhiGraph, parameter )      : myGraphBag.getTaggedGraph(graphAttributes | GraphBag::PhiGraph       , graphTag, parameter);
-  TGraph& thisDGraph         = graphTag.empty() ? myGraphBag.getGraph(graphAttributes | GraphBag::DGraph, parameter )        : myGraphBag.getTaggedGraph(graphAttributes | GraphBag::DGraph         , graphTag, parameter);
-  TGraph& thisCtgThetaGraph  = graphTag.empty() ? myGraphBag.getGraph(graphAttributes | GraphBag::CtgthetaGraph, parameter ) : myGraphBag.getTaggedGraph(graphAttributes | GraphBag::CtgthetaGraph  , graphTag, parameter);
-  TGraph& thisZ0Graph        = graphTag.empty() ? myGraphBag.getGraph(graphAttributes | GraphBag::Z0Graph, parameter )       : myGraphBag.getTaggedGraph(graphAttributes | GraphBag::Z0Graph        , graphTag, parameter);
-  TGraph& thisPGraph         = graphTag.empty() ? myGraphBag.getGraph(graphAttributes | GraphBag::PGraph, parameter )        : myGraphBag.getTaggedGraph(graphAttributes | GraphBag::PGraph         , graphTag, parameter);
+  // the series are all of different attributes, so that taking one does not move the others
+  GraphBag::Series& thisRhoGraph       = myGraphBag.getSeries(graphAttributes | GraphBag::RhoGraph, graphTag, parameter);
+  GraphBag::Series& thisPhiGraph       = myGraphBag.getSeries(graphAttributes | GraphBag::PhiGraph, graphTag, parameter);
+  GraphBag::Series& thisDGraph         = myGraphBag.getSeries(graphAttributes | GraphBag::DGraph, graphTag, parameter);
+  GraphBag::Series& thisCtgThetaGraph  = myGraphBag.getSeries(graphAttributes | GraphBag::CtgthetaGraph, graphTag, parameter);
+  GraphBag::Series& thisZ0Graph        = myGraphBag.getSeries(graphAttributes | GraphBag::Z0Graph, graphTag, parameter);
+  GraphBag::Series& thisPGraph         = myGraphBag.getSeries(graphAttributes | GraphBag::PGraph, graphTag, parameter);
 
   double eta, R;
 
@@ -1608,30 +2725,56 @@ void Analyzer::calculateGraphs(const int& parameter,
   // Prepare plots: pT
   double momentum = double(parameter)/1000.;
 
-  thisRhoGraph.SetTitle("Transverse momentum error;#eta;#sigma (#delta p_{T}/p_{T}) [%]");
+  thisRhoGraph.title = "Transverse momentum error;#eta;#sigma (#delta p_{T}/p_{T}) [%]";
   aName.str(""); aName << "pt_vs_eta" << momentum << graphTag;
-  thisRhoGraph.SetName(aName.str().c_str());
+  thisRhoGraph.name = aName.str();
   // Prepare plots: phi
-  thisPhiGraph.SetTitle("Track azimuthal angle error;#eta;#sigma (#delta #phi) [rad]");
+  thisPhiGraph.title = "Track azimuthal angle error;#eta;#sigma (#delta #phi) [rad]";
   aName.str(""); aName << "phi_vs_eta" << momentum << graphTag;
-  thisPhiGraph.SetName(aName.str().c_str());
+  thisPhiGraph.name = aName.str();
   // Prepare plots: d
-  thisDGraph.SetTitle("Transverse impact parameter error;#eta;#sigma (#delta d_{0}) [cm]");
+  thisDGraph.title = "Transverse impact parameter error;#eta;#sigma (#delta d_{0}) [cm]";
   aName.str(""); aName << "d_vs_eta" << momentum << graphTag;
-  thisDGraph.SetName(aName.str().c_str());
+  thisDGraph.name = aName.str();
   // Prepare plots: ctg(theta)
-  thisCtgThetaGraph.SetTitle("Track polar angle error;#eta;#sigma (#delta ctg(#theta))");
+  thisCtgThetaGraph.title = "Track polar angle error;#eta;#sigma (#delta ctg(#theta))";
   aName.str(""); aName << "ctgTheta_vs_eta" << momentum << graphTag;
-  thisCtgThetaGraph.SetName(aName.str().c_str());
+  thisCtgThetaGraph.name = aName.str();
   // Prepare plots: z0
-  thisZ0Graph.SetTitle("Longitudinal impact parameter error;#eta;#sigma (#delta z_{0}) [cm]");
+  thisZ0Graph.title = "Longitudinal impact parameter error;#eta;#sigma (#delta z_{0}) [cm]";
   aName.str(""); aName << "z_vs_eta" << momentum << graphTag;
-  thisZ0Graph.SetName(aName.str().c_str());
+  thisZ0Graph.name = aName.str();
   // Prepare plots: p
-  thisPGraph.SetTitle("Momentum error;#eta;#sigma (#delta p/p) [%]");
+  thisPGraph.title = "Momentum error;#eta;#sigma (#delta p/p) [%]";
   aName.str(""); aName << "p_vs_eta" << momentum << graphTag;
-  thisPGraph.SetName(aName.str().c_str());
+  thisPGraph.name = aName.str();
  
+  // In the binned mode the tracks are summed in eta bins, each of which gives one point: the mean eta and value of its tracks
+  struct BinSum { int n; double eta, value; };
+  std::map<GraphBag::Series*, std::vector<BinSum> > binSums;
+  double etaMax = 0;
+  if (resolutionGraphBins_ > 0) {
+    for (const auto& myTrack : aTrackCollection) etaMax = MAX(etaMax, myTrack.getEta());
+  }
+  if (resolutionGraphBins_ <= 0) {
+    for (GraphBag::Series* series : { &thisRhoGraph, &thisPhiGraph, &thisDGraph, &thisCtgThetaGraph, &thisZ0Graph, &thisPGraph }) {
+      series->x.reserve(series->x.size() + aTrackCollection.size());
+      series->y.reserve(series->y.size() + aTrackCollection.size());
+    }
+  }
+  auto addPoint = [&](GraphBag::Series& graph, double eta, double value) {
+    if (resolutionGraphBins_ <= 0) {
+      graph.addPoint(eta, value);
+      return;
+    }
+    std::vector<BinSum>& sums = binSums[&graph];
+    if (sums.empty()) sums.assign(resolutionGraphBins_, BinSum{0, 0., 0.});
+    BinSum& sum = sums[etaMax > 0 ? MAX(0, MIN(resolutionGraphBins_ - 1, int(eta / etaMax * resolutionGraphBins_))) : 0];
+    sum.n++;
+    sum.eta += eta;
+    sum.value += value;
+  };
+
   // track loop
   double graphValue;
   for ( const auto& myTrack : aTrackCollection ) {
@@ -1648,32 +2791,38 @@ void Analyzer::calculateGraphs(const int& parameter,
     if (drho>0) {
       // deltaRho / rho = deltaRho * R
       graphValue = (drho * R) * 100; // in percent
-      thisRhoGraph.SetPoint(thisRhoGraph.GetN(), eta, graphValue);
+      addPoint(thisRhoGraph, eta, graphValue);
     }
 
     if (dphi>0) {
       graphValue = dphi; // radians is ok
-      thisPhiGraph.SetPoint(thisPhiGraph.GetN(), eta, graphValue);
+      addPoint(thisPhiGraph, eta, graphValue);
     }
 
     if (dd>0) {
       graphValue = dd / 10.; // in cm
-      thisDGraph.SetPoint(thisDGraph.GetN(), eta, graphValue );
+      addPoint(thisDGraph, eta, graphValue);
     }
 
     if (dctg>0) {
       graphValue = dctg; // An absolute number
-      thisCtgThetaGraph.SetPoint(thisCtgThetaGraph.GetN(), eta, graphValue);
+      addPoint(thisCtgThetaGraph, eta, graphValue);
     }
 
     if (dz0>0) {
         graphValue =  (dz0) / 10.; // in cm
-        thisZ0Graph.SetPoint(thisZ0Graph.GetN(), eta, graphValue);
+        addPoint(thisZ0Graph, eta, graphValue);
     }
 
     if ((dp>0)||true) {
       graphValue = dp * 100.; // in percent 
-      thisPGraph.SetPoint(thisPGraph.GetN(), eta, graphValue);
+      addPoint(thisPGraph, eta, graphValue);
+    }
+  }
+
+  for (const auto& graphSums : binSums) {
+    for (const BinSum& sum : graphSums.second) {
+      if (sum.n) graphSums.first->addPoint(sum.eta / sum.n, sum.value / sum.n);
     }
   }
 }
@@ -1756,18 +2905,8 @@ void Analyzer::clearMaterialBudgetHistograms() {
   isor.SetNameTitle("isor", "Radiation Length Contours");
   isoi.Reset();
   isoi.SetNameTitle("isoi", "Interaction Length Contours");
-  mapRadiation.Reset();
-  mapRadiation.SetName("mapRadiation");
-  mapRadiation.SetTitle("Radiation length map (raw);z [mm];r [mm]");
-  mapInteraction.Reset();
-  mapInteraction.SetName("mapInteraction");
-  mapInteraction.SetTitle("Interaction length map (raw);z [mm];r [mm]");
-  mapRadiationCount.Reset();
-  mapRadiationCount.SetName("mapRadiationCount");
-  mapRadiationCount.SetTitle("Radiation length hit count map;z [mm];r [mm]");
-  mapInteractionCount.Reset();
-  mapInteractionCount.SetName("mapInteractionCount");
-  mapInteractionCount.SetTitle("Interaction length hit count map;z [mm];r [mm]");
+  mapRadiation = MaterialMapTree();
+  mapInteraction = MaterialMapTree();
   mapRadiationCalib.Reset();
   mapRadiationCalib.SetName("mapRadiationCalib");
   mapRadiationCalib.SetTitle("Radiation length map;z [mm];r [mm]");
@@ -1827,44 +2966,13 @@ void Analyzer::fillTriggerPerformanceMaps(Tracker& tracker) {
   TH2D& suggestedSpacingMapAW = myMapBag.getMaps(mapBag::suggestedSpacingMapAW)[mapBag::dummyMomentum];
   TH2D& nominalCutMap = myMapBag.getMaps(mapBag::nominalCutMap)[mapBag::dummyMomentum]; 
 
-  // Compute the trigger efficiency maps. The pT values are given by
-  // the maps
-  for (std::map<double, TH2D>::iterator it = efficiencyMaps.begin();
-       it!=efficiencyMaps.end(); ++it) {
-    double myPt = it->first;
-    TH2D& myMap = it->second;
-
-    // Reset the our map, in case it is not empty
-    for (int i=1; i<=myMap.GetNbinsX(); ++i)
-      for (int j=1; j<=myMap.GetNbinsY(); ++j)
-        myMap.SetBinContent(i,j,0);
-
-
-    TriggerEfficiencyMapVisitor temv(myMap, myPt);
-    simParms_->accept(temv);
-    tracker.accept(temv);
-    temv.postVisit();
-  }
-
-  // Compute the trigger threshold maps. The efficiency values are
-  // given by the maps
-  for (std::map<double, TH2D>::iterator it = thresholdMaps.begin();
-       it!=thresholdMaps.end(); ++it) {
-    double myEfficiency = it->first;
-    TH2D& myMap = it->second;
-
-    // Reset the our map, in case it is not empty
-    for (int i=1; i<=myMap.GetNbinsX(); ++i)
-      for (int j=1; j<=myMap.GetNbinsY(); ++j)
-        myMap.SetBinContent(i,j,0);
-
-
-    PtThresholdMapVisitor ptmv(myMap, myEfficiency);
-    simParms_->accept(ptmv);
-    tracker.accept(ptmv);
-    ptmv.postVisit();
-
-  }
+  // Compute the trigger efficiency maps (for the pT values given by the maps)
+  // and the trigger threshold maps (for the efficiency values given by the maps)
+  // in one pass, with the values computed once per class of identical modules
+  TriggerPerformanceMapVisitor tpmv(efficiencyMaps, thresholdMaps);
+  simParms_->accept(tpmv);
+  tracker.accept(tpmv);
+  tpmv.postVisit();
 
   // Then: single maps
 
@@ -2100,7 +3208,6 @@ void Analyzer::clearGeometryHistograms() {
   // geometry analysis
   mapPhiEta.Reset();
   mapPhiEta.SetNameTitle("mapPhiEta", "Number of hits;#phi;#eta");
-  etaProfileCanvas.SetName("etaProfileCanvas"); etaProfileCanvas.SetTitle("Eta Profiles");
   hitDistribution.Reset();
   hitDistribution.SetNameTitle("hitDistribution", "Hit distribution");
   //geomLite->SetName("geometryLite");   geomLite->SetTitle("Modules geometry");
@@ -2168,18 +3275,25 @@ void Analyzer::setHistogramBinsBoundaries(int bins, double min, double max) {
   // global
   rglobal.SetBins(bins, min, max);
   iglobal.SetBins(bins, min, max);
+  if (!fillMaterialMaps_) { // a single bin is kept, releasing the memory of any previous scan
+    for (TH2* map : std::initializer_list<TH2*>{&isor, &isoi, &mapRadiationCalib, &mapInteractionCalib}) {
+      map->SetBins(1, 0.0, max_length, 1, 0.0, outer_radius + volume_width);
+    }
+    mapRadiation = MaterialMapTree();
+    mapInteraction = MaterialMapTree();
+    return;
+  }
   // isolines
   isor.SetBins(bins, 0.0, max_length, bins / 2, 0.0, outer_radius + volume_width);
   isoi.SetBins(bins, 0.0, max_length, bins / 2, 0.0, outer_radius + volume_width);
-  // Material distribution maps
-  int materialMapBinsY = int( (outer_radius + volume_width) * 1.1 / 5.); // every half a cm
-  int materialMapBinsX = int( (max_length) * 1.1 / 5.); // every half a cm
-  mapRadiation.SetBins(materialMapBinsX, 0.0, max_length*1.1, materialMapBinsY, 0.0, (outer_radius + volume_width) * 1.1);
-  mapInteraction.SetBins(materialMapBinsX, 0.0, max_length*1.1, materialMapBinsY, 0.0, (outer_radius + volume_width) * 1.1);
-  mapRadiationCount.SetBins(materialMapBinsX, 0.0, max_length*1.1, materialMapBinsY, 0.0, (outer_radius + volume_width) * 1.1);
-  mapInteractionCount.SetBins(materialMapBinsX, 0.0, max_length*1.1, materialMapBinsY, 0.0, (outer_radius + volume_width) * 1.1);
-  mapRadiationCalib.SetBins(materialMapBinsX, 0.0, max_length*1.1, materialMapBinsY, 0.0, (outer_radius + volume_width) * 1.1);
-  mapInteractionCalib.SetBins(materialMapBinsX, 0.0, max_length*1.1, materialMapBinsY, 0.0, (outer_radius + volume_width) * 1.1);
+  // Material distribution maps: the bins are whole, for the cells of the trees (a power of two of bins wide) to nest in them
+  int materialMapBinsY = int(ceil((outer_radius + volume_width) * 1.1 / materialMapBinWidth));
+  int materialMapBinsX = int(ceil(max_length * 1.1 / materialMapBinWidth));
+  double materialMapSize = materialMapBinWidth * pow(2., ceil(log2(MAX(materialMapBinsX, materialMapBinsY))));
+  mapRadiation.reset(materialMapSize, materialMapBinWidth / materialMapCellsPerBin, materialMapMaxCells, materialMapTolerance);
+  mapInteraction.reset(materialMapSize, materialMapBinWidth / materialMapCellsPerBin, materialMapMaxCells, materialMapTolerance);
+  mapRadiationCalib.SetBins(materialMapBinsX, 0.0, materialMapBinsX * materialMapBinWidth, materialMapBinsY, 0.0, materialMapBinsY * materialMapBinWidth);
+  mapInteractionCalib.SetBins(materialMapBinsX, 0.0, materialMapBinsX * materialMapBinWidth, materialMapBinsY, 0.0, materialMapBinsY * materialMapBinWidth);
 }
 
 /**
@@ -2195,6 +3309,10 @@ void Analyzer::setCellBoundaries(int bins, double minr, double maxr, double mine
   double rstep, etastep;
   rstep = 2 * (maxr - minr) / bins;
   etastep = (maxeta - mineta) / bins;
+  cellMinR_ = minr;
+  cellStepR_ = rstep;
+  cellMinEta_ = mineta;
+  cellStepEta_ = etastep;
   Cell c;
   c.rmin = 0.0;  // TODO: is this right?
   c.rmax = 0.0;
@@ -2223,15 +3341,10 @@ void Analyzer::setCellBoundaries(int bins, double minr, double maxr, double mine
  * @param il The local interaction length
  */
 void Analyzer::fillMapRT(const double& r, const double& theta, const Material& mat) {
+  if (!fillMaterialMaps_) return;
   double z = r /tan(theta);
-  if (mat.radiation>0){
-    mapRadiation.Fill(z,r,mat.radiation);
-    mapRadiationCount.Fill(z,r);
-  } 
-  if (mat.interaction>0) {
-    mapInteraction.Fill(z,r,mat.interaction);
-    mapInteractionCount.Fill(z,r);
-  }
+  if (mat.radiation>0) fillMap(mapRadiation, z, r, mat.radiation);
+  if (mat.interaction>0) fillMap(mapInteraction, z, r, mat.interaction);
 }
 
 /**
@@ -2242,31 +3355,16 @@ void Analyzer::fillMapRT(const double& r, const double& theta, const Material& m
  * @param il The local interaction length
  */
 void Analyzer::fillMapRZ(const double& r, const double& z, const Material& mat) {
-  if (mat.radiation>0){
-    mapRadiation.Fill(z,r,mat.radiation);
-    mapRadiationCount.Fill(z,r);
-  } 
-  if (mat.interaction>0) {
-    mapInteraction.Fill(z,r,mat.interaction);
-    mapInteractionCount.Fill(z,r);
-  }
+  if (!fillMaterialMaps_) return;
+  if (mat.radiation>0) fillMap(mapRadiation, z, r, mat.radiation);
+  if (mat.interaction>0) fillMap(mapInteraction, z, r, mat.interaction);
 }
 
 /**
  * @return a (hit-scaled) map of radiation length
  */
 TH2D& Analyzer::getHistoMapRadiation() {
-  int nBins = mapRadiation.GetNbinsX()*mapRadiation.GetNbinsY();
-  double content;
-  double count;
-  for (int iBin=1; iBin<=nBins; ++iBin) {
-    content = mapRadiation.GetBinContent(iBin);
-    count = mapRadiationCount.GetBinContent(iBin);
-    //mapRadiationCalib.SetBinContent(iBin,content);
-    if (count==1) mapRadiationCalib.SetBinContent(iBin,content);
-    else if (count>1) mapRadiationCalib.SetBinContent(iBin,content/double(count));
-    //else if (count==0) mapRadiationCalib.SetBinContent(iBin, 0.);
-  }
+  mapRadiation.flatten(mapRadiationCalib);
   return mapRadiationCalib;
 }
 
@@ -2274,17 +3372,7 @@ TH2D& Analyzer::getHistoMapRadiation() {
  * @return a (hit-scaled) map of interaction length
  */
 TH2D& Analyzer::getHistoMapInteraction() {
-  int nBins = mapInteraction.GetNbinsX()*mapInteraction.GetNbinsY();
-  double content;
-  double count;
-  for (int iBin=1; iBin<=nBins; ++iBin) {
-    content = mapInteraction.GetBinContent(iBin);
-    count = mapInteractionCount.GetBinContent(iBin);
-    //mapInteractionCalib.SetBinContent(iBin,content);
-    if (count==1) mapInteractionCalib.SetBinContent(iBin,content);
-    else if (count>1) mapInteractionCalib.SetBinContent(iBin,content/double(count));
-    //else if (count==0) mapInteractionCalib.SetBinContent(iBin, 0.);
-  }
+  mapInteraction.flatten(mapInteractionCalib);
   return mapInteractionCalib;
 }
 
@@ -2298,20 +3386,28 @@ TH2D& Analyzer::getHistoMapInteraction() {
  * @param il The local interaction length
  */
 void Analyzer::fillCell(double r, double eta, double theta, Material mat) {
+  if (currentMaterialTrackRecord) {
+    currentMaterialTrackRecord->cellFills.push_back({r, eta, theta, mat});
+    return;
+  }
   double rl = mat.radiation;
   double il = mat.interaction;
   int rindex, etaindex;
-  if (cells.size() > 0) {
-    for (rindex = 0; (unsigned int) rindex < cells.at(0).size(); rindex++) {
-      if ((cells.at(0).at(rindex).rmin <= r) && (cells.at(0).at(rindex).rmax > r)) break;
-    }
-    if ((unsigned int) rindex < cells.at(0).size()) {
-      for (etaindex = 0; (unsigned int) etaindex < cells.size(); etaindex++) {
-        if ((cells.at(etaindex).at(rindex).etamin <= eta) && (cells.at(etaindex).at(rindex).etamax > eta)) break;
-      }
-      if ((unsigned int) etaindex < cells.size()) {
-        cells.at(etaindex).at(rindex).rlength = cells.at(etaindex).at(rindex).rlength + rl;
-        cells.at(etaindex).at(rindex).ilength = cells.at(etaindex).at(rindex).ilength + il;
+  if ((cells.size() > 0) && (cells.at(0).size() > 0)) {
+    const std::vector<Cell>& rcells = cells.at(0);
+    int nr = rcells.size();
+    // the cells are a partition of [minr, maxr) x [mineta, maxeta): the index is computed, then checked against the cell edges
+    rindex = cellIndexGuess(r, cellMinR_, cellStepR_, nr);
+    while ((rindex > 0) && (rcells[rindex - 1].rmax > r)) rindex--;
+    while ((rindex < nr) && (rcells[rindex].rmax <= r)) rindex++;
+    if ((rindex < nr) && (rcells[rindex].rmin <= r)) {
+      int neta = cells.size();
+      etaindex = cellIndexGuess(eta, cellMinEta_, cellStepEta_, neta);
+      while ((etaindex > 0) && (cells[etaindex - 1][rindex].etamax > eta)) etaindex--;
+      while ((etaindex < neta) && (cells[etaindex][rindex].etamax <= eta)) etaindex++;
+      if ((etaindex < neta) && (cells[etaindex][rindex].etamin <= eta)) {
+        cells[etaindex][rindex].rlength += rl;
+        cells[etaindex][rindex].ilength += il;
       }
     }
   }
@@ -2385,16 +3481,13 @@ void Analyzer::transformEtaToZ() {
  */
 int Analyzer::findCellIndexR(double r) {
   int index = -1;
-  if (r >= 0) {
-    if (cells.size() > 0) {
-      index = 0;
-      while (index < (int)cells.at(0).size()) {
-        if (cells.at(0).at(index).rmax < r) index++;
-        else break;
-      }
-      if (index == (int)cells.at(0).size()) index = -1;
-      return index;
-    }
+  if ((r >= 0) && (cells.size() > 0) && (cells.at(0).size() > 0)) {
+    const std::vector<Cell>& rcells = cells.at(0);
+    int n = rcells.size();
+    index = cellIndexGuess(r, cellMinR_, cellStepR_, n);
+    while ((index > 0) && (rcells[index - 1].rmax >= r)) index--;
+    while ((index < n) && (rcells[index].rmax < r)) index++;
+    if (index == n) index = -1;
   }
   return index;
 }
@@ -2406,24 +3499,32 @@ int Analyzer::findCellIndexR(double r) {
  */
 int Analyzer::findCellIndexEta(double eta) {
   int index = -1;
-  if (eta >= 0) {
-    index = 0;
-    while (index < (int)cells.size()) {
-      if (cells.at(index).size() > 0) {
-        if (cells.at(index).at(0).etamax < eta) index++;
-        else break;
-      }
-      else {
-        index = -1;
-        break;
-      }
-    }
-    if (index == (int)cells.size()) index = -1;
-    return index;
+  if ((eta >= 0) && (cells.size() > 0) && (cells.at(0).size() > 0)) {
+    int n = cells.size();
+    index = cellIndexGuess(eta, cellMinEta_, cellStepEta_, n);
+    while ((index > 0) && (cells[index - 1][0].etamax >= eta)) index--;
+    while ((index < n) && (cells[index][0].etamax < eta)) index++;
+    if (index == n) index = -1;
   }
   return index;
 }
 
+/**
+ * The index of the cell a value falls in, computed from the lower edge and the width of the cells. Because of rounding,
+ * the result can be one cell off for values close to an edge, so the callers compare it with the cell edges themselves.
+ * @param x The value
+ * @param min The lower edge of the first cell
+ * @param step The width of the cells
+ * @param n The number of cells
+ * @return The index of the cell, clamped to [0, n-1]
+ */
+int Analyzer::cellIndexGuess(double x, double min, double step, int n) {
+  double index = (x - min) / step;
+  if (!(index > 0)) return 0;
+  if (index >= n) return n - 1;
+  return int(index);
+}
+
 
 std::pair<double, double> Analyzer::computeMinMaxTracksEta(const Tracker& t) const {
   std::pair <double, double> etaMinMax = t.computeMinMaxEta();
@@ -2440,7 +3541,7 @@ std::pair<double, double> Analyzer::computeMinMaxTracksEta(const Tracker& t) con
  */
 void Analyzer::analyzeGeometry(Tracker& tracker, int nTracks /*=1000*/ ) {
   geometryTracksUsed = nTracks;
-  savingGeometryV.clear();
+  geometrySamples_.clear();
   clearGeometryHistograms();
 
 
@@ -2462,10 +3563,21 @@ void Analyzer::analyzeGeometry(Tracker& tracker, int nTracks /*=1000*/ ) {
   double randomSpan = (etaMinMax.second - etaMinMax.first)*(1. + randomPercentMargin);
   double randomBase = etaMinMax.first - (etaMinMax.second - etaMinMax.first)*(randomPercentMargin)/2.;
   double maxEta = etaMinMax.second *= (1 + randomPercentMargin);
+  // Only shoot the tracks in the eta region of interest, if one is set; the tracks of layouts being compared all take it as it is
+  if (recordTrackSamples_ && std::isfinite(geometryTrackMinEta_) && std::isfinite(geometryTrackMaxEta_)) {
+    randomBase = geometryTrackMinEta_;
+    randomSpan = geometryTrackMaxEta_ - geometryTrackMinEta_;
+  } else if (geometryTrackMinEta_ > randomBase || geometryTrackMaxEta_ < randomBase + randomSpan) {
+    double roiBase = MAX(randomBase, geometryTrackMinEta_);
+    double roiSpan = MIN(randomBase + randomSpan, geometryTrackMaxEta_) - roiBase;
+    if (roiSpan > 0) {
+      randomBase = roiBase;
+      randomSpan = roiSpan;
+    } else logWARNING("The eta region of interest of the geometry tracks is outside of the tracker: the tracks are shot over the whole tracker");
+  }
 
 
-  // Initialize random number generator, counters and histograms
-  myDice.SetSeed(MY_RANDOM_SEED);
+  // Initialize counters and histograms
   createResetCounters(tracker, moduleTypeCount);
   createResetCounters(tracker, sensorTypeCount);
   createResetCounters(tracker, moduleTypeCountStubs);
@@ -2526,9 +3638,6 @@ void Analyzer::analyzeGeometry(Tracker& tracker, int nTracks /*=1000*/ ) {
   double zError = simParms().zErrorCollider();
 
   // The real simulation
-  std::pair <XYZVector, double> aLine;
-
-
   int nTracksPerSide = int(pow(nTracks, 0.5));
   int nBlocks = int(nTracksPerSide/2.);
   nTracks = nTracksPerSide*nTracksPerSide;
@@ -2560,73 +3669,191 @@ void Analyzer::analyzeGeometry(Tracker& tracker, int nTracks /*=1000*/ ) {
 
   std::map<std::string, int> modulePlotColors; // CUIDADO quick and dirty way of creating a map with all the module colors (a cleaner way would be to have the map already created somewhere else)
 
+  // The inner and outer sensor and the eta range of each module, in the order trackHit() goes through them
+  if (!tracker.frozen()) tracker.freeze();
+  const Tracker::FrozenModules& frozenModules = tracker.frozenModules();
+  geometryTables_.hitPolys.clear();
+  geometryTables_.etaRanges.clear();
+  for (const ModuleGeometry& g : frozenModules) {
+    Module* m = g.module;
+    geometryTables_.hitPolys.add(m->innerSensor().hitPoly(), m->innerSensor().stripLength());
+    geometryTables_.hitPolys.add(m->outerSensor().hitPoly(), m->outerSensor().stripLength());
+    geometryTables_.etaRanges.push_back(m->minMaxEtaWithError(zError*BoundaryEtaSafetyMargin));
+  }
+  geometryTables_.moduleIndex.build(frozenModules, -zError, zError, geometryIndexSlices_, geometryIndexGranularity_);
+  // the tables and the frozen modules are read by every track: the threads of each NUMA node read their own copy
+  geometryReplicas_.replicate(geometryTables_);
+  NodeReplicas<Tracker::FrozenModules> frozenReplicas;
+  frozenReplicas.replicate(frozenModules);
+
+  // The module types and the layers resolved once to dense ids, and their profiles to pointers, so that counting the hits
+  // of a track neither hashes nor compares strings
+  const std::vector<std::string>& moduleTypes = tracker.frozenModuleTypes();
+  std::vector<TProfile*> typeProfiles, typeProfilesSensors, typeProfilesStubs;
+  for (const std::string& type : moduleTypes) {
+    typeProfiles.push_back(&etaProfileByType[type]);
+    typeProfilesSensors.push_back(&etaProfileByTypeSensors[type]);
+    typeProfilesStubs.push_back(&etaProfileByTypeStubs[type]);
+  }
+  std::map<std::string, int> layerIds;
+  std::vector<TProfile*> layerProfiles, layerProfilesStubs;
+  for (const std::string& layerName : layerNames.data) {
+    layerIds[layerName] = layerProfiles.size();
+    layerProfiles.push_back(&layerEtaCoverageProfile[layerName]);
+    layerProfilesStubs.push_back(&layerEtaCoverageProfileStubs[layerName]);
+  }
+  std::vector<int> moduleLayerIds; // by module index, -1 for a module out of the listed layers
+  moduleLayerIds.reserve(frozenModules.size());
+  std::unordered_map<ModuleKey, int> layerKeyIds; // the name of a layer is only formatted for its first module
+  for (const ModuleGeometry& g : frozenModules) {
+    auto layerKeyId = layerKeyIds.insert(std::make_pair(g.key.layerKey(), -1));
+    if (layerKeyId.second) {
+      auto layerId = layerIds.find(g.module->cntName() + " " + any2str(g.key.layer()));
+      if (layerId != layerIds.end()) layerKeyId.first->second = layerId->second;
+    }
+    moduleLayerIds.push_back(layerKeyId.first->second);
+  }
+  std::vector<int> typeHits(moduleTypes.size()), typeSensorHits(moduleTypes.size()), typeStubs(moduleTypes.size());
+  const int noColor = std::numeric_limits<int>::min();
+  std::vector<int> typeColors(moduleTypes.size(), noColor); // the plot color of the types which were hit
+  std::vector<char> layerHits(layerProfiles.size()), layerStubs(layerProfiles.size());
+
+  long indexLookups = 0, indexCandidates = 0, indexHits = 0;
+  double helixRadius = simParms().particleCurvatureR(geometryTrackPt_);
+  if (geometryTrackPt_ > 0) logINFO("Geometry tracks: following helices of pt " + any2str(geometryTrackPt_) + " GeV/c, of radius " + any2str(helixRadius, 1) + " mm");
+
   //XYZVector dir(0, 1, 0);
-  // Shoot nTracksPerSide^2 tracks
-  double angle = M_PI/2/(double)nTracksPerSide;
-  for (int i=0; i<nTracksPerSide; i++) {
-    for (int j=0; j<nTracksPerSide; j++) {
-      // Reset the hit counter
-      // Generate a straight track and collect the list of hit modules
-      aLine = shootDirection(randomBase, randomSpan);
-      std::vector<std::pair<Module*, HitType>> hitModules = trackHit( XYZVector(0, 0, ((myDice.Rndm()*2)-1)* zError), aLine.first, tracker.modules());
-      // Reset the per-type hit counter and fill it
-      resetTypeCounter(moduleTypeCount);
-      resetTypeCounter(sensorTypeCount);
-      resetTypeCounter(moduleTypeCountStubs);
+  // Shoot nTracksPerSide^2 tracks: the rows of a chunk are shot concurrently, then their hits are counted in track order.
+  // With a time budget, rows of nTracksPerSide tracks are shot until it is spent, however many they are.
+  struct GeometryTrack { std::pair<XYZVector, double> line; std::vector<std::pair<Module*, HitType>> hitModules; int candidates; };
+  // The chunks are sized after the cost of their rows, except when the scan stops at the end of the chunk where the
+  // coverage profile is precise enough, for the number of tracks shot not to depend on the speed of the machine
+  int rowsPerChunk = MAX(1, geometryTracksPerThreadChunk * numThreads_ / MAX(1, nTracksPerSide));
+  ChunkSizer chunks(rowsPerChunk, rowsPerChunk * maxTrackChunkGrowth, geometryTrackPrecision_ > 0 ? 0. : trackChunkSeconds);
+  int maxRows = geometryTrackSeconds_ > 0 ? std::numeric_limits<int>::max() / MAX(1, nTracksPerSide) : nTracksPerSide;
+  std::chrono::steady_clock::time_point geometryStart = std::chrono::steady_clock::now();
+  std::vector<GeometryTrack> chunkTracks;
+  ProgressMeter progress("Geometry tracks", geometryTrackSeconds_ > 0 ? 0 : (long)maxRows * nTracksPerSide);
+  for (int firstRow=0, lastRow; firstRow<maxRows; firstRow=lastRow) {
+    lastRow = firstRow + MIN(maxRows - firstRow, chunks.size());
+    chunks.start();
+    chunkTracks.assign((lastRow - firstRow)*nTracksPerSide, GeometryTrack());
+    parallelFor("Geometry tracks", firstRow, lastRow, [&](int i) {
+      timePathScope("Analyzer geometry track row");
+      const Tracker::FrozenModules& localModules = frozenReplicas.local(frozenModules);
+      for (int j=0; j<nTracksPerSide; j++) {
+        // Generate a straight track and collect the list of hit modules
+        GeometryTrack& aTrack = chunkTracks[(i - firstRow)*nTracksPerSide + j];
+        double uPhi, uEta, uZ;
+        if (quasiRandomTracks_) {
+          unsigned int k = i*nTracksPerSide + j + 1;
+          uPhi = radicalInverse(k, 2);
+          uEta = radicalInverse(k, 3);
+          uZ = radicalInverse(k, 5);
+        } else {
+          // every track has its own random stream, so that the tracks do not depend on how the rows are shared among threads
+          CounterRandom dice(randomSeed_, CounterRandom::GeometryTracks, (long long)i*nTracksPerSide + j);
+          uPhi = dice.uniform();
+          uEta = dice.uniform();
+          uZ = dice.uniform();
+        }
+        aTrack.line = shootDirection(randomBase, randomSpan, uPhi, uEta, geometryTrackMinPhi_, geometryTrackMaxPhi_ - geometryTrackMinPhi_,
+                                     stratifyGeometryTrackEta_ ? j : 0, stratifyGeometryTrackEta_ ? nTracksPerSide : 1);
+        XYZVector origin(0, 0, ((uZ*2)-1)* zError);
+        if (geometryTrackPt_ > 0) {
+          HelixPropagator helix(origin, aTrack.line.first.Phi(), aTrack.line.first.Eta(), helixRadius, j%2 ? -1 : 1);
+          aTrack.hitModules = trackHelixHit(helix, tracker.maxR(), tracker.maxZ(), origin, localModules, &aTrack.candidates);
+        } else {
+          aTrack.hitModules = trackHit(origin, aTrack.line.first, localModules, &aTrack.candidates);
+        }
+      }
+      progress.advance(nTracksPerSide);
+    });
+
+    timePathScope("Analyzer geometry histogram fills");
+    for (const GeometryTrack& aTrack : chunkTracks) {
+      const std::pair<XYZVector, double>& aLine = aTrack.line;
+      const std::vector<std::pair<Module*, HitType>>& hitModules = aTrack.hitModules;
+      indexLookups++;
+      indexCandidates += aTrack.candidates;
+      indexHits += hitModules.size();
+      // Reset the per-type hit counters and fill them
+      std::fill(typeHits.begin(), typeHits.end(), 0);
+      std::fill(typeSensorHits.begin(), typeSensorHits.end(), 0);
+      std::fill(typeStubs.begin(), typeStubs.end(), 0);
+      std::fill(layerHits.begin(), layerHits.end(), 0);
+      std::fill(layerStubs.begin(), layerStubs.end(), 0);
       int numStubs = 0;
       int numHits = 0;
       for (auto& mh : hitModules) {
-        moduleTypeCount[mh.first->moduleType()]++;
+        int moduleIndex = mh.first->moduleIndex();
+        int typeId = frozenModules[moduleIndex].typeId;
+        int layerId = moduleLayerIds[moduleIndex];
+        moduleHitCounts_[moduleIndex]++;
+        typeHits[typeId]++;
+        if (layerId >= 0) layerHits[layerId] = 1;
         if (mh.second & HitType::INNER) {
-          sensorTypeCount[mh.first->moduleType()]++;
+          typeSensorHits[typeId]++;
           numHits++;
         }
         if (mh.second & HitType::OUTER) {
-          sensorTypeCount[mh.first->moduleType()]++;
+          typeSensorHits[typeId]++;
           numHits++;
         }
         if (mh.second == HitType::STUB) {
-          moduleTypeCountStubs[mh.first->moduleType()]++;
+          typeStubs[typeId]++;
+          if (layerId >= 0) layerStubs[layerId] = 1;
           numStubs++;
         }
-        modulePlotColors[mh.first->moduleType()] = mh.first->plotColor();
+        typeColors[typeId] = mh.first->plotColor();
       }
       // Fill the module type hit plot
-      for (std::map <std::string, int>::iterator it = moduleTypeCount.begin(); it!=moduleTypeCount.end(); it++) {
-        etaProfileByType[(*it).first].Fill(fabs(aLine.second), (*it).second);
-      }
-
-      for (auto& mel : sensorTypeCount) {
-        etaProfileByTypeSensors[mel.first].Fill(fabs(aLine.second), mel.second);
-      }
-
-      for (auto& mel : moduleTypeCountStubs) {
-        etaProfileByTypeStubs[mel.first].Fill(fabs(aLine.second), mel.second);
+      for (size_t t = 0; t < moduleTypes.size(); t++) {
+        typeProfiles[t]->Fill(fabs(aLine.second), typeHits[t]);
+        typeProfilesSensors[t]->Fill(fabs(aLine.second), typeSensorHits[t]);
+        typeProfilesStubs[t]->Fill(fabs(aLine.second), typeStubs[t]);
       }
       // Fill other plots
       mapPhiEta.Fill(aLine.first.Phi(), aLine.second, hitModules.size()); // phi, eta 2d plot
       mapPhiEtaCount.Fill(aLine.first.Phi(), aLine.second);               // Number of shot tracks
 
       totalEtaProfile.Fill(fabs(aLine.second), hitModules.size());                // Total number of hits
+      if (recordTrackSamples_) geometrySamples_.push_back({ aLine.second, double(hitModules.size()), double(numStubs) });
       totalEtaProfileSensors.Fill(fabs(aLine.second), numHits);
       totalEtaProfileStubs.Fill(fabs(aLine.second), numStubs); 
 
-      for (auto layerName : layerNames.data) {
-        int layerHit = 0;
-        int layerStub = 0;
-        for (auto mh : hitModules) {
-          UniRef ur = mh.first->uniRef();
-          if (layerName == (ur.cnt + " " + any2str(ur.layer))) {
-            layerHit=1;
-            if (mh.second == HitType::STUB) layerStub=1;
-            if (layerHit && layerStub) break;
-          }
-        }
-        layerEtaCoverageProfile[layerName].Fill(aLine.second, layerHit);
-        layerEtaCoverageProfileStubs[layerName].Fill(aLine.second, layerStub);
+      for (size_t l = 0; l < layerProfiles.size(); l++) {
+        layerProfiles[l]->Fill(aLine.second, layerHits[l]);
+        layerProfilesStubs[l]->Fill(aLine.second, layerStubs[l]);
       }
 
     }
+    chunks.done(lastRow - firstRow);
+
+    // In the adaptive mode, stop as soon as the coverage profile is precise enough; with a time budget, once it is spent
+    bool outOfTime = geometryTrackSeconds_ > 0 &&
+                     std::chrono::duration<double>(std::chrono::steady_clock::now() - geometryStart).count() >= geometryTrackSeconds_;
+    if (geometryTrackPrecision_ > 0 || outOfTime) {
+      double worstError = worstRelativeError(totalEtaProfile);
+      bool precise = geometryTrackPrecision_ > 0 && worstError <= geometryTrackPrecision_;
+      if (precise || outOfTime || lastRow == maxRows) {
+        geometryTracksUsed = nTracks = lastRow * nTracksPerSide; // the hit fractions of the modules are over the tracks actually shot
+        if (precise) logINFO("Geometry tracks: a relative precision of " + any2str(worstError) + " was reached in every bin of the coverage profile after " + any2str(geometryTracksUsed) + " tracks");
+        else if (outOfTime) logINFO("Geometry tracks: the time budget of " + any2str(geometryTrackSeconds_, 1) + " s was spent after " + any2str(geometryTracksUsed) + " tracks, the worst bin of the coverage profile being at a relative precision of " + any2str(worstError));
+        else if (geometryTrackPrecision_ > 0) logWARNING("Geometry tracks: the relative precision of " + any2str(geometryTrackPrecision_) + " was not reached after all the " + any2str(geometryTracksUsed) + " tracks, the worst bin being at " + any2str(worstError));
+        break;
+      }
+    }
+  }
+  logDEBUG(chunks.summary("Geometry track rows"));
+  geometryTrackWorstError_ = worstRelativeError(totalEtaProfile);
+  for (size_t t = 0; t < moduleTypes.size(); t++) {
+    if (typeColors[t] != noColor) modulePlotColors[moduleTypes[t]] = typeColors[t];
+  }
+  if (indexLookups) {
+    logINFO("Geometry tracks: the module index has " + any2str(geometryTables_.moduleIndex.numBins()) + " bins listing " + any2str(geometryTables_.moduleIndex.numEntries())
+            + " candidates, " + any2str(double(indexCandidates)/indexLookups, 1) + " of which were tested per track, for " + any2str(double(indexHits)/indexLookups, 1)
+            + " hits (" + any2str(indexCandidates ? 100.*indexHits/indexCandidates : 0., 1) + "% hit rate)");
   }
 
   // Create and archive for saving our 2D map of hits
@@ -2642,29 +3869,19 @@ void Analyzer::analyzeGeometry(Tracker& tracker, int nTracks /*=1000*/ ) {
     }
   }
 
-  savingGeometryV.push_back(mapPhiEta);
-
   // Eta profile compute
   //TProfile *myProfile;
 
-  etaProfileCanvas.cd();
-  savingGeometryV.push_back(etaProfileCanvas);
-
   //TProfile* total = total2D.ProfileX("etaProfileTotal");
   char profileName_[256];
   sprintf(profileName_, "etaProfileTotal%d", bsCounter++);
   // totalEtaProfile = TProfile(*total2D.ProfileX(profileName_));
-  savingGeometryV.push_back(totalEtaProfile);
   if (totalEtaProfile.GetMaximum()<maximum_n_planes) totalEtaProfile.SetMaximum(maximum_n_planes);
   if (totalEtaProfileSensors.GetMaximum()<maximum_n_planes) totalEtaProfileSensors.SetMaximum(maximum_n_planes);
   if (totalEtaProfileStubs.GetMaximum()<maximum_n_planes) totalEtaProfileStubs.SetMaximum(maximum_n_planes);
-  totalEtaProfile.Draw();
-  totalEtaProfileSensors.Draw();
-  totalEtaProfileStubs.Draw();
   for (std::map <std::string, TProfile>::iterator it = etaProfileByType.begin();
        it!=etaProfileByType.end(); it++) {
     TProfile* myProfile=(TProfile*)it->second.Clone();
-    savingGeometryV.push_back(*myProfile); // TODO: remove savingGeometryV everywhere :-) [VERY obsolete...]
     myProfile->SetMarkerStyle(8);
     myProfile->SetMarkerColor(Palette::color(modulePlotColors[it->first]));
     myProfile->SetMarkerSize(1);
@@ -2673,7 +3890,6 @@ void Analyzer::analyzeGeometry(Tracker& tracker, int nTracks /*=1000*/ ) {
     myProfile->SetTitle((*it).first.c_str());
     myProfile->GetXaxis()->SetTitle("eta");
     myProfile->GetYaxis()->SetTitle("Number of hit modules");
-    myProfile->Draw("same");
     typeEtaProfile.push_back(*myProfile);
   }
 
@@ -2688,7 +3904,6 @@ void Analyzer::analyzeGeometry(Tracker& tracker, int nTracks /*=1000*/ ) {
     myProfile->SetTitle((*it).first.c_str());
     myProfile->GetXaxis()->SetTitle("eta");
     myProfile->GetYaxis()->SetTitle("Number of hits");
-    myProfile->Draw("same");
     typeEtaProfileSensors.push_back(*myProfile);
   }
 
@@ -2703,16 +3918,14 @@ void Analyzer::analyzeGeometry(Tracker& tracker, int nTracks /*=1000*/ ) {
     myProfile->SetTitle((*it).first.c_str());
     myProfile->GetXaxis()->SetTitle("eta");
     myProfile->GetYaxis()->SetTitle("Number of stubs");
-    myProfile->Draw("same");
     typeEtaProfileStubs.push_back(*myProfile);
   }
 
 
   // Record the fraction of hits per module
   hitDistribution.SetBins(nTracks, 0 , 1);
-  savingGeometryV.push_back(hitDistribution);
   for (auto m : tracker.modules()) {
-    hitDistribution.Fill(m->numHits()/double(nTracks));
+    hitDistribution.Fill(moduleHits(m)/double(nTracks));
   }
 
 
@@ -2764,7 +3977,7 @@ void Analyzer::createGeometryLite(Tracker& tracker) {
     // private
     /**
      * Creates a module type map
-     * It sets a different integer for each one
+     * It sets a different integer for each one and resets the module hit counts
      * @param tracker the tracker to be analyzed
      * @param moduleTypeCount the map to count the different module types
      * @return the total number of module types
@@ -2778,9 +3991,9 @@ void Analyzer::createGeometryLite(Tracker& tracker) {
       std::string aType;
       int typeCounter=0;
 
+      moduleHitCounts_.assign(tracker.modules().size(), 0);
       for (auto m : tracker.modules()) {
           aType = m->moduleType();
-          m->resetHits();
           if (moduleTypeCount.find(aType)==moduleTypeCount.end()) {
             moduleTypeCount[aType]=typeCounter++;
           }
@@ -2795,20 +4008,27 @@ void Analyzer::createGeometryLite(Tracker& tracker) {
      * gives also the direction's eta
      * @param minEta minimum eta to shoot tracks
      * @param spanEta difference between minimum and maximum eta
+     * @param uPhi the uniform [0, 1) number phi is drawn from
+     * @param uEta the uniform [0, 1) number eta is drawn from
+     * @param minPhi minimum phi to shoot tracks
+     * @param spanPhi difference between minimum and maximum phi
+     * @param etaStratum the slice of the eta range the track is shot in
+     * @param numEtaStrata the number of slices of equal width the eta range is divided into
      * @return the pair of value: pointing XYZVector and eta of the track
      */
-    std::pair <XYZVector, double > Analyzer::shootDirection(double minEta, double spanEta) {
+    std::pair <XYZVector, double > Analyzer::shootDirection(double minEta, double spanEta, double uPhi, double uEta, double minPhi, double spanPhi,
+                                                            int etaStratum, int numEtaStrata) {
       std::pair <XYZVector, double> result;
 
       double eta;
       double phi;
       double theta;
 
-      // phi is random [0, 2pi)
-      phi = myDice.Rndm() * 2 * M_PI; // debug
+      // phi is random [minPhi, minPhi + spanPhi)
+      phi = uPhi * spanPhi + minPhi;
 
-      // eta is random (-4, 4]
-      eta = myDice.Rndm() * spanEta + minEta;
+      // eta is random (minEta, minEta + spanEta], within the stratum
+      eta = (etaStratum + uEta) * spanEta / numEtaStrata + minEta;
       theta=2*atan(exp(-1*eta));
 
       // Direction
@@ -2817,39 +4037,159 @@ void Analyzer::createGeometryLite(Tracker& tracker) {
       return result;
     }
 
+    // private
+    /**
+     * The radical inverse of an integer, i.e. its digits in the given base mirrored around the decimal point: for consecutive
+     * indices and a prime base, it is one dimension of the Halton low-discrepancy sequence
+     * @param index The index of the point in the sequence, from 1
+     * @param base The base of the dimension
+     * @return The coordinate of the point, in (0, 1)
+     */
+    double Analyzer::radicalInverse(unsigned int index, unsigned int base) {
+      double inverse = 0, digitWeight = 1. / base;
+      for (; index > 0; index /= base, digitWeight /= base) inverse += (index % base) * digitWeight;
+      return inverse;
+    }
+
+    // private
+    /**
+     * The relative statistical error of the least precise bin of a profile. The bins with no entries, or whose mean is 0,
+     * are not considered; a bin with a single entry has no error estimate and counts as infinitely imprecise.
+     * @param profile The profile to be checked
+     * @return The largest ratio between the error and the mean of a bin
+     */
+    double Analyzer::worstRelativeError(const TProfile& profile) {
+      double worst = 0;
+      for (int i = 1; i <= profile.GetNbinsX(); i++) {
+        double entries = profile.GetBinEntries(i);
+        double content = profile.GetBinContent(i);
+        if (entries == 0 || content == 0) continue;
+        if (entries < 2) return std::numeric_limits<double>::infinity();
+        worst = MAX(worst, profile.GetBinError(i) / fabs(content));
+      }
+      return worst;
+    }
+
     // private
     /**
      * Checks whether a track would hit a module
      * @param origin XYZVector of origin of the track
      * @param direction pointing XYZVector of the track
-     * @param moduleV vector of modules to be checked
+     * @param moduleV the frozen geometry of the modules to be checked, which the geometry tables were built from
+     * @param numCandidates if given, set to the number of modules the index gave as candidates
      * @return the vector of hit modules
      */
-    std::vector<std::pair<Module*, HitType>> Analyzer::trackHit(const XYZVector& origin, const XYZVector& direction, Tracker::Modules& moduleV) {
+    std::vector<std::pair<Module*, HitType>> Analyzer::trackHit(const XYZVector& origin, const XYZVector& direction, const Tracker::FrozenModules& moduleV, int* numCandidates) {
       std::vector<std::pair<Module*, HitType>> result;
-      double distance;
-      static const double BoundaryEtaSafetyMargin = 5. ; // track origin shift in units of zError to compute boundaries
-
-      static std::ofstream ofs("hits.txt");
-      for (auto& m : moduleV) {
+      std::vector<int> candidates;
+      std::vector<int> polys;
+      double eta = direction.Eta(), phi = direction.Phi();
+      const GeometryTables& tables = geometryReplicas_.local(geometryTables_);
+
+      const std::vector<int>& indexCandidates = tables.moduleIndex.candidates(eta, phi, origin.Z());
+      if (numCandidates) *numCandidates = indexCandidates.size();
+      for (int k : indexCandidates) {
         // A module can be hit if it fits the phi (precise) contraints
-        // and the eta constaints (taken assuming origin within 5 sigma)
-        if (m->couldHit(direction, simParms().zErrorCollider()*BoundaryEtaSafetyMargin)) {
-          auto h = m->checkTrackHits(origin, direction); 
-          if (h.second != HitType::NONE) {
-            result.push_back(std::make_pair(m,h.second));
-          }
+        // and the eta constaints (taken assuming origin within 5 sigma): same as DetectorModule::couldHit()
+        const ModuleGeometry& g = moduleV[k];
+        bool withinEta = eta > tables.etaRanges[k].first && eta < tables.etaRanges[k].second;
+        bool withinPhi;
+        if (g.minPhi < 0. && g.maxPhi > 0. && g.maxPhi-g.minPhi > M_PI) // across PI
+          withinPhi = phi < g.minPhi || phi > g.maxPhi;
+        else
+          withinPhi = phi > g.minPhi && phi < g.maxPhi;
+        if (withinEta && withinPhi) {
+          candidates.push_back(k);
+          polys.push_back(2*k);
+          polys.push_back(2*k + 1);
+        }
+      }
+      // the sensors of all the candidates are tested at once against the track
+      std::vector<std::pair<XYZVector, int> > segments;
+      tables.hitPolys.checkHitSegments(polys, origin, direction, segments);
+      for (unsigned int i = 0; i < candidates.size(); i++) {
+        Module* m = moduleV[candidates[i]].module;
+        auto h = m->classifyTrackHits(segments[2*i], segments[2*i + 1]);
+        if (h.second != HitType::NONE) {
+          result.push_back(std::make_pair(m,h.second));
         }
       }
+      countPathValue("Analyzer::trackHit candidate modules per track", candidates.size());
+      countPathValue("Analyzer::trackHit hit modules per track", result.size());
       return result;
     }
 
-    // Resets a module type counter
-    void Analyzer::resetTypeCounter(std::map <std::string, int> &modTypes) {
-      for (std::map <std::string, int>::iterator it = modTypes.begin();
-           it!=modTypes.end(); it++) {
-        (*it).second = 0;
+    /**
+     * Checks which modules a charged track would hit along its helix, up to where it leaves the tracker or turns back.
+     * The index is looked up at points of the helix close enough for the (eta, phi) of the points, seen from the origin,
+     * to move by less than a bin between two of them, and the modules of all the bins in between are taken as candidates.
+     * The crossing of the helix with the plane of each sensor is then tested as a straight track along the tangent there.
+     * @param helix the propagator of the track
+     * @param maxRho the radius beyond which the track has left the tracker
+     * @param maxZ the |z| beyond which the track has left the tracker
+     * @param origin XYZVector of origin of the track, the origin of the helix
+     * @param moduleV the frozen geometry of the modules to be checked, which the geometry tables were built from
+     * @param numCandidates if given, set to the number of modules the index gave as candidates
+     * @return the vector of hit modules, in the order of the modules
+     */
+    std::vector<std::pair<Module*, HitType>> Analyzer::trackHelixHit(const HelixPropagator& helix, double maxRho, double maxZ, const XYZVector& origin,
+                                                                     const Tracker::FrozenModules& moduleV, int* numCandidates) {
+      std::vector<std::pair<Module*, HitType>> result;
+      std::vector<int> candidates;
+      double z0 = origin.Z();
+      double maxArc = helix.arcToRho(MIN(maxRho, helix.maxRho()));
+      if (maxArc < 0) maxArc = helix.maxArc();
+      double zArc = helix.arcToZ(maxZ);
+      if (zArc < 0) zArc = helix.arcToZ(-maxZ);
+      if (zArc >= 0) maxArc = MIN(maxArc, zArc);
+      const GeometryTables& tables = geometryReplicas_.local(geometryTables_);
+
+      double etaStep = tables.moduleIndex.etaBinWidth(z0) / 2, phiStep = tables.moduleIndex.phiBinWidth() / 2;
+      double arcStep = 2 * helix.radius() * phiStep; // the position phi turns by s/2R
+      double lastEta = helix.positionEta(0), lastPhi = helix.positionPhi(0);
+      for (double s = 0; s < maxArc; ) {
+        s = MIN(maxArc, s + arcStep);
+        double eta = helix.positionEta(s), phi = helix.positionPhi(s);
+        int etaSteps = MAX(1, int(ceil(fabs(eta - lastEta) / etaStep)));
+        for (int ie = 0; ie <= etaSteps; ie++) {
+          double stepEta = lastEta + (eta - lastEta) * ie / etaSteps;
+          for (double stepPhi : {lastPhi, phi}) {
+            const std::vector<int>& bin = tables.moduleIndex.candidates(stepEta, stepPhi, z0);
+            candidates.insert(candidates.end(), bin.begin(), bin.end());
+          }
+        }
+        lastEta = eta;
+        lastPhi = phi;
+      }
+      std::sort(candidates.begin(), candidates.end());
+      candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+      if (numCandidates) *numCandidates = candidates.size();
+
+      std::vector<int> poly(1);
+      std::vector<std::pair<XYZVector, int> > segments[2];
+      for (int k : candidates) {
+        const ModuleGeometry& g = moduleV[k];
+        if (g.minR > helix.maxRho()) continue;
+        double rhoGuess = helix.arcToRho(MIN((g.minR + g.maxR) / 2, helix.maxRho()));
+        for (int side = 0; side < 2; side++) {
+          poly[0] = 2*k + side;
+          XYZVector normal = tables.hitPolys.normal(poly[0]);
+          double d = tables.hitPolys.distance(poly[0]);
+          // a plane facing z (a disk) is better reached from its z than from its radius
+          double guess = fabs(normal.Z()) > 0.5 ? helix.arcToZ(d / normal.Z()) : rhoGuess;
+          double s = helix.arcToPlane(normal, d, guess >= 0 ? guess : rhoGuess);
+          if (s >= 0) tables.hitPolys.checkHitSegments(poly, helix.position(s), helix.direction(s), segments[side]);
+          else segments[side].assign(1, std::make_pair(XYZVector(), -1));
+        }
+        Module* m = g.module;
+        auto h = m->classifyTrackHits(segments[0][0], segments[1][0]);
+        if (h.second != HitType::NONE) {
+          result.push_back(std::make_pair(m,h.second));
+        }
       }
+      countPathValue("Analyzer::trackHelixHit candidate modules per track", candidates.size());
+      countPathValue("Analyzer::trackHelixHit hit modules per track", result.size());
+      return result;
     }
 
     double Analyzer::diffclock(clock_t clock1, clock_t clock2) {
@@ -2858,25 +4198,11 @@ void Analyzer::createGeometryLite(Tracker& tracker) {
       return diffms;
     }
 
-    std::vector<TObject> Analyzer::getSavingVector() {
-      std::vector<TObject> result;
-      std::vector<TObject>::iterator it;
-
-      for (it=savingGeometryV.begin(); it!=savingGeometryV.end(); ++it) {
-        result.push_back(*it);
-      }
-      for (it=savingMaterialV.begin(); it!=savingMaterialV.end(); ++it) {
-        result.push_back(*it);
-      }
-      return result;
-
-    }
-
-
     void Analyzer::computeBandwidth(Tracker& tracker) {
       BandwidthVisitor bv(chanHitDistribution, bandwidthDistribution, bandwidthDistributionSparsified);
+      bv.preVisit();
       simParms_->accept(bv);
-      tracker.accept(bv);
+      tracker.acceptModules(bv, numThreads_);
     }
 
 
@@ -4,72 +4,101 @@
 #include <iostream>
 
 void MaterialBillAnalyzer::inspectInactiveElements(const std::vector<InactiveElement>& inactiveElements) {
+  ServiceElement element;
+  const InactiveElement* previous = NULL;
   for (const auto& it : inactiveElements) {
-    const std::map<std::string, double>& localMasses = it.getLocalMasses();
-    const std::map<std::string, double>& exitingMasses = it.getExitingMasses();
-    std::map<std::string, double> totalMasses;
-    for (auto massIt : localMasses) totalMasses[massIt.first]+=massIt.second;
-    for (auto massIt : exitingMasses) totalMasses[massIt.first]+=massIt.second;
-    for (auto massIt : totalMasses) {
-      outputTable += any2str(it.getInnerRadius()) + ", ";
-      outputTable += any2str(it.getInnerRadius()+it.getRWidth()) + ", ";
-      outputTable += any2str(it.getZOffset()) + ", ";
-      outputTable += any2str(it.getZOffset()+it.getZLength()) + ", ";
-      outputTable += massIt.first + ", ";
-      outputTable += any2str(massIt.second) + "\n";
+    // the elements sharing their masses with the previous one have the same total masses
+    if (!previous || !it.sharesMasses(*previous)) {
+      const std::map<std::string, double>& localMasses = it.getLocalMasses();
+      const std::map<std::string, double>& exitingMasses = it.getExitingMasses();
+      element.materialMap.clear();
+      for (const auto& massIt : localMasses) element.materialMap[massIt.first]+=massIt.second;
+      for (const auto& massIt : exitingMasses) element.materialMap[massIt.first]+=massIt.second;
     }
+    previous = &it;
+    element.rmin = it.getInnerRadius();
+    element.rmax = it.getInnerRadius()+it.getRWidth();
+    element.zmin = it.getZOffset();
+    element.zmax = it.getZOffset()+it.getZLength();
+    auto inserted = servicesMaterialMap_.insert(std::make_pair(element, 0));
+    if (inserted.second) servicesOrder_.push_back(inserted.first);
+    inserted.first->second++;
   }
 }
 
-void MaterialBillAnalyzer::inspectModules(std::vector<std::vector<insur::ModuleCap> >& tracker) {
+void MaterialBillAnalyzer::inspectModules(std::vector<insur::ModuleCaps>& tracker) {
+  // TODO: put this in a better place
+  // (and make a better module typing)
+  struct Visitor : public ConstGeometryVisitor {
+    std::string id_;
+    void visit(const BarrelModule& m) { id_ = m.cntName() + "_L" + any2str(m.layer()); }
+    void visit(const EndcapModule& m) { id_ = m.cntName() + "_D" + any2str(m.disk()); }
+  };
+  // the modules sharing their masses, as the ones of a ring, are added once, times their number
+  const ModuleCap* first = NULL;
+  std::string firstId;
+  int count = 0;
+  auto addRun = [&]() {
+    if (!first) return;
+    MaterialMap& layerMaterial = layerMaterialMap_[firstId];
+    for (const auto &it : first->getLocalMasses())  layerMaterial[it.first]+=count*it.second;
+    for (const auto &it : first->getExitingMasses()) layerMaterial[it.first]+=count*it.second;
+  };
   // loop over layers
-  for (auto layerIt : tracker ) {
+  for (auto& layerIt : tracker ) {
     // Loop over modules
-    for (auto moduleIt : layerIt ) {
-      auto myModuleCap = (moduleIt);
-      auto myModule = &(myModuleCap.getModule());
-      // TODO: put this in a better place
-      // (and make a better module typing)
-      struct Visitor : public ConstGeometryVisitor {
-        std::string id_;
-        void visit(const BarrelModule& m) { id_ = m.cntName() + "_L" + any2str(m.layer()); }
-        void visit(const EndcapModule& m) { id_ = m.cntName() + "_D" + any2str(m.disk()); }
-      };
+    for (auto& moduleIt : layerIt ) {
       Visitor v;
-      myModule->accept(v);
-      MaterialMap& layerMaterial = layerMaterialMap_[v.id_];
-      const std::map<std::string, double>& localMasses = myModuleCap.getLocalMasses();
-      const std::map<std::string, double>& exitingMasses = myModuleCap.getExitingMasses();
-      for (const auto &it : localMasses)  layerMaterial[it.first]+=it.second;
-      for (const auto &it : exitingMasses) layerMaterial[it.first]+=it.second;
+      moduleIt.getModule().accept(v);
+      if (first && v.id_ == firstId && moduleIt.sharesMasses(*first)) {
+        count++;
+        continue;
+      }
+      addRun();
+      first = &moduleIt;
+      firstId = v.id_;
+      count = 1;
     }
   }
+  addRun();
 }
 
 void MaterialBillAnalyzer::inspectTracker(MaterialBudget& mb) {
-  outputTable="";
+  layerMaterialMap_.clear();
+  servicesMaterialMap_.clear();
+  servicesOrder_.clear();
 
   inspectModules(mb.getBarrelModuleCaps());
   inspectModules(mb.getEndcapModuleCaps());
 
-  outputTable += "material in layers\n";
-  outputTable += "layer, material, weight_grams\n";
+  InactiveSurfaces& is = mb.getInactiveSurfaces();
+  inspectInactiveElements(is.getBarrelServices());
+  inspectInactiveElements(is.getEndcapServices());
+  inspectInactiveElements(is.getSupports());
+}
+
+/**
+ * Write the bill of materials: the materials of the layers and disks, then the ones of the identical inactive
+ * elements, with their number and the weight of all of them
+ */
+void MaterialBillAnalyzer::write(std::ostream& output) const {
+  output << "material in layers\n";
+  output << "layer, material, weight_grams\n";
 
   for (const auto &it : layerMaterialMap_) {
     for (const auto &layMats : it.second) {
-      outputTable += it.first + ", ";
-      outputTable += layMats.first+ ", " + any2str(layMats.second) + "\n";
+      output << it.first << ", " << layMats.first << ", " << any2str(layMats.second) << "\n";
     }
   }
 
-  InactiveSurfaces& is = mb.getInactiveSurfaces();
-  std::vector<InactiveElement>& barrelServices = is.getBarrelServices();
-  std::vector<InactiveElement>& endcapServices = is.getEndcapServices();
-  std::vector<InactiveElement>& supports = is.getSupports();
-  outputTable += "other elements\n";
-  outputTable += "r_in, r_out, z_in, z_out, material, weight_grams\n";
-  inspectInactiveElements(barrelServices);
-  inspectInactiveElements(endcapServices);
-  inspectInactiveElements(supports);
+  output << "other elements\n";
+  output << "r_in, r_out, z_in, z_out, count, material, weight_grams\n";
+  for (const auto& entry : servicesOrder_) {
+    const ServiceElement& element = entry->first;
+    for (const auto& massIt : element.materialMap) {
+      output << any2str(element.rmin) << ", " << any2str(element.rmax) << ", "
+             << any2str(element.zmin) << ", " << any2str(element.zmax) << ", "
+             << entry->second << ", " << massIt.first << ", " << any2str(entry->second*massIt.second) << "\n";
+    }
+  }
 }
-
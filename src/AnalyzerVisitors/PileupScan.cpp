@@ -0,0 +1 @@
+#include "AnalyzerVisitors/PileupScan.h"
@@ -0,0 +1,145 @@
+#include "AnalyzerVisitors/ReadoutWhatIf.h"
+
+#include <fstream>
+#include <sstream>
+#include <set>
+
+#include "messageLogger.h"
+
+namespace {
+  // The properties a variant can change, by index
+  const char* const properties[] = { "triggerWindow", "numSparsifiedHeaderBits", "numSparsifiedPayloadBits",
+                                     "numTriggerDataHeaderBits", "numTriggerDataPayloadBits" };
+  const int numProperties = sizeof(properties) / sizeof(properties[0]);
+
+  int propertyIndex(const std::string& property) {
+    for (int i = 0; i < numProperties; i++) if (property == properties[i]) return i;
+    return -1;
+  }
+}
+
+bool ReadoutWhatIf::knownProperty(const std::string& property) {
+  return propertyIndex(property) >= 0;
+}
+
+/**
+ * Reads the variants of a readout what-if file. A line <i>variant name</i> starts a variant, and each of the lines
+ * <i>moduleType property value</i> after it changes a property of the modules of a type; lines starting with '#' are
+ * comments.
+ * @param fileName The name of the file
+ * @param variants Set to the variants of the file, in their order
+ * @return True if the file could be read, false otherwise
+ */
+bool ReadoutWhatIf::readFile(const std::string& fileName, std::vector<Variant>& variants) {
+  std::ifstream whatIfStream(fileName.c_str());
+  if (!whatIfStream) {
+    logERROR("Could not open the readout what-if file " + fileName);
+    return false;
+  }
+  variants.clear();
+  std::string line;
+  while (std::getline(whatIfStream, line)) {
+    std::istringstream lineStream(line);
+    std::string first;
+    if (!(lineStream >> first) || first[0] == '#') continue;
+    if (first == "variant") {
+      std::string name;
+      if (!(lineStream >> name)) {
+        logERROR("Malformed variant line '" + line + "' in " + fileName + ": expected variant name");
+        return false;
+      }
+      variants.push_back(Variant{ name, std::vector<Change>() });
+      continue;
+    }
+    Change change;
+    change.moduleType = first;
+    if (!(lineStream >> change.property >> change.value) || change.value < 0) {
+      logERROR("Malformed line '" + line + "' in " + fileName + ": expected moduleType property value");
+      return false;
+    }
+    if (!knownProperty(change.property)) {
+      logERROR("The property " + change.property + " in " + fileName + " cannot be changed without building the tracker again");
+      return false;
+    }
+    if (variants.empty()) {
+      logERROR("The change '" + line + "' in " + fileName + " comes before any variant line");
+      return false;
+    }
+    variants.back().changes.push_back(change);
+  }
+  return true;
+}
+
+/**
+ * @param tracker The tracker whose module types are changed
+ */
+ReadoutWhatIf::ReadoutWhatIf(Tracker& tracker) {
+  struct TypeVisitor : public GeometryVisitor {
+    std::map<std::string, std::vector<DetectorModule*> >& typeModules;
+    TypeVisitor(std::map<std::string, std::vector<DetectorModule*> >& modules) : typeModules(modules) {}
+    void visit(DetectorModule& m) { typeModules[m.moduleType()].push_back(&m); }
+  };
+  TypeVisitor v(typeModules_);
+  tracker.accept(v);
+}
+
+double ReadoutWhatIf::get(const DetectorModule& m, int property) {
+  switch (property) {
+  case 0: return m.triggerWindow();
+  case 1: return m.numSparsifiedHeaderBits();
+  case 2: return m.numSparsifiedPayloadBits();
+  case 3: return m.numTriggerDataHeaderBits();
+  default: return m.numTriggerDataPayloadBits();
+  }
+}
+
+void ReadoutWhatIf::set(DetectorModule& m, int property, double value) {
+  switch (property) {
+  case 0: m.triggerWindow.force(int(value)); break;
+  case 1: m.numSparsifiedHeaderBits.force(int(value)); break;
+  case 2: m.numSparsifiedPayloadBits.force(int(value)); break;
+  case 3: m.numTriggerDataHeaderBits.force(int(value)); break;
+  default: m.numTriggerDataPayloadBits.force(int(value));
+  }
+}
+
+/**
+ * Changes the module types as a variant does, from the values of the configuration
+ * @param variant The variant
+ * @return The number of modules changed, whose values differ from those of the previous variant
+ */
+int ReadoutWhatIf::apply(const Variant& variant) {
+  // the values of the properties the previous variant or this one changes, before this one does
+  std::map<std::pair<DetectorModule*, int>, double> before;
+  for (const auto& original : originals_) {
+    before.insert(std::make_pair(std::make_pair(original.first, original.second.first), get(*original.first, original.second.first)));
+  }
+  restore();
+  for (const Change& change : variant.changes) {
+    auto modules = typeModules_.find(change.moduleType);
+    if (modules == typeModules_.end()) {
+      logWARNING("Readout what-if " + variant.name + ": there is no module of type " + change.moduleType);
+      continue;
+    }
+    int property = propertyIndex(change.property);
+    for (DetectorModule* m : modules->second) {
+      double value = get(*m, property);
+      before.insert(std::make_pair(std::make_pair(m, property), value));
+      originals_.push_back(std::make_pair(m, std::make_pair(property, value)));
+      set(*m, property, change.value);
+    }
+  }
+  std::set<DetectorModule*> changed;
+  for (const auto& value : before) {
+    if (get(*value.first.first, value.first.second) != value.second) changed.insert(value.first.first);
+  }
+  return changed.size();
+}
+
+/**
+ * Gives the module types the values of the configuration back
+ */
+void ReadoutWhatIf::restore() {
+  for (auto it = originals_.rbegin(); it != originals_.rend(); ++it) set(*it->first, it->second.first, it->second.second);
+  originals_.clear();
+}
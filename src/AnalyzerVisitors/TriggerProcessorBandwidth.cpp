@@ -1,5 +1,7 @@
 
 #include "AnalyzerVisitors/TriggerProcessorBandwidth.h"
+#include "TaskPool.h"
+#include <algorithm>
 
 
 using AnalyzerHelpers::Circle;
@@ -26,29 +28,61 @@ bool AnalyzerHelpers::isPointInCircle(const Point& p, const Circle& c) { return
 
 
 
-double AnalyzerHelpers::calculatePetalAreaMC(const Tracker& tracker, const SimParms& simParms, double crossoverR) {
+/**
+ * Monte Carlo estimate of the area of the trigger petal with the given crossover, in a 40 degrees slice of the tracker.
+ * The points are drawn one after the other from a single random stream, then tested against the two circles of the petal
+ * in blocks of contiguous coordinates; the blocks can be spread over several threads, the hits found being the same.
+ * @param tracker The tracker whose radial extent the points are drawn in
+ * @param simParms The parameters holding the trigger pt cut
+ * @param crossoverR The radius at which the two circles of the petal cross
+ * @param numThreads The number of threads the circle tests are split across
+ * @return The number of points in the petal, out of 100000
+ */
+double AnalyzerHelpers::calculatePetalAreaMC(const Tracker& tracker, const SimParms& simParms, double crossoverR, int numThreads) {
   static TRandom3 die;
+  static const int numPoints = 100000;
+  static const int blockSize = 1024;
 
   double r = simParms.triggerPtCut()/(0.3*insur::magnetic_field) * 1e3; // curvature radius of particles with the minimum accepted pt
 
   std::pair<Circle, Circle> cc = findCirclesTwoPoints((Point){0, 0}, (Point){0, crossoverR}, r);
 
   // Monte Carlo area calculation
-  int hits = 0;
   double maxR = tracker.maxR(); // points randomly generated in a 40 degrees circle slice
   double minR = tracker.minR();
   double aperture = 0.34906585 * 2; // 40 degrees
   //double maxPhi = M_PI/2 + aperture/2;
   double minPhi = M_PI/2 - aperture/2;
-  for (int i = 0; i < 100000; i++) {
-    double rr  = minR + die.Rndm()*(maxR-minR);
-    double phi = minPhi + die.Rndm()*aperture;
-    Polar2DPoint rndp(rr, phi);
-    bool inFirstCircle  = isPointInCircle((Point){rndp.X(), rndp.Y()}, cc.first);
-    bool inSecondCircle = isPointInCircle((Point){rndp.X(), rndp.Y()}, cc.second);
-    if ((inFirstCircle && inSecondCircle) || (!inFirstCircle && !inSecondCircle)) hits++; // if it's in both circles means it's in the lower part of the petal (before the crossover), if it's outside both it means it's upper part of the petal (after the crossover)
+  std::vector<double> rr(numPoints), phi(numPoints);
+  for (int i = 0; i < numPoints; i++) {
+    rr[i]  = minR + die.Rndm()*(maxR-minR);
+    phi[i] = minPhi + die.Rndm()*aperture;
   }
 
+  int numBlocks = (numPoints + blockSize - 1) / blockSize;
+  std::vector<int> blockHits(numBlocks, 0);
+  auto countBlock = [&](int iBlock) {
+    int first = iBlock*blockSize, last = MIN(first + blockSize, numPoints);
+    double x[blockSize], y[blockSize];
+    for (int i = first; i < last; i++) {
+      x[i-first] = rr[i]*cos(phi[i]);
+      y[i-first] = rr[i]*sin(phi[i]);
+    }
+    int hits = 0;
+    for (int i = 0; i < last-first; i++) {
+      double dx1 = x[i] - cc.first.x0, dy1 = y[i] - cc.first.y0;
+      double dx2 = x[i] - cc.second.x0, dy2 = y[i] - cc.second.y0;
+      bool inFirstCircle  = dx1*dx1 + dy1*dy1 <= cc.first.r*cc.first.r;
+      bool inSecondCircle = dx2*dx2 + dy2*dy2 <= cc.second.r*cc.second.r;
+      hits += (inFirstCircle == inSecondCircle); // if it's in both circles means it's in the lower part of the petal (before the crossover), if it's outside both it means it's upper part of the petal (after the crossover)
+    }
+    blockHits[iBlock] = hits;
+  };
+
+  TaskPool::instance()->run("Trigger petal area", numBlocks, countBlock, numThreads);
+
+  int hits = 0;
+  for (int h : blockHits) hits += h;
   return hits;
 }
 
@@ -215,6 +249,7 @@ void TriggerProcessorBandwidthVisitor::visit(const SimParms& sp) {
   simParms_ = &sp;
   numProcEta = sp.numTriggerTowersEta();
   numProcPhi = sp.numTriggerTowersPhi();
+  sectorMap.reset(numProcEta, numProcPhi);
 }
 
 
@@ -239,36 +274,36 @@ void TriggerProcessorBandwidthVisitor::visit(const Layer& l) { seb_.numModsZMinu
 void TriggerProcessorBandwidthVisitor::visit(const DetectorModule& m) {
   TableRef p = m.tableRef();
 
-  int etaConnections = 0, totalConnections = 0;
-
   int sebCoords = dynamic_cast<const BarrelModule*>(&m) ? seb_.sebifyBarrelCoords((const BarrelModule&)m) : seb_.sebifyEndcapCoords((const EndcapModule&)m);
 
+  // The phi sectors of a module do not depend on its eta sectors: the processors it is connected to are the pairs of the two
+  std::vector<int> etaSectors, phiSectors;
   for (int i=0; i < numProcEta; i++) {
-    if (AnalyzerHelpers::isModuleInEtaSector(*simParms_, *tracker_, m, i)) {
-      etaConnections++;
-      for (int j=0; j < numProcPhi; j++) {
-        if (AnalyzerHelpers::isModuleInPhiSector(*simParms_, m, crossoverR, j)) {
-          totalConnections++;
-
-          processorConnections_[std::make_pair(j,i)] += 1;
-          processorConnectionSummary.setCell(j+1, i+1, processorConnections_[std::make_pair(j,i)]);
-
-          moduleConnections[&m].connectedProcessors.insert(make_pair(i+1, j+1));
-
-          processorInboundBandwidths_[std::make_pair(j,i)] += triggerDataBandwidths_[p.table][std::make_pair(p.row, p.col)]; // *2 takes into account negative Z's
-          processorInboundBandwidthSummary.setCell(j+1, i+1, processorInboundBandwidths_[std::make_pair(j,i)]);
-
-          processorInboundStubsPerEvent_[std::make_pair(j,i)] += triggerFrequenciesPerEvent_[p.table][std::make_pair(p.row, p.col)];
-          processorInboundStubPerEventSummary.setCell(j+1, i+1, processorInboundStubsPerEvent_[std::make_pair(j,i)]);
+    if (AnalyzerHelpers::isModuleInEtaSector(*simParms_, *tracker_, m, i)) etaSectors.push_back(i);
+  }
+  if (!etaSectors.empty()) {
+    for (int j=0; j < numProcPhi; j++) {
+      if (AnalyzerHelpers::isModuleInPhiSector(*simParms_, m, crossoverR, j)) phiSectors.push_back(j);
+    }
+  }
 
-          sectorMap[make_pair(i+1, j+1)].insert(sebCoords);
-        } 
-      }
+  int etaConnections = etaSectors.size(), totalConnections = etaSectors.size()*phiSectors.size();
+  double triggerDataBandwidth = totalConnections > 0 ? triggerDataBandwidths_[p.table][std::make_pair(p.row, p.col)] : 0.;
+  double triggerFrequencyPerEvent = totalConnections > 0 ? triggerFrequenciesPerEvent_[p.table][std::make_pair(p.row, p.col)] : 0.;
+  ModuleConnectionData& connections = moduleConnections[&m];
+
+  for (int i : etaSectors) {
+    for (int j : phiSectors) {
+      processorConnections_[std::make_pair(j,i)] += 1;
+      connections.connectedProcessors.insert(make_pair(i+1, j+1));
+      processorInboundBandwidths_[std::make_pair(j,i)] += triggerDataBandwidth; // *2 takes into account negative Z's
+      processorInboundStubsPerEvent_[std::make_pair(j,i)] += triggerFrequencyPerEvent;
+      sectorMap.add(i+1, j+1, sebCoords);
     }
   }
-  moduleConnections[&m].etaCpuConnections(etaConnections);
-  moduleConnections[&m].phiCpuConnections(totalConnections > 0 ? totalConnections/etaConnections : 0);
-  moduleConnections[&m].sebCoords = sebCoords;
+  connections.etaCpuConnections(etaConnections);
+  connections.phiCpuConnections(totalConnections > 0 ? totalConnections/etaConnections : 0);
+  connections.sebCoords = sebCoords;
 }
 
 int TriggerProcessorBandwidthVisitor::Sebifier::sebifyBarrelCoords(const BarrelModule& m) const {
@@ -285,7 +320,50 @@ int TriggerProcessorBandwidthVisitor::Sebifier::sebifyEndcapCoords(const EndcapM
   return disk*10000 + ring*100 + module;
 } 
 
+void TriggerProcessorBandwidthVisitor::TriggerSectorMap::reset(int numEta, int numPhi) {
+  numEta_ = numEta;
+  numPhi_ = numPhi;
+  added_.clear();
+  moduleCoords_.clear();
+  towerWords_ = 0;
+  towerBits_.clear();
+}
+
+void TriggerProcessorBandwidthVisitor::TriggerSectorMap::freeze() {
+  moduleCoords_.clear();
+  for (const auto& tc : added_) moduleCoords_.push_back(tc.second);
+  std::sort(moduleCoords_.begin(), moduleCoords_.end());
+  moduleCoords_.erase(std::unique(moduleCoords_.begin(), moduleCoords_.end()), moduleCoords_.end());
+  towerWords_ = (moduleCoords_.size() + 63) / 64;
+  towerBits_.assign(numEta_*numPhi_*towerWords_, 0);
+  for (const auto& tc : added_) {
+    size_t index = std::lower_bound(moduleCoords_.begin(), moduleCoords_.end(), tc.second) - moduleCoords_.begin();
+    towerBits_[tc.first*towerWords_ + index/64] |= uint64_t(1) << (index%64);
+  }
+  added_.clear();
+  added_.shrink_to_fit();
+}
+
+bool TriggerProcessorBandwidthVisitor::TriggerSectorMap::empty(int eta, int phi) const {
+  const uint64_t* words = bits(eta, phi);
+  return std::all_of(words, words + towerWords_, [](uint64_t word) { return word == 0; });
+}
+
+int TriggerProcessorBandwidthVisitor::TriggerSectorMap::numSharedModules(int eta1, int phi1, int eta2, int phi2) const {
+  const uint64_t* words1 = bits(eta1, phi1);
+  const uint64_t* words2 = bits(eta2, phi2);
+  int shared = 0;
+  for (size_t w = 0; w < towerWords_; w++) shared += __builtin_popcountll(words1[w] & words2[w]);
+  return shared;
+}
+
 void TriggerProcessorBandwidthVisitor::postVisit() {
+  sectorMap.freeze();
+
+  // The summaries only hold the final tallies, so they are filled once all the modules are visited
+  for (const auto& mvp : processorConnections_) processorConnectionSummary.setCell(mvp.first.first+1, mvp.first.second+1, mvp.second);
+  for (const auto& mvp : processorInboundBandwidths_) processorInboundBandwidthSummary.setCell(mvp.first.first+1, mvp.first.second+1, mvp.second);
+  for (const auto& mvp : processorInboundStubsPerEvent_) processorInboundStubPerEventSummary.setCell(mvp.first.first+1, mvp.first.second+1, mvp.second);
 
   for (const auto& mvp : processorInboundBandwidths_) inboundBandwidthTotal += mvp.second;
   for (const auto& mvp : processorConnections_) processorConnectionsTotal += mvp.second;
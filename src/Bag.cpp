@@ -1,4 +1,5 @@
 #include "Bag.h"
+#include <algorithm>
 #include <utility>
 
 const double GraphBag::Triggerable     = 0.;
@@ -52,16 +53,8 @@ GraphBag::GraphBag(string meaning) {
 
 const std::set<int> GraphBag::getParameterSet() {
   std::set<int> result;
-  for (const auto it : graphMap_) {
-    for (const auto it2 : it.second) {
-      result.insert(it2.first);
-    }
-  }
-
-  for (const auto it : taggedGraphMap_) {
-    for (const auto it2 : it.second) {
-      result.insert(it2.first);
-    }
+  for (const auto& it : seriesSets_) {
+    result.insert(it.second.parameters.begin(), it.second.parameters.end());
   }
 
   return result;
@@ -77,27 +70,12 @@ int GraphBag::clearStandardGraphs() {
 
 int GraphBag::clearGraphs(const int& attributeMask) {
   int deleteCounter = 0;
-  for (auto it = taggedGraphMap_.begin(); it != taggedGraphMap_.end();) { // first clear tagged graphs with the specified attribute
+  for (auto it = seriesSets_.begin(); it != seriesSets_.end();) {
     if ((it->first.first & attributeMask) == attributeMask) {
-      it = taggedGraphMap_.erase(it);
+      it = seriesSets_.erase(it);
       ++deleteCounter;
     } else ++it;
   }
-  std::map<int, std::map<int, TGraph> >::iterator it;
-  std::map<int, std::map<int, TGraph> >::iterator nextIt;
-
-  int anAttribute;
-  for (it=graphMap_.begin(); it!=graphMap_.end(); ) {
-    anAttribute=it->first;
-    if ((anAttribute&attributeMask)==attributeMask) {
-      nextIt = ((++it)--);
-      graphMap_.erase(it);
-      it=nextIt;
-      ++deleteCounter;
-    } else {
-      ++it;
-    }
-  }
   return deleteCounter;
 }
 
@@ -112,23 +90,66 @@ int GraphBag::buildAttribute(bool ideal, bool isTrigger) {
   return result;
 }
 
-std::map<int, TGraph>& GraphBag::getGraphs(const int& attribute) {
-  return graphMap_[attribute];
+/**
+ * Makes the graphs of a set of series, if any of them was written to since they were last made
+ * @param set The set of series
+ * @return The graphs, by parameter
+ */
+std::map<int, TGraph>& GraphBag::makeGraphs(SeriesSet& set) {
+  if (set.graphsMade) return set.graphs;
+  set.graphs.clear();
+  for (size_t i = 0; i < set.parameters.size(); i++) {
+    const Series& series = set.series[i];
+    TGraph& graph = set.graphs[set.parameters[i]];
+    if (!series.x.empty()) graph = TGraph(series.x.size(), series.x.data(), series.y.data());
+    graph.SetName(series.name.c_str());
+    graph.SetTitle(series.title.c_str());
+  }
+  set.graphsMade = true;
+  return set.graphs;
 }
 
-TGraph& GraphBag::getGraph(const int& attribute, const int& parameter) {
-  auto& aMap = getGraphs(attribute);
-  return aMap[parameter];
+std::map<int, TGraph>& GraphBag::getGraphs(const int& attribute) {
+  return makeGraphs(seriesSets_[std::make_pair(attribute, string())]);
 }
 
 std::map<int, TGraph>& GraphBag::getTaggedGraphs(int attribute, const string& tag) {
   tagSet_.insert(tag);
-  return taggedGraphMap_[std::make_pair(attribute, tag)];
-}
-
-TGraph& GraphBag::getTaggedGraph(const int& attribute, const string& tag, const int& parameter) {
-  auto& aMap = getTaggedGraphs(attribute, tag);
-  return aMap[parameter];
+  return makeGraphs(seriesSets_[std::make_pair(attribute, tag)]);
+}
+
+/**
+ * The series of points of a graph, to be written to. The series stays valid until a series of another parameter is
+ * added to the same attribute and tag, or until the series of the attribute are cleared.
+ * @param attribute The attribute of the graph
+ * @param tag The tag of the graph, empty for an untagged one
+ * @param parameter The parameter of the graph
+ * @return The series, created empty if it did not exist
+ */
+GraphBag::Series& GraphBag::getSeries(int attribute, const string& tag, int parameter) {
+  if (!tag.empty()) tagSet_.insert(tag);
+  SeriesSet& set = seriesSets_[std::make_pair(attribute, tag)];
+  set.graphsMade = false;
+  auto found = std::lower_bound(set.parameters.begin(), set.parameters.end(), parameter);
+  size_t index = found - set.parameters.begin();
+  if (found == set.parameters.end() || *found != parameter) {
+    set.parameters.insert(found, parameter);
+    set.series.insert(set.series.begin() + index, Series());
+  }
+  return set.series[index];
+}
+
+/**
+ * Empties the graphs of an attribute and a tag
+ * @param attribute The attribute of the graphs
+ * @param tag The tag of the graphs, empty for the untagged ones
+ */
+void GraphBag::clearSeries(int attribute, const string& tag) {
+  if (!tag.empty()) tagSet_.insert(tag);
+  SeriesSet& set = seriesSets_[std::make_pair(attribute, tag)];
+  set.parameters.clear();
+  set.series.clear();
+  set.graphsMade = false;
 }
 
 std::map<double, TH2D>& mapBag::getMaps(const int& attribute) {
@@ -9,7 +9,7 @@ void Barrel::cutAtEta(double eta) {
 
 void Barrel::build() {
   try {
-    logINFO(Form("Building %s", fullid(*this).c_str()));
+    logINFO("Building " + fullid(*this));
     check();
 
     for (int i = 1; i <= numLayers(); i++) {
@@ -29,8 +29,7 @@ void Barrel::build() {
       layer->store(propertyTree());
       if (layerNode.count(i) > 0) layer->store(layerNode.at(i));
       layer->build();
-      layer->rotateZ(barrelRotation());
-      layer->rotateZ(layer->layerRotation());
+      layer->rotateZ(barrelRotation() + layer->layerRotation()); // one move of the modules for the two rotations
       layers_.push_back(layer);
     }
 
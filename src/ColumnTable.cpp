@@ -0,0 +1,121 @@
+/**
+ * @file ColumnTable.cpp
+ * @brief This is the implementation of the table of typed columns written in a binary form that can be memory-mapped
+ */
+
+#include "ColumnTable.h"
+
+#include <cstring>
+#include <map>
+#include <stdexcept>
+
+namespace {
+  // The directory entry of a column, as it is written
+  struct DirectoryEntry {
+    char name[ColumnTable::NameLength];
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t dataOffset;
+    uint64_t dictionaryOffset;
+  };
+
+  const uint64_t HeaderSize = 8 + 4 + 4 + 8;
+
+  uint64_t aligned(uint64_t offset) { return (offset + 7) & ~uint64_t(7); }
+
+  void writeRaw(std::ostream& output, const void* data, size_t size) { output.write(static_cast<const char*>(data), size); }
+
+  void pad(std::ostream& output, uint64_t& offset) {
+    static const char zeros[8] = {};
+    uint64_t next = aligned(offset);
+    writeRaw(output, zeros, next - offset);
+    offset = next;
+  }
+}
+
+ColumnTable::Column& ColumnTable::addColumn(const std::string& name, Type type, size_t numRows) {
+  if (name.size() >= NameLength) throw std::invalid_argument("ColumnTable: the column name '" + name + "' is too long");
+  if (!columns_.empty() && numRows != numRows_) throw std::invalid_argument("ColumnTable: the column '" + name + "' does not have as many rows as the table");
+  numRows_ = numRows;
+  columns_.push_back(Column());
+  Column& column = columns_.back();
+  column.name = name;
+  column.type = type;
+  return column;
+}
+
+void ColumnTable::addIntegerColumn(const std::string& name, std::vector<int32_t> values) {
+  addColumn(name, Integer, values.size()).integers.swap(values);
+}
+
+void ColumnTable::addRealColumn(const std::string& name, std::vector<double> values) {
+  addColumn(name, Real, values.size()).reals.swap(values);
+}
+
+/**
+ * Add a column of names, stored as the indices of the names in its dictionary, in the order they first appear
+ */
+void ColumnTable::addCategoryColumn(const std::string& name, const std::vector<std::string>& values) {
+  Column& column = addColumn(name, Category, values.size());
+  std::map<std::string, int32_t> indices;
+  column.integers.reserve(values.size());
+  for (const std::string& value : values) {
+    auto found = indices.insert(std::make_pair(value, int32_t(column.categories.size())));
+    if (found.second) column.categories.push_back(value);
+    column.integers.push_back(found.first->second);
+  }
+}
+
+/**
+ * Write the table with one write per column (and per dictionary entry): the offsets of the directory are computed first
+ */
+void ColumnTable::write(std::ostream& output) const {
+  std::vector<DirectoryEntry> directory(columns_.size());
+  uint64_t offset = HeaderSize + directory.size() * sizeof(DirectoryEntry);
+  for (size_t i = 0; i < columns_.size(); ++i) {
+    const Column& column = columns_[i];
+    DirectoryEntry& entry = directory[i];
+    std::memset(&entry, 0, sizeof(entry));
+    std::strncpy(entry.name, column.name.c_str(), NameLength - 1);
+    entry.type = column.type;
+    entry.dataOffset = offset = aligned(offset);
+    offset += numRows_ * (column.type == Real ? sizeof(double) : sizeof(int32_t));
+    if (column.type == Category) {
+      entry.dictionaryOffset = offset = aligned(offset);
+      offset += sizeof(uint32_t);
+      for (const std::string& category : column.categories) offset += sizeof(uint32_t) + category.size();
+    }
+  }
+
+  uint32_t version = Version, numColumns = columns_.size();
+  uint64_t numRows = numRows_;
+  writeRaw(output, "TKCOLTAB", 8);
+  writeRaw(output, &version, sizeof(version));
+  writeRaw(output, &numColumns, sizeof(numColumns));
+  writeRaw(output, &numRows, sizeof(numRows));
+  if (!directory.empty()) writeRaw(output, directory.data(), directory.size() * sizeof(DirectoryEntry));
+
+  offset = HeaderSize + directory.size() * sizeof(DirectoryEntry);
+  for (const Column& column : columns_) {
+    pad(output, offset);
+    if (column.type == Real) {
+      writeRaw(output, column.reals.data(), column.reals.size() * sizeof(double));
+      offset += column.reals.size() * sizeof(double);
+    } else {
+      writeRaw(output, column.integers.data(), column.integers.size() * sizeof(int32_t));
+      offset += column.integers.size() * sizeof(int32_t);
+    }
+    if (column.type == Category) {
+      pad(output, offset);
+      uint32_t numCategories = column.categories.size();
+      writeRaw(output, &numCategories, sizeof(numCategories));
+      offset += sizeof(numCategories);
+      for (const std::string& category : column.categories) {
+        uint32_t length = category.size();
+        writeRaw(output, &length, sizeof(length));
+        writeRaw(output, category.data(), length);
+        offset += sizeof(length) + length;
+      }
+    }
+  }
+}
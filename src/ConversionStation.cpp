@@ -9,6 +9,7 @@
 #include "ConversionStation.h"
 //#include "MaterialObject.h"
 #include "InactiveElement.h"
+#include "MaterialKeys.h"
 #include "messageLogger.h"
 
 namespace material {
@@ -22,14 +23,21 @@ namespace material {
     try {
       stationType_ = typeString.at(type_());
       buildConversions();
+      compileConversions();
     } catch (const std::out_of_range& ex) {
       logERROR("Station type \"" + type_() + "\" not recognized.");
     }
     cleanup();
   }
 
+  /**
+   * Routes the service elements crossing the station, converting those of the materials the station has conversions
+   * for. The conversions of an element are found by its material key in the compiled conversions.
+   * @param localOutput The object the converted elements which are not services go to
+   * @param serviceOutput The object the converted services and the elements left as they are go to
+   * @param inactiveElement The volume of the station, which the quantities are converted over
+   */
   void ConversionStation::routeConvertedElements(MaterialObject& localOutput, MaterialObject& serviceOutput, InactiveElement& inactiveElement) {
-    MaterialObject::Element* inputElement;
     //double totalGrams = 0.0;
     double multiplier = 0.0;
     bool converted = false;
@@ -39,15 +47,15 @@ namespace material {
       converted = false;
       //if the material need to be converted (flange station, or endcap station with right destination)
       if ((stationType_ == FLANGE) || (stationType_ == SECOND && currElement->destination.state() && currElement->destination().compare(stationName_()) == 0)) {
-        for (const Conversion* currConversion : conversions) {
-          inputElement = currConversion->input->elements[0];
-          if (inputElement->elementName().compare(currElement->elementName()) == 0) {
+        int key = currElement->materialKey() != MaterialKeys::noKey ? currElement->materialKey() : MaterialKeys::key(currElement->elementName());
+        if (key < (int)conversionsByKey_.size()) {
+          for (const CompiledConversion& currConversion : conversionsByKey_[key]) {
             converted = true;
 
-            multiplier = currElement->quantityInUnit(inputElement->unit(), inactiveElement) / 
-              inputElement->quantityInUnit(inputElement->unit(), inactiveElement);
+            // the quantity of an input element in its own unit is its quantity
+            multiplier = currElement->quantityInUnit(*currConversion.inputUnit, inactiveElement) / currConversion.inputQuantity;
           
-            for (const MaterialObject::Element* outputElement : currConversion->outputs->elements) {
+            for (const MaterialObject::Element* outputElement : *currConversion.outputs) {
               MaterialObject::Element * newElement = new MaterialObject::Element(*outputElement, multiplier);
               if(currElement->debugInactivate()) {  //apply the inactivation also to converteds
                 newElement->debugInactivate(true);
@@ -135,6 +143,22 @@ namespace material {
     }
   }
 
+  /**
+   * Compiles the conversions of the station into rows by the material key of their input element, in the order of the
+   * conversions. The output elements get their keys too, so that the elements converted from them carry theirs.
+   */
+  void ConversionStation::compileConversions() {
+    conversionsByKey_.clear();
+    for (const Conversion* currConversion : conversions) {
+      if (!currConversion->input || currConversion->input->elements.empty() || !currConversion->outputs) continue;
+      const MaterialObject::Element* inputElement = currConversion->input->elements[0];
+      int key = inputElement->materialKey();
+      if (key >= (int)conversionsByKey_.size()) conversionsByKey_.resize(key + 1);
+      CompiledConversion compiled = { inputElement->quantity(), &inputElement->unit(), &currConversion->outputs->elements };
+      conversionsByKey_[key].push_back(compiled);
+    }
+  }
+
   void ConversionStation::Conversion::build() {
     //std::cout << "  CONVERSION" << std::endl;
 
@@ -167,8 +191,7 @@ namespace material {
       MaterialObject::Element* newElement = new MaterialObject::Element(elementMaterialType);
       newElement->store(propertyTree());
       newElement->store(currentElementNode.second);
-      newElement->check();
-      //newElement->build();
+      newElement->build(std::map<int, int>()); // for its material keys
       newElement->cleanup();
 
       elements.push_back(newElement);
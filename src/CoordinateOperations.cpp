@@ -22,4 +22,39 @@ namespace CoordinateOperations {
     }
   }
 
+  Placement::Placement() : t_(0., 0., 0.), yRotation_(0.), zRotation_(0.) {
+    for (int i = 0; i < 3; i++) {
+      for (int j = 0; j < 3; j++) m_[i][j] = (i == j);
+    }
+  }
+
+  /**
+   * Composes a rotation after the moves so far: M becomes R M and t becomes R t
+   */
+  void Placement::rotate(const double r[3][3]) {
+    double m[3][3];
+    for (int i = 0; i < 3; i++) {
+      for (int j = 0; j < 3; j++) m[i][j] = r[i][0]*m_[0][j] + r[i][1]*m_[1][j] + r[i][2]*m_[2][j];
+    }
+    std::copy(&m[0][0], &m[0][0] + 9, &m_[0][0]);
+    t_.SetCoordinates(r[0][0]*t_.X() + r[0][1]*t_.Y() + r[0][2]*t_.Z(),
+                      r[1][0]*t_.X() + r[1][1]*t_.Y() + r[1][2]*t_.Z(),
+                      r[2][0]*t_.X() + r[2][1]*t_.Y() + r[2][2]*t_.Z());
+  }
+
+  // the same rotations as the RotateY and RotateZ of the polygons
+  Placement& Placement::rotateY(double angle) {
+    const double r[3][3] = { { cos(angle), 0., sin(angle) }, { 0., 1., 0. }, { -sin(angle), 0., cos(angle) } };
+    rotate(r);
+    yRotation_ += angle;
+    return *this;
+  }
+
+  Placement& Placement::rotateZ(double angle) {
+    const double r[3][3] = { { cos(angle), -sin(angle), 0. }, { sin(angle), cos(angle), 0. }, { 0., 0., 1. } };
+    rotate(r);
+    zRotation_ += angle;
+    return *this;
+  }
+
 }
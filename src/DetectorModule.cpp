@@ -1,6 +1,25 @@
 
 #include "DetectorModule.h"
 #include "ModuleCap.h"
+#include "PathCounters.h"
+
+DetectorModule::OwnedModuleCap::~OwnedModuleCap() { delete cap; }
+
+void DetectorModule::setModuleCap(ModuleCap* newCap) {
+  if (myModuleCap_.cap != newCap) delete myModuleCap_.cap;
+  myModuleCap_.cap = newCap;
+}
+
+/**
+ * The cap of the module, created with the category of the module the first time it is asked for
+ */
+ModuleCap& DetectorModule::moduleCap() {
+  if (!myModuleCap_.cap) {
+    ModuleCap* cap = new ModuleCap(*this); // which gives itself to the module
+    cap->setCategory(subdet() == BARREL ? MaterialProperties::b_mod : MaterialProperties::e_mod);
+  }
+  return *myModuleCap_.cap;
+}
 
 /*
 DetectorModule* DetectorModule::assignType(const string& type, DetectorModule* m) {
@@ -55,6 +74,18 @@ void DetectorModule::build() {
 }
 
 
+/**
+ * Frees what only the build of the module needed, with the subtrees of its sensors and what the geometric module and
+ * the sensors kept of the configuration
+ */
+void DetectorModule::releaseBuildState() {
+  PropertyObject::releaseBuildState();
+  sensorNode.release();
+  materialObject_.releaseBuildState();
+  decorated().releaseBuildState();
+  for (auto& s : sensors_) s.releaseBuildState();
+}
+
 void DetectorModule::setup() {
   resolutionLocalX.setup([this]() { 
     double res = 0;
@@ -89,6 +120,21 @@ std::pair<double, double> DetectorModule::minMaxEtaWithError(double zError) cons
   return cachedMinMaxEtaWithError_;
 }
 
+/**
+ * Computes all the lazily evaluated geometry used by the hit finding, so that afterwards the module
+ * can be checked for hits from several threads at once without writing to it
+ */
+void DetectorModule::primeCaches() const {
+  minPhi();
+  maxPhi();
+  for (const Sensor& s : sensors()) {
+    s.minR(); s.maxR(); s.minZ(); s.maxZ();
+    const Polygon3d<4>& poly = s.hitPoly();
+    poly.getNormal();
+    poly.getCenter();
+  }
+}
+
 bool DetectorModule::couldHit(const XYZVector& direction, double zError) const {
   double eta = direction.Eta(), phi = direction.Phi();
   bool withinEta = eta > minEtaWithError(zError) && eta < maxEtaWithError(zError);
@@ -103,16 +149,28 @@ bool DetectorModule::couldHit(const XYZVector& direction, double zError) const {
 }
 
 
-double DetectorModule::resolutionEquivalentRPhi(double hitRho, double trackR) const {
+DetectorModule::ResolutionFactors DetectorModule::resolutionFactors() const {
+  return ResolutionFactors{ resolutionLocalX(), resolutionLocalY(), sin(skewAngle()), cos(skewAngle()), sin(tiltAngle()), cos(tiltAngle()) };
+}
+
+double DetectorModule::ResolutionFactors::equivalentRPhi(double hitRho, double trackR) const {
   double A = hitRho/(2*trackR); 
   double B = A/sqrt(1-A*A);
-  return sqrt(pow((B*sin(skewAngle())*cos(tiltAngle()) + cos(skewAngle())) * resolutionLocalX(),2) + pow(B*sin(tiltAngle()) * resolutionLocalY(),2));
+  return sqrt(pow((B*sinSkew*cosTilt + cosSkew) * localX,2) + pow(B*sinTilt * localY,2));
 }
 
-double DetectorModule::resolutionEquivalentZ(double hitRho, double trackR, double trackCotgTheta) const {
+double DetectorModule::ResolutionFactors::equivalentZ(double hitRho, double trackR, double trackCotgTheta) const {
   double A = hitRho/(2*trackR); 
   double D = trackCotgTheta/sqrt(1-A*A);
-  return sqrt(pow(((D*cos(tiltAngle()) + sin(tiltAngle()))*sin(skewAngle())) * resolutionLocalX(),2) + pow((D*sin(tiltAngle()) + cos(tiltAngle())) * resolutionLocalY(),2));
+  return sqrt(pow(((D*cosTilt + sinTilt)*sinSkew) * localX,2) + pow((D*sinTilt + cosTilt) * localY,2));
+}
+
+double DetectorModule::resolutionEquivalentRPhi(double hitRho, double trackR) const {
+  return resolutionFactors().equivalentRPhi(hitRho, trackR);
+}
+
+double DetectorModule::resolutionEquivalentZ(double hitRho, double trackR, double trackCotgTheta) const {
+  return resolutionFactors().equivalentZ(hitRho, trackR, trackCotgTheta);
 }
 
 
@@ -147,7 +205,7 @@ double DetectorModule::stripOccupancyPerEventEndcap() const {
   return occupancy;
 }
 
-double DetectorModule::stripOccupancyPerEvent() const {
+double DetectorModule::computeStripOccupancyPerEvent() const {
   if (fabs(tiltAngle()) < 1e-3) return stripOccupancyPerEventBarrel();
   else if (fabs(tiltAngle()) - M_PI/2. < 1e-3) return stripOccupancyPerEventEndcap();
   else return stripOccupancyPerEventBarrel()*pow(cos(tiltAngle()),2) + stripOccupancyPerEventEndcap()*pow(sin(tiltAngle()),2);
@@ -163,16 +221,29 @@ double DetectorModule::effectiveDsDistance() const {
   else return dsDistance()*sin(center().Theta())/sin(center().Theta()+tiltAngle());
 }
 
-std::pair<XYZVector, HitType> DetectorModule::checkTrackHits(const XYZVector& trackOrig, const XYZVector& trackDir) {
+std::pair<XYZVector, HitType> DetectorModule::checkTrackHits(const XYZVector& trackOrig, const XYZVector& trackDir) const {
+  std::pair<XYZVector, HitType> result;
+  if (numSensors() == 1) result = classifyTrackHits(innerSensor().checkHitSegment(trackOrig, trackDir), std::make_pair(XYZVector(), -1));
+  else result = classifyTrackHits(innerSensor().checkHitSegment(trackOrig, trackDir), outerSensor().checkHitSegment(trackOrig, trackDir));
+  countPathEvent("DetectorModule::checkTrackHits calls");
+  if (result.second != HitType::NONE) countPathEvent("DetectorModule::checkTrackHits hits");
+  return result;
+}
+
+/**
+ * Combine the hits of a track on the sensors of the module into the module hit
+ * @param inSegm The hit point and segment on the inner sensor, as given by <i>Sensor::checkHitSegment()</i>
+ * @param outSegm The same for the outer sensor; ignored for single-sensor modules
+ * @return The global coordinates and the type of the hit
+ */
+std::pair<XYZVector, HitType> DetectorModule::classifyTrackHits(const std::pair<XYZVector, int>& inSegm, const std::pair<XYZVector, int>& outSegm) const {
   HitType ht = HitType::NONE;
   XYZVector gc; // global coordinates of the hit
   if (numSensors() == 1) {
-    auto segm = innerSensor().checkHitSegment(trackOrig, trackDir);
+    const auto& segm = inSegm;
     // <SMe>The following line used to return HitType::BOTH. Changing to INNER in order to avoid double hit counting</SMe>
     if (segm.second > -1) { gc = segm.first; ht = HitType::INNER; } 
   } else {
-    auto inSegm = innerSensor().checkHitSegment(trackOrig, trackDir);
-    auto outSegm = outerSensor().checkHitSegment(trackOrig, trackDir);
     if (inSegm.second > -1 && outSegm.second > -1) { 
       gc = inSegm.first; // in case of both sensors are hit, the inner sensor hit coordinate is returned
       ht = ((zCorrelation() == SAMESEGMENT && (inSegm.second / (maxSegments()/minSegments()) == outSegm.second)) || zCorrelation() == MULTISEGMENT) ? HitType::STUB : HitType::BOTH;
@@ -180,7 +251,6 @@ std::pair<XYZVector, HitType> DetectorModule::checkTrackHits(const XYZVector& tr
     else if (outSegm.second > -1) { gc = outSegm.first; ht = HitType::OUTER; }
   }
   //basePoly().isLineIntersecting(trackOrig, trackDir, gc); // this was just for debug
-  if (ht != HitType::NONE) numHits_++;
   return std::make_pair(gc, ht);
 };
 
@@ -95,7 +95,7 @@ void Disk::build(const vector<double>& buildDsDistances) {
   materialObject_.build();
 
   try {
-    logINFO(Form("Building %s", fullid(*this).c_str()));
+    logINFO("Building " + fullid(*this));
     if (numRings.state()) buildTopDown(buildDsDistances);
     else buildBottomUp(buildDsDistances);
     translateZ(placeZ());
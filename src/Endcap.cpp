@@ -44,7 +44,7 @@ vector<double> Endcap::findMaxDsDistances() { // drill down into the property tr
 
 void Endcap::build() {
   try {
-    logINFO(Form("Building %s", fullid(*this).c_str()));
+    logINFO("Building " + fullid(*this));
     check();
 
     if (!innerZ.state()) innerZ(barrelMaxZ() + barrelGap());
@@ -10,7 +10,35 @@
 //#define __FLIPSENSORS_IN__
 
 #include <Extractor.h>
+#include <TaskPool.h>
 namespace insur {
+  /**
+   * Append the output of one layer or disc to the collections of the whole tracker.
+   * @param b The bundle of the layer or disc
+   * @param c, l, s, p, a, r, ri The collections of the whole tracker
+   */
+  static void appendBundle(CMSSWBundle& b, std::vector<Composite>& c, std::vector<LogicalInfo>& l, std::vector<ShapeInfo>& s,
+                           std::vector<PosInfo>& p, std::vector<AlgoInfo>& a, std::vector<Rotation>& r, std::vector<RILengthInfo>& ri) {
+    c.insert(c.end(), b.composites.begin(), b.composites.end());
+    l.insert(l.end(), b.logic.begin(), b.logic.end());
+    s.insert(s.end(), b.shapes.begin(), b.shapes.end());
+    p.insert(p.end(), b.positions.begin(), b.positions.end());
+    a.insert(a.end(), b.algos.begin(), b.algos.end());
+    r.insert(r.end(), b.rots.begin(), b.rots.end());
+    ri.insert(ri.end(), b.lrilength.begin(), b.lrilength.end());
+  }
+
+  /**
+   * Append the parts listed by a <i>SpecPar</i> block of one layer or disc to the block of the whole tracker.
+   * @param from The block of the layer or disc
+   * @param to The block of the tracker
+   */
+  static void appendSpec(const SpecParInfo& from, SpecParInfo& to) {
+    to.partselectors.insert(to.partselectors.end(), from.partselectors.begin(), from.partselectors.end());
+    to.partextras.insert(to.partextras.end(), from.partextras.begin(), from.partextras.end());
+    to.moduletypes.insert(to.moduletypes.end(), from.moduletypes.begin(), from.moduletypes.end());
+  }
+
   //public
   /**
    * This is the public analysis function that extracts the information that is necessary to convert a given material budget to a
@@ -29,8 +57,8 @@ namespace insur {
     Tracker& tr = mb.getTracker();
     InactiveSurfaces& is = mb.getInactiveSurfaces();
 
-    std::vector<std::vector<ModuleCap> >& bc = mb.getBarrelModuleCaps();
-    std::vector<std::vector<ModuleCap> >& ec = mb.getEndcapModuleCaps();
+    std::vector<ModuleCaps>& bc = mb.getBarrelModuleCaps();
+    std::vector<ModuleCaps>& ec = mb.getEndcapModuleCaps();
 
     std::vector<Element>& e = d.elements;
     std::vector<Composite>& c = d.composites;
@@ -404,17 +432,82 @@ namespace insur {
    * @param t A reference to the collection of topology information; used for output
    * @param ri A reference to the collection of overall radiation and interaction lengths per layer or disc; used for output
    */
-  void Extractor::analyseLayers(MaterialTable& mt/*, std::vector<std::vector<ModuleCap> >& bc*/, Tracker& tr,
+  void Extractor::analyseLayers(MaterialTable& mt/*, std::vector<ModuleCaps>& bc*/, Tracker& tr,
                                 std::vector<Composite>& c, std::vector<LogicalInfo>& l, std::vector<ShapeInfo>& s, std::vector<PosInfo>& p,
                                 std::vector<AlgoInfo>& a, std::vector<Rotation>& r, std::vector<SpecParInfo>& t, std::vector<RILengthInfo>& ri, bool wt) {
-    int layer;
+    SpecParInfo lspec, rspec, mspec;
+    // Layer
+    lspec.name = xml_subdet_layer + xml_par_tail;
+    lspec.parameter.first = xml_tkddd_structure;
+    lspec.parameter.second = xml_det_layer;
+    // Rod
+    rspec.name = xml_subdet_rod + xml_par_tail;
+    rspec.parameter.first = xml_tkddd_structure;
+    rspec.parameter.second = xml_det_rod;
+    // Module
+    mspec.name = xml_subdet_tobdet + xml_par_tail;
+    mspec.parameter.first = xml_tkddd_structure;
+    mspec.parameter.second = xml_det_tobdet;
+
+    // name goes into trackerStructureTopology
+    // parameter.first goes into trackerStructureTopology
+    // parameter.second goes into trackerStructureTopology?
+    //   >> well, as long as the values are TOBLayer, TOBRod, TOBDet
+    //   >> they do not go into any file!
+
+    LayerAggregator lagg;
+    tr.accept(lagg);
+    lagg.postVisit();
+    std::vector<ModuleCaps>& bc = lagg.getBarrelCap();
+
+    // the layer numbers of the caps, which stay put past a layer without rods
+    std::vector<int> layers;
+    int layer = 1;
+    for (unsigned int i = 0; i < bc.size(); i++) {
+      layers.push_back(layer);
+      if (lagg.getBarrelLayers()->at(layer - 1)->rodThickness() != 0.0) layer++;
+    }
+
+    // barrel caps layer loop, one task per layer, merged back in layer order
+    std::vector<CMSSWBundle> layerBundles(bc.size());
+    TaskPool::instance()->run("XML extraction of the layers", bc.size(), [&](int i) { analyseLayer(lagg, bc.at(i), layers.at(i), layerBundles.at(i), wt); }, numThreads_);
+    for (CMSSWBundle& b : layerBundles) {
+      appendBundle(b, c, l, s, p, a, r, ri);
+      appendSpec(b.specs.at(0), lspec);
+      appendSpec(b.specs.at(1), rspec);
+      appendSpec(b.specs.at(2), mspec);
+    }
+    if (!lspec.partselectors.empty()) t.push_back(lspec);
+    if (!rspec.partselectors.empty()) t.push_back(rspec);
+    if (!mspec.partselectors.empty()) t.push_back(mspec);
+  }
+
+  /**
+   * Extract the volumes of one barrel layer, as <i>analyseLayers()</i> does for all of them. The layers are independent,
+   * so this can be run for several of them at once.
+   * @param lagg The layers of the tracker and their module caps
+   * @param caps A reference to the caps of the modules of the layer; used as input
+   * @param layer The number of the layer, starting from 1
+   * @param d A reference to the bundle for the output of the layer, whose specs are the parts of the layer, rod and module blocks
+   * @param wt A flag for the alternative namespace of the volumes
+   */
+  void Extractor::analyseLayer(LayerAggregator& lagg, ModuleCaps& caps, int layer, CMSSWBundle& d, bool wt) {
+    std::vector<Composite>& c = d.composites;
+    std::vector<LogicalInfo>& l = d.logic;
+    std::vector<ShapeInfo>& s = d.shapes;
+    std::vector<PosInfo>& p = d.positions;
+    std::vector<AlgoInfo>& a = d.algos;
+    std::vector<Rotation>& r = d.rots;
+    std::vector<RILengthInfo>& ri = d.lrilength;
+    d.specs.resize(3);
+    SpecParInfo& lspec = d.specs.at(0);
+    SpecParInfo& rspec = d.specs.at(1);
+    SpecParInfo& mspec = d.specs.at(2);
 
     std::string nspace;
     if (wt) nspace = xml_newfileident;
     else nspace = xml_fileident;
-
-    std::vector<std::vector<ModuleCap> >::iterator oiter, oguard;
-    std::vector<ModuleCap>::iterator iiter, iguard;
+    ModuleCaps::iterator iiter, iguard;
 
     // Container inits
     ShapeInfo shape;
@@ -440,25 +533,6 @@ namespace insur {
 
     ModuleROCInfo minfo;
     ModuleROCInfo minfo_zero={}; 
-    SpecParInfo rocdims, lspec, rspec, mspec;
-    // Layer
-    lspec.name = xml_subdet_layer + xml_par_tail;
-    lspec.parameter.first = xml_tkddd_structure;
-    lspec.parameter.second = xml_det_layer;
-    // Rod
-    rspec.name = xml_subdet_rod + xml_par_tail;
-    rspec.parameter.first = xml_tkddd_structure;
-    rspec.parameter.second = xml_det_rod;
-    // Module
-    mspec.name = xml_subdet_tobdet + xml_par_tail;
-    mspec.parameter.first = xml_tkddd_structure;
-    mspec.parameter.second = xml_det_tobdet;
-
-    // name goes into trackerStructureTopology
-    // parameter.first goes into trackerStructureTopology
-    // parameter.second goes into trackerStructureTopology?
-    //   >> well, as long as the values are TOBLayer, TOBRod, TOBDet
-    //   >> they do not go into any file!
 
     RILengthInfo ril;
     ril.barrel = true;
@@ -468,247 +542,270 @@ namespace insur {
     // s and l: one entry for every module position on rod (box), one for every layer (tube), rods TBD
     // p: one entry for every layer (two for short layers), two modules, one wafer and active for each ring on rod
     // a: rods within layer (twice in case of a short layer)
-    layer = 1;
     alg.name = xml_tobalgo;
 
-    LayerAggregator lagg;
-    tr.accept(lagg);
-    lagg.postVisit();
-    std::vector<std::vector<ModuleCap> >& bc = lagg.getBarrelCap();
-    oguard = bc.end();
+    struct ThicknessVisitor : public ConstGeometryVisitor {
+      double max = 0;
+      void visit(const Module& m) { max = MAX(max, m.thickness()); }
+    };
+    ThicknessVisitor v;
+    lagg.getBarrelLayers()->at(layer-1)->accept(v);
 
-    // barrel caps layer loop
-    for (oiter = bc.begin(); oiter != oguard; oiter++) {
-      struct ThicknessVisitor : public ConstGeometryVisitor {
-        double max = 0;
-        void visit(const Module& m) { max = MAX(max, m.thickness()); }
-      };
-      ThicknessVisitor v;
-      lagg.getBarrelLayers()->at(layer-1)->accept(v);
-
-      double rmin = lagg.getBarrelLayers()->at(layer - 1)->minR();
-      //rmin = rmin - v.max / 2.0; // no need to manually add/subtract the thickness, it is already taken into account by the new volumetric minR/maxR functions
-      double rmax = lagg.getBarrelLayers()->at(layer - 1)->maxR();
-      //rmax = rmax + v.max / 2.0;
-      double zmin = lagg.getBarrelLayers()->at(layer - 1)->minZ();
-      double zmax = lagg.getBarrelLayers()->at(layer - 1)->maxZ();
-      double rodThickness = lagg.getBarrelLayers()->at(layer - 1)->rodThickness();
-      double deltar = rodThickness; //rmax - rmin; //findDeltaR(lagg.getBarrelLayers()->at(layer - 1)->getModuleVector()->begin(),
-      //           lagg.getBarrelLayers()->at(layer - 1)->getModuleVector()->end(), (rmin + rmax) / 2.0);
-
-      double ds, dt = 0.0;
-      double rtotal = 0.0, itotal = 0.0;
+    double rmin = lagg.getBarrelLayers()->at(layer - 1)->minR();
+    //rmin = rmin - v.max / 2.0; // no need to manually add/subtract the thickness, it is already taken into account by the new volumetric minR/maxR functions
+    double rmax = lagg.getBarrelLayers()->at(layer - 1)->maxR();
+    //rmax = rmax + v.max / 2.0;
+    double zmin = lagg.getBarrelLayers()->at(layer - 1)->minZ();
+    double zmax = lagg.getBarrelLayers()->at(layer - 1)->maxZ();
+    double rodThickness = lagg.getBarrelLayers()->at(layer - 1)->rodThickness();
+    double deltar = rodThickness; //rmax - rmin; //findDeltaR(lagg.getBarrelLayers()->at(layer - 1)->getModuleVector()->begin(),
+    //           lagg.getBarrelLayers()->at(layer - 1)->getModuleVector()->end(), (rmin + rmax) / 2.0);
 
-      int count = 0;
+    double ds, dt = 0.0;
+    double rtotal = 0.0, itotal = 0.0;
 
-      if (deltar == 0.0) continue;
+    int count = 0;
 
-      bool is_short = (zmax < 0.0) || (zmin > 0.0);
-      bool is_relevant = !is_short || (zmin > 0.0);
+    if (deltar == 0.0) return;
 
-      if (is_relevant) {
+    bool is_short = (zmax < 0.0) || (zmin > 0.0);
+    bool is_relevant = !is_short || (zmin > 0.0);
 
-        shape.type = bx; // box
-        shape.rmin = 0.0;
-        shape.rmax = 0.0;
+    if (is_relevant) {
 
-        ril.index = layer;
+      shape.type = bx; // box
+      shape.rmin = 0.0;
+      shape.rmax = 0.0;
 
-        std::set<int> rings;
-        std::ostringstream lname, rname, pconverter;
+      ril.index = layer;
 
-        lname << xml_layer << layer;
-        rname << xml_rod << layer;
+      std::set<int> rings;
+      std::ostringstream lname, rname, pconverter;
 
-        // lname and rname are Layer1 and Rod1 and go into all files
+      lname << xml_layer << layer;
+      rname << xml_rod << layer;
 
-        iguard = oiter->end();
+      // lname and rname are Layer1 and Rod1 and go into all files
 
-        // module caps loop
-        for (iiter = oiter->begin(); iiter != iguard; iiter++) {
-          int modRing = iiter->getModule().uniRef().ring;
-          if (rings.find(modRing) == rings.end()) {
+      iguard = caps.end();
+      PartnerIndex partners = indexPartnerModules(caps);
 
-            // This is the Barrel Case
-            std::vector<ModuleCap>::iterator partner;
-            std::ostringstream matname, shapename, specname;
+      // module caps loop
+      for (iiter = caps.begin(); iiter != iguard; iiter++) {
+        int modRing = iiter->getModule().moduleKey().ring();
+        if (rings.find(modRing) == rings.end()) {
+
+          // This is the Barrel Case
+          ModuleCaps::iterator partner;
+          std::ostringstream matname, shapename, specname;
 
 #ifndef __ADDVOLUMES__ 
-            // module composite material
-            matname << xml_base_actcomp << "L" << layer << "P" << modRing; 
-            c.push_back(createComposite(matname.str(), compositeDensity(*iiter, true), *iiter, true));
+          // module composite material
+          matname << xml_base_actcomp << "L" << layer << "P" << modRing; 
+          c.push_back(createComposite(matname.str(), compositeDensity(*iiter, true), *iiter, true));
 #endif
 
-            // module box
-            shapename << modRing << lname.str();
-            shape.name_tag = xml_barrel_module + shapename.str();
+          // module box
+          shapename << modRing << lname.str();
+          shape.name_tag = xml_barrel_module + shapename.str();
 #ifndef __ADDVOLUMES__
-            shape.dx = iiter->getModule().area() / iiter->getModule().length() / 2.0;
-            shape.dy = iiter->getModule().length() / 2.0;
+          shape.dx = iiter->getModule().area() / iiter->getModule().length() / 2.0;
+          shape.dy = iiter->getModule().length() / 2.0;
 #else
-            // Expand volumes for hybrids
-            shape.dx = iiter->getModule().area() / iiter->getModule().length() / 2.0 + iiter->getModule().serviceHybridWidth();
-            shape.dy = iiter->getModule().length() / 2.0 + iiter->getModule().frontEndHybridWidth();
+          // Expand volumes for hybrids
+          shape.dx = iiter->getModule().area() / iiter->getModule().length() / 2.0 + iiter->getModule().serviceHybridWidth();
+          shape.dy = iiter->getModule().length() / 2.0 + iiter->getModule().frontEndHybridWidth();
 #endif
-            shape.dz = iiter->getModule().thickness() / 2.0;
-            s.push_back(shape);
+          shape.dz = iiter->getModule().thickness() / 2.0;
+          s.push_back(shape);
 #ifdef __ADDVOLUMES__ 
-            // Get it back for sensors
-            shape.dx = iiter->getModule().area() / iiter->getModule().length() / 2.0;
-            shape.dy = iiter->getModule().length() / 2.0;
+          // Get it back for sensors
+          shape.dx = iiter->getModule().area() / iiter->getModule().length() / 2.0;
+          shape.dy = iiter->getModule().length() / 2.0;
 #endif
 
-            logic.name_tag = shape.name_tag;
-            logic.shape_tag = nspace + ":" + logic.name_tag;
+          logic.name_tag = shape.name_tag;
+          logic.shape_tag = nspace + ":" + logic.name_tag;
 #if 0
-            logic.material_tag = nspace + ":" + matname.str();
+          logic.material_tag = nspace + ":" + matname.str();
 #else
-            logic.material_tag = xml_material_air;
+          logic.material_tag = xml_material_air;
 #endif
-            l.push_back(logic);
+          l.push_back(logic);
 
-            // name_tag is BModule1Layer1 and it goes into all files
+          // name_tag is BModule1Layer1 and it goes into all files
 
-            pos.child_tag = logic.shape_tag;
-            pos.rotref = nspace + ":" + xml_barrel_tilt;
+          pos.child_tag = logic.shape_tag;
+          pos.rotref = nspace + ":" + xml_barrel_tilt;
 
-            if ((iiter->getModule().center().Rho() > (rmax - deltar / 2.0))
-                || ((iiter->getModule().center().Rho() < ((rmin + rmax) / 2.0))
-                    && (iiter->getModule().center().Rho() > (rmin + deltar / 2.0)))) pos.trans.dx = deltar / 2.0 - shape.dz;
-            else pos.trans.dx = shape.dz - deltar / 2.0;
+          if ((iiter->getModule().center().Rho() > (rmax - deltar / 2.0))
+              || ((iiter->getModule().center().Rho() < ((rmin + rmax) / 2.0))
+                  && (iiter->getModule().center().Rho() > (rmin + deltar / 2.0)))) pos.trans.dx = deltar / 2.0 - shape.dz;
+          else pos.trans.dx = shape.dz - deltar / 2.0;
 
-            if (is_short) {
-              pos.parent_tag = nspace + ":" + rname.str() + xml_plus;
-              pos.trans.dz = iiter->getModule().minZ() - ((zmax + zmin) / 2.0) + shape.dy;
+          if (is_short) {
+            pos.parent_tag = nspace + ":" + rname.str() + xml_plus;
+            pos.trans.dz = iiter->getModule().minZ() - ((zmax + zmin) / 2.0) + shape.dy;
+            p.push_back(pos);
+            pos.parent_tag = nspace + ":" + rname.str() + xml_minus;
+            pos.trans.dz = -pos.trans.dz;
+            pos.copy = 2; // This is a copy of the BModule (FW/BW barrel half)
+            p.push_back(pos);
+            pos.copy = 1;
+          } else {
+            pos.parent_tag = nspace + ":" + rname.str();
+            partner = findPartnerModule(caps, partners, iiter, iguard, modRing);
+            if (iiter->getModule().moduleKey().side() > 0) { 
+              pos.trans.dz = iiter->getModule().maxZ() - shape.dy;
               p.push_back(pos);
-              pos.parent_tag = nspace + ":" + rname.str() + xml_minus;
-              pos.trans.dz = -pos.trans.dz;
+              if (partner != iguard) {
+                if ((partner->getModule().center().Rho() > (rmax - deltar / 2.0))
+                    || ((partner->getModule().center().Rho() < ((rmin + rmax) / 2.0))
+                        && (partner->getModule().center().Rho() > (rmin + deltar / 2.0)))) pos.trans.dx = deltar / 2.0 - shape.dz;
+                else pos.trans.dx = shape.dz - deltar / 2.0;
+                pos.trans.dz = partner->getModule().maxZ() - shape.dy;
+                pos.copy = 2; // This is a copy of the BModule (FW/BW barrel half)
+                p.push_back(pos);
+                pos.copy = 1;
+              }
+            } else {
+              pos.trans.dz = iiter->getModule().maxZ() - shape.dy;
               pos.copy = 2; // This is a copy of the BModule (FW/BW barrel half)
               p.push_back(pos);
               pos.copy = 1;
-            } else {
-              pos.parent_tag = nspace + ":" + rname.str();
-              partner = findPartnerModule(iiter, iguard, modRing);
-              if (iiter->getModule().uniRef().side > 0) { 
-                pos.trans.dz = iiter->getModule().maxZ() - shape.dy;
-                p.push_back(pos);
-                if (partner != iguard) {
-                  if ((partner->getModule().center().Rho() > (rmax - deltar / 2.0))
-                      || ((partner->getModule().center().Rho() < ((rmin + rmax) / 2.0))
-                          && (partner->getModule().center().Rho() > (rmin + deltar / 2.0)))) pos.trans.dx = deltar / 2.0 - shape.dz;
-                  else pos.trans.dx = shape.dz - deltar / 2.0;
-                  pos.trans.dz = partner->getModule().maxZ() - shape.dy;
-                  pos.copy = 2; // This is a copy of the BModule (FW/BW barrel half)
-                  p.push_back(pos);
-                  pos.copy = 1;
-                }
-              } else {
-                pos.trans.dz = iiter->getModule().maxZ() - shape.dy;
-                pos.copy = 2; // This is a copy of the BModule (FW/BW barrel half)
+              if (partner != iguard) {
+                if ((partner->getModule().center().Rho() > (rmax - deltar / 2.0))
+                    || ((partner->getModule().center().Rho() < ((rmin + rmax) / 2.0))
+                        && (partner->getModule().center().Rho() > (rmin + deltar / 2.0)))) pos.trans.dx = deltar / 2.0 - shape.dz;
+                else pos.trans.dx = shape.dz - deltar / 2.0;
+                pos.trans.dz = partner->getModule().maxZ() - shape.dy;
                 p.push_back(pos);
-                pos.copy = 1;
-                if (partner != iguard) {
-                  if ((partner->getModule().center().Rho() > (rmax - deltar / 2.0))
-                      || ((partner->getModule().center().Rho() < ((rmin + rmax) / 2.0))
-                          && (partner->getModule().center().Rho() > (rmin + deltar / 2.0)))) pos.trans.dx = deltar / 2.0 - shape.dz;
-                  else pos.trans.dx = shape.dz - deltar / 2.0;
-                  pos.trans.dz = partner->getModule().maxZ() - shape.dy;
-                  p.push_back(pos);
-                }
               }
             }
-            pos.rotref = "";
+          }
+          pos.rotref = "";
 
 #ifdef __ADDVOLUMES__ 
 #if 0
-            if (iiter->getModule().numSensors() == 2) { // PS/2S module
-               std::cerr << (*iiter).getModule().length() << " " 
-                         << (*iiter).getModule().area()/(*iiter).getModule().length() << " " 
-                         << (*iiter).getModule().thickness() << std::endl;
-            } 
+          if (iiter->getModule().numSensors() == 2) { // PS/2S module
+             std::cerr << (*iiter).getModule().length() << " " 
+                       << (*iiter).getModule().area()/(*iiter).getModule().length() << " " 
+                       << (*iiter).getModule().thickness() << std::endl;
+          } 
 #endif
-            std::string moduleName = shape.name_tag; // e.g. BModule1Layer1
-            HybridVolumes hvs(moduleName,*iiter);
-            hvs.buildVolumes();
+          std::string moduleName = shape.name_tag; // e.g. BModule1Layer1
+          HybridVolumes hvs(moduleName,*iiter);
+          hvs.buildVolumes();
 #endif
 
-            // wafer
-            string xml_base_inout = "";
-            if (iiter->getModule().numSensors() == 2) xml_base_inout = xml_base_inner;
+          // wafer
+          string xml_base_inout = "";
+          if (iiter->getModule().numSensors() == 2) xml_base_inout = xml_base_inner;
+
+          shape.name_tag = xml_barrel_module + shapename.str() + xml_base_inout + xml_base_waf;
+          shape.dz = iiter->getModule().sensorThickness() / 2.0;
+          //if (iiter->getModule().numSensors() == 2) shape.dz = shape.dz / 2.0; // CUIDADO calcSensThick returned 2x what getSensThick returns, it means that now one-sided sensors are half as thick if not compensated for in the config files
+          s.push_back(shape);
+
+          pos.parent_tag = logic.shape_tag;
+
+          logic.name_tag = shape.name_tag;
+          logic.shape_tag = nspace + ":" + logic.name_tag;
+          logic.material_tag = xml_material_air;
+          l.push_back(logic);
+
+          pos.child_tag = logic.shape_tag;
+          pos.trans.dx = 0.0;
+          pos.trans.dz = /*shape.dz*/ - iiter->getModule().dsDistance() / 2.0; 
+          p.push_back(pos);
+
+          if (iiter->getModule().numSensors() == 2) {
+
+            xml_base_inout = xml_base_outer;
 
             shape.name_tag = xml_barrel_module + shapename.str() + xml_base_inout + xml_base_waf;
-            shape.dz = iiter->getModule().sensorThickness() / 2.0;
-            //if (iiter->getModule().numSensors() == 2) shape.dz = shape.dz / 2.0; // CUIDADO calcSensThick returned 2x what getSensThick returns, it means that now one-sided sensors are half as thick if not compensated for in the config files
             s.push_back(shape);
 
-            pos.parent_tag = logic.shape_tag;
-
             logic.name_tag = shape.name_tag;
             logic.shape_tag = nspace + ":" + logic.name_tag;
-            logic.material_tag = xml_material_air;
             l.push_back(logic);
 
             pos.child_tag = logic.shape_tag;
-            pos.trans.dx = 0.0;
-            pos.trans.dz = /*shape.dz*/ - iiter->getModule().dsDistance() / 2.0; 
+            pos.trans.dz = pos.trans.dz + /*2 * shape.dz +*/ iiter->getModule().dsDistance();  // CUIDADO: was with 2*shape.dz, but why???
+            //pos.copy = 2;
+
+            if (iiter->getModule().stereoRotation() != 0) {
+              rot.name = type_stereo + xml_barrel_module + shapename.str();
+              rot.thetax = 90.0;
+              rot.phix = iiter->getModule().stereoRotation() / M_PI * 180;
+              rot.thetay = 90.0;
+              rot.phiy = 90.0 + iiter->getModule().stereoRotation() / M_PI * 180;
+              r.push_back(rot);
+              pos.rotref = nspace + ":" + rot.name;
+            }
             p.push_back(pos);
 
-            if (iiter->getModule().numSensors() == 2) {
+            // Now reset
+            pos.rotref.clear();
+            rot.name.clear();
+            rot.thetax = 0.0;
+            rot.phix = 0.0;
+            rot.thetay = 0.0;
+            rot.phiy = 0.0;
+            pos.copy = 1;
+          }
+
 
-              xml_base_inout = xml_base_outer;
 
-              shape.name_tag = xml_barrel_module + shapename.str() + xml_base_inout + xml_base_waf;
-              s.push_back(shape);
+          // active surface
+          xml_base_inout = "";
+          if (iiter->getModule().numSensors() == 2) xml_base_inout = xml_base_inner;
 
-              logic.name_tag = shape.name_tag;
-              logic.shape_tag = nspace + ":" + logic.name_tag;
-              l.push_back(logic);
+          shape.name_tag = xml_barrel_module + shapename.str() + xml_base_inout + xml_base_act;
+          s.push_back(shape);
 
-              pos.child_tag = logic.shape_tag;
-              pos.trans.dz = pos.trans.dz + /*2 * shape.dz +*/ iiter->getModule().dsDistance();  // CUIDADO: was with 2*shape.dz, but why???
-              //pos.copy = 2;
+          //pos.parent_tag = logic.shape_tag;
+          pos.parent_tag = nspace + ":" + xml_barrel_module + shapename.str() + xml_base_inout + xml_base_waf;
 
-              if (iiter->getModule().stereoRotation() != 0) {
-                rot.name = type_stereo + xml_barrel_module + shapename.str();
-                rot.thetax = 90.0;
-                rot.phix = iiter->getModule().stereoRotation() / M_PI * 180;
-                rot.thetay = 90.0;
-                rot.phiy = 90.0 + iiter->getModule().stereoRotation() / M_PI * 180;
-                r.push_back(rot);
-                pos.rotref = nspace + ":" + rot.name;
-              }
-              p.push_back(pos);
+          logic.name_tag = shape.name_tag;
+          logic.shape_tag = nspace + ":" + logic.name_tag;
+          logic.material_tag = nspace + ":" + xml_sensor_silicon;
+          l.push_back(logic);
 
-              // Now reset
-              pos.rotref.clear();
-              rot.name.clear();
-              rot.thetax = 0.0;
-              rot.phix = 0.0;
-              rot.thetay = 0.0;
-              rot.phiy = 0.0;
-              pos.copy = 1;
-            }
+          pos.child_tag = logic.shape_tag;
+          pos.trans.dz = 0.0;
+#ifdef __FLIPSENSORS_IN__ // Flip INNER sensors
+          pos.rotref = nspace + ":" + rot_sensor_tag;
+#endif
+          p.push_back(pos);
 
+          // topology
+          mspec.partselectors.push_back(logic.name_tag);
 
+          minfo.name		= iiter->getModule().moduleType();
+          minfo.rocrows	= any2str<int>(iiter->getModule().innerSensor().numROCRows());  // in case of single sensor module innerSensor() and outerSensor() point to the same sensor
+          minfo.roccols	= any2str<int>(iiter->getModule().innerSensor().numROCCols());
+          minfo.rocx		= any2str<int>(iiter->getModule().innerSensor().numROCX());
+          minfo.rocy		= any2str<int>(iiter->getModule().innerSensor().numROCY());
+
+          mspec.moduletypes.push_back(minfo);
+
+          if (iiter->getModule().numSensors() == 2) { 
 
             // active surface
-            xml_base_inout = "";
-            if (iiter->getModule().numSensors() == 2) xml_base_inout = xml_base_inner;
+            xml_base_inout = xml_base_outer;
 
             shape.name_tag = xml_barrel_module + shapename.str() + xml_base_inout + xml_base_act;
             s.push_back(shape);
 
-            //pos.parent_tag = logic.shape_tag;
             pos.parent_tag = nspace + ":" + xml_barrel_module + shapename.str() + xml_base_inout + xml_base_waf;
 
             logic.name_tag = shape.name_tag;
             logic.shape_tag = nspace + ":" + logic.name_tag;
-            logic.material_tag = nspace + ":" + xml_sensor_silicon;
             l.push_back(logic);
 
             pos.child_tag = logic.shape_tag;
-            pos.trans.dz = 0.0;
-#ifdef __FLIPSENSORS_IN__ // Flip INNER sensors
+#ifdef __FLIPSENSORS_OUT__ // Flip OUTER sensors
             pos.rotref = nspace + ":" + rot_sensor_tag;
 #endif
             p.push_back(pos);
@@ -716,188 +813,152 @@ namespace insur {
             // topology
             mspec.partselectors.push_back(logic.name_tag);
 
-            minfo.name		= iiter->getModule().moduleType();
-            minfo.rocrows	= any2str<int>(iiter->getModule().innerSensor().numROCRows());  // in case of single sensor module innerSensor() and outerSensor() point to the same sensor
-            minfo.roccols	= any2str<int>(iiter->getModule().innerSensor().numROCCols());
-            minfo.rocx		= any2str<int>(iiter->getModule().innerSensor().numROCX());
-            minfo.rocy		= any2str<int>(iiter->getModule().innerSensor().numROCY());
+            minfo.rocrows	= any2str<int>(iiter->getModule().outerSensor().numROCRows());
+            minfo.roccols	= any2str<int>(iiter->getModule().outerSensor().numROCCols());
+            minfo.rocx		= any2str<int>(iiter->getModule().outerSensor().numROCX());
+            minfo.rocy		= any2str<int>(iiter->getModule().outerSensor().numROCY());
 
             mspec.moduletypes.push_back(minfo);
-
-            if (iiter->getModule().numSensors() == 2) { 
-
-              // active surface
-              xml_base_inout = xml_base_outer;
-
-              shape.name_tag = xml_barrel_module + shapename.str() + xml_base_inout + xml_base_act;
-              s.push_back(shape);
-
-              pos.parent_tag = nspace + ":" + xml_barrel_module + shapename.str() + xml_base_inout + xml_base_waf;
-
-              logic.name_tag = shape.name_tag;
-              logic.shape_tag = nspace + ":" + logic.name_tag;
-              l.push_back(logic);
-
-              pos.child_tag = logic.shape_tag;
-#ifdef __FLIPSENSORS_OUT__ // Flip OUTER sensors
-              pos.rotref = nspace + ":" + rot_sensor_tag;
-#endif
-              p.push_back(pos);
-
-              // topology
-              mspec.partselectors.push_back(logic.name_tag);
-
-              minfo.rocrows	= any2str<int>(iiter->getModule().outerSensor().numROCRows());
-              minfo.roccols	= any2str<int>(iiter->getModule().outerSensor().numROCCols());
-              minfo.rocx		= any2str<int>(iiter->getModule().outerSensor().numROCX());
-              minfo.rocy		= any2str<int>(iiter->getModule().outerSensor().numROCY());
-
-              mspec.moduletypes.push_back(minfo);
 #ifdef __ADDVOLUMES__
-              hvs.addMaterialInfo(c);
-              hvs.addShapeInfo(s);
-              hvs.addLogicInfo(l);
-              hvs.addPositionInfo(p);
+            hvs.addMaterialInfo(c);
+            hvs.addShapeInfo(s);
+            hvs.addLogicInfo(l);
+            hvs.addPositionInfo(p);
 #ifdef __DEBUGPRINT__
-              hvs.print();
+            hvs.print();
 #endif
 #endif
-            } // End of replica for Pt-modules
-
-            // material properties
-            rtotal = rtotal + iiter->getRadiationLength();
-            itotal = itotal + iiter->getInteractionLength();
-            count++;
-            rings.insert(modRing);
-            dt = iiter->getModule().thickness();
-          }
+          } // End of replica for Pt-modules
+
+          // material properties
+          rtotal = rtotal + iiter->getRadiationLength();
+          itotal = itotal + iiter->getInteractionLength();
+          count++;
+          rings.insert(modRing);
+          dt = iiter->getModule().thickness();
         }
-        if (count > 0) {
-          ril.rlength = rtotal / (double)count;
-          ril.ilength = itotal / (double)count;
-          ri.push_back(ril);
-        }
-        // rod(s)
-        shape.name_tag = rname.str();
-        if (is_short) shape.name_tag = shape.name_tag + xml_plus;
-        shape.dy = shape.dx;
-        shape.dx = rodThickness / 2.0;
-        if (is_short) shape.dz = (zmax - zmin) / 2.0;
-        else shape.dz = zmax;
+      }
+      if (count > 0) {
+        ril.rlength = rtotal / (double)count;
+        ril.ilength = itotal / (double)count;
+        ri.push_back(ril);
+      }
+      // rod(s)
+      shape.name_tag = rname.str();
+      if (is_short) shape.name_tag = shape.name_tag + xml_plus;
+      shape.dy = shape.dx;
+      shape.dx = rodThickness / 2.0;
+      if (is_short) shape.dz = (zmax - zmin) / 2.0;
+      else shape.dz = zmax;
+      s.push_back(shape);
+      logic.name_tag = shape.name_tag;
+      logic.shape_tag = nspace + ":" + logic.name_tag;
+      logic.material_tag = xml_material_air;
+      l.push_back(logic);
+      rspec.partselectors.push_back(logic.name_tag);
+      rspec.moduletypes.push_back(minfo_zero);
+      //rspec.moduletypes.push_back("");
+      pconverter << logic.shape_tag;
+      if (is_short) {
+        shape.name_tag = rname.str() + xml_minus;
         s.push_back(shape);
         logic.name_tag = shape.name_tag;
         logic.shape_tag = nspace + ":" + logic.name_tag;
-        logic.material_tag = xml_material_air;
         l.push_back(logic);
         rspec.partselectors.push_back(logic.name_tag);
-        rspec.moduletypes.push_back(minfo_zero);
         //rspec.moduletypes.push_back("");
-        pconverter << logic.shape_tag;
-        if (is_short) {
-          shape.name_tag = rname.str() + xml_minus;
-          s.push_back(shape);
-          logic.name_tag = shape.name_tag;
-          logic.shape_tag = nspace + ":" + logic.name_tag;
-          l.push_back(logic);
-          rspec.partselectors.push_back(logic.name_tag);
-          //rspec.moduletypes.push_back("");
-          rspec.moduletypes.push_back(minfo_zero);
-        }
-        ds = fromRim(rmax, shape.dy);
-        // extra containers for short layers
-        if (wt && is_short) {
-          shape.type = tb;
-          shape.dx = 0.0;
-          shape.dy = 0.0;
-          shape.rmin = rmin;
-          shape.rmax = rmax;
-          shape.name_tag = lname.str() + xml_plus;
-          s.push_back(shape);
-          logic.name_tag = shape.name_tag;
-          logic.shape_tag = nspace + ":" + logic.name_tag;
-          l.push_back(logic);
-          pos.trans.dx = 0.0;
-          pos.trans.dz = zmin + (zmax - zmin) / 2.0;
-          pos.parent_tag = nspace + ":" + lname.str();
-          pos.child_tag = logic.shape_tag;
-          p.push_back(pos);
-          shape.name_tag = lname.str() + xml_minus;
-          s.push_back(shape);
-          logic.name_tag = shape.name_tag;
-          logic.shape_tag = nspace + ":" + logic.name_tag;
-          l.push_back(logic);
-          pos.trans.dz = -pos.trans.dz;
-          pos.child_tag = logic.shape_tag;
-          p.push_back(pos);
-        }
-        // layer
+        rspec.moduletypes.push_back(minfo_zero);
+      }
+      ds = fromRim(rmax, shape.dy);
+      // extra containers for short layers
+      if (wt && is_short) {
         shape.type = tb;
         shape.dx = 0.0;
         shape.dy = 0.0;
-        pos.trans.dx = 0.0;
-        pos.trans.dz = 0.0;
-        shape.name_tag = lname.str();
         shape.rmin = rmin;
         shape.rmax = rmax;
-        shape.dz = zmax;
+        shape.name_tag = lname.str() + xml_plus;
         s.push_back(shape);
         logic.name_tag = shape.name_tag;
         logic.shape_tag = nspace + ":" + logic.name_tag;
         l.push_back(logic);
-        pos.parent_tag = xml_pixbarident + ":" + xml_pixbar;
+        pos.trans.dx = 0.0;
+        pos.trans.dz = zmin + (zmax - zmin) / 2.0;
+        pos.parent_tag = nspace + ":" + lname.str();
         pos.child_tag = logic.shape_tag;
         p.push_back(pos);
-        lspec.partselectors.push_back(logic.name_tag);
-        //lspec.moduletypes.push_back("");
-        lspec.moduletypes.push_back(minfo_zero);
-        // rods in layer algorithm(s)
-        alg.parent = logic.shape_tag;
-        if (wt && is_short) alg.parent = alg.parent + xml_plus;
-        alg.parameters.push_back(stringParam(xml_childparam, pconverter.str()));
-        pconverter.str("");
-        pconverter << (lagg.getBarrelLayers()->at(layer - 1)->tilt() + 90) << "*deg";
-        alg.parameters.push_back(numericParam(xml_tilt, pconverter.str()));
-        pconverter.str("");
-        pconverter << lagg.getBarrelLayers()->at(layer - 1)->startAngle();
-        alg.parameters.push_back(numericParam(xml_startangle, pconverter.str()));
+        shape.name_tag = lname.str() + xml_minus;
+        s.push_back(shape);
+        logic.name_tag = shape.name_tag;
+        logic.shape_tag = nspace + ":" + logic.name_tag;
+        l.push_back(logic);
+        pos.trans.dz = -pos.trans.dz;
+        pos.child_tag = logic.shape_tag;
+        p.push_back(pos);
+      }
+      // layer
+      shape.type = tb;
+      shape.dx = 0.0;
+      shape.dy = 0.0;
+      pos.trans.dx = 0.0;
+      pos.trans.dz = 0.0;
+      shape.name_tag = lname.str();
+      shape.rmin = rmin;
+      shape.rmax = rmax;
+      shape.dz = zmax;
+      s.push_back(shape);
+      logic.name_tag = shape.name_tag;
+      logic.shape_tag = nspace + ":" + logic.name_tag;
+      l.push_back(logic);
+      pos.parent_tag = xml_pixbarident + ":" + xml_pixbar;
+      pos.child_tag = logic.shape_tag;
+      p.push_back(pos);
+      lspec.partselectors.push_back(logic.name_tag);
+      //lspec.moduletypes.push_back("");
+      lspec.moduletypes.push_back(minfo_zero);
+      // rods in layer algorithm(s)
+      alg.parent = logic.shape_tag;
+      if (wt && is_short) alg.parent = alg.parent + xml_plus;
+      alg.parameters.push_back(stringParam(xml_childparam, pconverter.str()));
+      pconverter.str("");
+      pconverter << (lagg.getBarrelLayers()->at(layer - 1)->tilt() + 90) << "*deg";
+      alg.parameters.push_back(numericParam(xml_tilt, pconverter.str()));
+      pconverter.str("");
+      pconverter << lagg.getBarrelLayers()->at(layer - 1)->startAngle();
+      alg.parameters.push_back(numericParam(xml_startangle, pconverter.str()));
+      pconverter.str("");
+      alg.parameters.push_back(numericParam(xml_rangeangle, "360*deg"));
+      pconverter << (rmin + deltar / 2.0) << "*mm";
+      alg.parameters.push_back(numericParam(xml_radiusin, pconverter.str()));
+      pconverter.str("");
+      pconverter << (rmax - ds - deltar / 2.0 - 2.0 * dt) << "*mm";
+      alg.parameters.push_back(numericParam(xml_radiusout, pconverter.str()));
+      pconverter.str("");
+      if (!wt && is_short) {
+        pconverter << (zmin + (zmax - zmin) / 2.0) << "*mm";
+        alg.parameters.push_back(numericParam(xml_zposition, pconverter.str()));
         pconverter.str("");
-        alg.parameters.push_back(numericParam(xml_rangeangle, "360*deg"));
-        pconverter << (rmin + deltar / 2.0) << "*mm";
-        alg.parameters.push_back(numericParam(xml_radiusin, pconverter.str()));
+      }
+      else alg.parameters.push_back(numericParam(xml_zposition, "0.0*mm"));
+      pconverter << lagg.getBarrelLayers()->at(layer - 1)->numRods();
+      alg.parameters.push_back(numericParam(xml_number, pconverter.str()));
+      alg.parameters.push_back(numericParam(xml_startcopyno, "1"));
+      alg.parameters.push_back(numericParam(xml_incrcopyno, "1"));
+      a.push_back(alg);
+      // extras for short layers
+      if (is_short) {
         pconverter.str("");
-        pconverter << (rmax - ds - deltar / 2.0 - 2.0 * dt) << "*mm";
-        alg.parameters.push_back(numericParam(xml_radiusout, pconverter.str()));
+        if (wt) alg.parent = logic.shape_tag + xml_minus;
+        pconverter << nspace << ":" << rname.str() << xml_minus;
+        alg.parameters.front() = stringParam(xml_childparam, pconverter.str());
         pconverter.str("");
-        if (!wt && is_short) {
-          pconverter << (zmin + (zmax - zmin) / 2.0) << "*mm";
-          alg.parameters.push_back(numericParam(xml_zposition, pconverter.str()));
-          pconverter.str("");
-        }
-        else alg.parameters.push_back(numericParam(xml_zposition, "0.0*mm"));
-        pconverter << lagg.getBarrelLayers()->at(layer - 1)->numRods();
-        alg.parameters.push_back(numericParam(xml_number, pconverter.str()));
-        alg.parameters.push_back(numericParam(xml_startcopyno, "1"));
-        alg.parameters.push_back(numericParam(xml_incrcopyno, "1"));
+        if (wt) pconverter << "0.0*mm";
+        else pconverter << -(zmin + (zmax - zmin) / 2.0) << "*mm";
+        alg.parameters.at(6) = numericParam(xml_zposition, pconverter.str());
         a.push_back(alg);
-        // extras for short layers
-        if (is_short) {
-          pconverter.str("");
-          if (wt) alg.parent = logic.shape_tag + xml_minus;
-          pconverter << nspace << ":" << rname.str() << xml_minus;
-          alg.parameters.front() = stringParam(xml_childparam, pconverter.str());
-          pconverter.str("");
-          if (wt) pconverter << "0.0*mm";
-          else pconverter << -(zmin + (zmax - zmin) / 2.0) << "*mm";
-          alg.parameters.at(6) = numericParam(xml_zposition, pconverter.str());
-          a.push_back(alg);
-        }
-        alg.parameters.clear();
       }
-      layer++;
+      alg.parameters.clear();
     }
-    if (!lspec.partselectors.empty()) t.push_back(lspec);
-    if (!rspec.partselectors.empty()) t.push_back(rspec);
-    if (!mspec.partselectors.empty()) t.push_back(mspec);
   }
 
   /**
@@ -921,17 +982,66 @@ namespace insur {
    * @param t A reference to the collection of topology information; used for output
    * @param ri A reference to the collection of overall radiation and interaction lengths per layer or disc; used for output
    */
-  void Extractor::analyseDiscs(MaterialTable& mt, std::vector<std::vector<ModuleCap> >& ec, Tracker& tr,
+  void Extractor::analyseDiscs(MaterialTable& mt, std::vector<ModuleCaps>& ec, Tracker& tr,
                                std::vector<Composite>& c, std::vector<LogicalInfo>& l, std::vector<ShapeInfo>& s, std::vector<PosInfo>& p,
                                std::vector<AlgoInfo>& a, std::vector<Rotation>& r, std::vector<SpecParInfo>& t, std::vector<RILengthInfo>& ri, bool wt) {
-    int layer;
+    SpecParInfo dspec, rspec, mspec;
+    // Disk
+    dspec.name = xml_subdet_wheel + xml_par_tail;
+    dspec.parameter.first = xml_tkddd_structure;
+    dspec.parameter.second = xml_det_wheel;
+    // Ring
+    rspec.name = xml_subdet_ring + xml_par_tail;
+    rspec.parameter.first = xml_tkddd_structure;
+    rspec.parameter.second = xml_det_ring;
+    // Module
+    mspec.name = xml_subdet_tiddet + xml_par_tail;
+    mspec.parameter.first = xml_tkddd_structure;
+    mspec.parameter.second = xml_det_tiddet;
+
+    LayerAggregator lagg;
+    tr.accept(lagg);
+
+    // endcap caps layer loop, one task per disc, merged back in disc order
+    std::vector<CMSSWBundle> discBundles(ec.size());
+    TaskPool::instance()->run("XML extraction of the discs", ec.size(), [&](int i) { analyseDisc(lagg, ec.at(i), i + 1, discBundles.at(i), wt); }, numThreads_);
+    for (CMSSWBundle& b : discBundles) {
+      appendBundle(b, c, l, s, p, a, r, ri);
+      appendSpec(b.specs.at(0), dspec);
+      appendSpec(b.specs.at(1), rspec);
+      appendSpec(b.specs.at(2), mspec);
+    }
+    if (!dspec.partselectors.empty()) t.push_back(dspec);
+    if (!rspec.partselectors.empty()) t.push_back(rspec);
+    if (!mspec.partselectors.empty()) t.push_back(mspec);
+  }
+
+  /**
+   * Extract the volumes of one endcap disc, as <i>analyseDiscs()</i> does for all of them; only the discs in z+ give any.
+   * The discs are independent, so this can be run for several of them at once.
+   * @param lagg The discs of the tracker
+   * @param caps A reference to the caps of the modules of the disc; used as input
+   * @param layer The number of the disc, starting from 1
+   * @param d A reference to the bundle for the output of the disc, whose specs are the parts of the disc, ring and module blocks
+   * @param wt A flag for the alternative namespace of the volumes
+   */
+  void Extractor::analyseDisc(LayerAggregator& lagg, ModuleCaps& caps, int layer, CMSSWBundle& d, bool wt) {
+    std::vector<Composite>& c = d.composites;
+    std::vector<LogicalInfo>& l = d.logic;
+    std::vector<ShapeInfo>& s = d.shapes;
+    std::vector<PosInfo>& p = d.positions;
+    std::vector<AlgoInfo>& a = d.algos;
+    std::vector<Rotation>& r = d.rots;
+    std::vector<RILengthInfo>& ri = d.lrilength;
+    d.specs.resize(3);
+    SpecParInfo& dspec = d.specs.at(0);
+    SpecParInfo& rspec = d.specs.at(1);
+    SpecParInfo& mspec = d.specs.at(2);
 
     std::string nspace;
     if (wt) nspace = xml_newfileident;
     else nspace = xml_fileident;
-
-    std::vector<std::vector<ModuleCap> >::iterator oiter, oguard;
-    std::vector<ModuleCap>::iterator iiter, iguard;
+    ModuleCaps::iterator iiter, iguard;
 
     // Container inits
     ShapeInfo shape;
@@ -957,19 +1067,6 @@ namespace insur {
 
     ModuleROCInfo minfo;
     ModuleROCInfo minfo_zero={}; 
-    SpecParInfo rocdims, dspec, rspec, mspec;
-    // Disk
-    dspec.name = xml_subdet_wheel + xml_par_tail;
-    dspec.parameter.first = xml_tkddd_structure;
-    dspec.parameter.second = xml_det_wheel;
-    // Ring
-    rspec.name = xml_subdet_ring + xml_par_tail;
-    rspec.parameter.first = xml_tkddd_structure;
-    rspec.parameter.second = xml_det_ring;
-    // Module
-    mspec.name = xml_subdet_tiddet + xml_par_tail;
-    mspec.parameter.first = xml_tkddd_structure;
-    mspec.parameter.second = xml_det_tiddet;
 
     RILengthInfo ril;
     ril.barrel = false;
@@ -979,197 +1076,224 @@ namespace insur {
     // s and l: one entry for every ring module, one for every ring, one for every disc
     // p: one entry for every disc, one for every ring, one module, wafer and active per ring
     // a: two per ring with modules inside ring
-    layer = 1;
     alg.name = xml_ecalgo;
-    oguard = ec.end();
 
-    LayerAggregator lagg;
-    tr.accept(lagg);
+    if (lagg.getEndcapLayers()->at(layer - 1)->minZ() > 0) {
 
-    // endcap caps layer loop
-    for (oiter = ec.begin(); oiter != oguard; oiter++) {
-      if (lagg.getEndcapLayers()->at(layer - 1)->minZ() > 0) {
+      ril.index = layer;
+      std::set<int> ridx;
+      std::map<int, RingInfo> rinfo;
 
-        ril.index = layer;
-        std::set<int> ridx;
-        std::map<int, RingInfo> rinfo;
-
-        struct ThicknessVisitor : public ConstGeometryVisitor {
-          double max = 0;
-          void visit(const Module& m) { max = MAX(max, m.thickness()); }
-        };
-        ThicknessVisitor v;
-        lagg.getEndcapLayers()->at(layer-1)->accept(v);
+      struct ThicknessVisitor : public ConstGeometryVisitor {
+        double max = 0;
+        void visit(const Module& m) { max = MAX(max, m.thickness()); }
+      };
+      ThicknessVisitor v;
+      lagg.getEndcapLayers()->at(layer-1)->accept(v);
 		// CUIDADO refactor using Disk methods for min/max Z,R
-        double rmin = lagg.getEndcapLayers()->at(layer - 1)->minR();
-        double rmax = lagg.getEndcapLayers()->at(layer - 1)->maxR();
-        double zmax = lagg.getEndcapLayers()->at(layer - 1)->maxZ();
-        //zmax = zmax + v.max / 2.0; 
-        double zmin = lagg.getEndcapLayers()->at(layer - 1)->minZ();
-        //zmin = zmin - v.max / 2.0;
-        double ringThickness = lagg.getEndcapLayers()->at(layer - 1)->maxRingThickness(); // all the ring volumes will have the same thickness (equal to the thickest ring in the disk)  
-        double diskThickness = lagg.getEndcapLayers()->at(layer - 1)->thickness();
-
-        std::ostringstream dname, pconverter;
-
-        double rtotal = 0.0, itotal = 0.0;
-        int count = 0;
-        dname << xml_disc << layer;
-
-        //shape.type = tp;
-        shape.rmin = 0.0;
-        shape.rmax = 0.0;
-        pos.trans.dz = 0.0;
-        iguard = oiter->end();
-
-        // endcap module caps loop
-        for (iiter = oiter->begin(); iiter != iguard; iiter++) {
-          int modRing = iiter->getModule().uniRef().ring;
-          // new ring
-          if (ridx.find(modRing) == ridx.end()) {
-
-            // This is the Barrel Case
-            ridx.insert(modRing);
-            std::ostringstream matname, rname, mname, specname;
+      double rmin = lagg.getEndcapLayers()->at(layer - 1)->minR();
+      double rmax = lagg.getEndcapLayers()->at(layer - 1)->maxR();
+      double zmax = lagg.getEndcapLayers()->at(layer - 1)->maxZ();
+      //zmax = zmax + v.max / 2.0; 
+      double zmin = lagg.getEndcapLayers()->at(layer - 1)->minZ();
+      //zmin = zmin - v.max / 2.0;
+      double ringThickness = lagg.getEndcapLayers()->at(layer - 1)->maxRingThickness(); // all the ring volumes will have the same thickness (equal to the thickest ring in the disk)  
+      double diskThickness = lagg.getEndcapLayers()->at(layer - 1)->thickness();
+
+      std::ostringstream dname, pconverter;
+
+      double rtotal = 0.0, itotal = 0.0;
+      int count = 0;
+      dname << xml_disc << layer;
+
+      //shape.type = tp;
+      shape.rmin = 0.0;
+      shape.rmax = 0.0;
+      pos.trans.dz = 0.0;
+      iguard = caps.end();
+
+      // endcap module caps loop
+      for (iiter = caps.begin(); iiter != iguard; iiter++) {
+        int modRing = iiter->getModule().moduleKey().ring();
+        // new ring
+        if (ridx.find(modRing) == ridx.end()) {
+
+          // This is the Barrel Case
+          ridx.insert(modRing);
+          std::ostringstream matname, rname, mname, specname;
 
 #ifndef __ADDVOLUMES__
-            // module composite material
-            matname << xml_base_actcomp << "D" << layer << "R" << modRing;
-            c.push_back(createComposite(matname.str(), compositeDensity(*iiter, true), *iiter, true));
+          // module composite material
+          matname << xml_base_actcomp << "D" << layer << "R" << modRing;
+          c.push_back(createComposite(matname.str(), compositeDensity(*iiter, true), *iiter, true));
 #endif
 
-            rname << xml_ring << modRing << dname.str();
-            mname << xml_endcap_module << modRing << dname.str();
+          rname << xml_ring << modRing << dname.str();
+          mname << xml_endcap_module << modRing << dname.str();
 
-            // collect ring info
-            RingInfo rinf;
-            rinf.name = rname.str();
-            rinf.childname = mname.str();
-            rinf.fw = (iiter->getModule().center().Z() < (zmin + zmax) / 2.0);
-            //rinf.modules = lagg.getEndcapLayers()->at(layer - 1)->rings().at(modRing-1).numModules();
-            //rinf.modules = lagg.getEndcapLayers()->at(layer - 1)->rings().at(modRing).numModules();
-            rinf.modules = lagg.getEndcapLayers()->at(layer - 1)->ringsMap().at(modRing)->numModules();
+          // collect ring info
+          RingInfo rinf;
+          rinf.name = rname.str();
+          rinf.childname = mname.str();
+          rinf.fw = (iiter->getModule().center().Z() < (zmin + zmax) / 2.0);
+          //rinf.modules = lagg.getEndcapLayers()->at(layer - 1)->rings().at(modRing-1).numModules();
+          //rinf.modules = lagg.getEndcapLayers()->at(layer - 1)->rings().at(modRing).numModules();
+          rinf.modules = lagg.getEndcapLayers()->at(layer - 1)->ringsMap().at(modRing)->numModules();
 
-            rinf.rin = iiter->getModule().minR();
-            rinf.rout = iiter->getModule().maxR();
-            rinf.rmid = iiter->getModule().center().Rho();
-            rinf.mthk = iiter->getModule().thickness();
-            rinf.phi = iiter->getModule().center().Phi();
-            rinfo.insert(std::pair<int, RingInfo>(modRing, rinf));
+          rinf.rin = iiter->getModule().minR();
+          rinf.rout = iiter->getModule().maxR();
+          rinf.rmid = iiter->getModule().center().Rho();
+          rinf.mthk = iiter->getModule().thickness();
+          rinf.phi = iiter->getModule().center().Phi();
+          rinfo.insert(std::pair<int, RingInfo>(modRing, rinf));
 
-            // module trapezoid
+          // module trapezoid
 
-            shape.type = iiter->getModule().shape() == RECTANGULAR ? bx : tp;
+          shape.type = iiter->getModule().shape() == RECTANGULAR ? bx : tp;
 
-            shape.name_tag = mname.str();
+          shape.name_tag = mname.str();
 #ifndef __ADDVOLUMES__
-            shape.dx = iiter->getModule().minWidth() / 2.0;
-            shape.dxx = iiter->getModule().maxWidth() / 2.0;
-            shape.dy = iiter->getModule().length() / 2.0;
-            shape.dyy = iiter->getModule().length() / 2.0;
+          shape.dx = iiter->getModule().minWidth() / 2.0;
+          shape.dxx = iiter->getModule().maxWidth() / 2.0;
+          shape.dy = iiter->getModule().length() / 2.0;
+          shape.dyy = iiter->getModule().length() / 2.0;
 #else       // Expand module size for hybrids
-            shape.dx = iiter->getModule().minWidth() / 2.0 + iiter->getModule().serviceHybridWidth();
-            shape.dxx = iiter->getModule().maxWidth() / 2.0 + iiter->getModule().serviceHybridWidth();
-            shape.dy = iiter->getModule().length() / 2.0 + iiter->getModule().frontEndHybridWidth();
-            shape.dyy = iiter->getModule().length() / 2.0 + iiter->getModule().frontEndHybridWidth();
+          shape.dx = iiter->getModule().minWidth() / 2.0 + iiter->getModule().serviceHybridWidth();
+          shape.dxx = iiter->getModule().maxWidth() / 2.0 + iiter->getModule().serviceHybridWidth();
+          shape.dy = iiter->getModule().length() / 2.0 + iiter->getModule().frontEndHybridWidth();
+          shape.dyy = iiter->getModule().length() / 2.0 + iiter->getModule().frontEndHybridWidth();
 #endif
-            //shape.dx = iiter->getModule().length() / 2.0;
-            //shape.dy = iiter->getModule().minWidth() / 2.0;
-            //shape.dyy = iiter->getModule().maxWidth() / 2.0;
-            shape.dz = iiter->getModule().thickness() / 2.0;
-            s.push_back(shape);
+          //shape.dx = iiter->getModule().length() / 2.0;
+          //shape.dy = iiter->getModule().minWidth() / 2.0;
+          //shape.dyy = iiter->getModule().maxWidth() / 2.0;
+          shape.dz = iiter->getModule().thickness() / 2.0;
+          s.push_back(shape);
 #ifdef __ADDVOLUMES__ 
-            // Get it back for sensors
-            shape.dx = iiter->getModule().minWidth() / 2.0;
-            shape.dxx = iiter->getModule().maxWidth() / 2.0;
-            shape.dy = iiter->getModule().length() / 2.0;
-            shape.dyy = iiter->getModule().length() / 2.0;
+          // Get it back for sensors
+          shape.dx = iiter->getModule().minWidth() / 2.0;
+          shape.dxx = iiter->getModule().maxWidth() / 2.0;
+          shape.dy = iiter->getModule().length() / 2.0;
+          shape.dyy = iiter->getModule().length() / 2.0;
 #endif
 
-            logic.name_tag = shape.name_tag;
-            logic.shape_tag = nspace + ":" + logic.name_tag;
+          logic.name_tag = shape.name_tag;
+          logic.shape_tag = nspace + ":" + logic.name_tag;
 #if 0
-            logic.material_tag = nspace + ":" + matname.str();
+          logic.material_tag = nspace + ":" + matname.str();
 #else
-            logic.material_tag = xml_material_air;
+          logic.material_tag = xml_material_air;
 #endif
-            l.push_back(logic);
+          l.push_back(logic);
 
 #ifdef __ADDVOLUMES__ 
-            std::string moduleName = shape.name_tag; // e.g. BModule1Layer1
-            HybridVolumes hvs(moduleName,*iiter);
-            hvs.buildVolumes();
+          std::string moduleName = shape.name_tag; // e.g. BModule1Layer1
+          HybridVolumes hvs(moduleName,*iiter);
+          hvs.buildVolumes();
 #endif
 
 
 
-            // wafer -- same x and y size of parent shape, but different thickness
-            string xml_base_inout = "";
-            if (iiter->getModule().numSensors() == 2) xml_base_inout = xml_base_inner;
+          // wafer -- same x and y size of parent shape, but different thickness
+          string xml_base_inout = "";
+          if (iiter->getModule().numSensors() == 2) xml_base_inout = xml_base_inner;
+
 
+          pos.parent_tag = logic.shape_tag;
 
-            pos.parent_tag = logic.shape_tag;
+          shape.name_tag = mname.str() + xml_base_inout+ xml_base_waf;
+          shape.dz = iiter->getModule().sensorThickness() / 2.0; // CUIDADO WAS calculateSensorThickness(*iiter, mt) / 2.0;
+          //if (iiter->getModule().numSensors() == 2) shape.dz = shape.dz / 2.0; // CUIDADO calcSensThick returned 2x what getSensThick returns, it means that now one-sided sensors are half as thick if not compensated for in the config files
+          s.push_back(shape);
+
+          logic.name_tag = shape.name_tag;
+          logic.shape_tag = nspace + ":" + logic.name_tag;
+          logic.material_tag = xml_material_air;
+          l.push_back(logic);
+
+          pos.child_tag = logic.shape_tag;
+
+          if (iiter->getModule().maxZ() > 0) pos.trans.dz = /*shape.dz*/ - iiter->getModule().dsDistance() / 2.0; // CUIDADO WAS getModule().moduleThickness()
+          else pos.trans.dz = iiter->getModule().dsDistance() / 2.0 /*- shape.dz*/; // DITTO HERE
+          p.push_back(pos);
+          if (iiter->getModule().numSensors() == 2) {
+
+            xml_base_inout = xml_base_outer;
+
+            //pos.parent_tag = logic.shape_tag;
 
             shape.name_tag = mname.str() + xml_base_inout+ xml_base_waf;
-            shape.dz = iiter->getModule().sensorThickness() / 2.0; // CUIDADO WAS calculateSensorThickness(*iiter, mt) / 2.0;
-            //if (iiter->getModule().numSensors() == 2) shape.dz = shape.dz / 2.0; // CUIDADO calcSensThick returned 2x what getSensThick returns, it means that now one-sided sensors are half as thick if not compensated for in the config files
             s.push_back(shape);
 
             logic.name_tag = shape.name_tag;
             logic.shape_tag = nspace + ":" + logic.name_tag;
-            logic.material_tag = xml_material_air;
             l.push_back(logic);
 
             pos.child_tag = logic.shape_tag;
 
-            if (iiter->getModule().maxZ() > 0) pos.trans.dz = /*shape.dz*/ - iiter->getModule().dsDistance() / 2.0; // CUIDADO WAS getModule().moduleThickness()
-            else pos.trans.dz = iiter->getModule().dsDistance() / 2.0 /*- shape.dz*/; // DITTO HERE
+            if (iiter->getModule().maxZ() > 0) pos.trans.dz = /*pos.trans.dz + 2 * shape.dz +*/  iiter->getModule().dsDistance() / 2.0; // CUIDADO removed pos.trans.dz + 2*shape.dz, added / 2.0
+            else pos.trans.dz = /* pos.trans.dz - 2 * shape.dz -*/ - iiter->getModule().dsDistance() / 2.0;
+            //pos.copy = 2;
+            if (iiter->getModule().stereoRotation() != 0) {
+              rot.name = type_stereo + xml_endcap_module + mname.str();
+              rot.thetax = 90.0;
+              rot.phix = iiter->getModule().stereoRotation() / M_PI * 180;
+              rot.thetay = 90.0;
+              rot.phiy = 90.0 + iiter->getModule().stereoRotation() / M_PI * 180;
+              r.push_back(rot);
+              pos.rotref = nspace + ":" + rot.name;
+            }
+
             p.push_back(pos);
-            if (iiter->getModule().numSensors() == 2) {
 
-              xml_base_inout = xml_base_outer;
+            // Now reset
+            pos.rotref.clear();
+            rot.name.clear();
+            rot.thetax = 0.0;
+            rot.phix = 0.0;
+            rot.thetay = 0.0;
+            rot.phiy = 0.0;
+            pos.copy = 1;
+          }
 
-              //pos.parent_tag = logic.shape_tag;
 
-              shape.name_tag = mname.str() + xml_base_inout+ xml_base_waf;
-              s.push_back(shape);
 
-              logic.name_tag = shape.name_tag;
-              logic.shape_tag = nspace + ":" + logic.name_tag;
-              l.push_back(logic);
+          // active surface
+          xml_base_inout = "";
+          if (iiter->getModule().numSensors() == 2) xml_base_inout = xml_base_inner;
 
-              pos.child_tag = logic.shape_tag;
+          //pos.parent_tag = logic.shape_tag;
+          pos.parent_tag = nspace + ":" + mname.str() + xml_base_inout + xml_base_waf;
 
-              if (iiter->getModule().maxZ() > 0) pos.trans.dz = /*pos.trans.dz + 2 * shape.dz +*/  iiter->getModule().dsDistance() / 2.0; // CUIDADO removed pos.trans.dz + 2*shape.dz, added / 2.0
-              else pos.trans.dz = /* pos.trans.dz - 2 * shape.dz -*/ - iiter->getModule().dsDistance() / 2.0;
-              //pos.copy = 2;
-              if (iiter->getModule().stereoRotation() != 0) {
-                rot.name = type_stereo + xml_endcap_module + mname.str();
-                rot.thetax = 90.0;
-                rot.phix = iiter->getModule().stereoRotation() / M_PI * 180;
-                rot.thetay = 90.0;
-                rot.phiy = 90.0 + iiter->getModule().stereoRotation() / M_PI * 180;
-                r.push_back(rot);
-                pos.rotref = nspace + ":" + rot.name;
-              }
+          shape.name_tag = mname.str() + xml_base_inout + xml_base_act;
+          s.push_back(shape);
 
-              p.push_back(pos);
+          logic.name_tag = shape.name_tag;
+          logic.shape_tag = nspace + ":" + logic.name_tag;
+          logic.material_tag = nspace + ":" + xml_sensor_silicon;
+          l.push_back(logic);
 
-              // Now reset
-              pos.rotref.clear();
-              rot.name.clear();
-              rot.thetax = 0.0;
-              rot.phix = 0.0;
-              rot.thetay = 0.0;
-              rot.phiy = 0.0;
-              pos.copy = 1;
-            }
+          pos.child_tag = logic.shape_tag;
+          pos.trans.dz = 0.0;
+#ifdef __FLIPSENSORS_IN__ // Flip INNER sensors
+          pos.rotref = nspace + ":" + rot_sensor_tag;
+#endif
+          p.push_back(pos);
+
+          // topology
+          mspec.partselectors.push_back(logic.name_tag);
+
+          minfo.name		= iiter->getModule().moduleType();
+          minfo.rocrows	= any2str<int>(iiter->getModule().innerSensor().numROCRows());
+          minfo.roccols	= any2str<int>(iiter->getModule().innerSensor().numROCCols());
+          minfo.rocx		= any2str<int>(iiter->getModule().innerSensor().numROCX());
+          minfo.rocy		= any2str<int>(iiter->getModule().innerSensor().numROCY());
 
+          mspec.moduletypes.push_back(minfo);
 
+          if (iiter->getModule().numSensors() == 2) {
 
             // active surface
-            xml_base_inout = "";
-            if (iiter->getModule().numSensors() == 2) xml_base_inout = xml_base_inner;
+            xml_base_inout = xml_base_outer;
 
             //pos.parent_tag = logic.shape_tag;
             pos.parent_tag = nspace + ":" + mname.str() + xml_base_inout + xml_base_waf;
@@ -1184,7 +1308,7 @@ namespace insur {
 
             pos.child_tag = logic.shape_tag;
             pos.trans.dz = 0.0;
-#ifdef __FLIPSENSORS_IN__ // Flip INNER sensors
+#ifdef __FLIPSENSORS_OUT__ // Flip OUTER sensors
             pos.rotref = nspace + ":" + rot_sensor_tag;
 #endif
             p.push_back(pos);
@@ -1192,177 +1316,138 @@ namespace insur {
             // topology
             mspec.partselectors.push_back(logic.name_tag);
 
-            minfo.name		= iiter->getModule().moduleType();
-            minfo.rocrows	= any2str<int>(iiter->getModule().innerSensor().numROCRows());
-            minfo.roccols	= any2str<int>(iiter->getModule().innerSensor().numROCCols());
-            minfo.rocx		= any2str<int>(iiter->getModule().innerSensor().numROCX());
-            minfo.rocy		= any2str<int>(iiter->getModule().innerSensor().numROCY());
+            minfo.rocrows	= any2str<int>(iiter->getModule().outerSensor().numROCRows());
+            minfo.roccols	= any2str<int>(iiter->getModule().outerSensor().numROCCols());
+            minfo.rocx		= any2str<int>(iiter->getModule().outerSensor().numROCX());
+            minfo.rocy		= any2str<int>(iiter->getModule().outerSensor().numROCY());
 
             mspec.moduletypes.push_back(minfo);
-
-            if (iiter->getModule().numSensors() == 2) {
-
-              // active surface
-              xml_base_inout = xml_base_outer;
-
-              //pos.parent_tag = logic.shape_tag;
-              pos.parent_tag = nspace + ":" + mname.str() + xml_base_inout + xml_base_waf;
-
-              shape.name_tag = mname.str() + xml_base_inout + xml_base_act;
-              s.push_back(shape);
-
-              logic.name_tag = shape.name_tag;
-              logic.shape_tag = nspace + ":" + logic.name_tag;
-              logic.material_tag = nspace + ":" + xml_sensor_silicon;
-              l.push_back(logic);
-
-              pos.child_tag = logic.shape_tag;
-              pos.trans.dz = 0.0;
-#ifdef __FLIPSENSORS_OUT__ // Flip OUTER sensors
-              pos.rotref = nspace + ":" + rot_sensor_tag;
-#endif
-              p.push_back(pos);
-
-              // topology
-              mspec.partselectors.push_back(logic.name_tag);
-
-              minfo.rocrows	= any2str<int>(iiter->getModule().outerSensor().numROCRows());
-              minfo.roccols	= any2str<int>(iiter->getModule().outerSensor().numROCCols());
-              minfo.rocx		= any2str<int>(iiter->getModule().outerSensor().numROCX());
-              minfo.rocy		= any2str<int>(iiter->getModule().outerSensor().numROCY());
-
-              mspec.moduletypes.push_back(minfo);
-              //mspec.moduletypes.push_back(iiter->getModule().getType());
+            //mspec.moduletypes.push_back(iiter->getModule().getType());
 
 #ifdef __ADDVOLUMES__ 
-              hvs.addMaterialInfo(c);
-              hvs.addShapeInfo(s);
-              hvs.addLogicInfo(l);
-              hvs.addPositionInfo(p);
+            hvs.addMaterialInfo(c);
+            hvs.addShapeInfo(s);
+            hvs.addLogicInfo(l);
+            hvs.addPositionInfo(p);
 #ifdef __DEBUGPRINT__
-              hvs.print();
+            hvs.print();
 #endif
 #endif
-            }
-
-            // material properties
-            rtotal = rtotal + iiter->getRadiationLength();
-            itotal = itotal + iiter->getInteractionLength();
-            count++;
           }
-        }
 
-        if (count > 0) {
-          ril.rlength = rtotal / (double)count;
-          ril.ilength = itotal / (double)count;
-          ri.push_back(ril);
+          // material properties
+          rtotal = rtotal + iiter->getRadiationLength();
+          itotal = itotal + iiter->getInteractionLength();
+          count++;
         }
+      }
 
-        // rings
-        shape.type = tb;
-        shape.dx = 0.0;
-        shape.dy = 0.0;
-        shape.dyy = 0.0;
-        shape.dz = ringThickness / 2.0; //findDeltaZ(lagg.getEndcapLayers()->at(layer - 1)->getModuleVector()->begin(), // CUIDADO what the hell is this??
-        //lagg.getEndcapLayers()->at(layer - 1)->getModuleVector()->end(), (zmin + zmax) / 2.0) / 2.0;
+      if (count > 0) {
+        ril.rlength = rtotal / (double)count;
+        ril.ilength = itotal / (double)count;
+        ri.push_back(ril);
+      }
+
+      // rings
+      shape.type = tb;
+      shape.dx = 0.0;
+      shape.dy = 0.0;
+      shape.dyy = 0.0;
+      shape.dz = ringThickness / 2.0; //findDeltaZ(lagg.getEndcapLayers()->at(layer - 1)->getModuleVector()->begin(), // CUIDADO what the hell is this??
+      //lagg.getEndcapLayers()->at(layer - 1)->getModuleVector()->end(), (zmin + zmax) / 2.0) / 2.0;
+
+      std::set<int>::const_iterator siter, sguard = ridx.end();
+      for (siter = ridx.begin(); siter != sguard; siter++) {
+        if (rinfo[*siter].modules > 0) {
+
+          shape.name_tag = rinfo[*siter].name;
+          shape.rmin = rinfo[*siter].rin;
+          shape.rmax = rinfo[*siter].rout;
+          s.push_back(shape);
 
-        std::set<int>::const_iterator siter, sguard = ridx.end();
-        for (siter = ridx.begin(); siter != sguard; siter++) {
-          if (rinfo[*siter].modules > 0) {
+          logic.name_tag = shape.name_tag;
+          logic.shape_tag = nspace + ":" + logic.name_tag;
+          logic.material_tag = xml_material_air;
+          l.push_back(logic);
 
-            shape.name_tag = rinfo[*siter].name;
-            shape.rmin = rinfo[*siter].rin;
-            shape.rmax = rinfo[*siter].rout;
-            s.push_back(shape);
+          pos.parent_tag = nspace + ":" + dname.str(); // CUIDADO ended with: + xml_plus;
+          pos.child_tag = logic.shape_tag;
 
-            logic.name_tag = shape.name_tag;
-            logic.shape_tag = nspace + ":" + logic.name_tag;
-            logic.material_tag = xml_material_air;
-            l.push_back(logic);
+          if (rinfo[*siter].fw) pos.trans.dz = (zmin - zmax) / 2.0 + shape.dz;
+          else pos.trans.dz = (zmax - zmin) / 2.0 - shape.dz;
+          p.push_back(pos);
+          //pos.parent_tag = nspace + ":" + dname.str(); // CUIDADO ended with: + xml_minus;
+          //p.push_back(pos);
 
-            pos.parent_tag = nspace + ":" + dname.str(); // CUIDADO ended with: + xml_plus;
-            pos.child_tag = logic.shape_tag;
+          rspec.partselectors.push_back(logic.name_tag);
+          rspec.moduletypes.push_back(minfo_zero);
 
-            if (rinfo[*siter].fw) pos.trans.dz = (zmin - zmax) / 2.0 + shape.dz;
-            else pos.trans.dz = (zmax - zmin) / 2.0 - shape.dz;
-            p.push_back(pos);
-            //pos.parent_tag = nspace + ":" + dname.str(); // CUIDADO ended with: + xml_minus;
-            //p.push_back(pos);
-
-            rspec.partselectors.push_back(logic.name_tag);
-            rspec.moduletypes.push_back(minfo_zero);
-
-            alg.parent = logic.shape_tag;
-            alg.parameters.push_back(stringParam(xml_childparam, nspace + ":" + rinfo[*siter].childname));
-            pconverter << (rinfo[*siter].modules / 2);
-            alg.parameters.push_back(numericParam(xml_nmods, pconverter.str()));
-            pconverter.str("");
-            alg.parameters.push_back(numericParam(xml_startcopyno, "1"));
-            alg.parameters.push_back(numericParam(xml_incrcopyno, "2"));
-            alg.parameters.push_back(numericParam(xml_rangeangle, "360*deg"));
-            pconverter << rinfo[*siter].phi;
-            alg.parameters.push_back(numericParam(xml_startangle, pconverter.str()));
-            pconverter.str("");
-            pconverter << rinfo[*siter].rmid;
-            alg.parameters.push_back(numericParam(xml_radius, pconverter.str()));
-            pconverter.str("");
-            alg.parameters.push_back(vectorParam(0, 0, shape.dz - rinfo[*siter].mthk / 2.0));
-            a.push_back(alg);
-            alg.parameters.clear();
-            alg.parameters.push_back(stringParam(xml_childparam, nspace + ":" + rinfo[*siter].childname));
-            pconverter << (rinfo[*siter].modules / 2);
-            alg.parameters.push_back(numericParam(xml_nmods, pconverter.str()));
-            pconverter.str("");
-            alg.parameters.push_back(numericParam(xml_startcopyno, "2"));
-            alg.parameters.push_back(numericParam(xml_incrcopyno, "2"));
-            alg.parameters.push_back(numericParam(xml_rangeangle, "360*deg"));
-            pconverter << (rinfo[*siter].phi + 2 * PI / (double)(rinfo[*siter].modules));
-            alg.parameters.push_back(numericParam(xml_startangle, pconverter.str()));
-            pconverter.str("");
-            pconverter << rinfo[*siter].rmid;
-            alg.parameters.push_back(numericParam(xml_radius, pconverter.str()));
-            pconverter.str("");
-            alg.parameters.push_back(vectorParam(0, 0, rinfo[*siter].mthk / 2.0 - shape.dz));
-            a.push_back(alg);
-            alg.parameters.clear();
-          }
+          alg.parent = logic.shape_tag;
+          alg.parameters.push_back(stringParam(xml_childparam, nspace + ":" + rinfo[*siter].childname));
+          pconverter << (rinfo[*siter].modules / 2);
+          alg.parameters.push_back(numericParam(xml_nmods, pconverter.str()));
+          pconverter.str("");
+          alg.parameters.push_back(numericParam(xml_startcopyno, "1"));
+          alg.parameters.push_back(numericParam(xml_incrcopyno, "2"));
+          alg.parameters.push_back(numericParam(xml_rangeangle, "360*deg"));
+          pconverter << rinfo[*siter].phi;
+          alg.parameters.push_back(numericParam(xml_startangle, pconverter.str()));
+          pconverter.str("");
+          pconverter << rinfo[*siter].rmid;
+          alg.parameters.push_back(numericParam(xml_radius, pconverter.str()));
+          pconverter.str("");
+          alg.parameters.push_back(vectorParam(0, 0, shape.dz - rinfo[*siter].mthk / 2.0));
+          a.push_back(alg);
+          alg.parameters.clear();
+          alg.parameters.push_back(stringParam(xml_childparam, nspace + ":" + rinfo[*siter].childname));
+          pconverter << (rinfo[*siter].modules / 2);
+          alg.parameters.push_back(numericParam(xml_nmods, pconverter.str()));
+          pconverter.str("");
+          alg.parameters.push_back(numericParam(xml_startcopyno, "2"));
+          alg.parameters.push_back(numericParam(xml_incrcopyno, "2"));
+          alg.parameters.push_back(numericParam(xml_rangeangle, "360*deg"));
+          pconverter << (rinfo[*siter].phi + 2 * PI / (double)(rinfo[*siter].modules));
+          alg.parameters.push_back(numericParam(xml_startangle, pconverter.str()));
+          pconverter.str("");
+          pconverter << rinfo[*siter].rmid;
+          alg.parameters.push_back(numericParam(xml_radius, pconverter.str()));
+          pconverter.str("");
+          alg.parameters.push_back(vectorParam(0, 0, rinfo[*siter].mthk / 2.0 - shape.dz));
+          a.push_back(alg);
+          alg.parameters.clear();
         }
+      }
 
-        //disc
-        shape.name_tag = dname.str();
-        shape.rmin = rmin;
-        shape.rmax = rmax;
-        shape.dz = diskThickness/2.0; //(zmax - zmin) / 2.0;
-        s.push_back(shape);
+      //disc
+      shape.name_tag = dname.str();
+      shape.rmin = rmin;
+      shape.rmax = rmax;
+      shape.dz = diskThickness/2.0; //(zmax - zmin) / 2.0;
+      s.push_back(shape);
 
-        logic.name_tag = shape.name_tag; // CUIDADO ended with + xml_plus;
-        //logic.extra = xml_plus;
-        logic.shape_tag = nspace + ":" + shape.name_tag;
-        logic.material_tag = xml_material_air;
-        l.push_back(logic);
+      logic.name_tag = shape.name_tag; // CUIDADO ended with + xml_plus;
+      //logic.extra = xml_plus;
+      logic.shape_tag = nspace + ":" + shape.name_tag;
+      logic.material_tag = xml_material_air;
+      l.push_back(logic);
 
-        pos.parent_tag = xml_pixfwdident + ":" + xml_pixfwd;
-        pos.child_tag = nspace + ":" + logic.name_tag;
-        pos.trans.dz = (zmax + zmin) / 2.0 - xml_z_pixfwd;
-        p.push_back(pos);
+      pos.parent_tag = xml_pixfwdident + ":" + xml_pixfwd;
+      pos.child_tag = nspace + ":" + logic.name_tag;
+      pos.trans.dz = (zmax + zmin) / 2.0 - xml_z_pixfwd;
+      p.push_back(pos);
 
-        dspec.partselectors.push_back(logic.name_tag);
-        dspec.moduletypes.push_back(minfo_zero);
-        dspec.partextras.push_back(logic.extra);
-        //   logic.name_tag = shape.name_tag; // CUIDADO ended with + xml_minus;
-        //   logic.extra = xml_minus;
-        //   l.push_back(logic);
-        //   pos.parent_tag = xml_pixfwdident + ":" + xml_pixfwd;
-        //   pos.child_tag = nspace + ":" + logic.name_tag;
-        //   p.push_back(pos);
-        //dspec.partselectors.push_back(logic.name_tag); // CUIDADO dspec still needs to be duplicated for minus discs (I think)
-        //dspec.partextras.push_back(logic.extra);
-      }
-      layer++;
+      dspec.partselectors.push_back(logic.name_tag);
+      dspec.moduletypes.push_back(minfo_zero);
+      dspec.partextras.push_back(logic.extra);
+      //   logic.name_tag = shape.name_tag; // CUIDADO ended with + xml_minus;
+      //   logic.extra = xml_minus;
+      //   l.push_back(logic);
+      //   pos.parent_tag = xml_pixfwdident + ":" + xml_pixfwd;
+      //   pos.child_tag = nspace + ":" + logic.name_tag;
+      //   p.push_back(pos);
+      //dspec.partselectors.push_back(logic.name_tag); // CUIDADO dspec still needs to be duplicated for minus discs (I think)
+      //dspec.partextras.push_back(logic.extra);
     }
-    if (!dspec.partselectors.empty()) t.push_back(dspec);
-    if (!rspec.partselectors.empty()) t.push_back(rspec);
-    if (!mspec.partselectors.empty()) t.push_back(mspec);
   }
 
   /**
@@ -1629,32 +1714,50 @@ namespace insur {
     return comp;
   }
 
+  /**
+   * Index the modules of a layer by side of z=0 and position along the rod, for their partners to be found without scanning the layer.
+   * @param caps The module caps of the layer
+   * @return The positions of the module caps in the layer, in ascending order, by side of z=0 and position along the rod
+   */
+  Extractor::PartnerIndex Extractor::indexPartnerModules(ModuleCaps& caps) {
+    PartnerIndex index;
+    for (int pos = 0; pos < (int)caps.size(); pos++) {
+      ModuleKey key = caps[pos].getModule().moduleKey();
+      index[std::make_pair((key.side() > 0) - (key.side() < 0), key.ring())].push_back(pos);
+    }
+    return index;
+  }
+
   /**
    * Find the partner module of a given one in a layer, i.e. a module that is on the same rod but on the opposite side of z=0.
+   * @param caps The module caps of the layer
+   * @param index The index of the module caps of the layer, as built by <i>indexPartnerModules()</i>
    * @param i An iterator pointing to the start of the search range
    * @param g An iterator pointing to one past the end of the search range
    * @param ponrod The position along the rod of the original module
    * @param find_first A flag indicating whether to stop the search at the first module with the desired position, regardless of which side of z=0 it is on; default is false
    * @return An iterator pointing to the partner module, or to one past the end of the range if no partner is found
    */
-  std::vector<ModuleCap>::iterator Extractor::findPartnerModule(std::vector<ModuleCap>::iterator i,
-                                                                std::vector<ModuleCap>::iterator g, int ponrod, bool find_first) {
-    std::vector<ModuleCap>::iterator res = i;
-    if (i != g) {
-      bool plus = false;
-      if (!find_first) plus = i->getModule().uniRef().side > 0; //i->getModule().center().Z() > 0;
-      while (res != g) {
-        if (res->getModule().uniRef().ring == ponrod) {
-          if (find_first) break;
-          else {
-            if((plus && res->getModule().uniRef().side < 0 /*(res->getModule().center().Z() < 0)*/)
-               || (!plus && res->getModule().uniRef().side > 0 /*(res->getModule().center().Z() > 0)*/)) break;
-          }
-        }
-        res++;
-      }
+  ModuleCaps::iterator Extractor::findPartnerModule(ModuleCaps& caps, const PartnerIndex& index, ModuleCaps::iterator i,
+                                                                ModuleCaps::iterator g, int ponrod, bool find_first) {
+    if (i == g) return i;
+    int start = i - caps.begin(), end = g - caps.begin();
+    int found = end;
+    // the first module at the desired position within the range, on any of the sides a partner may be on
+    auto firstOnSide = [&](int side) {
+      PartnerIndex::const_iterator positions = index.find(std::make_pair(side, ponrod));
+      if (positions == index.end()) return;
+      std::vector<int>::const_iterator first = std::lower_bound(positions->second.begin(), positions->second.end(), start);
+      if (first != positions->second.end() && *first < found) found = *first;
+    };
+    if (find_first) {
+      firstOnSide(-1);
+      firstOnSide(0);
+      firstOnSide(1);
+    } else {
+      firstOnSide(i->getModule().moduleKey().side() > 0 ? -1 : 1);
     }
-    return res;
+    return caps.begin() + found;
   }
 
   /**
@@ -0,0 +1,204 @@
+/**
+ * @file FastResolution.cpp
+ * @brief This is the implementation of the analytic estimate of the track parameter resolutions
+ */
+
+#include <FastResolution.h>
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <global_constants.h>
+
+namespace insur {
+
+  namespace {
+    // a measurement or a scatterer along a track, in the order of their radii
+    struct Crossing {
+      double rho, x; // the radius of the crossing and the radiation length crossed, along the track
+      const DetectorModule::ResolutionFactors* resolution; // NULL if it does not measure the track
+    };
+
+    // the highland width of the scattering angle, in space, of a relativistic particle of momentum p [GeV/c]
+    double scatteringAngle(double p, double x) {
+      return x > 0 ? 0.0136 / p * sqrt(x) * (1 + 0.038 * log(x)) : 0.;
+    }
+
+    /**
+     * The covariance of the parameters of the weighted least squares fit of the points (r, y) by a polynomial in r
+     * @param n The number of parameters, 2 (a line) or 3 (a parabola of term r^2/2)
+     * @param diagonal Set to the variances of the parameters, by increasing power of r
+     * @return False if the fit is underconstrained
+     */
+    bool fitVariances(int n, const std::vector<double>& r, const std::vector<double>& sigma, double diagonal[3]) {
+      double a[3][3] = { { 0 } };
+      for (size_t i = 0; i < r.size(); i++) {
+        double f[3] = { 1., r[i], r[i] * r[i] / 2 };
+        double w = 1. / (sigma[i] * sigma[i]);
+        for (int j = 0; j < n; j++) {
+          for (int k = 0; k < n; k++) a[j][k] += w * f[j] * f[k];
+        }
+      }
+      if (n == 2) {
+        double det = a[0][0] * a[1][1] - a[0][1] * a[1][0];
+        if (!(det > 0)) return false;
+        diagonal[0] = a[1][1] / det;
+        diagonal[1] = a[0][0] / det;
+        return true;
+      }
+      double c00 = a[1][1] * a[2][2] - a[1][2] * a[2][1];
+      double c11 = a[0][0] * a[2][2] - a[0][2] * a[2][0];
+      double c22 = a[0][0] * a[1][1] - a[0][1] * a[1][0];
+      double det = a[0][0] * c00 - a[0][1] * (a[1][0] * a[2][2] - a[1][2] * a[2][0]) + a[0][2] * (a[1][0] * a[2][1] - a[1][1] * a[2][0]);
+      if (!(det > 0)) return false;
+      diagonal[0] = c00 / det;
+      diagonal[1] = c11 / det;
+      diagonal[2] = c22 / det;
+      return true;
+    }
+  }
+
+  /**
+   * Sum the modules of some layers or disks up in surfaces, one per ring on the positive z side
+   * @param layers The module caps of the layers or of the disks
+   */
+  void FastResolution::addLayers(std::vector<ModuleCaps>& layers) {
+    for (ModuleCaps& layer : layers) {
+      struct Sum { Surface surface; double position; int n; };
+      std::map<ModuleKey, Sum> rings;
+      for (ModuleCap& cap : layer) {
+        const DetectorModule& m = cap.getModule();
+        if (m.side() < 0) continue;
+        ModuleKey ring(m.moduleKey().value & ~uint64_t(0xFFFF)); // the phi position left out
+        bool barrel = m.subdet() == BARREL;
+        auto found = rings.find(ring);
+        if (found == rings.end()) {
+          Surface surface;
+          surface.barrel = barrel;
+          surface.low = barrel ? m.minZ() : m.minR();
+          surface.high = barrel ? m.maxZ() : m.maxR();
+          surface.radiation = surface.tilt = 0;
+          surface.resolution = m.resolutionFactors();
+          surface.tags.insert(m.trackingTags.begin(), m.trackingTags.end());
+          found = rings.insert(std::make_pair(ring, Sum{ surface, 0., 0 })).first;
+        }
+        Sum& sum = found->second;
+        sum.surface.low = MIN(sum.surface.low, barrel ? m.minZ() : m.minR());
+        sum.surface.high = MAX(sum.surface.high, barrel ? m.maxZ() : m.maxR());
+        sum.surface.radiation += cap.getRadiationLength();
+        sum.surface.tilt += m.tiltAngle();
+        sum.position += barrel ? m.center().Rho() : m.center().Z();
+        sum.n++;
+      }
+      for (auto& ring : rings) {
+        Sum& sum = ring.second;
+        sum.surface.position = sum.position / sum.n;
+        sum.surface.radiation /= sum.n;
+        sum.surface.tilt /= sum.n;
+        surfaces_.push_back(sum.surface);
+      }
+    }
+  }
+
+  /**
+   * The tags of the modules, which the errors are estimated for
+   */
+  std::set<std::string> FastResolution::tags() const {
+    std::set<std::string> result;
+    for (const Surface& surface : surfaces_) result.insert(surface.tags.begin(), surface.tags.end());
+    return result;
+  }
+
+  /**
+   * Estimate the errors of the parameters of a track from the origin, measured by the modules of a tag
+   * @param theta The polar angle of the track
+   * @param tag The tag of the modules measuring the track
+   * @param momenta The transverse momenta [GeV/c]
+   * @param material False for the errors without multiple scattering
+   * @param ipConstraint True to add the interaction point as a measurement, of the errors below [mm]
+   * @param errors Set to the errors of the track at each of the momenta, as <i>Track::computeErrors()</i> gives them
+   * @return False if the track crosses less than 3 surfaces of the tag
+   */
+  bool FastResolution::errors(double theta, const std::string& tag, const std::vector<double>& momenta, bool material,
+                              bool ipConstraint, double ipRError, double ipZError, std::vector<Track::Errors>& errors) const {
+    errors.clear();
+    double sinTheta = sin(theta), cosTheta = cos(theta), ctgTheta = cosTheta / sinTheta;
+    std::vector<Crossing> crossings;
+    crossings.push_back(Crossing{ beamPipeRadius, beamPipeRadiation / sinTheta, NULL });
+    int measurements = 0;
+    for (const Surface& surface : surfaces_) {
+      if (!surface.barrel && cosTheta <= 0) continue;
+      double rho = surface.barrel ? surface.position : surface.position * sinTheta / cosTheta;
+      double along = surface.barrel ? surface.position * ctgTheta : rho;
+      if (along < surface.low || along > surface.high) continue;
+      bool measures = surface.tags.count(tag) > 0;
+      crossings.push_back(Crossing{ rho, surface.radiation / fabs(sin(theta + surface.tilt)), measures ? &surface.resolution : NULL });
+      measurements += measures;
+    }
+    if (measurements < 3) return false;
+    std::sort(crossings.begin(), crossings.end(), [](const Crossing& a, const Crossing& b) { return a.rho < b.rho; });
+
+    errors.reserve(momenta.size());
+    std::vector<double> r, sigmaRPhi, sigmaZ;
+    for (double pt : momenta) {
+      double trackR = pt / insur::magnetic_field / 0.3 * 1E3; // curvature radius in mm
+      double p = pt / sinTheta;
+      r.clear();
+      sigmaRPhi.clear();
+      sigmaZ.clear();
+      if (ipConstraint) {
+        r.push_back(0.);
+        sigmaRPhi.push_back(ipRError);
+        sigmaZ.push_back(ipZError);
+      }
+      double firstRho = -1, lastRho = -1;
+      for (const Crossing& crossing : crossings) {
+        if (crossing.resolution && crossing.rho < 2 * trackR) { // the track curls back before the others
+          r.push_back(crossing.rho);
+          sigmaRPhi.push_back(crossing.resolution->equivalentRPhi(crossing.rho, trackR));
+          sigmaZ.push_back(crossing.resolution->equivalentZ(crossing.rho, trackR, ctgTheta));
+          if (firstRho < 0) firstRho = crossing.rho;
+          lastRho = crossing.rho;
+        }
+      }
+      // the scattering up to the first measurement moves the track as seen from the interaction point, the one between
+      // the first and the last measurement bends it
+      double innerD0 = 0, innerPhi = 0, innerZ0 = 0, innerCtg = 0, xBetween = 0;
+      for (const Crossing& crossing : crossings) {
+        if (crossing.rho <= firstRho) {
+          double angle = scatteringAngle(p, crossing.x);
+          innerD0 += pow(crossing.rho * angle / sinTheta, 2);
+          innerPhi += pow(angle / sinTheta, 2);
+          innerZ0 += pow(crossing.rho * angle / (sinTheta * sinTheta), 2);
+          innerCtg += pow(angle / (sinTheta * sinTheta), 2);
+        }
+        if (crossing.rho >= firstRho && crossing.rho < lastRho) xBetween += crossing.x;
+      }
+      double rPhi[3], rz[3];
+      if (r.size() - ipConstraint < 3 || !fitVariances(3, r, sigmaRPhi, rPhi) || !fitVariances(2, r, sigmaZ, rz)) {
+        errors.clear();
+        return false;
+      }
+      if (material) {
+        // the curvature from the scattering along the lever arm of the measurements [1/m], as 0.016 GeV/c sqrt(x) / (L pT)
+        double lever = (lastRho - firstRho) / 1000.;
+        double curvature = lever > 0 ? 0.016 * sqrt(xBetween) / (lever * pt) / 1000. : 0.;
+        rPhi[0] += innerD0;
+        rPhi[1] += innerPhi;
+        rPhi[2] += curvature * curvature;
+        rz[0] += innerZ0;
+        rz[1] += innerCtg;
+      }
+
+      Track::Errors e;
+      e.transverseMomentum = pt;
+      e.deltaD = sqrt(rPhi[0]);
+      e.deltaPhi = sqrt(rPhi[1]);
+      e.deltaRho = sqrt(rPhi[2]);
+      e.deltaZ0 = sqrt(rz[0]);
+      e.deltaCtgTheta = sqrt(rz[1]);
+      e.deltaP = e.deltaRho * trackR + sinTheta * cosTheta * e.deltaCtgTheta; // as Track::computeErrors() combines them
+      errors.push_back(e);
+    }
+    return true;
+  }
+}
@@ -26,7 +26,6 @@ double GeometricModule::trackCross(const XYZVector& PL, // Base line point
   }
 
   if (distance>=0) {
-    numHits_++;
     distance /= PU.r();
   } else {
     return -1;
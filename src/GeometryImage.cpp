@@ -0,0 +1,185 @@
+/**
+ * @file GeometryImage.cpp
+ * @brief This is the implementation of the frozen module table shared by the track simulation and the Hough jobs
+ */
+
+#include <GeometryImage.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+const char GeometryImage::magic[8] = { 't', 'k', 'g', 'e', 'o', 'm', '0', '1' };
+
+namespace {
+  void hashBytes(uint64_t& hash, const void* data, size_t size) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; i++) {
+      hash ^= bytes[i];
+      hash *= 1099511628211ULL;
+    }
+  }
+}
+
+/**
+ * Sorts a module table by the keys of the positional references of the modules. Of several modules with the same
+ * reference, the last one is kept, as a map filled in table order would.
+ * @param modules The module table
+ * @param keys Set to the keys, in increasing order
+ * @param sorted Set to the modules, in the order of their keys, with their padding bytes set to zero
+ */
+void GeometryImage::sortByKey(const std::vector<ModuleData>& modules, std::vector<uint32_t>& keys, std::vector<ModuleData>& sorted) {
+  std::vector<std::pair<uint32_t, size_t> > order;
+  order.reserve(modules.size());
+  for (size_t i = 0; i < modules.size(); i++) {
+    const ModuleData& m = modules[i];
+    order.push_back(std::make_pair(key(m.refcnt, m.refz, m.refrho, m.refphi), i));
+  }
+  std::stable_sort(order.begin(), order.end(), [](const std::pair<uint32_t, size_t>& a, const std::pair<uint32_t, size_t>& b) { return a.first < b.first; });
+  keys.clear();
+  sorted.clear();
+  for (size_t i = 0; i < order.size(); i++) {
+    if (i + 1 < order.size() && order[i + 1].first == order[i].first) continue;
+    keys.push_back(order[i].first);
+    sorted.push_back(ModuleData());
+    memset(&sorted.back(), 0, sizeof(ModuleData));
+    memcpy(&sorted.back(), &modules[order[i].second], sizeof(ModuleData));
+  }
+}
+
+/**
+ * The hash of a module table, made of the values of the fields of its records, whatever their padding
+ */
+uint64_t GeometryImage::hashRecords(const ModuleData* modules, size_t numModules) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < numModules; i++) {
+    const ModuleData& m = modules[i];
+    const double values[] = { m.x, m.y, m.z, m.rho, m.phi, m.widthlo, m.widthhi, m.height, m.stereo, m.pitchlo, m.pitchhi, m.striplen, m.yres };
+    const char codes[] = { m.inefftype, m.refcnt, m.refz, m.refrho, m.refphi, m.type };
+    hashBytes(hash, values, sizeof(values));
+    hashBytes(hash, codes, sizeof(codes));
+  }
+  return hash;
+}
+
+/**
+ * Writes a module table as an image, unless the file already holds the image of the same table. The file is replaced
+ * at once, so that a job mapping it never sees it half written.
+ * @param fileName The image file
+ * @param modules The module table, in any order
+ * @param hash Set to the hash of the image, which the jobs check it by
+ * @return True if the file holds the image of the table
+ */
+bool GeometryImage::write(const std::string& fileName, const std::vector<ModuleData>& modules, uint64_t& hash) {
+  std::vector<uint32_t> keys;
+  std::vector<ModuleData> sorted;
+  sortByKey(modules, keys, sorted);
+  hash = hashRecords(sorted.data(), sorted.size());
+
+  GeometryImage existing;
+  if (existing.open(fileName) && existing.size() == sorted.size() && existing.hash() == hash) return true;
+  existing.close();
+
+  Header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, magic, sizeof(magic));
+  header.recordSize = sizeof(ModuleData);
+  header.numModules = sorted.size();
+  header.hash = hash;
+  std::vector<char> paddedKeys(keySpace(keys.size()), 0);
+  if (!keys.empty()) memcpy(paddedKeys.data(), keys.data(), keys.size() * sizeof(uint32_t));
+
+  // the part file is the writer's own, for several simulation jobs to be able to write the same image at once
+  std::string partFileName = fileName + "." + std::to_string(getpid()) + ".part";
+  std::ofstream out(partFileName.c_str(), std::ios::binary | std::ios::trunc);
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  out.write(paddedKeys.data(), paddedKeys.size());
+  out.write(reinterpret_cast<const char*>(sorted.data()), sorted.size() * sizeof(ModuleData));
+  out.close();
+  bool written = out && std::rename(partFileName.c_str(), fileName.c_str()) == 0;
+  if (!written) {
+    std::remove(partFileName.c_str());
+    std::cerr << "Failed writing the geometry image \"" << fileName << "\"." << std::endl;
+  }
+  return written;
+}
+
+/**
+ * Maps an image file into memory, checking its format
+ * @param fileName The image file
+ * @return True if the image can be looked up
+ */
+bool GeometryImage::open(const std::string& fileName) {
+  close();
+  int fd = ::open(fileName.c_str(), O_RDONLY);
+  if (fd < 0) return false;
+  struct stat fileStat;
+  if (fstat(fd, &fileStat) == 0 && fileStat.st_size >= (off_t)sizeof(Header)) {
+    mappedSize_ = fileStat.st_size;
+    mapped_ = mmap(NULL, mappedSize_, PROT_READ, MAP_SHARED, fd, 0);
+    if (mapped_ == MAP_FAILED) mapped_ = NULL;
+  }
+  ::close(fd); // the mapping stays valid
+
+  if (!mapped_) return false;
+  const Header& header = *static_cast<const Header*>(mapped_);
+  size_t maxModules = (mappedSize_ - sizeof(Header)) / (sizeof(uint32_t) + sizeof(ModuleData));
+  if (memcmp(header.magic, magic, sizeof(magic)) || header.recordSize != sizeof(ModuleData) || header.numModules > maxModules ||
+      mappedSize_ != sizeof(Header) + keySpace(header.numModules) + header.numModules * sizeof(ModuleData)) {
+    close();
+    return false;
+  }
+  numModules_ = header.numModules;
+  hash_ = header.hash;
+  keys_ = reinterpret_cast<const uint32_t*>(static_cast<const char*>(mapped_) + sizeof(Header));
+  modules_ = reinterpret_cast<const ModuleData*>(static_cast<const char*>(mapped_) + sizeof(Header) + keySpace(numModules_));
+  if (!std::is_sorted(keys_, keys_ + numModules_)) {
+    close();
+    return false;
+  }
+  return true;
+}
+
+/**
+ * Looks a module table up the way an image would be, from a copy of the table (such as one read from the geometry
+ * tree of a tracks file)
+ * @param modules The module table, in any order
+ */
+void GeometryImage::adopt(const std::vector<ModuleData>& modules) {
+  close();
+  sortByKey(modules, ownKeys_, ownModules_);
+  keys_ = ownKeys_.data();
+  modules_ = ownModules_.data();
+  numModules_ = ownModules_.size();
+  hash_ = hashRecords(modules_, numModules_);
+}
+
+/**
+ * Unmaps the image file, or drops the adopted table
+ */
+void GeometryImage::close() {
+  if (mapped_) munmap(mapped_, mappedSize_);
+  mapped_ = NULL;
+  mappedSize_ = 0;
+  ownKeys_.clear();
+  ownModules_.clear();
+  keys_ = NULL;
+  modules_ = NULL;
+  numModules_ = 0;
+  hash_ = 0;
+}
+
+/**
+ * The module of a positional reference
+ * @return The data of the module, NULL if there is no such module
+ */
+const ModuleData* GeometryImage::find(char cnt, char z, char rho, char phi) const {
+  uint32_t wanted = key(cnt, z, rho, phi);
+  const uint32_t* found = std::lower_bound(keys_, keys_ + numModules_, wanted);
+  return found != keys_ + numModules_ && *found == wanted ? modules_ + (found - keys_) : NULL;
+}
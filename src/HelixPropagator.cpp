@@ -0,0 +1,78 @@
+/**
+ * @file HelixPropagator.cpp
+ * @brief This is the implementation of the closed-form propagation of a charged track along its helix
+ */
+
+#include <HelixPropagator.h>
+
+#include <algorithm>
+
+namespace insur {
+
+  /**
+   * The point of the helix at the transverse path length s
+   */
+  XYZVector HelixPropagator::position(double s) const {
+    double phi = phi0_ - charge_*s/radius_;
+    return XYZVector(charge_*radius_*(sin(phi0_) - sin(phi)), charge_*radius_*(cos(phi) - cos(phi0_)), z0_ + s*cotTheta_);
+  }
+
+  /**
+   * The unit tangent to the helix at the transverse path length s
+   */
+  XYZVector HelixPropagator::direction(double s) const {
+    double phi = phi0_ - charge_*s/radius_;
+    return XYZVector(cos(phi), sin(phi), cotTheta_) / sqrt(1 + cotTheta_*cotTheta_);
+  }
+
+  /**
+   * The eta of the point of the helix at the transverse path length s, as seen from the origin of the track: it grows
+   * from the eta of the track as the helix bends, since the path to a radius is longer than the radius
+   */
+  double HelixPropagator::positionEta(double s) const {
+    double rho = 2*radius_*sin(s/(2*radius_));
+    return rho > 0 ? asinh(s*cotTheta_/rho) : asinh(cotTheta_);
+  }
+
+  double HelixPropagator::arcToRho(double rho) const {
+    return rho <= 2*radius_ ? 2*radius_*asin(rho/(2*radius_)) : -1;
+  }
+
+  double HelixPropagator::arcToZ(double z) const {
+    double s = (z - z0_)/cotTheta_;
+    return s >= 0 && s <= maxArc() ? s : -1;
+  }
+
+  /**
+   * The arcs to a set of radii at once, with no branch in the loop so that it can be vectorised
+   */
+  void HelixPropagator::arcsToRhos(const double* rhos, double* arcs, int n) const {
+    double diameter = 2*radius_;
+    for (int i = 0; i < n; i++) {
+      double x = rhos[i]/diameter;
+      arcs[i] = x <= 1 ? diameter*asin(x) : -1;
+    }
+  }
+
+  /**
+   * The crossing with the plane of the points p with normal.p = d, by Newton steps from a guess of the arc, kept within the
+   * outgoing half turn: of two crossings, the one closer to the guess is usually found
+   */
+  double HelixPropagator::arcToPlane(const XYZVector& normal, double d, double guess) const {
+    static const int maxSteps = 20;
+    static const double tolerance = 1e-9; // mm
+    double s = std::min(std::max(guess, 0.), maxArc());
+    for (int i = 0; i < maxSteps; i++) {
+      double phi = phi0_ - charge_*s/radius_;
+      double f = normal.X()*charge_*radius_*(sin(phi0_) - sin(phi)) + normal.Y()*charge_*radius_*(cos(phi) - cos(phi0_))
+               + normal.Z()*(z0_ + s*cotTheta_) - d;
+      double df = normal.X()*cos(phi) + normal.Y()*sin(phi) + normal.Z()*cotTheta_;
+      if (fabs(f) < tolerance) return s;
+      if (df == 0) return -1;
+      double next = std::min(std::max(s - f/df, 0.), maxArc());
+      if (next == s) return -1; // stuck on an end of the half turn, away from the plane
+      s = next;
+    }
+    return -1;
+  }
+}
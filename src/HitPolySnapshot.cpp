@@ -0,0 +1,168 @@
+/**
+ * @file HitPolySnapshot.cpp
+ * @brief This is the implementation of the structure-of-arrays copy of the sensor hit polygons used by the track hit tests
+ */
+
+#include <HitPolySnapshot.h>
+#include <cmath>
+
+namespace insur {
+
+  /**
+   * Remove all the polygons from the snapshot
+   */
+  void HitPolySnapshot::clear() {
+    nx_.clear(); ny_.clear(); nz_.clear(); d_.clear(); area_.clear();
+    for (int j = 0; j < 4; j++) { vx_[j].clear(); vy_[j].clear(); vz_[j].clear(); }
+    ux_.clear(); uy_.clear(); uz_.clear(); stripLength_.clear();
+    fnx_.clear(); fny_.clear(); fnz_.clear(); fd_.clear(); farea_.clear();
+    for (int j = 0; j < 4; j++) { fvx_[j].clear(); fvy_[j].clear(); fvz_[j].clear(); }
+  }
+
+  /**
+   * Copy a sensor hit polygon into the snapshot
+   * @param poly The hit polygon of the sensor
+   * @param stripLength The strip length of the sensor, to compute the hit segment
+   * @return The index of the polygon in the snapshot
+   */
+  int HitPolySnapshot::add(const Polygon3d<4>& poly, double stripLength) {
+    const XYZVector& normal = poly.getNormal();
+    nx_.push_back(normal.X());
+    ny_.push_back(normal.Y());
+    nz_.push_back(normal.Z());
+    d_.push_back(poly.getCenter().Dot(normal));
+    area_.push_back(poly.getDoubleArea());
+    for (int j = 0; j < 4; j++) {
+      vx_[j].push_back(poly.getVertex(j).X());
+      vy_[j].push_back(poly.getVertex(j).Y());
+      vz_[j].push_back(poly.getVertex(j).Z());
+    }
+    XYZVector u = (poly.getVertex(1) - poly.getVertex(0)).Unit();
+    ux_.push_back(u.X());
+    uy_.push_back(u.Y());
+    uz_.push_back(u.Z());
+    stripLength_.push_back(stripLength);
+    fnx_.push_back(nx_.back());
+    fny_.push_back(ny_.back());
+    fnz_.push_back(nz_.back());
+    fd_.push_back(d_.back());
+    farea_.push_back(area_.back());
+    for (int j = 0; j < 4; j++) {
+      fvx_[j].push_back(vx_[j].back());
+      fvy_[j].push_back(vy_[j].back());
+      fvz_[j].push_back(vz_[j].back());
+    }
+    return size() - 1;
+  }
+
+  /**
+   * Test a straight track against a list of polygons of the snapshot. The intersection with the plane, the point-inside
+   * test (with the same 1e-4 area tolerance) and the segment are computed as in <i>Sensor::checkHitSegment()</i>.
+   * In single precision, the polygons the float test rejects are not tested further, and have no hit point.
+   * @param polys The indices of the polygons to be tested
+   * @param trackOrig The origin of the track
+   * @param trackDir The direction of the track
+   * @param result The hit point and segment for each of the polygons, in the same order; the segment is -1 if there is no hit
+   */
+  void HitPolySnapshot::checkHitSegments(const std::vector<int>& polys, const XYZVector& trackOrig, const XYZVector& trackDir,
+                                         std::vector<std::pair<XYZVector, int> >& result) const {
+    if (!singlePrecision_) {
+      checkHitSegmentsDouble(polys, trackOrig, trackDir, result);
+      return;
+    }
+    // the buffers of the polygons left to the double precision test, kept from a track to the next
+    static thread_local std::vector<int> kept, keptPositions;
+    static thread_local std::vector<std::pair<XYZVector, int> > keptResult;
+    const float ox = trackOrig.X(), oy = trackOrig.Y(), oz = trackOrig.Z();
+    const float dx = trackDir.X(), dy = trackDir.Y(), dz = trackDir.Z();
+    int n = polys.size();
+    result.assign(n, std::make_pair(XYZVector(), -1));
+    kept.clear();
+    keptPositions.clear();
+    for (int first = 0; first < n; first += singlePrecisionBlockSize) {
+      int m = n - first < singlePrecisionBlockSize ? n - first : singlePrecisionBlockSize;
+      float px[singlePrecisionBlockSize], py[singlePrecisionBlockSize], pz[singlePrecisionBlockSize], sum[singlePrecisionBlockSize];
+      bool facing[singlePrecisionBlockSize];
+      int k[singlePrecisionBlockSize];
+      for (int i = 0; i < singlePrecisionBlockSize; i++) k[i] = polys[first + (i < m ? i : m - 1)];
+
+      for (int i = 0; i < singlePrecisionBlockSize; i++) {
+        float normOrig = fnx_[k[i]]*ox + fny_[k[i]]*oy + fnz_[k[i]]*oz;
+        float normDir = fnx_[k[i]]*dx + fny_[k[i]]*dy + fnz_[k[i]]*dz;
+        float t = (fd_[k[i]] - normOrig)/normDir;
+        facing[i] = !(normDir < 1e-3f - 1e-5f); // a polygon at the threshold is left to the double precision test
+        px[i] = ox + t*dx;
+        py[i] = oy + t*dy;
+        pz[i] = oz + t*dz;
+        sum[i] = 0.f;
+      }
+      for (int j = 0; j < 4; j++) {
+        const std::vector<float> &ax = fvx_[j], &ay = fvy_[j], &az = fvz_[j];
+        const std::vector<float> &bx = fvx_[(j+1)%4], &by = fvy_[(j+1)%4], &bz = fvz_[(j+1)%4];
+        for (int i = 0; i < singlePrecisionBlockSize; i++) {
+          float v1x = ax[k[i]] - px[i], v1y = ay[k[i]] - py[i], v1z = az[k[i]] - pz[i];
+          float v2x = bx[k[i]] - px[i], v2y = by[k[i]] - py[i], v2z = bz[k[i]] - pz[i];
+          float cx = v1y*v2z - v2y*v1z, cy = v1z*v2x - v2z*v1x, cz = v1x*v2y - v2x*v1y;
+          sum[i] += sqrtf(cx*cx + cy*cy + cz*cz);
+        }
+      }
+      // a point outside the polygon makes the sum exceed its double area; a NaN (a track parallel to the plane) is rejected
+      for (int i = 0; i < m; i++) {
+        if (facing[i] && sum[i] - farea_[k[i]] < singlePrecisionMargin * farea_[k[i]]) {
+          kept.push_back(k[i]);
+          keptPositions.push_back(first + i);
+        }
+      }
+    }
+    checkHitSegmentsDouble(kept, trackOrig, trackDir, keptResult);
+    for (unsigned int i = 0; i < kept.size(); i++) result[keptPositions[i]] = keptResult[i];
+  }
+
+  // The double precision test of the polygons, which gives the hits
+  void HitPolySnapshot::checkHitSegmentsDouble(const std::vector<int>& polys, const XYZVector& trackOrig, const XYZVector& trackDir,
+                                         std::vector<std::pair<XYZVector, int> >& result) const {
+    const double ox = trackOrig.X(), oy = trackOrig.Y(), oz = trackOrig.Z();
+    const double dx = trackDir.X(), dy = trackDir.Y(), dz = trackDir.Z();
+    int n = polys.size();
+    result.resize(n);
+    for (int first = 0; first < n; first += blockSize) {
+      int m = n - first < blockSize ? n - first : blockSize;
+      double px[blockSize], py[blockSize], pz[blockSize], sum[blockSize], seg[blockSize];
+      bool facing[blockSize];
+      // the block is padded with the last polygon, so that the loops below have a fixed trip count
+      int k[blockSize];
+      for (int i = 0; i < blockSize; i++) k[i] = polys[first + (i < m ? i : m - 1)];
+
+      for (int i = 0; i < blockSize; i++) {
+        double normOrig = nx_[k[i]]*ox + ny_[k[i]]*oy + nz_[k[i]]*oz;
+        double normDir = nx_[k[i]]*dx + ny_[k[i]]*dy + nz_[k[i]]*dz;
+        double t = (d_[k[i]] - normOrig)/normDir;
+        facing[i] = !(normDir < 1e-3);
+        px[i] = ox + t*dx;
+        py[i] = oy + t*dy;
+        pz[i] = oz + t*dz;
+        sum[i] = 0.;
+      }
+      for (int j = 0; j < 4; j++) {
+        const std::vector<double> &ax = vx_[j], &ay = vy_[j], &az = vz_[j];
+        const std::vector<double> &bx = vx_[(j+1)%4], &by = vy_[(j+1)%4], &bz = vz_[(j+1)%4];
+        for (int i = 0; i < blockSize; i++) {
+          double v1x = ax[k[i]] - px[i], v1y = ay[k[i]] - py[i], v1z = az[k[i]] - pz[i];
+          double v2x = bx[k[i]] - px[i], v2y = by[k[i]] - py[i], v2z = bz[k[i]] - pz[i];
+          double cx = v1y*v2z - v2y*v1z, cy = v1z*v2x - v2z*v1x, cz = v1x*v2y - v2x*v1y;
+          sum[i] += sqrt(cx*cx + cy*cy + cz*cz);
+        }
+      }
+      for (int i = 0; i < blockSize; i++) {
+        double projL = (px[i] - vx_[0][k[i]])*ux_[k[i]] + (py[i] - vy_[0][k[i]])*uy_[k[i]] + (pz[i] - vz_[0][k[i]])*uz_[k[i]];
+        seg[i] = projL / stripLength_[k[i]];
+      }
+
+      for (int i = 0; i < m; i++) {
+        if (!facing[i]) result[first + i] = std::make_pair(XYZVector(), -1);
+        else if (fabs(area_[k[i]] - sum[i]) < 1e-4) result[first + i] = std::make_pair(XYZVector(px[i], py[i], pz[i]), int(seg[i]));
+        else result[first + i] = std::make_pair(XYZVector(px[i], py[i], pz[i]), -1);
+      }
+    }
+  }
+}
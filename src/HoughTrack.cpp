@@ -1,4 +1,5 @@
 #include <HoughTrack.h>
+#include <TNamed.h>
 
 
 HoughTrack::~HoughTrack() {
@@ -49,12 +50,23 @@ double myatan2(double y, double x) {
 
 
 double HoughTrack::calcTheta(double x, double y, double z, double z0, double pt) {
-  
+  return calcTheta(calcArcLength(x, y, pt), z, z0);
+}
+
+
+double HoughTrack::calcArcLength(double x, double y, double pt) {
+
   double r = sqrt(x*x + y*y);
 
   double R = fabs(pt)/(0.3*insur::magnetic_field) * 1e3;
 
-  double theta = myatan2(R*acos(1-r*r/(2*R*R)),(z-z0));
+  return R*acos(1-r*r/(2*R*R)); // transverse length of the trajectory from the origin to the hit
+}
+
+
+double HoughTrack::calcTheta(double arcLength, double z, double z0) {
+
+  double theta = myatan2(arcLength,(z-z0));
 //  double theta = atan(R*acos(1-r*r/(2*R*R))/(z-z0));
 
   //double theta = atan2(r, z-z0);
@@ -77,16 +89,18 @@ void HoughTrack::processHit(int evid, int hitid, double x, double y, double z, d
   double invPt = die_.Uniform(1/pt - sigmaInvPt, 1/pt + sigmaInvPt);
   int nSamplesPt = 2*sigmaInvPt/histo_.getWbins(H_K); 
   z = die_.Uniform(z-sigmaZ, z+sigmaZ);
+  // the sample counts and the transverse arc length do not depend on the z samples: they are computed out of the inner loops
+  int nSamplesZ0 = 2*sigmaZ0/histo_.getWbins(H_Z0);
+  int nSamplesZ = 2*sigmaZ/histo_.getWbins(H_Z0);
   for (int k = 0; k < nSamplesPt; k++) {
     double invPtSample = rectangularSmear(invPt, sigmaInvPt, nSamplesPt, k);
     double phi0 = calcPhi0(x, y, 1/invPtSample);
-    int nSamplesZ0 = 2*sigmaZ0/histo_.getWbins(H_Z0);
+    double arcLength = calcArcLength(x, y, 1/invPtSample);
     for (int l = 0; l < nSamplesZ0; l++) {
       double z0Sample = rectangularSmear(0, sigmaZ0, nSamplesZ0, l);
-      int nSamplesZ = 2*sigmaZ/histo_.getWbins(H_Z0);
       for (int m = 0; m < nSamplesZ; m++) {
         double zSample = rectangularSmear(z, sigmaZ, nSamplesZ, m);
-        double theta = calcTheta(x, y, zSample, z0Sample, 1/invPtSample);
+        double theta = calcTheta(arcLength, zSample, z0Sample);
         //histo_.fill(seq<4>(invPtSample)(phi0)(z0Sample)(theta));
         histo_[invPtSample][phi0][z0Sample][theta] += SmartBin(1, evid, 1 << hitid);
       }
@@ -94,7 +108,21 @@ void HoughTrack::processHit(int evid, int hitid, double x, double y, double z, d
   }
 }
 
+/**
+ * Takes the module table of a tracks file from the geometry image of its directory, mapped without copying it, when
+ * the file names the hash of that image, and else from the geometry tree of the file
+ */
 void HoughTrack::loadGeometryData(TFile* infile) {
+  TNamed* imageHash = NULL;
+  infile->GetObject("geomimage", imageHash);
+  if (imageHash) {
+    std::string fileName = infile->GetName();
+    size_t slash = fileName.find_last_of('/');
+    std::string directory = slash != std::string::npos ? fileName.substr(0, slash) : ".";
+    if (mods_.open(GeometryImage::fileName(directory)) && any2str(mods_.hash()) == imageHash->GetTitle()) return;
+    std::cerr << "The geometry image of \"" << fileName << "\" is missing or not for its tracks: reading the geometry tree." << std::endl;
+  }
+
   TTree* tree;
   ModuleData mdata;
 
@@ -103,10 +131,13 @@ void HoughTrack::loadGeometryData(TFile* infile) {
   tree->SetBranchAddress("mdata", &mdata); 
 
   long int nentries = tree->GetEntriesFast();
+  std::vector<ModuleData> modules;
+  modules.reserve(nentries);
   for (int i = 0; i < nentries; i++) {
     tree->GetEntry(i);
-    mods_[mdata.refcnt][mdata.refz][mdata.refrho][mdata.refphi] = mdata;
+    modules.push_back(mdata);
   }
+  mods_.adopt(modules);
 
 }
 
@@ -132,6 +163,7 @@ void HoughTrack::processTree(std::string filename, long int startev, long int ho
   HitsP hits;
 
   ptError pterror;
+  const ModuleData noModule = ModuleData(); // the zeros a hit on a module missing from the table gets
 
   TFile* infile = new TFile(filename.c_str(), "read");
   if (infile->IsZombie()) {
@@ -189,7 +221,8 @@ void HoughTrack::processTree(std::string filename, long int startev, long int ho
       maxHits = tracks.nhits->at(j) > maxHits ? hits.cnt->size() /*tracks.nhits->at(j)*/ : maxHits;
 #ifndef GENERATE_HIT_MAP
       for (size_t k = 0; k < hits.cnt->size(); k++) {
-        ModuleData& mdata = mods_[hits.cnt->at(k)][hits.z->at(k)][hits.rho->at(k)][hits.phi->at(k)];
+        const ModuleData* found = mods_.find(hits.cnt->at(k), hits.z->at(k), hits.rho->at(k), hits.phi->at(k));
+        const ModuleData& mdata = found ? *found : noModule;
         pterror.setPitch((mdata.pitchhi+mdata.pitchlo)/2);
         pterror.setStripLength(mdata.striplen);
         pterror.setZ(mdata.z);
@@ -0,0 +1,95 @@
+/**
+ * @file InactiveHitIndex.cpp
+ * @brief This is the implementation of the eta binned lookup of the inactive elements a straight track can cross
+ */
+
+#include <InactiveHitIndex.h>
+#include <cmath>
+#include <limits>
+#include <global_constants.h>
+#include <global_funcs.h>
+
+namespace insur {
+
+  const int InactiveHitIndex::maxBins = 1000;
+
+  /**
+   * Fill the bins with the elements of the given collection. Only the elements lying (at least partially) on the z+ side
+   * are considered, since those are the only ones the material tracks are checked against. Elements whose eta range
+   * is not a number can never be hit, and are left out as well.
+   * @param elements A reference to the collection of inactive elements to be indexed
+   * @param cat The category of the elements to be indexed; all of them if <i>no_cat</i>
+   */
+  void InactiveHitIndex::build(std::vector<InactiveElement>& elements, MaterialProperties::Category cat) {
+    struct Bounds { int index; double etaMin, etaMax; };
+    std::vector<Bounds> bounds;
+    bins_.clear();
+    etaMin_ = std::numeric_limits<double>::max();
+    etaMax_ = -std::numeric_limits<double>::max();
+
+    for (int i = 0; i < (int)elements.size(); i++) {
+      InactiveElement& e = elements[i];
+      if ((e.getZOffset() + e.getZLength()) <= 0) continue;
+      if ((cat != MaterialProperties::no_cat) && (e.getCategory() != cat)) continue;
+      std::pair<double, double> etaMinMax = e.getEtaMinMax();
+      if (std::isnan(etaMinMax.first) || std::isnan(etaMinMax.second)) continue;
+      Bounds b = { i, etaMinMax.first, etaMinMax.second };
+      // the infinite edges (volumes reaching the z axis or z=0) go to the first or the last bin
+      if (std::isfinite(b.etaMin)) { etaMin_ = MIN(etaMin_, b.etaMin); etaMax_ = MAX(etaMax_, b.etaMin); }
+      if (std::isfinite(b.etaMax)) { etaMin_ = MIN(etaMin_, b.etaMax); etaMax_ = MAX(etaMax_, b.etaMax); }
+      bounds.push_back(b);
+    }
+
+    if (bounds.empty()) {
+      etaBins_ = 0;
+      return;
+    }
+
+    etaBins_ = (etaMax_ > etaMin_) ? MAX(1, MIN(maxBins, int(bounds.size()))) : 1;
+    bins_.resize(etaBins_);
+    // etaBin() does not decrease with eta, hence an eta strictly within the range of an element falls in one of its bins;
+    // bounds are in ascending element-index order, so each bin keeps the order of the brute-force scan
+    for (const Bounds& b : bounds) {
+      int first = etaBin(b.etaMin), last = etaBin(b.etaMax);
+      for (int ie = first; ie <= last; ie++) {
+        bins_[ie].elements.push_back(b.index);
+        bins_[ie].etaMin.push_back(b.etaMin);
+        bins_[ie].etaMax.push_back(b.etaMax);
+      }
+    }
+  }
+
+  /**
+   * Get the elements that a track leaving the origin with the given pseudorapidity crosses, that is those whose eta
+   * range strictly contains the eta of the track. The candidates of the bin are all tested, each index being written
+   * and kept only if its element is crossed.
+   * @param eta The pseudorapidity of the track
+   * @param crossed Set to the indices within the collection of the elements crossed, in ascending order
+   * @return The number of candidate elements tested
+   */
+  int InactiveHitIndex::crossings(double eta, std::vector<int>& crossed) const {
+    crossed.clear();
+    if (bins_.empty() || std::isnan(eta)) return 0;
+    const Bin& bin = bins_[etaBin(eta)];
+    int nCandidates = bin.elements.size(), nCrossed = 0;
+    crossed.resize(nCandidates);
+    const int* elements = bin.elements.data();
+    const double* etaMin = bin.etaMin.data();
+    const double* etaMax = bin.etaMax.data();
+    int* out = crossed.data();
+    for (int k = 0; k < nCandidates; k++) {
+      out[nCrossed] = elements[k];
+      nCrossed += (etaMin[k] < eta) & (etaMax[k] > eta);
+    }
+    crossed.resize(nCrossed);
+    return nCandidates;
+  }
+
+  int InactiveHitIndex::etaBin(double eta) const {
+    if (etaBins_ == 1) return 0;
+    double bin = floor((eta - etaMin_) / (etaMax_ - etaMin_) * etaBins_);
+    if (!(bin > 0)) return 0;
+    if (bin >= etaBins_) return etaBins_ - 1;
+    return int(bin);
+  }
+}
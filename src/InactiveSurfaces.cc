@@ -87,6 +87,15 @@ namespace insur {
     void InactiveSurfaces::addSupportPart(InactiveElement support) {
         supports.push_back(support);
     }
+
+    /**
+     * Add several inactive elements to the list of supports by copying them, in one append.
+     * @param parts The elements that are appended to the list of support parts, in their order
+     */
+    void InactiveSurfaces::addSupportParts(const std::vector<InactiveElement*>& parts) {
+        supports.reserve(supports.size() + parts.size());
+        for (const InactiveElement* part : parts) supports.push_back(*part);
+    }
     
     /**
      * Access an individual element in the list of supports by its index.
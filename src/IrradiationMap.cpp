@@ -6,6 +6,23 @@
  */
 
 #include"IrradiationMap.h"
+#include <cstdio>
+#include <cstring>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+  // Identifies the content of a raw map file without reading it: its size and modification time
+  bool sourceStamp(const std::string& fileName, int64_t stamp[3]) {
+    struct stat status;
+    if (stat(fileName.c_str(), &status)) return false;
+    stamp[0] = status.st_size;
+    stamp[1] = status.st_mtim.tv_sec;
+    stamp[2] = status.st_mtim.tv_nsec;
+    return true;
+  }
+}
 
 IrradiationMap::IrradiationMap(std::string irradiationMapFile) :
       rhoMin (0),
@@ -16,7 +33,8 @@ IrradiationMap::IrradiationMap(std::string irradiationMapFile) :
       zMax (0),
       zBinWidth (0),
       zBinNum (0),
-      invFemUnit (1)
+      invFemUnit (1),
+      gridWidth (0)
 {
   if (! irradiationMapFile.empty()) {
     ingest(irradiationMapFile);
@@ -27,6 +45,12 @@ IrradiationMap::IrradiationMap() : IrradiationMap("")
 {}
 
 void IrradiationMap::ingest(std::string irradiationMapFile) {
+  if (readCache(irradiationMapFile)) return;
+  if (parse(irradiationMapFile)) writeCache(irradiationMapFile);
+}
+
+bool IrradiationMap::parse(const std::string& irradiationMapFile) {
+  bool valid = true;
   std::string line;
   bool found_rhoMin = false;
   bool found_rhoMax = false;
@@ -38,10 +62,12 @@ void IrradiationMap::ingest(std::string irradiationMapFile) {
   bool found_zBinNum = false;
   bool found_invFemUnit = false;
   double irradiationValue = 0;
+  std::vector< std::vector<double> > irradiation;
   std::ifstream filein(irradiationMapFile);
 
   if (!filein.is_open()) {
     logERROR("Failed opening irradiation map file!");
+    valid = false;
   }
 
   while(std::getline(filein, line)) {
@@ -129,6 +155,19 @@ void IrradiationMap::ingest(std::string irradiationMapFile) {
     irradiation.push_back(irradiationLine);
   }
 
+  //copy the matrix in a single contiguous grid
+  gridWidth = irradiation.empty() ? 0 : irradiation.front().size();
+  irradiationGrid.clear();
+  irradiationGrid.reserve(irradiation.size() * gridWidth);
+  for (auto& irradiationLine : irradiation) {
+    if (irradiationLine.size() != gridWidth) {
+      logERROR("Error while parsing irradiation map values: the rows of the map have different lengths");
+      valid = false;
+    }
+    irradiationLine.resize(gridWidth, 0.);
+    irradiationGrid.insert(irradiationGrid.end(), irradiationLine.begin(), irradiationLine.end());
+  }
+
   //convert cm to mm
   zMin *= 10;
   zMax *= 10;
@@ -154,6 +193,69 @@ void IrradiationMap::ingest(std::string irradiationMapFile) {
         << "; found_zMax " << found_zMax << "; found_zBinWidth " << found_zBinWidth
         << "; found_zBinNum " << found_zBinNum << "; found_invFemUnit " << found_invFemUnit;
     logERROR(tempSS);
+    valid = false;
+  }
+  return valid;
+}
+
+bool IrradiationMap::readCache(const std::string& irradiationMapFile) {
+  int64_t stamp[3], cachedStamp[3];
+  if (!sourceStamp(irradiationMapFile, stamp)) return false;
+  std::ifstream in(cacheFile(irradiationMapFile), std::ios::binary);
+  if (!in) return false;
+  char magic[4];
+  uint32_t version;
+  in.read(magic, 4);
+  in.read((char*)&version, sizeof(version));
+  in.read((char*)cachedStamp, sizeof(cachedStamp));
+  if (!in || memcmp(magic, cacheMagic(), 4) || version != CacheVersion || memcmp(stamp, cachedStamp, sizeof(stamp))) return false;
+  double values[7];
+  int64_t binNums[2];
+  uint64_t sizes[2];
+  in.read((char*)values, sizeof(values));
+  in.read((char*)binNums, sizeof(binNums));
+  in.read((char*)sizes, sizeof(sizes));
+  if (!in) return false;
+  std::vector<double> grid(sizes[1]);
+  if (sizes[1]) in.read((char*)&grid[0], sizes[1] * sizeof(double));
+  if (!in) return false;
+  rhoMin = values[0];
+  rhoMax = values[1];
+  rhoBinWidth = values[2];
+  zMin = values[3];
+  zMax = values[4];
+  zBinWidth = values[5];
+  invFemUnit = values[6];
+  rhoBinNum = binNums[0];
+  zBinNum = binNums[1];
+  gridWidth = sizes[0];
+  irradiationGrid.swap(grid);
+  return true;
+}
+
+void IrradiationMap::writeCache(const std::string& irradiationMapFile) const {
+  int64_t stamp[3];
+  if (!sourceStamp(irradiationMapFile, stamp)) return;
+  // written aside and renamed, so that the processes reading the same map never see a partial cache
+  std::string fileName = cacheFile(irradiationMapFile);
+  std::string partialName = fileName + "." + std::to_string(getpid());
+  std::ofstream out(partialName, std::ios::binary);
+  if (!out) return;
+  uint32_t version = CacheVersion;
+  double values[7] = { rhoMin, rhoMax, rhoBinWidth, zMin, zMax, zBinWidth, invFemUnit };
+  int64_t binNums[2] = { rhoBinNum, zBinNum };
+  uint64_t sizes[2] = { gridWidth, irradiationGrid.size() };
+  out.write(cacheMagic(), 4);
+  out.write((const char*)&version, sizeof(version));
+  out.write((const char*)stamp, sizeof(stamp));
+  out.write((const char*)values, sizeof(values));
+  out.write((const char*)binNums, sizeof(binNums));
+  out.write((const char*)sizes, sizeof(sizes));
+  if (!irradiationGrid.empty()) out.write((const char*)&irradiationGrid[0], irradiationGrid.size() * sizeof(double));
+  out.close();
+  if (!out || std::rename(partialName.c_str(), fileName.c_str())) {
+    std::remove(partialName.c_str());
+    logWARNING("Could not write the cache of the irradiation map " + irradiationMapFile + ", it will be parsed again");
   }
 }
 
@@ -166,69 +268,78 @@ bool IrradiationMap::operator < (const IrradiationMap& confrontedMap) const{
 }
 
 bool IrradiationMap::isInRegion(std::pair<double,double> coordinates) const {
-  return ((zMin <= coordinates.first) && (zMax >= coordinates.first) && (rhoMin <= coordinates.second) && (rhoMax >= coordinates.second));
+  return isInRegion(coordinates.first, coordinates.second);
+}
+
+bool IrradiationMap::isInRegion(double z, double rho) const {
+  return ((zMin <= z) && (zMax >= z) && (rhoMin <= rho) && (rhoMax >= rho));
 }
 
 double IrradiationMap::calculateIrradiation(std::pair<double,double> coordinates) const {
-  double z = 0;
-  double rho = 0;
-  double z1 = 0;
-  double z2 = 0;
-  double rho1 = 0;
-  double rho2 = 0;
-  double irr1 = 0;
-  double irr2 = 0;
-  double irr11 = 0;
-  double irr21 = 0;
-  double irr12 = 0;
-  double irr22 = 0;
   double irrxy = 0;
 
   if(isInRegion(coordinates)) {
-    //correct the coordinates in the map matrix reference
-    z = (coordinates.first - zMin) / zBinWidth;
-    rho = (coordinates.second - rhoMin) / rhoBinWidth;
-
-    //take the 4 nearest bin centers
-    z1 = floor(z);
-    z2 = ceil(z);
-    rho1 = floor(rho);
-    rho2 = ceil(rho);
-
-    //if the point is in a intersection of the grid formed by the map bin centers
-    if((z1 == z2) && (rho1 == rho2)) {
-      //single value
-      irrxy = irradiation[int(rho1)][int(z1)];
-    }
+    irrxy = interpolate(coordinates.first, coordinates.second);
+  } else {
+    logERROR("Error while calculating module irradiation, module out of region");
+  }
 
-    //if is in a z line
-    else if (z1 == z2) {
-      irr1 = irradiation[int(rho1)][int(z1)];
-      irr2 = irradiation[int(rho2)][int(z1)];
-      //linear interpolation in rho
-      irrxy = irr1/(rho2-rho1) * (rho-rho1) + irr2/(rho2-rho1) * (rho2-rho);
-    }
+  return irrxy;
+}
 
-    //if is in a rho line
-    else if (rho1 == rho2) {
-      irr1 = irradiation[int(rho1)][int(z1)];
-      irr2 = irradiation[int(rho1)][int(z2)];
-      //linear interpolation in z
-      irrxy = irr1/(z2-z1) * (z-z1) + irr2/(z2-z1) * (z2-z);
+void IrradiationMap::calculateIrradiation(const double* z, const double* rho, double* out, size_t n) const {
+  for (size_t i = 0; i < n; i++) {
+    if (isInRegion(z[i], rho[i])) {
+      out[i] = interpolate(z[i], rho[i]);
+    } else {
+      out[i] = 0;
+      logERROR("Error while calculating module irradiation, module out of region");
     }
+  }
+}
 
-    //if is in the middle
-    else {
-      irr11 = irradiation[int(rho1)][int(z1)];
-      irr21 = irradiation[int(rho1)][int(z2)];
-      irr12 = irradiation[int(rho2)][int(z1)];
-      irr22 = irradiation[int(rho2)][int(z2)];
-      //bilinear interpolation in z and rho
-      irrxy = irr11/((z2-z1)*(rho2-rho1))*(z2-z)*(rho2-rho) + irr21/((z2-z1)*(rho2-rho1))*(z-z1)*(rho2-rho) + irr12/((z2-z1)*(rho2-rho1))*(z2-z)*(rho-rho1) + irr22/((z2-z1)*(rho2-rho1))*(z-z1)*(rho-rho1);
-    }
-  } else {
-    logERROR("Error while calculating module irradiation, module out of region");
+double IrradiationMap::interpolate(double zCoordinate, double rhoCoordinate) const {
+  //correct the coordinates in the map matrix reference
+  double z = (zCoordinate - zMin) / zBinWidth;
+  double rho = (rhoCoordinate - rhoMin) / rhoBinWidth;
+
+  //take the 4 nearest bin centers
+  double z1 = floor(z);
+  double z2 = ceil(z);
+  double rho1 = floor(rho);
+  double rho2 = ceil(rho);
+  const double* row1 = &irradiationGrid[int(rho1) * gridWidth];
+  const double* row2 = &irradiationGrid[int(rho2) * gridWidth];
+
+  //if the point is in a intersection of the grid formed by the map bin centers
+  if((z1 == z2) && (rho1 == rho2)) {
+    //single value
+    return row1[int(z1)];
   }
 
-  return irrxy;
+  //if is in a z line
+  else if (z1 == z2) {
+    double irr1 = row1[int(z1)];
+    double irr2 = row2[int(z1)];
+    //linear interpolation in rho
+    return irr1/(rho2-rho1) * (rho-rho1) + irr2/(rho2-rho1) * (rho2-rho);
+  }
+
+  //if is in a rho line
+  else if (rho1 == rho2) {
+    double irr1 = row1[int(z1)];
+    double irr2 = row1[int(z2)];
+    //linear interpolation in z
+    return irr1/(z2-z1) * (z-z1) + irr2/(z2-z1) * (z2-z);
+  }
+
+  //if is in the middle
+  else {
+    double irr11 = row1[int(z1)];
+    double irr21 = row1[int(z2)];
+    double irr12 = row2[int(z1)];
+    double irr22 = row2[int(z2)];
+    //bilinear interpolation in z and rho
+    return irr11/((z2-z1)*(rho2-rho1))*(z2-z)*(rho2-rho) + irr21/((z2-z1)*(rho2-rho1))*(z-z1)*(rho2-rho) + irr12/((z2-z1)*(rho2-rho1))*(z2-z)*(rho-rho1) + irr22/((z2-z1)*(rho2-rho1))*(z-z1)*(rho-rho1);
+  }
 }
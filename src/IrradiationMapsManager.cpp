@@ -6,6 +6,8 @@
  */
 
 #include "IrradiationMapsManager.h"
+#include <map>
+#include <mutex>
 
 IrradiationMapsManager::IrradiationMapsManager() {
 }
@@ -19,8 +21,24 @@ void IrradiationMapsManager::addIrradiationMap(const IrradiationMap& newIrradiat
 }
 
 void IrradiationMapsManager::addIrradiationMap(std::string newIrradiationMapFile) {
-  IrradiationMap newIrradiationMap (newIrradiationMapFile);
-  addIrradiationMap(newIrradiationMap);
+  addIrradiationMap(cachedIrradiationMap(newIrradiationMapFile));
+}
+
+const IrradiationMap& IrradiationMapsManager::cachedIrradiationMap(const std::string& irradiationMapFile) {
+  // each map is read by the first thread asking for it, the others waiting for it, while the other maps are being read
+  struct CachedMap {
+    std::once_flag read;
+    IrradiationMap map;
+  };
+  static std::map<std::string, CachedMap> cache;
+  static std::mutex cacheMutex;
+  CachedMap* cached;
+  {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    cached = &cache[irradiationMapFile];
+  }
+  std::call_once(cached->read, [&]() { cached->map.ingest(irradiationMapFile); });
+  return cached->map;
 }
 
 double IrradiationMapsManager::calculateIrradiationPower(std::pair<double,double> coordinates) const{
@@ -41,3 +59,16 @@ double IrradiationMapsManager::calculateIrradiationPower(std::pair<double,double
 
   return irradiation;
 }
+
+void IrradiationMapsManager::calculateIrradiationPower(const double* z, const double* rho, double* out, size_t n) const {
+  for (size_t i = 0; i < n; i++) {
+    out[i] = 0;
+    std::set<IrradiationMap>::const_iterator iter = irradiationMaps.cbegin();
+    while (iter != irradiationMaps.cend() && !iter->isInRegion(z[i], rho[i])) ++iter;
+    if (iter == irradiationMaps.cend()) {
+      logERROR("Error while calculating irradiation, a proper irradiation map is not found");
+      continue;
+    }
+    iter->calculateIrradiation(z + i, rho + i, out + i, 1);
+  }
+}
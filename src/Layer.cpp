@@ -129,7 +129,7 @@ void Layer::buildStraight() {
   first->store(propertyTree());
   first->build(rodTemplate);
 
-  logINFO(Form("Copying rod %s", fullid(*this).c_str()));
+  logINFO("Copying rod " + fullid(*this));
   StraightRodPair* second = GeometryFactory::clone(*first);
   second->myid(2);
   if (!sameParityRods()) second->zPlusParity(first->zPlusParity()*-1);
@@ -209,7 +209,7 @@ void Layer::build() {
     materialObject_.store(propertyTree());
     materialObject_.build();
 
-    logINFO(Form("Building %s", fullid(*this).c_str()));
+    logINFO("Building " + fullid(*this));
     check();
 
     if (tiltedLayerSpecFile().empty()) buildStraight();
@@ -0,0 +1,159 @@
+/**
+ * @file LayoutComparison.cpp
+ * @brief This is the implementation of the comparison of layouts analysed with the same tracks
+ */
+
+#include <LayoutComparison.h>
+#include <cmath>
+#include <iomanip>
+#include <memory>
+#include <vector>
+#include <TFile.h>
+#include <TGraphErrors.h>
+#include <global_funcs.h>
+#include <messageLogger.h>
+
+namespace insur {
+
+  namespace {
+    // The sums of the values of the pairs of tracks of an eta bin, of their squares and of those of their differences
+    struct PairSums {
+      PairSums() : n(0), a(0), a2(0), b(0), b2(0), d(0), d2(0) {}
+      void add(double x, double y) {
+        n++;
+        a += x; a2 += x*x;
+        b += y; b2 += y*y;
+        d += y - x; d2 += (y - x)*(y - x);
+      }
+      static double variance(double n, double sum, double sum2) { return n > 1 ? MAX(0., (sum2 - sum*sum/n) / (n - 1)) : 0; }
+      double difference() const { return n ? d / n : 0; }
+      double pairedError() const { return n ? sqrt(variance(n, d, d2) / n) : 0; }
+      double independentError() const { return n ? sqrt((variance(n, a, a2) + variance(n, b, b2)) / n) : 0; }
+      double n, a, a2, b, b2, d, d2;
+    };
+  }
+
+  /**
+   * Compares the track samples of a layout with the ones of a reference layout, and writes the differences
+   * @param referenceFile The track samples of the reference layout
+   * @param layoutFile The track samples of the layout compared to the reference
+   * @param outputFile The file the graphs of the differences are written to, which is recreated
+   * @param summary The stream the average differences are listed to
+   * @return True if the samples could be read, were made with the same tracks, and the differences could be written
+   */
+  bool LayoutComparison::compare(const std::string& referenceFile, const std::string& layoutFile, const std::string& outputFile, std::ostream& summary) const {
+    TDirectory* currentDirectory = gDirectory;
+    std::unique_ptr<TFile> reference(TFile::Open(referenceFile.c_str(), "READ"));
+    std::unique_ptr<TFile> layout(TFile::Open(layoutFile.c_str(), "READ"));
+    bool compared = true;
+    for (const auto& file : { std::make_pair(reference.get(), referenceFile), std::make_pair(layout.get(), layoutFile) }) {
+      if (!file.first || file.first->IsZombie()) {
+        logERROR("Could not open the track samples " + file.second);
+        compared = false;
+      }
+    }
+    if (compared) {
+      TFile output(outputFile.c_str(), "RECREATE");
+      if (output.IsZombie()) {
+        logERROR("Could not create the comparison file " + outputFile);
+        compared = false;
+      } else {
+        summary << "Differences of " << layoutFile << " from " << referenceFile << ", with the same tracks:" << std::endl;
+        for (const char* name : { "geometry", "material" }) {
+          compared = compareSamples(dynamic_cast<TNtupleD*>(reference->Get(name)), dynamic_cast<TNtupleD*>(layout->Get(name)), name, output, summary) && compared;
+        }
+        output.Close();
+      }
+    }
+    if (reference) reference->Close();
+    if (layout) layout->Close();
+    if (currentDirectory) currentDirectory->cd();
+    return compared;
+  }
+
+  /**
+   * Compares the samples of one scan: the tracks are paired by index, the pairs are binned in eta, and the average
+   * difference of each value is written as a graph against eta, with the error of the mean of the differences of the
+   * pairs, next to the graph with the error two independent samples would have had
+   * @param reference The samples of the reference layout
+   * @param layout The samples of the layout compared to the reference
+   * @param name The name of the scan
+   * @param output The directory the graphs are written to
+   * @param summary The stream the average differences over all the tracks are listed to
+   * @return False if the samples are missing or were not made with the same tracks
+   */
+  bool LayoutComparison::compareSamples(TNtupleD* reference, TNtupleD* layout, const std::string& name, TDirectory& output, std::ostream& summary) const {
+    if (!reference || !layout) {
+      logERROR("The track samples of the " + name + " scan are missing");
+      return false;
+    }
+    // a scan with fewer tracks (such as an adaptive geometry scan) shot the first tracks of the other
+    long long numPairs = MIN(reference->GetEntries(), layout->GetEntries());
+    if (!numPairs) return true; // the scan was not run
+    if (reference->GetNvar() != 3 || layout->GetNvar() != 3) {
+      logERROR("The track samples of the " + name + " scan do not have the expected variables");
+      return false;
+    }
+    std::vector<double> eta(numPairs), values[2][2];
+    for (int v = 0; v < 2; v++) {
+      values[0][v].resize(numPairs);
+      values[1][v].resize(numPairs);
+    }
+    double minEta = 0, maxEta = 0;
+    for (long long i = 0; i < numPairs; i++) {
+      reference->GetEntry(i);
+      const double* referenceSample = reference->GetArgs();
+      layout->GetEntry(i);
+      const double* layoutSample = layout->GetArgs();
+      if (fabs(referenceSample[0] - layoutSample[0]) > 1e-9 * (1 + fabs(referenceSample[0]))) {
+        logERROR("The " + name + " tracks of the layouts are not the same (track " + any2str(i) + " has an eta of " + any2str(referenceSample[0]) + " and " +
+                 any2str(layoutSample[0]) + "): they have to be analysed with the same seed, number of tracks and track options");
+        return false;
+      }
+      eta[i] = referenceSample[0];
+      for (int v = 0; v < 2; v++) {
+        values[0][v][i] = referenceSample[v + 1];
+        values[1][v][i] = layoutSample[v + 1];
+      }
+      if (i == 0 || eta[i] < minEta) minEta = eta[i];
+      if (i == 0 || eta[i] > maxEta) maxEta = eta[i];
+    }
+
+    double binWidth = maxEta > minEta ? (maxEta - minEta) / etaBins_ : 1;
+    output.cd();
+    for (int v = 0; v < 2; v++) {
+      std::string variable = reference->GetListOfBranches()->At(v + 1)->GetName();
+      std::vector<PairSums> bins(etaBins_);
+      PairSums total;
+      for (long long i = 0; i < numPairs; i++) {
+        int bin = MIN(etaBins_ - 1, int((eta[i] - minEta) / binWidth));
+        bins[bin].add(values[0][v][i], values[1][v][i]);
+        total.add(values[0][v][i], values[1][v][i]);
+      }
+      TGraphErrors paired, independent;
+      for (int bin = 0; bin < etaBins_; bin++) {
+        if (bins[bin].n < 2) continue;
+        double center = minEta + (bin + 0.5) * binWidth;
+        int point = paired.GetN();
+        paired.SetPoint(point, center, bins[bin].difference());
+        paired.SetPointError(point, binWidth / 2, bins[bin].pairedError());
+        independent.SetPoint(point, center, bins[bin].difference());
+        independent.SetPointError(point, binWidth / 2, bins[bin].independentError());
+      }
+      std::string graphName = name + "_" + variable + "_difference";
+      paired.SetName(graphName.c_str());
+      paired.SetTitle((name + " tracks: difference of the " + variable + ", paired tracks;#eta;#Delta " + variable).c_str());
+      paired.Write();
+      independent.SetName((graphName + "_independent").c_str());
+      independent.SetTitle((name + " tracks: difference of the " + variable + ", independent samples;#eta;#Delta " + variable).c_str());
+      independent.Write();
+
+      double pairedError = total.pairedError(), independentError = total.independentError();
+      summary << "  " << std::left << std::setw(24) << (name + " " + variable) << std::right << std::setw(14) << total.difference()
+              << " +/- " << std::setw(10) << pairedError << " (independent samples: +/- " << independentError;
+      if (pairedError > 0) summary << ", " << any2str(pow(independentError / pairedError, 2), 1) << " times the tracks";
+      summary << ") over " << numPairs << " tracks" << std::endl;
+    }
+    return true;
+  }
+}
@@ -348,7 +348,9 @@ namespace insur {
      * @param barrelcaps The collection mapping to the barrel modules that need to have a material mix assigned to them
      * @return True if there were no errors during processing, false otherwise
      */
-    bool MatCalc::calculateBarrelMaterials(std::vector<std::vector<ModuleCap> >& barrelcaps) { // sorry, but this code is a POS
+    bool MatCalc::calculateBarrelMaterials(std::vector<ModuleCaps>& barrelcaps) { // sorry, but this code is a POS
+      // the modules whose materials were computed, by recipe, for the rings made of the same parts
+      std::map<std::vector<RingPart>, ModuleCap*> ringMaterials;
       // layer loop
       for (unsigned int i = 0; i < barrelcaps.size(); i++) {
         if (barrelcaps.at(i).size() > 0) {
@@ -361,8 +363,8 @@ namespace insur {
             // module loop for ring types and multipliers for strips and segments
             for (unsigned int j = 0; j < barrelcaps.at(i).size(); j++) {
               // ring index of current module
-              rindex = barrelcaps.at(i).at(j).getModule().uniRef().ring;
-              maxRing = barrelcaps.at(i).at(j).getModule().uniRef().side > 0 ? MAX(barrelcaps.at(i).at(j).getModule().uniRef().ring, maxRing) : maxRing;
+              rindex = barrelcaps.at(i).at(j).getModule().moduleKey().ring();
+              maxRing = barrelcaps.at(i).at(j).getModule().moduleKey().side() > 0 ? MAX(barrelcaps.at(i).at(j).getModule().moduleKey().ring(), maxRing) : maxRing;
               // collect ring types
               if ((int)mtypes.size() < rindex) {
                 while ((int)mtypes.size() < rindex) mtypes.push_back("");
@@ -394,11 +396,9 @@ namespace insur {
             // ring loop
             for (int j = 0; j < /*maxRing*/ rindex; j++) { // CUIDADO rindex WTF!?!?!?
               if (!modinrings.at(j).empty()) {
-                double A, B, C, D;
-                double density, surface, length;
+                double surface, length;
+                std::vector<RingPart> parts;
                 std::list<int>::iterator first = modinrings.at(j).begin();
-                std::list<int>::iterator start = modinrings.at(j).begin(); start++;
-                std::list<int>::iterator stop = modinrings.at(j).end();
                 surface = barrelcaps.at(i).at(*first).getSurface();
                 if (surface < 0) {
                   std::cerr << msg_negative_area << " Barrel module in layer " << i << ", position " << j;
@@ -432,24 +432,7 @@ namespace insur {
                     }
                   //}
 #endif
-                  std::vector<SingleMod>& vect = getModVector(mtypes.at(j));
-                  std::vector<SingleMod>::const_iterator guard = vect.end();
-                  std::vector<SingleMod>::const_iterator iter;
-                  // materials loop
-                  for (iter = vect.begin(); iter != guard; iter++) {
-                    // measurement for unit conversion
-                    density = mt.getMaterial(iter->tag).density;
-                    // unit conversion per parameter (internal unit is grammes)
-                    if (iter->uB == grpm) B = convert(iter->B, iter->uB, length);
-                    else B = convert(iter->B, iter->uB, density, surface);
-                    if (iter->uD == grpm) D = convert(iter->D, iter->uD, length);
-                    else D = convert(iter->D, iter->uD, density, surface);
-                    // parameter scaling
-                    B = B * stripseg_scalars.at(j);
-                    // save converted and scaled material
-                    if (iter->is_local) barrelcaps.at(i).at(*first).addLocalMass(iter->tag, iter->comp, B + D); // CUIDADO MIXED UP j and *first?? was j
-                    //else barrelcaps.at(i).at(*first).addExitingMass(iter->tag, iter->comp, B + D); // was j
-                  }
+                  parts.push_back(RingPart(mtypes.at(j), false, length, surface, stripseg_scalars.at(j)));
                   //accumulation of travelling parameters for outer rings
                   if (j > 0) {
                     // inner rings accumulation loop
@@ -480,36 +463,12 @@ namespace insur {
                           }
                         // }
 #endif
-                        std::vector<SingleMod>& vect = getModVector(mtypes.at(k));
-                        std::vector<SingleMod>::const_iterator iter, guard = vect.end();
-                        for (iter = vect.begin(); iter != guard; iter++) {
-                          // measurement for unit conversion
-                          density = mt.getMaterial(iter->tag).density;
-                          // unit conversion per parameter (internal unit is grammes)
-                          if (iter->uA == grpm) A = convert(iter->A, iter->uA, length);
-                          else A = convert(iter->A, iter->uA, density, surface);
-                          if (iter->uC == grpm) C = convert(iter->C, iter->uC, length);
-                          else C = convert(iter->C, iter->uC, density, surface);
-                          // parameter scaling
-                          A = A * stripseg_scalars.at(k);
-                          // save converted and scaled material
-                          if (iter->is_local) barrelcaps.at(i).at(*first).addLocalMass(iter->tag, iter->comp, A + C); // was j
-                          //else barrelcaps.at(i).at(*first).addExitingMass(iter->tag, iter->comp, A + C); // was j
-                        }
+                        parts.push_back(RingPart(mtypes.at(k), true, length, surface, stripseg_scalars.at(k)));
                       }
                     }
                   }
                   // use recorded materials to calculate material properties for every module in current ring
-                  barrelcaps.at(i).at(*first).calculateTotalMass();
-                  barrelcaps.at(i).at(*first).calculateRadiationLength(mt);
-                  barrelcaps.at(i).at(*first).calculateInteractionLength(mt);
-                  while (start != stop) {
-                    barrelcaps.at(i).at(*first).copyMassVectors(barrelcaps.at(i).at(*start));
-                    barrelcaps.at(i).at(*start).calculateTotalMass();
-                    barrelcaps.at(i).at(*start).calculateRadiationLength(mt);
-                    barrelcaps.at(i).at(*start).calculateInteractionLength(mt);
-                    start++;
-                  }
+                  assignRingMaterials(barrelcaps.at(i), modinrings.at(j), parts, ringMaterials);
                 }
               }
             }
@@ -532,7 +491,9 @@ namespace insur {
      * @param endcapcaps The collection mapping to the endcap modules that need to have a material mix assigned to them
      * @return True if there were no errors during processing, false otherwise
      */
-    bool MatCalc::calculateEndcapMaterials(std::vector<std::vector<ModuleCap> >& endcapcaps) {
+    bool MatCalc::calculateEndcapMaterials(std::vector<ModuleCaps>& endcapcaps) {
+      // the modules whose materials were computed, by recipe, for the rings made of the same parts
+      std::map<std::vector<RingPart>, ModuleCap*> ringMaterials;
       // disc loop
       for (unsigned int i = 0; i < endcapcaps.size(); i++) {
         if (endcapcaps.at(i).size() > 0) {
@@ -545,7 +506,7 @@ namespace insur {
             // module loop for ring types and multipliers for strips and segments
             for (unsigned int j = 0; j < endcapcaps.at(i).size(); j++) {
               // sum up the number of modules per ring
-              rindex = endcapcaps.at(i).at(j).getModule().uniRef().ring;
+              rindex = endcapcaps.at(i).at(j).getModule().moduleKey().ring();
               if ((int)mods.size() < rindex) {
                 while ((int)mods.size() < rindex) mods.push_back(0);
               }
@@ -580,11 +541,9 @@ namespace insur {
             // ring loop
             for (int j = 0; j < rindex; j++) {
               if (!modinrings.at(j).empty()) {
-                double A, B, C, D;
-                double density, surface, length;
+                double surface, length;
+                std::vector<RingPart> parts;
                 std::list<int>::iterator first = modinrings.at(j).begin();
-                std::list<int>::iterator start = modinrings.at(j).begin(); start++;
-                std::list<int>::iterator stop = modinrings.at(j).end();
                 surface = endcapcaps.at(i).at(*first).getSurface();
                 if (surface < 0) {
                   std::cerr << msg_negative_area << " Endcap module in disc " << i << ", ring " << j;
@@ -594,22 +553,7 @@ namespace insur {
                 // calculation of static parameters for all rings
                 else {
                   length = endcapcaps.at(i).at(*first).getModule().length();
-                  std::vector<SingleMod>& vect = getModVector(mtypes.at(j));
-                  std::vector<SingleMod>::const_iterator iter, guard = vect.end();
-                  // materials loop
-                  for (iter = vect.begin(); iter != guard; iter++) {
-                    // unit conversion per parameter (internal unit is grammes)
-                    density = mt.getMaterial(iter->tag).density;
-                    if (iter->uB == grpm) B = convert(iter->B, iter->uB, length);
-                    else B = convert(iter->B, iter->uB, density, surface);
-                    if (iter->uD == grpm) D = convert(iter->D, iter->uD, length);
-                    else D = convert(iter->D, iter->uD, density, surface);
-                    // parameter scaling
-                    B = B * stripseg_scalars.at(j);
-                    // save converted and scaled material
-                    if (iter->is_local) endcapcaps.at(i).at(*first).addLocalMass(iter->tag, iter->comp, B + D);
-                    //else endcapcaps.at(i).at(*first).addExitingMass(iter->tag, iter->comp, B + D);
-                  }
+                  parts.push_back(RingPart(mtypes.at(j), false, length, surface, stripseg_scalars.at(j)));
                   // accumulation of travelling parameters for outer rings
                   if (j > 0) {
                     // inner rings accumulation loop
@@ -623,39 +567,13 @@ namespace insur {
                         }
                         else {
                           length = endcapcaps.at(i).at(modinrings.at(k).front()).getModule().length();
-                          std::vector<SingleMod>& vect = getModVector(mtypes.at(k));
-                          std::vector<SingleMod>::const_iterator guard = vect.end();
-                          std::vector<SingleMod>::const_iterator iter;
-                          // materials loop
-                          for (iter = vect.begin(); iter != guard; iter++) {
-                            // unit conversion per parameter (internal unit is grammes)
-                            density = mt.getMaterial(iter->tag).density;
-                            if (iter->uA == grpm) A = convert(iter->A, iter->uA, length);
-                            else A = convert(iter->A, iter->uA, density, surface);
-                            if (iter->uC == grpm) C = convert(iter->C, iter->uC, length);
-                            else C = convert(iter->C, iter->uC, density, surface);
-                            // parameter scaling
-                            A = A * (double)mods.at(k) / (double)mods.at(j) * stripseg_scalars.at(k);
-                            C = C * (double)mods.at(k) / (double)mods.at(j);
-                            // save converted and scaled material
-                            if (iter->is_local) endcapcaps.at(i).at(*first).addLocalMass(iter->tag, iter->comp, A + C);
-                            //else endcapcaps.at(i).at(*first).addExitingMass(iter->tag, iter->comp, A + C);
-                          }
+                          parts.push_back(RingPart(mtypes.at(k), true, length, surface, stripseg_scalars.at(k), mods.at(k), mods.at(j)));
                         }
                       }
                     }
                   }
                   // use recorded materials to calculate material properties for every module in current ring
-                  endcapcaps.at(i).at(*first).calculateTotalMass();
-                  endcapcaps.at(i).at(*first).calculateRadiationLength(mt);
-                  endcapcaps.at(i).at(*first).calculateInteractionLength(mt);
-                  while (start != stop) {
-                    endcapcaps.at(i).at(*first).copyMassVectors(endcapcaps.at(i).at(*start));
-                    endcapcaps.at(i).at(*start).calculateTotalMass();
-                    endcapcaps.at(i).at(*start).calculateRadiationLength(mt);
-                    endcapcaps.at(i).at(*start).calculateInteractionLength(mt);
-                    start++;
-                  }
+                  assignRingMaterials(endcapcaps.at(i), modinrings.at(j), parts, ringMaterials);
                 }
               }
             }
@@ -669,6 +587,80 @@ namespace insur {
       return true;
     }
 
+    /**
+     * Adds the materials of a recipe to a module: each part adds the materials of its module type, converted for its
+     * length and surface, the parameters depending on chips and segments being scaled by its strip and segment multiplier.
+     * @param cap The module
+     * @param parts The parts of the recipe
+     */
+    void MatCalc::addRingMaterials(ModuleCap& cap, const std::vector<RingPart>& parts) {
+      double A, B, C, D;
+      double density;
+      for (const RingPart& part : parts) {
+        std::vector<SingleMod>& vect = getModVector(part.type);
+        std::vector<SingleMod>::const_iterator iter, guard = vect.end();
+        // materials loop
+        for (iter = vect.begin(); iter != guard; iter++) {
+          // measurement for unit conversion
+          density = mt.getMaterial(iter->tag).density;
+          // unit conversion per parameter (internal unit is grammes)
+          if (part.travelling) {
+            if (iter->uA == grpm) A = convert(iter->A, iter->uA, part.length);
+            else A = convert(iter->A, iter->uA, density, part.surface);
+            if (iter->uC == grpm) C = convert(iter->C, iter->uC, part.length);
+            else C = convert(iter->C, iter->uC, density, part.surface);
+            // parameter scaling
+            A = A * part.multiplier / part.divisor * part.stripsegScalar;
+            C = C * part.multiplier / part.divisor;
+            // save converted and scaled material
+            if (iter->is_local) cap.addLocalMass(iter->tag, iter->comp, A + C);
+          } else {
+            if (iter->uB == grpm) B = convert(iter->B, iter->uB, part.length);
+            else B = convert(iter->B, iter->uB, density, part.surface);
+            if (iter->uD == grpm) D = convert(iter->D, iter->uD, part.length);
+            else D = convert(iter->D, iter->uD, density, part.surface);
+            // parameter scaling
+            B = B * part.stripsegScalar;
+            // save converted and scaled material
+            if (iter->is_local) cap.addLocalMass(iter->tag, iter->comp, B + D);
+          }
+        }
+      }
+    }
+
+    /**
+     * Assigns the materials of a recipe to the modules of a ring. They are computed for the first module, unless a module
+     * of an earlier ring has the same recipe, and copied to the others along with their mass and radiation and interaction
+     * lengths, which are only calculated again for a module with another surface.
+     * @param caps The modules of the layer or disc
+     * @param ring The indices of the modules of the ring within the layer or disc
+     * @param parts The recipe of the materials of the ring
+     * @param ringMaterials The modules already assigned, by recipe
+     */
+    void MatCalc::assignRingMaterials(ModuleCaps& caps, const std::list<int>& ring, const std::vector<RingPart>& parts,
+                                      std::map<std::vector<RingPart>, ModuleCap*>& ringMaterials) {
+      ModuleCap& firstCap = caps.at(ring.front());
+      std::map<std::vector<RingPart>, ModuleCap*>::iterator known = ringMaterials.find(parts);
+      if (known != ringMaterials.end()) known->second->copyMaterialValues(firstCap);
+      else {
+        addRingMaterials(firstCap, parts);
+        firstCap.calculateTotalMass();
+        firstCap.calculateRadiationLength(mt);
+        firstCap.calculateInteractionLength(mt);
+        ringMaterials[parts] = &firstCap;
+      }
+      for (std::list<int>::const_iterator it = ++ring.begin(); it != ring.end(); ++it) {
+        ModuleCap& cap = caps.at(*it);
+        if (cap.getSurface() == firstCap.getSurface()) firstCap.copyMaterialValues(cap);
+        else {
+          firstCap.copyMassVectors(cap);
+          cap.calculateTotalMass();
+          cap.calculateRadiationLength(mt);
+          cap.calculateInteractionLength(mt);
+        }
+      }
+    }
+
     /**
      * This is the core function that assigns materials to barrel services once the calculator has been initialised.
      * It loops through the elements of the provided vector and calculates the relevant material mix for the element
@@ -680,7 +672,7 @@ namespace insur {
      * @param endcapservices The collection of endcap service volumes - they may act as neighbour volumes to the barrel services
      * @return True if there were no errors during processing, false otherwise
      */
-    bool MatCalc::calculateBarrelServiceMaterials(std::vector<std::vector<ModuleCap> >& barrelcaps,
+    bool MatCalc::calculateBarrelServiceMaterials(std::vector<ModuleCaps>& barrelcaps,
                                                   std::vector<InactiveElement>& barrelservices, std::vector<InactiveElement>& endcapservices) {
       int feeder, neighbour;
       InactiveElement::InType ftype, ntype;
@@ -745,7 +737,7 @@ namespace insur {
      * @param endcapservices The collection of endcap services that need to have a material mix assigned to them
      * @return True if there were no errors during processing, false otherwise
      */
-    bool MatCalc::calculateEndcapServiceMaterials(std::vector<std::vector<ModuleCap> >& endcapcaps,
+    bool MatCalc::calculateEndcapServiceMaterials(std::vector<ModuleCaps>& endcapcaps,
                                                   std::vector<InactiveElement>& barrelservices, std::vector<InactiveElement>& endcapservices) {
       int feeder, neighbour;
       InactiveElement::InType ftype, ntype;
@@ -1103,7 +1095,7 @@ namespace insur {
      * @param layer The layer under investigation
      * @return The number of rods in the given layer
      */
-    int MatCalc::findBarrelRods(std::vector<std::vector<ModuleCap> >& caps, int layer) {
+    int MatCalc::findBarrelRods(std::vector<ModuleCaps>& caps, int layer) {
       return findEndcapRods(caps, layer) / 2;
     }
 
@@ -1113,16 +1105,16 @@ namespace insur {
      * @param layer The disc under investigation
      * @return The number of modules in the outmost ring of the given disc
      */
-    int MatCalc::findEndcapRods(std::vector<std::vector<ModuleCap> >& caps, int layer) {
+    int MatCalc::findEndcapRods(std::vector<ModuleCaps>& caps, int layer) {
       int res = 0;
       int index = 1;
       if ((layer >= 0) && (layer < (int)caps.size())) {
         for (unsigned int i = 0; i < caps.at(layer).size(); i++) {
-          if (caps.at(layer).at(i).getModule().uniRef().ring > index) {
-            index = caps.at(layer).at(i).getModule().uniRef().ring;
+          if (caps.at(layer).at(i).getModule().moduleKey().ring() > index) {
+            index = caps.at(layer).at(i).getModule().moduleKey().ring();
             res = 1;
           }
-          else if (caps.at(layer).at(i).getModule().uniRef().ring == index) res++;
+          else if (caps.at(layer).at(i).getModule().moduleKey().ring() == index) res++;
         }
       }
       return res;
@@ -1157,7 +1149,7 @@ namespace insur {
      * @param l The length that e.g. a cable would have to travel to cross along the service volume
      * @param s The surface of the service volume
      */
-    void MatCalc::adjacentDifferentCategory(std::vector<ModuleCap>& source, InactiveElement& dest, int r, double l, double s) {
+    void MatCalc::adjacentDifferentCategory(ModuleCaps& source, InactiveElement& dest, int r, double l, double s) {
       // S-labelled service materials
       std::vector<SingleSerLocal>::const_iterator liter, lguard = internals.serlocalinfo.end();
       // materials loop
@@ -1173,9 +1165,9 @@ namespace insur {
       int modsonrod = 0, lastmod = 0;
       // loop to find information about contributing source modules
       for (unsigned int j = 0; j < source.size(); j++) {
-        if (modsonrod < source.at(j).getModule().uniRef().ring) {
+        if (modsonrod < source.at(j).getModule().moduleKey().ring()) {
           // modsonrod finds the number of modules along a rod
-          modsonrod = source.at(j).getModule().uniRef().ring;
+          modsonrod = source.at(j).getModule().moduleKey().ring();
           // lastmod finds the index of a sample module at the end of a rod
           lastmod = j;
         }
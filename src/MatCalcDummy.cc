@@ -16,7 +16,7 @@ namespace insur {
      * @param barrelcaps A reference to the collection of <i>ModuleCap</i> objects that sit on top of the barrel modules
      * @return True, because the process is always considered successful - even if one of the module surfaces was reported as negative
      */
-    bool MatCalcDummy::calculateBarrelMaterials(std::vector<std::vector<ModuleCap> >& barrelcaps) {
+    bool MatCalcDummy::calculateBarrelMaterials(std::vector<ModuleCaps>& barrelcaps) {
         for (unsigned int i = 0; i < barrelcaps.size(); i++) {
             for (unsigned int j = 0; j < barrelcaps.at(i).size(); j++) {
                 if (barrelcaps.at(i).at(j).getSurface() <= 0) {
@@ -38,7 +38,7 @@ namespace insur {
      * @param endcapcaps A reference to the collection of <i>ModuleCap</i> objects that sit on top of the endcap modules
      * @return True, because the process is always considered successful - even if one of the module surfaces was reported as negative
      */
-    bool MatCalcDummy::calculateEndcapMaterials(std::vector<std::vector<ModuleCap> >& endcapcaps) {
+    bool MatCalcDummy::calculateEndcapMaterials(std::vector<ModuleCaps>& endcapcaps) {
         for (unsigned int i = 0; i < endcapcaps.size(); i++) {
             for (unsigned int j = 0; j < endcapcaps.at(i).size(); j++) {
                 if (endcapcaps.at(i).at(j).getSurface() <= 0) {
@@ -61,7 +61,7 @@ namespace insur {
      * @param endcapservices A reference to the collection of endcap services; unused
      * @return True, because the process is always considered successful
      */
-    bool MatCalcDummy::calculateBarrelServiceMaterials(std::vector<std::vector<ModuleCap> >& barrelcaps,
+    bool MatCalcDummy::calculateBarrelServiceMaterials(std::vector<ModuleCaps>& barrelcaps,
                             std::vector<InactiveElement>& barrelservices, std::vector<InactiveElement>& endcapservices) {
         for (unsigned int i = 0; i < barrelservices.size(); i++) {
             barrelservices.at(i).addLocalMass(ts, sb);
@@ -80,7 +80,7 @@ namespace insur {
      * @param endcapservices A reference to the collection of endcap services
      * @return True, because the process is always considered successful
      */
-    bool MatCalcDummy::calculateEndcapServiceMaterials(std::vector<std::vector<ModuleCap> >& endcapcaps,
+    bool MatCalcDummy::calculateEndcapServiceMaterials(std::vector<ModuleCaps>& endcapcaps,
                             std::vector<InactiveElement>& barrelservices, std::vector<InactiveElement>& endcapservices) {
         for (unsigned int i = 0; i < endcapservices.size(); i++) {
             endcapservices.at(i).addLocalMass(ts, se);
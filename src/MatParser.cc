@@ -40,39 +40,36 @@ namespace insur {
         bfs::path mpath(materialfile);
         if (bfs::exists(mpath)) {
             try {
-                std::string line, word;
-                std::ifstream infilestream;
-                infilestream.open(materialfile.c_str());
+                // the file is read in one block and scanned in place, the table being sized for a material per line
+                std::string content;
+                if (!readText(materialfile, content)) {
+                    logERROR(msg_no_mat_file);
+                    return false;
+                }
+                mattab.reserve(std::count(content.begin(), content.end(), '\n') + 1);
+                TextPiece text{ content.data(), content.data() + content.size() }, line, word;
                 // material file line loop
-                while (std::getline(infilestream, line)) {
-                    // cosmetics and word extraction preparations
-                    balgo::trim(line);
-                    std::istringstream wordstream(line);
-                    std::vector<std::string> tmp;
-                    MaterialRow row;
-                    // word loop
-                    while (wordstream >> word) {
-                        // save everything that is not a comment word for word in a temporary vector
-                        if ((word.compare(0, c_comment.size(), c_comment) == 0) || (word.compare(0, shell_comment.size(), shell_comment) == 0)) break;
-                        else tmp.push_back(word);
-                    }
-                    if (tmp.empty()) continue;
-                    else {
-                        // fill up necessary data with dummy values if there is too little information or complain if there is too much
-                        if (tmp.size() < 4) {
-                            while (tmp.size() < 4) tmp.push_back(dummy_value);
-                        }
-                        if (tmp.size() > 4) std::cerr << warning_too_many_values << std::endl;
-                        // convert the information in the temporary vector to fill the fields in the material row
-                        row.tag = tmp.at(0);
-                        row.density = atof(tmp.at(1).c_str());
-                        row.rlength = atof(tmp.at(2).c_str());
-                        row.ilength = atof(tmp.at(3).c_str());
-                        // add the completed struct to the internal material table
-                        mattab.addMaterial(row);
+                while (nextLine(text, line)) {
+                    TextPiece words[4];
+                    int count = 0;
+                    bool tooMany = false;
+                    // word loop: everything up to a comment
+                    while (nextWord(line, word)) {
+                        if (word.startsWith(c_comment) || word.startsWith(shell_comment)) break;
+                        if (count < 4) words[count++] = word;
+                        else tooMany = true;
                     }
+                    if (count == 0) continue;
+                    // fill up necessary data with dummy values if there is too little information or complain if there is too much
+                    if (tooMany) std::cerr << warning_too_many_values << std::endl;
+                    MaterialRow row;
+                    row.tag = words[0].str();
+                    row.density = count > 1 ? wordToDouble(words[1]) : atof(dummy_value.c_str());
+                    row.rlength = count > 2 ? wordToDouble(words[2]) : atof(dummy_value.c_str());
+                    row.ilength = count > 3 ? wordToDouble(words[3]) : atof(dummy_value.c_str());
+                    // add the completed struct to the internal material table
+                    mattab.addMaterial(row);
                 }
-                infilestream.close();
             }
             catch (bfs::filesystem_error& bfe) {
 	        std::cerr << bfe.what() << std::endl;
@@ -100,14 +97,14 @@ namespace insur {
         if (bfs::exists(mpath)) {
             try {
     	        std::string line, word, type, comp;
-                std::ifstream infilestream;
-                infilestream.open(configfile.c_str());
+                std::string content;
+                readText(configfile, content); // prefetched at startup (see Squid::prefetchInputs())
+                std::istringstream infilestream(content);
                 // material file line loop
                 while (std::getline(infilestream, line)) {
                     // cosmetics and word extraction preparations
                     balgo::trim(line);
-                    std::istringstream wordstream(line);
-                    wordstream >> word;
+                    word.assign(line, 0, line.find_first_of(" \t\n\v\f\r"));
                     // skip comments
                     if ((word.compare(0, c_comment.size(), c_comment) == 0)
                             || (word.compare(0, shell_comment.size(), shell_comment) == 0)) continue;
@@ -188,7 +185,6 @@ namespace insur {
                     }
                     word.clear();
                 }
-                infilestream.close();
                 return true;
             }
             catch (bfs::filesystem_error& bfe) {
@@ -235,7 +231,7 @@ namespace insur {
      * @param segs A reference to the output string for the parsed number of segments
      * @return True if there were no errors during parsing, false otherwise
      */
-    bool MatParser::parseStripsSegs(std::ifstream& instream, std::string& strips, std::string& segs) {
+    bool MatParser::parseStripsSegs(std::istream& instream, std::string& strips, std::string& segs) {
         bool strips_done = false, segs_done = false;
         std::string line;
         // type block line loop
@@ -269,17 +265,17 @@ namespace insur {
      * @param calc The material calculator where the extracted information is transferred
      * @return True if there were no errors during parsing, false otherwise
      */
-  bool MatParser::parseMLine(std::string line, std::string type, MatCalc& calc, std::string comp) {
+  bool MatParser::parseMLine(const std::string& line, const std::string& type, MatCalc& calc, const std::string& comp) {
         if (type.empty()) return false;
         // set starting and end points of information on line
         size_t start = line.find(m_line_delim) + m_line_delim.size();
         size_t stop = line.find(line_end_delim);
         if ((start >= line.size()) || (stop == std::string::npos)) return false;
         // clip line to information section and remove whitespace at beginning and end
-        line = line.substr(start, stop - start);
-        balgo::trim(line);
+        std::string info = line.substr(start, stop - start);
+        balgo::trim(info);
         // preparations for word extraction
-        std::stringstream wordstream(line);
+        std::stringstream wordstream(info);
         std::string tag, tmp;
         if (!(wordstream >> tag)) return false;
 	//tag+=component_separator+comp;
@@ -345,16 +341,16 @@ namespace insur {
      * @param calc The material calculator where the extracted information is transferred
      * @return True if there were no errors during parsing, false otherwise
      */
-    bool MatParser::parseDLine(std::string line, MatCalc& calc) {
+    bool MatParser::parseDLine(const std::string& line, MatCalc& calc) {
         // set starting and end points of information on line
         size_t start = line.find(d_line_delim) +d_line_delim.size();
         size_t stop = line.find(line_end_delim);
         if ((start >= line.size()) || (stop == std::string::npos)) return false;
         // clip line to information section and remove whitespace at beginning and end
-        line = line.substr(start, stop - start);
-        balgo::trim(line);
+        std::string info = line.substr(start, stop - start);
+        balgo::trim(info);
         // preparations for word extraction
-        std::stringstream wordstream(line);
+        std::stringstream wordstream(info);
         std::string inTag, outTag, tmp;
         double in, out;
         MatCalc::Matunit uIn, uOut;
@@ -401,16 +397,16 @@ namespace insur {
      * @param marker A string identifying the material category
      * @return True if there were no errors during parsing, false otherwise
      */
-    bool MatParser::parseSimpleLine(std::string line, MatCalc& calc, std::string marker) {
+    bool MatParser::parseSimpleLine(const std::string& line, MatCalc& calc, const std::string& marker) {
         // set starting and end points of information on line
         size_t start = line.find(marker) + marker.size();
         size_t stop = line.find(line_end_delim);
         if ((start >= line.size()) || (stop == std::string::npos)) return false;
         // clip line to information section and remove whitespace at beginning and end
-        line = line.substr(start, stop - start);
-        balgo::trim(line);
+        std::string info = line.substr(start, stop - start);
+        balgo::trim(info);
         // preparations for word extraction
-        std::stringstream wordstream(line);
+        std::stringstream wordstream(info);
         std::string tag, tmp;
         // material and unit retrieval: if no unit, assume grams
         if (!(wordstream >> tag)) return false;
@@ -450,10 +446,10 @@ namespace insur {
      * @param paramname The parameter identifier that the requested value belongs to
      * @return The requested value in string form
      */
-    std::string MatParser::readFromLine(std::string source, std::string paramname) {
-        std::string value, tmp;
-        std::istringstream wordstream(source);
-        if ((wordstream >> tmp) && (tmp.compare(paramname) == 0)) {
+    std::string MatParser::readFromLine(const std::string& source, const std::string& paramname) {
+        std::string value;
+        size_t start = source.find_first_not_of(" \t\n\v\f\r");
+        if (start != std::string::npos && source.compare(start, source.find_first_of(" \t\n\v\f\r", start) - start, paramname) == 0) {
             value = getValue(source);
         }
         return value;
@@ -467,18 +463,21 @@ namespace insur {
      * @param delimiter The marker denoting the beginning of the substring that is to be extracted
      * @return The substring containing the requested value
      */
-    std::string MatParser::getValue(std::string source, bool final_delim, std::string delimiter) {
-        std::string value;
+    std::string MatParser::getValue(const std::string& source, bool final_delim, const std::string& delimiter) {
         size_t start = source.find(delimiter) + delimiter.size();
-        if (start < source.size()) {
-            if (final_delim) {
-                size_t stop = source.find(line_end_delim);
-                if (stop != std::string::npos) value = source.substr(start, stop - start);
-            }
-            else value = source.substr(start);
+        size_t stop = source.size();
+        if (start >= stop) return "";
+        if (final_delim) {
+            stop = source.find(line_end_delim);
+            if (stop == std::string::npos) return "";
+            if (stop < start) stop = source.size();
         }
-        balgo::trim(value);
-        return value;
+        // only the trimmed value is copied
+        const char* blanks = " \t\n\v\f\r";
+        size_t first = source.find_first_not_of(blanks, start);
+        if (first == std::string::npos || first >= stop) return "";
+        size_t last = source.find_last_not_of(blanks, stop - 1);
+        return source.substr(first, last + 1 - first);
     }
     
     /**
@@ -487,7 +486,7 @@ namespace insur {
      * @param source The string that needs to be converted
      * @return The unit described by the input string
      */
-    MatCalc::Matunit MatParser::getUnit(std::string source) { // throws exception
+    MatCalc::Matunit MatParser::getUnit(const std::string& source) { // throws exception
         if (source.compare(gr_unit) == 0) return MatCalc::gr;
         else if(source.compare(mm_unit) == 0) return MatCalc::mm;
         else if(source.compare(mm3_unit) == 0) return MatCalc::mm3;
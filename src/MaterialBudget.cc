@@ -14,11 +14,11 @@ namespace insur {
     inactive = &is;
 
     class CapsVisitor : public GeometryVisitor {
-      typedef std::vector<std::vector<ModuleCap>> Caps;
+      typedef std::vector<ModuleCaps> Caps;
       Caps &capsbarrelmods_, &capsendmods_;
     public:
       CapsVisitor(Caps& capsbarrelmods, Caps& capsendmods) : capsbarrelmods_(capsbarrelmods), capsendmods_(capsendmods) {}
-      void visit(Layer&) { capsbarrelmods_.push_back(std::vector<ModuleCap>()); }
+      void visit(Layer&) { capsbarrelmods_.push_back(ModuleCaps()); }
       void visit(BarrelModule& m) {
 		/*
         ModuleCap* cap = new ModuleCap(m);
@@ -26,9 +26,9 @@ namespace insur {
         capsbarrelmods_.back().push_back(*cap);
 	m.setModuleCap(& (capsbarrelmods_.back().back()));
 		*/
-        capsbarrelmods_.back().push_back(*m.getModuleCap());
+        capsbarrelmods_.back().push_back(m.getModuleCap());
       }
-      void visit(Disk&) { capsendmods_.push_back(std::vector<ModuleCap>()); }
+      void visit(Disk&) { capsendmods_.push_back(ModuleCaps()); }
       void visit(EndcapModule& m) {
 		/*
         ModuleCap* cap = new ModuleCap(m);
@@ -36,7 +36,7 @@ namespace insur {
         capsendmods_.back().push_back(*cap);
         m.setModuleCap(& (capsendmods_.back().back()));
 		*/
-        capsendmods_.back().push_back(*m.getModuleCap());
+        capsendmods_.back().push_back(m.getModuleCap());
       }
     };
 
@@ -65,13 +65,13 @@ namespace insur {
      * Get the collection of barrel module caps.
      * @return A reference to the vector of vectors listing the module caps that are associated with the barrel modules
      */
-    std::vector<std::vector<ModuleCap> >& MaterialBudget::getBarrelModuleCaps() { return capsbarrelmods; }
+    std::vector<ModuleCaps>& MaterialBudget::getBarrelModuleCaps() { return capsbarrelmods; }
     
     /**
      * Get the collection of endcap module caps.
      * @return A reference to the vector of vectors listing the module caps that are associated with the endcap modules
      */
-    std::vector<std::vector<ModuleCap> >& MaterialBudget::getEndcapModuleCaps() { return capsendmods; }
+    std::vector<ModuleCaps>& MaterialBudget::getEndcapModuleCaps() { return capsendmods; }
     
     /**
      * This is the general function that calls all other functions related to material assignment in sequence.
@@ -364,7 +364,7 @@ namespace insur {
      * @param layer The layer within that the query applies to
      * @return The index of the sample module within the vector of module caps of the given layer
      */
-    int MaterialBudget::onBoundary(std::vector<std::vector<ModuleCap> >& source, int layer) { //throws exception
+    int MaterialBudget::onBoundary(std::vector<ModuleCaps>& source, int layer) { //throws exception
         int ring = 0, index = 0;
         if ((layer >= 0) && (layer < (int)source.size())) {
             for (unsigned int mod = 0; mod < source.at(layer).size(); mod++) {
@@ -0,0 +1,240 @@
+/**
+ * @file MaterialMapTree.cpp
+ * @brief This is the implementation of the adaptive (z, r) map the material tracks accumulate their crossings into
+ */
+
+#include <MaterialMapTree.h>
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <vector>
+#include <global_funcs.h>
+
+namespace insur {
+
+  namespace {
+    // the codes have to be exact once written as doubles: 2*26 bits
+    const int maxDepth = 26;
+
+    uint64_t spread(uint32_t v) {
+      uint64_t x = v;
+      x = (x | x << 16) & 0x0000FFFF0000FFFFULL;
+      x = (x | x << 8) & 0x00FF00FF00FF00FFULL;
+      x = (x | x << 4) & 0x0F0F0F0F0F0F0F0FULL;
+      x = (x | x << 2) & 0x3333333333333333ULL;
+      x = (x | x << 1) & 0x5555555555555555ULL;
+      return x;
+    }
+
+    /**
+     * The bins of an axis of fixed bins whose centers are within [low, high), clamped to the bins of the axis
+     * @return False if there is no such bin
+     */
+    bool coveredBins(const TAxis& axis, double low, double high, int& first, int& last) {
+      double width = axis.GetBinWidth(1);
+      first = MAX(1, int(ceil((low - axis.GetXmin()) / width + 0.5)));
+      last = MIN(axis.GetNbins(), int(ceil((high - axis.GetXmin()) / width + 0.5)) - 1);
+      return first <= last;
+    }
+  }
+
+  uint64_t MaterialMapTree::interleave(uint32_t x, uint32_t y) {
+    return spread(x) | spread(y) << 1;
+  }
+
+  /**
+   * The index given by the even bits of a Morton code: the x index of the code, or the y one of the code shifted by one
+   */
+  uint32_t MaterialMapTree::deinterleave(uint64_t code) {
+    uint64_t x = code & 0x5555555555555555ULL;
+    x = (x | x >> 1) & 0x3333333333333333ULL;
+    x = (x | x >> 2) & 0x0F0F0F0F0F0F0F0FULL;
+    x = (x | x >> 4) & 0x00FF00FF00FF00FFULL;
+    x = (x | x >> 8) & 0x0000FFFF0000FFFFULL;
+    x = (x | x >> 16) & 0x00000000FFFFFFFFULL;
+    return uint32_t(x);
+  }
+
+  /**
+   * Empty the map, and set its region and its finest cells
+   * @param size The side of the region, which starts from 0 in both directions
+   * @param cellSize The largest size of the finest cells: the region is halved as many times as it takes
+   * @param maxCells The number of cells over which the cells are replaced by their parents
+   * @param tolerance The largest relative difference of the averages of four cells merged when the map is flattened
+   */
+  void MaterialMapTree::reset(double size, double cellSize, size_t maxCells, double tolerance) {
+    cells_.clear();
+    size_ = size;
+    depth_ = size > cellSize && cellSize > 0 ? MIN(maxDepth, int(ceil(log2(size / cellSize)))) : 0;
+    maxCells_ = MAX(size_t(1), maxCells);
+    tolerance_ = tolerance;
+  }
+
+  /**
+   * Add a value to the finest cell of a point; the points out of the region are left out
+   */
+  void MaterialMapTree::fill(double x, double y, double w) {
+    if (!(x >= 0 && x < size_ && y >= 0 && y < size_)) return;
+    uint32_t cells = uint32_t(1) << depth_;
+    uint32_t ix = MIN(cells - 1, uint32_t(x / size_ * cells));
+    uint32_t iy = MIN(cells - 1, uint32_t(y / size_ * cells));
+    Cell& cell = cells_[interleave(ix, iy)];
+    cell.sum += w;
+    cell.count += 1;
+    if (cells_.size() > maxCells_) bound();
+  }
+
+  /**
+   * Replace the cells by their ancestors at a coarser level
+   */
+  void MaterialMapTree::coarsen(int depth) {
+    if (depth >= depth_) return;
+    int shift = 2 * (depth_ - depth);
+    std::unordered_map<uint64_t, Cell> coarser;
+    for (const auto& cell : cells_) {
+      Cell& parent = coarser[cell.first >> shift];
+      parent.sum += cell.second.sum;
+      parent.count += cell.second.count;
+    }
+    cells_.swap(coarser);
+    depth_ = depth;
+  }
+
+  /**
+   * Coarsen the cells, a level at a time, until there are no more of them than the bound
+   */
+  void MaterialMapTree::bound() {
+    while (cells_.size() > maxCells_ && depth_ > 0) coarsen(depth_ - 1);
+  }
+
+  /**
+   * Add the values of another part of the tracks, at the coarser of the levels of the two maps
+   * @param part The map of the part
+   * @return True if the part covers the same region
+   */
+  bool MaterialMapTree::merge(const MaterialMapTree& part) {
+    if (part.size_ != size_) return false;
+    coarsen(part.depth_);
+    int shift = 2 * (part.depth_ - depth_);
+    for (const auto& cell : part.cells_) {
+      Cell& merged = cells_[cell.first >> shift];
+      merged.sum += cell.second.sum;
+      merged.count += cell.second.count;
+    }
+    bound();
+    return true;
+  }
+
+  /**
+   * Add the values of another part of the tracks, written by <i>write()</i>
+   * @param part The vector the part was written as
+   * @return True if the part covers the same region and is not corrupted
+   */
+  bool MaterialMapTree::merge(const TVectorD& part) {
+    if (part.GetNrows() < 3) return false;
+    MaterialMapTree partMap;
+    partMap.size_ = part[0];
+    partMap.depth_ = int(part[1]);
+    double numCells = part[2];
+    if (partMap.depth_ != part[1] || partMap.depth_ < 0 || partMap.depth_ > maxDepth || part.GetNrows() != 3 + 3 * numCells) return false;
+    for (int i = 3; i < part.GetNrows(); i += 3) {
+      Cell& cell = partMap.cells_[uint64_t(part[i])];
+      cell.sum += part[i + 1];
+      cell.count += part[i + 2];
+    }
+    return merge(partMap);
+  }
+
+  /**
+   * Write the map to a directory, as a vector of the side of the region, the level of the finest cells, the number of
+   * cells, then the code, the sum and the number of values of each cell, in the order of the codes
+   * @param dir The directory, where any object with the same name is overwritten
+   * @param name The name of the map
+   */
+  void MaterialMapTree::write(TDirectory& dir, const std::string& name) const {
+    std::vector<std::pair<uint64_t, Cell> > cells(cells_.begin(), cells_.end());
+    std::sort(cells.begin(), cells.end(), [](const std::pair<uint64_t, Cell>& a, const std::pair<uint64_t, Cell>& b) { return a.first < b.first; });
+    TVectorD vector(3 + 3 * cells.size());
+    vector[0] = size_;
+    vector[1] = depth_;
+    vector[2] = cells.size();
+    for (size_t i = 0; i < cells.size(); i++) {
+      vector[3 + 3 * i] = cells[i].first;
+      vector[4 + 3 * i] = cells[i].second.sum;
+      vector[5 + 3 * i] = cells[i].second.count;
+    }
+    dir.WriteTObject(&vector, name.c_str(), "Overwrite");
+  }
+
+  /**
+   * Set the bins of a histogram of fixed bins to the averages of the map, the cells being merged where they agree.
+   * The bins no cell reaches are left as they are.
+   * @param map The histogram, whose axes are in the units of the region
+   */
+  void MaterialMapTree::flatten(TH2D& map) const {
+    struct Node { double sum, count; bool uniform; };
+    struct Leaf { uint64_t code; int level; double sum, count; };
+    std::vector<Leaf> leaves;
+    std::map<uint64_t, Node> nodes;
+    for (const auto& cell : cells_) nodes[cell.first] = Node{ cell.second.sum, cell.second.count, true };
+    for (int level = depth_; level > 0; level--) {
+      std::map<uint64_t, Node> parents;
+      for (auto it = nodes.begin(); it != nodes.end(); ) {
+        // the children of a cell have consecutive codes
+        uint64_t parent = it->first >> 2;
+        auto first = it;
+        int children = 0;
+        double sum = 0, count = 0;
+        bool uniform = true;
+        for (; it != nodes.end() && (it->first >> 2) == parent; ++it) {
+          children++;
+          sum += it->second.sum;
+          count += it->second.count;
+          uniform = uniform && it->second.uniform;
+        }
+        // an empty child is an edge of the material: its siblings are kept
+        uniform = uniform && children == 4;
+        for (auto child = first; child != it && uniform; ++child) {
+          uniform = fabs(child->second.sum / child->second.count - sum / count) <= tolerance_ * fabs(sum / count);
+        }
+        if (!uniform) {
+          for (auto child = first; child != it; ++child) {
+            if (child->second.uniform) leaves.push_back(Leaf{ child->first, level, child->second.sum, child->second.count });
+          }
+        }
+        parents[parent] = uniform ? Node{ sum, count, true } : Node{ 0, 0, false };
+      }
+      nodes.swap(parents);
+    }
+    for (const auto& node : nodes) {
+      if (node.second.uniform) leaves.push_back(Leaf{ node.first, 0, node.second.sum, node.second.count });
+    }
+
+    // the cells share their values among the bins whose centers they hold, or give them to the bin of their center
+    const TAxis& xAxis = *map.GetXaxis();
+    const TAxis& yAxis = *map.GetYaxis();
+    int binsX = xAxis.GetNbins(), binsY = yAxis.GetNbins();
+    std::vector<double> sums(binsX * binsY, 0.), counts(binsX * binsY, 0.);
+    for (const Leaf& leaf : leaves) {
+      double width = size_ / double(uint64_t(1) << leaf.level);
+      double x = deinterleave(leaf.code) * width, y = deinterleave(leaf.code >> 1) * width;
+      int firstX, lastX, firstY, lastY;
+      if (!coveredBins(xAxis, x, x + width, firstX, lastX)) firstX = lastX = xAxis.FindFixBin(x + width / 2);
+      if (!coveredBins(yAxis, y, y + width, firstY, lastY)) firstY = lastY = yAxis.FindFixBin(y + width / 2);
+      if (firstX < 1 || lastX > binsX || firstY < 1 || lastY > binsY) continue;
+      double bins = (lastX - firstX + 1) * (lastY - firstY + 1);
+      for (int ix = firstX; ix <= lastX; ix++) {
+        for (int iy = firstY; iy <= lastY; iy++) {
+          sums[(ix - 1) + (iy - 1) * binsX] += leaf.sum / bins;
+          counts[(ix - 1) + (iy - 1) * binsX] += leaf.count / bins;
+        }
+      }
+    }
+    for (int ix = 1; ix <= binsX; ix++) {
+      for (int iy = 1; iy <= binsY; iy++) {
+        double count = counts[(ix - 1) + (iy - 1) * binsX];
+        if (count > 0) map.SetBinContent(ix, iy, sums[(ix - 1) + (iy - 1) * binsX] / count);
+      }
+    }
+  }
+}
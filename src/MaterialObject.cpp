@@ -10,11 +10,13 @@
 #include "ConversionStation.h"
 #include "global_constants.h"
 #include "MaterialTab.h"
+#include "MaterialKeys.h"
 //#include "InactiveElement.h"
 #include "MaterialProperties.h"
 #include "DetectorModule.h"
 #include "messageLogger.h"
 #include <stdexcept>
+#include <mutex>
 
 
 namespace material {
@@ -82,12 +84,14 @@ namespace material {
       
 
       static std::map<MaterialObjectKey, Materials*> materialsMap_; //for saving memory
+      static std::mutex materialsMapMutex_; // the materials of different subdetectors may be built at the same time
       for (auto& currentMaterialNode : materialsNode_) {
         store(currentMaterialNode.second);
 
         check();
         if (type_().compare(getTypeString()) == 0) {
           MaterialObjectKey myKey(currentMaterialNode.first, sensorChannels, destination_.state()? destination_() : std::string(""));
+          std::lock_guard<std::mutex> lock(materialsMapMutex_);
           if (materialsMap_.count(myKey) == 0) {
             Materials * newMaterials  = new Materials(materialType_);
             newMaterials->store(currentMaterialNode.second);
@@ -139,7 +143,11 @@ namespace material {
       if (currElement->debugInactivate() == false) {
         quantity = currElement->totalGrams(materialProperties);
 
-        if (currElement->componentName.state()) {
+        if (currElement->componentKey() != MaterialKeys::noKey) {
+          materialProperties.addLocalMass(currElement->materialKey(), currElement->componentKey(), quantity);
+        } else if (currElement->materialKey() != MaterialKeys::noKey) {
+          materialProperties.addLocalMass(currElement->materialKey(), quantity);
+        } else if (currElement->componentName.state()) {
           materialProperties.addLocalMass(currElement->elementName(), currElement->componentName(), quantity);
         } else {
           materialProperties.addLocalMass(currElement->elementName(), quantity);
@@ -317,6 +325,8 @@ namespace material {
     destination ("destination", parsedOnly()),
     targetVolume ("targetVolume", parsedOnly(), 0),
     materialTab_ (MaterialTab::instance()),
+    materialKey_ (MaterialKeys::noKey),
+    componentKey_ (MaterialKeys::noKey),
     materialType_(newMaterialType) {};
 
   MaterialObject::Element::Element(const Element& original, double multiplier) : Element(original.materialType_) {
@@ -330,6 +340,8 @@ namespace material {
     scaleOnSensor(0);
     unit(original.unit());
     debugInactivate(original.debugInactivate());
+    materialKey_ = original.materialKey_;
+    componentKey_ = original.componentKey_;
   }
   
   MaterialObject::Element::~Element() { }
@@ -505,6 +517,7 @@ namespace material {
 
   void MaterialObject::Element::build(const std::map<int, int>& newSensorChannels) {
     check();
+    resolveKeys();
     // if(destination.state())
     //   std::cout << "DESTINATION " << destination() << " for " << elementName() << std::endl;
     for (const auto& aSensorChannel : newSensorChannels ) {
@@ -543,11 +556,23 @@ namespace material {
     if(debugInactivate() == false) {
       if(service() == false) {
         quantity = totalGrams(materialProperties);
-        materialProperties.addLocalMass(elementName(), componentName(), quantity);
+        if (componentKey_ != MaterialKeys::noKey) {
+          materialProperties.addLocalMass(materialKey_, componentKey_, quantity);
+        } else {
+          materialProperties.addLocalMass(elementName(), componentName(), quantity);
+        }
       }
     }
   }
 
+  /**
+   * Sets the keys of the names of the element, so that the mass maps are filled without looking them up by name
+   */
+  void MaterialObject::Element::resolveKeys() {
+    materialKey_ = MaterialKeys::key(elementName());
+    componentKey_ = componentName.state() ? MaterialKeys::key(componentName()) : MaterialKeys::noKey;
+  }
+
   void MaterialObject::Element::getLocalElements(ElementsVector& elementsList) const {
     if(service() == false) {
       elementsList.push_back(this);
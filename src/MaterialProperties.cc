@@ -5,6 +5,7 @@
 
 #include <MaterialProperties.h>
 #include<MaterialTab.h>
+#include <MaterialKeys.h>
 
 RILength& RILength::operator+=(const RILength &a) {
   interaction += a.interaction;
@@ -27,7 +28,7 @@ namespace insur {
      * set to false, the element category to none, i.e. unidentified, and the numeric values for the sums of masses
      * and the radiation and interaction lengths to -1 to indicate that they are all uninitialised.
      */
-    MaterialProperties::MaterialProperties() {
+    MaterialProperties::MaterialProperties() : masses_(std::make_shared<Masses>()) {
         msl_set = false;
         mse_set = false;
         trck = true;
@@ -68,9 +69,9 @@ namespace insur {
      * @param tag The name of the material
      * @return The mass of the requested material
      */
-    double MaterialProperties::getLocalMass(std::string tag) { // throws exception
-        if (!localmasses.count(tag)) throw std::runtime_error("MaterialProperties::getLocalMass(std::string): " + err_local_mass + ": " + tag);
-        return localmasses.at(tag);
+    double MaterialProperties::getLocalMass(const std::string& tag) { // throws exception
+        if (!masses_->localmasses.count(tag)) throw std::runtime_error("MaterialProperties::getLocalMass(std::string): " + err_local_mass + ": " + tag);
+        return masses_->localmasses.at(tag);
     }
 
     /**
@@ -79,9 +80,9 @@ namespace insur {
      * @param tag The name of the component
      * @return The mass of the requested component
      */
-    double MaterialProperties::getLocalMassComp(std::string comp) { // throws exception
-        if (!localmassesComp.count(comp)) throw std::runtime_error("MaterialProperties::getLocalMass(std::string): " + err_local_mass + ": " + comp);
-        return localmassesComp.at(comp);
+    double MaterialProperties::getLocalMassComp(const std::string& comp) { // throws exception
+        if (!masses_->localmassesComp.count(comp)) throw std::runtime_error("MaterialProperties::getLocalMass(std::string): " + err_local_mass + ": " + comp);
+        return masses_->localmassesComp.at(comp);
     }
     
     
@@ -91,15 +92,15 @@ namespace insur {
      * @param tag The name of the material
      * @return The mass of the requested material
      */
-    double MaterialProperties::getExitingMass(std::string tag) { // throws exception
-        if (!exitingmasses.count(tag)) throw std::runtime_error("MaterialProperties::getExitingMass(std::string): " + err_exiting_mass + ": " + tag);
-        return exitingmasses.at(tag);
+    double MaterialProperties::getExitingMass(const std::string& tag) { // throws exception
+        if (!masses_->exitingmasses.count(tag)) throw std::runtime_error("MaterialProperties::getExitingMass(std::string): " + err_exiting_mass + ": " + tag);
+        return masses_->exitingmasses.at(tag);
     }
     
-    const std::map<std::string, double>& MaterialProperties::getLocalMasses() const { return localmasses; }
-    const std::map<std::string, double>& MaterialProperties::getExitingMasses() const { return exitingmasses; }
-    const std::map<std::string, double>& MaterialProperties::getLocalMassesComp() const { return localmassesComp; }
-    const std::map<std::string, double>& MaterialProperties::getExitingMassesComp() const { return exitingmassesComp; }
+    const std::map<std::string, double>& MaterialProperties::getLocalMasses() const { return masses_->localmasses; }
+    const std::map<std::string, double>& MaterialProperties::getExitingMasses() const { return masses_->exitingmasses; }
+    const std::map<std::string, double>& MaterialProperties::getLocalMassesComp() const { return masses_->localmassesComp; }
+    const std::map<std::string, double>& MaterialProperties::getExitingMassesComp() const { return masses_->exitingmassesComp; }
 
     /**
      * Get the exiting mass of one of the components, as identified by its name, that make up the element.
@@ -107,9 +108,9 @@ namespace insur {
      * @param tag The name of the component
      * @return The mass of the requested component
      */
-    double MaterialProperties::getExitingMassComp(std::string comp) { // throws exception
-        if (!exitingmassesComp.count(comp)) throw std::runtime_error("MaterialProperties::getExitingMass(std::string): " + err_exiting_mass + ": " + comp);
-        return exitingmassesComp.at(comp);
+    double MaterialProperties::getExitingMassComp(const std::string& comp) { // throws exception
+        if (!masses_->exitingmassesComp.count(comp)) throw std::runtime_error("MaterialProperties::getExitingMass(std::string): " + err_exiting_mass + ": " + comp);
+        return masses_->exitingmassesComp.at(comp);
     }
     
     
@@ -120,9 +121,10 @@ namespace insur {
      * @param tag The name of the material
      * @param ms The mass value
      */
-  void MaterialProperties::addLocalMass(std::string tag, double ms) {
+  void MaterialProperties::addLocalMass(const std::string& tag, double ms) {
+        Masses& masses = mutableMasses();
         msl_set = true;
-        localmasses[tag] += ms;
+        masses.localmasses[tag] += ms;
     }
 
     /**
@@ -134,11 +136,46 @@ namespace insur {
      * @param comp The name of the component
      * @param ms The mass value
      */
-  void MaterialProperties::addLocalMass(std::string tag, std::string comp, double ms, int minZ) {
+  void MaterialProperties::addLocalMass(const std::string& tag, const std::string& comp, double ms, int minZ) {
+        Masses& masses = mutableMasses();
         msl_set = true;
-        localmasses[tag] += ms;
-        localmassesComp[getSubName(comp)] += ms;
-        localCompMats[comp][tag] += ms; 
+        masses.localmasses[tag] += ms;
+        masses.localmassesComp[getSubName(comp)] += ms;
+        masses.localCompMats[comp][tag] += ms; 
+    }
+
+    /**
+     * Add the local mass for a material, as specified by its key in the <i>MaterialKeys</i>, to the internal list.
+     * The entry is the same as with the name of the material, but the map is only searched the first time the key is used.
+     * @param materialKey The key of the name of the material
+     * @param ms The mass value
+     */
+  void MaterialProperties::addLocalMass(int materialKey, double ms) {
+        Masses& masses = mutableMasses();
+        msl_set = true;
+        double* mass = localMassSlots.find(materialKey);
+        if (!mass) mass = localMassSlots.add(materialKey, &masses.localmasses[material::MaterialKeys::name(materialKey)]);
+        *mass += ms;
+    }
+
+    /**
+     * Add the local mass for a material, as specified by its key in the <i>MaterialKeys</i>, to the internal list.
+     * Also keeps track of the originating component, as specified by its key
+     * The entries are the same as with the names, but the maps are only searched the first time the keys are used.
+     * @param materialKey The key of the name of the material
+     * @param componentKey The key of the name of the component
+     * @param ms The mass value
+     */
+  void MaterialProperties::addLocalMass(int materialKey, int componentKey, double ms) {
+        Masses& masses = mutableMasses();
+        addLocalMass(materialKey, ms);
+        double* mass = localMassCompSlots.find(componentKey);
+        if (!mass) mass = localMassCompSlots.add(componentKey, &masses.localmassesComp[material::MaterialKeys::subName(componentKey)]);
+        *mass += ms;
+        long compMatKey = ((long)componentKey << 32) | materialKey;
+        mass = localCompMatSlots.find(compMatKey);
+        if (!mass) mass = localCompMatSlots.add(compMatKey, &masses.localCompMats[material::MaterialKeys::name(componentKey)][material::MaterialKeys::name(materialKey)]);
+        *mass += ms;
     }
     
     
@@ -149,9 +186,10 @@ namespace insur {
      * @param tag The name of the material
      * @param ms The mass value
      */
-  void MaterialProperties::addExitingMass(std::string tag, double ms) {
+  void MaterialProperties::addExitingMass(const std::string& tag, double ms) {
+        Masses& masses = mutableMasses();
         mse_set = true;
-        exitingmasses[tag] += ms;
+        masses.exitingmasses[tag] += ms;
     }
 
     /**
@@ -163,52 +201,51 @@ namespace insur {
      * @param comp The name of the component
      * @param ms The mass value
      */
-  void MaterialProperties::addExitingMass(std::string tag, std::string comp, double ms) {
+  void MaterialProperties::addExitingMass(const std::string& tag, const std::string& comp, double ms) {
+        Masses& masses = mutableMasses();
     //    std::pair<std::string, double> p(tag, ms);
      //   addExitingMass(p);
         mse_set = true;
-        exitingmasses[tag] += ms;
+        masses.exitingmasses[tag] += ms;
      //   std::pair<std::string, double> pc(getSubName(comp), ms);
      //   addExitingMassComp(pc);
-        exitingmassesComp[getSubName(comp)] += ms;
+        masses.exitingmassesComp[getSubName(comp)] += ms;
 
-        exitingCompMats[comp][tag] += ms; 
+        masses.exitingCompMats[comp][tag] += ms; 
     }
     
     /**
      * Get the number of registered local masses for the materials found in the inactive element.
      * @return The size of the internal mass vector
      */
-    unsigned int MaterialProperties::localMassCount() { return localmasses.size(); }
+    unsigned int MaterialProperties::localMassCount() { return masses_->localmasses.size(); }
     
     /**
      * Get the number of registered exiting masses for the materials found in the inactive element.
      * @return The size of the internal mass vector
      */
-    unsigned int MaterialProperties::exitingMassCount() { return exitingmasses.size(); }
+    unsigned int MaterialProperties::exitingMassCount() { return masses_->exitingmasses.size(); }
 
     /**
      * Get the number of registered local masses for the components found in the inactive element.
      * @return The size of the internal mass vector
      */
-    unsigned int MaterialProperties::localMassCompCount() { return localmassesComp.size(); }
+    unsigned int MaterialProperties::localMassCompCount() { return masses_->localmassesComp.size(); }
     
     /**
      * Get the number of registered exiting masses for the components found in the inactive element.
      * @return The size of the internal mass vector
      */
-    unsigned int MaterialProperties::exitingMassCompCount() { return exitingmassesComp.size(); }
+    unsigned int MaterialProperties::exitingMassCompCount() { return masses_->exitingmassesComp.size(); }
     
     /**
      * Reset the state of the internal mass vector to empty, discarding all entries.
      */
     void MaterialProperties::clearMassVectors() {
-        localmasses.clear();
-        exitingmasses.clear();
-        localmassesComp.clear();
-        exitingmassesComp.clear();
-        localCompMats.clear();
-        exitingCompMats.clear();
+        masses_ = std::make_shared<Masses>();
+        localMassSlots.clear();
+        localMassCompSlots.clear();
+        localCompMatSlots.clear();
     }
     
     /**
@@ -221,15 +258,83 @@ namespace insur {
         //for (unsigned int i = 0; i < exitingMassCount(); i++) mp.addExitingMass(exitingmasses.at(i));
         //for (unsigned int i = 0; i < localMassCompCount(); i++) mp.addLocalMassComp(localmassesComp.at(i));
         //for (unsigned int i = 0; i < exitingMassCompCount(); i++) mp.addExitingMassComp(exitingmassesComp.at(i));
-        for (std::map<std::string, std::map<std::string, double> >::iterator compit = localCompMats.begin(); compit != localCompMats.end(); ++compit)
+        for (std::map<std::string, std::map<std::string, double> >::iterator compit = masses_->localCompMats.begin(); compit != masses_->localCompMats.end(); ++compit)
             for (std::map<std::string, double>::iterator matit = compit->second.begin(); matit != compit->second.end(); ++matit)
                 mp.addLocalMass(matit->first, compit->first, matit->second);
 
-        for (std::map<std::string, std::map<std::string, double> >::iterator compit = exitingCompMats.begin(); compit != exitingCompMats.end(); ++compit)
+        for (std::map<std::string, std::map<std::string, double> >::iterator compit = masses_->exitingCompMats.begin(); compit != masses_->exitingCompMats.end(); ++compit)
             for (std::map<std::string, double>::iterator matit = compit->second.begin(); matit != compit->second.end(); ++matit) 
                 mp.addExitingMass(matit->first, compit->first, matit->second);
     }
     
+    /**
+     * Copy the masses and the values calculated from them to another instance of <i>MaterialProperties</i> of the same
+     * surface, which then needs no calculation of its own. The masses themselves are shared until either object adds to them.
+     * @param mp The destination object
+     */
+    void MaterialProperties::copyMaterialValues(MaterialProperties& mp) const {
+        mp.clearMassVectors();
+        mp.msl_set = msl_set;
+        mp.mse_set = mse_set;
+        mp.masses_ = masses_;
+        mp.componentsRI = componentsRI;
+        mp.total_mass = total_mass;
+        mp.local_mass = local_mass;
+        mp.exiting_mass = exiting_mass;
+        mp.r_length = r_length;
+        mp.i_length = i_length;
+    }
+
+    /**
+     * Check whether another object holds the very same masses as this one, rather than an equal copy of them.
+     * @param mp The other object
+     * @return True if the two objects share their masses
+     */
+    bool MaterialProperties::sharesMasses(const MaterialProperties& mp) const { return masses_ == mp.masses_; }
+
+    /**
+     * Make the elements with equal masses share a single copy of them, as the modules of a ring usually can once
+     * their materials are assigned. The elements are otherwise unchanged, and any of them adding to its masses
+     * later gets its own copy back.
+     * @param elements The elements, in no particular order
+     * @return The number of copies of the masses that were released
+     */
+    unsigned int MaterialProperties::shareIdenticalMasses(const std::vector<MaterialProperties*>& elements) {
+        std::unordered_map<size_t, std::vector<MaterialProperties*> > candidates; // the distinct payloads, by hash
+        unsigned int released = 0;
+        for (MaterialProperties* element : elements) {
+            const Masses& masses = *element->masses_;
+            size_t hash = 0;
+            auto combine = [&hash](size_t value) { hash ^= value + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2); };
+            const std::map<std::string, std::map<std::string, double> >* compMats[] = { &masses.localCompMats, &masses.exitingCompMats };
+            for (const std::map<std::string, std::map<std::string, double> >* cm : compMats) {
+                combine(cm->size());
+                for (const auto& comp : *cm) {
+                    combine(std::hash<std::string>()(comp.first));
+                    for (const auto& mat : comp.second) {
+                        combine(std::hash<std::string>()(mat.first));
+                        combine(std::hash<double>()(mat.second));
+                    }
+                }
+            }
+            std::vector<MaterialProperties*>& sameHash = candidates[hash];
+            bool shared = false;
+            for (size_t i = 0; i < sameHash.size() && !shared; i++) {
+                if (sameHash[i]->masses_ == element->masses_) shared = true;
+                else if (*sameHash[i]->masses_ == masses) {
+                    element->masses_ = sameHash[i]->masses_;
+                    element->localMassSlots.clear();
+                    element->localMassCompSlots.clear();
+                    element->localCompMatSlots.clear();
+                    released++;
+                    shared = true;
+                }
+            }
+            if (!shared) sameHash.push_back(element);
+        }
+        return released;
+    }
+
     /**
      * Get the cumulative mass of the inactive element.
      * @return The overall mass, taking into account all registered materials; -1 if the value has not yet been computed
@@ -252,7 +357,7 @@ namespace insur {
      * Get the radiation length of the inactive element.
      * @return The overall radiation length, taking into account all registered materials; -1 if the value has not yet been computed
      */
-    double MaterialProperties::getRadiationLength() { return r_length; }
+    double MaterialProperties::getRadiationLength() const { return r_length; }
     
 
     const std::map<std::string, RILength>& MaterialProperties::getComponentsRI() const { return componentsRI; } // CUIDADO: I know it parts with the old API but it's so much more practical this way
@@ -261,7 +366,7 @@ namespace insur {
      * Get the intraction length of the inactive element.
      * @return The overall radiation length, taking into account all registered materials; -1 if the value has not yet been computed
      */
-    double MaterialProperties::getInteractionLength() { return i_length; }
+    double MaterialProperties::getInteractionLength() const { return i_length; }
 
     RILength MaterialProperties::getMaterialLengths() {
       RILength myMaterials;
@@ -292,7 +397,7 @@ namespace insur {
     void MaterialProperties::calculateLocalMass(double offset) {
         if (msl_set) {
             local_mass = offset;
-            for (std::map<std::string, double>::iterator it = localmasses.begin(); it != localmasses.end(); ++it) {
+            for (std::map<std::string, double>::iterator it = masses_->localmasses.begin(); it != masses_->localmasses.end(); ++it) {
                 local_mass += it->second;
             }
         }
@@ -307,7 +412,7 @@ namespace insur {
     void MaterialProperties::calculateExitingMass(double offset) {
         if (mse_set) {
             exiting_mass = offset;
-            for (std::map<std::string, double>::iterator it = exitingmasses.begin(); it != exitingmasses.end(); ++it) {
+            for (std::map<std::string, double>::iterator it = masses_->exitingmasses.begin(); it != masses_->exitingmasses.end(); ++it) {
                 exiting_mass += it->second;
             }
         }
@@ -323,23 +428,25 @@ namespace insur {
             r_length = offset;
             if (msl_set) {
                 // local mass loop
-                for (std::map<std::string, double>::iterator it = localmasses.begin(); it != localmasses.end(); ++it) {
+                for (std::map<std::string, double>::iterator it = masses_->localmasses.begin(); it != masses_->localmasses.end(); ++it) {
                     r_length += it->second / (materials.getMaterial(it->first).rlength * getSurface() / 100.0);
                 }
-                for (std::map<std::string, std::map<std::string, double> >::iterator cit = localCompMats.begin(); cit != localCompMats.end(); ++cit) {
+                for (std::map<std::string, std::map<std::string, double> >::iterator cit = masses_->localCompMats.begin(); cit != masses_->localCompMats.end(); ++cit) {
+                    RILength& componentRI = componentsRI[getSuperName(cit->first)];
                     for (std::map<std::string, double>::iterator mit = cit->second.begin(); mit != cit->second.end(); ++mit) {
-                        componentsRI[getSuperName(cit->first)].radiation += mit->second / (materials.getMaterial(mit->first).rlength * getSurface() / 100.0);
+                        componentRI.radiation += mit->second / (materials.getMaterial(mit->first).rlength * getSurface() / 100.0);
                     }
                 }
             }
             if (mse_set) {
                 // exiting mass loop
-                for (std::map<std::string, double>::iterator it = exitingmasses.begin(); it != exitingmasses.end(); ++it) {
+                for (std::map<std::string, double>::iterator it = masses_->exitingmasses.begin(); it != masses_->exitingmasses.end(); ++it) {
                     r_length += it->second / (materials.getMaterial(it->first).rlength * getSurface() / 100.0);
                 }
-                for (std::map<std::string, std::map<std::string, double> >::iterator cit = exitingCompMats.begin(); cit != exitingCompMats.end(); ++cit) {
+                for (std::map<std::string, std::map<std::string, double> >::iterator cit = masses_->exitingCompMats.begin(); cit != masses_->exitingCompMats.end(); ++cit) {
+                    RILength& componentRI = componentsRI[getSuperName(cit->first)];
                     for (std::map<std::string, double>::iterator mit = cit->second.begin(); mit != cit->second.end(); ++mit) {
-                        componentsRI[getSuperName(cit->first)].radiation += mit->second / (materials.getMaterial(mit->first).rlength * getSurface() / 100.0);
+                        componentRI.radiation += mit->second / (materials.getMaterial(mit->first).rlength * getSurface() / 100.0);
                     }
                 }
             }
@@ -357,25 +464,29 @@ namespace insur {
             i_length = offset;
             if (msl_set) {
                 // local mass loop
-                for (std::map<std::string, double>::iterator it = localmasses.begin(); it != localmasses.end(); ++it) {
+                for (std::map<std::string, double>::iterator it = masses_->localmasses.begin(); it != masses_->localmasses.end(); ++it) {
                     i_length += it->second / (materials.getMaterial(it->first).ilength * getSurface() / 100.0);
                 }
                     
-                for (std::map<std::string, std::map<std::string, double> >::iterator cit = localCompMats.begin(); cit != localCompMats.end(); ++cit) {
+                for (std::map<std::string, std::map<std::string, double> >::iterator cit = masses_->localCompMats.begin(); cit != masses_->localCompMats.end(); ++cit) {
+                    
+                    RILength& componentRI = componentsRI[getSuperName(cit->first)];
                     for (std::map<std::string, double>::iterator mit = cit->second.begin(); mit != cit->second.end(); ++mit) {
-                        componentsRI[getSuperName(cit->first)].interaction += mit->second / (materials.getMaterial(mit->first).ilength * getSurface() / 100.0);
+                        componentRI.interaction += mit->second / (materials.getMaterial(mit->first).ilength * getSurface() / 100.0);
                     }
                 }
             }
             if (mse_set) {
                 // exiting mass loop
-                for (std::map<std::string, double>::iterator it = exitingmasses.begin(); it != exitingmasses.end(); ++it) {
+                for (std::map<std::string, double>::iterator it = masses_->exitingmasses.begin(); it != masses_->exitingmasses.end(); ++it) {
                     i_length += it->second / (materials.getMaterial(it->first).ilength * getSurface() / 100.0);
                 }
 
-                for (std::map<std::string, std::map<std::string, double> >::iterator cit = exitingCompMats.begin(); cit != exitingCompMats.end(); ++cit) {
+                for (std::map<std::string, std::map<std::string, double> >::iterator cit = masses_->exitingCompMats.begin(); cit != masses_->exitingCompMats.end(); ++cit) {
+
+                    RILength& componentRI = componentsRI[getSuperName(cit->first)];
                     for (std::map<std::string, double>::iterator mit = cit->second.begin(); mit != cit->second.end(); ++mit) {
-                        componentsRI[getSuperName(cit->first)].interaction += mit->second / (materials.getMaterial(mit->first).ilength * getSurface() / 100.0);
+                        componentRI.interaction += mit->second / (materials.getMaterial(mit->first).ilength * getSurface() / 100.0);
                     }
                 }
             }
@@ -390,23 +501,25 @@ namespace insur {
             r_length = offset;
             if (msl_set) {
                 // local mass loop
-                for (std::map<std::string, double>::iterator it = localmasses.begin(); it != localmasses.end(); ++it) {
+                for (std::map<std::string, double>::iterator it = masses_->localmasses.begin(); it != masses_->localmasses.end(); ++it) {
                     r_length += it->second / (materialTab.radiationLength(it->first) * getSurface() / 100.0);
                 }
-                for (std::map<std::string, std::map<std::string, double> >::iterator cit = localCompMats.begin(); cit != localCompMats.end(); ++cit) {
+                for (std::map<std::string, std::map<std::string, double> >::iterator cit = masses_->localCompMats.begin(); cit != masses_->localCompMats.end(); ++cit) {
+                    RILength& componentRI = componentsRI[getSuperName(cit->first)];
                     for (std::map<std::string, double>::iterator mit = cit->second.begin(); mit != cit->second.end(); ++mit) {
-                        componentsRI[getSuperName(cit->first)].radiation += mit->second / (materialTab.radiationLength(mit->first) * getSurface() / 100.0);
+                        componentRI.radiation += mit->second / (materialTab.radiationLength(mit->first) * getSurface() / 100.0);
                     }
                 }
             }
             if (mse_set) {
                 // exiting mass loop
-                for (std::map<std::string, double>::iterator it = exitingmasses.begin(); it != exitingmasses.end(); ++it) {
+                for (std::map<std::string, double>::iterator it = masses_->exitingmasses.begin(); it != masses_->exitingmasses.end(); ++it) {
                     r_length += it->second / (materialTab.radiationLength(it->first) * getSurface() / 100.0);
                 }
-                for (std::map<std::string, std::map<std::string, double> >::iterator cit = exitingCompMats.begin(); cit != exitingCompMats.end(); ++cit) {
+                for (std::map<std::string, std::map<std::string, double> >::iterator cit = masses_->exitingCompMats.begin(); cit != masses_->exitingCompMats.end(); ++cit) {
+                    RILength& componentRI = componentsRI[getSuperName(cit->first)];
                     for (std::map<std::string, double>::iterator mit = cit->second.begin(); mit != cit->second.end(); ++mit) {
-                        componentsRI[getSuperName(cit->first)].radiation += mit->second / (materialTab.radiationLength(mit->first) * getSurface() / 100.0);
+                        componentRI.radiation += mit->second / (materialTab.radiationLength(mit->first) * getSurface() / 100.0);
                     }
                 }
             }
@@ -420,25 +533,29 @@ namespace insur {
             i_length = offset;
             if (msl_set) {
                 // local mass loop
-                for (std::map<std::string, double>::iterator it = localmasses.begin(); it != localmasses.end(); ++it) {
+                for (std::map<std::string, double>::iterator it = masses_->localmasses.begin(); it != masses_->localmasses.end(); ++it) {
                     i_length += it->second / (materialTab.interactionLength(it->first) * getSurface() / 100.0);
                 }
                     
-                for (std::map<std::string, std::map<std::string, double> >::iterator cit = localCompMats.begin(); cit != localCompMats.end(); ++cit) {
+                for (std::map<std::string, std::map<std::string, double> >::iterator cit = masses_->localCompMats.begin(); cit != masses_->localCompMats.end(); ++cit) {
+                    
+                    RILength& componentRI = componentsRI[getSuperName(cit->first)];
                     for (std::map<std::string, double>::iterator mit = cit->second.begin(); mit != cit->second.end(); ++mit) {
-                        componentsRI[getSuperName(cit->first)].interaction += mit->second / (materialTab.interactionLength(mit->first) * getSurface() / 100.0);
+                        componentRI.interaction += mit->second / (materialTab.interactionLength(mit->first) * getSurface() / 100.0);
                     }
                 }
             }
             if (mse_set) {
                 // exiting mass loop
-                for (std::map<std::string, double>::iterator it = exitingmasses.begin(); it != exitingmasses.end(); ++it) {
+                for (std::map<std::string, double>::iterator it = masses_->exitingmasses.begin(); it != masses_->exitingmasses.end(); ++it) {
                     i_length += it->second / (materialTab.interactionLength(it->first) * getSurface() / 100.0);
                 }
 
-                for (std::map<std::string, std::map<std::string, double> >::iterator cit = exitingCompMats.begin(); cit != exitingCompMats.end(); ++cit) {
+                for (std::map<std::string, std::map<std::string, double> >::iterator cit = masses_->exitingCompMats.begin(); cit != masses_->exitingCompMats.end(); ++cit) {
+
+                    RILength& componentRI = componentsRI[getSuperName(cit->first)];
                     for (std::map<std::string, double>::iterator mit = cit->second.begin(); mit != cit->second.end(); ++mit) {
-                        componentsRI[getSuperName(cit->first)].interaction += mit->second / (materialTab.interactionLength(mit->first) * getSurface() / 100.0);
+                        componentRI.interaction += mit->second / (materialTab.interactionLength(mit->first) * getSurface() / 100.0);
                     }
                 }
             }
@@ -463,13 +580,13 @@ namespace insur {
      */
     void MaterialProperties::print() {
         std::cout << "Material properties (current state)" << std::endl;
-        std::cout << "localmasses: vector with " << localmasses.size() << " elements." << std::endl;
+        std::cout << "localmasses: vector with " << masses_->localmasses.size() << " elements." << std::endl;
         int i = 0;
-        for (std::map<std::string, double>::const_iterator it = localmasses.begin(); it != localmasses.end(); ++it)
+        for (std::map<std::string, double>::const_iterator it = masses_->localmasses.begin(); it != masses_->localmasses.end(); ++it)
             std::cout << "Material " << i++ << " (material, mass): (" << it->first << ", " << it->second << ")" << std::endl;
         i = 0;
-        std::cout << "exitingmasses: vector with " << exitingmasses.size() << " elements." << std::endl;
-        for (std::map<std::string, double>::const_iterator it = exitingmasses.begin(); it != exitingmasses.end(); ++it)
+        std::cout << "exitingmasses: vector with " << masses_->exitingmasses.size() << " elements." << std::endl;
+        for (std::map<std::string, double>::const_iterator it = masses_->exitingmasses.begin(); it != masses_->exitingmasses.end(); ++it)
             std::cout << "Material " << i++ << " (material, mass): (" << it->first << ", " << it->second << ")" << std::endl;
 
         std::cout << "total_mass = " << total_mass << std::endl;
@@ -483,7 +600,28 @@ namespace insur {
 
     /*-----protected-----*/
 
-    std::string MaterialProperties::getSuperName(std::string name) const {
+    /**
+     * Get the masses of this object for writing, after making a copy of its own if they are shared with other objects.
+     * The entries filled by key point into the old masses, so they are forgotten along with them.
+     * @return The masses, which belong to this object only
+     */
+    MaterialProperties::Masses& MaterialProperties::mutableMasses() {
+        if (masses_.use_count() > 1) {
+            masses_ = std::make_shared<Masses>(*masses_);
+            localMassSlots.clear();
+            localMassCompSlots.clear();
+            localCompMatSlots.clear();
+        }
+        return *masses_;
+    }
+
+    bool MaterialProperties::Masses::operator==(const Masses& other) const {
+        return localmasses == other.localmasses && exitingmasses == other.exitingmasses
+            && localmassesComp == other.localmassesComp && exitingmassesComp == other.exitingmassesComp
+            && localCompMats == other.localCompMats && exitingCompMats == other.exitingCompMats;
+    }
+
+    std::string MaterialProperties::getSuperName(const std::string& name) const {
         std::stringstream ss(name);
         std::pair<std::string, std::string> split;
         std::getline(ss, split.first, '_');
@@ -491,7 +629,7 @@ namespace insur {
         return !split.second.empty() ? split.second : split.first;
     }
 
-    std::string MaterialProperties::getSubName(std::string name) const {
+    std::string MaterialProperties::getSubName(const std::string& name) const {
         std::stringstream ss(name);
         std::pair<std::string, std::string> split;
         std::getline(ss, split.first, '_');
@@ -499,5 +637,208 @@ namespace insur {
         return split.first;
     }
 
+    /**
+     * Collect the mass entries of an object, to compute its radiation and interaction lengths with the others of the batch.
+     * As with <i>calculateRadiationLength()</i>, the object is left alone if it has no surface.
+     * @param mp The object, which must stay where it is until the batch is no longer evaluated
+     * @param offset A starting value for the lengths of this object
+     */
+    void MaterialLengthBatch::add(MaterialProperties& mp, double offset) {
+        double s = mp.getSurface();
+        if (s <= 0) return;
+        owners.push_back(&mp);
+        offsets.push_back(offset);
+        const std::map<std::string, double>* totals[] = { mp.msl_set ? &mp.masses_->localmasses : nullptr, mp.mse_set ? &mp.masses_->exitingmasses : nullptr };
+        for (const std::map<std::string, double>* masses : totals) {
+            if (!masses) continue;
+            for (std::map<std::string, double>::const_iterator it = masses->begin(); it != masses->end(); ++it) {
+                termMaterial.push_back(materialIndex(it->first));
+                termMass.push_back(it->second);
+                termSurface.push_back(s);
+                componentTarget.push_back(nullptr);
+                termComponent.push_back(-1);
+            }
+        }
+        ownerTotalTermsEnd.push_back(termMass.size());
+        size_t firstBaseline = componentBaselines.size();
+        const std::map<std::string, std::map<std::string, double> >* components[] = { mp.msl_set ? &mp.masses_->localCompMats : nullptr, mp.mse_set ? &mp.masses_->exitingCompMats : nullptr };
+        for (const std::map<std::string, std::map<std::string, double> >* compMats : components) {
+            if (!compMats) continue;
+            for (std::map<std::string, std::map<std::string, double> >::const_iterator cit = compMats->begin(); cit != compMats->end(); ++cit) {
+                RILength* target = &mp.componentsRI[mp.getSuperName(cit->first)];
+                bool seen = false;
+                for (size_t i = firstBaseline; i < componentBaselines.size() && !seen; i++) seen = componentBaselines[i].first == target;
+                if (!seen) componentBaselines.push_back(std::make_pair(target, *target));
+                int component = componentIndex(mp.getSubName(cit->first));
+                for (std::map<std::string, double>::const_iterator mit = cit->second.begin(); mit != cit->second.end(); ++mit) {
+                    termMaterial.push_back(materialIndex(mit->first));
+                    termMass.push_back(mit->second);
+                    termSurface.push_back(s);
+                    componentTarget.push_back(target);
+                    termComponent.push_back(component);
+                }
+            }
+        }
+        ownerTermsEnd.push_back(termMass.size());
+    }
+
+    /**
+     * Forget all the objects and materials of the batch.
+     */
+    void MaterialLengthBatch::clear() {
+        owners.clear();
+        offsets.clear();
+        termMaterial.clear();
+        termMass.clear();
+        termSurface.clear();
+        inverseRadiation.clear();
+        inverseInteraction.clear();
+        ownerTermsEnd.clear();
+        ownerTotalTermsEnd.clear();
+        componentTarget.clear();
+        componentBaselines.clear();
+        termComponent.clear();
+        materialIndices.clear();
+        materialNames.clear();
+        rlengths.clear();
+        ilengths.clear();
+        componentIndices.clear();
+        componentScales.clear();
+    }
+
+    /**
+     * Read the radiation and interaction lengths of all the materials of the batch from the material tab again.
+     */
+    void MaterialLengthBatch::resolveLengths() {
+        rlengths.clear();
+        ilengths.clear();
+        resolveNewLengths();
+    }
+
+    /**
+     * Override the lengths of a material of the batch, to evaluate it again with other values than those of the material tab.
+     * @param material The name of the material
+     * @param rlength The radiation length
+     * @param ilength The interaction length
+     */
+    void MaterialLengthBatch::setLengths(const std::string& material, double rlength, double ilength) {
+        int index = materialIndex(material);
+        resolveNewLengths();
+        rlengths[index] = rlength;
+        ilengths[index] = ilength;
+    }
+
+    /**
+     * Scale the masses of a component in the next evaluations, e.g. to see what a lighter version of it would weigh in the budget.
+     * The total lengths of the objects change by the scaled part of the terms of the component, which keep their order.
+     * @param component The name the masses of the component are summed under, i.e. the part of its name before the first '_'
+     * @param scale The factor its masses are multiplied by; 1 for the masses as they are
+     */
+    void MaterialLengthBatch::setComponentScale(const std::string& component, double scale) {
+        componentScales[componentIndex(component)] = scale;
+    }
+
+    /**
+     * Compute the radiation and interaction lengths of all the objects of the batch, as well as those of their components.
+     */
+    void MaterialLengthBatch::evaluate() {
+        evaluateTerms();
+        const double* r = inverseRadiation.data();
+        const double* i = inverseInteraction.data();
+        for (auto& baseline : componentBaselines) *baseline.first = baseline.second;
+        size_t k = 0;
+        for (size_t o = 0; o < owners.size(); o++) {
+            double radiation = offsets[o], interaction = offsets[o];
+            for (; k < (size_t)ownerTotalTermsEnd[o]; k++) {
+                radiation += r[k];
+                interaction += i[k];
+            }
+            for (; k < (size_t)ownerTermsEnd[o]; k++) {
+                double scale = componentScales[termComponent[k]];
+                if (scale != 1.) {
+                    radiation += (scale - 1.) * r[k];
+                    interaction += (scale - 1.) * i[k];
+                }
+                componentTarget[k]->radiation += scale * r[k];
+                componentTarget[k]->interaction += scale * i[k];
+            }
+            owners[o]->r_length = radiation;
+            owners[o]->i_length = interaction;
+        }
+    }
+
+    /**
+     * Compute the total radiation and interaction lengths of all the objects of the batch without storing them in the
+     * objects, which are left as they are.
+     * @param lengths The lengths, one per object in the order of <i>objects()</i>
+     */
+    void MaterialLengthBatch::evaluate(std::vector<RILength>& lengths) {
+        evaluateTerms();
+        const double* r = inverseRadiation.data();
+        const double* i = inverseInteraction.data();
+        lengths.resize(owners.size());
+        size_t k = 0;
+        for (size_t o = 0; o < owners.size(); o++) {
+            double radiation = offsets[o], interaction = offsets[o];
+            for (; k < (size_t)ownerTotalTermsEnd[o]; k++) {
+                radiation += r[k];
+                interaction += i[k];
+            }
+            for (; k < (size_t)ownerTermsEnd[o]; k++) {
+                double scale = componentScales[termComponent[k]];
+                if (scale != 1.) {
+                    radiation += (scale - 1.) * r[k];
+                    interaction += (scale - 1.) * i[k];
+                }
+            }
+            lengths[o].radiation = radiation;
+            lengths[o].interaction = interaction;
+        }
+    }
+
+    int MaterialLengthBatch::materialIndex(const std::string& material) {
+        std::unordered_map<std::string, int>::const_iterator it = materialIndices.find(material);
+        if (it != materialIndices.end()) return it->second;
+        materialIndices[material] = materialNames.size();
+        materialNames.push_back(material);
+        return materialNames.size() - 1;
+    }
+
+    int MaterialLengthBatch::componentIndex(const std::string& component) {
+        std::unordered_map<std::string, int>::const_iterator it = componentIndices.find(component);
+        if (it != componentIndices.end()) return it->second;
+        componentIndices[component] = componentScales.size();
+        componentScales.push_back(1.);
+        return componentScales.size() - 1;
+    }
+
+    // Reads the lengths of the materials added since the last time from the material tab
+    void MaterialLengthBatch::resolveNewLengths() {
+        const material::MaterialTab& materialTab = material::MaterialTab::instance();
+        for (size_t i = rlengths.size(); i < materialNames.size(); i++) {
+            rlengths.push_back(materialTab.radiationLength(materialNames[i]));
+            ilengths.push_back(materialTab.interactionLength(materialNames[i]));
+        }
+    }
+
+    // Evaluates the lengths of all the terms, in one loop over the flat arrays
+    void MaterialLengthBatch::evaluateTerms() {
+        resolveNewLengths();
+        size_t n = termMass.size();
+        inverseRadiation.resize(n);
+        inverseInteraction.resize(n);
+        const int* mat = termMaterial.data();
+        const double* m = termMass.data();
+        const double* s = termSurface.data();
+        const double* rl = rlengths.data();
+        const double* il = ilengths.data();
+        double* r = inverseRadiation.data();
+        double* i = inverseInteraction.data();
+        for (size_t k = 0; k < n; k++) {
+            r[k] = m[k] / (rl[mat[k]] * s[k] / 100.0);
+            i[k] = m[k] / (il[mat[k]] * s[k] / 100.0);
+        }
+    }
+
 define_enum_strings(MaterialProperties::Category) = { "Nocat", "Bmod", "Emod", "Bser", "Eser", "Bsup", "Esup", "Osup", "Tsup", "Usup" };
 }
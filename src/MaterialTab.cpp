@@ -6,10 +6,9 @@
  */
 
 
-#include <fstream>
-#include <sstream>
 #include "MaterialTab.h"
 #include "global_constants.h"
+#include "global_funcs.h"
 #include "mainConfigHandler.h"
 #include <messageLogger.h>
 #include <stdexcept>
@@ -22,26 +21,22 @@ namespace material {
 
   MaterialTab::MaterialTab() {
     std::string mattabFile(mainConfigHandler::instance().getMattabDirectory() + "/" + insur::default_mattabfile);
-    std::ifstream mattabStream(mainConfigHandler::instance().getMattabDirectory() + "/" + insur::default_mattabfile);
-    std::string line;
-    std::string material;
-    std::istringstream lineStream;
-    double density, radiationLength, interactionLength;
+    std::string content;
 
-    if (mattabStream.good()) {
-      while (!mattabStream.eof()) {
-        std::getline(mattabStream, line);
-        lineStream.str(line);
-        lineStream >> material;
-
-        //check if is a comment
-        if (material[0] != '#') {
-          lineStream >> density >> radiationLength >> interactionLength;
-          density /= 1000; // convert g/cm3 in g/mm3
-          insert(make_pair(material, make_tuple(density, radiationLength, interactionLength)));
+    if (readText(mattabFile, content)) {
+      // the file is scanned in place, line by line: a material and its density, radiation and interaction lengths
+      TextPiece text{ content.data(), content.data() + content.size() }, line, word;
+      while (nextLine(text, line)) {
+        //skip the empty lines and the comments
+        if (!nextWord(line, word) || *word.begin == '#') continue;
+        std::string material = word.str();
+        double values[3] = { 0, 0, 0 };
+        for (double& value : values) {
+          if (!nextWord(line, word)) break;
+          value = wordToDouble(word);
         }
-
-        lineStream.clear();
+        double density = values[0] / 1000; // convert g/cm3 in g/mm3
+        insert(make_pair(material, make_tuple(density, values[1], values[2])));
       }
     } else {
       logERROR(msg_no_mat_file);
@@ -53,7 +48,7 @@ namespace material {
     return instance_;
   }
 
-  double MaterialTab::density(std::string material) const {
+  double MaterialTab::density(const std::string& material) const {
     double val = 0;
     try {
       val = std::get<0>(at(material));
@@ -64,7 +59,7 @@ namespace material {
     return val;
   }
 
-  double MaterialTab::radiationLength(std::string material) const {
+  double MaterialTab::radiationLength(const std::string& material) const {
     double val = 0;
     try {
       val = std::get<1>(at(material));
@@ -75,7 +70,7 @@ namespace material {
     return val;
   }
 
-  double MaterialTab::interactionLength(std::string material) const {
+  double MaterialTab::interactionLength(const std::string& material) const {
     double val = 0;
     try {
       val = std::get<2>(at(material));
@@ -132,7 +132,8 @@ namespace insur {
    * Adds a material already bundled into a <i>MaterialRow</i> struct to the container class.
    * @param mat The struct that will be copied and appended to the internal vector container
    */
-  void MaterialTable::addMaterial(MaterialRow mat) {
+  void MaterialTable::addMaterial(const MaterialRow& mat) {
+    indices.insert(std::make_pair(mat.tag, (int)materials.size()));
     materials.push_back(mat);
   }
 
@@ -143,13 +144,13 @@ namespace insur {
    * @param rlength The radiation length of the material
    * @param ilength The interaction length of the material
    */
-  void MaterialTable::addMaterial(std::string tag, double density, double rlength, double ilength) {
+  void MaterialTable::addMaterial(const std::string& tag, double density, double rlength, double ilength) {
     MaterialRow row;
     row.tag = tag;
     row.density = density;
     row.rlength = rlength;
     row.ilength = ilength;
-    materials.push_back(row);
+    addMaterial(row);
   }
 
   /**
@@ -157,7 +158,7 @@ namespace insur {
    * @param tag The name of the requested material
    * @return A reference to the requested <i>MaterialRow</i> struct
    */
-  MaterialRow& MaterialTable::getMaterial(std::string tag) { // throws std::runtime_error
+  MaterialRow& MaterialTable::getMaterial(const std::string& tag) { // throws std::runtime_error
     int index = findIndex(tag);
     if (index < 0) throw std::runtime_error("MaterialTable::getMaterialByTag(): " + errEntryNotFound);
     return getMaterial(index);
@@ -179,7 +180,7 @@ namespace insur {
    * @param newmat The <i>MaterialRow</i> struct containing the replacement
    * @return True if the operation was successful, false if the material that was to be replaced does not exist
    */
-  bool MaterialTable::replaceMaterial(std::string oldtag, MaterialRow newmat) {
+  bool MaterialTable::replaceMaterial(const std::string& oldtag, const MaterialRow& newmat) {
     int index = findIndex(oldtag);
     return replaceMaterial(index, newmat);
   }
@@ -190,9 +191,11 @@ namespace insur {
    * @param newmat The <i>MaterialRow</i> struct containing the replacement
    * @return True if the operation was successful, false if the index was out of range
    */
-  bool MaterialTable::replaceMaterial(int index, MaterialRow newmat) {
+  bool MaterialTable::replaceMaterial(int index, const MaterialRow& newmat) {
     if (index < 0 || index >= (int)materials.size()) return false;
     materials.at(index) = newmat;
+    indices.clear();
+    for (int i = materials.size() - 1; i >= 0; i--) indices[materials.at(i).tag] = i;
     return false;
   }
 
@@ -225,18 +228,13 @@ namespace insur {
   }
 
   /**
-   * Find the internal index of a material as identified by its tag
+   * Find the internal index of a material as identified by its tag, in the hash index kept along with the rows
    * @param tag The name of the material
-   * @return The index of the requested material; -1 if no such material exists in the table
+   * @return The index of the first row of the requested material; -1 if no such material exists in the table
    */
-  int MaterialTable::findIndex(std::string tag) {
-    bool found = false;
-    int index = 0;
-    while (index < (int)materials.size() && !found) {
-      if (tag.compare(materials.at(index).tag) == 0) found = true;
-      else index++;
-    }
-    if (!found) return -1;
-    return index;
+  int MaterialTable::findIndex(const std::string& tag) {
+    std::unordered_map<std::string, int>::const_iterator it = indices.find(tag);
+    if (it == indices.end()) return -1;
+    return it->second;
   }
 }
@@ -22,8 +22,10 @@
 #include "Layer.h"
 #include "WeightDistributionGrid.h"
 #include "StopWatch.h"
+#include "TaskPool.h"
 
 #include <ctime>
+#include <algorithm>
 
 
 namespace material {
@@ -253,6 +255,9 @@ namespace material {
   MaterialObject& Materialway::Section::materialObject() {
     return materialObject_;
   }
+  const std::vector<std::string>& Materialway::Section::unitsToPass() const {
+    return unitsToPass_;
+  }
 
   void Materialway::Section::inactiveElement(InactiveElement* inactiveElement) {
     inactiveElement_ = inactiveElement;
@@ -308,12 +313,64 @@ namespace material {
 
   //END Materialway::Station
   //=================================================================================
+  //START Materialway::CollisionIndex
+  template<class Element> Materialway::CollisionIndex<Element>::CollisionIndex(int margin, int binWidth) :
+    margin_(margin),
+    binWidth_(binWidth),
+    size_(0) {}
+
+  template<class Element> void Materialway::CollisionIndex<Element>::clear() {
+    rBins_.clear();
+    zBins_.clear();
+    size_ = 0;
+  }
+
+  template<class Element> int Materialway::CollisionIndex<Element>::bin(int coordinate) const {
+    return coordinate >= 0 ? coordinate / binWidth_ : -((-coordinate - 1) / binWidth_) - 1;
+  }
+
+  template<class Element> void Materialway::CollisionIndex<Element>::insert(Element* element) {
+    for (int i = bin(element->minR() - margin_); i <= bin(element->maxR() + margin_); i++) rBins_[i].push_back(element);
+    for (int i = bin(element->minZ() - margin_); i <= bin(element->maxZ() + margin_); i++) zBins_[i].push_back(element);
+    size_++;
+  }
+
+  /**
+   * Get the elements that could be hit by a search starting from the given point
+   * @param z is the Z coordinate of the starting point
+   * @param r is the rho coordinate of the starting point
+   * @param direction is the direction of the search
+   * @return the candidates, in insertion order
+   */
+  template<class Element> const std::vector<Element*>& Materialway::CollisionIndex<Element>::candidates(int z, int r, Direction direction) const {
+    const std::unordered_map<int, std::vector<Element*> >& bins = (direction == HORIZONTAL) ? rBins_ : zBins_;
+    typename std::unordered_map<int, std::vector<Element*> >::const_iterator it = bins.find(bin((direction == HORIZONTAL) ? r : z));
+    return it != bins.end() ? it->second : noCandidates_;
+  }
+
+  //END Materialway::CollisionIndex
+  //=================================================================================
   //START Materialway::OuterUsher
   Materialway::OuterUsher::OuterUsher(SectionVector& sectionsList, BoundariesSet& boundariesList) :
     sectionsList_(sectionsList),
-    boundariesList_(boundariesList) {}
+    boundariesList_(boundariesList),
+    sectionIndex_(sectionWidth + safetySpace, collisionIndexBinWidth),
+    boundaryIndex_(0, collisionIndexBinWidth) {}
   Materialway::OuterUsher::~OuterUsher() {}
 
+  /**
+   * Bring the collision indices up to date: the sections appended to the list since the last search are added,
+   * the boundaries are indexed again if their set has changed
+   */
+  void Materialway::OuterUsher::updateIndices() {
+    if (sectionIndex_.size() > sectionsList_.size()) sectionIndex_.clear();
+    for (size_t i = sectionIndex_.size(); i < sectionsList_.size(); i++) sectionIndex_.insert(sectionsList_[i]);
+    if (boundaryIndex_.size() != boundariesList_.size()) {
+      boundaryIndex_.clear();
+      for (Boundary* boundary : boundariesList_) boundaryIndex_.insert(boundary);
+    }
+  }
+
   void Materialway::OuterUsher::go(Boundary* boundary, const Tracker& tracker, Direction direction) {
     int startZ, startR, collision, border;
     bool foundBoundaryCollision, noSectionCollision;
@@ -348,24 +405,24 @@ namespace material {
     int hitCoord;
     int globalMaxZ = discretize(tracker.maxZ()) + globalMaxZPadding;
     int globalMaxR = discretize(tracker.maxR()) + globalMaxRPadding;
-    std::map<int, BoundariesSet::const_iterator> hitBoundariesCoords;
+    std::map<int, Boundary*> hitBoundariesCoords;
     bool foundCollision = false;
 
-    //test all the boundaries for an hit (keep it on a map ordered for key = collision coords, so the first is the nearest collision)
-    //for (Boundary& currBoundary : boundariesList_) {
-    for(BoundariesSet::const_iterator it = boundariesList_.cbegin(); it != boundariesList_.cend(); ++it) {
-      hitCoord = (*it)->isHit(startZ, startR, direction);
+    //test the boundaries that can be hit (keep it on a map ordered for key = collision coords, so the first is the nearest collision)
+    updateIndices();
+    for (Boundary* currBoundary : boundaryIndex_.candidates(startZ, startR, direction)) {
+      hitCoord = currBoundary->isHit(startZ, startR, direction);
       if (hitCoord>0) {
-        hitBoundariesCoords[hitCoord] = it;
+        hitBoundariesCoords[hitCoord] = currBoundary;
       }
     }
 
     if (hitBoundariesCoords.size()) {
       collision = hitBoundariesCoords.begin()->first;
       if(direction == HORIZONTAL) {
-        border = (*hitBoundariesCoords.begin()->second)->maxR();
+        border = hitBoundariesCoords.begin()->second->maxR();
       } else {
-        border = (*hitBoundariesCoords.begin()->second)->maxZ();
+        border = hitBoundariesCoords.begin()->second->maxZ();
       }
       foundCollision = true;
     } else {
@@ -395,8 +452,9 @@ namespace material {
     int hitCoord;
     std::map<int, Section*> hitSectionsCoords;
 
-    //test all the sections for an hit (keep it on a map ordered for key = collision coords, so the first is the nearest collision)
-    for (Section* currSection : sectionsList_) {
+    //test the sections that can be hit (keep it on a map ordered for key = collision coords, so the first is the nearest collision)
+    updateIndices();
+    for (Section* currSection : sectionIndex_.candidates(startZ, startR, direction)) {
       hitCoord = currSection->isHit(startZ, startR, end, direction);
       if (hitCoord>0) {
         hitSectionsCoords[hitCoord] = currSection;
@@ -996,6 +1054,71 @@ namespace material {
 
   //END Materialway::InnerUsher
   //=================================================================================
+  //START Materialway::ServiceRouting
+
+  /**
+   * Requests the deposit of the material of a source into a single section, as MaterialObject::deployMaterialTo does
+   * @param source The material object to deposit, which must not change until run()
+   * @param section The section receiving the material
+   * @param units The units to deposit, which must outlive run()
+   * @param onlyServices Whether only the service elements are deposited
+   * @param gramsMultiplier The factor applied to the elements in grams
+   */
+  void Materialway::ServiceRouting::deploy(const MaterialObject& source, Section* section, const std::vector<std::string>& units, bool onlyServices /*= false*/, double gramsMultiplier /*= 1.*/) {
+    Deposit deposit = { &source, &units, onlyServices, gramsMultiplier };
+    add(section->materialObject(), deposit);
+  }
+
+  /**
+   * Requests the deposit of the services of a source along a chain of sections, as Section::getServicesAndPass does
+   * @param source The material object to deposit, which must not change until run()
+   * @param section The first section of the chain
+   * @param units The units to deposit into the first section, which must outlive run(); the following sections receive their default ones
+   */
+  void Materialway::ServiceRouting::pass(const MaterialObject& source, Section* section, const std::vector<std::string>& units) {
+    const std::vector<std::string>* currUnits = &units;
+    for (Section* currSection = section; currSection != nullptr; currSection = currSection->nextSection()) {
+      Deposit deposit = { &source, currUnits, MaterialObject::ONLY_SERVICES, 1. };
+      Station* station = dynamic_cast<Station*>(currSection);
+      if (station != nullptr) {
+        add(station->conversionStation(), deposit);
+        break;
+      }
+      add(currSection->materialObject(), deposit);
+      if (!currSection->hasNextSection()) break;
+      currUnits = &currSection->nextSection()->unitsToPass();
+    }
+  }
+
+  void Materialway::ServiceRouting::pass(const MaterialObject& source, Section* section) {
+    pass(source, section, section->unitsToPass());
+  }
+
+  void Materialway::ServiceRouting::add(MaterialObject& target, const Deposit& deposit) {
+    auto inserted = targetIndex_.insert(std::make_pair(&target, targets_.size()));
+    if (inserted.second) targets_.push_back(std::make_pair(&target, std::vector<Deposit>()));
+    targets_[inserted.first->second].second.push_back(deposit);
+  }
+
+  /**
+   * Makes all the deposits requested so far, one target per task, then forgets them
+   * @param numThreads The number of threads; the deposits are made on the calling thread if it is 1 or less
+   */
+  void Materialway::ServiceRouting::run(int numThreads) {
+    // the deposits are forgotten even if some of them fail
+    struct Clear {
+      ServiceRouting& routing;
+      ~Clear() { routing.targets_.clear(); routing.targetIndex_.clear(); }
+    } clear = { *this };
+    TaskPool::instance()->run("Service routing", targets_.size(), [&](int i) {
+      for (const Deposit& deposit : targets_[i].second) {
+        deposit.source->deployMaterialTo(*targets_[i].first, *deposit.units, deposit.onlyServices, deposit.gramsMultiplier);
+      }
+    }, numThreads);
+  }
+
+  //END Materialway::ServiceRouting
+  //=================================================================================
   //START Materialway
 
   const double Materialway::gridFactor = 1000.0;                                     /**< the conversion factor for using integers in the algorithm (helps finding collisions),
@@ -1017,12 +1140,14 @@ namespace material {
   const int Materialway::sectionTolerance = discretize(1.0);       /**< the tolerance for attaching the modules in the layers and disk to the service section next to it */
   const int Materialway::layerStationLenght = discretize(5.0);         /**< the lenght of the converting station on right of the layers */
   const int Materialway::layerStationWidth = discretize(20.0);         /**< the width of the converting station on right of the layers */
+  const int Materialway::collisionIndexBinWidth = discretize(50.0);     /**< the width of the bins of the section and boundary collision indices */
 
 
   Materialway::Materialway() :
     outerUsher(sectionsList_, boundariesList_),
     innerUsher(sectionsList_, stationListFirst_, stationListSecond_, barrelBoundaryAssociations_, endcapBoundaryAssociations_, moduleSectionAssociations_, layerRodSections_, diskRodSections_),
-    boundariesList_() {}
+    boundariesList_(),
+    numThreads_(1) {}
   Materialway::~Materialway() {}
 
   int Materialway::discretize(double input) {
@@ -1105,7 +1230,7 @@ namespace material {
     startTaskClock("Rounting services"); routeServices(tracker); stopTaskClock();
     startTaskClock("First step conversions"); firstStepConversions(); stopTaskClock();
     startTaskClock("Second step conversions"); secondStepConversions(); stopTaskClock();
-    startTaskClock("Creating ModuleCaps"); createModuleCaps(tracker); stopTaskClock();
+    startTaskClock("Releasing ModuleCaps"); releaseModuleCaps(tracker); stopTaskClock();
     startTaskClock("Duplicating sections"); duplicateSections(); stopTaskClock();
     startTaskClock("Populating MaterialProperties"); populateAllMaterialProperties(tracker, weightDistribution); stopTaskClock();
     startTaskClock("Building inactive surfaces"); buildInactiveSurface(tracker, inactiveSurface); stopTaskClock();
@@ -1217,6 +1342,7 @@ namespace material {
       ModuleSectionMap& moduleSectionAssociations_;  /**< Map that associate each module with the section that it feeds */
       LayerRodSectionsMap& layerRodSections_;      /**< maps for sections of the rods */
       DiskRodSectionsMap& diskRodSections_;
+      ServiceRouting& routing_;
 
       const Layer* currLayer_;
       const Disk* currDisk_;
@@ -1234,10 +1360,10 @@ namespace material {
       const std::vector<std::string> unitsToPassLayer = {"g", "g/m", "mm"};
       const std::vector<std::string> unitsToPassLayerServ = {"g/m", "mm"};
     public:
-      ServiceVisitor(ModuleSectionMap& moduleSectionAssociations, LayerRodSectionsMap& layerRodSections, DiskRodSectionsMap& diskRodSections) :
+      ServiceVisitor(ModuleSectionMap& moduleSectionAssociations, LayerRodSectionsMap& layerRodSections, DiskRodSectionsMap& diskRodSections, ServiceRouting& routing) :
         moduleSectionAssociations_(moduleSectionAssociations),
         layerRodSections_(layerRodSections),
-        diskRodSections_(diskRodSections), printGuard(true), printCounter(0), firstRing(false), rodSectionsSize(0) {}
+        diskRodSections_(diskRodSections), routing_(routing), printGuard(true), printCounter(0), firstRing(false), rodSectionsSize(0) {}
 
       void visit(const Layer& layer) {
         currLayer_ = &layer;
@@ -1249,9 +1375,9 @@ namespace material {
           }
 
           for (Section* currSection : layerRodSections_.at(currLayer_).getSections()) {
-            layer.materialObject().deployMaterialTo(currSection->materialObject(), unitsToPassLayer, MaterialObject::SERVICES_AND_LOCALS, double(currSection->maxZ()-currSection->minZ()) / totalLength);
+            routing_.deploy(layer.materialObject(), currSection, unitsToPassLayer, MaterialObject::SERVICES_AND_LOCALS, double(currSection->maxZ()-currSection->minZ()) / totalLength);
           }
-          layerRodSections_.at(currLayer_).getStation()->getServicesAndPass(layer.materialObject(), unitsToPassLayerServ);
+          routing_.pass(layer.materialObject(), layerRodSections_.at(currLayer_).getStation(), unitsToPassLayerServ);
         }
       }
 
@@ -1259,21 +1385,21 @@ namespace material {
         if (firstRod) {
           rodSectionsSize = 0;
           for (Section* currSection : layerRodSections_.at(currLayer_).getSections()) {
-            rod.materialObject().deployMaterialTo(currSection->materialObject(), unitsToPassRodMM);
+            routing_.deploy(rod.materialObject(), currSection, unitsToPassRodMM);
             rodSectionsSize += currSection->maxZ() - currSection->minZ();
           }
           firstRod = false;
-          layerRodSections_.at(currLayer_).getStation()->getServicesAndPass(rod.materialObject(), unitsToPassRodMM);
+          routing_.pass(rod.materialObject(), layerRodSections_.at(currLayer_).getStation(), unitsToPassRodMM);
         }
         for (Section* currSection : layerRodSections_.at(currLayer_).getSections()) {
-          rod.materialObject().deployMaterialTo(currSection->materialObject(), unitsToPassRodGGM, MaterialObject::SERVICES_AND_LOCALS, double(currSection->maxZ()-currSection->minZ()) / rodSectionsSize);
+          routing_.deploy(rod.materialObject(), currSection, unitsToPassRodGGM, MaterialObject::SERVICES_AND_LOCALS, double(currSection->maxZ()-currSection->minZ()) / rodSectionsSize);
         }
-        layerRodSections_.at(currLayer_).getStation()->getServicesAndPass(rod.materialObject(), unitsToPassRodGM);
+        routing_.pass(rod.materialObject(), layerRodSections_.at(currLayer_).getStation(), unitsToPassRodGM);
       }
 
       void visit(const BarrelModule& module) {
         if(module.maxZ() > 0) {
-          moduleSectionAssociations_.at(&module)->getServicesAndPass(module.materialObject());
+          routing_.pass(module.materialObject(), moduleSectionAssociations_.at(&module));
 
           return;
 
@@ -1361,9 +1487,9 @@ namespace material {
             totalLength += currSection->maxR() - currSection->minR();
           }
           for (Section* currSection : diskRodSections_.at(currDisk_).getSections()) {
-            disk.materialObject().deployMaterialTo(currSection->materialObject(), unitsToPassLayer, MaterialObject::SERVICES_AND_LOCALS, double(currSection->maxR()-currSection->minR()) / totalLength);
+            routing_.deploy(disk.materialObject(), currSection, unitsToPassLayer, MaterialObject::SERVICES_AND_LOCALS, double(currSection->maxR()-currSection->minR()) / totalLength);
           }          
-          diskRodSections_.at(currDisk_).getStation()->getServicesAndPass(disk.materialObject(), unitsToPassLayerServ);
+          routing_.pass(disk.materialObject(), diskRodSections_.at(currDisk_).getStation(), unitsToPassLayerServ);
         }
 
         /*
@@ -1417,7 +1543,7 @@ namespace material {
       void visit(const EndcapModule& module) {
         if (module.minZ() >= 0) {
           //route module services
-          moduleSectionAssociations_.at(&module)->getServicesAndPass(module.materialObject());
+          routing_.pass(module.materialObject(), moduleSectionAssociations_.at(&module));
 
           /*
           //route disk rod services
@@ -1431,8 +1557,10 @@ namespace material {
       }
     };
 
-    ServiceVisitor v(moduleSectionAssociations_, layerRodSections_, diskRodSections_);
+    ServiceRouting routing;
+    ServiceVisitor v(moduleSectionAssociations_, layerRodSections_, diskRodSections_, routing);
     tracker.accept(v);
+    routing.run(numThreads_);
   }
 
   /*
@@ -1514,32 +1642,12 @@ namespace material {
     }
   }
 
-  void Materialway::createModuleCaps(Tracker& tracker) {
-
-    class CapsVisitor : public GeometryVisitor {
-    public:
-      //std::map<BarrelModule*, int> mappaB;
-      //std::map<EndcapModule*, int> mappaE;
-      //int totB = 0;
-      //int totE = 0;
-      CapsVisitor() {}
-      void visit(BarrelModule& m) {
-        ModuleCap* cap = new ModuleCap(m);
-        cap->setCategory(MaterialProperties::b_mod);
-        //mappaB[&m] = 0;
-        //totB ++;
-      }
-      void visit(EndcapModule& m) {
-        ModuleCap* cap = new ModuleCap(m);
-        cap->setCategory(MaterialProperties::e_mod);
-        //mappaE[&m] = 0;
-        //totE ++;
-      }
-    };
-
-    CapsVisitor v;
-    tracker.accept(v);
-    //std::cout << "Barrel " << v.mappaB.size() << " = " << v.totB << "  ----  Endcap " << v.mappaE.size() << " = " << v.totE << std::endl;
+  /**
+   * Drop the caps a previous build left to the modules: each module gets a new one, from DetectorModule::moduleCap(),
+   * when its material properties are populated
+   */
+  void Materialway::releaseModuleCaps(Tracker& tracker) {
+    for (Module* m : tracker.modules()) m->releaseModuleCap();
   }
  
   void Materialway::duplicateSections() {
@@ -1587,27 +1695,11 @@ namespace material {
       }
     }
 
-    //modules
-    class ModuleVisitor : public GeometryVisitor {
-    private:
-      WeightDistributionGrid& weightDistribution_;
-    public:
-      ModuleVisitor(WeightDistributionGrid& weightDistribution) :
-        weightDistribution_(weightDistribution) {}
-      virtual ~ModuleVisitor() {}
-
-      void visit(DetectorModule& module) {
-        //ModuleCap* moduleCap = module.getModuleCap();
-        //MaterialProperties* materialProperties = ModuleCap;
-        //module.materialObject().populateMaterialProperties(*materialProperties);
-        module.materialObject().populateMaterialProperties(*module.getModuleCap());
-
-        //weightDistribution_.addTotalGrams(module.minZ(), module.minR(), module.maxZ(), module.maxR(), module.length(), module.area(), module.materialObject());
-      }
-    };
-
-    ModuleVisitor visitor(weightDistribution);
-    tracker.accept(visitor);
+    //modules: each one fills its own cap, from elements only read (the material keys are shared under a lock)
+    Tracker::Modules& modules = tracker.modules();
+    TaskPool::instance()->run("Module materials", modules.size(), [&](int i) {
+      modules[i]->materialObject().populateMaterialProperties(modules[i]->moduleCap());
+    }, numThreads_);
   }
 
   /*
@@ -1641,27 +1733,30 @@ namespace material {
   */
 
   void Materialway::buildInactiveSurface(Tracker& tracker, InactiveSurfaces& inactiveSurface) {
+    //the elements of all the supports are gathered, then copied in one append
     class SupportVisitor : public GeometryVisitor {
     private:
-      InactiveSurfaces& inactiveSurface_;
+      std::vector<InactiveElement*>& supportParts_;
     public:
-      SupportVisitor(InactiveSurfaces& inactiveSurface) : inactiveSurface_(inactiveSurface) {}
+      SupportVisitor(std::vector<InactiveElement*>& supportParts) : supportParts_(supportParts) {}
     
       void visit (Tracker& tracker) {
         for (auto& supportStructure : tracker.supportStructures()) {
-          supportStructure.updateInactiveSurfaces(inactiveSurface_);
+          supportStructure.collectInactiveElements(supportParts_);
         }
       }
       
       void visit (Barrel& barrel) {
         for (auto& supportStructure : barrel.supportStructures()) {
-          supportStructure.updateInactiveSurfaces(inactiveSurface_);
+          supportStructure.collectInactiveElements(supportParts_);
         }
       }
     };
 
-    SupportVisitor supportVisitor(inactiveSurface);
+    std::vector<InactiveElement*> supportParts;
+    SupportVisitor supportVisitor(supportParts);
     tracker.accept(supportVisitor);
+    inactiveSurface.addSupportParts(supportParts);
     
     
     for(Section* section : sectionsList_) {
@@ -1692,36 +1787,33 @@ namespace material {
   }
 
   void Materialway::calculateMaterialValues(InactiveSurfaces& inactiveSurface, Tracker& tracker) {
-    //supports
-    for (InactiveElement& currElem : inactiveSurface.getSupports()) {
-      currElem.calculateTotalMass();
-      currElem.calculateRadiationLength();
-      currElem.calculateInteractionLength();
-    }
+    //the radiation and interaction lengths of everything are computed at the end, in one batch
+    insur::MaterialLengthBatch lengths;
+    std::vector<InactiveElement>& supports = inactiveSurface.getSupports();
+    std::vector<InactiveElement>& services = inactiveSurface.getBarrelServices();
+    Tracker::Modules& modules = tracker.modules();
+
+    //the masses are summed element by element in parallel, the batch is then filled in the usual order
+    TaskPool::instance()->run("Material masses", supports.size() + services.size() + modules.size(), [&](int i) {
+      if (i < int(supports.size())) supports[i].calculateTotalMass();
+      else if ((i -= supports.size()) < int(services.size())) services[i].calculateTotalMass();
+      else modules[i - services.size()]->moduleCap().calculateTotalMass();
+    }, numThreads_);
 
+    //supports
+    for (InactiveElement& currElem : supports) lengths.add(currElem);
     //sections
-    for (InactiveElement& currElem : inactiveSurface.getBarrelServices()) {
-      currElem.calculateTotalMass();
-      currElem.calculateRadiationLength();
-      currElem.calculateInteractionLength();
-    }
-
+    for (InactiveElement& currElem : services) lengths.add(currElem);
     //modules
-    class ModuleVisitor : public GeometryVisitor {
-    public:
-      ModuleVisitor() {}
-      virtual ~ModuleVisitor() {}
-
-      void visit(DetectorModule& module) {
-        ModuleCap* moduleCap = module.getModuleCap();
-        moduleCap->calculateTotalMass();
-        moduleCap->calculateRadiationLength();
-        moduleCap->calculateInteractionLength();
-      }
-    };
-
-    ModuleVisitor visitor;
-    tracker.accept(visitor);
+    std::vector<insur::MaterialProperties*> moduleCaps;
+    moduleCaps.reserve(modules.size());
+    for (Module* module : modules) {
+      lengths.add(module->moduleCap());
+      moduleCaps.push_back(&module->moduleCap());
+    }
+    lengths.evaluate();
+    //identical modules keep a single copy of their masses from now on (the batch is done with them)
+    insur::MaterialProperties::shareIdenticalMasses(moduleCaps);
   }
 
   /*
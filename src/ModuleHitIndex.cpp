@@ -0,0 +1,305 @@
+/**
+ * @file ModuleHitIndex.cpp
+ * @brief This is the implementation of the (eta, phi) binned lookup of the modules a straight track can cross
+ */
+
+#include <ModuleHitIndex.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <set>
+#include <global_constants.h>
+
+namespace insur {
+
+  const double ModuleHitIndex::etaMargin = 1e-3;
+  const double ModuleHitIndex::phiMargin = 1e-3;
+
+  namespace {
+    /**
+     * Bring a phi difference back into the range (-PI, PI]
+     */
+    double normalizedDeltaPhi(double dphi) {
+      while (dphi > PI) dphi -= 2*PI;
+      while (dphi <= -PI) dphi += 2*PI;
+      return dphi;
+    }
+
+    /**
+     * Check whether the projection of a convex polygon on the xy-plane contains the z axis, in which case
+     * the polygon covers all the phi values and its eta range is unbounded
+     */
+    bool containsAxis(const Polygon3d<4>& poly) {
+      int positive = 0, negative = 0;
+      for (int i = 0; i < poly.getNumSides(); i++) {
+        const XYZVector& v0 = poly.getVertex(i);
+        const XYZVector& v1 = poly.getVertex((i+1) % poly.getNumSides());
+        double cross = v0.X()*v1.Y() - v0.Y()*v1.X();
+        if (cross > 0) positive++;
+        else if (cross < 0) negative++;
+      }
+      return positive == 0 || negative == 0;
+    }
+  }
+
+  /**
+   * Fill the bins with the modules of the given layer. Only the modules lying (at least partially) on the z+ side
+   * are considered, since those are the only ones the material tracks are checked against.
+   * @param layer A reference to the <i>ModuleCap</i> vector of the layer to be indexed
+   * @return True if the index was built, false if the layer cannot be indexed and has to be scanned module by module
+   */
+  bool ModuleHitIndex::build(ModuleCaps& layer) {
+    struct Bounds { int index, ring; double etaMin, etaMax, phiMin, phiMax, refPhi; };
+    std::vector<Bounds> bounds;
+    std::set<int> rods;
+    std::map<int, int> rings; // the number of modules of each ring
+    bool barrel = true, endcap = true;
+    double sumRadius = 0, sumZ = 0;
+    bins_.clear();
+    rowEdges_.clear();
+    radius_ = z_ = 0;
+    phiStart_ = -PI;
+
+    for (int i = 0; i < (int)layer.size(); i++) {
+      Module& m = layer[i].getModule();
+      if (m.maxZ() <= 0) continue;
+      Bounds b;
+      b.index = i;
+      b.etaMin = std::numeric_limits<double>::max();
+      b.etaMax = -std::numeric_limits<double>::max();
+      double refPhi = m.center().Phi();
+      double dPhiMin = 0., dPhiMax = 0.;
+      for (const Sensor& s : m.sensors()) {
+        const Polygon3d<4>& poly = s.hitPoly();
+        if (containsAxis(poly)) return false;
+        // eta decreases with rho and increases with z: the extremes sit on the corners of the (rho, z) bounding box
+        double minR = CoordinateOperations::computeMinR(poly), maxR = CoordinateOperations::computeMaxR(poly);
+        double minZ = CoordinateOperations::computeMinZ(poly), maxZ = CoordinateOperations::computeMaxZ(poly);
+        b.etaMin = MIN(b.etaMin, XYZVector(0., maxR, minZ).Eta());
+        b.etaMax = MAX(b.etaMax, XYZVector(0., minR, maxZ).Eta());
+        // the projection of the polygon does not contain the axis, hence its phi extremes are on the vertices
+        for (const XYZVector& v : poly) {
+          double dphi = normalizedDeltaPhi(v.Phi() - refPhi);
+          dPhiMin = MIN(dPhiMin, dphi);
+          dPhiMax = MAX(dPhiMax, dphi);
+        }
+      }
+      b.etaMin -= etaMargin;
+      b.etaMax += etaMargin;
+      b.phiMin = refPhi + dPhiMin - phiMargin;
+      b.phiMax = refPhi + dPhiMax + phiMargin;
+      b.refPhi = refPhi;
+      ModuleKey key = m.moduleKey();
+      b.ring = key.ring();
+      bounds.push_back(b);
+      rings[key.ring()]++;
+      if (m.subdet() == BARREL) {
+        rods.insert(key.phi());
+        sumRadius += m.center().Rho();
+        endcap = false;
+      } else {
+        sumZ += m.center().Z();
+        barrel = false;
+        if (b.etaMin <= 0) endcap = false; // the radius at the z of the disk is only monotonic in eta for eta > 0
+      }
+    }
+
+    if (bounds.empty()) {
+      rowBins_ = phiBins_ = 0;
+      return true;
+    }
+
+    if (barrel) {
+      radius_ = sumRadius / bounds.size();
+      phiBins_ = 2 * rods.size();
+      phiStart_ = bounds.front().refPhi - PI / phiBins_; // the rods sit in the middle of every other bin
+    } else if (endcap) {
+      z_ = sumZ / bounds.size();
+      int largestRing = 0;
+      for (const auto& ring : rings) largestRing = MAX(largestRing, ring.second);
+      phiBins_ = 2 * largestRing;
+    } else {
+      phiBins_ = MAX(1, int(sqrt(double(bounds.size()))));
+    }
+    // the row decreases with eta on a disk
+    std::map<int, std::pair<double, double> > ringRows; // the rows of the (r, z) envelope of each ring
+    for (const Bounds& b : bounds) {
+      double low = MIN(row(b.etaMin), row(b.etaMax)), high = MAX(row(b.etaMin), row(b.etaMax));
+      auto ringRow = ringRows.insert(std::make_pair(b.ring, std::make_pair(low, high)));
+      ringRow.first->second.first = MIN(ringRow.first->second.first, low);
+      ringRow.first->second.second = MAX(ringRow.first->second.second, high);
+    }
+    rowMin_ = std::numeric_limits<double>::max();
+    rowMax_ = -std::numeric_limits<double>::max();
+    for (const auto& ringRow : ringRows) {
+      rowMin_ = MIN(rowMin_, ringRow.second.first);
+      rowMax_ = MAX(rowMax_, ringRow.second.second);
+      if (barrel || endcap) {
+        rowEdges_.push_back(ringRow.second.first);
+        rowEdges_.push_back(ringRow.second.second);
+      }
+    }
+    if (barrel || endcap) {
+      std::sort(rowEdges_.begin(), rowEdges_.end());
+      rowEdges_.erase(std::unique(rowEdges_.begin(), rowEdges_.end()), rowEdges_.end());
+    } else {
+      int bins = phiBins_;
+      for (int i = 0; i <= bins; i++) rowEdges_.push_back(rowMin_ + (rowMax_ - rowMin_) * i / bins);
+    }
+    rowBins_ = MAX(1, int(rowEdges_.size()) - 1);
+
+    bins_.resize(rowBins_ * phiBins_);
+    // bounds are in ascending module-index order, so each bin keeps the order of the brute-force scan
+    for (const Bounds& b : bounds) {
+      int firstRow = rowBin(MIN(row(b.etaMin), row(b.etaMax))), lastRow = lastRowBin(MAX(row(b.etaMin), row(b.etaMax)));
+      int firstPhi = int(floor((b.phiMin - phiStart_) / (2*PI) * phiBins_));
+      int lastPhi = int(floor((b.phiMax - phiStart_) / (2*PI) * phiBins_));
+      if (lastPhi - firstPhi >= phiBins_) lastPhi = firstPhi + phiBins_ - 1;
+      for (int ir = firstRow; ir <= lastRow; ir++) {
+        for (int ip = firstPhi; ip <= lastPhi; ip++) {
+          bins_[ir * phiBins_ + ((ip % phiBins_) + phiBins_) % phiBins_].push_back(b.index);
+        }
+      }
+    }
+    return true;
+  }
+
+  /**
+   * Get the modules that a track leaving the origin along the given direction could cross. For a barrel layer the
+   * row is the z of the crossing with the average radius of the layer, and for a disk the radius of the crossing with
+   * its average z: neither needs the eta of the track.
+   * @param direction The direction of the track
+   * @return The indices within the layer of the candidate modules, in ascending order
+   */
+  const std::vector<int>& ModuleHitIndex::candidates(const XYZVector& direction) const {
+    if (bins_.empty()) return noCandidates_;
+    double trackRow = radius_ > 0 ? radius_ * direction.Z() / direction.Rho()
+                    : z_ > 0 ? z_ * direction.Rho() / direction.Z() : direction.Eta();
+    if (!(trackRow >= rowMin_ && trackRow <= rowMax_)) return noCandidates_;
+    return bins_[rowBin(trackRow) * phiBins_ + phiBin(direction.Phi())];
+  }
+
+  /**
+   * The row bin of a row, the one it opens if it is on an edge
+   */
+  int ModuleHitIndex::rowBin(double row) const {
+    int bin = int(std::upper_bound(rowEdges_.begin(), rowEdges_.end(), row) - rowEdges_.begin()) - 1;
+    return MAX(0, MIN(rowBins_ - 1, bin));
+  }
+
+  /**
+   * The row bin of the upper end of a range of rows, the one it closes if it is on an edge
+   */
+  int ModuleHitIndex::lastRowBin(double row) const {
+    int bin = int(std::lower_bound(rowEdges_.begin(), rowEdges_.end(), row) - rowEdges_.begin()) - 1;
+    return MAX(0, MIN(rowBins_ - 1, bin));
+  }
+
+  int ModuleHitIndex::phiBin(double phi) const {
+    double phase = normalizedDeltaPhi(phi - phiStart_);
+    if (phase < 0) phase += 2*PI;
+    int bin = int(floor(phase / (2*PI) * phiBins_));
+    return MAX(0, MIN(phiBins_ - 1, bin));
+  }
+
+  const double FrozenModuleIndex::etaMargin = 1e-3;
+
+  /**
+   * Fill the bins with the modules of a frozen tracker
+   * @param modules The frozen modules
+   * @param zMin The lowest z of the origins of the tracks
+   * @param zMax The highest z of the origins of the tracks
+   * @param zSlices The number of slices the range of the origins is split into
+   * @param granularity The number of (eta, phi) bins of a slice, relative to the number of modules
+   */
+  void FrozenModuleIndex::build(const std::vector<ModuleGeometry>& modules, double zMin, double zMax, int zSlices, double granularity) {
+    clear();
+    if (modules.empty()) return;
+    zMin_ = zMin;
+    zMax_ = MAX(zMin, zMax);
+    etaBins_ = phiBins_ = MAX(1, int(sqrt(granularity * modules.size())));
+    slices_.resize(MAX(1, zSlices));
+    std::vector<std::pair<double, double> > etaRanges(modules.size());
+
+    for (int iz = 0; iz < (int)slices_.size(); iz++) {
+      Slice& slice = slices_[iz];
+      double z1 = zMin_ + (zMax_ - zMin_) * iz / slices_.size();
+      double z2 = zMin_ + (zMax_ - zMin_) * (iz + 1) / slices_.size();
+      // eta decreases with r and increases with the z from the origin: the extremes sit on the corners of the (r, z) extent
+      slice.etaMin = std::numeric_limits<double>::max();
+      slice.etaMax = -std::numeric_limits<double>::max();
+      for (int k = 0; k < (int)modules.size(); k++) {
+        const ModuleGeometry& g = modules[k];
+        etaRanges[k].first = XYZVector(0., g.maxR, g.minZ - z2).Eta() - etaMargin;
+        etaRanges[k].second = XYZVector(0., g.minR, g.maxZ - z1).Eta() + etaMargin;
+        slice.etaMin = MIN(slice.etaMin, etaRanges[k].first);
+        slice.etaMax = MAX(slice.etaMax, etaRanges[k].second);
+      }
+      if (!(slice.etaMin < slice.etaMax)) { slice.etaMin = -1; slice.etaMax = 1; }
+
+      slice.bins.resize(etaBins_ * phiBins_);
+      for (int k = 0; k < (int)modules.size(); k++) {
+        const ModuleGeometry& g = modules[k];
+        int firstEta = etaBin(slice, etaRanges[k].first), lastEta = etaBin(slice, etaRanges[k].second);
+        int firstPhi = phiBin(g.minPhi), lastPhi = phiBin(g.maxPhi);
+        // same convention as Analyzer::trackHit(): a range wider than PI across zero is the one across PI
+        if (g.minPhi < 0. && g.maxPhi > 0. && g.maxPhi-g.minPhi > PI) {
+          firstPhi = phiBin(g.maxPhi);
+          lastPhi = phiBin(g.minPhi) + phiBins_;
+        }
+        for (int ie = firstEta; ie <= lastEta; ie++) {
+          for (int ip = firstPhi; ip <= lastPhi; ip++) {
+            slice.bins[ie * phiBins_ + ip % phiBins_].push_back(k);
+          }
+        }
+      }
+    }
+  }
+
+  /**
+   * Get the modules a track could cross
+   * @param eta The eta of the direction of the track
+   * @param phi The phi of the direction of the track
+   * @param z0 The z of the origin of the track, on the z axis
+   * @return The indices of the candidate modules, in ascending order
+   */
+  const std::vector<int>& FrozenModuleIndex::candidates(double eta, double phi, double z0) const {
+    if (slices_.empty()) return noCandidates_;
+    int iz = zMax_ > zMin_ ? int(floor((z0 - zMin_) / (zMax_ - zMin_) * slices_.size())) : 0;
+    const Slice& slice = slices_[MAX(0, MIN((int)slices_.size() - 1, iz))];
+    return slice.bins[etaBin(slice, eta) * phiBins_ + phiBin(phi)];
+  }
+
+  /**
+   * The eta width of the bins of the z0 slice of the given z0, which a track whose eta changes along its path (a helix)
+   * has to be looked up at least once per
+   */
+  double FrozenModuleIndex::etaBinWidth(double z0) const {
+    if (slices_.empty()) return std::numeric_limits<double>::max();
+    int iz = zMax_ > zMin_ ? int(floor((z0 - zMin_) / (zMax_ - zMin_) * slices_.size())) : 0;
+    const Slice& slice = slices_[MAX(0, MIN((int)slices_.size() - 1, iz))];
+    return (slice.etaMax - slice.etaMin) / etaBins_;
+  }
+
+  /**
+   * The total length of the lists of candidates, which is what the index takes in memory
+   */
+  long FrozenModuleIndex::numEntries() const {
+    long entries = 0;
+    for (const Slice& slice : slices_) {
+      for (const std::vector<int>& bin : slice.bins) entries += bin.size();
+    }
+    return entries;
+  }
+
+  int FrozenModuleIndex::etaBin(const Slice& slice, double eta) const {
+    if (!(eta > slice.etaMin)) return 0; // also for a NaN
+    if (eta >= slice.etaMax) return etaBins_ - 1;
+    return MIN(etaBins_ - 1, int(floor((eta - slice.etaMin) / (slice.etaMax - slice.etaMin) * etaBins_)));
+  }
+
+  int FrozenModuleIndex::phiBin(double phi) const {
+    int bin = int(floor((normalizedDeltaPhi(phi) + PI) / (2*PI) * phiBins_));
+    return MAX(0, MIN(phiBins_ - 1, bin));
+  }
+}
@@ -0,0 +1,92 @@
+#include <PathCounters.h>
+
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+#include <messageLogger.h>
+
+// Returns the registry, which lives as long as the program so that the counters can be dumped at exit
+PathCounters* PathCounters::instance() {
+  static PathCounters* myInstance = new PathCounters;
+  return myInstance;
+}
+
+// Whether the macros of the call sites were compiled in
+bool PathCounters::compiledIn() {
+#ifdef TKLAYOUT_COUNTERS
+  return true;
+#else
+  return false;
+#endif
+}
+
+PathCounters::PathCounters() : droppedTraceEvents_(0), origin_(Clock::now()), tracing_(false) {}
+
+/**
+ * Gets a counter by its name, creating it the first time
+ * @param name The name of the counter
+ * @return The counter, whose address does not change afterwards
+ */
+PathCounters::Counter& PathCounters::counter(const std::string& name) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return counters_[name];
+}
+
+/**
+ * Records a timed scope for the trace, keeping at most maxTraceEvents of them
+ * @param name The name of the scope, which must outlive the registry (a string literal)
+ * @param start The time the scope was entered
+ * @param stop The time the scope was left
+ */
+void PathCounters::addTraceEvent(const char* name, const Clock::time_point& start, const Clock::time_point& stop) {
+  TraceEvent event = { name,
+                       (long)std::chrono::duration_cast<std::chrono::microseconds>(start - origin_).count(),
+                       (long)std::chrono::duration_cast<std::chrono::microseconds>(stop - start).count(),
+                       std::hash<std::thread::id>()(std::this_thread::get_id()) };
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (traceEvents_.size() < maxTraceEvents) traceEvents_.push_back(event);
+  else droppedTraceEvents_++;
+}
+
+/**
+ * Lists the counters in alphabetical order, one per line, with the number of updates, their sum and mean
+ * @return The text of the report
+ */
+std::string PathCounters::report() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::ostringstream out;
+  out << std::left << std::setw(60) << "counter" << std::right << std::setw(16) << "count" << std::setw(20) << "sum" << std::setw(16) << "mean" << std::endl;
+  for (const auto& c : counters_) {
+    long count = c.second.count.load(), sum = c.second.sum.load();
+    out << std::left << std::setw(60) << c.first << std::right << std::setw(16) << count << std::setw(20) << sum
+        << std::setw(16) << (count ? double(sum)/count : 0.) << std::endl;
+  }
+  if (droppedTraceEvents_) out << droppedTraceEvents_ << " trace events were dropped" << std::endl;
+  return out.str();
+}
+
+/**
+ * Writes the timed scopes in the Chrome trace-event format, one complete ("X") event per scope
+ * @param fileName The name of the file
+ * @return True if the file could be written
+ */
+bool PathCounters::writeTrace(const std::string& fileName) const {
+  std::ofstream out(fileName.c_str());
+  if (!out) {
+    logERROR("Could not open the trace file " + fileName);
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::map<size_t, int> threadIds; // small thread numbers, in order of appearance
+  out << "{\"traceEvents\": [";
+  for (size_t i = 0; i < traceEvents_.size(); i++) {
+    const TraceEvent& e = traceEvents_[i];
+    int tid = threadIds.insert(std::make_pair(e.thread, (int)threadIds.size())).first->second;
+    out << (i ? ",\n" : "\n") << "{\"name\": \"" << e.name << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << tid
+        << ", \"ts\": " << e.startUs << ", \"dur\": " << e.durationUs << "}";
+  }
+  out << "\n], \"displayTimeUnit\": \"ms\"}" << std::endl;
+  return bool(out);
+}
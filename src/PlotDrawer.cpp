@@ -1,8 +1,48 @@
 #include <PlotDrawer.h>
+#include <algorithm>
 
 int IdMaker::id = 0;
 const int IdMaker::nBinsZoom = 1000;
 
+MapRaster::Mode MapRaster::mode = MapRaster::AUTO;
+const size_t MapRaster::autoThreshold = 5000;
+const int MapRaster::nBins = 600;
+
+/**
+ * Sets the bins of the raster covered by a module outline to the value of the module.
+ * The bins along the edges are set too, so that the modules seen edge-on (or thinner than a bin) still show.
+ * @param raster The raster of the map
+ * @param line The outline of the module
+ * @param value The value of the module
+ */
+void MapRaster::fill(TH2D& raster, TPolyLine& line, double value) {
+  int n = line.GetN();
+  double* x = line.GetX();
+  double* y = line.GetY();
+  if (n == 0) return;
+  TAxis* xAxis = raster.GetXaxis();
+  TAxis* yAxis = raster.GetYaxis();
+  if (n >= 3) {
+    int minBinX = xAxis->FindFixBin(TMath::MinElement(n, x)), maxBinX = xAxis->FindFixBin(TMath::MaxElement(n, x));
+    int minBinY = yAxis->FindFixBin(TMath::MinElement(n, y)), maxBinY = yAxis->FindFixBin(TMath::MaxElement(n, y));
+    for (int ix = minBinX; ix <= maxBinX; ix++) {
+      for (int iy = minBinY; iy <= maxBinY; iy++) {
+        if (TMath::IsInside(xAxis->GetBinCenter(ix), yAxis->GetBinCenter(iy), n, x, y)) raster.SetBinContent(ix, iy, value);
+      }
+    }
+  }
+  double step = std::min(xAxis->GetBinWidth(1), yAxis->GetBinWidth(1)) / 2;
+  for (int i = 0; i < n; i++) {
+    int j = (i + 1) % n;
+    double length = sqrt(pow(x[j] - x[i], 2) + pow(y[j] - y[i], 2));
+    int numSteps = int(length / step) + 1;
+    for (int k = 0; k <= numSteps; k++) {
+      double l = double(k) / numSteps;
+      raster.SetBinContent(xAxis->FindFixBin(x[i] + l * (x[j] - x[i])), yAxis->FindFixBin(y[i] + l * (y[j] - y[i])), value);
+    }
+  }
+}
+
 template<> TH2C* FrameGetter<YZFull>::operator()(double viewportX, double viewportY) const {
   std::string name = std::string("frameYZ") + nextString();
   TH2C* frame = new TH2C(name.c_str(), ";z [mm];r [mm]", nBinsZoom, -viewportX, viewportX, nBinsZoom, 0, viewportY);
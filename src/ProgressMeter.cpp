@@ -0,0 +1,114 @@
+#include <ProgressMeter.h>
+
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <unistd.h>
+
+double ProgressMeter::intervalSeconds_ = 0;
+bool ProgressMeter::print_ = false;
+std::string ProgressMeter::statusFile_;
+
+/**
+ * Sets how the scans report their progress
+ * @param intervalSeconds The time between two reports of a scan, in s; the meters do nothing if it is not positive
+ * @param print Whether the progress lines are printed
+ * @param statusFile The file rewritten with the progress of the running scan, none if empty
+ */
+void ProgressMeter::configure(double intervalSeconds, bool print, const std::string& statusFile) {
+  intervalSeconds_ = intervalSeconds;
+  print_ = print;
+  statusFile_ = statusFile;
+}
+
+/* Whether the scans report their progress */
+bool ProgressMeter::enabled() {
+  return intervalSeconds_ > 0 && (print_ || !statusFile_.empty());
+}
+
+/**
+ * Starts the meter of a scan
+ * @param scan The name of the scan
+ * @param total The number of tracks of the scan, or 0 if it is not known in advance (a scan within a time budget)
+ */
+ProgressMeter::ProgressMeter(const std::string& scan, long total) :
+  scan_(scan), total_(total), active_(enabled()), done_(0), nextReportNs_(0), start_(Clock::now()) {
+  if (active_) nextReportNs_ = long(intervalSeconds_ * 1e9);
+}
+
+/* Reports the scan as finished */
+ProgressMeter::~ProgressMeter() {
+  if (active_) report(true);
+}
+
+/**
+ * Counts tracks as done, reporting the progress if it is time to
+ * @param tracks The number of tracks done
+ */
+void ProgressMeter::advance(long tracks) {
+  if (!active_) return;
+  done_.fetch_add(tracks, std::memory_order_relaxed);
+  long elapsedNs = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start_).count();
+  if (elapsedNs < nextReportNs_.load(std::memory_order_relaxed)) return;
+  // a single thread reports, the others go on
+  std::unique_lock<std::mutex> lock(reportMutex_, std::try_to_lock);
+  if (!lock.owns_lock() || elapsedNs < nextReportNs_.load(std::memory_order_relaxed)) return;
+  nextReportNs_ = elapsedNs + long(intervalSeconds_ * 1e9);
+  report(false);
+}
+
+/**
+ * Prints the progress line and rewrites the status file
+ * @param finished Whether the scan is over
+ */
+void ProgressMeter::report(bool finished) {
+  long done = done_.load(std::memory_order_relaxed);
+  double elapsed = std::chrono::duration<double>(Clock::now() - start_).count();
+  double rate = elapsed > 0 ? done / elapsed : 0;
+  double left = total_ > 0 && rate > 0 ? (total_ - done) / rate : -1;
+  long rssKb = residentKb();
+
+  if (print_ && !finished) {
+    std::ostringstream line;
+    line << std::fixed << std::setprecision(1) << scan_ << ": " << done;
+    if (total_ > 0) line << "/" << total_;
+    line << " tracks";
+    if (total_ > 0) line << " (" << 100. * done / total_ << "%)";
+    line << ", " << rate << " tracks/s";
+    if (left >= 0) line << ", " << left << " s left";
+    line << ", RSS " << rssKb / 1024. << " MB";
+    std::cout << std::endl << "  " << line.str() << std::flush;
+  }
+
+  if (!statusFile_.empty()) {
+    char host[256] = "";
+    gethostname(host, sizeof(host) - 1);
+    std::ostringstream json;
+    json << std::fixed << std::setprecision(3)
+         << "{\"scan\": \"" << scan_ << "\", \"host\": \"" << host << "\", \"pid\": " << getpid()
+         << ", \"time\": " << (long)time(NULL) << ", \"done\": " << done << ", \"total\": " << total_
+         << ", \"elapsed_s\": " << elapsed << ", \"tracks_per_s\": " << rate << ", \"left_s\": ";
+    if (left >= 0) json << left;
+    else json << "null";
+    json << ", \"rss_mb\": " << rssKb / 1024. << ", \"finished\": " << (finished ? "true" : "false") << "}" << std::endl;
+    std::string tempFile = statusFile_ + ".tmp";
+    std::ofstream out(tempFile.c_str());
+    out << json.str();
+    out.close();
+    if (!out || std::rename(tempFile.c_str(), statusFile_.c_str()) != 0) {
+      std::cerr << "Could not write the status file " << statusFile_ << std::endl;
+      std::remove(tempFile.c_str());
+    }
+  }
+}
+
+/* Returns the current resident memory of the process, in kB */
+long ProgressMeter::residentKb() {
+  long pages = 0, residentPages = 0;
+  std::ifstream statm("/proc/self/statm");
+  if (!(statm >> pages >> residentPages)) return 0;
+  return residentPages * (sysconf(_SC_PAGESIZE) / 1024);
+}
@@ -14,5 +14,24 @@
 std::function<int()> noDefault() { return [](){ throw std::logic_error("Tried to get value from an unset property"); return 0; }; }
 std::function<bool()> cacheIf(const bool& flag) { return [&flag]() { return flag; }; }
 
+unsigned int ComputableEpoch::current = 0;
+
 std::set<string> PropertyObject::globalMatchedProperties_;
 std::set<string> PropertyObject::globalUnmatchedProperties_;
+std::mutex PropertyObject::globalPropertiesMutex_;
+
+/**
+ * Hash the content of a property tree: the data, and the keys and contents of the children in their order.
+ * Two trees with the same hash are taken to build the same object.
+ * @param pt The tree to be hashed
+ * @return The hash of the tree
+ */
+std::size_t PropertyObject::contentHash(const PropertyTree& pt) {
+  std::hash<string> hashString;
+  std::size_t seed = hashString(pt.data());
+  for (const auto& child : pt) {
+    seed ^= hashString(child.first) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+    seed ^= contentHash(child.second) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+  }
+  return seed;
+}
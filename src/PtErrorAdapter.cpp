@@ -10,18 +10,36 @@ const double PtErrorAdapter::ptFitParamsLow[]  = { 2.52523e+01, -6.84183e+00, -1
 const double PtErrorAdapter::ptFitParamsMid[]  = { 7.27638e-01, -1.04041e+00,  8.56495e+00,  6.52714e-03}; // 1 GeV to 4 GeV     Chi^2 / dof = 84.2299/71 = 1.18634
 const double PtErrorAdapter::ptFitParamsHigh[] = { 4.66514e+01, -2.88910e+00, -3.78716e+01,  1.26635e-01}; // 4 GeV to 10 GeV    Chi^2 / dof = 102.736/135 = 0.76101
 
-void PtErrorAdapter::setPterrorParameters() {
-  myPtError.setDistance( mod_.dsDistance() );
-  myPtError.setEffectiveDistance( mod_.effectiveDsDistance() );
-  myPtError.setPitch(mod_.outerSensor().pitch());
-  myPtError.setStripLength( mod_.outerSensor().stripLength() );
+void PtErrorAdapter::cacheModuleParameters() {
+  params_.dsDistance = mod_.dsDistance();
+  params_.effectiveDsDistance = mod_.effectiveDsDistance();
+  params_.pitch = mod_.outerSensor().pitch();
+  params_.stripLength = mod_.outerSensor().stripLength();
   XYZVector center = mod_.center();
-  myPtError.setZ(fabs(center.Z()));
-  myPtError.setR(center.Rho());
-  myPtError.setHeight(mod_.length());
-  myPtError.setZCorrelation(mod_.zCorrelation());
-  myPtError.setModuleType(mod_.subdet());
-  myPtError.setTilt(mod_.tiltAngle());
+  params_.z = center.Z();
+  params_.rho = center.Rho();
+  params_.theta = center.Theta();
+  params_.length = mod_.length();
+  params_.tilt = mod_.tiltAngle();
+  params_.geometricEfficiency = mod_.geometricEfficiency();
+  params_.phiAperture = mod_.phiAperture();
+  params_.etaAperture = mod_.etaAperture();
+  params_.zCorrelation = mod_.zCorrelation();
+  params_.subdet = mod_.subdet();
+  params_.triggerWindow = mod_.triggerWindow();
+}
+
+void PtErrorAdapter::setPterrorParameters() {
+  myPtError.setDistance( params_.dsDistance );
+  myPtError.setEffectiveDistance( params_.effectiveDsDistance );
+  myPtError.setPitch(params_.pitch);
+  myPtError.setStripLength( params_.stripLength );
+  myPtError.setZ(fabs(params_.z));
+  myPtError.setR(params_.rho);
+  myPtError.setHeight(params_.length);
+  myPtError.setZCorrelation(params_.zCorrelation);
+  myPtError.setModuleType(params_.subdet);
+  myPtError.setTilt(params_.tilt);
 }
 
 
@@ -29,19 +47,19 @@ double PtErrorAdapter::getTriggerProbability(const double& trackPt, const double
   setPterrorParameters();
   if (stereoDistance!=0) {
     myPtError.setDistance(stereoDistance);
-    if (fabs(mod_.tiltAngle()) < 1e-3) myPtError.setEffectiveDistance(mod_.dsDistance()); // CUIDADO temporary fix!!! this belongs inside a function
-    else myPtError.setEffectiveDistance(mod_.dsDistance()*sin(mod_.center().Theta())/sin(mod_.center().Theta()+mod_.tiltAngle()));
+    if (fabs(params_.tilt) < 1e-3) myPtError.setEffectiveDistance(params_.dsDistance); // CUIDADO temporary fix!!! this belongs inside a function
+    else myPtError.setEffectiveDistance(params_.dsDistance*sin(params_.theta)/sin(params_.theta+params_.tilt));
 
   }
   int thisTriggerWindow;
   if (triggerWindow!=0) thisTriggerWindow = triggerWindow;
-  else thisTriggerWindow = mod_.triggerWindow();
+  else thisTriggerWindow = params_.triggerWindow;
   double pt_cut = stripsToP(thisTriggerWindow/2.);
   // Error on curvatre is the relative error of trackPt times the
   // curvature (cur = 1/pt)
   double cur_error = myPtError.computeError(trackPt) / trackPt; 
   double result;
-  result = myPtError.probabilityInside(1/pt_cut, 1/trackPt, cur_error) * mod_.geometricEfficiency();
+  result = myPtError.probabilityInside(1/pt_cut, 1/trackPt, cur_error) * params_.geometricEfficiency;
   // std::cerr << "trigger prob @ " << trackPt << " GeV/c is " << result <<std::endl; // debug
   return result;
 }
@@ -60,17 +78,22 @@ double PtErrorAdapter::getTriggerFrequencyTruePerEventBelow(const double& myCut)
   return getTriggerFrequencyTruePerEventBetween(ptMinFit, myCut);
 }
 
-// TODO: this and the next one should be merged in the same code...
-double PtErrorAdapter::getTriggerFrequencyTruePerEventBetween(double myLowCut, double myHighCut) { 
+/**
+ * The steps of the integrals over the pt spectrum between two cuts
+ * @param pts The pt of each step
+ * @param weights The number of particles per event in each step crossing the module
+ */
+void PtErrorAdapter::ptSpectrum(double myLowCut, double myHighCut, std::vector<double>& pts, std::vector<double>& weights) const {
   if (myLowCut<ptMinFit) myLowCut=ptMinFit;
   if (myHighCut>ptMaxFit) myHighCut=ptMaxFit;
-  double r = mod_.center().Rho()/1000;
+  double r = params_.rho/1000;
   double ptMin = MAX(0.3 * insur::magnetic_field * r, myLowCut);
-  double integral = 0.0;
   double dPt = 0.05;
-  double etaphi = mod_.phiAperture()/(2.0*3.141592)*fabs(mod_.etaAperture())/6.0;	
+  double etaphi = params_.phiAperture/(2.0*3.141592)*fabs(params_.etaAperture)/6.0;	
   double nPt;
   const double* ptFitParams;
+  pts.clear();
+  weights.clear();
   for (double pt = ptMin; pt < myHighCut; pt += dPt) {
     if (pt < 1) ptFitParams = ptFitParamsLow;
     else if (pt < 6) ptFitParams = ptFitParamsMid;
@@ -81,37 +104,106 @@ double PtErrorAdapter::getTriggerFrequencyTruePerEventBetween(double myLowCut, d
               + ptFitParams[2] * pow(pt,-0.1)
               + ptFitParams[3] * pow(pt,2))/12000;
 
-    integral += getTriggerProbability(pt) * (nPt/4e-2) * etaphi * dPt;
+    pts.push_back(pt);
+    weights.push_back((nPt/4e-2) * etaphi * dPt);
   }
+}
+
+/**
+ * The trigger probabilities of all the steps are evaluated in one batch, with the module parameters set once
+ */
+double PtErrorAdapter::getTriggerFrequencyTruePerEventBetween(double myLowCut, double myHighCut) { 
+  std::vector<double> pts, weights;
+  ptSpectrum(myLowCut, myHighCut, pts, weights);
+  setPterrorParameters();
+  double pt_cut = stripsToP(params_.triggerWindow/2.);
+  std::vector<double> cuts(pts.size(), 1/pt_cut), curvatures(pts.size()), errors(pts.size()), probabilities(pts.size());
+  for (unsigned int i = 0; i < pts.size(); i++) {
+    curvatures[i] = 1/pts[i];
+    errors[i] = myPtError.computeError(pts[i]) / pts[i];
+  }
+  ptError::probabilityInside(pts.size(), cuts.data(), curvatures.data(), errors.data(), probabilities.data());
+  double integral = 0.0;
+  for (unsigned int i = 0; i < pts.size(); i++) integral += probabilities[i] * params_.geometricEfficiency * weights[i];
 
   return integral;
 }
 
-// TODO: this and the previous one should be merged in the same code...
 double PtErrorAdapter::getParticleFrequencyPerEventBetween(double myLowCut, double myHighCut) {
-  if (myLowCut<ptMinFit) myLowCut=ptMinFit;
-  if (myHighCut>ptMaxFit) myHighCut=ptMaxFit;
-  double r = mod_.center().Rho()/1000;
-  double ptMin = MAX(0.3 * insur::magnetic_field * r, myLowCut);
+  std::vector<double> pts, weights;
+  ptSpectrum(myLowCut, myHighCut, pts, weights);
   double integral = 0.0;
-  double dPt = 0.05;
-  double etaphi = mod_.phiAperture()/(2.0*3.141592)*fabs(mod_.etaAperture())/6.0;	
-  double nPt;
-  const double* ptFitParams;
-  for (double pt = ptMin; pt < myHighCut; pt += dPt) {
-    if (pt < 1) ptFitParams = ptFitParamsLow;
-    else if (pt < 6) ptFitParams = ptFitParamsMid;
-    else ptFitParams = ptFitParamsHigh;
+  for (double weight : weights) integral += weight;
 
-    nPt = exp(ptFitParams[0]
-              + ptFitParams[1] * pt
-              + ptFitParams[2] * pow(pt,-0.1)
-              + ptFitParams[3] * pow(pt,2))/12000;
+  return integral;
+}
 
-    integral += (nPt/4e-2) * etaphi * dPt;
+/**
+ * The trigger probabilities of a series of track pts, as given by <i>getTriggerProbability()</i> with the stereo distance
+ * and the trigger window of the module, evaluated in one batch with the module parameters set once
+ * @param trackPts The pts of the tracks
+ * @param probabilities The probabilities, one per pt in the same order
+ */
+void PtErrorAdapter::getTriggerProbabilities(const std::vector<double>& trackPts, std::vector<double>& probabilities) {
+  setPterrorParameters();
+  double pt_cut = stripsToP(params_.triggerWindow/2.);
+  std::vector<double> cuts(trackPts.size(), 1/pt_cut), curvatures(trackPts.size()), errors(trackPts.size());
+  for (unsigned int i = 0; i < trackPts.size(); i++) {
+    curvatures[i] = 1/trackPts[i];
+    errors[i] = myPtError.computeError(trackPts[i]) / trackPts[i];
   }
+  probabilities.resize(trackPts.size());
+  ptError::probabilityInside(trackPts.size(), cuts.data(), curvatures.data(), errors.data(), probabilities.data());
+  for (double& probability : probabilities) probability *= params_.geometricEfficiency;
+}
 
-  return integral;
+/**
+ * The frequencies of <i>getParticleFrequencyPerEventAbove()</i>, <i>getTriggerFrequencyTruePerEventAbove()</i> and
+ * <i>getTriggerFrequencyTruePerEventBelow()</i> for a series of cuts: the trigger probabilities of the steps of all the
+ * integrals are evaluated in a single batch
+ * @param cuts The pt cuts
+ * @param particlesAbove The particle frequencies above each cut
+ * @param trueAbove The true stub frequencies above each cut
+ * @param trueBelow The true stub frequencies below each cut
+ */
+void PtErrorAdapter::getFrequenciesPerEvent(const std::vector<double>& cuts, std::vector<double>& particlesAbove, std::vector<double>& trueAbove, std::vector<double>& trueBelow) {
+  std::vector<double> pts, weights, rangePts, rangeWeights;
+  std::vector<size_t> rangeEnds; // the steps of the range above the first cut, below the first cut, above the second cut...
+  for (double cut : cuts) {
+    for (int below = 0; below < 2; below++) {
+      if (below) ptSpectrum(ptMinFit, cut, rangePts, rangeWeights);
+      else ptSpectrum(cut, ptMaxFit, rangePts, rangeWeights);
+      pts.insert(pts.end(), rangePts.begin(), rangePts.end());
+      weights.insert(weights.end(), rangeWeights.begin(), rangeWeights.end());
+      rangeEnds.push_back(pts.size());
+    }
+  }
+  setPterrorParameters();
+  double pt_cut = stripsToP(params_.triggerWindow/2.);
+  std::vector<double> ptCuts(pts.size(), 1/pt_cut), curvatures(pts.size()), errors(pts.size()), probabilities(pts.size());
+  for (unsigned int i = 0; i < pts.size(); i++) {
+    curvatures[i] = 1/pts[i];
+    errors[i] = myPtError.computeError(pts[i]) / pts[i];
+  }
+  ptError::probabilityInside(pts.size(), ptCuts.data(), curvatures.data(), errors.data(), probabilities.data());
+
+  particlesAbove.assign(cuts.size(), 0.);
+  trueAbove.assign(cuts.size(), 0.);
+  trueBelow.assign(cuts.size(), 0.);
+  size_t first = 0;
+  for (unsigned int r = 0; r < rangeEnds.size(); r++) {
+    double particles = 0.0, integral = 0.0;
+    for (size_t i = first; i < rangeEnds[r]; i++) {
+      particles += weights[i];
+      integral += probabilities[i] * params_.geometricEfficiency * weights[i];
+    }
+    if (r % 2) trueBelow[r / 2] = integral;
+    else {
+      particlesAbove[r / 2] = particles;
+      trueAbove[r / 2] = integral;
+    }
+    first = rangeEnds[r];
+  }
 }
 
 double PtErrorAdapter::getTriggerFrequencyFakePerEvent() {
@@ -119,25 +211,25 @@ double PtErrorAdapter::getTriggerFrequencyFakePerEvent() {
 }
 
 double PtErrorAdapter::getPtThreshold(const double& myEfficiency) {
-  double pt_cut = stripsToP(mod_.triggerWindow()/2.);
+  double pt_cut = stripsToP(params_.triggerWindow/2.);
   return find_probability(myEfficiency, pt_cut);
 }
 
 double PtErrorAdapter::stripsToP(double strips) const {
-  double A = 0.3 * insur::magnetic_field * mod_.center().Rho() / 1000. / 2.; // GeV
+  double A = 0.3 * insur::magnetic_field * params_.rho / 1000. / 2.; // GeV
   double p;
   double x;
-  double effective_d = mod_.effectiveDsDistance();
+  double effective_d = params_.effectiveDsDistance;
 
-  x = strips * mod_.outerSensor().pitch();
+  x = strips * params_.pitch;
   p = A * sqrt( pow(effective_d/x,2) + 1 );
   return p;
 }
 
 double PtErrorAdapter::pToStrips(double p) const {
-  double A = 0.3 * insur::magnetic_field * mod_.center().Rho() / 1000. / 2.; // GeV
+  double A = 0.3 * insur::magnetic_field * params_.rho / 1000. / 2.; // GeV
   double a = pow(p/A,2);
-  double strips = mod_.effectiveDsDistance() / sqrt(a-1) / mod_.outerSensor().pitch();
+  double strips = params_.effectiveDsDistance / sqrt(a-1) / params_.pitch;
 
   return strips;
 } 
@@ -147,8 +239,8 @@ double PtErrorAdapter::find_probability(double target, double ptCut) {
   double lowerPt = minimumPt;
   double higherPt = maximumPt;
 
-  double lowerProbability =  mod_.geometricEfficiency() * myPtError.probabilityInside(1/ptCut, 1/lowerPt, myPtError.computeError(lowerPt)/lowerPt);
-  double higerProbability =  mod_.geometricEfficiency() * myPtError.probabilityInside(1/ptCut, 1/higherPt, myPtError.computeError(higherPt)/higherPt);
+  double lowerProbability =  params_.geometricEfficiency * myPtError.probabilityInside(1/ptCut, 1/lowerPt, myPtError.computeError(lowerPt)/lowerPt);
+  double higerProbability =  params_.geometricEfficiency * myPtError.probabilityInside(1/ptCut, 1/higherPt, myPtError.computeError(higherPt)/higherPt);
 
   double testPt;
   double testProbability;
@@ -164,7 +256,7 @@ double PtErrorAdapter::find_probability(double target, double ptCut) {
     //std::cerr << std::endl;
     //std::cerr << "****** STEP # " << i << "*********" << std::endl;
     testPt = sqrt(lowerPt*higherPt);
-    testProbability = mod_.geometricEfficiency() * myPtError.probabilityInside(1/ptCut, 1/testPt, myPtError.computeError(testPt)/testPt);
+    testProbability = params_.geometricEfficiency * myPtError.probabilityInside(1/ptCut, 1/testPt, myPtError.computeError(testPt)/testPt);
     //std::cerr << "Geometric efficiency is " << geometricEfficiency() << std::endl;
     //std::cerr << "LO: prob("<<lowerPt<<") = " << lowerProbability << std::endl;
     //std::cerr << "HI: prob("<<higherPt<<") = " << higerProbability << std::endl;
@@ -185,5 +277,5 @@ double PtErrorAdapter::find_probability(double target, double ptCut) {
 }
 
 double PtErrorAdapter::getPtCut() const {
-  return stripsToP(mod_.triggerWindow()/2.);
+  return stripsToP(params_.triggerWindow/2.);
 }
@@ -28,28 +28,39 @@ void Ring::cutAtEta(double eta) { modules_.erase_if([eta](EndcapModule& m) { ret
 double Ring::computeTentativePhiAperture(double moduleWaferDiameter, double minRadius) {
   double r = moduleWaferDiameter/2;
 
-  double l = (minRadius-r);
-  double y = pow(r/l, 2);
-  double x = solvex(y);
-
-
-  double tempd;
-
+  // l is the root of residual(l): the fixed point iteration on it converges linearly, and very slowly for the wider wedges,
+  // so it only gives the two starting points of secant steps. It is kept as a whole when the secant steps do not converge
+  auto fixedPointStep = [&](double length) { double y = pow(r/length, 2); return compute_l(solvex(y), y, minRadius); };
+  auto residual = [&](double length) { double y = pow(r/length, 2); return compute_d(solvex(y), y, length) - minRadius; };
+  double tolerance = 1e-12*minRadius;
+
+  double l = fixedPointStep(minRadius-r);
+  double f = residual(l);
   int i = 0;
-  for (; i < MAX_WEDGE_CALC_LOOPS; i++) {
-    l = compute_l(x, y, minRadius);
-    y = pow(r/l, 2);
-    x = solvex(y);
-
-    tempd = compute_d(x, y, l);
-
-    if (fabs(minRadius - tempd)<1e-15) break;
+  if (minRadius > r) {
+    double lPrevious = l, fPrevious = f;
+    l = fixedPointStep(l);
+    f = residual(l);
+    for (; i < MAX_WEDGE_CALC_LOOPS && fabs(f) > tolerance && f != fPrevious; i++) {
+      double lNext = l - f*(l-lPrevious)/(f-fPrevious);
+      lPrevious = l; fPrevious = f;
+      l = lNext;
+      f = residual(l);
+    }
   }
 
-  if (i >= MAX_WEDGE_CALC_LOOPS) {
-    //logWarning("Maximum number of iterations hit while computing wedge geometry");
+  if (fabs(f) <= tolerance && l > 0) {
+    logDEBUG("Wedge geometry computed after " + any2str(i+2) + " iterations, residual " + any2str(f) + " mm");
+  } else {
+    l = minRadius-r;
+    for (i = 0; i < MAX_WEDGE_CALC_LOOPS; i++) {
+      l = fixedPointStep(l);
+      if (fabs(residual(l))<1e-15) break;
+    }
+    logDEBUG("Wedge geometry computed by fixed point iteration after " + any2str(i) + " iterations, residual " + any2str(residual(l)) + " mm");
   }
 
+  double x = solvex(pow(r/l, 2));
   double alpha = asin(sqrt(x)) * 2;
 
   return alpha;
@@ -84,9 +95,9 @@ void Ring::buildModules(EndcapModule* templ, int numMods, double smallDelta) {
   for (int i = 0, parity = smallParity(); i < numMods; i++, parity *= -1) {
     EndcapModule* mod = GeometryFactory::clone(*templ);
     mod->myid(i+1);
-    mod->rotateZ(2*M_PI*(i+alignmentRotation)/numMods); // CUIDADO had a rotation offset of PI/2
-    mod->rotateZ(zRotation());
-    mod->translateZ(parity*smallDelta); 
+    mod->place(CoordinateOperations::Placement().rotateZ(2*M_PI*(i+alignmentRotation)/numMods) // CUIDADO had a rotation offset of PI/2
+                                                .rotateZ(zRotation())
+                                                .translateZ(parity*smallDelta));
     modules_.push_back(mod);  
   }
 }
@@ -197,7 +208,7 @@ void Ring::build() {
   }
 
   try {
-    logINFO(Form("Building %s", fullid(*this).c_str()));
+    logINFO("Building " + fullid(*this));
     check();
     if (buildDirection() == BOTTOMUP) buildBottomUp();
     else buildTopDown();
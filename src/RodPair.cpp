@@ -73,11 +73,17 @@ void StraightRodPair::compressToZ(double z) {
     }
   }
 
+  // Each round scales the z of the modules by the fraction the rod exceeds by. The guards keeping the modules of a parity
+  // from overlapping damp how far the end of the rod moves, so each step is divided by the fraction of the previous step
+  // the end actually moved by (a secant step on the scale), rather than waiting for the damped steps to add up
+  auto secantGain = [](double gain, double before, double after) { return MAX(0.2, MIN(1., gain*(before-after)/before)); };
+
   logINFO("Iterative compression of Z+ rod");
   int i;
   static const int maxIterations = 50;
+  double gain = 1.;
   for (i = 0; fabs(Deltap) > 0.1 && i < maxIterations; i++) {
-    double deltap=Deltap/((findMaxZModule().center()).Z());
+    double deltap=Deltap/((findMaxZModule().center()).Z())/gain;
     std::map<int, double> zGuards;
     zGuards[1] = zGuards[-1] = std::numeric_limits<double>::lowest();
     int parity = zPlusParity();
@@ -90,7 +96,9 @@ void StraightRodPair::compressToZ(double z) {
       double maxPhysZ = MAX(it->planarMaxZ(), it->center().Z() + it->physicalLength()/2);
       zGuards[parity] = maxPhysZ;
     }
+    double previousDeltap = Deltap;
     Deltap =  fabs(z) - findMaxZModule().planarMaxZ();
+    gain = secantGain(gain, previousDeltap, Deltap);
   }
   if (i == maxIterations) {
     logINFO("Iterative compression didn't terminate after " + any2str(maxIterations) + " iterations. Z+ rod still exceeds by " + any2str(fabs(Deltap))); 
@@ -98,8 +106,9 @@ void StraightRodPair::compressToZ(double z) {
   } else logINFO("Z+ rod successfully compressed after " + any2str(i) + " iterations. Rod now only exceeds by " + any2str(fabs(Deltap)) + " mm.");
 
   logINFO("Iterative compression of Z- rod");
+  gain = 1.;
   for (i = 0; fabs(Deltam) > 0.1 && i < maxIterations; i++) {
-    double deltam=Deltam/((findMinZModule().center()).Z()); // this can be optimized
+    double deltam=Deltam/((findMinZModule().center()).Z())/gain;
     std::map<int, double> zGuards;
     zGuards[1] = zGuards[-1] = std::numeric_limits<double>::max();
     int parity = -zPlusParity();
@@ -112,9 +121,11 @@ void StraightRodPair::compressToZ(double z) {
       double minPhysZ = MIN(it->planarMinZ(), it->center().Z() - it->physicalLength()/2);
       zGuards[parity] = minPhysZ;
     }
+    double previousDeltam = Deltam;
     Deltam = -fabs(z) - findMinZModule().planarMinZ(); 
+    gain = secantGain(gain, previousDeltam, Deltam);
   }  
-  if (i == 20) {
+  if (i == maxIterations) {
     logINFO("Iterative compression didn't terminate after " + any2str(maxIterations) + " iterations. Z- rod still exceeds by " + any2str(fabs(Deltam))); 
     logWARNING("Failed to compress Z- rod. Still exceeding by " + any2str(fabs(Deltam)) + ". Check info tab.");
   } else logINFO("Z- rod successfully compressed after " + any2str(i) + " iterations. Rod now only exceeds by " + any2str(fabs(Deltam)) + " mm.");
@@ -315,8 +326,8 @@ void StraightRodPair::buildModules(Container& modules, const RodTemplate& rodTem
     //mod->store(propertyTree());
     //if (ringNode.count(i+1) > 0) mod->store(ringNode.at(i+1)); 
     //mod->build();
-    mod->translateR(parity > 0 ? smallDelta() : -smallDelta());
-    mod->translateZ(posList[i] + (direction == BuildDir::RIGHT ? mod->length()/2 : -mod->length()/2));
+    mod->place(CoordinateOperations::Placement().translate(mod->rAxis().Unit()*(parity > 0 ? smallDelta() : -smallDelta()))
+                                                .translateZ(posList[i] + (direction == BuildDir::RIGHT ? mod->length()/2 : -mod->length()/2)));
    // mod->translate(XYZVector(parity > 0 ? smallDelta() : -smallDelta(), 0, posList[i])); // CUIDADO: we are now translating the center instead of an edge as before
     modules.push_back(mod);
   }
@@ -360,7 +371,7 @@ void StraightRodPair::build(const RodTemplate& rodTemplate) {
   materialObject_.build();
 
   try {
-    logINFO(Form("Building %s", fullid(*this).c_str()));
+    logINFO("Building " + fullid(*this));
     check();
     if (!mezzanine()) buildFull(rodTemplate);
     else buildMezzanine(rodTemplate);
@@ -380,8 +391,7 @@ void TiltedRodPair::buildModules(Container& modules, const RodTemplate& rodTempl
     mod->myid(i+1);
     mod->side(side);
     mod->tilt(side * tmspecs[i].gamma);
-    mod->translateR(tmspecs[i].r);
-    mod->translateZ(side * tmspecs[i].z);
+    mod->place(CoordinateOperations::Placement().translate(mod->rAxis().Unit()*tmspecs[i].r).translateZ(side * tmspecs[i].z));
     modules.push_back(mod);
   }
 }
@@ -392,7 +402,7 @@ void TiltedRodPair::build(const RodTemplate& rodTemplate, const std::vector<Tilt
   materialObject_.build();
 
   try {
-    logINFO(Form("Building %s", fullid(*this).c_str()));
+    logINFO("Building " + fullid(*this));
     check();
     buildModules(zPlusModules_, rodTemplate, tmspecs, BuildDir::RIGHT);
     buildModules(zMinusModules_, rodTemplate, tmspecs, BuildDir::LEFT);
@@ -0,0 +1,111 @@
+#include <RunEstimate.h>
+
+#include <iomanip>
+#include <sstream>
+#include <StopWatch.h>
+#include <TaskPool.h>
+
+/**
+ * The number of tracks a scan is calibrated with: as many tracks per thread of the pool, and at most half of the
+ * tracks requested, since the scan is also run with twice as many
+ * @param tracks The number of tracks requested
+ * @param tracksPerThread The number of calibration tracks per thread
+ * @return The number of calibration tracks, at least 1
+ */
+int RunEstimate::calibrationTracks(int tracks, int tracksPerThread) {
+  long long calibration = (long long)tracksPerThread * TaskPool::instance()->numThreads();
+  if (calibration > tracks / 2) calibration = tracks / 2;
+  return calibration > 1 ? int(calibration) : 1;
+}
+
+// Runs a stage within a task of the stop watch, and takes its resources from the task
+bool RunEstimate::timed(const std::string& name, const std::function<bool()>& run, Cost& cost) {
+  StopWatch* stopWatch = StopWatch::instance();
+  size_t index = stopWatch->tasks().size();
+  stopWatch->startCounter(name);
+  bool success = run();
+  stopWatch->stopCounter();
+  const StopWatch::Task& task = stopWatch->tasks()[index];
+  cost.wallSeconds = task.wallSeconds;
+  cost.cpuSeconds = task.cpuSeconds;
+  cost.peakRssKb = task.peakRssKb;
+  return success;
+}
+
+/**
+ * Runs a stage whose cost does not depend on the number of tracks, as the run would
+ * @param stage The name of the stage
+ * @param run The stage, returning false if it failed
+ * @return False if the stage failed
+ */
+bool RunEstimate::measure(const std::string& stage, const std::function<bool()>& run) {
+  Stage measured;
+  measured.name = stage;
+  measured.tracks = measured.calibrationTracks = 0;
+  if (!timed("Estimating " + stage, run, measured.measured)) return false;
+  measured.projected = measured.measured;
+  stages_.push_back(measured);
+  return true;
+}
+
+/**
+ * Runs a track scan with the calibration number of tracks and with twice as many, and projects its cost with the
+ * requested number of tracks
+ * @param stage The name of the stage
+ * @param tracks The number of tracks requested
+ * @param calibrationTracks The number of tracks of the first calibration scan
+ * @param run The scan of the given number of tracks, returning false if it failed
+ * @return False if a scan failed
+ */
+bool RunEstimate::measureScaling(const std::string& stage, int tracks, int calibrationTracks, const std::function<bool(int)>& run) {
+  Cost small, large;
+  if (!timed("Estimating " + stage + " with " + std::to_string(calibrationTracks) + " tracks", [&]() { return run(calibrationTracks); }, small) ||
+      !timed("Estimating " + stage + " with " + std::to_string(2 * calibrationTracks) + " tracks", [&]() { return run(2 * calibrationTracks); }, large)) return false;
+  Stage measured;
+  measured.name = stage;
+  measured.tracks = tracks;
+  measured.calibrationTracks = calibrationTracks;
+  measured.measured = large;
+  // the fixed cost and the cost of a track, neither of which can be negative whatever the noise of the timings
+  auto project = [&](double smallCost, double largeCost) {
+    double perTrack = largeCost > smallCost ? (largeCost - smallCost) / calibrationTracks : 0;
+    double fixed = smallCost > perTrack * calibrationTracks ? smallCost - perTrack * calibrationTracks : 0;
+    return fixed + perTrack * tracks;
+  };
+  measured.projected.wallSeconds = project(small.wallSeconds, large.wallSeconds);
+  measured.projected.cpuSeconds = project(small.cpuSeconds, large.cpuSeconds);
+  // the memory the scan keeps per track adds up over the tracks beyond those of the second calibration scan
+  double trackRssKb = large.peakRssKb > small.peakRssKb ? (large.peakRssKb - small.peakRssKb) / calibrationTracks : 0;
+  measured.projected.peakRssKb = large.peakRssKb + (tracks > 2 * calibrationTracks ? trackRssKb * (tracks - 2 * calibrationTracks) : 0);
+  stages_.push_back(measured);
+  return true;
+}
+
+/**
+ * Lists the stages in the order they were measured, one per line, with the tracks they were calibrated with and their
+ * projected wall clock time, CPU time and peak memory, followed by the total of the run
+ * @return The text of the report
+ */
+std::string RunEstimate::report() const {
+  std::ostringstream out;
+  out << "Estimate of the run on this machine, with " << TaskPool::instance()->numThreads() << " thread" << (TaskPool::instance()->numThreads() > 1 ? "s" : "") << std::endl;
+  out << std::left << std::setw(40) << "stage" << std::right << std::setw(12) << "tracks" << std::setw(14) << "calibration"
+      << std::setw(14) << "wall [s]" << std::setw(14) << "cpu [s]" << std::setw(18) << "peak memory [MB]" << std::endl;
+  Cost total;
+  for (const Stage& stage : stages_) {
+    out << std::left << std::setw(40) << stage.name << std::right;
+    if (stage.calibrationTracks) out << std::setw(12) << stage.tracks << std::setw(14) << stage.calibrationTracks;
+    else out << std::setw(12) << "-" << std::setw(14) << "-";
+    out << std::setw(14) << std::fixed << std::setprecision(1) << stage.projected.wallSeconds << std::setw(14) << stage.projected.cpuSeconds
+        << std::setw(18) << stage.projected.peakRssKb / 1024 << std::endl;
+    total.wallSeconds += stage.projected.wallSeconds;
+    total.cpuSeconds += stage.projected.cpuSeconds;
+    if (stage.projected.peakRssKb > total.peakRssKb) total.peakRssKb = stage.projected.peakRssKb;
+  }
+  long seconds = long(total.wallSeconds + 0.5);
+  out << std::left << std::setw(66) << "total" << std::right << std::setw(14) << total.wallSeconds << std::setw(14) << total.cpuSeconds
+      << std::setw(18) << total.peakRssKb / 1024 << std::endl;
+  out << "Projected wall time " << seconds / 3600 << ":" << std::setfill('0') << std::setw(2) << seconds / 60 % 60 << ":" << std::setw(2) << seconds % 60
+      << " (the reports and the website are not included)" << std::endl;
+  return out.str();
+}
@@ -6,30 +6,35 @@ double Sensor::normalOffset() const {
   return parent_->numSensors() <= 1 ? 0. : (myid() == 1 ? -parent_->dsDistance()/2. : parent_->dsDistance()/2.);
 }
 
-Polygon3d<4>* Sensor::buildOwnPoly(double polyOffset) const {
-  Polygon3d<4>* p = new Polygon3d<4>(parent_->basePoly());
-  p->translate(p->getNormal()*polyOffset);
+Polygon3d<4> Sensor::buildOwnPoly(double polyOffset) const {
+  Polygon3d<4> p(parent_->basePoly());
+  p.translate(p.getNormal()*polyOffset);
   return p;
 }
 
-void Sensor::clearPolys() { 
-  delete hitPoly_; 
-  hitPoly_ = 0; 
-  delete envPoly_;
-  envPoly_ = 0;
+double Sensor::envelopeOffset() const {
+  return normalOffset() > 1e-6 ? normalOffset() + sensorThickness()/2. : (normalOffset() < -1e-6 ? normalOffset() - sensorThickness()/2. : 0.);
+}
+
+void Sensor::clearPolys() const { 
+  hitPoly_.clear();
+  envPoly_.clear();
 }
 
 const Polygon3d<4>& Sensor::hitPoly() const {
-  if (hitPoly_ == 0) hitPoly_ = buildOwnPoly(normalOffset());
-  return *hitPoly_;
+  if (!hitPoly_.poly) {
+    hitPoly_.owned.reset(new Polygon3d<4>(buildHitPoly()));
+    hitPoly_.poly = hitPoly_.owned.get();
+  }
+  return *hitPoly_.poly;
 }
 
 const Polygon3d<4>& Sensor::envelopePoly() const {
-  if (envPoly_ == 0) {
-    double envelopeOffset = normalOffset() > 1e-6 ? normalOffset() + sensorThickness()/2. : (normalOffset() < -1e-6 ? normalOffset() - sensorThickness()/2. : 0.);
-    envPoly_ = buildOwnPoly(envelopeOffset); 
+  if (!envPoly_.poly) {
+    envPoly_.owned.reset(new Polygon3d<4>(buildEnvelopePoly()));
+    envPoly_.poly = envPoly_.owned.get();
   }
-  return *envPoly_;
+  return *envPoly_.poly;
 }
 
 std::pair<XYZVector, int> Sensor::checkHitSegment(const XYZVector& trackOrig, const XYZVector& trackDir) const {
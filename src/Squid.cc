@@ -7,8 +7,37 @@
 #include "SvnRevision.h"
 #include "Squid.h"
 #include "StopWatch.h"
+#include "TaskPool.h"
+#include "MaterialTab.h"
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <limits>
+#include <functional>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <TMemFile.h>
 
 namespace insur {
+  namespace {
+    /**
+     * @class SiteInputTag
+     * @brief This class tags the pages added to the site during its lifetime with the inputs of a report, and
+     * hands them over once the report is done
+     */
+    class SiteInputTag {
+      RootWSite& site_;
+      std::function<void()> done_;
+    public:
+      SiteInputTag(RootWSite& site, const std::string& tag, const std::function<void()>& done = std::function<void()>()) : site_(site), done_(done) { site_.setInputTag(tag); }
+      ~SiteInputTag() {
+        site_.setInputTag("");
+        if (done_) done_();
+      }
+    };
+  }
+
   // public
   /**
    * The constructor sets the internal pointers to <i>NULL</i>.
@@ -19,6 +48,10 @@ namespace insur {
       weightDistributionTracker(0.1),
       weightDistributionPixel(0.1) {
     tr = NULL;
+    trHash_ = pxHash_ = 0;
+    configurationHash_ = 0;
+    trMaterialsKey_ = pxMaterialsKey_ = 0;
+    trBudgetKey_ = pxBudgetKey_ = 0;
     is = NULL;
     mb = NULL;
     px = NULL;
@@ -26,6 +59,18 @@ namespace insur {
     pm = NULL;
     //pixelAnalyzer = NULL;
     sitePrepared = false;
+    materialWhatIf_ = false;
+    materialShard_ = 0;
+    materialShards_ = 1;
+    materialCheckpointMinutes_ = 0;
+    geometrySeconds_ = materialSeconds_ = 0;
+    resumeMaterialScan_ = false;
+    reuseTrackHitCache_ = false;
+    fastResolution_ = false;
+    workerProcesses_ = 1;
+    materialScanTracks_ = 0;
+    materialScanMaps_ = false;
+    resultsCompression_ = 101;
     myGeometryFile_ = "";
     mySettingsFile_ = "";
     myMaterialFile_ = "";
@@ -38,6 +83,7 @@ namespace insur {
    * The destructor deletes the heap-allocated internal objects if they exist.
    */
   Squid::~Squid() {
+    inputLoads_.clear(); // waits for the inputs still being loaded
     if (mb) delete mb;
     if (is) delete is;
     if (tr) delete tr;
@@ -58,23 +104,29 @@ namespace insur {
    * @return True if there were no errors during processing, false otherwise
    */
   bool Squid::buildTracker() {
-    if (tr) delete tr;
-    if (px) delete px;
+    scopeTaskClock("Squid::buildTracker");
+    StopWatch::MemoryScope memoryScope(StopWatch::GeometryMemory);
+    // the trackers built from an unchanged configuration are kept, the others are rebuilt
+    std::unique_ptr<Tracker> oldTr(tr), oldPx(px);
     tr = NULL;
     px = NULL;
+    ComputableEpoch::bump(); // nothing computed on the previous geometry is valid any more
 
-    std::ifstream ifs(getGeometryFile());
-    if (ifs.fail()) {
-      std::cerr << "ERROR: cannot open geometry file " << getGeometryFile() << std::endl;
-      return false;
-    }
-    startTaskClock("Building tracker and pixel");
-    std::stringstream ss;
-    includeSet_ = mainConfiguration.preprocessConfiguration(ifs, ss, getGeometryFile());
-    t2c.addConfigFile(tk2CMSSW::ConfigFile{getGeometryFile(), ss.str()});
     using namespace boost::property_tree;
+    std::string configuration;
     ptree pt;
-    info_parser::read_info(ss, pt);
+    if (!readConfiguration(getGeometryFile(), configuration, pt, &includeSet_)) return false;
+    startTaskClock("Building tracker and pixel");
+    t2c.clearConfigFiles();
+    t2c.addConfigFile(tk2CMSSW::ConfigFile{getGeometryFile(), configuration});
+    // the preprocessed configuration has all the included files expanded: together with the revision it identifies the build
+    configurationHash_ = std::hash<std::string>()(configuration + SvnRevision::revisionNumber);
+    std::ostringstream hashMessage;
+    hashMessage << "Geometry build key " << std::hex << configurationHash_;
+    logINFO(hashMessage.str());
+    for (Support* s : supports_) delete s;
+    supports_.clear();
+    bool keptTr = false, keptPx = false;
 
     /*
     class CoordExportVisitor : public ConstGeometryVisitor {
@@ -114,11 +166,23 @@ namespace insur {
     try { 
       auto childRange = getChildRange(pt, "Tracker");
       std::for_each(childRange.first, childRange.second, [&](const ptree::value_type& kv) {
+        bool isPixel = kv.second.data() == "Pixels";
+        std::size_t hash = trackerKey(kv.second, baseName_);
+        std::unique_ptr<Tracker>& old = isPixel ? oldPx : oldTr;
+        if (old && hash == (isPixel ? pxHash_ : trHash_)) {
+          logINFO("Configuration and material file of " + kv.second.data() + " unchanged, the tracker is not rebuilt");
+          (isPixel ? px : tr) = old.release();
+          (isPixel ? keptPx : keptTr) = true;
+          return;
+        }
+        (isPixel ? pxHash_ : trHash_) = hash;
         Tracker* t = new Tracker();
         t->setup();
         t->myid(kv.second.data());
         t->store(kv.second);
+        t->buildThreads(a.numThreads());
         t->build();
+        t->freeze(); // the geometry does not change from here on
         //CoordExportVisitor v(t->myid());
         //ModuleDataVisitor v1(t->myid());
         //t->accept(v);
@@ -126,6 +190,9 @@ namespace insur {
         if (t->myid() == "Pixels") px = t;
         else tr = t;
       });
+      // whatever was built on a tracker which is not kept goes with it
+      if (!keptTr) dropMaterials(false);
+      if (!keptPx) dropMaterials(true);
 
       std::set<string> unmatchedProperties = PropertyObject::reportUnmatchedProperties();
       if (!unmatchedProperties.empty()) {
@@ -160,6 +227,8 @@ namespace insur {
     }
     catch (PathfulException& e) { 
       std::cerr << e.path() << " : " << e.what() << std::endl; 
+      if (!keptTr) dropMaterials(false);
+      if (!keptPx) dropMaterials(true);
       stopTaskClock();
       return false;
     }
@@ -168,6 +237,114 @@ namespace insur {
     return true;
   }
 
+  /**
+   * Read a geometry configuration, with all of its included files expanded
+   * @param fileName The name of the geometry configuration file
+   * @param configuration The preprocessed configuration
+   * @param pt The property tree parsed from it
+   * @param includes If given, the set the names of the configuration files are put in
+   * @return True if the file could be opened
+   */
+  bool Squid::readConfiguration(const std::string& fileName, std::string& configuration, boost::property_tree::ptree& pt, std::set<std::string>* includes) {
+    std::string text;
+    if (!readText(fileName, text)) {
+      std::cerr << "ERROR: cannot open geometry file " << fileName << std::endl;
+      return false;
+    }
+    std::set<std::string> includeSet = mainConfiguration.preprocessText(text, configuration, fileName);
+    if (includes) includes->swap(includeSet);
+    boost::iostreams::stream<boost::iostreams::array_source> configurationStream(configuration.data(), configuration.size()); // parsed in place
+    boost::property_tree::info_parser::read_info(configurationStream, pt);
+    return true;
+  }
+
+  /**
+   * The declaration of a stage of the analysis of a layout: the stages it needs to have run before, and what it makes
+   * @param stage The stage
+   * @return Its declaration
+   */
+  const Squid::StageDeclaration& Squid::stageDeclaration(Stage stage) {
+    static const std::map<Stage, StageDeclaration> declarations = {
+      { TrackerStage,        { "tracker", {}, "the trackers, their module tables and simulation parameters (buildTracker())" } },
+      { GeometryScanStage,   { "geometry scan", { TrackerStage }, "the coverage and hit counts of the geometry tracks (pureAnalyzeGeometry())" } },
+      { BandwidthStage,      { "bandwidth", { TrackerStage }, "the bandwidths and trigger rates of the modules (pureAnalyzeBandwidth())" } },
+      { PowerStage,          { "power", { TrackerStage }, "the power dissipated in the irradiated sensors (pureAnalyzePower())" } },
+      { MaterialsStage,      { "materials", { TrackerStage }, "the inactive surfaces with the routed materials (buildMaterials())" } },
+      { MaterialBudgetStage, { "material budget", { MaterialsStage }, "the material budgets of the module caps (createMaterialBudget())" } },
+      { MaterialScanStage,   { "material scan", { MaterialBudgetStage }, "the radiation and interaction lengths of the material tracks (pureAnalyzeMaterialBudget())" } },
+      { ResolutionStage,     { "resolution", { MaterialBudgetStage }, "the tracking resolutions, estimated with the material scan" } },
+      { TriggerStage,        { "trigger efficiency", { TrackerStage }, "the trigger efficiencies and performance maps (analyzeTriggerEfficiency())" } }
+    };
+    return declarations.at(stage);
+  }
+
+  /**
+   * The stages to run for some wanted ones: those, and all the stages they take their inputs from
+   * @param wanted The stages whose results are used
+   * @return The stages to run
+   */
+  std::set<Squid::Stage> Squid::requiredStages(const std::set<Stage>& wanted) {
+    std::set<Stage> required;
+    std::vector<Stage> pending(wanted.begin(), wanted.end());
+    while (!pending.empty()) {
+      Stage stage = pending.back();
+      pending.pop_back();
+      if (!required.insert(stage).second) continue;
+      for (Stage input : stageDeclaration(stage).inputs) pending.push_back(input);
+    }
+    return required;
+  }
+
+  /**
+   * Compute the keys of the trackers a geometry configuration would build, without building anything. A tracker
+   * whose key is unchanged is kept by buildTracker(), and so are then its materials by buildMaterials() and its
+   * material budget by createMaterialBudget().
+   * @param geometryFile The name of the geometry configuration file
+   * @param keys The keys, by the name of the tracker they were computed for
+   * @return True if the configuration could be read
+   */
+  bool Squid::stageKeys(const std::string& geometryFile, std::map<std::string, std::size_t>& keys) {
+    std::string configuration;
+    boost::property_tree::ptree pt;
+    if (!readConfiguration(geometryFile, configuration, pt)) return false;
+    std::string baseName = geometryFile.substr(0, geometryFile.find_last_of('.'));
+    auto childRange = getChildRange(pt, "Tracker");
+    std::for_each(childRange.first, childRange.second, [&](const boost::property_tree::ptree::value_type& kv) {
+      keys[kv.second.data()] = trackerKey(kv.second, baseName);
+    });
+    return true;
+  }
+
+  /**
+   * Identify what a tracker and the materials routed on it are built from: the content of its configuration and
+   * its customized material file, if there is one (the default material files are the same for every layout).
+   * @param config The configuration of the tracker
+   * @param baseName The name of the geometry configuration file, without its extension
+   * @return The key of the tracker, never 0
+   */
+  std::size_t Squid::trackerKey(const boost::property_tree::ptree& config, const std::string& baseName) {
+    std::string materialFile = baseName + (config.data() == "Pixels" ? suffix_pixel_material_file : suffix_tracker_material_file);
+    std::size_t key = std::hash<std::string>()(std::to_string(PropertyObject::contentHash(config)) + fileFingerprint(materialFile));
+    return key ? key : 1;
+  }
+
+  /**
+   * Delete what was built on top of a tracker: its inactive surfaces (with the routed materials) and material budget.
+   * @param pixel True for the pixel detector, false for the outer tracker
+   */
+  void Squid::dropMaterials(bool pixel) {
+    InactiveSurfaces*& surfaces = pixel ? pi : is;
+    MaterialBudget*& budget = pixel ? pm : mb;
+    if (budget) delete budget;
+    budget = NULL;
+    if (surfaces) delete surfaces;
+    surfaces = NULL;
+    (pixel ? materialwayPixel : materialwayTracker).reset();
+    (pixel ? weightDistributionPixel : weightDistributionTracker).clear();
+    (pixel ? pxMaterialsKey_ : trMaterialsKey_) = 0;
+    (pixel ? pxBudgetKey_ : trBudgetKey_) = 0;
+  }
+
  /*
   bool Squid::buildNewTracker() {
     boost::ptree pt;
@@ -210,14 +387,16 @@ namespace insur {
    * @return True if there were no errors during processing, false otherwise
    */
   bool Squid::buildInactiveSurfaces(bool verbose) {
+    scopeTaskClock("Squid::buildInactiveSurfaces");
+    StopWatch::MemoryScope memoryScope(StopWatch::MaterialsMemory);
     startTaskClock("Building inactive surfaces");
     if (getGeometryFile()!="") {
       if (tr) {
-        if (is) delete is;
+        dropMaterials(false);
         is = new InactiveSurfaces();
         u.arrange(*tr, *is, supports_, verbose);
         if (px) {
-          if (pi) delete pi;
+          dropMaterials(true);
           pi = new InactiveSurfaces();
           u.arrangePixels(*px, *pi, verbose);
         }
@@ -238,11 +417,18 @@ namespace insur {
   }
 
   bool Squid::buildMaterials(bool verbose) {
+    scopeTaskClock("Squid::buildMaterials");
+    StopWatch::MemoryScope memoryScope(StopWatch::MaterialwayMemory);
     startTaskClock("Building materials");
 
     if (tr) {
         std::string trackm = getMaterialFile();
         if (trackm=="") { stopTaskClock(); return false; }
+        inputs_["material-files"] = fileFingerprint(trackm) + " " + (px ? fileFingerprint(getPixelMaterialFile()) : "");
+        // a tracker kept by buildTracker() has the same materials as before: they are not routed again
+        if (trMaterialsKey_ == trHash_) {
+          logINFO("The materials of " + tr->myid() + " are unchanged, they are not routed again");
+        } else {
         if (!is) is = new InactiveSurfaces();
         //if (mb) delete mb;
         //mb  = new MaterialBudget(*tr, *is);
@@ -250,19 +436,28 @@ namespace insur {
         //if (pxMaterialCalc.initDone()) pxMaterialCalc.reset(); // TODO: obsolete these
 
         //if (mp.initMatCalc(trackm, tkMaterialCalc, mainConfiguration.getMattabDirectory())) {
-        materialwayTracker.build(*tr, *is, weightDistributionTracker);
+        materialwayTracker.reset(new Materialway());
+        materialwayTracker->numThreads(a.numThreads());
+        materialwayTracker->build(*tr, *is, weightDistributionTracker);
+        trMaterialsKey_ = trHash_;
+        }
 
           // mb->materialsAll(tkMaterialCalc);
           // if (verbose) mb->print();
 
           if (px) {
             std::string pixm = getPixelMaterialFile();
-            if (pixm!="") {
+            if (pixm!="" && pxMaterialsKey_ == pxHash_) {
+              logINFO("The materials of " + px->myid() + " are unchanged, they are not routed again");
+            } else if (pixm!="") {
               //if (mp.initMatCalc(pixm, pxMaterialCalc, mainConfiguration.getMattabDirectory())) {
                 if (!pi) pi = new InactiveSurfaces();
                 //if (pm) delete pm;
                 //pm = new MaterialBudget(*px, *pi);
-                materialwayPixel.build(*px, *pi, weightDistributionPixel);
+                materialwayPixel.reset(new Materialway());
+                materialwayPixel->numThreads(a.numThreads());
+                materialwayPixel->build(*px, *pi, weightDistributionPixel);
+                pxMaterialsKey_ = pxHash_;
 
                 //pm->materialsAll(pxMaterialCalc);
                 //if (verbose) pm->print();
@@ -301,19 +496,31 @@ namespace insur {
    * @return True if there were no errors during processing, false otherwise
    */
   bool Squid::createMaterialBudget(bool verbose) {
+    scopeTaskClock("Squid::createMaterialBudget");
+    StopWatch::MemoryScope memoryScope(StopWatch::MaterialsMemory);
     if (tr) {
       std::string trackm = getMaterialFile();
       if (trackm=="") return false;
       if (!is) is = new InactiveSurfaces();
-      if (mb) delete mb;
-      mb  = new MaterialBudget(*tr, *is);
-      if (tkMaterialCalc.initDone()) tkMaterialCalc.reset();
-      if (pxMaterialCalc.initDone()) pxMaterialCalc.reset();
-      if (mp.initMatCalc(trackm, tkMaterialCalc, mainConfiguration.getMattabDirectory())) {
-        mb->materialsAll(tkMaterialCalc);
+      // the budget made for the materials of an unchanged tracker is kept
+      bool keepTracker = mb && trBudgetKey_ && trBudgetKey_ == trMaterialsKey_;
+      bool keepPixel = px && pm && pxBudgetKey_ && pxBudgetKey_ == pxMaterialsKey_;
+      if (!keepTracker) {
+        if (mb) delete mb;
+        mb  = new MaterialBudget(*tr, *is);
+        if (tkMaterialCalc.initDone()) tkMaterialCalc.reset();
+      }
+      if (!keepPixel && pxMaterialCalc.initDone()) pxMaterialCalc.reset();
+      if (keepTracker || mp.initMatCalc(trackm, tkMaterialCalc, mainConfiguration.getMattabDirectory())) {
+        if (keepTracker) logINFO("The material budget of " + tr->myid() + " is unchanged, it is not made again");
+        else mb->materialsAll(tkMaterialCalc);
+        trBudgetKey_ = trMaterialsKey_;
         if (verbose) mb->print();
 
-        if (px) {
+        if (px && keepPixel) {
+          logINFO("The material budget of " + px->myid() + " is unchanged, it is not made again");
+          if (verbose) pm->print();
+        } else if (px) {
           std::string pixm = getPixelMaterialFile();
           if (pixm!="") {
             if (mp.initMatCalc(pixm, pxMaterialCalc, mainConfiguration.getMattabDirectory())) {
@@ -321,16 +528,27 @@ namespace insur {
               if (pm) delete pm;
               pm = new MaterialBudget(*px, *pi);
               pm->materialsAll(pxMaterialCalc);
+              pxBudgetKey_ = pxMaterialsKey_;
               if (verbose) pm->print();
             }
           }
         }
+        startTaskClock("Indexing modules and inactive surfaces for the material tracks");
+        // one lookup over the whole detector: the pixel analyzer finds the layers of the pixels in it
+        a.buildModuleHitIndex(*mb, pm);
+        a.buildInactiveHitIndex(*mb, pm);
+        pixelAnalyzer.shareHitIndices(a);
+        stopTaskClock();
+        // the geometry is frozen and its materials made: what only the build needed goes
+        tr->releaseBuildState();
+        if (px) px->releaseBuildState();
         return true;
       } else {
         if (mb) delete mb;
         mb = NULL;
         if (pm) delete pm;
         pm = NULL;
+        trBudgetKey_ = pxBudgetKey_ = 0;
         logERROR(err_init_failed);
         return false;
       }
@@ -363,9 +581,10 @@ namespace insur {
    * @return True if there were no errors during processing, false otherwise
    */
   bool Squid::analyzeNeighbours(std::string graphout) {
+    scopeTaskClock("Squid::analyzeNeighbours");
     if (is) {
       startTaskClock("Creating inactive materials hierarchy");
-      v.writeNeighbourGraph(*is, graphout);
+      vizard().writeNeighbourGraph(*is, graphout);
       stopTaskClock();
       return true;
     }
@@ -381,7 +600,9 @@ namespace insur {
    * @return True if there were no errors during processing, false otherwise
    */
   bool Squid::translateFullSystemToXML(std::string xmlout) {
+    scopeTaskClock("Squid::translateFullSystemToXML");
     if (mb) {
+      t2c.materialFingerprint(inputs_["material-files"] + ";" + inputs_["material-whatif"] + ";" + inputs_["material-shards"]);
       t2c.translate(tkMaterialCalc.getMaterialTable(), *mb, xmlout.empty() ? baseName_ : xmlout, false); // false is setting a mysterious flag called wt which changes the way the XML is output. apparently setting it to true is of no use anymore.
       return true;
     }
@@ -417,8 +638,19 @@ namespace insur {
 
   // private
   void Squid::resetVizard() {
-    v.~Vizard();
-    new ((void*) &v) Vizard();
+    v_.reset();
+  }
+
+  /**
+   * The visualisation of the reports, made the first time it is needed
+   * @return The visualisation
+   */
+  Vizard& Squid::vizard() {
+    if (!v_) {
+      v_.reset(new Vizard());
+      v_->setCommandLine(commandLine_);
+    }
+    return *v_;
   }
 
   /**
@@ -427,6 +659,7 @@ namespace insur {
    * @return a boolean with the operation success
    */
   bool Squid::prepareWebsite() {
+    scopeTaskClock("Squid::prepareWebsite");
     if (sitePrepared) return true;
     string trackerName;
     if (htmlDir_ != "") trackerName = htmlDir_;
@@ -452,11 +685,23 @@ namespace insur {
   }
 
 
+  /**
+   * Starts rendering the images of the pages of the report just made, when the reports are pipelined:
+   * they are printed by background processes while the next analyses run
+   */
+  void Squid::renderReportPages() {
+    scopeTaskClock("Squid::renderReportPages");
+    if (!site.renderAhead()) return;
+    if (!prepareWebsite() || !site.renderNewPages()) logWARNING("Could not start rendering the pages of the report: their images may be missing");
+  }
+
   /**
    * Actually creates the website where it was supposed to be
    * @return a boolean with the operation success
    */
   bool Squid::makeSite(bool addLogPage /* = true */) {
+    scopeTaskClock("Squid::makeSite");
+    StopWatch::MemoryScope memoryScope(StopWatch::SiteMemory);
     startTaskClock("Creating website");
     if (!prepareWebsite()) {
       logERROR("Problem in preparing website");
@@ -465,7 +710,7 @@ namespace insur {
     }
 
     if (addLogPage) {
-      v.makeLogPage(site);
+      vizard().makeLogPage(site);
     }
 
     bool result = site.makeSite(false);
@@ -478,11 +723,22 @@ namespace insur {
    * @return True if there were no errors during processing, false otherwise
    */
   bool Squid::pureAnalyzeGeometry(int tracks) {
+    scopeTaskClock("Squid::pureAnalyzeGeometry");
+    StopWatch::MemoryScope memoryScope(StopWatch::AnalysisMemory);
     if (tr) {
       startTaskClock("Analyzing geometry");
+      // with a time budget, the pixel tracks have what the outer ones leave of it, and half of it at least
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      a.geometryTrackSeconds(px ? geometrySeconds_ / 2 : geometrySeconds_);
       a.analyzeGeometry(*tr, tracks);
-      if (px) pixelAnalyzer.analyzeGeometry(*px, tracks);
+      if (px) {
+        double spent = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        pixelAnalyzer.geometryTrackSeconds(geometrySeconds_ > 0 ? MAX(geometrySeconds_ - spent, geometrySeconds_ / 2) : 0);
+        pixelAnalyzer.analyzeGeometry(*px, tracks);
+      }
       stopTaskClock();
+      // the pages depend on the tracks actually shot
+      inputs_["geometry-tracks"] = geometrySeconds_ > 0 ? any2str(a.getGeometryTracksUsed()) + " in " + any2str(geometrySeconds_) + " s" : any2str(tracks);
       return true; // TODO: this return value is not really meaningful
     } else {
       std::cout << "Squid::pureAnalyzeGeometry(): " << err_no_tracker << std::endl;
@@ -491,6 +747,9 @@ namespace insur {
   }
 
   bool Squid::analyzeTriggerEfficiency(int tracks, bool detailed) {
+    scopeTaskClock("Squid::analyzeTriggerEfficiency");
+    StopWatch::MemoryScope memoryScope(StopWatch::AnalysisMemory);
+    inputs_["trigger-tracks"] = any2str(tracks) + (detailed ? " detailed" : "");
     // Call this before analyzetrigger if you want to have the map of suggested spacings
     if (detailed) {
       startTaskClock("Creating distance tuning plots");
@@ -509,24 +768,78 @@ namespace insur {
   /**
    * Analyze the previously created material budget with no output.
    * @param tracks The number of tracks that should be fanned out across the analysed region
+   * @param triggerResolution Whether the tracking resolutions are estimated too
+   * @param materialReport Whether the material report is going to be produced, which is the only one needing the material maps
+   * @param materialScan Whether the material tracks are shot: the resolutions alone do not need them, unless they take
+   * the tracks of the material scan (see <i>setSinglePassScan()</i>)
    * @return True if there were no errors during processing, false otherwise
    */
-  bool Squid::pureAnalyzeMaterialBudget(int tracks, bool triggerResolution) {
+  bool Squid::pureAnalyzeMaterialBudget(int tracks, bool triggerResolution, bool materialReport, bool materialScan) {
+    scopeTaskClock("Squid::pureAnalyzeMaterialBudget");
+    StopWatch::MemoryScope memoryScope(StopWatch::AnalysisMemory);
     if (mb) {
+      inputs_["material-tracks"] = any2str(tracks) + (triggerResolution ? " resolution" : "") + (materialReport ? " maps" : "");
 //      startTaskClock(!trackingResolution ? "Analyzing material budget" : "Analyzing material budget and estimating resolution");
-      // TODO: insert the creation of sample tracks here, to compute intersections only once
-      startTaskClock("Analyzing material budget" );
-      a.analyzeMaterialBudget(*mb, mainConfiguration.getMomenta(), tracks, pm);
-      stopTaskClock();
-      if (pm) {
-        startTaskClock("Analyzing pixel material budget");
-        pixelAnalyzer.analyzeMaterialBudget(*pm, mainConfiguration.getMomenta(), tracks, NULL);
+      bool cachedTracks = false;
+      if (triggerResolution && !trackHitCacheFile_.empty() && !fastResolution_) {
+        // what the hits of the resolution tracks depend on: the layouts and the tracks, not what they are analysed with
+        std::ostringstream key;
+        key << std::hex << trHash_ << ";" << pxHash_ << std::dec << ";tracks=" << tracks;
+        for (const std::string& name : {"seed", "quasi-random", "phi-symmetry", "single-pass", "material-files"}) key << ";" << name << "=" << inputs_[name];
+        a.trackHitCache(trackHitCacheFile_, key.str(), reuseTrackHitCache_);
+        // the material budget is only scanned for its report then
+        cachedTracks = materialScan && !materialReport && a.trackHitCacheMatches(*mb, pm, tracks);
+      }
+      if (cachedTracks) {
+        logINFO("Resolution tracks: the hits of the " + any2str(tracks) + " tracks are taken from the track cache " + trackHitCacheFile_ +
+                ", without scanning the material budget");
+        materialScan = false;
+      }
+      materialScanTracks_ = materialScan ? tracks : 0;
+      materialScanMaps_ = materialScan && materialReport;
+      if (!materialScan) {
+        // only the resolutions, with tracks of their own
+      } else if (!materialShardFiles_.empty()) {
+        if (!mergeMaterialShards(tracks, materialReport)) return false;
+      } else {
+        if (!materialCheckpointFile_.empty()) {
+          // what the scan depends on, for a checkpoint not to be resumed by another scan
+          std::ostringstream key;
+          key << std::hex << configurationHash_ << std::dec << ";tracks=" << tracks << ";maps=" << materialReport;
+          for (const std::string& name : {"seed", "quasi-random", "phi-symmetry", "material-files"}) key << ";" << name << "=" << inputs_[name];
+          key << ";shard=" << materialShard_ + 1 << "/" << materialShards_;
+          a.materialCheckpoint(materialCheckpointFile_, key.str(), materialCheckpointMinutes_ * 60, resumeMaterialScan_);
+          pixelAnalyzer.materialCheckpoint(materialCheckpointFile_ + "-pixel", key.str(), materialCheckpointMinutes_ * 60, resumeMaterialScan_);
+        }
+        if (materialSeconds_ > 0) {
+          // a pilot scan gives the time of a track, and the scan is redone with as many tracks as its budget allows
+          int pilotTracks = MIN(tracks, materialPilotTracks * TaskPool::instance()->numThreads());
+          std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+          if (!analyzeMaterialBudgetOnce(pilotTracks, materialReport)) return false;
+          double spent = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+          double budgetTracks = (materialSeconds_ - spent) * pilotTracks / MAX(spent, 1e-6);
+          tracks = budgetTracks > pilotTracks ? int(MIN(budgetTracks, double(std::numeric_limits<int>::max()))) : pilotTracks;
+          logINFO("Material tracks: " + any2str(tracks) + " tracks fit in the time budget of " + any2str(materialSeconds_) + " s, a pilot scan of " +
+                  any2str(pilotTracks) + " tracks having taken " + any2str(spent, 1) + " s");
+          inputs_["material-tracks"] = any2str(tracks) + (triggerResolution ? " resolution" : "") + (materialReport ? " maps" : "");
+          materialScanTracks_ = tracks;
+          if (tracks > pilotTracks && !analyzeMaterialBudgetOnce(tracks, materialReport)) return false;
+        } else if (!analyzeMaterialBudgetOnce(tracks, materialReport)) return false;
+      }
+      if (materialWhatIf_ && materialScan) {
+        startTaskClock("Reweighting the material budget");
+        bool reweighted = a.reweightMaterialBudget(whatIfMaterialLengths_, whatIfComponentScales_);
         stopTaskClock();
+        if (!reweighted) return false;
       }
       startTaskClock("Computing the weight summary");
       a.computeWeightSummary(*mb);
       stopTaskClock();
-      if (triggerResolution) {
+      if (triggerResolution && fastResolution_) {
+        startTaskClock("Estimating tracking resolutions analytically");
+        a.analyzeFastResolution(*mb, mainConfiguration.getMomenta(), tracks, pm);
+        stopTaskClock();
+      } else if (triggerResolution) {
         startTaskClock("Estimating tracking resolutions");
         a.analyzeTaggedTracking(*mb,
                                 mainConfiguration.getMomenta(),
@@ -547,10 +860,13 @@ namespace insur {
    * @return True if there were no errors during processing, false otherwise
    */
   bool Squid::reportGeometrySite() {
+    scopeTaskClock("Squid::reportGeometrySite");
+    StopWatch::MemoryScope memoryScope(StopWatch::SiteMemory);
     if (tr) {
+      SiteInputTag tag(site, inputTag("geometry", {"geometry-tracks", "geometry-region", "geometry-precision", "geometry-pt", "stratified-eta", "quasi-random", "seed", "material-files"}), [this]() { renderReportPages(); });
       startTaskClock("Creating geometry report");
-      v.geometrySummary(a, *tr, *simParms_, is, site);
-      if (px) v.geometrySummary(pixelAnalyzer, *px, *simParms_, pi, site, "pixel");
+      vizard().geometrySummary(a, *tr, *simParms_, is, site);
+      if (px) vizard().geometrySummary(pixelAnalyzer, *px, *simParms_, pi, site, "pixel");
       stopTaskClock();
       return true;
     } else {
@@ -559,14 +875,38 @@ namespace insur {
     }
   }
 
-  bool Squid::reportBandwidthSite() {
+  /**
+   * Compute the bandwidth and trigger rates of the modules, without any output
+   * @return True if there were no errors during processing, false otherwise
+   */
+  bool Squid::pureAnalyzeBandwidth() {
+    scopeTaskClock("Squid::pureAnalyzeBandwidth");
+    StopWatch::MemoryScope memoryScope(StopWatch::AnalysisMemory);
     if (tr) {
       startTaskClock("Computing bandwidth and rates");
-      a.computeBandwidth(*tr);
-      a.computeTriggerFrequency(*tr);
+      a.computeBandwidthAndTriggerFrequency(*tr);
+      if (!pileupScan_.empty()) a.computePileupScan(*tr, pileupScan_);
+      if (!readoutVariants_.empty()) {
+        startTaskClock("Computing the readout what-if variants");
+        a.computeReadoutWhatIf(*tr, readoutVariants_);
+        stopTaskClock();
+      }
       stopTaskClock();
+      return true;
+    } else {
+      logERROR(err_no_tracker);
+      return false;
+    }
+  }
+
+  bool Squid::reportBandwidthSite() {
+    scopeTaskClock("Squid::reportBandwidthSite");
+    StopWatch::MemoryScope memoryScope(StopWatch::SiteMemory);
+    if (tr) {
+      SiteInputTag tag(site, inputTag("bandwidth", {"pileup-scan", "readout-whatif"}), [this]() { renderReportPages(); });
+      pureAnalyzeBandwidth();
       startTaskClock("Creating bandwidth and rates report");
-      v.bandwidthSummary(a, *tr, *simParms_, site);
+      vizard().bandwidthSummary(a, *tr, *simParms_, site);
       stopTaskClock();
       return true;
     } else {
@@ -576,10 +916,13 @@ namespace insur {
   }
 
   bool Squid::reportTriggerProcessorsSite() {
+    scopeTaskClock("Squid::reportTriggerProcessorsSite");
+    StopWatch::MemoryScope memoryScope(StopWatch::SiteMemory);
     if (tr) {
+      SiteInputTag tag(site, inputTag("trigger processors", {}), [this]() { renderReportPages(); });
       startTaskClock("Computing multiple trigger tower connections");
       a.computeTriggerProcessorsBandwidth(*tr);
-      v.triggerProcessorsSummary(a, *tr, site);
+      vizard().triggerProcessorsSummary(a, *tr, site);
       stopTaskClock();
       return true;
     } else {
@@ -589,13 +932,34 @@ namespace insur {
 
   }
 
-  bool Squid::reportPowerSite() {
+  /**
+   * Compute the power dissipated in the irradiated sensors, over the operating points of the power scan if any,
+   * without any output
+   * @return True if there were no errors during processing, false otherwise
+   */
+  bool Squid::pureAnalyzePower() {
+    scopeTaskClock("Squid::pureAnalyzePower");
+    StopWatch::MemoryScope memoryScope(StopWatch::AnalysisMemory);
     if (tr) {
       startTaskClock("Computing dissipated power");
       a.analyzePower(*tr);
+      if (!powerScan_.empty()) a.computeIrradiatedPowerScan(*tr, powerScan_);
       stopTaskClock();
+      return true;
+    } else {
+      logERROR(err_no_tracker);
+      return false;
+    }
+  }
+
+  bool Squid::reportPowerSite() {
+    scopeTaskClock("Squid::reportPowerSite");
+    StopWatch::MemoryScope memoryScope(StopWatch::SiteMemory);
+    if (tr) {
+      SiteInputTag tag(site, inputTag("power", {"power-scan"}), [this]() { renderReportPages(); });
+      pureAnalyzePower();
       startTaskClock("Creating power report");
-      v.irradiatedPowerSummary(a, *tr, site);
+      vizard().irradiatedPowerSummary(a, *tr, site);
       stopTaskClock();
       return true;
     } else {
@@ -609,11 +973,14 @@ namespace insur {
    * @return True if there were no errors during processing, false otherwise
    */
   bool Squid::reportMaterialBudgetSite() {
+    scopeTaskClock("Squid::reportMaterialBudgetSite");
+    StopWatch::MemoryScope memoryScope(StopWatch::SiteMemory);
     if (mb) {
+      SiteInputTag tag(site, inputTag("material", {"material-tracks", "material-files", "material-whatif", "material-shards", "quasi-random", "phi-symmetry", "seed"}), [this]() { renderReportPages(); });
       startTaskClock("Creating material budget report");
-      v.histogramSummary(a, site, "outer");
-      if (pm) v.histogramSummary(pixelAnalyzer, site, "pixel");
-      v.weigthSummart(a, weightDistributionTracker, site, "outer");
+      vizard().histogramSummary(a, site, "outer");
+      if (pm) vizard().histogramSummary(pixelAnalyzer, site, "pixel");
+      vizard().weigthSummart(a, weightDistributionTracker, site, "outer");
       stopTaskClock();
       return true;
     }
@@ -628,13 +995,16 @@ namespace insur {
    * @return True if there were no errors during processing, false otherwise
    */
   bool Squid::reportResolutionSite() {
+    scopeTaskClock("Squid::reportResolutionSite");
+    StopWatch::MemoryScope memoryScope(StopWatch::SiteMemory);
     if (mb) {
+      SiteInputTag tag(site, inputTag("resolution", {"material-tracks", "material-files", "material-whatif", "material-shards", "quasi-random", "phi-symmetry", "single-pass", "resolution-bins", "fast-resolution", "seed"}), [this]() { renderReportPages(); });
       startTaskClock("Creating resolution report");
-      v.errorSummary(a, site, "", false);
+      vizard().errorSummary(a, site, "", false);
 #ifdef NO_TAGGED_TRACKING
-      v.errorSummary(a, site, "trigger", true);
+      vizard().errorSummary(a, site, "trigger", true);
 #else
-      v.taggedErrorSummary(a, site);
+      vizard().taggedErrorSummary(a, site);
 #endif
       stopTaskClock();
       return true;
@@ -651,8 +1021,11 @@ namespace insur {
    * @return True if there were no errors during processing, false otherwise
    */
   bool Squid::reportTriggerPerformanceSite(bool extended) {
+    scopeTaskClock("Squid::reportTriggerPerformanceSite");
+    StopWatch::MemoryScope memoryScope(StopWatch::SiteMemory);
+    SiteInputTag tag(site, inputTag(extended ? "extended trigger" : "trigger", {"trigger-tracks", "single-pass", "seed"}), [this]() { renderReportPages(); });
     startTaskClock("Creating trigger summary report");
-    if (v.triggerSummary(a, *tr, site, extended)) {
+    if (vizard().triggerSummary(a, *tr, site, extended)) {
       stopTaskClock();
       return true;
     } else {
@@ -662,7 +1035,10 @@ namespace insur {
   }
 
   bool Squid::reportNeighbourGraphSite() {
-    if (v.neighbourGraphSummary(*is, site)) return true;
+    scopeTaskClock("Squid::reportNeighbourGraphSite");
+    StopWatch::MemoryScope memoryScope(StopWatch::SiteMemory);
+    SiteInputTag tag(site, inputTag("neighbours", {}), [this]() { renderReportPages(); });
+    if (vizard().neighbourGraphSummary(*is, site)) return true;
     else {
       logERROR(err_no_inacsurf);
       return false;
@@ -670,6 +1046,8 @@ namespace insur {
   }
 
   bool Squid::additionalInfoSite() {
+    scopeTaskClock("Squid::additionalInfoSite");
+    StopWatch::MemoryScope memoryScope(StopWatch::SiteMemory);
     if (!tr) {
       logERROR(err_no_tracker);
       return false;
@@ -677,7 +1055,7 @@ namespace insur {
       getMaterialFile();
       getPixelMaterialFile();
       startTaskClock("Saving additional information");
-      v.additionalInfoSite(includeSet_, getSettingsFile(),
+      vizard().additionalInfoSite(includeSet_, getSettingsFile(),
                            getMaterialFile(), getPixelMaterialFile(),
                            defaultMaterialFile, defaultPixelMaterialFile,
                            a, pixelAnalyzer, *tr, *simParms_, site);
@@ -695,6 +1073,44 @@ namespace insur {
     size_t pos = geomFile.find_last_of('.');
     if (pos != string::npos) { geomFile.erase(pos); }
     baseName_ = geomFile;
+    // the other files are looked up again next to the new one
+    mySettingsFile_ = myMaterialFile_ = myPixelMaterialFile_ = "";
+  }
+
+  /**
+   * Start reading the inputs of the layout which do not depend on each other, each on a thread of its own, for the
+   * build to wait for the slowest of them rather than for all of them in turn: the geometry configuration, whose
+   * includes are read ahead as it is expanded, and the material files of the trackers (the default pixel one is read
+   * even for a layout without pixels), besides the material table and the irradiation maps (see
+   * <i>loadSharedInputs()</i>). The geometry file has to be set.
+   */
+  void Squid::prefetchInputs() {
+    prefetchText(getGeometryFile());
+    std::string materialsDirectory = mainConfiguration.getDefaultMaterialsDirectory();
+    std::string trackerMaterials = baseName_ + suffix_tracker_material_file;
+    std::string pixelMaterials = baseName_ + suffix_pixel_material_file;
+    prefetchText(fileExists(trackerMaterials) ? trackerMaterials : materialsDirectory + "/" + default_tracker_materials_file);
+    prefetchText(fileExists(pixelMaterials) ? pixelMaterials : materialsDirectory + "/" + default_pixel_materials_file);
+    inputLoads_ = loadSharedInputs();
+  }
+
+  /**
+   * Start reading and parsing the inputs which are the same for every layout, each on a thread of its own: the material
+   * table and the irradiation maps. Whoever uses them afterwards waits for them to be loaded, if they are not yet.
+   * @return The loads, which are done once their futures are
+   */
+  std::vector<std::future<void> > Squid::loadSharedInputs() {
+    // the directories are read from the main configuration here, not by the threads
+    mainConfigHandler& mainConfiguration = mainConfigHandler::instance();
+    mainConfiguration.getMattabDirectory();
+    std::string irradiationDirectory = mainConfiguration.getIrradiationDirectory();
+    std::vector<std::future<void> > loads;
+    loads.push_back(std::async(std::launch::async, []() { material::MaterialTab::instance(); }));
+    for (const std::string& irradiationFile : default_irradiationfiles) {
+      std::string fileName = irradiationDirectory + "/" + irradiationFile;
+      loads.push_back(std::async(std::launch::async, [fileName]() { IrradiationMapsManager::cachedIrradiationMap(fileName); }));
+    }
+    return loads;
   }
 
   void Squid::setHtmlDir(std::string htmlDir) {
@@ -753,6 +1169,7 @@ namespace insur {
   }
 
   void Squid::simulateTracks(const po::variables_map& varmap, int seed) { // CUIDADO not ported to coderev -- yet?
+    scopeTaskClock("Squid::simulateTracks");
     startTaskClock("Shooting particles");
 /*    TrackShooter ts;
     //std::ofstream ofs((outputfile + "." + any2str(getpid())).c_str());
@@ -768,6 +1185,7 @@ namespace insur {
     }
 
     ts.shootTracks(varmap, seed);*/
+    logERROR(err_no_tracksim);
     stopTaskClock();
   }
 
@@ -775,11 +1193,941 @@ namespace insur {
     if (argc <= 1) return;
     std::string cmdLine(argv[1]);
     g=0; for (int i = 2; i < argc; i++) { if (argv[i] == "-"+std::string(1,103)) g=1; cmdLine += std::string(" ") + argv[i]; }
-    v.setCommandLine(cmdLine);
+    commandLine_ = cmdLine;
+    if (v_) v_->setCommandLine(cmdLine);
+  }
+
+  /**
+   * Choose whether the material tracks look up the modules they cross through the (eta, phi) module index
+   * or check every module of each layer. Both give the same hits: the full scan is kept as a reference.
+   * @param use True to use the module index, false for the full scan
+   */
+  void Squid::useModuleHitIndex(bool use) {
+    a.useModuleHitIndex(use);
+    pixelAnalyzer.useModuleHitIndex(use);
+  }
+
+  /**
+   * Choose whether the geometry and material tracks are tested against the sensors in single precision first, and in
+   * double precision only where they may hit. Both give the same hits.
+   * @param use True for the single precision test first
+   */
+  void Squid::useSinglePrecisionHits(bool use) {
+    a.singlePrecisionHits(use);
+    pixelAnalyzer.singlePrecisionHits(use);
+  }
+
+  /**
+   * Set the number of threads of the task pool the track scans of the analyses, the tracker build and visits, the service
+   * routing of the materials and the extraction of the layers and discs for the XML are split across, within the CPUs the
+   * process may use. The images of the website are rendered by as many processes.
+   * @param n The number of threads; 1 (or less) for a serial scan
+   */
+  void Squid::setNumThreads(int n) {
+    int cpus = TaskPool::availableCpus();
+    if (n > cpus) {
+      logWARNING("Only " + any2str(cpus) + " CPUs are available to the process (affinity and cgroup quota): running " + any2str(cpus) + " threads instead of " + any2str(n));
+      n = cpus;
+    }
+    TaskPool::instance()->setNumThreads(n);
+    a.numThreads(n);
+    pixelAnalyzer.numThreads(n);
+    t2c.numThreads(n);
+    site.numThreads(n);
+  }
+
+  /**
+   * Pin the threads of the task pool to the NUMA nodes of the machine, and copy the read-only tables of the track scans
+   * (the frozen modules, the module and inactive element indices, the sensor snapshots) to the memory of each node, so
+   * that the threads of a node do not read those of another socket. The performance report then gives the tasks of
+   * each node. On a machine of a single node the threads are pinned and nothing is copied.
+   * @param pinned True to pin the threads and copy the tables
+   */
+  void Squid::setNumaPinning(bool pinned) {
+    int nodes = TaskPool::numaNodes().size();
+    if (pinned && nodes < 2) logINFO("The CPUs available to the process are on a single NUMA node: the scan tables are not copied");
+    TaskPool::instance()->setNumaPinning(pinned);
+  }
+
+  /**
+   * Set the seed the random streams of the tracks of all the scans are derived from.
+   * @param seed The seed; 0 for a random one
+   */
+  void Squid::setRandomSeed(int seed) {
+    // the results of a random seed are never the same twice
+    inputs_["seed"] = seed ? any2str(seed) : "random " + any2str((long long)std::chrono::system_clock::now().time_since_epoch().count());
+    a.randomSeed(seed);
+    pixelAnalyzer.randomSeed(seed);
+  }
+
+  /**
+   * Set the operating points the irradiated power is computed for, in addition to the nominal one.
+   * @param scan A comma separated list of <i>parameter=first:last:step</i> ranges, the parameter being one of
+   * <i>lumi</i> (fb^-1), <i>temp</i> (C) or <i>voltage</i> (V); the points are all the combinations of the values
+   * @return True if the scan could be parsed, false otherwise
+   */
+  bool Squid::setPowerScan(const std::string& scan) {
+    inputs_["power-scan"] = scan;
+    powerScan_.clear();
+    for (const std::string& range : split(scan, ",")) {
+      auto assignment = split(range, "=");
+      auto limits = assignment.size() == 2 ? split<double>(assignment[1], ":") : std::vector<double>();
+      const std::string parameter = assignment.empty() ? "" : trim(assignment[0]);
+      if ((parameter != "lumi" && parameter != "temp" && parameter != "voltage") || limits.size() != 3 || limits[2] <= 0 || limits[1] < limits[0]) {
+        logERROR("Malformed power scan range '" + range + "': expected lumi, temp or voltage=first:last:step");
+        powerScan_.clear();
+        return false;
+      }
+      std::vector<double>& values = powerScan_[parameter];
+      values.clear();
+      for (int i = 0; limits[0] + i * limits[2] <= limits[1] + 1e-9 * limits[2]; i++) values.push_back(limits[0] + i * limits[2]);
+    }
+    return true;
+  }
+
+  /**
+   * Set the pile-ups the bandwidth and the trigger rates are computed for, in addition to the one of the simulation parameters.
+   * @param scan A comma separated list of numbers of minimum bias events per bunch crossing, e.g. <i>140,200,250</i>
+   * @return True if the scan could be parsed, false otherwise
+   */
+  bool Squid::setPileupScan(const std::string& scan) {
+    inputs_["pileup-scan"] = scan;
+    pileupScan_.clear();
+    for (const std::string& value : split(scan, ",")) {
+      std::istringstream parser(trim(value));
+      double pileup;
+      if (!(parser >> pileup) || !parser.eof() || pileup <= 0) {
+        logERROR("Malformed pile-up scan value '" + value + "': expected a positive number of minimum bias events");
+        pileupScan_.clear();
+        return false;
+      }
+      pileupScan_.push_back(pileup);
+    }
+    return true;
+  }
+
+  /**
+   * Also compute the bandwidth and the trigger rates for other readouts of some module types, one variant after the
+   * other, without building the tracker again: only the modules whose trigger parameters a variant changes have their
+   * stub frequencies integrated again. The configuration itself comes first, as the reference of the variants. Each
+   * line of the file is either <i>variant name</i>, starting a variant, or <i>moduleType property value</i>, changing a
+   * readout property of a type (see <i>ReadoutWhatIf</i>); lines starting with '#' are comments.
+   * @param fileName The name of the file of the variants
+   * @return True if the file could be read, false otherwise
+   */
+  bool Squid::setReadoutWhatIf(const std::string& fileName) {
+    std::vector<ReadoutWhatIf::Variant> variants;
+    if (!ReadoutWhatIf::readFile(fileName, variants)) return false;
+    readoutVariants_.assign(1, ReadoutWhatIf::Variant{ "configuration", std::vector<ReadoutWhatIf::Change>() });
+    readoutVariants_.insert(readoutVariants_.end(), variants.begin(), variants.end());
+    inputs_["readout-whatif"] = fileFingerprint(fileName);
+    return true;
+  }
+
+  /**
+   * Choose the formats the plots of the website are saved in, besides the PNG ones.
+   * @param formats A comma separated list of file extensions, e.g. <i>pdf,root</i>; empty for PNG only
+   * @param lazy If true, only the PNG files are rendered, the canvases being kept in a ROOT file of the site
+   * for the other formats to be rendered on demand with <i>renderimages</i>
+   * @return True if all the formats are allowed, false otherwise
+   */
+  bool Squid::setImageFormats(const std::string& formats, bool lazy) {
+    inputs_["image-formats"] = formats + (lazy ? " lazy" : "");
+    RootWImage::setLazyFormats(lazy);
+    return RootWImage::setDefaultFormats(formats);
+  }
+
+  /**
+   * Choose whether the images of each report are rendered as soon as the report is made, by background processes
+   * running alongside the next analyses, rather than all at once when the website is written.
+   * @param pipelined True to render the images of each report ahead of the website
+   */
+  void Squid::setPipelinedReports(bool pipelined) {
+    site.setRenderAhead(pipelined);
+  }
+
+  /**
+   * Choose when the module maps of values are drawn as a raster rather than one outline per module.
+   * @param mode <i>auto</i> (past MapRaster::autoThreshold modules), <i>always</i> or <i>never</i>
+   * @return True if the mode is one of those, false otherwise
+   */
+  bool Squid::setRasterMaps(const std::string& mode) {
+    inputs_["raster-maps"] = mode;
+    if (mode == "auto") MapRaster::mode = MapRaster::AUTO;
+    else if (mode == "always") MapRaster::mode = MapRaster::ALWAYS;
+    else if (mode == "never") MapRaster::mode = MapRaster::NEVER;
+    else {
+      logERROR("Unknown raster map mode '" + mode + "': expected auto, always or never");
+      return false;
+    }
+    return true;
+  }
+
+  /**
+   * Restrict the geometry coverage tracks to a region of interest.
+   * @param region A comma separated list of <i>parameter=min:max</i> ranges, the parameter being <i>eta</i> or <i>phi</i> (rad);
+   * the parameters which are not listed keep their whole range
+   * @return True if the region could be parsed, false otherwise
+   */
+  bool Squid::setGeometryTrackRegion(const std::string& region) {
+    inputs_["geometry-region"] += region + ";";
+    for (const std::string& range : split(region, ",")) {
+      auto assignment = split(range, "=");
+      auto limits = assignment.size() == 2 ? split<double>(assignment[1], ":") : std::vector<double>();
+      const std::string parameter = assignment.empty() ? "" : trim(assignment[0]);
+      if ((parameter != "eta" && parameter != "phi") || limits.size() != 2 || limits[1] <= limits[0]) {
+        logERROR("Malformed geometry track range '" + range + "': expected eta or phi=min:max");
+        return false;
+      }
+      if (parameter == "eta") {
+        a.geometryTrackEtaRange(limits[0], limits[1]);
+        pixelAnalyzer.geometryTrackEtaRange(limits[0], limits[1]);
+      } else {
+        a.geometryTrackPhiRange(limits[0], limits[1]);
+        pixelAnalyzer.geometryTrackPhiRange(limits[0], limits[1]);
+      }
+    }
+    return true;
+  }
+
+  /**
+   * Size the lookup of the modules the geometry tracks may hit. More z slices and bins mean fewer modules tested per track,
+   * for more memory: the geometry analysis logs both, with the fraction of the modules tested which were actually hit.
+   * @param sizes A comma-separated list of z=slices and bins=factor, the number of (eta, phi) bins per slice relative to the number of modules
+   * @return True if the sizes could be parsed, false otherwise
+   */
+  bool Squid::setGeometryIndex(const std::string& sizes) {
+    int zSlices = 1;
+    double granularity = 1;
+    for (const std::string& size : split(sizes, ",")) {
+      auto assignment = split(size, "=");
+      const std::string parameter = assignment.empty() ? "" : trim(assignment[0]);
+      double value = assignment.size() == 2 ? str2any<double>(assignment[1]) : 0;
+      if ((parameter != "z" && parameter != "bins") || value <= 0) {
+        logERROR("Malformed geometry index size '" + size + "': expected z=slices or bins=factor");
+        return false;
+      }
+      if (parameter == "z") zSlices = int(value);
+      else granularity = value;
+    }
+    a.geometryIndexGranularity(zSlices, granularity);
+    pixelAnalyzer.geometryIndexGranularity(zSlices, granularity);
+    return true;
+  }
+
+  /**
+   * Shoot each geometry coverage track of a row in its own slice of the eta range, instead of anywhere in it
+   * @param stratify True to stratify the tracks in eta
+   */
+  void Squid::stratifyGeometryTracks(bool stratify) {
+    inputs_["stratified-eta"] = stratify ? "1" : "0";
+    a.stratifyGeometryTrackEta(stratify);
+    pixelAnalyzer.stratifyGeometryTrackEta(stratify);
   }
-}
 
+  /**
+   * Stop shooting the geometry coverage tracks once the coverage profile has reached the given precision.
+   * @param precision The relative statistical error to be reached in every bin; 0 to always shoot all the tracks
+   */
+  void Squid::setGeometryTrackPrecision(double precision) {
+    inputs_["geometry-precision"] = any2str(precision);
+    a.geometryTrackPrecision(precision);
+    pixelAnalyzer.geometryTrackPrecision(precision);
+  }
+
+  /**
+   * Give the track scans a wall time rather than a number of tracks: the geometry scan shoots rows of tracks until its
+   * time is spent, and the material scan is sized from the time a pilot scan takes. The number of tracks of each scan
+   * (and the precision of the coverage profile) is then reported on the info page.
+   * @param budget The time in seconds, either shared evenly among the analyses, or given per analysis as
+   * <i>geometry=seconds,material=seconds</i>
+   * @param analyses The analyses of the run a global budget is shared among, of <i>geometry</i> and <i>material</i>
+   * @return True if the budget could be parsed, false otherwise
+   */
+  bool Squid::setTimeBudget(const std::string& budget, const std::vector<std::string>& analyses) {
+    geometrySeconds_ = materialSeconds_ = 0;
+    for (const std::string& share : split(budget, ",")) {
+      auto assignment = split(share, "=");
+      std::string analysis = assignment.size() == 2 ? trim(assignment[0]) : "";
+      double seconds = assignment.empty() ? 0 : str2any<double>(assignment.back());
+      if (assignment.empty() || assignment.size() > 2 || seconds <= 0 || (assignment.size() == 2 && analysis != "geometry" && analysis != "material")) {
+        logERROR("Malformed time budget '" + share + "': expected seconds, or geometry=seconds and material=seconds");
+        geometrySeconds_ = materialSeconds_ = 0;
+        return false;
+      }
+      if (assignment.size() == 1) {
+        for (const std::string& name : analyses) {
+          if (name == "geometry") geometrySeconds_ = seconds / analyses.size();
+          else if (name == "material") materialSeconds_ = seconds / analyses.size();
+        }
+      } else (analysis == "geometry" ? geometrySeconds_ : materialSeconds_) = seconds;
+    }
+    return true;
+  }
+
+  /**
+   * Shoot the geometry coverage tracks as charged particles of the given pt, which follow their helix in the field.
+   * @param pt The transverse momentum of the tracks, in GeV/c; 0 for straight tracks
+   */
+  void Squid::setGeometryTrackPt(double pt) {
+    inputs_["geometry-pt"] = any2str(pt);
+    a.geometryTrackPt(pt);
+    pixelAnalyzer.geometryTrackPt(pt);
+  }
+
+  /**
+   * Take the directions of the geometry and material tracks from a low-discrepancy (Halton) sequence instead of random streams.
+   * @param quasiRandom True to use the quasi-random sequence
+   */
+  void Squid::setQuasiRandomTracks(bool quasiRandom) {
+    inputs_["quasi-random"] = quasiRandom ? "1" : "0";
+    a.quasiRandomTracks(quasiRandom);
+    pixelAnalyzer.quasiRandomTracks(quasiRandom);
+  }
+
+  /**
+   * Let the resolution and trigger scans take the tracks of the material budget scan, with the hits found there, instead
+   * of shooting tracks of their own and looking for their hits again. The tracks then span the eta range of the material
+   * scan and start from the origin.
+   * @param singlePass True to share the tracks of the material budget scan
+   */
+  void Squid::setSinglePassScan(bool singlePass) {
+    inputs_["single-pass"] = singlePass ? "1" : "0";
+    a.shareMaterialTracks(singlePass);
+  }
+
+  /**
+   * Shoot the material tracks within the smallest phi period the modules of the layout repeat with: the material budget
+   * is the same, and a quasi-random sequence of directions covers the period more densely than the whole turn.
+   * @param phiSymmetry True to use the phi symmetry of the modules
+   */
+  void Squid::setPhiSymmetry(bool phiSymmetry) {
+    inputs_["phi-symmetry"] = phiSymmetry ? "1" : "0";
+    a.usePhiSymmetry(phiSymmetry);
+    pixelAnalyzer.usePhiSymmetry(phiSymmetry);
+  }
+
+  /**
+   * Average the points of the resolution graphs in eta bins, instead of keeping one point per track: the graphs then
+   * hold a fixed number of points, however many tracks are shot.
+   * @param bins The number of eta bins; 0 to keep one point per track
+   */
+  void Squid::setResolutionGraphBins(int bins) {
+    inputs_["resolution-bins"] = any2str(bins);
+    a.resolutionGraphBins(bins);
+    pixelAnalyzer.resolutionGraphBins(bins);
+  }
+
+  /**
+   * Estimate the resolutions analytically, from the radii, the material and the resolutions of the layers and disks,
+   * instead of shooting the resolution tracks and fitting their hits: the curves come out at once, for screening
+   * layouts, the tracks being kept for the final numbers.
+   * @param fast True for the analytic estimate
+   */
+  void Squid::setFastResolution(bool fast) {
+    inputs_["fast-resolution"] = fast ? "1" : "0";
+    fastResolution_ = fast;
+  }
+
+  /**
+   * Report the material budget for other materials than those of the material tab, or other masses of some components.
+   * The material tracks are sent once, keeping the elements they cross, then the histograms of the material budget are
+   * reweighted with the changes, instead of building and routing the materials again. Each line of the file is either a
+   * material in the format of the material tab (<i>name density radiation_length interaction_length</i>), replacing its
+   * lengths, or <i>component name factor</i>, scaling the masses of a component; lines starting with '#' are comments.
+   * @param fileName The name of the file of the changes
+   * @return True if the file could be read, false otherwise
+   */
+  bool Squid::setMaterialWhatIf(const std::string& fileName) {
+    std::ifstream whatIfStream(fileName.c_str());
+    if (!whatIfStream) {
+      logERROR("Could not open the material what-if file " + fileName);
+      return false;
+    }
+    whatIfMaterialLengths_.clear();
+    whatIfComponentScales_.clear();
+    std::string line;
+    while (std::getline(whatIfStream, line)) {
+      std::istringstream lineStream(line);
+      std::string name;
+      if (!(lineStream >> name) || name[0] == '#') continue;
+      if (name == "component") {
+        double scale;
+        if (!(lineStream >> name >> scale) || scale < 0) {
+          logERROR("Malformed component line '" + line + "' in " + fileName + ": expected component name factor");
+          return false;
+        }
+        whatIfComponentScales_[name] = scale;
+      } else {
+        double density, radiationLength, interactionLength;
+        if (!(lineStream >> density >> radiationLength >> interactionLength) || radiationLength <= 0 || interactionLength <= 0) {
+          logERROR("Malformed material line '" + line + "' in " + fileName + ": expected name density radiation_length interaction_length");
+          return false;
+        }
+        whatIfMaterialLengths_[name] = std::make_pair(radiationLength, interactionLength);
+      }
+    }
+    materialWhatIf_ = true;
+    inputs_["material-whatif"] = fileFingerprint(fileName);
+    a.recordMaterialCrossings(true);
+    return true;
+  }
+
+  /**
+   * Restrict the material budget scans to a shard of the material tracks, to be merged with the other shards by a
+   * later run. The shards are contiguous slices of the tracks, whose directions do not depend on the slicing: the
+   * merged scan is the one a single run would make, with the same random seed.
+   * @param shard The shard, as i/N with i from 1 to N
+   * @return True if the shard could be parsed, false otherwise
+   */
+  bool Squid::setMaterialTrackShard(const std::string& shard) {
+    auto parts = split(shard, "/");
+    int i = parts.size() == 2 ? str2any<int>(parts[0]) : 0;
+    int n = parts.size() == 2 ? str2any<int>(parts[1]) : 0;
+    if (n < 1 || i < 1 || i > n) {
+      logERROR("Malformed shard '" + shard + "': expected i/N with 1 <= i <= N");
+      return false;
+    }
+    materialShard_ = i - 1;
+    materialShards_ = n;
+    a.materialTrackShard(materialShard_, materialShards_);
+    pixelAnalyzer.materialTrackShard(materialShard_, materialShards_);
+    return true;
+  }
+
+  /**
+   * Take the material budget scans from the files written by the runs of all the shards of the material tracks,
+   * instead of shooting the tracks. The shards are checked against the geometry, number of tracks and seed of this run.
+   * @param fileNames The files of the shards, in any order
+   */
+  void Squid::setMaterialShardFiles(const std::vector<std::string>& fileNames) {
+    materialShardFiles_ = fileNames;
+    inputs_["material-shards"] = "";
+    for (const std::string& fileName : fileNames) inputs_["material-shards"] += fileFingerprint(fileName) + " ";
+  }
+
+  /**
+   * Write the material budget scans of this run's shard of the material tracks, with what identifies the scan
+   * @param fileName The name of the file, which is recreated
+   * @return True if the file could be written, false otherwise
+   */
+  bool Squid::writeMaterialShard(const std::string& fileName) {
+    scopeTaskClock("Squid::writeMaterialShard");
+    if (!materialScanTracks_) {
+      logERROR("There is no material budget scan to write to " + fileName);
+      return false;
+    }
+    TDirectory* currentDirectory = gDirectory;
+    TFile shardFile(fileName.c_str(), "RECREATE");
+    if (shardFile.IsZombie()) {
+      logERROR("Could not create the material shard file " + fileName);
+      if (currentDirectory) currentDirectory->cd();
+      return false;
+    }
+    std::ostringstream build;
+    build << std::hex << configurationHash_;
+    TNamed("shard", (any2str(materialShard_ + 1) + "/" + any2str(materialShards_)).c_str()).Write();
+    TNamed("build", build.str().c_str()).Write();
+    TNamed("tracks", any2str(materialScanTracks_).c_str()).Write();
+    TNamed("maps", materialScanMaps_ ? "1" : "0").Write();
+    TNamed("seed", inputs_["seed"].c_str()).Write();
+    a.writeMaterialScan(*shardFile.mkdir("tracker"));
+    if (pm) pixelAnalyzer.writeMaterialScan(*shardFile.mkdir("pixel"));
+    shardFile.Write();
+    bool written = shardFile.IsOpen() && !shardFile.TestBit(TFile::kWriteError);
+    shardFile.Close();
+    if (currentDirectory) currentDirectory->cd();
+    if (!written) logERROR("Could not write the material shard file " + fileName);
+    return written;
+  }
 
+  /**
+   * Checkpoint the material budget scans as they go, so that a run which is interrupted (as when its batch slot
+   * expires) can be resumed by the same command: the scan of the resumed run starts from the fills of the tracks before
+   * the checkpoint, merged as a shard is, and is the one an uninterrupted run would make. The checkpoint is only taken
+   * between two chunks of tracks, and is written to a temporary file first, so that a run killed meanwhile leaves the
+   * previous one. The scan of the pixel tracker is checkpointed to the same file name followed by "-pixel".
+   * @param fileName The checkpoint file, which is replaced at each checkpoint
+   * @param minutes The time between two checkpoints
+   * @param resume Whether the scans resume from the checkpoint, if there is one
+   */
+  void Squid::setMaterialCheckpoint(const std::string& fileName, double minutes, bool resume) {
+    materialCheckpointFile_ = fileName;
+    materialCheckpointMinutes_ = minutes;
+    resumeMaterialScan_ = resume;
+  }
 
+  /**
+   * Keep the hits of the resolution tracks in a file, so that a later run can compute the resolutions again (for other
+   * momenta, efficiencies or with and without the IP constraint) from the same hits, without scanning the material
+   * budget unless its report is asked for. The file is mapped into memory by the run reusing it, which only takes it
+   * if it holds the tracks of the same layouts, number of tracks and random seed; otherwise the hits are looked for
+   * again and the file is rewritten.
+   * @param fileName The track hit cache file
+   * @param reuse Whether the resolution scan takes its tracks from the file when it matches
+   */
+  void Squid::setTrackHitCache(const std::string& fileName, bool reuse) {
+    trackHitCacheFile_ = fileName;
+    reuseTrackHitCache_ = reuse;
+  }
 
+  /**
+   * Shoot the material tracks in a number of worker processes instead of this one, each with a shard of the tracks and
+   * its share of the threads, for the parts of the analyses which do not run well in threads sharing the ROOT state
+   * (see <i>analyzeMaterialBudgetInWorkers()</i>). The material budget scans are the same as in this process.
+   * @param n The number of worker processes; 1 to scan in this process
+   */
+  void Squid::setWorkerProcesses(int n) {
+    workerProcesses_ = MAX(1, n);
+  }
 
+  /**
+   * Keep what each geometry and material track of the outer tracker finds, for the comparison of layouts analysed with
+   * the same tracks: the geometry tracks are then shot over the eta region of the geometry tracks as it is given.
+   * @param record Whether the track samples are kept
+   */
+  void Squid::recordTrackSamples(bool record) {
+    inputs_["track-samples"] = record ? "1" : "0";
+    a.recordTrackSamples(record);
+  }
+
+  /**
+   * Write the samples of the geometry and material tracks of the outer tracker, kept since <i>recordTrackSamples()</i>,
+   * to a file that <i>LayoutComparison</i> compares with the one of another layout
+   * @param fileName The file the samples are written to, which is recreated
+   * @return True if the file could be written
+   */
+  bool Squid::writeTrackSamples(const std::string& fileName) {
+    scopeTaskClock("Squid::writeTrackSamples");
+    TDirectory* currentDirectory = gDirectory;
+    TFile samplesFile(fileName.c_str(), "RECREATE");
+    if (samplesFile.IsZombie()) {
+      logERROR("Could not create the track samples file " + fileName);
+      if (currentDirectory) currentDirectory->cd();
+      return false;
+    }
+    std::ostringstream build;
+    build << std::hex << configurationHash_;
+    TNamed("build", build.str().c_str()).Write();
+    TNamed("seed", inputs_["seed"].c_str()).Write();
+    a.writeTrackSamples(samplesFile);
+    samplesFile.Write();
+    bool written = samplesFile.IsOpen() && !samplesFile.TestBit(TFile::kWriteError);
+    samplesFile.Close();
+    if (currentDirectory) currentDirectory->cd();
+    if (!written) logERROR("Could not write the track samples file " + fileName);
+    return written;
+  }
+
+  /**
+   * Write a record of each track of the material and resolution scans of the outer tracker to a file, in the trees
+   * "material" and "resolution" (see <i>TrackRecordWriter</i>), compressed as the results file is: the records are
+   * written on a thread of their own as the scans go, and the file is complete once <i>closeTrackRecords()</i> is
+   * called. The tracks of a checkpoint resumed or of merged shards were not shot by this run and have no records.
+   * @param fileName The file the records are written to, which is recreated
+   * @return True if the file could be created
+   */
+  bool Squid::writeTrackRecords(const std::string& fileName) {
+    if (!trackRecords_.open(fileName, resultsCompression_)) return false;
+    a.writeTrackRecords(&trackRecords_);
+    return true;
+  }
+
+  /**
+   * Write the track records still queued and close their file
+   * @return True if the file was written
+   */
+  bool Squid::closeTrackRecords() {
+    scopeTaskClock("Squid::closeTrackRecords");
+    a.writeTrackRecords(NULL);
+    return trackRecords_.close();
+  }
+
+  /**
+   * Set how the results file is compressed
+   * @param compression The compression algorithm and level, as zlib:L, lzma:L or lz4:L with L from 0 (none) to 9,
+   * or the level alone for zlib
+   * @return True if the compression could be parsed, false otherwise
+   */
+  bool Squid::setResultsCompression(const std::string& compression) {
+    static const std::map<std::string, int> algorithms = { { "zlib", 1 }, { "lzma", 2 }, { "lz4", 4 } };
+    auto parts = split(compression, ":");
+    auto algorithm = algorithms.find(parts.size() == 2 ? parts[0] : "zlib");
+    std::string level = parts.empty() ? "" : parts.back();
+    if (parts.size() > 2 || algorithm == algorithms.end() || level.size() != 1 || !isdigit(level[0])) {
+      logERROR("Malformed compression '" + compression + "': expected zlib:L, lzma:L or lz4:L with 0 <= L <= 9");
+      return false;
+    }
+    resultsCompression_ = level == "0" ? 0 : 100 * algorithm->second + (level[0] - '0');
+    return true;
+  }
+
+  /**
+   * Write the results of the geometry scan of the outer tracker and, if there was one, of the material budget scans
+   * to a ROOT file. Each histogram is streamed to the file from where the analyzer keeps it, without a copy.
+   * @param fileName The file the results are written to, which is recreated
+   * @return True if the file could be written
+   */
+  bool Squid::writeResults(const std::string& fileName) {
+    scopeTaskClock("Squid::writeResults");
+    TDirectory* currentDirectory = gDirectory;
+    TFile resultsFile(fileName.c_str(), "RECREATE", "", resultsCompression_);
+    if (resultsFile.IsZombie()) {
+      logERROR("Could not create the results file " + fileName);
+      if (currentDirectory) currentDirectory->cd();
+      return false;
+    }
+    std::ostringstream build;
+    build << std::hex << configurationHash_;
+    TNamed("build", build.str().c_str()).Write();
+    TNamed("seed", inputs_["seed"].c_str()).Write();
+    a.writeGeometryResults(*resultsFile.mkdir("geometry"));
+    if (materialScanTracks_) {
+      a.writeMaterialScan(*resultsFile.mkdir("tracker"));
+      if (pm) pixelAnalyzer.writeMaterialScan(*resultsFile.mkdir("pixel"));
+    }
+    resultsFile.Write();
+    bool written = resultsFile.IsOpen() && !resultsFile.TestBit(TFile::kWriteError);
+    resultsFile.Close();
+    if (currentDirectory) currentDirectory->cd();
+    if (!written) logERROR("Could not write the results file " + fileName);
+    return written;
+  }
+
+  /**
+   * Write the numbers of the analyses run so far to a JSON file, for the runs which need them without a website:
+   * the eta profiles of the coverage, the radiation and interaction lengths of the outer tracker per eta bin, the
+   * averages of the bandwidth distributions and the tables of the power dissipated in the irradiated sensors.
+   * An analysis which was not run is left out.
+   * @param fileName The file the results are written to, which is recreated
+   * @return True if the file could be written
+   */
+  bool Squid::writeResultsJson(const std::string& fileName) {
+    scopeTaskClock("Squid::writeResultsJson");
+    auto quoted = [](const std::string& text) {
+      std::string result = "\"";
+      for (char c : text) {
+        if (c == '"' || c == '\\') result += '\\';
+        if (c == '\n') result += "\\n";
+        else result += c;
+      }
+      return result + "\"";
+    };
+    // the bin centres of a histogram, or its bin contents
+    auto bins = [](const TH1& histogram, bool centres) {
+      std::ostringstream list;
+      list << std::setprecision(8) << "[";
+      for (int i = 1; i <= histogram.GetNbinsX(); i++) {
+        list << (i > 1 ? ", " : "") << (centres ? histogram.GetXaxis()->GetBinCenter(i) : histogram.GetBinContent(i));
+      }
+      list << "]";
+      return list.str();
+    };
+    std::ofstream out(fileName.c_str());
+    if (!out) {
+      logERROR("Could not open the results file " + fileName);
+      return false;
+    }
+    std::ostringstream build;
+    build << std::hex << configurationHash_;
+    out << "{" << std::endl
+        << "  \"layout\": " << quoted(baseName_) << "," << std::endl
+        << "  \"build\": " << quoted(build.str()) << "," << std::endl
+        << "  \"seed\": " << quoted(inputs_["seed"]);
+    if (tr && a.getGeometryTracksUsed()) {
+      out << "," << std::endl << "  \"coverage\": {\"tracks\": " << a.getGeometryTracksUsed()
+          << ", \"eta\": " << bins(a.getTotalEtaProfile(), true)
+          << ", \"modules\": " << bins(a.getTotalEtaProfile(), false)
+          << ", \"hits\": " << bins(a.getTotalEtaProfileSensors(), false)
+          << ", \"stubs\": " << bins(a.getTotalEtaProfileStubs(), false) << "}";
+    }
+    if (materialScanTracks_) {
+      out << "," << std::endl << "  \"material\": {\"tracks\": " << materialScanTracks_
+          << ", \"eta\": " << bins(a.getHistoGlobalR(), true)
+          << ", \"radiation_length\": " << bins(a.getHistoGlobalR(), false)
+          << ", \"interaction_length\": " << bins(a.getHistoGlobalI(), false) << "}";
+    }
+    if (a.getBandwidthDistribution().GetEntries() > 0) {
+      out << "," << std::endl << "  \"bandwidth\": {\"mean_bandwidth\": " << a.getBandwidthDistribution().GetMean()
+          << ", \"mean_bandwidth_sparsified\": " << a.getBandwidthDistributionSparsified().GetMean()
+          << ", \"mean_channel_hits\": " << a.getChanHitDistribution().GetMean() << "}";
+    }
+    std::map<std::string, SummaryTable>& powerSummaries = a.getIrradiatedPowerConsumptionSummaries();
+    if (!powerSummaries.empty()) {
+      out << "," << std::endl << "  \"power\": {";
+      for (auto it = powerSummaries.begin(); it != powerSummaries.end(); ++it) {
+        // the table, row by row, the cells missing in a row being empty
+        std::vector<std::vector<std::string> > rows;
+        for (const auto& cell : it->second.getContent()) {
+          if (cell.first.first >= int(rows.size())) rows.resize(cell.first.first + 1);
+          std::vector<std::string>& row = rows[cell.first.first];
+          if (cell.first.second >= int(row.size())) row.resize(cell.first.second + 1);
+          row[cell.first.second] = cell.second;
+        }
+        out << (it != powerSummaries.begin() ? "," : "") << std::endl << "    " << quoted(it->first) << ": [";
+        for (size_t i = 0; i < rows.size(); i++) {
+          out << (i ? ", " : "") << "[";
+          for (size_t j = 0; j < rows[i].size(); j++) out << (j ? ", " : "") << quoted(rows[i][j]);
+          out << "]";
+        }
+        out << "]";
+      }
+      out << std::endl << "  }";
+    }
+    out << std::endl << "}" << std::endl;
+    out.close();
+    if (!out) logERROR("Could not write the results file " + fileName);
+    return bool(out);
+  }
+
+  /**
+   * Shoot the material tracks through the material budgets of the outer and pixel trackers
+   * @param tracks The number of material tracks
+   * @param materialReport Whether the material maps are filled
+   * @return False if a scan could not resume from its checkpoint
+   */
+  bool Squid::analyzeMaterialBudgetOnce(int tracks, bool materialReport) {
+    if (workerProcesses_ > 1) return analyzeMaterialBudgetInWorkers(tracks, materialReport);
+    startTaskClock("Analyzing material budget" );
+    bool analyzed = a.analyzeMaterialBudget(*mb, mainConfiguration.getMomenta(), tracks, pm, materialReport);
+    stopTaskClock();
+    if (analyzed && pm) {
+      startTaskClock("Analyzing pixel material budget");
+      analyzed = pixelAnalyzer.analyzeMaterialBudget(*pm, mainConfiguration.getMomenta(), tracks, NULL, materialReport);
+      stopTaskClock();
+    }
+    return analyzed;
+  }
+
+  namespace {
+    bool writeAll(int fd, const char* data, size_t size) {
+      while (size) {
+        ssize_t written = write(fd, data, size);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) return false;
+        data += written;
+        size -= written;
+      }
+      return true;
+    }
+
+    bool readAll(int fd, char* data, size_t size) {
+      while (size) {
+        ssize_t got = read(fd, data, size);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return false;
+        data += got;
+        size -= got;
+      }
+      return true;
+    }
+  }
+
+  /**
+   * Shoot the material tracks in worker processes forked from this one, each scanning a shard of the tracks (as with
+   * <i>setMaterialTrackShard()</i>) with its share of the threads. The workers inherit the frozen geometry and the
+   * material budgets, whose pages they share with this process until written to, and none of the ROOT objects they
+   * create is seen by the others. Each worker sends its mergeable scans back through a pipe, as the image of an
+   * in-memory ROOT file, and the scans are merged in shard order: the result is the one of a scan in this process.
+   * @param tracks The number of material tracks
+   * @param materialReport Whether the material maps are filled
+   * @return True if every worker sent its scans and they could be merged
+   */
+  bool Squid::analyzeMaterialBudgetInWorkers(int tracks, bool materialReport) {
+    startTaskClock("Analyzing material budget in " + any2str(workerProcesses_) + " worker processes");
+    int workerThreads = MAX(1, TaskPool::instance()->numThreads() / workerProcesses_);
+    std::vector<pid_t> workers;
+    std::vector<int> pipes;
+    bool started = true;
+    for (int shard = 0; shard < workerProcesses_; shard++) {
+      int fds[2];
+      if (pipe(fds) < 0) {
+        started = false;
+        break;
+      }
+      std::cout << std::flush;
+      std::cerr << std::flush;
+      fflush(NULL);
+      pid_t pid = fork();
+      if (pid == 0) {
+        close(fds[0]);
+        for (int fd : pipes) close(fd);
+        TaskPool::instance()->setNumThreads(workerThreads);
+        a.numThreads(workerThreads);
+        pixelAnalyzer.numThreads(workerThreads);
+        a.materialTrackShard(shard, workerProcesses_);
+        pixelAnalyzer.materialTrackShard(shard, workerProcesses_);
+        a.writeTrackRecords(NULL); // the thread of the writer is not in this process
+        bool analyzed = a.analyzeMaterialBudget(*mb, mainConfiguration.getMomenta(), tracks, pm, materialReport) &&
+                        (!pm || pixelAnalyzer.analyzeMaterialBudget(*pm, mainConfiguration.getMomenta(), tracks, NULL, materialReport));
+        if (analyzed) {
+          TMemFile scan("worker.root", "RECREATE");
+          a.writeMaterialScan(*scan.mkdir("tracker"));
+          if (pm) pixelAnalyzer.writeMaterialScan(*scan.mkdir("pixel"));
+          scan.Write();
+          Long64_t size = scan.GetSize();
+          std::vector<char> image(size);
+          scan.CopyTo(image.data(), size);
+          analyzed = writeAll(fds[1], reinterpret_cast<const char*>(&size), sizeof(size)) && writeAll(fds[1], image.data(), size);
+        }
+        close(fds[1]);
+        _exit(analyzed ? EXIT_SUCCESS : EXIT_FAILURE); // without the exit handlers of this process
+      }
+      close(fds[1]);
+      if (pid < 0) {
+        close(fds[0]);
+        started = false;
+        break;
+      }
+      workers.push_back(pid);
+      pipes.push_back(fds[0]);
+    }
+    if (!started) logERROR("Could not start the worker processes of the material budget scan");
+
+    // the scans are read in shard order, each worker waiting for its turn to finish writing
+    std::vector<std::vector<char> > images(pipes.size());
+    bool received = started;
+    for (size_t i = 0; i < pipes.size(); i++) {
+      Long64_t size = 0;
+      if (received) {
+        received = readAll(pipes[i], reinterpret_cast<char*>(&size), sizeof(size)) && size > 0;
+        if (received) {
+          images[i].resize(size);
+          received = readAll(pipes[i], images[i].data(), size);
+        }
+        if (!received) logERROR("The worker process of shard " + any2str(i + 1) + "/" + any2str(workerProcesses_) + " of the material budget scan failed");
+      }
+      close(pipes[i]);
+    }
+    for (pid_t pid : workers) {
+      int status;
+      while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+    }
+
+    bool merged = received;
+    if (merged) {
+      TDirectory* currentDirectory = gDirectory;
+      std::vector<std::unique_ptr<TMemFile> > scans;
+      std::vector<TDirectory*> trackerScans, pixelScans;
+      for (size_t i = 0; i < images.size(); i++) {
+        scans.emplace_back(new TMemFile(("worker-" + any2str(i + 1) + ".root").c_str(), images[i].data(), images[i].size(), "READ"));
+        trackerScans.push_back(scans.back()->GetDirectory("tracker"));
+        pixelScans.push_back(scans.back()->GetDirectory("pixel"));
+        if (scans.back()->IsZombie() || !trackerScans.back() || (pm && !pixelScans.back())) merged = false;
+      }
+      if (!merged) logERROR("A worker process sent an unreadable material budget scan");
+      merged = merged && a.mergeMaterialBudget(trackerScans, tracks, materialReport) &&
+               (!pm || pixelAnalyzer.mergeMaterialBudget(pixelScans, tracks, materialReport));
+      for (auto& scan : scans) scan->Close();
+      if (currentDirectory) currentDirectory->cd();
+    }
+    stopTaskClock();
+    return merged;
+  }
+
+  /**
+   * Fill the material budget scans from the files of the shards, which must be all the shards of one scan matching
+   * this run
+   * @param tracks The number of material tracks of the whole scan
+   * @param materialMaps Whether the (z, r) material maps are filled
+   * @return True if the shards could be merged, false otherwise
+   */
+  bool Squid::mergeMaterialShards(int tracks, bool materialMaps) {
+    startTaskClock("Merging the material budget shards");
+    std::ostringstream build;
+    build << std::hex << configurationHash_;
+    std::map<std::string, std::string> expected = { {"build", build.str()}, {"tracks", any2str(tracks)},
+                                                    {"maps", materialMaps ? "1" : "0"}, {"seed", inputs_["seed"]} };
+    std::vector<std::unique_ptr<TFile> > files;
+    std::map<int, TFile*> shards;
+    int numShards = 0;
+    TDirectory* currentDirectory = gDirectory;
+    bool merged = true;
+    for (const std::string& fileName : materialShardFiles_) {
+      files.emplace_back(TFile::Open(fileName.c_str(), "READ"));
+      TFile* file = files.back().get();
+      if (!file || file->IsZombie()) {
+        logERROR("Could not open the material shard file " + fileName);
+        merged = false;
+        break;
+      }
+      for (const auto& value : expected) {
+        TNamed* found = dynamic_cast<TNamed*>(file->Get(value.first.c_str()));
+        if (!found || value.second != found->GetTitle()) {
+          logERROR("The material shard file " + fileName + " is not for this scan: its " + value.first + " is " +
+                   (found ? found->GetTitle() : "missing") + " instead of " + value.second);
+          merged = false;
+        }
+      }
+      TNamed* shard = dynamic_cast<TNamed*>(file->Get("shard"));
+      auto parts = split(shard ? shard->GetTitle() : "", "/");
+      int i = parts.size() == 2 ? str2any<int>(parts[0]) : 0, n = parts.size() == 2 ? str2any<int>(parts[1]) : 0;
+      if (!merged || n < 1 || i < 1 || i > n || (numShards && n != numShards) || shards.count(i)) {
+        if (merged) logERROR("The material shard file " + fileName + " does not add a shard to the others");
+        merged = false;
+        break;
+      }
+      numShards = n;
+      shards[i] = file;
+    }
+    if (merged && (int)shards.size() != numShards) {
+      logERROR("Only " + any2str(shards.size()) + " shards of the " + any2str(numShards) + " of the material scan were given");
+      merged = false;
+    }
+    if (merged) {
+      std::vector<TDirectory*> trackerScans, pixelScans;
+      for (const auto& shard : shards) {
+        trackerScans.push_back(shard.second->GetDirectory("tracker"));
+        pixelScans.push_back(shard.second->GetDirectory("pixel"));
+        if (!trackerScans.back() || (pm && !pixelScans.back())) {
+          logERROR(std::string("The material shard file ") + shard.second->GetName() + " lacks the scan of a tracker");
+          merged = false;
+        }
+      }
+      merged = merged && a.mergeMaterialBudget(trackerScans, tracks, materialMaps) &&
+               (!pm || pixelAnalyzer.mergeMaterialBudget(pixelScans, tracks, materialMaps));
+    }
+    for (auto& file : files) if (file) file->Close();
+    if (currentDirectory) currentDirectory->cd();
+    stopTaskClock();
+    return merged;
+  }
+
+  /**
+   * Put together what a report depends on, for its pages to be left in place by the website if it is unchanged:
+   * the configuration (with its included files and the revision), the momenta of the main configuration, the given
+   * parameters and how the plots are drawn.
+   * @param report The name of the report
+   * @param inputNames The names of the parameters of the report, as recorded in inputs_
+   * @return The tag of the pages of the report
+   */
+  std::string Squid::inputTag(const std::string& report, const std::vector<std::string>& inputNames) {
+    std::ostringstream tag;
+    tag << report << ";configuration=" << std::hex << configurationHash_ << std::dec << ";momenta=";
+    for (double p : mainConfiguration.getMomenta()) tag << p << " ";
+    tag << ";trigger-momenta=";
+    for (double p : mainConfiguration.getTriggerMomenta()) tag << p << " ";
+    tag << ";threshold-probabilities=";
+    for (double p : mainConfiguration.getThresholdProbabilities()) tag << p << " ";
+    std::vector<std::string> names(inputNames);
+    names.push_back("image-formats");
+    names.push_back("raster-maps");
+    for (const std::string& name : names) tag << ";" << name << "=" << inputs_[name];
+    return tag.str();
+  }
+
+  /**
+   * Identify the content of a file which is read besides the configuration
+   * @param fileName The name of the file
+   * @return The hash of the content, in hex, or "missing" if the file cannot be read
+   */
+  std::string Squid::fileFingerprint(const std::string& fileName) {
+    std::ifstream file(fileName.c_str());
+    if (!file) return "missing";
+    std::ostringstream content;
+    content << file.rdbuf();
+    std::ostringstream fingerprint;
+    fingerprint << std::hex << std::hash<std::string>()(content.str());
+    return fingerprint.str();
+  }
+}
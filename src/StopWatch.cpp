@@ -1,6 +1,122 @@
 #include <StopWatch.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cxxabi.h>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <new>
+#include <sstream>
+#include <sys/resource.h>
+
+// Number of heap allocations made by the program so far, counted by the operator new below
+static std::atomic<long> heapAllocations_(0);
+
+namespace {
+  const char* const memoryAccountNames[StopWatch::NumMemoryAccounts] = { "Other", "Geometry", "Materials", "Service routing", "Analyses", "Tracks", "Site" };
+
+  struct AccountCounters {
+    std::atomic<long> liveBytes, peakBytes, allocations;
+  };
+  // zero-initialised, as they are static, before any allocation is made
+  AccountCounters memoryAccounts_[StopWatch::NumMemoryAccounts];
+  thread_local int currentAccount_ = StopWatch::OtherMemory;
+
+  // every allocation starts with its size and its account, so that it is credited back to the account it was charged to
+  struct AllocationHeader {
+    std::size_t size;
+    int account;
+  };
+  const std::size_t headerSize = alignof(std::max_align_t);
+  static_assert(sizeof(AllocationHeader) <= headerSize, "The allocation header does not fit before the aligned memory");
+
+  void* accountedAlloc(std::size_t size) noexcept {
+    char* p = static_cast<char*>(malloc(headerSize + size));
+    if (!p) return nullptr;
+    heapAllocations_.fetch_add(1, std::memory_order_relaxed);
+    int account = currentAccount_;
+    AllocationHeader* header = reinterpret_cast<AllocationHeader*>(p);
+    header->size = size;
+    header->account = account;
+    AccountCounters& counters = memoryAccounts_[account];
+    counters.allocations.fetch_add(1, std::memory_order_relaxed);
+    long live = counters.liveBytes.fetch_add(size, std::memory_order_relaxed) + size;
+    long peak = counters.peakBytes.load(std::memory_order_relaxed);
+    while (live > peak && !counters.peakBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed));
+    return p + headerSize;
+  }
+
+  void accountedFree(void* ptr) noexcept {
+    if (!ptr) return;
+    char* p = static_cast<char*>(ptr) - headerSize;
+    const AllocationHeader* header = reinterpret_cast<const AllocationHeader*>(p);
+    memoryAccounts_[header->account].liveBytes.fetch_sub(header->size, std::memory_order_relaxed);
+    free(p);
+  }
+}
+
+void* operator new(std::size_t size) {
+  void* p = accountedAlloc(size);
+  if (!p) throw std::bad_alloc();
+  return p;
+}
+
+void* operator new[](std::size_t size) {
+  return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+  return accountedAlloc(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+  return accountedAlloc(size);
+}
+
+void operator delete(void* p) noexcept {
+  accountedFree(p);
+}
+
+void operator delete[](void* p) noexcept {
+  accountedFree(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept {
+  accountedFree(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept {
+  accountedFree(p);
+}
+
+#ifdef __cpp_sized_deallocation
+void operator delete(void* p, std::size_t) noexcept {
+  accountedFree(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept {
+  accountedFree(p);
+}
+#endif
+
+StopWatch::MemoryScope::MemoryScope(MemoryAccount account) : previous_(memoryAccount()) {
+  currentAccount_ = account;
+}
+
+StopWatch::MemoryScope::~MemoryScope() {
+  currentAccount_ = previous_;
+}
+
+StopWatch::Scope::Scope(const std::string& name) : active_(StopWatch::instance()->onOwnThread()) {
+  if (active_) StopWatch::instance()->startCounter(name, true);
+}
+
+StopWatch::Scope::~Scope() {
+  if (active_) StopWatch::instance()->stopCounter();
+}
 
 // Global static pointer used to ensure a single instance of the class
 StopWatch* StopWatch::myInstance_ = NULL;
@@ -13,7 +129,7 @@ StopWatch* StopWatch::instance() {
 // Destroys the current instance
 void StopWatch::destroy() {
   if (myInstance_) {
-    delete myInstance_; 
+    delete myInstance_;
     myInstance_ = NULL;
   }
 }
@@ -26,37 +142,74 @@ void StopWatch::setVerbosity(unsigned int newVerbosity, bool newPerformance) {
 /* Object constructor */
 StopWatch::StopWatch() {
   lastVerbosity_ = 0;
+  printedTasks_ = 0;
   verbosity_ = 1000;
   reportTime_ = true;
-} 
+  thread_ = std::this_thread::get_id();
+}
 
 /* Object destructor */
 StopWatch::~StopWatch() {
   std::cout << std::endl;
-} 
+}
 
-void StopWatch::startCounter(std::string message) {
-  startTimes_.push_back(clock());
-  if (startTimes_.size()<=verbosity_) {
+/**
+ * Starts a counter within the running ones
+ * @param message The name of the task
+ * @param quiet True if the task is not printed; a quiet task started again right after it finished, within the same
+ * task, is summed up with its previous runs
+ */
+void StopWatch::startCounter(std::string message, bool quiet /* = false */) {
+  int depth = startTimes_.size();
+  size_t index;
+  if (quiet && !tasks_.empty() && tasks_.back().finished && tasks_.back().depth == depth && tasks_.back().name == message) {
+    index = tasks_.size() - 1;
+    tasks_[index].finished = false;
+    tasks_[index].calls++;
+  } else {
+    Task task = { message, depth, 0, 0, 0, 0, false, 1, 0 };
+    tasks_.push_back(task);
+    index = tasks_.size() - 1;
+  }
+  OpenTask open = { index, Clock::now(), cpuSeconds(), allocationCount(), quiet, 0 };
+  startTimes_.push_back(open);
+  if (quiet) return;
+  printedTasks_++;
+  if (printedTasks_<=verbosity_) {
     std::cout << std::endl;
-    for (unsigned int i=1; i<startTimes_.size(); ++i) std::cout << "  ";
+    for (unsigned int i=1; i<printedTasks_; ++i) std::cout << "  ";
     std::cout << message << " ... " << std::flush;
   }
 }
 
+/**
+ * Stops the innermost running counter and records the resources used by its task
+ * @return The wall clock time of the task in s
+ */
 double StopWatch::stopCounter() {
   double timeSeconds;
   if (startTimes_.size()) {
-    clock_t stopTime = clock();
-    clock_t startTime = startTimes_.back();
+    const OpenTask& open = startTimes_.back();
+    Task& task = tasks_[open.index];
+    timeSeconds = std::chrono::duration<double>(Clock::now() - open.wallStart).count();
+    task.wallSeconds += timeSeconds;
+    task.selfSeconds += timeSeconds - open.childSeconds;
+    task.cpuSeconds += cpuSeconds() - open.cpuStart;
+    task.allocations += allocationCount() - open.allocationStart;
+    task.peakRssKb = peakRssKb();
+    task.finished = true;
+    bool quiet = open.quiet;
     startTimes_.pop_back();
-    timeSeconds = diffClock(stopTime, startTime);
-    if (startTimes_.size()<verbosity_) {
-      if (startTimes_.size()<lastVerbosity_) std::cout << std::endl;
-      std::cout << "done" ;
-      if (reportTime_) std::cout << " [in " << timeSeconds << " s]";
-      std::cout << std::flush;
-      lastVerbosity_=startTimes_.size();
+    if (!startTimes_.empty()) startTimes_.back().childSeconds += timeSeconds;
+    if (!quiet) {
+      printedTasks_--;
+      if (printedTasks_<verbosity_) {
+        if (printedTasks_<lastVerbosity_) std::cout << std::endl;
+        std::cout << "done" ;
+        if (reportTime_) std::cout << " [in " << task.wallSeconds << " s, cpu " << task.cpuSeconds << " s]";
+        std::cout << std::flush;
+        lastVerbosity_=printedTasks_;
+      }
     }
   } else {
     timeSeconds = 0;
@@ -65,16 +218,164 @@ double StopWatch::stopCounter() {
   return timeSeconds;
 }
 
+/**
+ * Records a task which was timed elsewhere, by another thread for instance, as a finished subtask of the running one
+ * @param name The name of the task
+ * @param wallSeconds The wall clock time of the task
+ * @param cpuSeconds The CPU time of the task
+ */
+void StopWatch::addTask(const std::string& name, double wallSeconds, double cpuSeconds) {
+  Task task = { name, (int)startTimes_.size(), wallSeconds, cpuSeconds, peakRssKb(), 0, true, 1, wallSeconds };
+  tasks_.push_back(task);
+}
+
 void StopWatch::addInfo(std::string message) {
   if (startTimes_.size()<=verbosity_) {
     std::cout << message << " " << std::flush;
   }
 }
 
-/* Returns the difference between start and stop time in s */
-double StopWatch::diffClock(const clock_t& stopTime, const clock_t& startTime) {
-  double diffticks=stopTime-startTime;
-  double diffs=(diffticks)/CLOCKS_PER_SEC;
-  return diffs;
+/**
+ * Lists the tasks, one per line, in the order they were started
+ * @return The text of the CSV table, with a header line
+ */
+std::string StopWatch::csvReport() const {
+  std::ostringstream csv;
+  csv << "task,depth,wall_s,cpu_s,peak_rss_kb,allocations,finished,calls,self_s" << std::endl;
+  for (const Task& t : tasks_) {
+    std::string name = t.name;
+    for (size_t pos = name.find('"'); pos != std::string::npos; pos = name.find('"', pos + 2)) name.insert(pos, 1, '"');
+    csv << '"' << name << "\"," << t.depth << "," << t.wallSeconds << "," << t.cpuSeconds << ","
+        << t.peakRssKb << "," << t.allocations << "," << (t.finished ? 1 : 0) << "," << t.calls << "," << t.selfSeconds << std::endl;
+  }
+  return csv.str();
+}
+
+/**
+ * Lists the tasks as a tree, the tasks started within a task being its "subtasks"
+ * @return The text of the JSON array of the outermost tasks
+ */
+std::string StopWatch::jsonReport() const {
+  std::ostringstream json;
+  int depth = -1;
+  json << "[";
+  for (size_t i = 0; i < tasks_.size(); i++) {
+    const Task& t = tasks_[i];
+    for (; depth > t.depth; depth--) json << "}]";
+    if (depth == t.depth) json << "},";
+    else if (i > 0 && depth < t.depth) json << ", \"subtasks\": [";
+    depth = t.depth;
+    std::string name;
+    for (char c : t.name) {
+      if (c == '"' || c == '\\') name += '\\';
+      if (c == '\n') name += "\\n";
+      else name += c;
+    }
+    json << std::endl << std::string(2*(t.depth+1), ' ')
+         << "{\"task\": \"" << name << "\", \"wall_s\": " << t.wallSeconds << ", \"cpu_s\": " << t.cpuSeconds
+         << ", \"peak_rss_kb\": " << t.peakRssKb << ", \"allocations\": " << t.allocations
+         << ", \"finished\": " << (t.finished ? "true" : "false") << ", \"calls\": " << t.calls << ", \"self_s\": " << t.selfSeconds;
+  }
+  if (depth >= 0) {
+    json << "}";
+    for (; depth > 0; depth--) json << "]}";
+  }
+  json << "]" << std::endl;
+  return json.str();
+}
+
+/**
+ * Writes the report of the tasks to a file, as JSON if its name ends by .json and as CSV otherwise
+ * @param fileName The name of the file
+ * @return True if the file could be written
+ */
+bool StopWatch::writeReport(const std::string& fileName) const {
+  std::ofstream out(fileName.c_str());
+  if (!out) {
+    logERROR("Could not open the performance report file " + fileName);
+    return false;
+  }
+  bool json = fileName.size() >= 5 && fileName.compare(fileName.size() - 5, 5, ".json") == 0;
+  out << (json ? jsonReport() : csvReport());
+  return bool(out);
 }
 
+/* Returns the number of heap allocations made so far */
+long StopWatch::allocationCount() {
+  return heapAllocations_.load(std::memory_order_relaxed);
+}
+
+/* Returns the account the allocations of the calling thread are charged to */
+StopWatch::MemoryAccount StopWatch::memoryAccount() {
+  return MemoryAccount(currentAccount_);
+}
+
+/**
+ * Gives the heap memory of each account
+ * @return The usage of the accounts, in the order of MemoryAccount
+ */
+std::vector<StopWatch::MemoryUsage> StopWatch::memoryUsage() {
+  std::vector<MemoryUsage> usage;
+  for (int i = 0; i < NumMemoryAccounts; i++) {
+    const AccountCounters& counters = memoryAccounts_[i];
+    usage.push_back({ memoryAccountNames[i], counters.liveBytes.load(std::memory_order_relaxed), counters.peakBytes.load(std::memory_order_relaxed),
+                      counters.allocations.load(std::memory_order_relaxed) });
+  }
+  return usage;
+}
+
+/**
+ * Lists the heap memory of each account, as a text table. The peaks of the accounts are reached at different times,
+ * so that they do not add up to the peak of the process
+ * @return The text of the table
+ */
+std::string StopWatch::memoryReport() {
+  std::ostringstream out;
+  out << "Heap memory by subsystem" << std::endl;
+  out << std::left << std::setw(20) << "account" << std::right << std::setw(14) << "live [MB]" << std::setw(14) << "peak [MB]"
+      << std::setw(16) << "allocations" << std::endl;
+  for (const MemoryUsage& usage : memoryUsage()) {
+    out << std::left << std::setw(20) << usage.account << std::right << std::fixed << std::setprecision(1)
+        << std::setw(14) << usage.liveBytes / 1048576. << std::setw(14) << usage.peakBytes / 1048576.
+        << std::setw(16) << usage.allocations << std::endl;
+  }
+  return out.str();
+}
+
+/* Returns the CPU time (user and system) used by all the threads of the process so far, in s */
+double StopWatch::cpuSeconds() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec)*1e-6;
+}
+
+/* Returns the CPU time (user and system) used by the calling thread so far, in s, or by the process where it is not known */
+double StopWatch::threadCpuSeconds() {
+#ifdef RUSAGE_THREAD
+  struct rusage usage;
+  getrusage(RUSAGE_THREAD, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec)*1e-6;
+#else
+  return cpuSeconds();
+#endif
+}
+
+/**
+ * Gives the readable name of a type, to name the task of what it does
+ * @param type The type, as given by typeid
+ * @return The demangled name, or the mangled one if it cannot be demangled
+ */
+std::string StopWatch::typeName(const std::type_info& type) {
+  int status = 0;
+  char* demangled = abi::__cxa_demangle(type.name(), NULL, NULL, &status);
+  std::string name = status == 0 && demangled ? demangled : type.name();
+  free(demangled);
+  return name;
+}
+
+/* Returns the peak resident memory of the process so far, in kB */
+long StopWatch::peakRssKb() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
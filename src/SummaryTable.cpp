@@ -1,26 +1,96 @@
 #include "SummaryTable.h"
 
-template<> void SummaryTable::setCell<std::string>(const int row, const int column, const std::string& content) {
-  if (column > 0 && !hasCell(0, column)) summaryTable[std::make_pair(0, column)] = any2str(column + columnOffset_);
-  if (row > 0 && !hasCell(row, 0)) summaryTable[std::make_pair(row, 0)] = any2str(row + rowOffset_);
-  summaryTable[std::make_pair(row, column)]=content;
+/**
+ * The cell at a position, with the rows and columns up to it created empty if they do not exist yet
+ */
+SummaryTable::Cell& SummaryTable::cell(int row, int column) {
+  if (row >= (int)cells_.size()) cells_.resize(row + 1);
+  std::vector<Cell>& cellRow = cells_[row];
+  if (column >= (int)cellRow.size()) cellRow.resize(column + 1);
+  return cellRow[column];
+}
+
+/**
+ * The content of the cell as a string: the text, or the number converted with the precision it was set with
+ */
+std::string SummaryTable::Cell::str() const {
+  switch (kind) {
+  case Text: return text;
+  case Integer: return any2str((long long)number);
+  case Real: return any2str(number, precision);
+  default: return std::string();
+  }
+}
+
+/**
+ * Set a cell, numbering its row and column headers if they were not set yet
+ */
+void SummaryTable::setCellContent(int row, int column, const Cell& content) {
+  if (column > 0 && !hasCell(0, column)) cell(0, column).setNumber(column + columnOffset_, true, -1);
+  if (row > 0 && !hasCell(row, 0)) cell(row, 0).setNumber(row + rowOffset_, true, -1);
+  cell(row, column) = content;
   numRows_ = row+1 > numRows_ ? row+1 : numRows_;
   numColumns_ = column+1 > numColumns_ ? column+1 : numColumns_;
 }
 
+template<> void SummaryTable::setCell<std::string>(int row, int column, const std::string& content) {
+  Cell c;
+  c.setText(content);
+  setCellContent(row, column, c);
+}
+
+/**
+ * The content of the table for rendering, with the numbers converted to strings
+ * @return The cells that were set, by (row, column)
+ */
+const SummaryTable::Content& SummaryTable::getContent() const {
+  content_.clear();
+  for (int row = 0; row < (int)cells_.size(); row++) {
+    for (int column = 0; column < (int)cells_[row].size(); column++) {
+      if (cells_[row][column].kind != Cell::Empty) content_[std::make_pair(row, column)] = cells_[row][column].str();
+    }
+  }
+  return content_;
+}
+
+/**
+ * Copy the cells of another table into this one, as if they had been set with <i>setCell()</i>. The cells the two tables have
+ * in common take the content of the other one; the header of the other table, if any, replaces the one of this table.
+ * @param other The table to be merged into this one
+ */
+void SummaryTable::merge(const SummaryTable& other) {
+  for (int row = 0; row < (int)other.cells_.size(); row++) {
+    for (int column = 0; column < (int)other.cells_[row].size(); column++) {
+      const Cell& c = other.cells_[row][column];
+      if (c.kind == Cell::Empty) continue;
+      if (row == 0 && column == 0) cell(0, 0) = c;
+      else setCellContent(row, column, c);
+    }
+  }
+}
+
+/**
+ * Merge each of the tables of a collection into the table with the same name of another collection
+ * @param into The collection the tables are merged into
+ * @param from The collection of the tables to be merged
+ */
+void mergeSummaries(MultiSummaryTable& into, const MultiSummaryTable& from) {
+  for (const auto& table : from) into[table.first].merge(table.second);
+}
+
 template<> void SummaryTable::setSummaryCell<std::string>(std::string label, const std::string& content) {
   if (!hasSummaryCell()) {
     if (numRows_ > 2 && numColumns_ > 2) {
-      summaryLabelPosition_ = std::make_pair(numRows_, 0); 
+      summaryLabelPosition_ = std::make_pair(numRows_, 0);
       summaryCellPosition_ = std::make_pair(numRows_++, numColumns_++);
     } else if (numRows_ >= 2 && numColumns_ == 2) {
-      summaryLabelPosition_ = std::make_pair(numRows_, 0); 
+      summaryLabelPosition_ = std::make_pair(numRows_, 0);
       summaryCellPosition_ = std::make_pair(numRows_++, 1);
     } else if (numRows_ == 2 && numColumns_ > 2) {
-      summaryLabelPosition_ = std::make_pair(0, numColumns_); 
+      summaryLabelPosition_ = std::make_pair(0, numColumns_);
       summaryCellPosition_ = std::make_pair(1, numColumns_++);
     }
   }
-  summaryTable[summaryLabelPosition_] = label;
-  summaryTable[summaryCellPosition_] = content;
+  cell(summaryLabelPosition_.first, summaryLabelPosition_.second).setText(label);
+  cell(summaryCellPosition_.first, summaryCellPosition_.second).setText(content);
 }
@@ -8,6 +8,7 @@
 #include <set>
 #include "SupportStructure.h"
 #include "MaterialTab.h"
+#include "MaterialKeys.h"
 #include "messageLogger.h"
 #include "MaterialProperties.h"
 #include "InactiveElement.h"
@@ -168,9 +169,7 @@ namespace material {
   }
 
   void SupportStructure::updateInactiveSurfaces(InactiveSurfaces& inactiveSurfaces) {
-    for(InactiveElement* inactiveElement : inactiveElements) {
-      inactiveSurfaces.addSupportPart(*inactiveElement);
-    }
+    inactiveSurfaces.addSupportParts(inactiveElements);
   }
 
   void SupportStructure::buildBase() {
@@ -264,6 +263,7 @@ namespace material {
       newElement->store(propertyTree());
       newElement->store(currentElementNode.second);
       newElement->check();
+      newElement->resolveKeys();
       newElement->cleanup();
 
       elements_.push_back(newElement);
@@ -288,7 +288,9 @@ namespace material {
     quantity ("quantity", parsedAndChecked()),
     unit ("unit", parsedAndChecked()),
     debugInactivate ("debugInactivate", parsedOnly(), false),
-    materialTab_ (MaterialTab::instance()) {}
+    materialTab_ (MaterialTab::instance()),
+    materialKey_ (MaterialKeys::noKey),
+    componentKey_ (MaterialKeys::noKey) {}
     
   const std::string SupportStructure::Element::msg_no_valid_unit = "No valid unit: ";
 
@@ -328,9 +330,21 @@ namespace material {
     
     if(debugInactivate() == false) {
       quantity = quantityInGrams(materialProperties.getLength(), materialProperties.getSurface());
-      materialProperties.addLocalMass(elementName(), componentName(), quantity);
+      if (componentKey_ != MaterialKeys::noKey) {
+        materialProperties.addLocalMass(materialKey_, componentKey_, quantity);
+      } else {
+        materialProperties.addLocalMass(elementName(), componentName(), quantity);
+      }
     }
   }
+
+  /**
+   * Sets the keys of the names of the element, so that the mass maps are filled without looking them up by name
+   */
+  void SupportStructure::Element::resolveKeys() {
+    materialKey_ = MaterialKeys::key(elementName());
+    componentKey_ = componentName.state() ? MaterialKeys::key(componentName()) : MaterialKeys::noKey;
+  }
   
   //=============== end class SupportStructure::Element
 }
@@ -0,0 +1,464 @@
+#include <TaskPool.h>
+#include <StopWatch.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <pthread.h>
+#include <sched.h>
+
+namespace {
+  typedef std::chrono::steady_clock Clock;
+
+  // Whether the current thread is running a task of the pool, whose own jobs are then run in place
+  thread_local bool inTask = false;
+  // The NUMA node the current thread is pinned to, or -1 if it is not
+  thread_local int pinnedNode = -1;
+
+  double secondsSince(const Clock::time_point& start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+  }
+
+  // The CPUs the quota of a cgroup amounts to, rounded up; 0 if there is no quota
+  int cgroupCpus() {
+    long quota = -1, period = 0;
+    std::ifstream v2("/sys/fs/cgroup/cpu.max");
+    std::string max;
+    if (v2 >> max >> period) {
+      if (max == "max") return 0;
+      std::istringstream(max) >> quota;
+    } else {
+      std::ifstream v1Quota("/sys/fs/cgroup/cpu/cpu.cfs_quota_us"), v1Period("/sys/fs/cgroup/cpu/cpu.cfs_period_us");
+      if (!(v1Quota >> quota) || !(v1Period >> period)) return 0;
+    }
+    if (quota <= 0 || period <= 0) return 0;
+    return (quota + period - 1) / period;
+  }
+
+  // The CPUs of a list of the kernel, such as "0-7,16-23"
+  std::vector<int> parseCpuList(const std::string& list) {
+    std::vector<int> cpus;
+    std::istringstream in(list);
+    std::string range;
+    while (std::getline(in, range, ',')) {
+      int first, last;
+      char dash;
+      std::istringstream r(range);
+      if (!(r >> first)) continue;
+      if (!(r >> dash >> last)) last = first;
+      for (int cpu = first; cpu <= last; cpu++) cpus.push_back(cpu);
+    }
+    return cpus;
+  }
+
+  // The node of each CPU, -1 for the CPUs of no node the process may use
+  std::vector<int>& cpuNodes() {
+    static std::vector<int> nodes;
+    return nodes;
+  }
+}
+
+// Returns the pool, which lives as long as the program so that no job outlives its threads
+TaskPool* TaskPool::instance() {
+  static TaskPool* myInstance = new TaskPool;
+  return myInstance;
+}
+
+TaskPool::TaskPool() : numThreads_(1), numaPinning_(false), workers_(new Workers) {
+  pthread_atfork(NULL, NULL, &TaskPool::forgetWorkersInChild);
+}
+
+/**
+ * Leaves the threads of the parent process, which do not exist in the child, to their fate (with the mutexes they may
+ * hold): the child starts threads of its own at its first job
+ */
+void TaskPool::forgetWorkersInChild() {
+  TaskPool* pool = instance();
+  pool->workers_ = new Workers;
+}
+
+/**
+ * The number of CPUs the process may use: those of its affinity mask, within the CPU quota of its cgroup if it has one
+ * @return The number of CPUs, at least 1
+ */
+int TaskPool::availableCpus() {
+  int cpus = std::thread::hardware_concurrency();
+  cpu_set_t mask;
+  if (sched_getaffinity(0, sizeof(mask), &mask) == 0) cpus = CPU_COUNT(&mask);
+  int quota = cgroupCpus();
+  if (quota > 0 && quota < cpus) cpus = quota;
+  return cpus > 1 ? cpus : 1;
+}
+
+/**
+ * The NUMA nodes of the machine which have CPUs the process may use, read once from the kernel; a single node of all the
+ * CPUs of the process where the kernel does not tell
+ * @return The CPUs of each node, within the affinity mask of the process
+ */
+const std::vector<std::vector<int> >& TaskPool::numaNodes() {
+  static std::vector<std::vector<int> > nodes;
+  static std::once_flag read;
+  std::call_once(read, []() {
+    cpu_set_t mask;
+    bool masked = sched_getaffinity(0, sizeof(mask), &mask) == 0;
+    for (int node = 0; ; node++) {
+      std::ifstream list("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+      std::string text;
+      if (!(list >> text)) {
+        if (node < 64) continue; // the nodes may be numbered with gaps
+        break;
+      }
+      std::vector<int> cpus;
+      for (int cpu : parseCpuList(text)) if (cpu >= 0 && cpu < CPU_SETSIZE && (!masked || CPU_ISSET(cpu, &mask))) cpus.push_back(cpu);
+      if (!cpus.empty()) nodes.push_back(cpus);
+    }
+    if (nodes.empty()) {
+      std::vector<int> cpus;
+      for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) if (!masked || CPU_ISSET(cpu, &mask)) cpus.push_back(cpu);
+      nodes.push_back(cpus);
+    }
+    for (unsigned int node = 0; node < nodes.size(); node++) {
+      for (int cpu : nodes[node]) {
+        if ((int)cpuNodes().size() <= cpu) cpuNodes().resize(cpu + 1, -1);
+        cpuNodes()[cpu] = node;
+      }
+    }
+  });
+  return nodes;
+}
+
+/**
+ * Pins the threads of the pool to the NUMA nodes, or lets them run anywhere again. The threads are shared among the
+ * nodes in contiguous blocks of their indices, the calling thread of a job (index 0) staying unpinned. No job may be
+ * running.
+ * @param pinned True to pin the threads
+ */
+void TaskPool::setNumaPinning(bool pinned) {
+  std::lock_guard<std::mutex> running(workers_->runMutex);
+  if (pinned == numaPinning_) return;
+  stopWorkers();
+  numaPinning_ = pinned;
+  startWorkers();
+}
+
+/**
+ * The NUMA node of the calling thread: the one it is pinned to, or else the one of the CPU it runs on
+ * @return The index of the node in <i>numaNodes()</i>, 0 if it is not known
+ */
+int TaskPool::currentNode() {
+  if (pinnedNode >= 0) return pinnedNode;
+  numaNodes();
+  int cpu = sched_getcpu();
+  return cpu >= 0 && cpu < (int)cpuNodes().size() && cpuNodes()[cpu] >= 0 ? cpuNodes()[cpu] : 0;
+}
+
+/**
+ * Runs a function on a thread pinned to a NUMA node, so that the memory it allocates and first writes is that of the
+ * node, and returns once it is done
+ * @param node The index of the node in <i>numaNodes()</i>
+ * @param task The function
+ */
+void TaskPool::runOnNode(int node, const std::function<void()>& task) {
+  std::exception_ptr failure;
+  StopWatch::MemoryAccount account = StopWatch::memoryAccount();
+  std::thread thread([&]() {
+    StopWatch::MemoryScope memoryScope(account);
+    pinToNode(node);
+    try { task(); }
+    catch (...) { failure = std::current_exception(); }
+  });
+  thread.join();
+  if (failure) std::rethrow_exception(failure);
+}
+
+// Pins the calling thread to the CPUs of a NUMA node; false if it could not be
+bool TaskPool::pinToNode(int node) {
+  const std::vector<std::vector<int> >& nodes = numaNodes();
+  if (node < 0 || node >= (int)nodes.size()) return false;
+  cpu_set_t mask;
+  CPU_ZERO(&mask);
+  for (int cpu : nodes[node]) CPU_SET(cpu, &mask);
+  if (pthread_setaffinity_np(pthread_self(), sizeof(mask), &mask) != 0) return false;
+  pinnedNode = node;
+  return true;
+}
+
+// The NUMA node a thread of the pool is pinned to, or -1 if the threads are not pinned
+int TaskPool::workerNode(int worker) const {
+  if (!numaPinning_) return -1;
+  return (long long)worker * numaNodes().size() / numThreads_;
+}
+
+/**
+ * Sets the number of threads of the pool, the calling thread of a job included. The threads of the previous size are
+ * stopped first: no job may be running.
+ * @param n The number of threads; 1 (or less) to run every job on its calling thread
+ */
+void TaskPool::setNumThreads(int n) {
+  n = n > 1 ? n : 1;
+  std::lock_guard<std::mutex> running(workers_->runMutex);
+  if (n == numThreads_) return;
+  stopWorkers();
+  numThreads_ = n;
+  startWorkers();
+}
+
+// Starts the threads missing to the pool; the run mutex has to be held
+void TaskPool::startWorkers() {
+  Workers* workers = workers_;
+  for (int worker = workers->threads.size() + 1; worker < numThreads_; worker++) {
+    workers->threads.push_back(std::thread(&TaskPool::workerLoop, workers, worker, workerNode(worker)));
+  }
+}
+
+// Stops all the threads of the pool; the run mutex has to be held
+void TaskPool::stopWorkers() {
+  {
+    std::lock_guard<std::mutex> lock(workers_->mutex);
+    workers_->stopping = true;
+  }
+  workers_->wakeUp.notify_all();
+  for (auto& thread : workers_->threads) thread.join();
+  workers_->threads.clear();
+  workers_->stopping = false;
+}
+
+/**
+ * Runs a set of independent tasks on the pool, and returns once they are all done. If any of the tasks fail, the
+ * exception of the first task that failed is thrown once all the others are done, as if they had been run one after
+ * the other.
+ * @param stage The name the tasks are accounted under in the report
+ * @param numTasks The number of tasks
+ * @param task The function running the task of the given index
+ * @param maxThreads The most threads the job may take, such as the thread count of the stage; 0 for the whole pool
+ */
+void TaskPool::run(const std::string& stage, int numTasks, const std::function<void(int)>& task, int maxThreads) {
+  if (numTasks <= 0) return;
+  int numThreads = maxThreads > 0 && maxThreads < numThreads_ ? maxThreads : numThreads_;
+  if (numThreads > numTasks) numThreads = numTasks;
+  Workers& workers = *workers_;
+  std::unique_lock<std::mutex> running(workers.runMutex, std::defer_lock);
+  Clock::time_point start = Clock::now();
+  if (numThreads <= 1 || inTask || !running.try_lock()) {
+    std::vector<std::exception_ptr> failures(numTasks);
+    bool wasInTask = inTask;
+    inTask = true;
+    TaskCosts costs;
+    for (int i = 0; i < numTasks; i++) {
+      Clock::time_point taskStart = Clock::now();
+      try { task(i); }
+      catch (...) { failures[i] = std::current_exception(); }
+      costs.add(secondsSince(taskStart));
+    }
+    inTask = wasInTask;
+    if (!wasInTask) record(stage, numTasks, 1, secondsSince(start), NULL, costs);
+    for (auto& failure : failures) if (failure) std::rethrow_exception(failure);
+    return;
+  }
+  if ((int)workers.threads.size() < numThreads_ - 1) startWorkers();
+
+  Job job;
+  job.task = &task;
+  job.numThreads = numThreads;
+  job.ranges.reset(new Range[numThreads]);
+  for (int t = 0; t < numThreads; t++) {
+    job.ranges[t].begin = (long long)numTasks * t / numThreads;
+    job.ranges[t].end = (long long)numTasks * (t + 1) / numThreads;
+  }
+  job.failures.resize(numTasks);
+  job.busyNs = 0;
+  job.steals = 0;
+  job.costs.reset(new TaskCosts[numThreads]);
+  job.nodes.reset(new int[numThreads]);
+  job.memoryAccount = StopWatch::memoryAccount();
+  {
+    std::lock_guard<std::mutex> lock(workers.mutex);
+    workers.job = &job;
+    workers.pending = numThreads - 1;
+    workers.generation++;
+  }
+  workers.wakeUp.notify_all();
+  work(job, 0);
+  {
+    std::unique_lock<std::mutex> lock(workers.mutex);
+    workers.jobDone.wait(lock, [&]() { return workers.pending == 0; });
+    workers.job = NULL;
+  }
+  running.unlock();
+  record(stage, numTasks, numThreads, secondsSince(start), &job, TaskCosts());
+  for (auto& failure : job.failures) if (failure) std::rethrow_exception(failure);
+}
+
+/**
+ * The loop of a thread of the pool, which takes part in the jobs that need it
+ * @param workers The threads of the pool
+ * @param worker The index of the thread within the pool, from 1 (0 is the calling thread of a job)
+ * @param node The NUMA node the thread is pinned to, -1 for none
+ */
+void TaskPool::workerLoop(Workers* workers, int worker, int node) {
+  if (node >= 0) pinToNode(node);
+  unsigned long seen = 0;
+  while (true) {
+    Job* job;
+    {
+      std::unique_lock<std::mutex> lock(workers->mutex);
+      workers->wakeUp.wait(lock, [&]() { return workers->stopping || workers->generation != seen; });
+      if (workers->stopping) return;
+      seen = workers->generation;
+      job = workers->job && worker < workers->job->numThreads ? workers->job : NULL;
+    }
+    if (!job) continue;
+    work(*job, worker);
+    std::lock_guard<std::mutex> lock(workers->mutex);
+    if (--workers->pending == 0) workers->jobDone.notify_all();
+  }
+}
+
+/**
+ * Runs the tasks of a job, first from the share of the thread and then from those of the others
+ * @param job The job
+ * @param thread The index of the thread within the job
+ */
+void TaskPool::work(Job& job, int thread) {
+  Clock::time_point start = Clock::now();
+  StopWatch::MemoryScope memoryScope(StopWatch::MemoryAccount(job.memoryAccount));
+  inTask = true;
+  int index;
+  TaskCosts costs; // kept here until the thread is done, for the threads not to write to the same cache lines
+  while (take(job, thread, index)) {
+    Clock::time_point taskStart = Clock::now();
+    try { (*job.task)(index); }
+    catch (...) { job.failures[index] = std::current_exception(); }
+    costs.add(secondsSince(taskStart));
+  }
+  job.costs[thread] = costs;
+  job.nodes[thread] = currentNode();
+  inTask = false;
+  job.busyNs += std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+}
+
+/**
+ * Takes the next task of a thread: the first one of its range, or else the first one of the upper half of the
+ * largest range of the other threads, the rest of that half becoming the range of the thread
+ * @param job The job
+ * @param thread The index of the thread within the job
+ * @param index Set to the index of the task
+ * @return False if no task is left
+ */
+bool TaskPool::take(Job& job, int thread, int& index) {
+  Range& own = job.ranges[thread];
+  {
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (own.begin < own.end) {
+      index = own.begin++;
+      return true;
+    }
+  }
+  while (true) {
+    int victim = -1, most = 0;
+    for (int t = 0; t < job.numThreads; t++) {
+      if (t == thread) continue;
+      std::lock_guard<std::mutex> lock(job.ranges[t].mutex);
+      int left = job.ranges[t].end - job.ranges[t].begin;
+      if (left > most) {
+        most = left;
+        victim = t;
+      }
+    }
+    if (victim < 0) return false;
+    int first, last;
+    {
+      Range& range = job.ranges[victim];
+      std::lock_guard<std::mutex> lock(range.mutex);
+      int left = range.end - range.begin;
+      if (left <= 0) continue; // emptied meanwhile: look again
+      last = range.end;
+      first = range.end - (left + 1) / 2;
+      range.end = first;
+    }
+    job.steals++;
+    std::lock_guard<std::mutex> lock(own.mutex);
+    own.begin = first + 1;
+    own.end = last;
+    index = first;
+    return true;
+  }
+}
+
+void TaskPool::TaskCosts::add(double seconds) {
+  count++;
+  sum += seconds;
+  squares += seconds * seconds;
+  if (seconds > max) max = seconds;
+}
+
+void TaskPool::TaskCosts::add(const TaskCosts& other) {
+  count += other.count;
+  sum += other.sum;
+  squares += other.squares;
+  if (other.max > max) max = other.max;
+}
+
+void TaskPool::record(const std::string& stage, int numTasks, int numThreads, double wallSeconds, const Job* job, const TaskCosts& serialCosts) {
+  std::lock_guard<std::mutex> lock(statsMutex_);
+  StageStats& stats = stats_[stage];
+  stats.calls++;
+  stats.tasks += numTasks;
+  stats.wallSeconds += wallSeconds;
+  stats.threadSeconds += wallSeconds * numThreads;
+  if (wallSeconds > stats.maxJobSeconds) stats.maxJobSeconds = wallSeconds;
+  if (job) {
+    stats.steals += job->steals;
+    stats.busySeconds += job->busyNs * 1e-9;
+    for (int t = 0; t < job->numThreads; t++) {
+      stats.taskCosts.add(job->costs[t]);
+      if (!numaPinning_) continue;
+      if ((int)stats.nodeCosts.size() <= job->nodes[t]) stats.nodeCosts.resize(job->nodes[t] + 1);
+      stats.nodeCosts[job->nodes[t]].add(job->costs[t]);
+    }
+  } else {
+    stats.busySeconds += wallSeconds;
+    stats.taskCosts.add(serialCosts);
+  }
+}
+
+/**
+ * Lists the stages in alphabetical order, one per line, with their number of jobs, tasks and steals, their wall clock
+ * time and the utilisation of the threads that took part, then the cost of their tasks (mean, coefficient of variation
+ * and maximum) and their longest job. A stage whose jobs are chunks of its work has a low utilisation when its chunks
+ * hold too few tasks for their spread of cost, the threads waiting for the last tasks of each chunk. When the threads
+ * are pinned to the NUMA nodes, each stage is followed by the tasks run on each node, their time and their throughput
+ * over the wall clock time of the stage.
+ * @return The text of the report
+ */
+std::string TaskPool::report() const {
+  std::lock_guard<std::mutex> lock(statsMutex_);
+  std::ostringstream out;
+  out << "Task pool of " << numThreads_ << " thread" << (numThreads_ > 1 ? "s" : "") << " (" << availableCpus() << " CPUs available";
+  if (numaPinning_) out << ", pinned to " << numaNodes().size() << " NUMA node" << (numaNodes().size() > 1 ? "s" : "");
+  out << ")" << std::endl;
+  out << std::left << std::setw(40) << "stage" << std::right << std::setw(10) << "jobs" << std::setw(12) << "tasks"
+      << std::setw(10) << "steals" << std::setw(12) << "wall [s]" << std::setw(14) << "utilisation"
+      << std::setw(14) << "task [ms]" << std::setw(10) << "task cv" << std::setw(14) << "max task [ms]" << std::setw(14) << "max job [s]" << std::endl;
+  for (const auto& stage : stats_) {
+    const StageStats& stats = stage.second;
+    out << std::left << std::setw(40) << stage.first << std::right << std::setw(10) << stats.calls << std::setw(12) << stats.tasks
+        << std::setw(10) << stats.steals << std::setw(12) << std::fixed << std::setprecision(3) << stats.wallSeconds
+        << std::setw(13) << std::setprecision(1) << (stats.threadSeconds > 0 ? 100 * stats.busySeconds / stats.threadSeconds : 0.) << "%";
+    const TaskCosts& costs = stats.taskCosts;
+    double mean = costs.count ? costs.sum / costs.count : 0.;
+    double variance = costs.count ? std::max(0., costs.squares / costs.count - mean * mean) : 0.;
+    out << std::setw(14) << std::setprecision(4) << 1e3 * mean << std::setw(10) << std::setprecision(2) << (mean > 0 ? std::sqrt(variance) / mean : 0.)
+        << std::setw(14) << std::setprecision(3) << 1e3 * costs.max << std::setw(14) << stats.maxJobSeconds << std::endl;
+    for (unsigned int node = 0; node < stats.nodeCosts.size(); node++) {
+      const TaskCosts& nodeCosts = stats.nodeCosts[node];
+      out << std::left << std::setw(40) << ("  node " + std::to_string(node)) << std::right << std::setw(10) << "" << std::setw(12) << nodeCosts.count
+          << std::setw(10) << "" << std::setw(12) << std::setprecision(3) << nodeCosts.sum
+          << std::setw(14) << std::setprecision(1) << (stats.wallSeconds > 0 ? nodeCosts.count / stats.wallSeconds : 0.) << " tasks/s" << std::endl;
+    }
+  }
+  return out.str();
+}
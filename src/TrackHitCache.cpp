@@ -0,0 +1,202 @@
+/**
+ * @file TrackHitCache.cpp
+ * @brief This is the implementation of the cache of the hits of the resolution tracks
+ */
+
+#include <TrackHitCache.h>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <global_funcs.h>
+#include <messageLogger.h>
+
+namespace insur {
+
+  const char TrackHitCache::magic[8] = { 't', 'k', 'h', 'i', 't', 's', '0', '1' };
+
+  /**
+   * Adds the hits of a track to the cache
+   * @param track The track, with all its hits
+   * @param modules The module tables of the trackers the hit modules belong to
+   */
+  void TrackHitCache::addTrack(Track& track, const ModuleTables& modules) {
+    TrackRecord trackRecord = { track.getTheta(), track.getPhi(), hitRecords_.size(), (uint64_t)track.nHits() };
+    trackRecords_.push_back(trackRecord);
+    for (int i = 0; i < track.nHits(); i++) {
+      Hit& hit = *track.getHit(i);
+      RILength material = hit.getCorrectedMaterial();
+      HitRecord record;
+      memset(&record, 0, sizeof(record)); // for the padding to be written as zeroes
+      record.distance = hit.getDistance();
+      record.radiation = material.radiation;
+      record.interaction = material.interaction;
+      record.module = -1;
+      Module* module = hit.getHitModule();
+      if (module) {
+        for (size_t t = 0; t < modules.size(); t++) {
+          int index = module->moduleIndex();
+          if (index >= 0 && index < (int)modules[t]->size() && (*modules[t])[index] == module) {
+            record.module = index;
+            record.tracker = t;
+            break;
+          }
+        }
+      } else if (hit.getObjectKind() == Hit::Active) {
+        record.resolutionRphi = hit.measuredResolutionRphi(0);
+        record.resolutionY = hit.measuredResolutionZ(0);
+      }
+      record.orientation = hit.getOrientation();
+      record.objectKind = hit.getObjectKind();
+      record.activeHitType = hit.getActiveHitType();
+      record.flags = (hit.isPixel() ? PixelHit : 0) | (hit.isTrigger() ? TriggerHit : 0) | (hit.isIP() ? IPHit : 0);
+      hitRecords_.push_back(record);
+    }
+  }
+
+  /**
+   * Writes the hits added to the cache to its file. The file is replaced at once, so that a run reading it never sees
+   * it half written.
+   * @param fileName The cache file
+   * @param key What identifies the tracks of the cache
+   * @return True if the cache could be written
+   */
+  bool TrackHitCache::write(const std::string& fileName, const std::string& key) const {
+    Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, magic, sizeof(magic));
+    header.keyLength = key.size();
+    header.hitRecordSize = sizeof(HitRecord);
+    header.numTracks = trackRecords_.size();
+    header.numHits = hitRecords_.size();
+    std::string paddedKey = key;
+    paddedKey.resize(keySpace(key.size()), '\0');
+
+    std::string partFileName = fileName + ".part";
+    std::ofstream out(partFileName.c_str(), std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(paddedKey.data(), paddedKey.size());
+    out.write(reinterpret_cast<const char*>(trackRecords_.data()), trackRecords_.size() * sizeof(TrackRecord));
+    out.write(reinterpret_cast<const char*>(hitRecords_.data()), hitRecords_.size() * sizeof(HitRecord));
+    out.close();
+    bool written = out && std::rename(partFileName.c_str(), fileName.c_str()) == 0;
+    if (!written) {
+      std::remove(partFileName.c_str());
+      logWARNING("Could not write the track cache " + fileName);
+    } else {
+      logINFO("Track cache: " + any2str(header.numTracks) + " tracks and " + any2str(header.numHits) + " hits written to " + fileName);
+    }
+    return written;
+  }
+
+  /**
+   * Maps a cache file into memory, checking that it holds the tracks of the key and that its hit modules are in the
+   * module tables
+   * @param fileName The cache file
+   * @param key What identifies the tracks the cache must hold
+   * @param modules The module tables of the trackers of the run
+   * @param quiet Whether a cache that is missing or does not match goes without a message
+   * @return True if the cache can be read
+   */
+  bool TrackHitCache::open(const std::string& fileName, const std::string& key, const ModuleTables& modules, bool quiet) {
+    close();
+    int fd = ::open(fileName.c_str(), O_RDONLY);
+    if (fd < 0) {
+      if (!quiet) logINFO("There is no track cache " + fileName + " to take the hits of the resolution tracks from");
+      return false;
+    }
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) == 0 && fileStat.st_size >= (off_t)sizeof(Header)) {
+      mappedSize_ = fileStat.st_size;
+      mapped_ = mmap(NULL, mappedSize_, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (mapped_ == MAP_FAILED) mapped_ = NULL;
+    }
+    ::close(fd); // the mapping stays valid
+
+    std::string problem;
+    if (!mapped_) problem = "cannot be mapped into memory";
+    else {
+      const Header& header = *static_cast<const Header*>(mapped_);
+      const char* keyBegin = static_cast<const char*>(mapped_) + sizeof(Header);
+      size_t recordsOffset = sizeof(Header) + keySpace(header.keyLength);
+      if (memcmp(header.magic, magic, sizeof(magic)) || header.hitRecordSize != sizeof(HitRecord) ||
+          recordsOffset > mappedSize_ ||
+          header.numTracks > (mappedSize_ - recordsOffset) / sizeof(TrackRecord) ||
+          header.numHits != (mappedSize_ - recordsOffset - header.numTracks * sizeof(TrackRecord)) / sizeof(HitRecord) ||
+          mappedSize_ != recordsOffset + header.numTracks * sizeof(TrackRecord) + header.numHits * sizeof(HitRecord)) {
+        problem = "is corrupted";
+      } else if (std::string(keyBegin, header.keyLength) != key) {
+        problem = "is not for these tracks";
+      } else {
+        numTracks_ = header.numTracks;
+        numHits_ = header.numHits;
+        tracks_ = reinterpret_cast<const TrackRecord*>(static_cast<const char*>(mapped_) + recordsOffset);
+        hits_ = reinterpret_cast<const HitRecord*>(tracks_ + numTracks_);
+        for (long i = 0; i < numTracks_ && problem.empty(); i++) {
+          if (tracks_[i].firstHit > (uint64_t)numHits_ || tracks_[i].numHits > numHits_ - tracks_[i].firstHit) problem = "is corrupted";
+        }
+        for (long i = 0; i < numHits_ && problem.empty(); i++) {
+          const HitRecord& hit = hits_[i];
+          if (hit.module >= 0 && (hit.tracker < 0 || hit.tracker >= (int)modules.size() || hit.module >= (int)modules[hit.tracker]->size())) {
+            problem = "is not for these trackers";
+          }
+        }
+      }
+    }
+    if (!problem.empty()) {
+      if (!quiet) logWARNING("The track cache " + fileName + " " + problem + ": the hits of the resolution tracks are looked for again");
+      close();
+      return false;
+    }
+    return true;
+  }
+
+  /**
+   * Unmaps the cache file, if any
+   */
+  void TrackHitCache::close() {
+    if (mapped_) munmap(mapped_, mappedSize_);
+    mapped_ = NULL;
+    mappedSize_ = 0;
+    tracks_ = NULL;
+    hits_ = NULL;
+    numTracks_ = numHits_ = 0;
+  }
+
+  /**
+   * Builds a track of the opened cache back
+   * @param index The index of the track, from 0 to <i>numTracks()</i> excluded
+   * @param modules The module tables the cache was opened with
+   * @param track Set to the track, with its hits
+   */
+  void TrackHitCache::readTrack(long index, const ModuleTables& modules, Track& track) const {
+    const TrackRecord& record = tracks_[index];
+    track = Track();
+    double theta = record.theta, phi = record.phi;
+    track.setTheta(theta);
+    track.setPhi(phi);
+    for (const HitRecord* hitRecord = hits_ + record.firstHit; hitRecord != hits_ + record.firstHit + record.numHits; ++hitRecord) {
+      Hit hit(hitRecord->distance);
+      if (hitRecord->module >= 0) {
+        hit.setHitModule((*modules[hitRecord->tracker])[hitRecord->module]);
+      } else {
+        hit.setResolutionRphi(hitRecord->resolutionRphi);
+        hit.setResolutionY(hitRecord->resolutionY);
+      }
+      hit.setOrientation(hitRecord->orientation);
+      hit.setObjectKind(hitRecord->objectKind);
+      hit.setActiveHitType(HitType(hitRecord->activeHitType));
+      RILength material;
+      material.radiation = hitRecord->radiation;
+      material.interaction = hitRecord->interaction;
+      hit.setCorrectedMaterial(material);
+      hit.setPixel(hitRecord->flags & PixelHit);
+      hit.setTrigger(hitRecord->flags & TriggerHit);
+      hit.setIP(hitRecord->flags & IPHit);
+      track.addHit(hit);
+    }
+  }
+}
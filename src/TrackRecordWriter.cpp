@@ -0,0 +1,149 @@
+/**
+ * @file TrackRecordWriter.cpp
+ * @brief This is the implementation of the writer of the per-track records of the material and resolution scans
+ */
+
+#include <TrackRecordWriter.h>
+#include <chrono>
+#include <TFile.h>
+#include <TTree.h>
+#include <messageLogger.h>
+
+namespace insur {
+
+  TrackRecordWriter::TrackRecordWriter(size_t capacity) :
+    tree_(NULL), capacity_(capacity), batches_(new Batch[capacity]), pushed_(0), written_(0), finished_(false) {}
+
+  TrackRecordWriter::~TrackRecordWriter() {
+    close();
+  }
+
+  /**
+   * Creates the file of the records and starts the thread writing them
+   * @param fileName The name of the file, which is recreated
+   * @param compression The ROOT compression setting of the file, as 100 * algorithm + level
+   * @return False if the file could not be created
+   */
+  bool TrackRecordWriter::open(const std::string& fileName, int compression) {
+    close();
+    TDirectory* currentDirectory = gDirectory;
+    file_.reset(new TFile(fileName.c_str(), "RECREATE", "Track records", compression));
+    if (currentDirectory) currentDirectory->cd();
+    if (file_->IsZombie()) {
+      logERROR("Could not create the track records file " + fileName);
+      file_.reset();
+      return false;
+    }
+    pushed_ = written_ = 0;
+    finished_ = false;
+    thread_ = std::thread(&TrackRecordWriter::writeLoop, this);
+    return true;
+  }
+
+  /**
+   * Starts the tree of a scan, which the records pushed afterwards go to, once the records of the previous scan are
+   * written. A tree of the same name already there is emptied, for a scan run again to replace its records.
+   * @param scan The name of the scan, which names its tree
+   * @param resolutions Whether the tree has the tag and the errors of the records
+   */
+  void TrackRecordWriter::begin(const std::string& scan, bool resolutions) {
+    if (!isOpen()) return;
+    drain();
+    TTree*& tree = trees_[scan];
+    if (tree) {
+      tree->Reset();
+    } else {
+      TDirectory* currentDirectory = gDirectory;
+      file_->cd();
+      tree = new TTree(scan.c_str(), ("Tracks of the " + scan + " scan").c_str());
+      if (currentDirectory) currentDirectory->cd();
+      tree->Branch("eta", &treeRecord_.eta);
+      tree->Branch("phi", &treeRecord_.phi);
+      tree->Branch("z0", &treeRecord_.z0);
+      tree->Branch("radiation", &treeRecord_.radiation);
+      tree->Branch("interaction", &treeRecord_.interaction);
+      tree->Branch("hits", &treeRecord_.hits);
+      if (resolutions) {
+        tree->Branch("tag", &treeRecord_.tag);
+        tree->Branch("pt", &treeRecord_.pt);
+        tree->Branch("deltaRho", &treeRecord_.deltaRho);
+        tree->Branch("deltaPhi", &treeRecord_.deltaPhi);
+        tree->Branch("deltaD", &treeRecord_.deltaD);
+        tree->Branch("deltaCtgTheta", &treeRecord_.deltaCtgTheta);
+        tree->Branch("deltaZ0", &treeRecord_.deltaZ0);
+        tree->Branch("deltaP", &treeRecord_.deltaP);
+      }
+    }
+    tree_ = tree; // published to the thread with the next batch
+  }
+
+  void TrackRecordWriter::push(Batch& batch) {
+    if (!isOpen() || !tree_) {
+      batch.clear();
+      return;
+    }
+    size_t pushed = pushed_.load(std::memory_order_relaxed);
+    while (pushed - written_.load(std::memory_order_acquire) == capacity_) std::this_thread::sleep_for(std::chrono::microseconds(50)); // the disk is behind
+    batches_[pushed % capacity_].swap(batch); // the batch gets back the emptied records of a batch already written
+    batch.clear();
+    pushed_.store(pushed + 1, std::memory_order_release);
+  }
+
+  // Waits for all the batches pushed to be written
+  void TrackRecordWriter::drain() const {
+    while (written_.load(std::memory_order_acquire) != pushed_.load(std::memory_order_relaxed)) std::this_thread::sleep_for(std::chrono::microseconds(50));
+  }
+
+  void TrackRecordWriter::writeLoop() {
+    size_t written = 0;
+    for (;;) {
+      if (written == pushed_.load(std::memory_order_acquire)) {
+        if (finished_.load(std::memory_order_acquire) && written == pushed_.load(std::memory_order_acquire)) return;
+        std::this_thread::sleep_for(std::chrono::microseconds(50)); // the scan is behind
+        continue;
+      }
+      Batch& batch = batches_[written % capacity_];
+      for (Record& record : batch) {
+        treeRecord_.eta = record.eta;
+        treeRecord_.phi = record.phi;
+        treeRecord_.z0 = record.z0;
+        treeRecord_.radiation = record.radiation;
+        treeRecord_.interaction = record.interaction;
+        treeRecord_.hits = record.hits;
+        treeRecord_.tag.swap(record.tag);
+        treeRecord_.pt.swap(record.pt);
+        treeRecord_.deltaRho.swap(record.deltaRho);
+        treeRecord_.deltaPhi.swap(record.deltaPhi);
+        treeRecord_.deltaD.swap(record.deltaD);
+        treeRecord_.deltaCtgTheta.swap(record.deltaCtgTheta);
+        treeRecord_.deltaZ0.swap(record.deltaZ0);
+        treeRecord_.deltaP.swap(record.deltaP);
+        tree_->Fill();
+      }
+      batch.clear();
+      written_.store(++written, std::memory_order_release);
+    }
+  }
+
+  /**
+   * Writes the records still queued and the trees, and closes the file
+   * @return True if the file was written, or if there was none
+   */
+  bool TrackRecordWriter::close() {
+    if (!isOpen()) return true;
+    finished_.store(true, std::memory_order_release);
+    thread_.join();
+    TDirectory* currentDirectory = gDirectory;
+    file_->cd();
+    for (auto& tree : trees_) tree.second->Write("", TObject::kOverwrite);
+    bool written = file_->IsOpen() && !file_->TestBit(TFile::kWriteError);
+    std::string fileName = file_->GetName();
+    file_->Close();
+    file_.reset();
+    if (currentDirectory) currentDirectory->cd();
+    trees_.clear();
+    tree_ = NULL;
+    if (!written) logERROR("Could not write the track records file " + fileName);
+    return written;
+  }
+}
@@ -1,33 +1,78 @@
 #include <TrackShooter.h>
+#include <GeometryImage.h>
+#include <ProgressMeter.h>
+#include <TNamed.h>
 
+#include <chrono>
 
-std::set<int> getModuleOctants(const Module* mod) {
-  std::set<int> octants;
-  octants.insert(getPointOctant(mod->getCorner(0).X(), mod->getCorner(0).Y(), mod->getCorner(0).Z())); 
-  octants.insert(getPointOctant(mod->getCorner(1).X(), mod->getCorner(1).Y(), mod->getCorner(1).Z())); 
-  octants.insert(getPointOctant(mod->getCorner(2).X(), mod->getCorner(2).Y(), mod->getCorner(2).Z())); 
-  octants.insert(getPointOctant(mod->getCorner(3).X(), mod->getCorner(3).Y(), mod->getCorner(3).Z())); 
-  return octants;
-}
 
+const double TrackShooter::SECTOR_PHI_MARGIN = 0.01;
 
+/**
+ * The phi sector a point of the transverse plane falls in
+ */
+int TrackShooter::getPointPhiSector(double x, double y) const {
+  int sector = int(floor((atan2(y, x) + M_PI) / (2*M_PI) * numPhiSectors_));
+  return MAX(0, MIN(numPhiSectors_ - 1, sector));
+}
 
+/**
+ * The phi sectors spanned by the corners of a module, widened by a safety margin. The corners are taken relative
+ * to the phi of the module centre, so that modules straddling phi = +/-PI get a contiguous span.
+ */
+std::set<int> TrackShooter::getModulePhiSectors(const Module* mod) const {
+  double refPhi = mod->getMeanPoint().Phi();
+  double dPhiMin = 0., dPhiMax = 0.;
+  for (int i = 0; i < 4; i++) {
+    double dphi = mod->getCorner(i).Phi() - refPhi;
+    while (dphi > M_PI) dphi -= 2*M_PI;
+    while (dphi <= -M_PI) dphi += 2*M_PI;
+    dPhiMin = MIN(dPhiMin, dphi);
+    dPhiMax = MAX(dPhiMax, dphi);
+  }
+  int first = int(floor((refPhi + dPhiMin - SECTOR_PHI_MARGIN + M_PI) / (2*M_PI) * numPhiSectors_));
+  int last = int(floor((refPhi + dPhiMax + SECTOR_PHI_MARGIN + M_PI) / (2*M_PI) * numPhiSectors_));
+  if (last - first >= numPhiSectors_) last = first + numPhiSectors_ - 1;
+  std::set<int> sectors;
+  for (int i = first; i <= last; i++) sectors.insert(((i % numPhiSectors_) + numPhiSectors_) % numPhiSectors_);
+  return sectors;
+}
 
 
 
-ParticleGenerator::ParticleGenerator(TRandom& aDie) : die(aDie) {
-  // if parameter tree is not specified (or zero), connect the file
-  // used to generate this class and read the Tree.
+ParticleGenerator::ParticleGenerator(TRandom& aDie, const std::string& fileName) : die(aDie), fChain(0), numEntries(0) {
+  // connect the file used to generate this class, if it is not open already, and read the Tree.
     //TFile *f = (TFile*)gROOT->GetListOfFiles()->FindObject("BunchX_PhaseIISLHC_rootuple.root");
-  TFile *f = (TFile*)gROOT->GetListOfFiles()->FindObject("MinBias12k_ppAt14TeV_rootuple.root");
+  TFile *f = (TFile*)gROOT->GetListOfFiles()->FindObject(fileName.c_str());
   if (!f) {
     //f = new TFile("BunchX_PhaseIISLHC_rootuple.root");
-    f = new TFile("MinBias12k_ppAt14TeV_rootuple.root");
+    f = new TFile(fileName.c_str());
+  }
+  if (f->IsZombie()) {
+    std::cerr << "Failed opening particle file \"" << fileName << "\"." << std::endl;
+    return;
   }
-  TTree* tree = (TTree*)gDirectory->Get("particles");
+  TTree* tree = (TTree*)f->Get("particles");
 
   //myPtz=NULL;
   Init(tree);
+  cacheParticles();
+}
+
+/**
+ * Decode the whole particle tree once into particles_, so that the sampling does not read from the file any more
+ */
+void ParticleGenerator::cacheParticles() {
+  particles_.clear();
+  entryOffsets_.assign(1, 0);
+  if (!fChain) return;
+  for (Long64_t entry = 0; entry < getNumEntries(); entry++) {
+    fChain->GetEntry(entry);
+    for (Int_t i = 0; i < NumPart; i++) {
+      particles_.push_back((CachedParticle){ Pt[i], Eta[i], Phi[i], charge[i], pdgId[i], status[i] });
+    }
+    entryOffsets_.push_back(particles_.size());
+  }
 }
 
 
@@ -100,16 +145,22 @@ Bool_t ParticleGenerator::Notify()
 
 
 ParticleGenerator::Particle ParticleGenerator::getParticle() {
-    if (fChain == 0 || getNumEntries() == 0) return (Particle){ 0, 0, 0, 0 };
+    return getParticle(die);
+}
+
+ParticleGenerator::Particle ParticleGenerator::getParticle(TRandom& aDie) const {
+    if (particles_.empty()) return (Particle){ 0, 0, 0, 0 };
     Long64_t entryIndex;
-    Int_t partIndex; 
+    Int_t numPart;
+    const CachedParticle* particle;
     do {
-      entryIndex = die.Integer(getNumEntries()); // event entry index
-      fChain->GetEntry(entryIndex); // retrieves the entry, appropriately setting the class variables
-      partIndex = die.Integer(NumPart); // particle index inside the event entry
-    } while(charge[partIndex] == 0.);
+      entryIndex = aDie.Integer(getNumEntries()); // event entry index
+      numPart = entryOffsets_[entryIndex + 1] - entryOffsets_[entryIndex];
+      if (numPart == 0) { particle = 0; continue; } // nothing to pick in this entry
+      particle = &particles_[entryOffsets_[entryIndex] + aDie.Integer(numPart)]; // particle index inside the event entry
+    } while(!particle || particle->charge == 0.);
 
-    return (Particle){ Pt[partIndex]/charge[partIndex], Eta[partIndex], Phi[partIndex], die.Uniform(-Z0_SMEAR_MM, Z0_SMEAR_MM) };
+    return (Particle){ particle->pt/particle->charge, particle->eta, particle->phi, aDie.Uniform(-Z0_SMEAR_MM, Z0_SMEAR_MM) };
 }
 
 Long64_t ParticleGenerator::getNumEntries() const { return numEntries; }
@@ -117,6 +168,45 @@ Long64_t ParticleGenerator::getNumEntries() const { return numEntries; }
 
 
 
+TrackEntryWriter::TrackEntryWriter(TTree& tree, Tracks& treeTracks, Hits& treeHits, size_t capacity) :
+  tree_(tree), treeTracks_(treeTracks), treeHits_(treeHits), capacity_(capacity), entries_(new Entry[capacity]),
+  pushed_(0), written_(0), finished_(false), thread_(&TrackEntryWriter::writeLoop, this) {}
+
+void TrackEntryWriter::push(Tracks& tracks, Hits& hits) {
+  size_t pushed = pushed_.load(std::memory_order_relaxed);
+  while (pushed - written_.load(std::memory_order_acquire) == capacity_) std::this_thread::sleep_for(std::chrono::microseconds(50)); // the disk is behind
+  Entry& entry = entries_[pushed % capacity_];
+  entry.tracks.swap(tracks); // the holders get back the emptied vectors of an entry already written
+  entry.hits.swap(hits);
+  tracks.clear();
+  hits.clear();
+  pushed_.store(pushed + 1, std::memory_order_release);
+}
+
+void TrackEntryWriter::writeLoop() {
+  size_t written = 0;
+  for (;;) {
+    if (written == pushed_.load(std::memory_order_acquire)) {
+      if (finished_.load(std::memory_order_acquire) && written == pushed_.load(std::memory_order_acquire)) return;
+      std::this_thread::sleep_for(std::chrono::microseconds(50)); // the simulation is behind
+      continue;
+    }
+    Entry& entry = entries_[written % capacity_];
+    treeTracks_.swap(entry.tracks);
+    treeHits_.swap(entry.hits);
+    tree_.Fill();
+    treeTracks_.clear();
+    treeHits_.clear();
+    written_.store(++written, std::memory_order_release);
+  }
+}
+
+void TrackEntryWriter::finish() {
+  if (!thread_.joinable()) return;
+  finished_.store(true, std::memory_order_release);
+  thread_.join();
+}
+
 void TrackShooter::setOutput(ostream& output, const char* fieldSeparator, const char* lineSeparator, bool) {
   output_ = &output;
   FS = fieldSeparator;
@@ -130,26 +220,32 @@ void TrackShooter::setTrackerBoundaries(double trackerMaxRho, double barrelMinZ,
 }  
 
 void TrackShooter::addModule(Module* module) { // also locks modules geometry so that only cached values for geometry properties are returned from now on
-  BarrelModule* bmod; EndcapModule* emod;
   module->lockGeometry();
   allMods_.push_back(module);
-  
-  const std::set<int>& octants = getModuleOctants(module);
+}
 
-  if ((bmod=dynamic_cast<BarrelModule*>(module))) {
-    BarrelOctants& barrelOctants = barrelModsByRadius_[module->getMeanPoint().Rho()-module->getStereoDistance()/2]; // the radius is the radius of the center point of the lower module
-    barrelOctants.resize(8); // prepare the octants vector. it's going to be called for each module, but after the first time the call will do nothing
-    for (std::set<int>::const_iterator oit = octants.begin(); oit != octants.end(); ++oit) {
-      barrelOctants[*oit].push_back(bmod);
-    }
-  } else if ((emod=dynamic_cast<EndcapModule*>(module))) { 
-    EndcapOctants& endcapOctants = endcapModsByZ_[module->getMeanPoint().Z()-(module->getZSide()*module->getStereoDistance()/2)]; // getZSide() changes the sign of the addition because if mod is in Z+ then the first sensor to be hit is the one at lower Z, viceversa for Z-
-    endcapOctants.resize(8);
-    for (std::set<int>::const_iterator oit = octants.begin(); oit != octants.end(); ++oit) {
-      endcapOctants[*oit].push_back(emod);
+void TrackShooter::bucketModules() { // the modules are put in their phi sectors once the number of sectors is known, right before shooting
+  barrelModsByRadius_.clear();
+  endcapModsByZ_.clear();
+  for (std::vector<Module*>::const_iterator mit = allMods_.begin(); mit != allMods_.end(); ++mit) {
+    Module* module = *mit;
+    BarrelModule* bmod; EndcapModule* emod;
+    const std::set<int>& sectors = getModulePhiSectors(module);
+
+    if ((bmod=dynamic_cast<BarrelModule*>(module))) {
+      BarrelSectors& barrelSectors = barrelModsByRadius_[module->getMeanPoint().Rho()-module->getStereoDistance()/2]; // the radius is the radius of the center point of the lower module
+      barrelSectors.resize(numPhiSectors_); // prepare the sectors vector. it's going to be called for each module, but after the first time the call will do nothing
+      for (std::set<int>::const_iterator sit = sectors.begin(); sit != sectors.end(); ++sit) {
+        barrelSectors[*sit].push_back(bmod);
+      }
+    } else if ((emod=dynamic_cast<EndcapModule*>(module))) { 
+      EndcapSectors& endcapSectors = endcapModsByZ_[module->getMeanPoint().Z()-(module->getZSide()*module->getStereoDistance()/2)]; // getZSide() changes the sign of the addition because if mod is in Z+ then the first sensor to be hit is the one at lower Z, viceversa for Z-
+      endcapSectors.resize(numPhiSectors_);
+      for (std::set<int>::const_iterator sit = sectors.begin(); sit != sectors.end(); ++sit) {
+        endcapSectors[*sit].push_back(emod);
+      }
     }
   }
-
 }
 
 XYVector TrackShooter::convertToLocalCoords(const XYZVector& globalHit, const BarrelModule* mod) const {
@@ -352,6 +448,9 @@ void TrackShooter::setDefaultParameters() {
 
   instanceId_ = any2str(getpid()) + "_" + any2str(time(NULL)); 
   tracksDir_ = ".";
+  compressionLevel_ = 1;
+  basketSize_ = 0;
+  numPhiSectors_ = 64;
 
   useInvPt_ = false;
 }
@@ -389,6 +488,9 @@ void TrackShooter::shootTracks(const po::variables_map& varmap, int seed) {
       if ((pos = instanceId_.find(timetag)) != std::string::npos) instanceId_.replace(pos, timetag.size(), any2str(time(NULL)));
       if ((pos = instanceId_.find(pidtag)) != std::string::npos) instanceId_.replace(pos, pidtag.size(), any2str(getpid()));
     } else if (key == "tracks-dir") tracksDir_ = it->second.as<std::string>();
+    else if (key == "tracks-compression") compressionLevel_ = str2any<int>(it->second.as<std::string>());
+    else if (key == "tracks-basket-size") basketSize_ = str2any<int>(it->second.as<std::string>());
+    else if (key == "phi-sectors") numPhiSectors_ = MAX(1, str2any<int>(it->second.as<std::string>()));
   
   }
 
@@ -411,13 +513,23 @@ void TrackShooter::printParameters() {
   std::cout << "charge = " << charge_->toString() << std::endl;
   std::cout << "instance-id = " << instanceId_ << std::endl;
   std::cout << "tracks-dir = " << tracksDir_ << std::endl;
+  std::cout << "phi-sectors = " << numPhiSectors_ << std::endl;
+  std::cout << "tracks-compression = " << compressionLevel_ << std::endl;
+  std::cout << "tracks-basket-size = " << (basketSize_ > 0 ? any2str(basketSize_) : "default") << std::endl;
   std::cout << "rand-seed = " << die_.GetSeed() << std::endl;
 }
 
 
+/**
+ * Writes the module table into the geometry tree of the current file, and as the geometry image of the tracks
+ * directory (see GeometryImage), whose hash is named in the file for the Hough jobs to map the image instead of
+ * reading the tree
+ */
 void TrackShooter::exportGeometryData() {
 
   ModuleData mdata;
+  std::vector<ModuleData> modules;
+  modules.reserve(allMods_.size());
 
   TTree* tree = new TTree("geomdata", "Geometry data");
   tree->Branch("mdata", &mdata, "x/D:y:z:rho:phi:widthlo:widthhi:height:stereo:pitchlo:pitchhi:striplen:yres:inefftype/B:refcnt:refz:refrho:refphi:type"); 
@@ -438,20 +550,83 @@ void TrackShooter::exportGeometryData() {
                           mod->getSubdetectorType() };
 
     tree->Fill();
+    modules.push_back(mdata);
+  }
+
+  uint64_t hash;
+  if (GeometryImage::write(GeometryImage::fileName(tracksDir_), modules, hash)) {
+    TNamed("geomimage", any2str(hash).c_str()).Write();
+  }
+}
+
+#ifdef FAKE_HITS
+void TrackShooter::buildFakeHitSources() {
+  fakeSources_.clear();
+  fakeRates_.clear();
+  double rate = 0.;
+  for (std::vector<Module*>::const_iterator mit = allMods_.begin(); mit != allMods_.end(); ++mit) {
+    Module* mod = (*mit);
+    FakeHitSource source;
+    source.meanPoint = mod->getMeanPoint();
+    source.poly << mod->getCorner(0)-source.meanPoint << mod->getCorner(1)-source.meanPoint << mod->getCorner(2)-source.meanPoint << mod->getCorner(3)-source.meanPoint;
+    source.cosPhi = cos(-source.meanPoint.Phi());
+    source.sinPhi = sin(-source.meanPoint.Phi());
+    source.barrel = dynamic_cast<BarrelModule*>(mod) != NULL;
+    source.halfWindow = mod->getTriggerWindow()/2;
+    source.ptErr = mod->getPtError();
+    source.posref = mod->getPositionalReference();
+    fakeSources_.push_back(source);
+    rate += mod->getTriggerFrequencyFakePerEvent();
+    fakeRates_.push_back(rate);
+  }
+  fakeCounts_.assign(fakeSources_.size(), 0);
+}
+
+void TrackShooter::shootFakeHits(long int event, Tracks& tracks, Hits& hits) {
+  // the fake hits of all the modules are independent Poisson draws: their total is drawn at once, then each hit goes to a module with a probability proportional to its rate
+  if (fakeRates_.empty()) return;
+  int numFake = die_.Poisson(fakeRates_.back());
+  std::fill(fakeCounts_.begin(), fakeCounts_.end(), 0);
+  for (int k = 0; k < numFake; k++) {
+    size_t m = std::upper_bound(fakeRates_.begin(), fakeRates_.end(), die_.Uniform(fakeRates_.back())) - fakeRates_.begin();
+    fakeCounts_[std::min(m, fakeCounts_.size() - 1)]++;
+  }
+
+  // the hits are written module by module, all in the entry of the event noise, after its tracks
+  hits.glox.reserve(numFake); hits.gloy.reserve(numFake); hits.gloz.reserve(numFake);
+  hits.locx.reserve(numFake); hits.locy.reserve(numFake);
+  hits.pterr.reserve(numFake); hits.hitprob.reserve(numFake); hits.deltas.reserve(numFake);
+  hits.cnt.reserve(numFake); hits.z.reserve(numFake); hits.rho.reserve(numFake); hits.phi.reserve(numFake);
+  for (size_t m = 0; m < fakeSources_.size(); m++) {
+    const FakeHitSource& source = fakeSources_[m];
+    for (int k = 0; k < fakeCounts_[m]; k++) {
+      XYZVector fakehit = source.poly.generateRandomPoint(&die_);
+      double locx = fakehit.X()*source.sinPhi + fakehit.Y()*source.cosPhi; // the Y of the hit rotated to phi = 0
+      double locy = source.barrel ? fakehit.Z() : fakehit.X()*source.cosPhi - fakehit.Y()*source.sinPhi;
+      float deltaStrips = 1 + die_.Integer(source.halfWindow);
+      float fakept = source.ptErr->stripsToP(deltaStrips);
+      float pterr = source.ptErr->computeError(fakept);
+      XYZVector glov = source.meanPoint + fakehit;
+      hits.push_back(glov.X(), glov.Y(), glov.Z(), locx, locy, pterr, 1., deltaStrips, source.posref.cnt, source.posref.z, source.posref.rho, source.posref.phi); // a fake hit is a stub that passed, so its probability is 1
+    }
   }
+  tracks.push_back(event, numTracksEv_, 0., 0., 0., 0., hits.size());
 }
+#endif
 
 void TrackShooter::shootTracks() {
 
-  Tracks tracks("tracks");
-  Hits hits("hits");
+  Tracks tracks("tracks"), treeTracks("tracks"); // the simulation fills the first ones, the writer thread hands them to the tree through the second ones
+  Hits hits("hits"), treeHits("hits");
 //  Hits plhits("plhits");
 
   printParameters();
 
+  bucketModules();
+
   std::string outfileName = tracksDir_ + "/tracks_" + instanceId_ + ".root";
 
-  TFile* outfile = new TFile(outfileName.c_str(), "recreate");
+  TFile* outfile = new TFile(outfileName.c_str(), "recreate", "", compressionLevel_);
   if (outfile->IsZombie()) {
     std::cerr << "Failed opening file \"" << outfileName << "\" for writing. Simulation aborted." << std::endl;
     return;
@@ -463,15 +638,23 @@ void TrackShooter::shootTracks() {
 
   gROOT->ProcessLine("#include <vector>");
 
-  tracks.setupBranches(*tree);
-  hits.setupBranches(*tree);
+  treeTracks.setupBranches(*tree);
+  treeHits.setupBranches(*tree);
   //plhits.setupBranches(*tree);
+  // larger baskets mean fewer, bigger compressed writes of the hit columns
+  if (basketSize_ > 0) tree->SetBasketSize("*", basketSize_);
 
+#ifdef FAKE_HITS
+  buildFakeHitSources();
+#endif
+
+  TrackEntryWriter writer(*tree, treeTracks, treeHits);
+  ProgressMeter progress("Simulated tracks", numEvents_*numTracksEv_);
   // build ordered maps
   for (long int i=eventOffset_, totTracks = eventOffset_*numTracksEv_; i<numEvents_+eventOffset_; i++) {
     // new event
     //
-    for (long int j=0; j<numTracksEv_; j++, totTracks++) {
+    for (long int j=0; j<numTracksEv_; j++, totTracks++, progress.advance()) {
       double eta = eta_->get();
       double phi0 = phi0_->get();
       double z0 = z0_->get();
@@ -514,8 +697,8 @@ void TrackShooter::shootTracks() {
        // double phirot = atan2(y,x) + phi0;
        // if (phirot > M_PI) phirot -= 2*M_PI;
 
-        const BarrelOctants& octants = rit->second;
-        const BarrelModules& bmods = octants[getPointOctant(xrot, yrot, z)]; // jump to the octant of the point (CUIDADO octant is determined used non-planar mods)
+        const BarrelSectors& sectors = rit->second;
+        const BarrelModules& bmods = sectors[getPointPhiSector(xrot, yrot)]; // jump to the phi sector of the point of the helix at the layer radius
 
         for (BarrelModules::const_iterator mit = bmods.begin(); mit != bmods.end(); ++mit) {
           BarrelModule* mod = (*mit);
@@ -572,9 +755,7 @@ void TrackShooter::shootTracks() {
         double z = 1/B*acos(1-(trackerMaxRho_*trackerMaxRho_)/(2*R*R)) + z0;
         if (barrelMinZ_ <= z && z <= barrelMaxZ_) { // check whether the track will escape from the barrel volume
           tracks.push_back(i, j, eta, phi0, z0, pt, hits.size());
-          tree->Fill();
-          hits.clear();
-          tracks.clear();
+          writer.push(tracks, hits);
           continue; // particle has escaped the detector from the barrel volume, we don't want the endcaps to see escaped particles curving back into the tracker, so we skip on
         }
       }
@@ -587,8 +768,8 @@ void TrackShooter::shootTracks() {
         double xrot = x*cos(phi0) - y*sin(phi0);
         double yrot = x*sin(phi0) + y*cos(phi0);
 
-        const EndcapOctants& octants = zit->second;
-        const EndcapModules& emods = octants[getPointOctant(xrot, yrot, z)];
+        const EndcapSectors& sectors = zit->second;
+        const EndcapModules& emods = sectors[getPointPhiSector(xrot, yrot)]; // jump to the phi sector of the point of the helix at the disk z
 
 
         for (EndcapModules::const_iterator mit = emods.begin(); mit != emods.end(); ++mit) {
@@ -638,32 +819,15 @@ void TrackShooter::shootTracks() {
       }
       tracks.push_back(i, j, eta, phi0, z0, pt, hits.size());
 
-      tree->Fill();
-
-      hits.clear();
-      tracks.clear();
+      writer.push(tracks, hits);
     }     
 #ifdef FAKE_HITS
-    // NOW BROKEN! ENABLING THEM IS USELESS!!
-    for (std::vector<Module*>::iterator mit = allMods_.begin(); mit != allMods_.end(); ++mit) {
-      Module* mod = (*mit);
-      // loop over all the modules again
-      // fake hits
-      Polygon3d<4> poly;
-      poly << mod->getCorner(0)-mod->getMeanPoint() << mod->getCorner(1)-mod->getMeanPoint() << mod->getCorner(2)-mod->getMeanPoint() << mod->getCorner(3)-mod->getMeanPoint();
-
-      int numFake = die.Poisson(mod->getTriggerFrequencyFakePerEvent());
-      for (int k = 0; k < numFake; k++) {
-        XYZVector fakehit = poly.generateRandomPoint(&die);
-        float deltaStrips = 1 + die.Integer(mod->getTriggerWindow()/2);
-        float fakept = mod->getPtError()->stripsToP(deltaStrips);
-        float pterr = mod->getPtError()->computeError(fakept);
-        PosRef posref = mod->getPositionalReference();
-      }
-    }
+    shootFakeHits(i, tracks, hits);
+    writer.push(tracks, hits);
 #endif
   }
 
+  writer.finish();
   outfile->Write();
   outfile->Close();
   delete outfile;
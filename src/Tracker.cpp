@@ -1,58 +1,170 @@
+#include <memory>
 #include "Tracker.h"
+#include "PathCounters.h"
+#include "TaskPool.h"
 
-std::pair<double, double> Tracker::computeMinMaxEta() const {
+/**
+ * Compute the global quantities of the geometry, for the current geometry epoch
+ */
+void Tracker::computeSummary() const {
   double min = 9999, max = 0;
   for (auto m : modules()) {
     min = MIN(min, m->minEta());
     max = MAX(max, m->maxEta());
   } 
+  summary_.minModuleEta = min;
+  summary_.maxModuleEta = max;
+  //summary_.minTracksEta = min; summary_.maxTracksEta = max;
+  summary_.minTracksEta = -4.0; summary_.maxTracksEta = 4.0; // CUIDADO to make it equal to the extended pixel - make it better ASAP!!
+  summaryEpoch_ = ComputableEpoch::current;
+}
+
+/**
+ * The global quantities of the geometry, as computed when the tracker was frozen, or computed again once the geometry
+ * epoch has moved on
+ */
+const Tracker::GeometrySummary& Tracker::geometrySummary() const {
+  if (summaryEpoch_ != ComputableEpoch::current) computeSummary();
+  return summary_;
+}
+
+std::pair<double, double> Tracker::computeMinMaxEta() const {
+  const GeometrySummary& summary = geometrySummary();
+  return std::make_pair(summary.minTracksEta, summary.maxTracksEta);
+}
 
-  //return std::make_pair(-1*log(tan(min/2.)), -1*log(tan(max/2.)));
-  //return std::make_pair(min, max);
-  return std::make_pair(-4.0,4.0); // CUIDADO to make it equal to the extended pixel - make it better ASAP!!
+/**
+ * Visit a tracker with a forkable visitor, one layer or disk per task, as described in <i>ForkableGeometryVisitor</i>
+ * @param tracker The tracker to be visited
+ * @param barrels The barrels of the tracker
+ * @param endcaps The endcaps of the tracker
+ * @param v The visitor, into which all the forks are merged at the end
+ * @param numThreads The number of threads; the tracker is visited as by <i>accept()</i> if it is 1 or less
+ */
+template<class TrackerType, class BarrelsType, class EndcapsType, class VisitorType>
+static void acceptInParallel(TrackerType& tracker, BarrelsType& barrels, EndcapsType& endcaps, VisitorType& v, int numThreads) {
+  if (numThreads <= 1) {
+    tracker.accept(v);
+    return;
+  }
+  scopeTaskClock("Visit " + StopWatch::typeName(typeid(v)));
+  std::vector<std::unique_ptr<VisitorType> > forks;
+  std::vector<std::function<void()> > branches;
+  v.visit(tracker);
+  for (auto& b : barrels) {
+    v.visit(b);
+    for (auto& l : b.layers()) {
+      forks.emplace_back(v.fork());
+      VisitorType* forked = forks.back().get();
+      auto* layer = &l;
+      branches.push_back([forked, layer]() { layer->accept(*forked); });
+    }
+  }
+  for (auto& e : endcaps) {
+    v.visit(e);
+    for (auto& d : e.disks()) {
+      forks.emplace_back(v.fork());
+      VisitorType* forked = forks.back().get();
+      auto* disk = &d;
+      branches.push_back([forked, disk]() { disk->accept(*forked); });
+    }
+  }
+  TaskPool::instance()->run("Tracker visit", branches.size(), [&](int i) {
+    timePathScope("Tracker::parallelAccept branch");
+    branches[i]();
+  }, numThreads);
+  timePathScope("Tracker::parallelAccept merge");
+  for (auto& forked : forks) v.merge(*forked);
+}
+
+/**
+ * Build a set of independent subdetectors, on as many threads as set with <i>buildThreads()</i>. If any of the builds
+ * fail, the exception of the first subdetector that failed is thrown once all the others are done, as in a serial build.
+ * The state the builders share (the interned property names, the matched property lists, the message log and the
+ * materials map) is guarded by mutexes. Each subdetector is allocated from a lane of the arena of its own.
+ * @param numSubdetectors The number of subdetectors
+ * @param buildOne The function building the subdetector of the given index
+ */
+void Tracker::buildSubdetectors(int numSubdetectors, const std::function<void(int)>& buildOne) {
+  TaskPool::instance()->run("Tracker build", numSubdetectors, [&](int i) {
+    GeometryArena::Scope scope(*arena_);
+    buildOne(i);
+  }, buildThreads_);
+}
+
+/**
+ * Visit the tracker, splitting the visit of its layers and disks across threads
+ * @param v The visitor, which has to be forkable
+ * @param numThreads The number of threads
+ */
+void Tracker::parallelAccept(ForkableGeometryVisitor& v, int numThreads) {
+  acceptInParallel(*this, barrels_, endcaps_, v, numThreads);
+}
+
+/**
+ * Visit the tracker, without changing it, splitting the visit of its layers and disks across threads
+ * @param v The visitor, which has to be forkable
+ * @param numThreads The number of threads
+ */
+void Tracker::parallelAccept(ForkableConstGeometryVisitor& v, int numThreads) const {
+  acceptInParallel(*this, barrels_, endcaps_, v, numThreads);
 }
 
 void Tracker::build() {
+  if (!arena_) arena_ = std::make_shared<GeometryArena>();
+  GeometryArena::Scope scope(*arena_);
   try {
     check();
 
     double barrelMaxZ = 0;
 
+    std::vector<Barrel*> barrels;
     for (auto& mapel : barrelNode) {
       if (!containsOnly.empty() && containsOnly.count(mapel.first) == 0) continue;
       Barrel* b = GeometryFactory::make<Barrel>();
       b->myid(mapel.first);
+      barrels_.push_back(b);
+      barrels.push_back(b);
+    }
+    buildSubdetectors(barrels.size(), [&](int i) {
+      Barrel* b = barrels[i];
       b->store(propertyTree());
-      b->store(mapel.second);
+      b->store(barrelNode.at(b->myid()));
       b->build();
       b->cutAtEta(etaCut());
-      barrelMaxZ = MAX(b->maxZ(), barrelMaxZ);
-      barrels_.push_back(b);
-    }
+    });
+    for (auto b : barrels) barrelMaxZ = MAX(b->maxZ(), barrelMaxZ);
 
+    std::vector<Endcap*> endcaps; // the endcaps are placed after the barrels, so they are only built once all the barrels are
     for (auto& mapel : endcapNode) {
       if (!containsOnly.empty() && containsOnly.count(mapel.first) == 0) continue;
       Endcap* e = GeometryFactory::make<Endcap>();
       e->myid(mapel.first);
       e->barrelMaxZ(barrelMaxZ);
+      endcaps_.push_back(e);
+      endcaps.push_back(e);
+    }
+    buildSubdetectors(endcaps.size(), [&](int i) {
+      Endcap* e = endcaps[i];
       e->store(propertyTree());
-      e->store(mapel.second);
+      e->store(endcapNode.at(e->myid()));
       e->build();
       e->cutAtEta(etaCut());
-      endcaps_.push_back(e);
-    }
+    });
 
-    for (auto& mapel : supportNode) {
-      SupportStructure* s = new SupportStructure();
-      s->store(propertyTree());
-      s->store(mapel.second);
-      s->buildInTracker();
-      supportStructures_.push_back(s);
-    }
+    // the supports are independent of each other, and of the subdetectors: they are built as these are
+    std::vector<SupportStructure*> supports(supportNode.size(), nullptr);
+    buildSubdetectors(supports.size(), [&](int i) {
+      supports[i] = new SupportStructure();
+      supports[i]->store(propertyTree());
+      supports[i]->store(supportNode[i].second);
+      supports[i]->buildInTracker();
+    });
+    for (SupportStructure* s : supports) supportStructures_.push_back(s);
   }
   catch (PathfulException& pe) { pe.pushPath(fullid(*this)); throw; }
 
-  accept(moduleSetVisitor_);
+  accept(moduleTableVisitor_);
 
   class HierarchicalNameVisitor : public GeometryVisitor {
     int cntId = 0;
@@ -75,3 +187,96 @@ void Tracker::build() {
   cleanup();
   builtok(true);
 }
+
+/**
+ * Free what only the build needed once the geometry is final, the modules frozen and the materials routed: the property
+ * trees of every object of the tracker and the subtrees their nodes kept for their children. The geometry cannot be
+ * built again from the objects after this.
+ */
+void Tracker::releaseBuildState() {
+  class BuildStateReleaser : public GeometryVisitor {
+  public:
+    void visit(Barrel& b) { b.releaseBuildState(); }
+    void visit(Endcap& e) { e.releaseBuildState(); }
+    void visit(Layer& l) { l.releaseBuildState(); }
+    void visit(Disk& d) { d.releaseBuildState(); }
+    void visit(Ring& r) { r.releaseBuildState(); }
+    void visit(RodPair& r) { r.releaseBuildState(); }
+    void visit(DetectorModule& m) { m.releaseBuildState(); }
+  } releaser;
+  accept(releaser);
+  for (auto& s : supportStructures_) s.releaseBuildState();
+  PropertyObject::releaseBuildState();
+  barrelNode.release();
+  endcapNode.release();
+  supportNode.release();
+}
+
+/**
+ * Take a flat copy of the geometry of all the modules, in the order of <i>modules()</i>. The module types are numbered
+ * in the order they are first met.
+ */
+void Tracker::freeze() {
+  frozenModules_.clear();
+  frozenModuleTypes_.clear();
+  frozenModules_.reserve(modules().size());
+  std::map<string, int> typeIds;
+  for (auto m : modules()) {
+    auto type = typeIds.insert(std::make_pair(m->moduleType(), (int)typeIds.size()));
+    if (type.second) frozenModuleTypes_.push_back(m->moduleType());
+    ModuleGeometry g;
+    g.module = m;
+    g.centerX = m->center().X(); g.centerY = m->center().Y(); g.centerZ = m->center().Z();
+    g.normalX = m->normal().X(); g.normalY = m->normal().Y(); g.normalZ = m->normal().Z();
+    g.minR = m->minR(); g.maxR = m->maxR();
+    g.minZ = m->minZ(); g.maxZ = m->maxZ();
+    g.minPhi = m->minPhi(); g.maxPhi = m->maxPhi();
+    m->freezeOccupancy(-1., -1., -1.); // computed from the live geometry, not from a previous freeze
+    g.phiAperture = m->phiAperture(); g.etaAperture = m->etaAperture();
+    g.stripOccupancyPerEvent = m->computeStripOccupancyPerEvent();
+    g.subdet = m->subdet();
+    g.key = m->moduleKey();
+    g.typeId = type.first->second;
+    frozenModules_.push_back(g);
+  }
+  for (const ModuleGeometry& g : frozenModules_) g.module->freezeOccupancy(g.phiAperture, g.etaAperture, g.stripOccupancyPerEvent); // every reader of the occupancy gets the value of the table
+  buildSensorPolys();
+  computeSummary();
+}
+
+/**
+ * Build the hit and envelope polygons of all the sensors in one pass, into a single block the sensors then use, instead
+ * of one heap allocation per polygon when each of them is first asked for. A sensor moved afterwards goes back to
+ * building its own polygons.
+ */
+void Tracker::buildSensorPolys() {
+  releaseSensorPolys();
+  size_t numSensors = 0;
+  for (auto m : modules()) numSensors += m->sensors().size();
+  sensorPolys_.reserve(2*numSensors); // the polygons must not be moved once the sensors point to them
+  for (auto m : modules()) {
+    for (const auto& s : m->sensors()) {
+      sensorPolys_.push_back(s.buildHitPoly());
+      sensorPolys_.push_back(s.buildEnvelopePoly());
+    }
+  }
+  auto poly = sensorPolys_.begin();
+  for (auto m : modules()) {
+    for (const auto& s : m->sensors()) {
+      s.attachPolys(&*poly, &*(poly+1));
+      poly += 2;
+    }
+  }
+}
+
+/**
+ * Free the polygons built by <i>buildSensorPolys()</i>, for the analyses that do not need them: the sensors build their
+ * own again if they are asked for
+ */
+void Tracker::releaseSensorPolys() {
+  if (sensorPolys_.empty()) return;
+  for (auto m : modules()) {
+    for (const auto& s : m->sensors()) s.clearPolys();
+  }
+  std::vector<Polygon3d<4> >().swap(sensorPolys_);
+}
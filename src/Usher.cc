@@ -4,6 +4,7 @@
  */
 
 #include <Usher.h>
+#include <TaskPool.h>
 namespace insur {
     // public
     /**
@@ -92,6 +93,10 @@ namespace insur {
      * @return A reference to the modified collection of inactive surfaces
      */
     InactiveSurfaces& Usher::mirror(TrackerIntRep& tracker, InactiveSurfaces& is) {
+        // each list grows to at most twice its size: reserve it once rather than copy the elements on every reallocation
+        is.getBarrelServices().reserve(2 * is.getBarrelServices().size());
+        is.getEndcapServices().reserve(2 * is.getEndcapServices().size());
+        is.getSupports().reserve(2 * is.getSupports().size());
         startTaskClock("Mirroring barrel services");
         // number of barrel service volumes that need to be reflected
         unsigned int half = is.getBarrelServices().size();
@@ -1388,8 +1393,11 @@ namespace insur {
         bool up;
         skipAllServices_ = tracker.skipAllServices();
         skipAllSupports_ = tracker.skipAllSupports();
-        n_of_layers = analyzeBarrels(tracker, layers_io_radius, barrels_length_offset, real_index_layer, short_layers, barrel_has_services);
-        n_of_discs = analyzeEndcaps(tracker, endcaps_io_radius, discs_length_offset, real_index_disc, endcap_has_services);
+        // the barrels and the endcaps share no objects, and their extents are first computed here over all of their modules
+        TaskPool::instance()->run("Usher", 2, [&](int i) {
+            if (i == 0) n_of_layers = analyzeBarrels(tracker, layers_io_radius, barrels_length_offset, real_index_layer, short_layers, barrel_has_services);
+            else n_of_discs = analyzeEndcaps(tracker, endcaps_io_radius, discs_length_offset, real_index_disc, endcap_has_services);
+        });
         post_analysis = true;
         up = tracker.servicesForcedUp() || analyzePolarity();
         return up;
@@ -1516,7 +1524,7 @@ namespace insur {
 
 
         BarrelVisitor v(radius_list_io, length_offset_list, real_index, layers_short, barrel_has_services);
-        tracker.accept(v);
+        for (const Barrel& barrel : tracker.barrels()) v.visit(barrel); // no need to walk down to the modules
 
         return v.layer_counters();
     }
@@ -1590,7 +1598,7 @@ namespace insur {
         };
         
         EndcapVisitor v(radius_list_io, length_offset_list, real_index, endcap_has_services);
-        tracker.accept(v);
+        for (const Endcap& endcap : tracker.endcaps()) v.visit(endcap); // no need to walk down to the modules
 
         return v.layer_counters();
     }
@@ -5,6 +5,8 @@
 
 #include <Vizard.h>
 #include <TPolyLine.h>
+#include <StopWatch.h>
+#include <algorithm>
 
 namespace insur {
   // public
@@ -81,6 +83,10 @@ namespace insur {
    * thousands; since volume creation and placement in this function is at this point unoptimised, this will cause
    * considerable strain on the resources of whatever is used to visualise the geometry tree later.
    *
+   * NOTE: The body is disabled (it was written against the former layer and module interfaces) and nothing calls this
+   * function or <i>display()</i>, so no geometry tree is built. Should it be revived, the modules are to share one
+   * volume per module type, placed with a matrix each, rather than have a shape each.
+   *
    * @param am A reference to the tracker object that contains the collection of active surfaces
    * @param is A reference to the collection of inactive surfaces
    * @param simplified A flag indicating whether to draw bounding boxes around the layers/discs or whether to display each module individually
@@ -243,11 +249,33 @@ namespace insur {
     if (outfile.empty()) filename = filename + default_graphfile;
     else filename = filename + outfile;
     std::cout << "Preparing to write neighbour graph to " << filename << "..." << std::endl;
-    std::ofstream outstream(filename.c_str());
+    std::ofstream outstream;
+    std::vector<char> outbuffer(1 << 20); // the graph goes to the file in large writes
+    outstream.rdbuf()->pubsetbuf(&outbuffer[0], outbuffer.size());
+    outstream.open(filename.c_str());
     writeNeighbourGraph(is, outstream);
     outstream.close();    
     std::cout << "Neighbour graph written to " << filename << "." << std::endl;
   }
+  // The name of a kind of feeder or neighbour in the graph
+  static const char* graphInTypeName(InactiveElement::InType type) {
+    switch (type) {
+    case InactiveElement::no_in: return "none, ";
+    case InactiveElement::tracker: return "tracker, ";
+    case InactiveElement::barrel: return "barrel service, ";
+    case InactiveElement::endcap: return "endcap service, ";
+    default: return "something weird, ";
+    }
+  }
+
+  // The entry of a service element in the graph: the lines are ended with '\n', the stream is only flushed by its owner
+  static void writeGraphElement(std::ostream& outstream, const char* kind, unsigned int index, InactiveElement& element) {
+    outstream << kind << " element " << index << ": service is " << (element.isFinal() ? "final and " : "not final and ")
+              << (element.isVertical() ? "vertical." : "horizontal.") << '\n'
+              << "Feeder type: " << graphInTypeName(element.getFeederType()) << "feeder index = " << element.getFeederIndex() << "." << '\n'
+              << "Neighbour type: " << graphInTypeName(element.getNeighbourType()) << "neighbour index = " << element.getNeighbourIndex() << "." << '\n' << '\n';
+  }
+
   /**
    * This function writes the feeder/neighbour relations in a collection of inactive surfaces to a very simple text
    * file. It essentially lists all edges of the neighbour graph, first those in the barrels, then those in the endcaps,
@@ -260,77 +288,14 @@ namespace insur {
     try {
       if (outstream) {
         // barrel services loop
-        outstream << "BARREL SERVICES:" << std::endl << std::endl;
-        for (unsigned int i = 0; i < is.getBarrelServices().size(); i++) {
-          outstream << "Barrel element " << i << ": service is ";
-          if (is.getBarrelServicePart(i).isFinal()) outstream << "final and ";
-          else outstream << "not final and ";
-          if (is.getBarrelServicePart(i).isVertical()) outstream << "vertical.";
-          else outstream << "horizontal.";
-          outstream << std::endl << "Feeder type: ";
-          switch (is.getBarrelServicePart(i).getFeederType()) {
-          case InactiveElement::no_in: outstream << "none, ";
-                                       break;
-          case InactiveElement::tracker: outstream << "tracker, ";
-                                         break;
-          case InactiveElement::barrel: outstream << "barrel service, ";
-                                        break;
-          case InactiveElement::endcap: outstream << "endcap service, ";
-                                        break;
-          default: outstream << "something weird, ";
-          }
-          outstream << "feeder index = " << is.getBarrelServicePart(i).getFeederIndex() << ".";
-          outstream << std::endl << "Neighbour type: ";
-          switch (is.getBarrelServicePart(i).getNeighbourType()) {
-          case InactiveElement::no_in: outstream << "none, ";
-                                       break;
-          case InactiveElement::tracker: outstream << "tracker, ";
-                                         break;
-          case InactiveElement::barrel: outstream << "barrel service, ";
-                                        break;
-          case InactiveElement::endcap: outstream << "endcap service, ";
-                                        break;
-          default: outstream << "something weird, ";
-          }
-          outstream << "neighbour index = " << is.getBarrelServicePart(i).getNeighbourIndex() << ".";
-          outstream << std::endl << std::endl;
-        }
+        std::vector<InactiveElement>& barrelServices = is.getBarrelServices();
+        outstream << "BARREL SERVICES:" << '\n' << '\n';
+        for (unsigned int i = 0; i < barrelServices.size(); i++) writeGraphElement(outstream, "Barrel", i, barrelServices[i]);
         // endcap services
-        outstream << "ENDCAP SERVICES:" << std::endl << std::endl;
-        for (unsigned int i = 0; i < is.getEndcapServices().size(); i++) {
-          outstream << "Endcap element " << i << ": service is ";
-          if (is.getEndcapServicePart(i).isFinal()) outstream << "final and ";
-          else outstream << "not final and ";
-          if (is.getEndcapServicePart(i).isVertical()) outstream << "vertical.";
-          else outstream << "horizontal.";
-          outstream << std::endl << "Feeder type: ";
-          switch (is.getEndcapServicePart(i).getFeederType()) {
-          case InactiveElement::no_in: outstream << "none, ";
-                                       break;
-          case InactiveElement::tracker: outstream << "tracker, ";
-                                         break;
-          case InactiveElement::barrel: outstream << "barrel service, ";
-                                        break;
-          case InactiveElement::endcap: outstream << "endcap service, ";
-                                        break;
-          default: outstream << "something weird, ";
-          }
-          outstream << "feeder index = " << is.getEndcapServicePart(i).getFeederIndex() << ".";
-          outstream << std::endl << "Neighbour type: ";
-          switch (is.getEndcapServicePart(i).getNeighbourType()) {
-          case InactiveElement::no_in: outstream << "none, ";
-                                       break;
-          case InactiveElement::tracker: outstream << "tracker, ";
-                                         break;
-          case InactiveElement::barrel: outstream << "barrel service, ";
-                                        break;
-          case InactiveElement::endcap: outstream << "endcap service, ";
-                                        break;
-          default: outstream << "something weird, ";
-          }
-          outstream << "neighbour index = " << is.getEndcapServicePart(i).getNeighbourIndex() << ".";
-          outstream << std::endl << std::endl;
-        }
+        std::vector<InactiveElement>& endcapServices = is.getEndcapServices();
+        outstream << "ENDCAP SERVICES:" << '\n' << '\n';
+        for (unsigned int i = 0; i < endcapServices.size(); i++) writeGraphElement(outstream, "Endcap", i, endcapServices[i]);
+        outstream.flush();
       }
       else std::cout << graph_wrong << std::endl;
     }
@@ -371,6 +336,7 @@ namespace insur {
    * @param name a qualifier that goes in parenthesis in the title (outer or strip, for example)
    */  
   void Vizard::weigthSummart(Analyzer& a, WeightDistributionGrid& weightGrid, RootWSite& site, std::string name) {
+    scopeTaskClock("Vizard::weigthSummart");
     RootWContent* myContent;
 
     // Initialize the page with the material budget
@@ -425,6 +391,7 @@ namespace insur {
    * @param name a qualifier that goes in parenthesis in the title (outer or strip, for example)
    */
   void Vizard::histogramSummary(Analyzer& a, RootWSite& site, std::string name) {
+    scopeTaskClock("Vizard::histogramSummary");
     // Initialize the page with the material budget
     RootWPage* myPage;
     RootWContent* myContent;
@@ -1114,6 +1081,7 @@ namespace insur {
    * @param site the RootWSite object for the output
    */
   bool Vizard::geometrySummary(Analyzer& analyzer, Tracker& tracker, SimParms& simparms, InactiveSurfaces* inactive, RootWSite& site, std::string name) {
+    scopeTaskClock("Vizard::geometrySummary");
     trackers_.push_back(&tracker);
 
     std::map<std::string, double>& tagMapWeight = analyzer.getTagWeigth();
@@ -2006,6 +1974,7 @@ namespace insur {
                                   const std::string& matfile, const std::string& pixmatfile,
                                   bool defaultMaterial, bool defaultPixelMaterial,
                                   Analyzer& analyzer, Analyzer& pixelAnalyzer, Tracker& tracker, SimParms& simparms, RootWSite& site) {
+    scopeTaskClock("Vizard::additionalInfoSite");
     RootWPage* myPage = new RootWPage("Info");
     myPage->setAddress("info.html");
     site.addPage(myPage);
@@ -2101,23 +2070,32 @@ namespace insur {
     myInfo = new RootWInfo("Number of tracks used for geometry");
     myInfo->setValue(geometryTracksUsed);
     simulationContent->addItem(myInfo);
+    double geometryPrecision = analyzer.getGeometryTrackPrecision();
+    if (geometryPrecision > 0 && std::isfinite(geometryPrecision)) {
+      myInfo = new RootWInfo("Worst relative error of the geometry coverage profile (%)");
+      myInfo->setValue(100 * geometryPrecision, 2);
+      simulationContent->addItem(myInfo);
+    }
 
     RootWTextFile* myTextFile;
-    createBarrelModulesCsv(tracker);
-    createEndcapModulesCsv(tracker);
-    createAllModulesCsv(tracker);
+    // The coordinate files have a line per module: they are written straight to their destination when the site is written
+    const Tracker* coordinatesTracker = &tracker;
     // Barrel coordinates
-    myTextFile = new RootWTextFile("barrelCoordinates.csv", "Barrel modules coordinate file");
-    myTextFile->addText(barrelModulesCsv_);
-    filesContent->addItem(myTextFile);
+    filesContent->addItem(new RootWStreamFile("barrelCoordinates.csv", "Barrel modules coordinate file",
+                                              [coordinatesTracker](std::ostream& output) { writeBarrelModulesCsv(*coordinatesTracker, output); }));
     // Endcap coordinates
-    myTextFile = new RootWTextFile("endcapCoordinates.csv", "Endcap modules coordinate file");
-    myTextFile->addText(endcapModulesCsv_);
-    filesContent->addItem(myTextFile);
+    filesContent->addItem(new RootWStreamFile("endcapCoordinates.csv", "Endcap modules coordinate file",
+                                              [coordinatesTracker](std::ostream& output) { writeEndcapModulesCsv(*coordinatesTracker, output); }));
     // All coordinates
-    myTextFile = new RootWTextFile("allCoordinates.csv", "Complete coordinate file");
-    myTextFile->addText(allModulesCsv_);
-    filesContent->addItem(myTextFile);
+    filesContent->addItem(new RootWStreamFile("allCoordinates.csv", "Complete coordinate file",
+                                              [coordinatesTracker](std::ostream& output) { writeAllModulesCsv(*coordinatesTracker, output); }));
+    // All the modules, with their analysis results, as a binary table of typed columns (see ColumnTable)
+    const Analyzer* tableAnalyzer = &analyzer;
+    const SimParms* tableSimParms = &simparms;
+    filesContent->addItem(new RootWStreamFile("allModules.tkcol", "Complete module table (binary columns)",
+                                              [coordinatesTracker, tableAnalyzer, tableSimParms](std::ostream& output) {
+                                                writeModuleTable(*coordinatesTracker, *tableAnalyzer, *tableSimParms, output);
+                                              }, true));
 
     // TODO: make an object that handles this properly:
     RootWTable* myTable = new RootWTable();
@@ -2171,10 +2149,10 @@ namespace insur {
     myTextFile->addText(occupancyCsv_);
     summaryContent->addItem(myTextFile);
 
-    // Bill of materials
-    myTextFile = new RootWTextFile("materials.csv", "Bill of materials");
-    myTextFile->addText(analyzer.getBillOfMaterials());
-    summaryContent->addItem(myTextFile);
+    // Bill of materials, written straight to its destination
+    const Analyzer* billAnalyzer = &analyzer;
+    summaryContent->addItem(new RootWStreamFile("materials.csv", "Bill of materials",
+                                                [billAnalyzer](std::ostream& output) { billAnalyzer->writeBillOfMaterials(output); }));
 
     createTriggerSectorMapCsv(analyzer.getTriggerSectorMap());
     myTextFile = new RootWTextFile("trigger_sector_map.csv", "Trigger Towers to Modules connections");
@@ -2191,6 +2169,7 @@ namespace insur {
 
 
   bool Vizard::bandwidthSummary(Analyzer& analyzer, Tracker& tracker, SimParms& simparms, RootWSite& site) {
+    scopeTaskClock("Vizard::bandwidthSummary");
     RootWPage* myPage = new RootWPage("Bandwidth");
     myPage->setAddress("bandwidth.html");
     site.addPage(myPage);
@@ -2285,6 +2264,22 @@ namespace insur {
     for (std::map<std::string, SummaryTable>::iterator it = hitOccupancySummaries.begin(); it != hitOccupancySummaries.end(); ++it) {
       myPage->addContent(std::string("Hit occupancy (") + it->first + ")", false).addTable().setContent(it->second.getContent());
     }
+
+    if (!analyzer.getPileupScanPoints().empty()) {
+      myPage->addContent("Bandwidth over the pile-up scan", false).addTable().setContent(analyzer.getPileupScanBandwidthSummary().getContent());
+      for (auto& point : analyzer.getPileupScanPoints()) {
+        std::string pileup = any2str(point.numMinBiasEvents) + " minimum bias events";
+        for (auto& summary : point.triggerRateSummaries) {
+          myPage->addContent("Total (true + fake) stub rate (" + summary.first + ") at " + pileup, false).addTable().setContent(summary.second.getContent());
+        }
+        for (auto& summary : point.triggerDataBandwidthSummaries) {
+          myPage->addContent("Trigger data bandwidth Gbps (" + summary.first + ") at " + pileup, false).addTable().setContent(summary.second.getContent());
+        }
+      }
+    }
+    if (analyzer.getReadoutWhatIfSummary().hasCell(0, 1)) {
+      myPage->addContent("Bandwidth over the readout variants", false).addTable().setContent(analyzer.getReadoutWhatIfSummary().getContent());
+    }
    
 
     myContent = &myPage->addContent("Trigger bandwidth and frequency maps", true);
@@ -2346,6 +2341,7 @@ namespace insur {
 
 
   bool Vizard::triggerProcessorsSummary(Analyzer& analyzer, Tracker& tracker, RootWSite& site) {
+    scopeTaskClock("Vizard::triggerProcessorsSummary");
     RootWPage* myPage = new RootWPage("Trigger CPUs");
     myPage->setAddress("trigger_cpus.html");
     site.addPage(myPage);
@@ -2466,6 +2462,7 @@ namespace insur {
   }
 
   bool Vizard::irradiatedPowerSummary(Analyzer& a, Tracker& tracker, RootWSite& site) {
+    scopeTaskClock("Vizard::irradiatedPowerSummary");
     RootWPage* myPage = new RootWPage("Power");
     myPage->setAddress("power.html");
     site.addPage(myPage);
@@ -2475,6 +2472,15 @@ namespace insur {
       myPage->addContent(std::string("Power in irradiated sensors (") + it->first + ")", false).addTable().setContent(it->second.getContent());
     }
 
+    for (auto& scanPoint : a.getIrradiatedPowerScanSummaries()) {
+      const PowerOperatingPoint& point = scanPoint.first;
+      std::ostringstream pointName;
+      pointName << point.timeIntegratedLumi << " fb^-1, " << point.operatingTemp << " C, " << point.chargeDepletionVoltage << " V";
+      for (auto& summary : scanPoint.second) {
+        myPage->addContent("Power in irradiated sensors (" + summary.first + ") at " + pointName.str(), false).addTable().setContent(summary.second.getContent());
+      }
+    }
+
     // Some helper string objects
     ostringstream tempSS;
     std::string tempString;    
@@ -2524,6 +2530,7 @@ namespace insur {
   }
 
   bool Vizard::errorSummary(Analyzer& a, RootWSite& site, std::string additionalTag, bool isTrigger) {
+    scopeTaskClock("Vizard::errorSummary");
 
     //********************************//
     //*                              *//
@@ -2909,6 +2916,7 @@ namespace insur {
   }
 
   bool Vizard::taggedErrorSummary(Analyzer& a, RootWSite& site) {
+    scopeTaskClock("Vizard::taggedErrorSummary");
 
     //********************************//
     //*                              *//
@@ -3288,6 +3296,7 @@ namespace insur {
   }
 
   bool Vizard::triggerSummary(Analyzer& a, Tracker& tracker, RootWSite& site, bool extended) {
+    scopeTaskClock("Vizard::triggerSummary");
     //********************************//
     //*                              *//
     //*   Page with the trigger      *//
@@ -3960,6 +3969,7 @@ namespace insur {
 
 
   bool Vizard::neighbourGraphSummary(InactiveSurfaces& is, RootWSite& site) {
+    scopeTaskClock("Vizard::neighbourGraphSummary");
     std::stringstream ss;
     writeNeighbourGraph(is, ss);
 
@@ -4058,6 +4068,65 @@ namespace insur {
         //MessageLogger::getLatestLog(iLevel);
       }
     }
+
+    // The resources used by each computing step, nested as the steps are, as a flame graph laid on its side: the bar of
+    // a task is as long as its share of the time of its parent
+    const std::vector<StopWatch::Task>& tasks = StopWatch::instance()->tasks();
+    if (!tasks.empty()) {
+      anythingFound=true;
+      RootWContent& perfContent = myPage.addContent("Performance", false);
+      RootWTable& perfTable = perfContent.addTable();
+      perfTable.setContent(0, 0, "Task");
+      perfTable.setContent(0, 1, "Wall time [s]");
+      perfTable.setContent(0, 2, "Self time [s]");
+      perfTable.setContent(0, 3, "Share of parent");
+      perfTable.setContent(0, 4, "CPU time [s]");
+      perfTable.setContent(0, 5, "Peak RSS [MB]");
+      perfTable.setContent(0, 6, "Allocations");
+      perfTable.setContent(0, 7, "Calls");
+      std::vector<const StopWatch::Task*> parents; // the running parents of the task, by depth
+      for (unsigned int i=0; i<tasks.size(); ++i) {
+        const StopWatch::Task& task = tasks[i];
+        parents.resize(task.depth);
+        const StopWatch::Task* parent = task.depth > 0 ? parents.back() : NULL;
+        parents.push_back(&task);
+        std::string indent;
+        for (int j=0; j<task.depth; ++j) indent += "&nbsp;&nbsp;";
+        perfTable.setContent(i+1, 0, indent + task.name);
+        if (!task.finished) continue;
+        perfTable.setContent(i+1, 1, task.wallSeconds, 3);
+        perfTable.setContent(i+1, 2, task.selfSeconds, 3);
+        if (parent && parent->finished && parent->wallSeconds > 0) {
+          double share = std::min(1., task.wallSeconds / parent->wallSeconds);
+          perfTable.setContent(i+1, 3, "<span style=\"display:inline-block;background:#e8743b;width:" + any2str(int(100*share)) + "px\">&nbsp;</span> "
+                                       + any2str(int(100*share + 0.5)) + "%");
+        }
+        perfTable.setContent(i+1, 4, task.cpuSeconds, 3);
+        perfTable.setContent(i+1, 5, task.peakRssKb/1024., 1);
+        perfTable.setContent(i+1, 6, std::to_string(task.allocations));
+        perfTable.setContent(i+1, 7, std::to_string(task.calls));
+      }
+      RootWTextFile* perfFile = new RootWTextFile("performance.csv", "Performance report (CSV)");
+      perfFile->addText(StopWatch::instance()->csvReport());
+      perfContent.addItem(perfFile);
+      perfFile = new RootWTextFile("performance.json", "Performance report (JSON)");
+      perfFile->addText(StopWatch::instance()->jsonReport());
+      perfContent.addItem(perfFile);
+
+      // The heap memory held by each subsystem, now and at its peak
+      RootWTable& memoryTable = perfContent.addTable();
+      memoryTable.setContent(0, 0, "Memory account");
+      memoryTable.setContent(0, 1, "Live [MB]");
+      memoryTable.setContent(0, 2, "Peak [MB]");
+      memoryTable.setContent(0, 3, "Allocations");
+      std::vector<StopWatch::MemoryUsage> memory = StopWatch::memoryUsage();
+      for (unsigned int i=0; i<memory.size(); ++i) {
+        memoryTable.setContent(i+1, 0, memory[i].account);
+        memoryTable.setContent(i+1, 1, memory[i].liveBytes/1048576., 1);
+        memoryTable.setContent(i+1, 2, memory[i].peakBytes/1048576., 1);
+        memoryTable.setContent(i+1, 3, std::to_string(memory[i].allocations));
+      }
+    }
     return anythingFound;
   }
 
@@ -4453,12 +4522,13 @@ namespace insur {
   void Vizard::createTriggerSectorMapCsv(const TriggerSectorMap& tsm) {
     triggerSectorMapCsv_.clear();
     triggerSectorMapCsv_ = "eta_idx, phi_idx, module_list" + csv_eol; 
-    for (TriggerSectorMap::const_iterator it = tsm.begin(); it != tsm.end(); ++it) {
-      triggerSectorMapCsv_ += any2str(it->first.first) + csv_separator + any2str(it->first.second);
-      for (std::set<int>::const_iterator it2 = it->second.begin(); it2 != it->second.end(); ++it2) {
-        triggerSectorMapCsv_ += csv_separator + any2str(*it2);
+    for (int eta = 1; eta <= tsm.numEta(); eta++) {
+      for (int phi = 1; phi <= tsm.numPhi(); phi++) {
+        if (tsm.empty(eta, phi)) continue;
+        triggerSectorMapCsv_ += any2str(eta) + csv_separator + any2str(phi);
+        tsm.forEachModule(eta, phi, [&](int sebCoords) { triggerSectorMapCsv_ += csv_separator + any2str(sebCoords); });
+        triggerSectorMapCsv_ += csv_eol;
       }
-      triggerSectorMapCsv_ += csv_eol;
     }
   }
 
@@ -4476,12 +4546,14 @@ namespace insur {
     moduleConnectionsCsv_ = ss.str();
   }
 
-  void Vizard::createAllModulesCsv(const Tracker& t) {
+  void Vizard::writeAllModulesCsv(const Tracker& t, std::ostream& output) {
+    scopeTaskClock("Vizard::writeAllModulesCsv");
     class TrackerVisitor : public ConstGeometryVisitor {
-      std::stringstream output_;
+      std::ostream& output_;
       string sectionName_;
       int layerId_;
     public:
+      TrackerVisitor(std::ostream& output) : output_(output) {}
       void preVisit() {
         output_ << "Section/C:Layer/I:Ring/I:r_mm/D:z_mm/D:phi_rad/D:sensorSpacing_mm/D" <<  std::endl;
         output_ << "Section/C, Layer/I, Ring/I, r_mm/D, z_mm/D, phi_rad/D, sensorSpacing_mm/D" << std::endl;
@@ -4499,25 +4571,111 @@ namespace insur {
           << m.center().Z() << ", "
           << m.center().Phi() << ", "
           << m.dsDistance()
-          << std::endl;
+          << '\n';
       }
-
-      std::string output() const { return output_.str(); }
     };
 
-    TrackerVisitor v;
+    TrackerVisitor v(output);
     v.preVisit();
     t.accept(v);
-    allModulesCsv_ = v.output();
   }
 
-  void Vizard::createBarrelModulesCsv(const Tracker& t) {
+  /**
+   * Write the modules of the module table of the tracker, in its order, as a binary table of typed columns: the position,
+   * the dimensions and the type of each module, and what the analyses found for it (occupancy, bandwidth, power, fluence,
+   * material). The values are written at full precision; the results of an analysis which was not run are left at 0.
+   */
+  void Vizard::writeModuleTable(const Tracker& t, const Analyzer& a, const SimParms& simparms, std::ostream& output) {
+    scopeTaskClock("Vizard::writeModuleTable");
+    const Tracker::Modules& modules = t.modules();
+    size_t n = modules.size();
+    std::vector<std::string> sections(n), types(n);
+    std::vector<int32_t> subdetectors(n), layers(n), rings(n), rods(n), sides(n), channels(n), hits(n);
+    std::vector<double> r(n), z(n), phi(n), dsDistances(n), widths(n), lengths(n), thicknesses(n), tilts(n), areas(n);
+    std::vector<double> occupancies(n), bandwidths(n), sparsifiedBandwidths(n), powers(n), irradiationPowers(n), fluences(n);
+    std::vector<double> radiationLengths(n), interactionLengths(n);
+    double numMinBiasEvents = simparms.numMinBiasEvents();
+    double timeIntegratedLumi = simparms.timeIntegratedLumi();
+    for (size_t i = 0; i < n; ++i) {
+      const Module& m = *modules[i];
+      UniRef ref = m.uniRef();
+      sections[i] = ref.cnt;
+      types[i] = m.moduleType();
+      subdetectors[i] = m.subdet();
+      layers[i] = ref.layer;
+      rings[i] = ref.ring;
+      rods[i] = ref.phi;
+      sides[i] = ref.side;
+      channels[i] = m.totalChannels();
+      hits[i] = a.moduleHits(&m);
+      r[i] = m.center().Rho();
+      z[i] = m.center().Z();
+      phi[i] = m.center().Phi();
+      dsDistances[i] = m.dsDistance();
+      widths[i] = m.meanWidth();
+      lengths[i] = m.length();
+      thicknesses[i] = m.thickness();
+      tilts[i] = m.tiltAngle();
+      areas[i] = m.area();
+      occupancies[i] = m.hitOccupancyPerEvent();
+      if (m.sensors().back().type() == SensorType::Strip) { // as in BandwidthVisitor
+        for (const auto& s : m.sensors()) {
+          double hitChannels = occupancies[i] * numMinBiasEvents * s.numChannels();
+          int nChips = s.totalROCs();
+          bandwidths[i] += (16*nChips + s.numChannels())*100E3;
+          sparsifiedBandwidths[i] += ((m.numSparsifiedHeaderBits()*nChips)+(hitChannels*m.numSparsifiedPayloadBits()))*100E3;
+        }
+      }
+      powers[i] = m.totalPower();
+      irradiationPowers[i] = m.irradiationPower();
+      const ModuleFluence* fluence = a.moduleFluence(&m);
+      if (fluence) fluences[i] = fluence->irradiation * timeIntegratedLumi;
+      const ModuleCap* cap = m.getModuleCap();
+      if (cap) {
+        radiationLengths[i] = cap->getRadiationLength();
+        interactionLengths[i] = cap->getInteractionLength();
+      }
+    }
+
+    ColumnTable table;
+    table.addCategoryColumn("section", sections);
+    table.addIntegerColumn("subdetector", std::move(subdetectors));
+    table.addIntegerColumn("layer", std::move(layers));
+    table.addIntegerColumn("ring", std::move(rings));
+    table.addIntegerColumn("rod", std::move(rods));
+    table.addIntegerColumn("side", std::move(sides));
+    table.addCategoryColumn("moduleType", types);
+    table.addRealColumn("r_mm", std::move(r));
+    table.addRealColumn("z_mm", std::move(z));
+    table.addRealColumn("phi_rad", std::move(phi));
+    table.addRealColumn("sensorSpacing_mm", std::move(dsDistances));
+    table.addRealColumn("meanWidth_mm", std::move(widths));
+    table.addRealColumn("length_mm", std::move(lengths));
+    table.addRealColumn("thickness_mm", std::move(thicknesses));
+    table.addRealColumn("tilt_rad", std::move(tilts));
+    table.addRealColumn("area_mm2", std::move(areas));
+    table.addIntegerColumn("channels", std::move(channels));
+    table.addIntegerColumn("geometryTrackHits", std::move(hits));
+    table.addRealColumn("hitOccupancyPerEvent", std::move(occupancies));
+    table.addRealColumn("bandwidth_bps", std::move(bandwidths));
+    table.addRealColumn("sparsifiedBandwidth_bps", std::move(sparsifiedBandwidths));
+    table.addRealColumn("power_mW", std::move(powers));
+    table.addRealColumn("irradiationPower", std::move(irradiationPowers));
+    table.addRealColumn("fluence_cm-2", std::move(fluences));
+    table.addRealColumn("radiationLength", std::move(radiationLengths));
+    table.addRealColumn("interactionLength", std::move(interactionLengths));
+    table.write(output);
+  }
+
+  void Vizard::writeBarrelModulesCsv(const Tracker& t, std::ostream& output) {
+    scopeTaskClock("Vizard::writeBarrelModulesCsv");
     class BarrelVisitor : public ConstGeometryVisitor {
-      std::stringstream output_;
+      std::ostream& output_;
       string barName_;
       int layId_;
       int numRods_;
     public:
+      BarrelVisitor(std::ostream& output) : output_(output) {}
       void preVisit() {
         output_ << "Barrel-Layer name, r(mm), z(mm), ss(mm), num mods" << std::endl;
       }
@@ -4530,23 +4688,22 @@ namespace insur {
       }
       void visit(const BarrelModule& m) {
         if (m.posRef().phi > 2) return;
-        output_ << barName_ << "-L" << layId_ << ", " << std::fixed << std::setprecision(3) << m.center().Rho() << ", " << m.center().Z() << ", " << m.dsDistance() << ", " << numRods_/2. << std::endl;
+        output_ << barName_ << "-L" << layId_ << ", " << std::fixed << std::setprecision(3) << m.center().Rho() << ", " << m.center().Z() << ", " << m.dsDistance() << ", " << numRods_/2. << '\n';
       }
-
-      std::string output() const { return output_.str(); }
     };
 
-    BarrelVisitor v;
+    BarrelVisitor v(output);
     v.preVisit();
     t.accept(v);
-    barrelModulesCsv_ = v.output();
   }
   
-  void Vizard::createEndcapModulesCsv(const Tracker& t) {
+  void Vizard::writeEndcapModulesCsv(const Tracker& t, std::ostream& output) {
+    scopeTaskClock("Vizard::writeEndcapModulesCsv");
     class EndcapVisitor : public ConstGeometryVisitor {
       double minZ_;
     public:
-      std::stringstream output;
+      std::ostream& output;
+      EndcapVisitor(std::ostream& out) : output(out) {}
       void preVisit() {
         output << "Ring, r(mm), phi(deg), z(mm), base_inner(mm), base_outer(mm), height(mm)" <<std::endl;
       }
@@ -4565,13 +4722,12 @@ namespace insur {
                << std::fixed << std::setprecision(3) << m.center().Z() - minZ_ << ", "
                << std::fixed << std::setprecision(3) << m.minWidth() << ", "
                << std::fixed << std::setprecision(3) << m.maxWidth() << ", "
-               << std::fixed << std::setprecision(3) << m.length() << std::endl;
+               << std::fixed << std::setprecision(3) << m.length() << '\n';
       }
     };
-    EndcapVisitor v;
+    EndcapVisitor v(output);
     v.preVisit(); 
     t.accept(v);
-    endcapModulesCsv_ = v.output.str();
   }
 
   void Vizard::drawCircle(double radius, bool full, int color/*=kBlack*/) {
@@ -1,42 +1,75 @@
 #include "WeightDistributionGrid.h"
 #include "MaterialObject.h"
 #include <algorithm>
+#include <cmath>
 
 namespace material {
 
   WeightDistributionGrid::WeightDistributionGrid(double binDimension) :
-    binDimension_(binDimension) {}
+    binDimension_(binDimension), minBinZ_(0), minBinR_(0), numBinsZ_(0), numBinsR_(0) {}
 
   void WeightDistributionGrid::addTotalGrams(double minZ, double minR, double maxZ, double maxR, double length, double surface, const MaterialObject& materialObject) {
-    int binIndexZStart = floor(minZ / binDimension_);
-    int binIndexZ = binIndexZStart;
-    int binIndexR = floor(minR / binDimension_);
-    double binMinZ, binMinR, binMaxZ, binMaxR, zMul, rMul;
-
-    do {
-      binMinR = floor(binIndexR * binDimension_);
-      binMaxR = binMinR + binDimension_;
-
-      do {
-        binMinZ = floor(binIndexZ * binDimension_);
-        binMaxZ = binMinZ + binDimension_;
-
-        zMul = std::max(binMinZ, minZ) - std::min(binMaxZ, maxZ);
-        rMul = std::max(binMinR, minR) - std::min(binMaxR, maxR);
-
-        operator[](std::make_pair(binIndexZ, binIndexR)) += 
-          (materialObject.totalGrams(length, surface) * zMul * rMul) / ((maxZ - minZ) * (maxR - minR));
-
-        binIndexZ ++;
-      } while (binMaxZ < maxZ);
-      
-      binIndexR ++;
-      binIndexZ = binIndexZStart;
-    } while (binMinR < maxR);
+    int firstBinZ = floor(minZ / binDimension_), lastBinZ = std::max(firstBinZ, int(ceil(maxZ / binDimension_)) - 1);
+    int firstBinR = floor(minR / binDimension_), lastBinR = std::max(firstBinR, int(ceil(maxR / binDimension_)) - 1);
+    cover(firstBinZ, lastBinZ, firstBinR, lastBinR);
+
+    std::vector<double> zFractions = overlaps(minZ, maxZ, firstBinZ, lastBinZ);
+    std::vector<double> rFractions = overlaps(minR, maxR, firstBinR, lastBinR);
+    double totalGrams = materialObject.totalGrams(length, surface);
+    for (int binR = firstBinR; binR <= lastBinR; binR++) {
+      double rowGrams = totalGrams * rFractions[binR - firstBinR];
+      double* row = &grams_[(binR - minBinR_) * numBinsZ_ + (firstBinZ - minBinZ_)];
+      for (int i = 0; i <= lastBinZ - firstBinZ; i++) row[i] += rowGrams * zFractions[i];
+    }
+  }
+
+  /**
+   * The fraction of the range [min, max] in each of the bins from firstBin to lastBin; all of it in the first bin if the range is empty
+   */
+  std::vector<double> WeightDistributionGrid::overlaps(double min, double max, int firstBin, int lastBin) const {
+    std::vector<double> fractions(lastBin - firstBin + 1, 0.);
+    if (max <= min) {
+      fractions[0] = 1.;
+      return fractions;
+    }
+    for (int bin = firstBin; bin <= lastBin; bin++) {
+      double binMin = bin * binDimension_, binMax = binMin + binDimension_;
+      fractions[bin - firstBin] = std::max(0., std::min(binMax, max) - std::max(binMin, min)) / (max - min);
+    }
+    return fractions;
+  }
+
+  /**
+   * Grow the grid so that it covers the given bins, keeping the content of the bins it already had
+   */
+  void WeightDistributionGrid::cover(int firstBinZ, int lastBinZ, int firstBinR, int lastBinR) {
+    if (!grams_.empty()) {
+      if (firstBinZ >= minBinZ_ && lastBinZ < minBinZ_ + numBinsZ_ && firstBinR >= minBinR_ && lastBinR < minBinR_ + numBinsR_) return;
+      firstBinZ = std::min(firstBinZ, minBinZ_); lastBinZ = std::max(lastBinZ, minBinZ_ + numBinsZ_ - 1);
+      firstBinR = std::min(firstBinR, minBinR_); lastBinR = std::max(lastBinR, minBinR_ + numBinsR_ - 1);
+    }
+    int numBinsZ = lastBinZ - firstBinZ + 1, numBinsR = lastBinR - firstBinR + 1;
+    std::vector<double> grams(numBinsZ * numBinsR, 0.);
+    for (int r = 0; r < numBinsR_; r++) {
+      std::copy(grams_.begin() + r * numBinsZ_, grams_.begin() + (r + 1) * numBinsZ_,
+                grams.begin() + (r + minBinR_ - firstBinR) * numBinsZ + (minBinZ_ - firstBinZ));
+    }
+    grams_.swap(grams);
+    minBinZ_ = firstBinZ; minBinR_ = firstBinR;
+    numBinsZ_ = numBinsZ; numBinsR_ = numBinsR;
+  }
+
+  double WeightDistributionGrid::grams(int binZ, int binR) const {
+    if (binZ < minBinZ_ || binZ >= minBinZ_ + numBinsZ_ || binR < minBinR_ || binR >= minBinR_ + numBinsR_) return 0.;
+    return grams_[(binR - minBinR_) * numBinsZ_ + (binZ - minBinZ_)];
+  }
+
+  void WeightDistributionGrid::clear() {
+    grams_.clear();
+    minBinZ_ = minBinR_ = numBinsZ_ = numBinsR_ = 0;
   }
 
   double WeightDistributionGrid::binDimension() const {
     return binDimension_;
   }
 }
-
@@ -20,9 +20,9 @@ namespace insur {
     void XMLWriter::pixbar(std::vector<ShapeInfo>& s, std::ifstream& in, std::ofstream& out) {
         unsigned int pos = 0;
         std::string line;
-        while (std::getline(in, line) && (line.find(xml_preamble_concise) == std::string::npos)) out << line << std::endl; // scan for preamble
-        out << line << std::endl << getSimpleHeader(); // output the preamble followed by the header
-        while (std::getline(in, line) && (line.find(xml_insert_marker) == std::string::npos)) out << line << std::endl;
+        while (std::getline(in, line) && (line.find(xml_preamble_concise) == std::string::npos)) out << line << '\n'; // scan for preamble
+        out << line << '\n' << getSimpleHeader(); // output the preamble followed by the header
+        while (std::getline(in, line) && (line.find(xml_insert_marker) == std::string::npos)) out << line << '\n';
         if (in.eof()) return; // No mid point marker, no party
         if (s.size() > 0) {
             while ((pos < s.size()) && (s.at(pos).name_tag.find(xml_tob) == std::string::npos)) pos++;
@@ -41,7 +41,7 @@ namespace insur {
                 out << xml_zv3 << xml_general_endline;
             }
         }
-        while (std::getline(in, line)) out << line << std::endl;
+        while (std::getline(in, line)) out << line << '\n';
     }
     
     /**
@@ -57,9 +57,9 @@ namespace insur {
     void XMLWriter::pixfwd(std::vector<ShapeInfo>& s, std::ifstream& in, std::ofstream& out) {
         unsigned pos = 0;
         std::string line;
-        while (std::getline(in, line) && (line.find(xml_preamble_concise) == std::string::npos)) out << line << std::endl; // scan for preamble
-        out << line << std::endl << getSimpleHeader(); // output the preamble followed by the header
-        while (std::getline(in, line) && (line.find(xml_insert_marker) == std::string::npos)) out << line << std::endl;
+        while (std::getline(in, line) && (line.find(xml_preamble_concise) == std::string::npos)) out << line << '\n'; // scan for preamble
+        out << line << '\n' << getSimpleHeader(); // output the preamble followed by the header
+        while (std::getline(in, line) && (line.find(xml_insert_marker) == std::string::npos)) out << line << '\n';
         if (in.eof()) return; // No mid point marker, no party
         if (s.size() > 0) {
             while ((pos < s.size()) && (s.at(pos).name_tag.find(xml_tid) == std::string::npos)) pos++;
@@ -78,7 +78,7 @@ namespace insur {
                 out << s.at(pos).rzdown.at(0).second << xml_rzpoint_close;
             }
         }
-        while (std::getline(in, line)) out << line << std::endl;
+        while (std::getline(in, line)) out << line << '\n';
     }
     
     /**
@@ -101,27 +101,25 @@ namespace insur {
         std::vector<PosInfo>& p = d.positions;
         std::vector<AlgoInfo>& a = d.algos;
         std::vector<Rotation>& r = d.rots;
-        std::ostringstream buffer;
-        buffer << xml_preamble;
-        buffer << getExtendedHeader();
+        out << xml_preamble;
+        out << getExtendedHeader();
         if (wt) {
-            buffer << xml_new_const_section;
-            materialSection(xml_newtrackerfile, e, c, buffer);
-            rotationSection(r, xml_newtrackerfile, buffer);
-            logicalPartSection(l, xml_newtrackerfile, buffer, true);
-            solidSection(s, xml_newtrackerfile, buffer, trackerVolumeTemplate, true, true);
-            posPartSection(p, a, xml_newtrackerfile, buffer);
+            out << xml_new_const_section;
+            materialSection(xml_newtrackerfile, e, c, out);
+            rotationSection(r, xml_newtrackerfile, out);
+            logicalPartSection(l, xml_newtrackerfile, out, true);
+            solidSection(s, xml_newtrackerfile, out, trackerVolumeTemplate, true, true);
+            posPartSection(p, a, xml_newtrackerfile, out);
         }
         else {
-            buffer << xml_const_section;
-            materialSection(xml_trackerfile, e, c, buffer);
-            rotationSection(r, xml_trackerfile, buffer);
-            logicalPartSection(l, xml_trackerfile, buffer);
-            solidSection(s, xml_trackerfile, buffer, trackerVolumeTemplate, true);
-            posPartSection(p, a, xml_trackerfile, buffer);
+            out << xml_const_section;
+            materialSection(xml_trackerfile, e, c, out);
+            rotationSection(r, xml_trackerfile, out);
+            logicalPartSection(l, xml_trackerfile, out);
+            solidSection(s, xml_trackerfile, out, trackerVolumeTemplate, true);
+            posPartSection(p, a, xml_trackerfile, out);
         }
-        buffer << xml_defclose;
-        out << buffer.str();
+        out << xml_defclose;
     }
     
     /**
@@ -137,19 +135,19 @@ namespace insur {
      * @out A reference to a file stream that is bound to the output file
      */
     void XMLWriter::topology(std::vector<SpecParInfo>& t, std::ifstream& in, std::ofstream& out) {
-        std::ostringstream strm;
         std::string line;
         unsigned int i;
         int pos;
-        while (std::getline(in, line) && (line.find(xml_preamble_concise) == std::string::npos)) out << line << std::endl; // scan for preamble
-        out << line << std::endl << getSimpleHeader(); // output the preamble followed by the header
+        EntryIndex index = indexEntries(t);
+        while (std::getline(in, line) && (line.find(xml_preamble_concise) == std::string::npos)) out << line << '\n'; // scan for preamble
+        out << line << '\n' << getSimpleHeader(); // output the preamble followed by the header
 
         // Find the break
-        while (std::getline(in, line) && (line.find(xml_insert_marker) == std::string::npos)) out << line << std::endl;
+        while (std::getline(in, line) && (line.find(xml_insert_marker) == std::string::npos)) out << line << '\n';
 
         // Add Layers
         out << xml_spec_par_open << "OuterTracker" << xml_subdet_layer << xml_par_tail << xml_general_inter;
-        pos = findEntry(t, xml_subdet_layer + xml_par_tail);
+        pos = findEntry(index, xml_subdet_layer + xml_par_tail);
         if (pos != -1) {
             for (i = 0; i < t.at(pos).partselectors.size(); i++) {
                 out << xml_spec_par_selector << t.at(pos).partselectors.at(i) << xml_general_endline;
@@ -161,7 +159,7 @@ namespace insur {
 
         // Add Rods
         out << xml_spec_par_open << "OuterTracker" << xml_subdet_rod << xml_par_tail << xml_general_inter;
-        pos = findEntry(t, xml_subdet_rod + xml_par_tail);
+        pos = findEntry(index, xml_subdet_rod + xml_par_tail);
         if (pos != -1) {
             for (i = 0; i < t.at(pos).partselectors.size(); i++) {
                 out << xml_spec_par_selector << t.at(pos).partselectors.at(i) << xml_general_endline;
@@ -173,7 +171,7 @@ namespace insur {
 
         // Add Disks
         out << xml_spec_par_open << "OuterTracker" << xml_subdet_wheel << xml_par_tail << xml_general_inter;
-        pos = findEntry(t, xml_subdet_wheel + xml_par_tail);
+        pos = findEntry(index, xml_subdet_wheel + xml_par_tail);
         if (pos != -1) {
             for (i = 0; i < t.at(pos).partselectors.size(); i++) {
                 out << xml_spec_par_selector << t.at(pos).partselectors.at(i) << xml_general_endline;
@@ -184,7 +182,7 @@ namespace insur {
 
         // Add Rings
         out << xml_spec_par_open << "OuterTracker" << xml_subdet_ring << xml_par_tail << xml_general_inter;
-        pos = findEntry(t, xml_subdet_ring + xml_par_tail);
+        pos = findEntry(index, xml_subdet_ring + xml_par_tail);
         if (pos != -1) {
             for (i = 0; i < t.at(pos).partselectors.size(); i++) {
                 out << xml_spec_par_selector << t.at(pos).partselectors.at(i) << xml_general_endline;
@@ -196,21 +194,21 @@ namespace insur {
 		
 		//Write specPar blocks for ROC parameters 
 		//TOB
-		pos = findEntry(t, xml_subdet_tobdet + xml_par_tail);
+		pos = findEntry(index, xml_subdet_tobdet + xml_par_tail);
 		if (pos != -1) {
 			  specParROC(t.at(pos).partselectors, t.at(pos).moduletypes, t.at(pos).parameter, out);
 		
 		}
 
 		//TID
-		pos = findEntry(t, xml_subdet_tiddet + xml_par_tail);
+		pos = findEntry(index, xml_subdet_tiddet + xml_par_tail);
 		if (pos != -1) {
 			  specParROC(t.at(pos).partselectors, t.at(pos).moduletypes, t.at(pos).parameter, out);
 		
 		}
 
         //copy rest of skeleton file unchanged
-        while (std::getline(in, line)) out << line << std::endl;
+        while (std::getline(in, line)) out << line << '\n';
 
     }
     
@@ -224,10 +222,10 @@ namespace insur {
     void XMLWriter::prodcuts(std::vector<SpecParInfo>& t, std::ifstream& in, std::ofstream& out) {
         unsigned int pos = 0;
         std::string line;
-        while (std::getline(in, line) && (line.find(xml_preamble_concise) == std::string::npos)) out << line << std::endl; // scan for preamble
-        out << line << std::endl << getSimpleHeader(); // output the preamble followed by the header
+        while (std::getline(in, line) && (line.find(xml_preamble_concise) == std::string::npos)) out << line << '\n'; // scan for preamble
+        out << line << '\n' << getSimpleHeader(); // output the preamble followed by the header
         // head of file
-        while (std::getline(in, line) && (line.find(xml_insert_marker) == std::string::npos)) out << line << std::endl;
+        while (std::getline(in, line) && (line.find(xml_insert_marker) == std::string::npos)) out << line << '\n';
         // TOB
         while ((pos < t.size()) && (t.at(pos).name.find(xml_subdet_tobdet) == std::string::npos)) pos++;
         if (pos < t.size()) {
@@ -244,7 +242,7 @@ namespace insur {
             }
         }
         // tail of file
-        while (std::getline(in, line)) out << line << std::endl;
+        while (std::getline(in, line)) out << line << '\n';
     }
     
     /**
@@ -258,11 +256,11 @@ namespace insur {
     void XMLWriter::trackersens(std::vector<SpecParInfo>& t, std::ifstream& in, std::ofstream& out) {
         unsigned int pos = 0;
         std::string line;
-        while (std::getline(in, line) && (line.find(xml_preamble_concise) == std::string::npos)) out << line << std::endl; // scan for preamble
-        out << line << std::endl << getSimpleHeader(); // output the preamble followed by the header
+        while (std::getline(in, line) && (line.find(xml_preamble_concise) == std::string::npos)) out << line << '\n'; // scan for preamble
+        out << line << '\n' << getSimpleHeader(); // output the preamble followed by the header
         // TOB
         while ((pos < t.size()) && (t.at(pos).name.find(xml_subdet_tobdet) == std::string::npos)) pos++;
-        while (std::getline(in, line) && (line.find(xml_insert_marker) == std::string::npos)) out << line << std::endl;
+        while (std::getline(in, line) && (line.find(xml_insert_marker) == std::string::npos)) out << line << '\n';
         if (pos < t.size()) {
             for (unsigned int i = 0; i < t.at(pos).partselectors.size(); i++) {
                 out << xml_spec_par_selector << t.at(pos).partselectors.at(i) << xml_general_endline;
@@ -271,14 +269,14 @@ namespace insur {
         pos = 0;
         // TID
         while ((pos < t.size()) && (t.at(pos).name.find(xml_subdet_tiddet) == std::string::npos)) pos++;
-        while (std::getline(in, line) && (line.find(xml_insert_marker) == std::string::npos)) out << line << std::endl;
+        while (std::getline(in, line) && (line.find(xml_insert_marker) == std::string::npos)) out << line << '\n';
         if (pos < t.size()) {
             for (unsigned int i = 0; i < t.at(pos).partselectors.size(); i++) {
                 out << xml_spec_par_selector << t.at(pos).partselectors.at(i) << xml_general_endline;
             }
         }
         // tail of file
-        while (std::getline(in, line)) out << line << std::endl;
+        while (std::getline(in, line)) out << line << '\n';
     }
     
     /**
@@ -297,9 +295,9 @@ namespace insur {
         b = buildPaths(t, b, wt);
         if (!b.empty()) {
             std::string line;
-            while (std::getline(in, line) && (line.find(xml_preamble_concise) == std::string::npos)) out << line << std::endl; // scan for preamble
-            out << line << std::endl << getSimpleHeader(); // output the preamble followed by the header
-            while (std::getline(in, line) && (line.find(xml_insert_marker) == std::string::npos)) out << line << std::endl;
+            while (std::getline(in, line) && (line.find(xml_preamble_concise) == std::string::npos)) out << line << '\n'; // scan for preamble
+            out << line << '\n' << getSimpleHeader(); // output the preamble followed by the header
+            while (std::getline(in, line) && (line.find(xml_insert_marker) == std::string::npos)) out << line << '\n';
             std::vector<PathInfo>::iterator iter, guard = b.end();
             for (iter = b.begin(); iter != guard; iter++) {
                 unsigned int id;
@@ -323,10 +321,10 @@ namespace insur {
                         std::cerr << " in XMLWriter::recomaterial(). Using default dummy values." << std::endl;
                         out << xml_recomat_parameters;
                     }
-                    out << xml_spec_par_close << std::endl;
+                    out << xml_spec_par_close << '\n';
                 }
             }
-            while (std::getline(in, line)) out << line << std::endl;
+            while (std::getline(in, line)) out << line << '\n';
         }
     }
     
@@ -334,14 +332,13 @@ namespace insur {
     /**
      * This function writes the opening and closing tags for a material section in a CMSSW XML file. It also loops through
      * the list of elementary materials and that of the composites to generate one entry each for the material section. Actual
-     * XML formatting of those list elements is left to two other functions, though. All generated output is sent to an
-     * <i>ostringstream</i> that serves as a buffer for the output file contents.
+     * XML formatting of those list elements is left to two other functions, though. All generated output is sent to the output stream.
      * @param name The label of the material section, typically the name of the output file
      * @param e A reference to the vector containing a series of elementary material definitions
      * @param c A reference to the vector containing a series of composite material definitions
-     * @param stream A reference to the output buffer
+     * @param stream A reference to the output stream
      */
-    void XMLWriter::materialSection(std::string name , std::vector<Element>& e, std::vector<Composite>& c, std::ostringstream& stream) {
+    void XMLWriter::materialSection(std::string name , std::vector<Element>& e, std::vector<Composite>& c, std::ostream& stream) {
         stream << xml_material_section_open << name << xml_general_inter;
         for (unsigned int i = 0; i < e.size(); i++) elementaryMaterial(e.at(i).tag, e.at(i).density, e.at(i).atomic_number, e.at(i).atomic_weight, stream);
         for (unsigned int i = 0; i < c.size(); i++) compositeMaterial(c.at(i).name, c.at(i).density, c.at(i).method, c.at(i).elements, stream);
@@ -351,12 +348,12 @@ namespace insur {
     /**
      * This function writes the opening and closing tags for a rotation section in a CMSSW XML file, if such a block is
      * necessary. It also loops through the list of rotations, but leaves XML formatting of the individual entries to another
-     * function. All generated output is sent to an <i>ostringstream</i> that serves as a buffer for the output file contents.
+     * function. All generated output is sent to the output stream.
      * @param r A reference to the vector containing a series of rotation definitions
      * @param label The label of the rotation section, typically the name of the output file
-     * @param stream A reference to the output buffer
+     * @param stream A reference to the output stream
      */
-    void XMLWriter::rotationSection(std::vector<Rotation>& r, std::string label, std::ostringstream& stream) {
+    void XMLWriter::rotationSection(std::vector<Rotation>& r, std::string label, std::ostream& stream) {
         if (!r.empty()) {
             stream << xml_rotation_section_open << label << xml_general_inter;
             for (unsigned int i = 0; i < r.size(); i++)
@@ -369,12 +366,12 @@ namespace insur {
      * This function writes the opening and closing tags for the logical part section in a CMSSW XML file that describes
      * a volume hierachy. It writes an entry for the root volume <i>Tracker</i> before looping through the list of logical
      * volumes within it. XML formatting of the those entries is left to another function, though. All generated output is sent
-     * to an <i>ostringstream</i> that serves as a buffer for the output file contents.
+     * to the output stream.
      * @param l A reference to the vector containing a series of logical volume definitions
      * @param label The label of the logical part section, typically the name of the output file
-     * @param stream A reference to the output buffer
+     * @param stream A reference to the output stream
      */
-    void XMLWriter::logicalPartSection(std::vector<LogicalInfo>& l, std::string label, std::ostringstream& stream, bool wt) {
+    void XMLWriter::logicalPartSection(std::vector<LogicalInfo>& l, std::string label, std::ostream& stream, bool wt) {
         std::vector<LogicalInfo>::const_iterator iter, guard = l.end();
         stream << xml_logical_part_section_open << label << xml_general_inter;
         if (!wt) logicalPart(xml_tracker, xml_fileident + ":" + xml_tracker, xml_material_air, stream);
@@ -383,27 +380,26 @@ namespace insur {
     }
 
 
-    void XMLWriter::trackerLogicalVolume(std::ostringstream& stream, std::istream& instream) {
+    void XMLWriter::trackerLogicalVolume(std::ostream& stream, std::istream& instream) {
       std::string line;
       while (getline(instream, line)) {
         size_t pos = line.find(xml_insert_marker);
         if (pos != std::string::npos) {
           line.replace(pos, xml_insert_marker.size(), xml_tracker);
         }
-        stream << line << std::endl;
+        stream << line << '\n';
       }
     }
     
     /**
      * This function writes the opening and closing tags for the solid section in a CMSSW XML file. It writes an entry for the
      * root volume <i>Tracker</i> before looping through the list of physical shapes within it. XML formatting of all entries
-     * is left to another function, though. All generated output is sent to an <i>ostringstream</i> that serves as a buffer for
-     * the output file contents.
+     * is left to another function, though. All generated output is sent to the output stream.
      * @param s A reference to the vector containing a series of physical volume definitions
      * @param label The label of the solid section, typically the name of the output file
-     * @param stream A reference to the output buffer
+     * @param stream A reference to the output stream
      */
-    void XMLWriter::solidSection(std::vector<ShapeInfo>& s, std::string label, std::ostringstream& stream, std::istream& trackerVolumeTemplate, bool notobtid, bool wt) {
+    void XMLWriter::solidSection(std::vector<ShapeInfo>& s, std::string label, std::ostream& stream, std::istream& trackerVolumeTemplate, bool notobtid, bool wt) {
         stream << xml_solid_section_open << label << xml_general_inter;
         if (!wt) {
           //tubs(xml_tracker, pixel_radius, outer_radius, max_length, stream); // CUIDADO old tracker volume, now parsed from a file
@@ -433,14 +429,13 @@ namespace insur {
     /**
      * This function writes the opening and closing tags for the positioning section in a CMSSW XML file. It loops first through the
      * collection of explicit volume placements and then through those of the required placement algorithms, while leaving XML
-     * formatting of the individual entries to two other functions. All generated output is sent to an <i>ostringstream</i> that serves
-     * as a buffer for the output file contents.
+     * formatting of the individual entries to two other functions. All generated output is sent to the output stream.
      * @param p A reference to the vector containing a series of placement definitions
      * @param a A reference to the vector containing a series of algorithm names and parameters
      * @param label The label of the position section, typically the name of the output file
-     * @param stream A reference to the output buffer
+     * @param stream A reference to the output stream
      */
-    void XMLWriter::posPartSection(std::vector<PosInfo>& p, std::vector<AlgoInfo>& a, std::string label, std::ostringstream& stream) {
+    void XMLWriter::posPartSection(std::vector<PosInfo>& p, std::vector<AlgoInfo>& a, std::string label, std::ostream& stream) {
         std::vector<PosInfo>::iterator piter, pguard = p.end();
         std::vector<AlgoInfo>::iterator aiter, aguard = a.end();
         stream << xml_pos_part_section_open << label << xml_general_inter;
@@ -452,12 +447,12 @@ namespace insur {
     /**
      * This function writes the opening and closing tags for a section specifying additional parameters for various detector parts in a
      * CMSSW XML file. It also loops through the collection of parameter information but leaves formatting of the individual entries
-     * to another function. All generated output is sent to an <i>ostringstream</i> that serves as a buffer for the output file contents.
+     * to another function. All generated output is sent to the output stream.
      * @param t A reference to the collection of tracker topology information
      * @param label The label of the <i>SpecPar</i> section, typically the name of the output file
-     * @param stream A reference to the output buffer
+     * @param stream A reference to the output stream
      */
-    void XMLWriter::specParSection(std::vector<SpecParInfo>& t, std::string label, std::ostringstream& stream) {
+    void XMLWriter::specParSection(std::vector<SpecParInfo>& t, std::string label, std::ostream& stream) {
         std::vector<SpecParInfo>::iterator titer, tguard = t.end();
         stream << xml_spec_par_section_open << label << xml_general_inter;
         for (titer = t.begin(); titer != tguard; titer++) specPar(titer->name, titer->parameter, titer->partselectors, stream);
@@ -465,29 +460,27 @@ namespace insur {
     }
 
     /**
-     * This formatter writes an XML entry describing a call to a volume placement algorithm to the stream that serves as a
-     * buffer for the output file contents.
+     * This formatter writes an XML entry describing a call to a volume placement algorithm to the output stream.
      * @param name The name of the chosen algorithm as defined elsewhere in CMSSW
      * @param parent The name of the parent volume in which the duplicated volumes will be placed
      * @param params A pre-formatted list of arguments for the algorithm
-     * @param stream A reference to the output buffer
+     * @param stream A reference to the output stream
      */
-    void XMLWriter::algorithm(std::string name, std::string parent, std::vector<std::string>& params, std::ostringstream& stream) {
+    void XMLWriter::algorithm(const std::string& name, const std::string& parent, std::vector<std::string>& params, std::ostream& stream) {
         stream << xml_algorithm_open << name << xml_algorithm_parent << parent << xml_general_endline;
         for (unsigned int i = 0; i < params.size(); i++) stream << params.at(i);
         stream << xml_algorithm_close;
     }
     
     /**
-     * This formatter writes an XML entry describing an elementary material to the stream that serves as a buffer for the
-     * output file contents.
+     * This formatter writes an XML entry describing an elementary material to the output stream.
      * @param tag The material name; must be unique
      * @param density The density of the element, in g/cm3
      * @param a_number The atomic number of the element
      * @param a_weight The atomic weight of the element, in g/mole
-     * @param stream A reference to the output buffer
+     * @param stream A reference to the output stream
      */
-    void XMLWriter::elementaryMaterial(std::string tag, double density, int a_number, double a_weight, std::ostringstream& stream) {
+    void XMLWriter::elementaryMaterial(std::string tag, double density, int a_number, double a_weight, std::ostream& stream) {
         stream << xml_elementary_material_open << tag << xml_elementary_material_first_inter << tag;
         stream << xml_elementary_material_second_inter << a_number << xml_elementary_material_third_inter;
         stream << a_weight << xml_elementary_material_fourth_inter << density;
@@ -495,16 +488,15 @@ namespace insur {
     }
     
     /**
-     * This formatter writes an XML entry describing a composite material to the stream that serves as a buffer for the
-     * output file contents.
+     * This formatter writes an XML entry describing a composite material to the output stream.
      * @param name The name of the composite material; must be unique
      * @param density The overall density of the composite material, in g/cm3
      * @param method An enumeration value denoting the material mixing method
      * @param es A reference to a list of elementary material names and their fractions in the composite mixture, stored in instances of <i>std::pair</i>
-     * @param stream A reference to the output buffer
+     * @param stream A reference to the output stream
      */
     void XMLWriter::compositeMaterial(std::string name,
-            double density, CompType method, std::vector<std::pair<std::string, double> >& es, std::ostringstream& stream) {
+            double density, CompType method, std::vector<std::pair<std::string, double> >& es, std::ostream& stream) {
         stream << xml_composite_material_open << name << xml_composite_material_first_inter;
         stream << density << xml_composite_material_second_inter ;
         switch (method) {
@@ -526,43 +518,40 @@ namespace insur {
     }
     
     /**
-     * This formatter writes an XML entry describing a logical volume to the stream that serves as a buffer for the
-     * output file contents.
+     * This formatter writes an XML entry describing a logical volume to the output stream.
      * @param name The name of the logical volume; must be unique
      * @param solid The name of the physical shape entry that this logical volume describes further
      * @param material The name of the material that this volume is made of
-     * @param stream A reference to the output buffer
+     * @param stream A reference to the output stream
      */
-    void XMLWriter::logicalPart(std::string name, std::string solid, std::string material, std::ostringstream& stream) {
+    void XMLWriter::logicalPart(const std::string& name, const std::string& solid, const std::string& material, std::ostream& stream) {
         stream << xml_logical_part_open << name << xml_logical_part_first_inter << solid;
         stream << xml_logical_part_second_inter << material << xml_logical_part_close;
     }
     
     /**
-     * This formatter writes an XML entry describing a box shape to the stream that serves as a buffer for the output
-     * file contents.
+     * This formatter writes an XML entry describing a box shape to the output stream.
      * @param name The name of the box shape; must be unique
      * @param dx Half the volume length along x
      * @param dy Half the volume length along y
      * @param dz Half the volume length along z
-     * @param stream A reference to the output buffer
+     * @param stream A reference to the output stream
      */
-    void XMLWriter::box(std::string name, double dx, double dy, double dz, std::ostringstream& stream) {
+    void XMLWriter::box(std::string name, double dx, double dy, double dz, std::ostream& stream) {
         stream << xml_box_open << name << xml_box_first_inter << dx << xml_box_second_inter << dy;
         stream << xml_box_third_inter << dz << xml_box_close;
     }
     
     /**
-     * This formatter writes an XML entry describing an isosceles trapezium shape to the stream that serves as a buffer
-     * for the output file contents.
+     * This formatter writes an XML entry describing an isosceles trapezium shape to the output stream.
      * @param name The name of the trapezium shape; must be unique
      * @param dx Half the volume length along x
      * @param dy Half the volume length along the lower y
      * @param dyy Half the volume length along the upper x
      * @param dz Half the volume length along z
-     * @param stream A reference to the output buffer
+     * @param stream A reference to the output stream
      */
-    void XMLWriter::trapezoid(std::string name, double dx, double dxx, double dy, double dyy, double dz, std::ostringstream& stream) {
+    void XMLWriter::trapezoid(std::string name, double dx, double dxx, double dy, double dyy, double dz, std::ostream& stream) {
         stream << xml_trapezoid_open << name << xml_trapezoid_first_inter << dx;
         stream << xml_trapezoid_second_inter << dxx << xml_trapezoid_third_inter << dy;
         stream << xml_trapezoid_fourth_inter << dyy << xml_trapezoid_fifth_inter << dz;
@@ -573,22 +562,21 @@ namespace insur {
     }
     
     /**
-     * This formatter writes an XML entry describing a tube shape to the stream that serves as a buffer for the output
-     * file contents.
+     * This formatter writes an XML entry describing a tube shape to the output stream.
      * @param name The name of the tube shape; must be unique
      * @param rmin The inner radius of the tube
      * @param rmax The outer radius of the tube
      * @param dz Half the length of the tube
-     * @param stream A reference to the output buffer
+     * @param stream A reference to the output stream
      */
-    void XMLWriter::tubs(std::string name, double rmin, double rmax, double dz, std::ostringstream& stream) {
+    void XMLWriter::tubs(std::string name, double rmin, double rmax, double dz, std::ostream& stream) {
         stream << xml_tubs_open << name << xml_tubs_first_inter << rmin << xml_tubs_second_inter << rmax;
         stream << xml_tubs_third_inter << dz << xml_tubs_close;
     }
     
     /**
-     * This formatter writes an XML entry describing a polycone to the stream that serves as a buffer for the output
-     * file contents. Since the list of points describing the polycone must be in the order in which they will be connected,
+     * This formatter writes an XML entry describing a polycone to the output stream.
+     * Since the list of points describing the polycone must be in the order in which they will be connected,
      * it is provided in two halves: one from the lowest possible starting point on the left side to the topmost point on the
      * same side, the other from the lowest possible starting point on the right side to the topmost point on the same side.
      * The two halved are then combined by looping through the two lists, in ascending order for the first and in descending
@@ -596,10 +584,10 @@ namespace insur {
      * @param name The name of the polycone; must be unique
      * @param rzu A reference to the list of ascending points in <i>r, z</i> coordinates
      * @param rzd A reference to the list of descending points in <i>r, z</i> coordinates
-     * @param stream A reference to the output buffer
+     * @param stream A reference to the output stream
      */
     void XMLWriter::polycone(std::string name, std::vector<std::pair<double, double> >& rzu,
-            std::vector<std::pair<double, double> >& rzd, std::ostringstream& stream) {
+            std::vector<std::pair<double, double> >& rzd, std::ostream& stream) {
         stream << xml_polycone_open << name << xml_polycone_inter;
         for (unsigned int i = 0; i < rzu.size(); i++) {
             stream << xml_rzpoint_open << rzu.at(i).first << xml_rzpoint_inter << rzu.at(i).second << xml_rzpoint_close;
@@ -611,17 +599,17 @@ namespace insur {
     }
     
     /**
-     * This formatter writes an XML entry describing a volume placement in space to the stream that serves as a buffer for the
-     * output file contents. Namely, a child volume is placed at its appropriate position within a parent volume. The coordinate
+     * This formatter writes an XML entry describing a volume placement in space to the output stream.
+     * Namely, a child volume is placed at its appropriate position within a parent volume. The coordinate
      * system used is that of the parent volume, so rotations and translations have to be given in this context.
      * @param parent The name of the logical part describing the parent volume
      * @param child The name of the logical part describing the child volume
      * @param rotref The name of a rotation that will be applied to the child volume; an empty string (the default) means none
      * @param trans A reference to a struct describing a translation that will be applied to the child volume
      * @param copy The number of the child volume copy allowing different copies of the same child to be identified; <i>starts at 1</i>
-     * @param stream A reference to the output buffer
+     * @param stream A reference to the output stream
      */
-    void XMLWriter::posPart(std::string parent, std::string child, std::string rotref, Translation& trans, int copy, std::ostringstream& stream) {
+    void XMLWriter::posPart(const std::string& parent, const std::string& child, const std::string& rotref, Translation& trans, int copy, std::ostream& stream) {
         stream << xml_pos_part_open << copy << xml_pos_part_first_inter << parent;
         stream << xml_pos_part_second_inter << child << xml_general_endline;
         if (!rotref.empty()) stream << xml_pos_part_third_inter << rotref << xml_general_endline;
@@ -630,7 +618,7 @@ namespace insur {
     }
     
     /**
-     * This formatter writes an XML entry describing a rotation in 3D to the stream that servers as a buffer for the output file contents.
+     * This formatter writes an XML entry describing a rotation in 3D to the output stream.
      * @param name The name of the rotation definition; must be unique
      * @param thetax The angle theta with respect to the x-axis
      * @param phix The angle phi with respect to the x-axis
@@ -638,37 +626,35 @@ namespace insur {
      * @param phiy The angle phi with respect to the y-axis
      * @param thetaz The angle theta with respect to the z-axis
      * @param phiz The angle phi with respect to the z-axis
-     * @param stream A reference to the output buffer
+     * @param stream A reference to the output stream
      */
     void XMLWriter::rotation(std::string name, double thetax, double phix,
-            double thetay, double phiy, double thetaz, double phiz, std::ostringstream& stream) {
+            double thetay, double phiy, double thetaz, double phiz, std::ostream& stream) {
         stream << xml_rotation_open << name << xml_rotation_first_inter << thetax << xml_rotation_second_inter << phix;
         stream << xml_rotation_third_inter << thetay << xml_rotation_fourth_inter << phiy << xml_rotation_fifth_inter;
         stream << thetaz << xml_rotation_sixth_inter << phiz << xml_rotation_close;
     }
     
     /**
-     * This formatter writes an XML entry describing a translation in three dimensions to the stream that serves as a buffer for
-     * the output file contents.
+     * This formatter writes an XML entry describing a translation in three dimensions to the output stream.
      * @param x The displacement along the x axis
      * @param y The displacement along the y axis
      * @param z The displacement along the z axis
-     * @param stream A reference to the output buffer
+     * @param stream A reference to the output stream
      */
-    void XMLWriter::translation(double x, double y, double z, std::ostringstream& stream) {
+    void XMLWriter::translation(double x, double y, double z, std::ostream& stream) {
         stream << xml_translation_open << x << xml_translation_first_inter << y << xml_translation_second_inter << z;
         stream << xml_translation_close;
     }
     
     /**
-     * This formatter writes an XML entry describing an additional parameter and the detector parts it is relevant for to the stream
-     * that serves as a buffer for the output file contents.
+     * This formatter writes an XML entry describing an additional parameter and the detector parts it is relevant for to the output stream.
      * @param name The name of the <i>SpecPar</i> block; must be unique
      * @param param The name and value of the additional parameter, given as instances of <i>std::string</i> and packaged into a <i>std::pair</i>
      * @param partsel A list of logical volume names that the additional parameter applies to
-     * @param stream A reference to the output buffer
+     * @param stream A reference to the output stream
      */
-    void XMLWriter::specPar1(std::string name, std::pair<std::string, std::string> param, std::vector<std::string>& partsel, std::ostringstream& stream) {
+    void XMLWriter::specPar1(std::string name, std::pair<std::string, std::string> param, std::vector<std::string>& partsel, std::ostream& stream) {
         stream << xml_spec_par_open << name << xml_general_inter;
 //std::cerr<<" >       "<<xml_spec_par_open << name << xml_general_inter<<std::endl;
         for (unsigned i = 0; i < partsel.size(); i++) {
@@ -685,7 +671,7 @@ namespace insur {
 
 
 
-    void XMLWriter::specPar(std::string name, std::pair<std::string, std::string> param, std::vector<std::string>& partsel, std::ostringstream& stream) {
+    void XMLWriter::specPar(const std::string& name, const std::pair<std::string, std::string>& param, std::vector<std::string>& partsel, std::ostream& stream) {
         stream << xml_spec_par_open << name << xml_general_inter;
         for (unsigned i = 0; i < partsel.size(); i++) {
             stream << xml_spec_par_selector << partsel.at(i) << xml_general_endline;
@@ -700,10 +686,10 @@ namespace insur {
      * @param param The name and value of the additional parameter, given as instances of <i>std::string</i> and packaged into a <i>std::pair</i>
 	 * @param minfo Values of ROC parameters for the module 
      * @param partsel A list of logical volume names that the additional parameter applies to
-     * @param stream A reference to the output buffer
+     * @param stream A reference to the output stream
      */
 
-	void XMLWriter::specParROC(std::vector<std::string>& partsel, std::vector<ModuleROCInfo>& minfo, std::pair<std::string, std::string> param, std::ofstream& stream) {
+	void XMLWriter::specParROC(std::vector<std::string>& partsel, std::vector<ModuleROCInfo>& minfo, std::pair<std::string, std::string> param, std::ostream& stream) {
 		for (unsigned i = 0; i < partsel.size(); i++) {
 			stream <<xml_spec_par_open << partsel.at(i)<<xml_par_tail<<xml_general_inter;
 			stream << xml_spec_par_selector <<partsel.at(i) << xml_general_endline;
@@ -737,10 +723,11 @@ namespace insur {
         int dindex, rindex, mindex, layer = 0;
         int windex = 0;
         std::vector<PathInfo> tblocks;
+        EntryIndex specIndex = indexEntries(specs), blockIndex, tblockIndex;
         blocks.clear();
         //TOB
-        rindex = findEntry(specs, xml_subdet_rod + xml_par_tail);
-        mindex = findEntry(specs, xml_subdet_tobdet + xml_par_tail);
+        rindex = findEntry(specIndex, xml_subdet_rod + xml_par_tail);
+        mindex = findEntry(specIndex, xml_subdet_tobdet + xml_par_tail);
         if ((rindex >= 0) && (mindex >= 0)) {
             // rod loop
             for (unsigned int i = 0; i < specs.at(rindex).partselectors.size(); i++) {
@@ -797,7 +784,7 @@ namespace insur {
                         paths.push_back(prefix + "/" + postfix);
                     }
                 }
-                existing = findEntry(spname, blocks);
+                existing = findEntry(spname, blocks, blockIndex);
                 if (existing != blocks.end()) existing->paths.insert(existing->paths.end(), paths.begin(), paths.end());
                 else {
                     PathInfo pi;
@@ -805,15 +792,16 @@ namespace insur {
                     pi.layer = layer;
                     pi.barrel = true;
                     pi.paths = paths;
+                    blockIndex[spname] = blocks.size();
                     blocks.push_back(pi);
                 }
                 paths.clear();
             }
         }
         //TID
-        dindex = findEntry(specs, xml_subdet_wheel + xml_par_tail);
-        rindex = findEntry(specs, xml_subdet_ring + xml_par_tail);
-        windex = findEntry(specs, xml_subdet_tiddet + xml_par_tail);
+        dindex = findEntry(specIndex, xml_subdet_wheel + xml_par_tail);
+        rindex = findEntry(specIndex, xml_subdet_ring + xml_par_tail);
+        windex = findEntry(specIndex, xml_subdet_tiddet + xml_par_tail);
         if ((dindex >= 0) && (rindex >= 0)) {
             // disc loop
             for (unsigned int i = 0; i < specs.at(dindex).partselectors.size(); i++) {
@@ -882,10 +870,10 @@ namespace insur {
                     }
                 }
                 if (plus) {
-                    existing = findEntry(spname, blocks);
+                    existing = findEntry(spname, blocks, blockIndex);
                 }
                 else {
-                    existing = findEntry(spname, tblocks);
+                    existing = findEntry(spname, tblocks, tblockIndex);
                 }
                 if (plus && (existing != blocks.end())) {
                     existing->paths.insert(existing->paths.end(), paths.begin(), paths.end());
@@ -900,10 +888,12 @@ namespace insur {
                     pi.barrel = false;
                     if (plus) {
                         pi.paths = paths;
+                        blockIndex[spname] = blocks.size();
                         blocks.push_back(pi);
                     }
                     else {
                         pi.paths = tpaths;
+                        tblockIndex[spname] = tblocks.size();
                         tblocks.push_back(pi);
                     }
                 }
@@ -951,34 +941,38 @@ namespace insur {
     }
     
     /**
-     * This is a custom function to find an entry in a collection of <i>SpecParInfo</i> structs
+     * This function indexes a collection of <i>SpecParInfo</i> structs by block name, so that the blocks can be looked up
+     * without scanning the collection every time
      * @param specs The collection of available <i>SpecParInfo</i> instances
+     * @return The index of the first entry of every block name in the collection
+     */
+    XMLWriter::EntryIndex XMLWriter::indexEntries(const std::vector<SpecParInfo>& specs) {
+        EntryIndex index;
+        for (int i = 0; i < (int)(specs.size()); i++) index.insert(std::make_pair(specs.at(i).name, i));
+        return index;
+    }
+
+    /**
+     * This is a custom function to find an entry in a collection of <i>SpecParInfo</i> structs
+     * @param index The index of the collection of available <i>SpecParInfo</i> instances, as built by <i>indexEntries()</i>
      * @param name The requested block name
      * @return The index of the matching entry in the collection; -1 if no such entry exists
      */
-    int XMLWriter::findEntry(std::vector<SpecParInfo>& specs, std::string name) {
-        int index = 0;
-        while (index < (int)(specs.size())) {
-            if (specs.at(index).name.compare(name) == 0) return index;
-            index++;
-        }
-        return -1;
+    int XMLWriter::findEntry(const EntryIndex& index, const std::string& name) {
+        EntryIndex::const_iterator found = index.find(name);
+        return found != index.end() ? found->second : -1;
     }
     
     /**
      * This is a custom function to find the name of a <i>SpecPar</i> block in a nested string representation of a series of such blocks.
      * @param name The name of the requested <i>SpecPar</i> block
      * @param data The collection of available blocks
+     * @param index The positions of the blocks in the collection by name, kept up to date by the caller as blocks are added
      * @return An iterator pointing to the matching entry, or to <i>data.end()</i> if no such entry exists
      */
-    std::vector<PathInfo>::iterator XMLWriter::findEntry(std::string name, std::vector<PathInfo>& data) {
-        std::vector<PathInfo>::iterator result = data.begin();
-        std::vector<PathInfo>::iterator guard = data.end();
-        while (result != guard) {
-            if ((result->block_name).compare(name) == 0) return result;
-            result++;
-        }
-        return result;
+    std::vector<PathInfo>::iterator XMLWriter::findEntry(const std::string& name, std::vector<PathInfo>& data, const EntryIndex& index) {
+        EntryIndex::const_iterator found = index.find(name);
+        return found != index.end() ? data.begin() + found->second : data.end();
     }
 
 }
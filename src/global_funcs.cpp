@@ -1,4 +1,9 @@
 #include <global_funcs.h>
+#include <fstream>
+#include <cctype>
+#include <cstdlib>
+#include <future>
+#include <mutex>
 
 template<typename T> const std::vector<std::string> EnumTraits<T>::data = {};
 
@@ -26,6 +31,102 @@ std::vector<std::string> split(const std::string& str, const std::string& seps,
 }
 
 
+namespace {
+  // The files being read ahead by prefetchText(), until readText() takes them: whether each could be read, and its text
+  typedef std::map<std::string, std::future<std::pair<bool, std::string> > > Prefetches;
+  Prefetches& prefetches() {
+    static Prefetches prefetches_;
+    return prefetches_;
+  }
+  std::mutex& prefetchMutex() {
+    static std::mutex mutex_;
+    return mutex_;
+  }
+
+  bool readWholeFile(const std::string& fileName, std::string& text) {
+    std::ifstream file(fileName.c_str(), std::ios::binary);
+    if (!file) return false;
+    file.seekg(0, std::ios::end);
+    std::streamoff size = file.tellg();
+    if (size < 0) return false;
+    text.resize(size);
+    file.seekg(0, std::ios::beg);
+    if (size > 0) file.read(&text[0], size);
+    return bool(file);
+  }
+}
+
+/**
+ * Reads a whole file, or takes it from prefetchText() if it was read ahead: a prefetched file is taken once, the later
+ * reads go to the file again
+ */
+bool readText(const std::string& fileName, std::string& text) {
+  std::future<std::pair<bool, std::string> > prefetched;
+  {
+    std::lock_guard<std::mutex> lock(prefetchMutex());
+    Prefetches::iterator found = prefetches().find(fileName);
+    if (found != prefetches().end()) {
+      prefetched = std::move(found->second);
+      prefetches().erase(found);
+    }
+  }
+  if (!prefetched.valid()) return readWholeFile(fileName, text);
+  std::pair<bool, std::string> result = prefetched.get();
+  text.swap(result.second);
+  return result.first;
+}
+
+/**
+ * Starts reading a whole file on a thread of its own, for a later readText() of the file to wait for the read rather
+ * than to make it: the files read one after the other are then read concurrently, and the latency of a network file
+ * system is paid once. A file already being prefetched is not read again.
+ */
+void prefetchText(const std::string& fileName) {
+  std::lock_guard<std::mutex> lock(prefetchMutex());
+  if (prefetches().count(fileName)) return;
+  prefetches()[fileName] = std::async(std::launch::async, [fileName]() {
+    std::pair<bool, std::string> result;
+    result.first = readWholeFile(fileName, result.second);
+    return result;
+  });
+}
+
+/**
+ * Waits for the files being prefetched to be read: a process forked afterwards takes them as read, whereas the
+ * threads reading them would not be in it
+ */
+void finishPrefetches() {
+  std::lock_guard<std::mutex> lock(prefetchMutex());
+  for (Prefetches::value_type& prefetch : prefetches()) prefetch.second.wait();
+}
+
+bool nextLine(TextPiece& text, TextPiece& line) {
+  if (text.empty()) return false;
+  const char* stop = std::find(text.begin, text.end, '\n');
+  line.begin = text.begin;
+  line.end = stop;
+  if (line.end != line.begin && line.end[-1] == '\r') line.end--;
+  text.begin = stop == text.end ? stop : stop + 1;
+  return true;
+}
+
+bool nextWord(TextPiece& line, TextPiece& word) {
+  while (line.begin != line.end && isspace((unsigned char)*line.begin)) line.begin++;
+  if (line.empty()) return false;
+  word.begin = line.begin;
+  while (line.begin != line.end && !isspace((unsigned char)*line.begin)) line.begin++;
+  word.end = line.begin;
+  return true;
+}
+
+double wordToDouble(const TextPiece& word) {
+  char buffer[64];
+  size_t size = MIN(word.size(), sizeof(buffer) - 1);
+  std::copy(word.begin, word.begin + size, buffer);
+  buffer[size] = 0;
+  return atof(buffer);
+}
+
 std::string ltrim(std::string str) {
   return str.erase(0, str.find_first_not_of(" \t\n"));
 }
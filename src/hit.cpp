@@ -4,6 +4,7 @@
  */
 
 #include "hit.hh"
+#include "PathCounters.h"
 //#include "module.hh"
 #include <global_constants.h>
 #include <vector>
@@ -63,6 +64,7 @@ Hit::Hit(const Hit& h) {
     orientation_ = h.orientation_;
     objectKind_ = h.objectKind_;
     hitModule_ = h.hitModule_;
+    resolutionFactors_ = h.resolutionFactors_;
     correctedMaterial_ = h.correctedMaterial_;
     myTrack_ = NULL;
     isPixel_ = h.isPixel_;
@@ -114,6 +116,7 @@ Hit::Hit(double myDistance, Module* myModule, HitType activeHitType) {
 void Hit::setHitModule(Module* myModule) {
     if (myModule) {
         hitModule_ = myModule;
+        resolutionFactors_ = myModule->resolutionFactors();
         if (myModule->subdet() == BARREL) {
             orientation_ = Horizontal;
         } else {
@@ -153,13 +156,7 @@ double Hit::getResolutionRphi(double trackR) {
     std::cerr << "ERROR: Hit::getResolutionRphi called on a non-active hit" << std::endl;
     return -1;
   } else {
-    if (hitModule_) {
-      return hitModule_->resolutionEquivalentRPhi(getRadius(), trackR);
-     // if (isTrigger_) return hitModule_->resolutionRPhiTrigger();
-     // else return hitModule_->resolutionRPhi();
-    } else {
-      return myResolutionRphi_;
-    }
+    return measuredResolutionRphi(trackR);
   }
 }
 
@@ -177,13 +174,37 @@ double Hit::getResolutionZ(double trackR) {
     std::cerr << "ERROR: Hit::getResolutionZ called on a non-active hit" << std::endl;
     return -1;
   } else {
-    if (hitModule_) {
-      return hitModule_->resolutionEquivalentZ(getRadius(), trackR, myTrack_->getCotgTheta());
-      //if (isTrigger_) return hitModule_->resolutionYTrigger();
-      //else return hitModule_->resolutionY();
-    } else {
-      return myResolutionY_;
-    }
+    return measuredResolutionZ(trackR);
+  }
+}
+
+/**
+ * The rPhi resolution the hit would be measured with, whatever its kind: for the hits selected as active by a
+ * <i>Track::HitSelection</i>. The module part of it was taken when the module was set, only the track part is computed
+ * @return the hit's local resolution
+ */
+double Hit::measuredResolutionRphi(double trackR) {
+  if (hitModule_) {
+    return resolutionFactors_.equivalentRPhi(getRadius(), trackR);
+   // if (isTrigger_) return hitModule_->resolutionRPhiTrigger();
+   // else return hitModule_->resolutionRPhi();
+  } else {
+    return myResolutionRphi_;
+  }
+}
+
+/**
+ * The y resolution the hit would be measured with, whatever its kind: for the hits selected as active by a
+ * <i>Track::HitSelection</i>
+ * @return the hit's local resolution
+ */
+double Hit::measuredResolutionZ(double trackR) {
+  if (hitModule_) {
+    return resolutionFactors_.equivalentZ(getRadius(), trackR, myTrack_->getCotgTheta());
+    //if (isTrigger_) return hitModule_->resolutionYTrigger();
+    //else return hitModule_->resolutionY();
+  } else {
+    return myResolutionY_;
   }
 }
 
@@ -235,13 +256,15 @@ double Hit::getD() {
  */
 Track::Track() {
     theta_ = 0;
+    sorted_ = true;
 }
 
 /**
- * The copy constructor creates a deep copy of the vector of hits.
+ * The copy constructor creates a deep copy of the hits.
  */
 Track::Track(const Track& t) {
   theta_ = t.theta_;
+  phi_ = t.phi_;
   cotgTheta_ = t.cotgTheta_;
   eta_ = t.eta_;
   correlations_.ResizeTo(t.correlations_);
@@ -258,11 +281,7 @@ Track::Track(const Track& t) {
   deltaCtgTheta_ = t.deltaCtgTheta_;
   deltaZ0_ = t.deltaZ0_;
   deltaP_ = t.deltaP_;
-  vector<Hit*>::const_iterator iter, guard = t.hitV_.end();
-  for (iter = t.hitV_.begin(); iter != guard; iter++) {
-    Hit* h = new Hit(*(*iter));
-    addHit(h);
-  }
+  copyHits(t);
   transverseMomentum_ = t.transverseMomentum_;
   tags_ = t.tags_;
 }
@@ -275,6 +294,7 @@ Track& Track::operator= (const Track &t) {
   
   // do the copy
   theta_ = t.theta_;
+  phi_ = t.phi_;
   cotgTheta_ = t.cotgTheta_;
   eta_ = t.eta_;
   correlations_.ResizeTo(t.correlations_);
@@ -291,11 +311,7 @@ Track& Track::operator= (const Track &t) {
   deltaCtgTheta_ = t.deltaCtgTheta_;
   deltaZ0_ = t.deltaZ0_;
   deltaP_ = t.deltaP_;
-  vector<Hit*>::const_iterator iter, guard = t.hitV_.end();
-  for (iter = t.hitV_.begin(); iter != guard; iter++) {
-    Hit* h = new Hit(*(*iter));
-    addHit(h);
-  }
+  copyHits(t);
   transverseMomentum_ = t.transverseMomentum_;
   tags_ = t.tags_;
  
@@ -303,6 +319,68 @@ Track& Track::operator= (const Track &t) {
   return *this;
 }
 
+/**
+ * The move constructor takes over the hits of the original track, which is left without hits.
+ */
+Track::Track(Track&& t) noexcept {
+  *this = std::move(t);
+}
+
+/**
+ * The move assignment takes over the hits of the original track without copying them: the blocks
+ * they are stored in change owner, so the hit pointers stay valid and only need to point back to the new track.
+ * The resolution matrices are still copied, as ROOT matrices cannot be moved.
+ */
+Track& Track::operator= (Track&& t) noexcept {
+  if (this == &t)
+    return *this;
+
+  theta_ = t.theta_;
+  phi_ = t.phi_;
+  cotgTheta_ = t.cotgTheta_;
+  eta_ = t.eta_;
+  correlations_.ResizeTo(t.correlations_);
+  correlations_ = t.correlations_;
+  covariances_.ResizeTo(t.covariances_);
+  covariances_ = t.covariances_;
+  correlationsRZ_.ResizeTo(t.correlationsRZ_);
+  correlationsRZ_ = t.correlationsRZ_;
+  covariancesRZ_.ResizeTo(t.covariancesRZ_);
+  covariancesRZ_ = t.covariancesRZ_;
+  deltarho_ = t.deltarho_;
+  deltaphi_ = t.deltaphi_;
+  deltad_ = t.deltad_;
+  deltaCtgTheta_ = t.deltaCtgTheta_;
+  deltaZ0_ = t.deltaZ0_;
+  deltaP_ = t.deltaP_;
+  hitV_ = std::move(t.hitV_);
+  hitBlocks_ = std::move(t.hitBlocks_);
+  sorted_ = t.sorted_;
+  t.hitV_.clear();
+  t.hitBlocks_.clear();
+  t.sorted_ = true;
+  for (auto h : hitV_) h->setTrack(this);
+  transverseMomentum_ = t.transverseMomentum_;
+  tags_ = std::move(t.tags_);
+
+  return *this;
+}
+
+/**
+ * Replaces the hits of the track with copies of those of another track, all stored in a single block.
+ * @param t The track to copy the hits from
+ */
+void Track::copyHits(const Track& t) {
+  hitV_.clear();
+  hitBlocks_.clear();
+  sorted_ = true;
+  hitV_.reserve(t.hitV_.size());
+  hitBlocks_.emplace_back();
+  hitBlocks_.back().reserve(t.hitV_.size());
+  vector<Hit*>::const_iterator iter, guard = t.hitV_.end();
+  for (iter = t.hitV_.begin(); iter != guard; iter++) addHit(*(*iter));
+}
+
 /**
  * Gives the number of active hits
  * @param usePixels take into account also pixel hits
@@ -369,39 +447,21 @@ std::vector<double> Track::hadronActiveHitsProbability(bool usePixels /*= false
 
 /**
  * Gives the probability of having a given number of "clean" hits
- * for nuclear-interacting particles
+ * for nuclear-interacting particles. A hadron which interacts loses all
+ * the hits after the interaction, so this is the probability of the
+ * nHits-th active hit, as listed by hadronActiveHitsProbability(bool):
+ * several requirements on the same track should read them from that list,
+ * which is made in a single pass over the hits
  * @param nHits the required number of clean hits
  * @param usePixels take into account also pixel hits
- * @return a vector with the probabilities of hits
+ * @return the probability of at least nHits clean hits
  */
 double Track::hadronActiveHitsProbability(int nHits, bool usePixels /* = false */ ) {
-  std::vector<Hit*>::iterator hitIt;
-  double probability=1;
-  Hit* myHit;
-  RILength myMaterial;
-  int goodHits=0;
-  sort();
-  for (hitIt=hitV_.begin();
-       hitIt!=hitV_.end();
-       ++hitIt) {
-    myHit=(*hitIt);
-    if (myHit) {
-      if ( (usePixels) || (!myHit->isPixel()) ) {
-	if (myHit->getObjectKind()==Hit::Active)
-	  goodHits++;
-      }
-      // If I reached the requested number of hits
-      if (goodHits==nHits) 
-	return probability;
-      // Decrease the probability that the
-      // next hit is a clean one
-      myMaterial = myHit->getCorrectedMaterial();
-      probability /= exp(myMaterial.interaction);
-    }
-  }
-  // If I did not reach the requested number of active hits
+  if (nHits<=0) return 1;
+  std::vector<double> probabilities = hadronActiveHitsProbability(usePixels);
+  // If the track does not have the requested number of active hits
   // The probability is zero
-  return 0;
+  return nHits<=int(probabilities.size()) ? probabilities[nHits-1] : 0;
 }
 
 
@@ -418,17 +478,9 @@ void Track::removeMaterial() {
 }
 
 /**
- * The destructor makes sure that the hit vector is cleaned up properly.
+ * Nothing to do for the destructor, as the hits are stored by value in the track.
  */
-Track::~Track() {
-    std::vector<Hit*>::iterator hitIt;
-    for (hitIt=hitV_.begin(); hitIt!=hitV_.end(); hitIt++) {
-        if ((*hitIt)!=NULL) {
-            delete (*hitIt);
-        }
-    }
-    hitV_.clear();
-}
+Track::~Track() {}
 
 /**
  * Setter for the track azimuthal angle.
@@ -457,10 +509,18 @@ double Track::setPhi(double& newPhi) {
 
 /**
  * Adds a new hit to the track
- * @param newHit a pointer to the new hit to be added
+ * @param hit the hit to be added: a copy of it is stored in the track
+ * @return a pointer to the hit as stored in the track
  */
 // TODO: maybe updateradius is not necessary here. To be checked
-Hit* Track::addHit(Hit* newHit) {
+Hit* Track::addHit(const Hit& hit) {
+  if (hitBlocks_.empty() || hitBlocks_.back().size() == hitBlocks_.back().capacity()) {
+    hitBlocks_.emplace_back();
+    hitBlocks_.back().reserve(hitBlockSize);
+  }
+  hitBlocks_.back().push_back(hit); // never reallocates, the hits already stored keep their address
+  Hit* newHit = &hitBlocks_.back().back();
+  if (!hitV_.empty() && sortSmallerR(newHit, hitV_.back())) sorted_ = false;
   hitV_.push_back(newHit); 
   if (newHit->getHitModule() != NULL) {
     tags_.insert(newHit->getHitModule()->trackingTags.begin(), newHit->getHitModule()->trackingTags.end()); 
@@ -471,10 +531,80 @@ Hit* Track::addHit(Hit* newHit) {
 }
 
 /**
- * This function sorts the hits in the internal vector by their distance to the z-axis.
+ * This function sorts the hits in the internal vector by their distance to the z-axis. The hits come in runs already
+ * sorted, those of a subdetector or of the inactive elements: the runs are merged one after the other, in the same
+ * order as a stable sort would give, unless there are so many of them that sorting is cheaper. Once sorted, the track
+ * stays so until a hit is added out of order, so the later calls do nothing.
  */
 void Track::sort() {
-    std::stable_sort(hitV_.begin(), hitV_.end(), sortSmallerR);
+  if (sorted_) return;
+  std::vector<std::vector<Hit*>::iterator> runEnds;
+  for (auto it = hitV_.begin() + 1; it != hitV_.end(); ++it) {
+    if (sortSmallerR(*it, *(it - 1))) runEnds.push_back(it);
+  }
+  runEnds.push_back(hitV_.end());
+  if (runEnds.size() * runEnds.size() > hitV_.size()) std::stable_sort(hitV_.begin(), hitV_.end(), sortSmallerR);
+  else {
+    for (size_t i = 1; i < runEnds.size(); i++) std::inplace_merge(hitV_.begin(), runEnds[i - 1], runEnds[i], sortSmallerR);
+  }
+  sorted_ = true;
+}
+
+/**
+ * Gives the square of the multiple scattering angle on a layer of material
+ * @param radiation the material thickness in units of radiation length
+ * @param pt the transverse momentum of the track in GeV
+ * @return the variance of the scattering angle, or zero if there is no material
+ */
+double Track::multipleScatteringSq(double radiation, double pt) {
+  if (radiation <= 0) return 0;
+  return (13.6 * 13.6) / (1000 * 1000 * pt * pt) * radiation * (1 + 0.038 * log(radiation)) * (1 + 0.038 * log(radiation));
+}
+
+/**
+ * Computes D^T V^-1 D, where D are the derivatives of the active hits positions with respect to the track parameters and
+ * V is their correlation matrix: the hit resolutions plus the scattering accumulated on the inner hits. The scattering
+ * displacement is a random walk along the track, so V^-1 is applied with a Kalman filter on the (displacement, slope)
+ * state instead of inverting the dense matrix: same result as the matrix inversion in O(n) rather than O(n^3).
+ * @param points the hits of the track, ordered from the innermost outwards
+ * @param nPars the number of track parameters (at most 3)
+ * @param result the nPars x nPars matrix to be filled
+ * @return false if the correlation matrix is singular
+ */
+bool Track::scatteringNormalMatrix(const std::vector<FitPoint>& points, int nPars, TMatrixT<double>& result) {
+  double xHat[3] = { 0, 0, 0 }, sHat[3] = { 0, 0, 0 }; // expected displacement and slope for each column of D
+  double pxx = 0, pxs = 0, pss = 0; // covariance of the state, common to all the columns
+  bool sane = false;
+  result.Zero();
+  for (unsigned int k = 0; k < points.size(); k++) {
+    const FitPoint& p = points[k];
+    if (k > 0) {
+      double dr = p.position - points[k-1].position;
+      for (int a = 0; a < nPars; a++) xHat[a] += dr * sHat[a];
+      pxx += dr * (2 * pxs + dr * pss);
+      pxs += dr * pss;
+    }
+    if (p.active) {
+      double s = pxx + p.resolutionSq;
+      if (s <= 0) return false;
+      double nu[3];
+      for (int a = 0; a < nPars; a++) nu[a] = p.derivatives[a] - xHat[a];
+      for (int a = 0; a < nPars; a++)
+        for (int b = 0; b < nPars; b++)
+          result(a, b) += nu[a] * nu[b] / s;
+      double kx = pxx / s, ks = pxs / s;
+      for (int a = 0; a < nPars; a++) {
+        xHat[a] += kx * nu[a];
+        sHat[a] += ks * nu[a];
+      }
+      pss -= ks * pxs;
+      pxs -= kx * pxs;
+      pxx -= kx * pxx;
+      sane = true;
+    }
+    pss += p.scatteringSq;
+  }
+  return sane;
 }
 
 /**
@@ -559,29 +689,64 @@ void Track::computeCorrelationMatrix() {
 }
 
 /**
- * Compute the covariance matrices of the track hits from a series of previously calculated correlation matrices.
- * @param A reference to the map of correlation matrices per energy  that serves as the value source for the computation
+ * Collects the momentum-independent part of the fit points of the track: kind, position along the track and derivatives
+ * of the hits, plus the scattering angles for a 1 GeV track (they scale with 1/pT^2).
+ * @param rz true for the fit in the r-z plane, false for the r-phi plane
+ * @param selection the hits taken as active, and whether their material is counted
+ * @return the fit points, one per hit
  */
-void Track::computeCovarianceMatrix() {
-  unsigned int offset = 0;
-  unsigned int nhits = hitV_.size();
-  int n = correlations_.GetNrows();
-  TMatrixT<double> C(correlations_); // Local copy to be inverted
-  TMatrixT<double> diffsT(3, n);
-  TMatrixT<double> diffs(n, 3);
-  covariances_.ResizeTo(3, 3);
-
-  // set up partial derivative matrices diffs and diffsT
-  for (unsigned int i = 0; i < nhits; i++) {
-    if (hitV_.at(i)->getObjectKind()  == Hit::Active) {
-      diffs(i - offset, 0) = 0.5 * hitV_.at(i)->getRadius() * hitV_.at(i)->getRadius();
-      diffs(i - offset, 1) = - hitV_.at(i)->getRadius();
-      diffs(i - offset, 2) = 1;
+std::vector<Track::FitPoint> Track::fitGeometry(bool rz, const HitSelection& selection) const {
+  std::vector<FitPoint> points(hitV_.size());
+  for (unsigned int i = 0; i < hitV_.size(); i++) {
+    FitPoint& p = points[i];
+    Hit* h = hitV_.at(i);
+    p.active = selection.active[i];
+    // in r-z already divided by sin^2: see computeCorrelationMatrixRZ()
+    p.scatteringSq = selection.material ? multipleScatteringSq(h->getCorrectedMaterial().radiation, 1.) : 0;
+    if (rz) {
+      p.position = h->getDistance();
+      // partial derivatives for x = p[0] * y + p[1]
+      p.derivatives[0] = h->getRadius();
+      p.derivatives[1] = 1;
+    } else {
+      p.position = h->getRadius();
+      p.derivatives[0] = 0.5 * h->getRadius() * h->getRadius();
+      p.derivatives[1] = - h->getRadius();
+      p.derivatives[2] = 1;
     }
-    else offset++;
   }
-  diffsT.Transpose(diffs);
-  covariances_ = diffsT * C.Invert() * diffs;
+  return points;
+}
+
+/**
+ * Completes the fit points with the momentum-dependent part: scattering angles and hit resolutions.
+ * @param geometry the momentum-independent fit points, as given by <i>fitGeometry()</i>
+ * @param rz true for the fit in the r-z plane, false for the r-phi plane
+ * @param pt the transverse momentum of the track in GeV
+ * @param points the fit points to be filled
+ */
+void Track::fitMomentum(const std::vector<FitPoint>& geometry, bool rz, double pt, std::vector<FitPoint>& points) const {
+  double curvatureR = pt2radius(pt, insur::magnetic_field);
+  points = geometry;
+  for (unsigned int i = 0; i < points.size(); i++) {
+    FitPoint& p = points[i];
+    p.scatteringSq /= pt * pt;
+    if (!p.active) continue;
+    double prec = rz ? hitV_.at(i)->measuredResolutionZ(curvatureR) : hitV_.at(i)->measuredResolutionRphi(curvatureR); // if Bmod = getResoX natural
+    p.resolutionSq = prec * prec;
+  }
+}
+
+/**
+ * Compute the covariance matrix of the track parameters in the r-phi plane. The hit correlation matrix is not built:
+ * its inverse is applied through the recursive fit of <i>scatteringNormalMatrix()</i>.
+ * @param points the fit points of the track in the r-phi plane
+ */
+void Track::computeCovarianceMatrix(const std::vector<FitPoint>& points) {
+  covariances_.ResizeTo(3, 3);
+  if (!scatteringNormalMatrix(points, 3, covariances_)) {
+    std::cerr << "WARNING: This is embarassing and it should be handled somehow" << std::endl;
+  }
 }
 
 /**
@@ -673,90 +838,126 @@ void Track::computeCorrelationMatrixRZ() {
 }
 
 /**
- * Compute the covariance matrices of the track hits from a series of previously calculated correlation matrices.
- * @param A reference to the map of correlation matrices per energy  that serves as the value source for the computation
+ * Compute the covariance matrix of the track parameters in the r-z plane. As for the r-phi plane the hit correlation
+ * matrix is not built, the multiple scattering is accounted for by the recursive fit.
+ * @param points the fit points of the track in the r-z plane
  */
-void Track::computeCovarianceMatrixRZ() {
-  unsigned int offset = 0;
-  unsigned int nhits = hitV_.size();
-  int n = correlationsRZ_.GetNrows();
-  TMatrixT<double> C(correlationsRZ_); // Local copy to be inverted
-  TMatrixT<double> diffsT(2, n);
-  TMatrixT<double> diffs(n, 2);
-  covariancesRZ_.ResizeTo(2,2);
-  
-  // set up partial derivative matrices diffs and diffsT
-  for (unsigned int i = 0; i < nhits; i++) {
-    if (hitV_.at(i)->getObjectKind()  == Hit::Active) {
-      // partial derivatives for x = p[0] * y + p[1]
-      diffs(i - offset, 0) = hitV_.at(i)->getRadius();
-      diffs(i - offset, 1) = 1;
-    }
-    else offset++;
-    }
-  diffsT.Transpose(diffs);
-  // Invert the C matrix
-  // TODO: check if this matrix can be inverted
-  C.Invert();
-  // compute covariancesRZ_ from diffsT, the correlation matrix and diffs
-  covariancesRZ_ = diffsT * C * diffs;
+void Track::computeCovarianceMatrixRZ(const std::vector<FitPoint>& points) {
+  covariancesRZ_.ResizeTo(2, 2);
+  if (!scatteringNormalMatrix(points, 2, covariancesRZ_)) {
+    std::cerr << "WARNING: this should be handled properly" << std::endl;
+  }
 }
 
 
 /**
  * Calculate the errors of the track curvature radius, the propagation direction at the point of closest approach and the
- * distance of closest approach to the origin, all of them for each momentum of the test particle.
- * @param momentaList A reference of the list of energies that the errors should be calculated for
+ * distance of closest approach to the origin, for the current transverse momentum of the track.
  */
 void Track::computeErrors() {
-  deltarho_ = 0 ;
-  deltaphi_ = 0 ;
-  deltad_ = 0 ;
-  deltaCtgTheta_ = 0 ;
-  deltaZ0_ = 0 ;
-  deltaP_ = 0 ;
-
-  // Compute the relevant matrices (RZ plane)
-  computeCorrelationMatrixRZ();
-  computeCovarianceMatrixRZ();
-  TMatrixT<double> dataRz(covariancesRZ_); // Local copy to be inverted
+  setErrors(computeErrors(std::vector<double>(1, transverseMomentum_)).front());
+}
+
+/**
+ * Calculate the track errors for a series of transverse momenta. The geometry of the fit is collected once,
+ * only the scattering angles and the hit resolutions are updated for each momentum. The track itself is not modified.
+ * @param transverseMomenta A reference of the list of transverse momenta (in GeV) that the errors should be calculated for
+ * @return the errors, one per momentum, in the same order
+ */
+std::vector<Track::Errors> Track::computeErrors(const std::vector<double>& transverseMomenta) const {
+  return computeErrors(transverseMomenta, selectActive());
+}
+
+/**
+ * Calculate the track errors for a series of transverse momenta, as if only the selected hits were active, and without
+ * any material if the selection says so: the same errors as those of a copy of the track whose hits were changed
+ * accordingly, without copying the track nor changing its hits
+ * @param transverseMomenta A reference of the list of transverse momenta (in GeV) that the errors should be calculated for
+ * @param selection The hits taken as active, one flag per hit in the order of the hits
+ * @return the errors, one per momentum, in the same order
+ */
+std::vector<Track::Errors> Track::computeErrors(const std::vector<double>& transverseMomenta, const HitSelection& selection) const {
+  timePathScope("Track::computeErrors");
+  std::vector<Errors> result;
+  result.reserve(transverseMomenta.size());
+  std::vector<FitPoint> geometryRZ = fitGeometry(true, selection);
+  std::vector<FitPoint> geometry = fitGeometry(false, selection);
+  countPathValue("Track::computeErrors RZ matrix size", geometryRZ.size());
+  countPathValue("Track::computeErrors R-phi matrix size", geometry.size());
+  countPathValue("Track::computeErrors momenta", transverseMomenta.size());
+  std::vector<FitPoint> points;
+  Track fit; // scratch track holding the covariance matrices
   double err;
-  dataRz = dataRz.Invert();
 
-  if (dataRz(0, 0) >= 0) err = sqrt(dataRz(0, 0));
-  else err = -1;
-  deltaCtgTheta_ = err;
+  for (double pt : transverseMomenta) {
+    Errors e;
+    e.transverseMomentum = pt;
+
+    // Compute the relevant matrices (RZ plane)
+    fitMomentum(geometryRZ, true, pt, points);
+    fit.computeCovarianceMatrixRZ(points);
+    e.covariancesRZ.ResizeTo(fit.covariancesRZ_);
+    e.covariancesRZ = fit.covariancesRZ_;
+    TMatrixT<double> dataRz(fit.covariancesRZ_); // Local copy to be inverted
+    dataRz = dataRz.Invert();
+
+    if (dataRz(0, 0) >= 0) err = sqrt(dataRz(0, 0));
+    else err = -1;
+    e.deltaCtgTheta = err;
+
+    if (dataRz(1, 1) >= 0) err = sqrt(dataRz(1, 1));
+    else err = -1;
+    e.deltaZ0 = err;
+
+    // rPhi plane
+    fitMomentum(geometry, false, pt, points);
+    fit.computeCovarianceMatrix(points);
+    e.covariances.ResizeTo(fit.covariances_);
+    e.covariances = fit.covariances_;
+
+    // calculate delta rho, delta phi and delta d maps from covariances_ matrix
+    TMatrixT<double> data(fit.covariances_);
+    data = data.Invert();
+    if (data(0, 0) >= 0) err = sqrt(data(0, 0));
+    else err = -1;
+    e.deltaRho = err;
+    if (data(1, 1) >= 0) err = sqrt(data(1, 1));
+    else err = -1;
+    e.deltaPhi = err;
+    if (data(2, 2)) err = sqrt(data(2, 2));
+    else err = -1;
+    e.deltaD = err;
+
+    // Combining into p measurement
+    double ptErr = e.deltaRho;
+    double R = pt / insur::magnetic_field / 0.3 * 1E3; // curvature radius in mm
+    ptErr *= R; // fractional dpT/pT = dRho / Rho = dRho * R
+    // dp/p = dp_t/p_t + A / (1+A^2) * dA // with A = ctg(theta)
+    // dp/p = dp_t/p_t + sin(theta)*cos(theta) //
+    // double A = 1 / tan(theta_);
+    // double pErr = ptErr + A / (1+A*A) * ctgThetaErr;
+    e.deltaP = ptErr + sin(theta_) * cos(theta_) * e.deltaCtgTheta;
+    result.push_back(e);
+  }
+  return result;
+}
 
-  if (dataRz(1, 1) >= 0) err = sqrt(dataRz(1, 1));
-  else err = -1;
-  deltaZ0_ = err;
-  
-  // rPhi plane
-  computeCorrelationMatrix();
-  computeCovarianceMatrix();
-
-  // calculate delta rho, delta phi and delta d maps from covariances_ matrix
-  TMatrixT<double> data(covariances_);
-  data = data.Invert();
-  if (data(0, 0) >= 0) err = sqrt(data(0, 0));
-  else err = -1;
-  deltarho_ = err;
-  if (data(1, 1) >= 0) err = sqrt(data(1, 1));
-  else err = -1;
-  deltaphi_ = err;
-  if (data(2, 2)) err = sqrt(data(2, 2));
-  else err = -1;
-  deltad_ = err;
-
-  // Combining into p measurement
-  double ptErr = deltarho_;
-  double R = transverseMomentum_ / insur::magnetic_field / 0.3 * 1E3; // curvature radius in mm
-  ptErr *= R; // fractional dpT/pT = dRho / Rho = dRho * R
-  // dp/p = dp_t/p_t + A / (1+A^2) * dA // with A = ctg(theta)
-  // dp/p = dp_t/p_t + sin(theta)*cos(theta) //
-  // double A = 1 / tan(theta_);
-  // double pErr = ptErr + A / (1+A*A) * ctgThetaErr;
-  deltaP_ = ptErr + sin(theta_) * cos(theta_) * deltaCtgTheta_;
+/**
+ * Sets the track momentum and errors to one of the results of <i>computeErrors()</i>
+ * @param e the errors to be assigned to the track
+ */
+void Track::setErrors(const Errors& e) {
+  transverseMomentum_ = e.transverseMomentum;
+  covariancesRZ_.ResizeTo(e.covariancesRZ);
+  covariancesRZ_ = e.covariancesRZ;
+  covariances_.ResizeTo(e.covariances);
+  covariances_ = e.covariances;
+  deltarho_ = e.deltaRho;
+  deltaphi_ = e.deltaPhi;
+  deltad_ = e.deltaD;
+  deltaCtgTheta_ = e.deltaCtgTheta;
+  deltaZ0_ = e.deltaZ0;
+  deltaP_ = e.deltaP;
 }
 
 /**
@@ -765,6 +966,7 @@ void Track::computeErrors() {
 void Track::printErrors() {
     std::cout << "Overview of track errors:" << std::endl;
     std::cout << "Hit correlation matrix: " << std::endl;
+    computeCorrelationMatrix(); // only needed here: the errors are computed without it
     correlations_.Print();
     std::cout << "Covariance matrix: " << std::endl;
     covariances_.Print();
@@ -791,74 +993,115 @@ void Track::print() {
 }
 
 /**
- * Changes some active hits into inactive
- * according to the efficiency 
- * @param efficiency the modules active fraction
- * @param alsoPixel true if the efficiency removal applies to the pixel hits also
+ * Makes all non-trigger hits inactive
  */
-void Track::addEfficiency(double efficiency, bool pixel /* = false */ ) {
-  for (std::vector<Hit*>::iterator it = hitV_.begin(); it!=hitV_.end(); ++it) {
-    if ((*it)->getObjectKind() == Hit::Active) {
-      if ((pixel)&&(*it)->isPixel()) {
-	if ((double(random())/RAND_MAX) > efficiency) { // This hit is LOST
-	  (*it)->setObjectKind(Hit::Inactive);
-	}
-      }
-      if ((!pixel)&&(!(*it)->isPixel())) {
-	if ((double(random())/RAND_MAX) > efficiency) { // This hit is LOST
-	  (*it)->setObjectKind(Hit::Inactive);
-	}
-      }
+void Track::keepTriggerOnly() {
+  keepSelected(selectTrigger());
+}
+
+
+void Track::keepTaggedOnly(const string& tag) {
+  keepSelected(selectTagged(tag));
+}
+
+/**
+ * Selects the hits which are active
+ * @return the selection, with the material counted
+ */
+Track::HitSelection Track::selectActive() const {
+  HitSelection selection;
+  selection.material = true;
+  selection.active.reserve(hitV_.size());
+  for (auto h : hitV_) selection.active.push_back(h->getObjectKind() == Hit::Active);
+  return selection;
+}
+
+/**
+ * Selects the active hits which are trigger hits: those of the pt modules, and those without a module
+ * @return the selection, with the material counted
+ */
+Track::HitSelection Track::selectTrigger() const {
+  HitSelection selection = selectActive();
+  for (unsigned int i = 0; i < hitV_.size(); i++) {
+    if (!selection.active[i]) continue;
+    if (hitV_[i]->isPixel()) selection.active[i] = false;
+    else {
+      Module* myModule = hitV_[i]->getHitModule();
+      if (myModule && myModule->sensorLayout() != PT) selection.active[i] = false;
     }
   }
+  return selection;
 }
 
 /**
- * Makes all non-trigger hits inactive
+ * Selects the hits of the modules with the given tracking tag, whatever their kind, and the active hits without a module
+ * @param tag the tracking tag
+ * @return the selection, with the material counted
  */
-void Track::keepTriggerOnly() {
-  // int iRemove=0;
-  for (std::vector<Hit*>::iterator it = hitV_.begin(); it!=hitV_.end(); ++it) {
-    // if (debugRemoval) std::cerr << "Hit number "
-    //	                           << iRemove++ << ": ";
-    // if (debugRemoval) std::cerr << "r = " << (*it)->getRadius() << ", ";
-    // if (debugRemoval) std::cerr << "d = " << (*it)->getDistance() << ", ";
-    if ((*it)->getObjectKind() == Hit::Active) {
-      // if (debugRemoval) std::cerr << "active ";
-      if ((*it)->isPixel()) {
-	// if (debugRemoval) std::cerr << "pixel: removed";
-	(*it)->setObjectKind(Hit::Inactive);
-      } else {
-	Module* myModule = (*it)->getHitModule();
-	if (myModule) {
-	  // if (debugRemoval) std::cerr << "module ";
-	  if (myModule->sensorLayout() != PT) {
-	    // if (debugRemoval) std::cerr << "non-pt: removed";
-	    (*it)->setObjectKind(Hit::Inactive);
-	  } else {
-	    // if (debugRemoval) std::cerr << "pt: kept";
-	  }
-	} else {
-	  // if (debugRemoval) std::cerr << "active without module: kept";
-	}
-      }
-    } else {
-      // if (debugRemoval) std::cerr << "inactive";
-    }
-    // if (debugRemoval) std::cerr << std::endl;
+Track::HitSelection Track::selectTagged(const string& tag) const {
+  HitSelection selection = selectActive();
+  for (unsigned int i = 0; i < hitV_.size(); i++) {
+    Module* m = hitV_[i]->getHitModule();
+    if (!m) continue;
+    selection.active[i] = std::count_if(m->trackingTags.begin(), m->trackingTags.end(), [&tag](const string& s){ return s == tag; }) > 0;
   }
+  return selection;
+}
 
-  // debugRemoval=false;
+/**
+ * Draws which hits are lost according to the efficiency, all at once: one number per hit, in the order of the hits,
+ * so that the hits lost only depend on the dice and not on which hits are selected afterwards
+ * @param efficiency the active fraction of the modules which are not pixel modules
+ * @param pixelEfficiency the active fraction of the pixel modules
+ * @param die the random stream of the track
+ * @return the mask, one flag per hit, false where the hit is lost
+ */
+std::vector<bool> Track::efficiencyMask(double efficiency, double pixelEfficiency, insur::CounterRandom& die) const {
+  std::vector<bool> mask(hitV_.size(), true);
+  if (efficiency == 1 && pixelEfficiency == 1) return mask;
+  for (unsigned int i = 0; i < hitV_.size(); i++) {
+    double draw = die.uniform();
+    if (draw > (hitV_[i]->isPixel() ? pixelEfficiency : efficiency)) mask[i] = false; // This hit is LOST
+  }
+  return mask;
 }
 
+/**
+ * Drops the selected hits the efficiency mask has lost, as if they were inactive
+ * @param selection the selection to be changed
+ * @param mask the mask of the hits, as <i>efficiencyMask()</i> draws it
+ */
+void Track::addEfficiency(HitSelection& selection, const std::vector<bool>& mask) const {
+  for (unsigned int i = 0; i < hitV_.size(); i++) {
+    if (!mask[i]) selection.active[i] = false;
+  }
+}
 
-void Track::keepTaggedOnly(const string& tag) {
-  for (auto h : hitV_) {
-    Module* m = h->getHitModule();
-    if (!m) continue;
-    if (std::count_if(m->trackingTags.begin(), m->trackingTags.end(), [&tag](const string& s){ return s == tag; })) h->setObjectKind(Hit::Active);
-    else h->setObjectKind(Hit::Inactive);
+/**
+ * Counts the selected hits, as <i>nActiveHits()</i> counts the active ones
+ * @param selection the selected hits
+ * @param usePixels true if the pixel hits are counted
+ * @param useIP true if the IP constraint is counted
+ * @return the number of hits
+ */
+int Track::nActiveHits(const HitSelection& selection, bool usePixels /* = false */, bool useIP /* = true */) const {
+  int result = 0;
+  for (unsigned int i = 0; i < hitV_.size(); i++) {
+    if (selection.active[i] && (useIP || !hitV_[i]->isIP()) && (usePixels || !hitV_[i]->isPixel())) result++;
   }
+  return result;
+}
+
+/**
+ * Makes the selected hits active and the other active hits inactive, and removes the material if the selection has none
+ * @param selection the selected hits
+ */
+void Track::keepSelected(const HitSelection& selection) {
+  for (unsigned int i = 0; i < hitV_.size(); i++) {
+    if (selection.active[i]) hitV_[i]->setObjectKind(Hit::Active);
+    else if (hitV_[i]->getObjectKind() == Hit::Active) hitV_[i]->setObjectKind(Hit::Inactive);
+  }
+  if (!selection.material) removeMaterial();
 }
 
 /**
@@ -882,17 +1125,17 @@ void Track::addIPConstraint(double dr, double dz) {
   // This modeling of the IP constraint waas validated:
   // By placing dr = 0.5 mm and dz = 1 mm one obtains
   // sigma(d0) = 0.5 mm and sigma(z0) = 1 mm
-  Hit* newHit = new Hit(dr);
-  newHit->setIP(true);
+  Hit newHit(dr);
+  newHit.setIP(true);
   RILength emptyMaterial;
   emptyMaterial.radiation = 0;
   emptyMaterial.interaction = 0;
-  newHit->setPixel(false);
-  newHit->setCorrectedMaterial(emptyMaterial);
-  newHit->setOrientation(Hit::Horizontal);
-  newHit->setObjectKind(Hit::Active);
-  newHit->setResolutionRphi(dr);
-  newHit->setResolutionY(dz);
+  newHit.setPixel(false);
+  newHit.setCorrectedMaterial(emptyMaterial);
+  newHit.setOrientation(Hit::Horizontal);
+  newHit.setObjectKind(Hit::Active);
+  newHit.setResolutionRphi(dr);
+  newHit.setResolutionY(dz);
   this->addHit(newHit);
 }
 
@@ -941,9 +1184,20 @@ double Track::expectedTriggerPoints(const double& triggerMomentum) const {
 
 
 std::vector<std::pair<Module*, HitType>> Track::getHitModules() const {
+  std::vector<std::pair<Module*, HitType>> result;
+  getHitModules(result);
+  return result;
+}
+
+/**
+ * Lists the modules of the active trigger hits into a vector the caller keeps, so that going through many tracks does
+ * not allocate a new list for each of them
+ * @param result The modules and the kinds of their hits, in the order of the hits; its previous content is dropped
+ */
+void Track::getHitModules(std::vector<std::pair<Module*, HitType>>& result) const {
   std::vector<Hit*>::const_iterator hitIt;
   Hit* myHit;
-  std::vector<std::pair<Module*, HitType>> result;
+  result.clear();
 
   for (hitIt=hitV_.begin(); hitIt!=hitV_.end(); ++hitIt) {
     myHit=(*hitIt);
@@ -962,7 +1216,6 @@ std::vector<std::pair<Module*, HitType>> Track::getHitModules() const {
       }
     }
   }
-  return result;
 }
 
 
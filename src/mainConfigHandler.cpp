@@ -8,6 +8,8 @@
 #include <sstream>
 #include <vector>
 #include <iomanip>
+#include <algorithm>
+#include <ctime>
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -418,47 +420,187 @@ string mainConfigHandler::getStandardIncludeDirectory_() { return standardDirect
 string mainConfigHandler::getGeometriesDirectory_() { return standardDirectory_+"/"+insur::default_geometriesdir; }
 
 
+/**
+ * Expand the @include directives of a configuration, recursively. Each included file is read once and kept expanded,
+ * so later inclusions of the same file (within this run or in later runs) do not read nor parse it again, unless the
+ * file itself or one of the files it includes has been modified in the meantime.
+ * @param is The stream of the configuration to be expanded
+ * @param os The stream the expanded configuration is written to
+ * @param istreamid The name of the configuration, used for the warnings and as the first element of the returned set
+ * @return The set of all the files making up the configuration
+ */
 std::set<string> mainConfigHandler::preprocessConfiguration(istream& is, ostream& os, const string& istreamid) {
+  string expanded;
+  std::set<string> includeSet = preprocessConfiguration(is, expanded, istreamid);
+  os.write(expanded.data(), expanded.size());
+  return includeSet;
+}
+
+/**
+ * Expand the @include directives of a configuration, recursively, into a single buffer
+ * @param is The stream of the configuration to be expanded
+ * @param expanded The buffer the expanded configuration is written to
+ * @param istreamid The name of the configuration, used for the warnings and as the first element of the returned set
+ * @return The set of all the files making up the configuration
+ */
+std::set<string> mainConfigHandler::preprocessConfiguration(istream& is, string& expanded, const string& istreamid) {
+  string text;
+  readWholeStream(is, text);
+  return preprocessText(text, expanded, istreamid);
+}
+
+/**
+ * Expand the @include directives of a configuration already read, recursively, into a single buffer
+ * @param text The configuration to be expanded
+ * @param expanded The buffer the expanded configuration is written to
+ * @param textid The name of the configuration, used for the warnings and as the first element of the returned set
+ * @return The set of all the files making up the configuration
+ */
+std::set<string> mainConfigHandler::preprocessText(const string& text, string& expanded, const string& textid) {
+  includeModTimes_.clear(); // the files are checked for modifications once per configuration
+  std::set<string> includeSet;
+  includeSet.insert(textid);
+  expanded.clear();
+  std::vector<string> warnings; // the warnings of the cached files are given again each time they are included
+  expandIncludes(text, textid, expanded, includeSet, warnings);
+  for (auto& warning : warnings) cerr << warning << endl;
+  return includeSet;
+}
+
+/**
+ * Read a whole stream, from its current position, into a string
+ * @param is The stream to be read
+ * @param text The string the content of the stream is written to
+ */
+void mainConfigHandler::readWholeStream(istream& is, string& text) {
+  text.clear();
+  std::streampos start = is.tellg();
+  if (start != std::streampos(-1) && is.seekg(0, std::ios::end)) {
+    std::streampos end = is.tellg();
+    is.seekg(start);
+    text.resize(end - start);
+    is.read(&text[0], text.size());
+    text.resize(is.gcount());
+  } else { // the stream cannot be sought (e.g. a pipe)
+    is.clear();
+    std::ostringstream ss;
+    ss << is.rdbuf();
+    text = ss.str();
+  }
+}
+
+/**
+ * The modification time of an included file, asked to the file system at most once per configuration
+ * @param filename The name of the file
+ * @return The modification time of the file, or -1 if it cannot be determined
+ */
+std::time_t mainConfigHandler::includeModTime(const string& filename) {
+  auto it = includeModTimes_.find(filename);
+  if (it != includeModTimes_.end()) return it->second;
+  boost::system::error_code ec;
+  std::time_t modTime = filesystem::last_write_time(filename, ec);
+  if (ec) modTime = -1;
+  includeModTimes_[filename] = modTime;
+  return modTime;
+}
+
+/**
+ * Find an included file in the cache, expanding it (and caching it) if it is missing or if any of the files
+ * it is made of has been modified since it was expanded
+ * @param filename The name of the included file
+ * @return The expanded file, or NULL if the file cannot be read
+ */
+const mainConfigHandler::ExpandedInclude* mainConfigHandler::expandedInclude(const string& filename) {
+  auto it = includeCache_.find(filename);
+  if (it != includeCache_.end()) {
+    bool upToDate = true;
+    for (auto& dependency : it->second.modTimes) {
+      if (dependency.second == -1 || includeModTime(dependency.first) != dependency.second) { upToDate = false; break; }
+    }
+    if (upToDate) return &it->second;
+    includeCache_.erase(it);
+  }
+  string text;
+  if (!readText(filename, text)) return NULL;
+  ExpandedInclude& entry = includeCache_[filename];
+  entry.includes.insert(filename);
+  expandIncludes(text, filename, entry.text, entry.includes, entry.warnings);
+  for (auto& included : entry.includes) entry.modTimes[included] = includeModTime(included);
+  return &entry;
+}
+
+/**
+ * Expand the @include directives of a configuration text, appending the result to a buffer. Comments are stripped
+ * and the included files are indented as the directive including them. As with <i>std::getline()</i> looping on
+ * <i>good()</i>, a last line with no newline at its end is dropped.
+ * @param text The configuration text
+ * @param textid The name of the configuration, used for the warnings
+ * @param expanded The buffer the expanded configuration is appended to
+ * @param includeSet The set the names of the included files are added to
+ * @param warnings The list the warnings about the directives that could not be expanded are added to
+ */
+void mainConfigHandler::expandIncludes(const string& text, const string& textid, string& expanded, std::set<string>& includeSet,
+                                       std::vector<string>& warnings) {
   using namespace std;
-  string line;
+  static const char commentMarker[] = "//";
+  static const char includeDirective[] = "@include";
+  // the files included by the text and not expanded yet are all read ahead, while the text is expanded
+  for (size_t lineStart = 0, lineEnd; (lineEnd = text.find('\n', lineStart)) != string::npos; lineStart = lineEnd + 1) {
+    const char* first = text.data() + lineStart;
+    const char* last = std::search(first, text.data() + lineEnd, commentMarker, commentMarker + sizeof(commentMarker) - 1);
+    if (std::search(first, last, includeDirective, includeDirective + sizeof(includeDirective) - 1) == last) continue;
+    string filename = includedFileName(string(first, last));
+    if (!includeCache_.count(filename)) prefetchText(filename);
+  }
+  expanded.reserve(expanded.size() + text.size());
   int numLine = 1;
-  std::set<string> includeSet;
-  includeSet.insert(istreamid);
-  while(getline(is, line).good()) {
-    if (line.find("//") != string::npos) line = line.erase(line.find("//"));
-    string trimmed = trim(line);
-    int includeStart;
-    if ((includeStart = trimmed.find("@include")) != string::npos) { //@include @include-std @include-weak @include-std-weak
-      trimmed = trimmed.substr(includeStart);
-      int quoteStart, quoteEnd;
-      string filename;
-      if ((quoteStart = trimmed.find_first_of("\"")) != string::npos && (quoteEnd = trimmed.find_last_of("\"")) != string::npos) {
-        filename = ctrim(trimmed.substr(quoteStart, quoteEnd - quoteStart + 1), "\"");
-      } else {
-        auto tokens = split(trimmed, " ");
-        filename = tokens.size() > 1 ? tokens[1] : "";
-      }
-      bool includeStdOld = trimmed.find("@includestd") != string::npos;  // both @includestd (deprecated) and @include-std (preferred) are supported 
-      bool includeStdNew = trimmed.find("@include-std") != string::npos;
-     // bool includeWeak = trimmed.find("@include-weak") != string::npos || trimmed.find("@include-std-weak") != string::npos || trimmed.find("@includestd-weak") != string::npos; // include weak command not supported for the moment
-      string prefix = (includeStdOld || includeStdNew) ? getStandardIncludeDirectory()+"/" : std::string("");
-      filename = prefix + filename;
-      ifstream ifs(filename);
-      if (ifs) {
-        stringstream ss;
-        auto&& moreIncludes = preprocessConfiguration(ifs, ss, filename);
-        includeSet.insert(moreIncludes.begin(), moreIncludes.end());
-        string indent = line.substr(0, line.find_first_not_of(" \t"));
-        while (getline(ss, line).good()) {
-          os << indent << line << endl;   
-        }
-      } else {
-        cerr << "WARNING: " << istreamid << ":" << numLine << ": Ignoring malformed @include or @includestd directive" << endl;
+  for (size_t lineStart = 0, lineEnd; (lineEnd = text.find('\n', lineStart)) != string::npos; lineStart = lineEnd + 1, numLine++) {
+    const char* first = text.data() + lineStart;
+    const char* last = std::search(first, text.data() + lineEnd, commentMarker, commentMarker + sizeof(commentMarker) - 1);
+    if (std::search(first, last, includeDirective, includeDirective + sizeof(includeDirective) - 1) == last) {
+      expanded.append(first, last);
+      expanded += '\n';
+      continue;
+    }
+    string line(first, last);
+    const ExpandedInclude* included = expandedInclude(includedFileName(line));
+    if (included) {
+      includeSet.insert(included->includes.begin(), included->includes.end());
+      warnings.insert(warnings.end(), included->warnings.begin(), included->warnings.end());
+      string indent = line.substr(0, line.find_first_not_of(" \t"));
+      const string& includedText = included->text;
+      for (size_t start = 0, end; (end = includedText.find('\n', start)) != string::npos; start = end + 1) {
+        expanded += indent;
+        expanded.append(includedText, start, end - start + 1);
       }
     } else {
-      os << line << endl;
+      std::ostringstream warning;
+      warning << "WARNING: " << textid << ":" << numLine << ": Ignoring malformed @include or @includestd directive";
+      warnings.push_back(warning.str());
     }
-    numLine++;
   }
-  return includeSet;
+}
+
+/**
+ * The name of the file included by a line of a configuration, with the standard include directory for @include-std
+ * @param line The line, with the @include directive and without its comment
+ * @return The name of the file, which cannot be read if the directive is malformed
+ */
+string mainConfigHandler::includedFileName(const string& line) {
+  using namespace std;
+  string trimmed = trim(line);
+  trimmed = trimmed.substr(trimmed.find("@include")); //@include @include-std @include-weak @include-std-weak
+  size_t quoteStart, quoteEnd;
+  string filename;
+  if ((quoteStart = trimmed.find_first_of("\"")) != string::npos && (quoteEnd = trimmed.find_last_of("\"")) != string::npos) {
+    filename = ctrim(trimmed.substr(quoteStart, quoteEnd - quoteStart + 1), "\"");
+  } else {
+    auto tokens = split(trimmed, " ");
+    filename = tokens.size() > 1 ? tokens[1] : "";
+  }
+  bool includeStdOld = trimmed.find("@includestd") != string::npos;  // both @includestd (deprecated) and @include-std (preferred) are supported 
+  bool includeStdNew = trimmed.find("@include-std") != string::npos;
+  // bool includeWeak = trimmed.find("@include-weak") != string::npos || trimmed.find("@include-std-weak") != string::npos || trimmed.find("@includestd-weak") != string::npos; // include weak command not supported for the moment
+  string prefix = (includeStdOld || includeStdNew) ? getStandardIncludeDirectory()+"/" : std::string("");
+  return prefix + filename;
 }
@@ -1,19 +1,32 @@
 #include <messageLogger.h>
+#include <algorithm>
 
 //bool MessageLogger::wasModified[MessageLogger::NumberOfLevels];
 std::vector<LogMessage> MessageLogger::logMessageV;
 int MessageLogger::countInstances = 0;
+std::atomic<unsigned long> MessageLogger::sequence_(0);
+std::vector<LogSite*> MessageLogger::fullSites_;
 
 //  enum {UNKNOWN, ERROR, WARNING, INFO, DEBUG, NumberOfLevels};
 std::string MessageLogger::shortLevelCode[] = { "??", "EE", "WW", "II", "DD" };
 int MessageLogger::messageCounter[NumberOfLevels];
 
-// Global static pointer used to ensure a single instance of the class.
-MessageLogger* MessageLogger::myInstance_ = NULL;
+std::mutex MessageLogger::mutex_;
 
-// Returns the instance (if already present) or creates one if needed
+// The messages of a thread, kept aside with no lock until the log is read, the buffer is full or the thread ends
+class LogBuffer {
+ public:
+  static const size_t Capacity = 1024;
+  std::vector<LogMessage> messages;
+  ~LogBuffer() { MessageLogger::flush(messages); }
+};
+
+static thread_local LogBuffer threadLog;
+
+// Returns the instance, created on the first call
 MessageLogger* MessageLogger::instance() {
-  return myInstance_ ? myInstance_ : (myInstance_ = new MessageLogger);
+  static MessageLogger* myInstance = new MessageLogger;
+  return myInstance;
 }
 
 MessageLogger::MessageLogger() {
@@ -25,41 +38,79 @@ MessageLogger::MessageLogger() {
   ++countInstances;
 }
 
-bool MessageLogger::addMessage(string sourceFunction, string message, int level /*=UNKNOWN*/, bool unique /*=false*/ ) {
+bool LogSite::admit() {
+  unsigned long count = count_.fetch_add(1, std::memory_order_relaxed);
+  if (count == MessageLogger::MessagesPerSite) {
+    std::lock_guard<std::mutex> lock(MessageLogger::mutex_);
+    MessageLogger::fullSites_.push_back(this);
+  }
+  return count < MessageLogger::MessagesPerSite;
+}
+
+bool MessageLogger::addMessage(const char* sourceFunction, const string& message, int level /*=UNKNOWN*/, bool unique /*=false*/ ) {
   if(unique) {
-    if(uniqueMessages.count(message) == 0) {
-      uniqueMessages.insert(message);
-    } else {
-      return false;
-    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!uniqueMessages.insert(std::hash<std::string>()(message)).second) return false;
   }
-    
+
   if (level<=screenLevel_) {
+    std::lock_guard<std::mutex> lock(mutex_);
     std::cout << "(" + shortLevelCode[level]+ ") "
 	      << sourceFunction<<": " << message << std::endl;
   }
 
-  if (level==DEBUG) { // TODO: this could be more efficient
-     for (int i=sourceFunction.length(); i<20; ++i) message=" "+ message;
-     message = "[" + sourceFunction+"]: " + message;
-  }
-
   if ((level>=0)&&(level<NumberOfLevels)) {
     LogMessage newMessage;
     newMessage.level=level;
-    newMessage.message=message;
-    logMessageV.push_back(newMessage);
-    messageCounter[level]++;
+    newMessage.sequence=sequence_++;
+    if (level==DEBUG) { // TODO: this could be more efficient
+      std::string function(sourceFunction);
+      newMessage.message = "[" + function + "]: " + std::string(function.length() < 20 ? 20 - function.length() : 0, ' ') + message;
+    } else newMessage.message=message;
+    threadLog.messages.push_back(std::move(newMessage));
+    if (threadLog.messages.size() >= LogBuffer::Capacity) flush(threadLog.messages);
     return true;
   } else return false;
 }
 
-bool MessageLogger::addMessage(string sourceFunction, ostringstream& message, int level /*=UNKNOWN*/, bool unique /*=false*/ ) {
-  string newMessage = message.str();
-  return addMessage(sourceFunction, newMessage, level, unique);
+bool MessageLogger::addMessage(const char* sourceFunction, const ostringstream& message, int level /*=UNKNOWN*/, bool unique /*=false*/ ) {
+  return addMessage(sourceFunction, message.str(), level, unique);
+}
+
+// Moves the messages of a thread into the log
+void MessageLogger::flush(std::vector<LogMessage>& messages) {
+  if (messages.empty()) return;
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto& message : messages) {
+    messageCounter[message.level]++;
+    logMessageV.push_back(std::move(message));
+  }
+  messages.clear();
+}
+
+// Brings the log up to date before it is read: the messages of the calling thread (the other threads flush theirs when
+// they end), in the order they were logged, and how many messages the call sites over their quota held back since last time
+void MessageLogger::collect() {
+  flush(threadLog.messages);
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (LogSite* site : fullSites_) {
+    unsigned long heldBack = site->count_ - MessagesPerSite;
+    if (heldBack <= site->reported_) continue;
+    LogMessage newMessage;
+    newMessage.level = site->level_;
+    newMessage.sequence = sequence_++;
+    newMessage.message = std::string(site->function_) + ": " + std::to_string(heldBack - site->reported_) + " more messages were not logged";
+    site->reported_ = heldBack;
+    messageCounter[newMessage.level]++;
+    logMessageV.push_back(std::move(newMessage));
+  }
+  auto bySequence = [](const LogMessage& a, const LogMessage& b) { return a.sequence < b.sequence; };
+  if (!std::is_sorted(logMessageV.begin(), logMessageV.end(), bySequence)) std::stable_sort(logMessageV.begin(), logMessageV.end(), bySequence);
 }
 
 bool MessageLogger::hasEmptyLog(int level) {
+  collect();
+  std::lock_guard<std::mutex> lock(mutex_);
   if ((level>=0)&&(level<NumberOfLevels)) {
     return (messageCounter[level]==0);
   }
@@ -67,35 +118,33 @@ bool MessageLogger::hasEmptyLog(int level) {
 }
 
 string MessageLogger::getLatestLog(int level) {
+  collect();
+  std::lock_guard<std::mutex> lock(mutex_);
   string result="";
   if ((level>=0)&&(level<NumberOfLevels)) {
-    std::vector<LogMessage>::iterator itMessage;
-    //std::vector<LogMessage>::iterator nextMessage;
-    for (itMessage=logMessageV.begin();
-	 itMessage!=logMessageV.end(); ) {
-      if (itMessage->level==level) {
-        result += (*itMessage).message+"\n";
-	//nextMessage=itMessage+1;
-	messageCounter[itMessage->level]--;
-        logMessageV.erase(itMessage);
-	//itMessage=nextMessage;
+    std::vector<LogMessage> kept;
+    for (auto& message : logMessageV) {
+      if (message.level==level) {
+        result += message.message+"\n";
+        messageCounter[message.level]--;
       } else {
-	++itMessage;
+        kept.push_back(std::move(message));
       }
     }
+    logMessageV.swap(kept);
   }
   return result;
 }
 
 string MessageLogger::getLatestLog() {
+  collect();
+  std::lock_guard<std::mutex> lock(mutex_);
   string result="";
-  std::vector<LogMessage>::iterator itMessage=logMessageV.begin();
-  while (itMessage!=logMessageV.end()) {
-    result += "(" + shortLevelCode[itMessage->level]+ ") " + itMessage->message+"\n";
-    messageCounter[itMessage->level]--;
-    logMessageV.erase(itMessage);
-    itMessage=logMessageV.begin();
+  for (const auto& message : logMessageV) {
+    result += "(" + shortLevelCode[message.level]+ ") " + message.message+"\n";
+    messageCounter[message.level]--;
   }
+  logMessageV.clear();
   return result;
 }
 
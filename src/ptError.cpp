@@ -9,6 +9,8 @@ using namespace std;
 // Default values for gloabl parameters
 double ptError::IP_length = 70;     // mm
 double ptError::B = insur::magnetic_field; // T
+double ptError::minimumPt = 0.3; // GeV/c
+double ptError::maximumPt = 30;  // GeV/c
 
 void ptError::defaultParameters() {
   Module_pitch = defaultModulePitch;
@@ -137,6 +139,79 @@ double ptError::probabilityInside(double cut, double value, double value_err) {
   return probabilityInside_norm(mycut, myvalue);
 }
 
+/**
+ * An approximation of erf(x) with an absolute error below 1.5E-7 (Abramowitz and Stegun 7.1.26): one exp and no branch
+ */
+double ptError::fastErf(double x) {
+  double t = 1 / (1 + 0.3275911*fabs(x));
+  double y = 1 - t*(0.254829592 + t*(-0.284496736 + t*(1.421413741 + t*(-1.453152027 + t*1.061405429)))) * exp(-x*x);
+  return copysign(y, x);
+}
+
+/**
+ * The same as <i>probabilityInside()</i> for arrays of cuts, values and errors: the loop has no branches,
+ * so that the compiler can vectorise it where a vector erf is available
+ * @param fastErf Whether to use <i>fastErf()</i>, which vectorises anywhere, instead of erf
+ */
+void ptError::probabilityInside(int n, const double* cut, const double* value, const double* value_err, double* result, bool fastErf /*= false*/) {
+  if (fastErf) {
+    for (int i = 0; i < n; i++) {
+      double mycut = fabs(cut[i]/value_err[i]);
+      double myvalue = fabs(value[i]/value_err[i]);
+      result[i] = 0.5*(ptError::fastErf((mycut-myvalue)/sqrt(2)) - ptError::fastErf((-mycut-myvalue)/sqrt(2)));
+    }
+  } else {
+    for (int i = 0; i < n; i++) {
+      double mycut = fabs(cut[i]/value_err[i]);
+      double myvalue = fabs(value[i]/value_err[i]);
+      result[i] = 0.5*(erf((mycut-myvalue)/sqrt(2)) - erf((-mycut-myvalue)/sqrt(2)));
+    }
+  }
+}
+
+/**
+ * The p (in GeV/c) of the tracks whose bending in the module spans a number of strips
+ */
+double ptError::stripsToP(double strips) const {
+  double A = 0.3 * B * Module_r / 1000. / 2.; // GeV
+  double x = strips * Module_pitch;
+  return A * sqrt( pow(Module_ed/x,2) + 1 );
+}
+
+/**
+ * The fraction of the module where the tracks hit both sensors in the same segment
+ */
+double ptError::geometricEfficiency() const {
+  double theta = atan2(Module_r, Module_z);
+  return 1 - fabs(Module_d / (zCorrelation==SAMESEGMENT ? Module_strip_l : Module_h) / tan(theta + Module_tilt));
+}
+
+/**
+ * The pt at which the trigger probability of the module reaches a target, found by bisection in log(pt)
+ * @param target The trigger probability
+ * @param ptCut The pt cut of the trigger window
+ * @param efficiency The geometric efficiency of the module, which the probabilities are scaled by
+ * @return The pt, or -1 if the target is not reached between minimumPt and maximumPt or the bisection does not converge
+ */
+double ptError::findPtAtProbability(double target, double ptCut, double efficiency) {
+  double lowerPt = minimumPt;
+  double higherPt = maximumPt;
+
+  double lowerProbability = efficiency * probabilityInside(1/ptCut, 1/lowerPt, computeError(lowerPt)/lowerPt);
+  double higherProbability = efficiency * probabilityInside(1/ptCut, 1/higherPt, computeError(higherPt)/higherPt);
+  if ((target<lowerProbability)||(target>higherProbability)) return -1; // probability not reachable within desired pt range
+
+  for (int i=0; i<100; ++i) {
+    double testPt = sqrt(lowerPt*higherPt);
+    double testProbability = efficiency * probabilityInside(1/ptCut, 1/testPt, computeError(testPt)/testPt);
+    if (testProbability>target) higherPt = testPt;
+    else lowerPt = testPt;
+    if (fabs(testProbability-target)<1E-5) return testPt;
+  }
+
+  return -1; // could not converge
+}
+
 /* */
 
 
@@ -0,0 +1,73 @@
+/**
+ * @file renderimages.cpp
+ * @brief This program renders on demand the image formats of a website made with the lazy image formats
+ *
+ * The canvases of the images are read back from the file LAZYCANVASFILE of the site directory
+ * and printed there, next to their PNG files, in the formats the site was made with, or in the
+ * ones given. Only the named images are rendered, if any are given, e.g.
+ * <pre>renderimages layouts/myTracker pdf,C img003 img004</pre>
+ */
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <TCanvas.h>
+#include <TError.h>
+#include <TFile.h>
+#include <TKey.h>
+#include <TNamed.h>
+#include <TROOT.h>
+#include <rootweb.hh>
+
+int main(int argc, char* argv[]) {
+  if (argc < 2 || std::string(argv[1]) == "-h" || std::string(argv[1]) == "--help") {
+    std::cout << "Usage: " << argv[0] << " <site directory> [<formats, e.g. pdf,root> [<image name> ...]]" << std::endl;
+    return argc < 2 ? EXIT_FAILURE : 0;
+  }
+  std::string siteDirectory = argv[1];
+  std::string canvasFileName = siteDirectory + "/" + LAZYCANVASFILE;
+  gROOT->SetBatch(true);
+  gErrorIgnoreLevel = 1500;
+
+  TFile canvasFile(canvasFileName.c_str(), "READ");
+  if (canvasFile.IsZombie()) {
+    std::cerr << "Could not open " << canvasFileName << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::string formatList;
+  if (argc > 2) formatList = argv[2];
+  else if (TNamed* siteFormats = dynamic_cast<TNamed*>(canvasFile.Get(LAZYFORMATSNAME))) formatList = siteFormats->GetTitle();
+  std::vector<std::string> formats;
+  std::stringstream formatStream(formatList);
+  std::string format;
+  while (std::getline(formatStream, format, formatList.find('|') != std::string::npos ? '|' : ',')) {
+    if (format.empty()) continue;
+    if (std::string(DEFAULTALLOWEDEXTENSIONS).find("|" + format + "|") == std::string::npos) {
+      std::cerr << "Image format '" << format << "' is not allowed: it must be one of " << DEFAULTALLOWEDEXTENSIONS << std::endl;
+      return EXIT_FAILURE;
+    }
+    formats.push_back(format);
+  }
+  std::set<std::string> names(argv + std::min(argc, 3), argv + argc);
+
+  int rendered = 0;
+  TIter nextKey(canvasFile.GetListOfKeys());
+  while (TKey* key = (TKey*)nextKey()) {
+    if (std::string(key->GetClassName()) != "TCanvas") continue;
+    if (!names.empty() && !names.count(key->GetName())) continue;
+    TCanvas* canvas = (TCanvas*)key->ReadObj();
+    for (std::vector<std::string>::const_iterator it = formats.begin(); it != formats.end(); ++it) {
+      canvas->Print((siteDirectory + "/" + key->GetName() + "." + *it).c_str());
+    }
+    delete canvas;
+    rendered++;
+  }
+  if (rendered < (int)names.size()) std::cerr << "Only " << rendered << " of the " << names.size() << " images were found in " << canvasFileName << std::endl;
+  std::cout << rendered << " images rendered" << std::endl;
+  return rendered < (int)names.size() ? EXIT_FAILURE : 0;
+}
@@ -1,7 +1,20 @@
 #include <rootweb.hh>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
 
 int RootWImage::imageCounter_ = 0;
+int RootWTable::tableCounter_ = 0;
+int RootWTable::maxInlineRows_ = 2000;
 std::map <std::string, int> RootWImage::imageNameCounter_;
+vector<RootWImage::RenderJob> RootWImage::renderQueue_;
+vector<pid_t> RootWImage::backgroundRenderers_;
+std::set<string> RootWImage::lazyFilesStarted_;
+vector<string> RootWImage::defaultExtensions_ = { /*"C",*/ "pdf", "root" };
+bool RootWImage::lazyFormats_ = false;
 
 //*******************************************//
 // RootWTable                                //
@@ -9,89 +22,141 @@ std::map <std::string, int> RootWImage::imageNameCounter_;
 RootWTable::RootWTable() {
   serialRow_ = 0;
   serialCol_ = 0;
+  minRow_ = minCol_ = 0;
+  maxRow_ = maxCol_ = -1;
+  tableNumber_ = tableCounter_++;
+}
+
+// The cell at a row and column, created if needed; NULL for the negative rows and columns, which cannot be stored
+RootWTable::Cell* RootWTable::cell(int row, int column) {
+  if (row < 0 || column < 0) {
+    cerr << "Warning: RootWTable ignores the cell (" << row << ", " << column << "): rows and columns start from 0" << endl;
+    return NULL;
+  }
+  if (row >= int(cells_.size())) cells_.resize(row + 1);
+  vector<Cell>& cellRow = cells_[row];
+  if (column >= int(cellRow.size())) cellRow.resize(column + 1);
+  return &cellRow[column];
 }
 
 ostream& RootWTable::dump(ostream& output) {
-  RootWTable& myRootWTable = (*this);
-
-  int minRow = tableContent_.begin()->first.first; int maxRow=0;
-  int minCol = tableContent_.begin()->first.second; int maxCol=0;
-  bool firstNotFound = true;
-
-  pair<int, int> myIndex;
-  rootWTableContent::iterator tableContentIt;
-  rootWTableContent& myTableContent = myRootWTable.tableContent_;
-
-  //std::cerr << "Table: "; // debug
-  for (tableContentIt = tableContent_.begin();
-       tableContentIt != tableContent_.end(); ++tableContentIt) {
-    myIndex = (*tableContentIt).first;
-    //std::cerr << "(" << myIndex.first << ", " << myIndex.second << ")" << std::endl; // debug
-    if (firstNotFound) {
-      firstNotFound = false;
-      minRow = myIndex.first;
-      maxRow = myIndex.first;
-      minCol = myIndex.second;
-      maxCol = myIndex.second;
-    } else {
-      minRow = ( myIndex.first < minRow ) ? myIndex.first : minRow;
-      maxRow = ( myIndex.first > maxRow ) ? myIndex.first : maxRow;
-      minCol = ( myIndex.second < minCol ) ? myIndex.second : minCol;
-      maxCol = ( myIndex.second > maxCol ) ? myIndex.second : maxCol;
+  if (minRow_ > maxRow_) return output;
+  // past the inline rows, the table is written in full to a CSV file next to the page
+  int lastRow = maxRow_;
+  bool truncated = maxInlineRows_ > 0 && maxRow_ - minRow_ + 1 > maxInlineRows_ && !targetDirectory_.empty();
+  if (truncated) lastRow = minRow_ + maxInlineRows_ - 1;
+
+  // the page is composed in one buffer, and written at once
+  static const Cell emptyCell;
+  string html = "<table>";
+  for (int iRow = minRow_; iRow<=lastRow; ++iRow) {
+    const vector<Cell>* cellRow = iRow < int(cells_.size()) ? &cells_[iRow] : NULL;
+    const char* cellCode = ((iRow==minRow_)&&(iRow==0)) ? "th" : "td";
+    html += "<tr>";
+    for (int iCol = minCol_; iCol<=maxCol_; ++iCol) {
+      const Cell& myCell = (cellRow && iCol < int(cellRow->size())) ? (*cellRow)[iCol] : emptyCell;
+      html += "<";
+      html += cellCode;
+      if (myCell.color!=0) {
+        html += " style=\"color:";
+        html += gROOT->GetColor(myCell.color)->AsHexString();
+        html += ";\" \n";
+      }
+      html += ">";
+      html += myCell.content;
+      html += "</";
+      html += cellCode;
+      html += "> ";
     }
+    html += "</tr>";
+  }
+  html += "</table>\n";
+  if (truncated) {
+    ostringstream fileName;
+    fileName << "table" << setfill('0') << setw(3) << tableNumber_ << ".csv";
+    writeCsv(targetDirectory_ + "/" + fileName.str(), maxRow_);
+    ostringstream note;
+    note << "<p>The first " << maxInlineRows_ << " of " << maxRow_ - minRow_ + 1 << " rows are shown, the full table is in <a href=\""
+         << fileName.str() << "\">" << fileName.str() << "</a></p>\n";
+    html += note.str();
   }
-  //std::cerr << "Size:" << tableContent_.size() << "; Rows: " << minRow << "-" << maxRow <<"; Cols: " << minCol << "-" << maxCol << endl; // debug
-  if (firstNotFound) return output;
-  std::string myColorCode;
-  std::string myCellCode;
-  int myColorIndex;
-
-  output << "<table>";
-  for (int iRow = minRow; iRow<=maxRow; ++iRow) { 
-    output << "<tr>";
-    for (int iCol = minCol; iCol<=maxCol; ++iCol) {
-      if ((iRow==minRow)&&(iRow==0)) myCellCode = "th";
-      else myCellCode = "td";
-      output << "<" << myCellCode;
-      myColorIndex = tableContentColor_[make_pair(iRow, iCol)];
-      if (myColorIndex!=0) { 
-	myColorCode=gROOT->GetColor(myColorIndex)->AsHexString();        
-	output << " style=\"color:" << myColorCode << ";\" " << std::endl;
+  output.write(html.data(), html.size());
+  return output;
+}
+
+// Writes the rows of the table up to the given one as comma-separated values, quoting the cells which need it
+void RootWTable::writeCsv(const string& fileName, int lastRow) const {
+  static const size_t bufferSize = 1 << 20;
+  std::vector<char> buffer(bufferSize);
+  std::ofstream outputFile;
+  outputFile.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+  outputFile.open(fileName.c_str());
+  if (!outputFile) {
+    cerr << "Warning: RootWTable::dump() could not open " << fileName << endl;
+    return;
+  }
+  for (int iRow = minRow_; iRow<=lastRow; ++iRow) {
+    for (int iCol = minCol_; iCol<=maxCol_; ++iCol) {
+      if (iCol > minCol_) outputFile << ',';
+      if (iRow >= int(cells_.size()) || iCol >= int(cells_[iRow].size())) continue;
+      const string& content = cells_[iRow][iCol].content;
+      if (content.find_first_of(",\"\n") == string::npos) outputFile << content;
+      else {
+        outputFile << '"';
+        for (char c : content) outputFile << (c == '"' ? "\"\"" : string(1, c));
+        outputFile << '"';
       }
-      output << ">";
-      output << myTableContent[make_pair(iRow, iCol)];
-      output << "</" << myColorCode << ">" << " ";
     }
-    output << "</tr>";
+    outputFile << '\n';
   }
-  output << "</table>" << endl;
-  
-  return output;
+  outputFile.close();
 }
 
 void RootWTable::setColor(int row, int column, int newColor) {
-  tableContentColor_[make_pair(row, column)] = newColor;
+  if (Cell* myCell = cell(row, column)) myCell->color = newColor;
 }
 
 void RootWTable::setContent(int row, int column, string content) {
   // std::cerr << "setContent("<<row<<", "<<column<<", "<<content<<")"<<endl; // debug
-  tableContent_[make_pair(row, column)] = content;
+  Cell* myCell = cell(row, column);
+  if (!myCell) return;
+  myCell->content.swap(content);
+  if (!myCell->filled) {
+    myCell->filled = true;
+    if (minRow_ > maxRow_) {
+      minRow_ = maxRow_ = row;
+      minCol_ = maxCol_ = column;
+    } else {
+      minRow_ = std::min(minRow_, row);
+      maxRow_ = std::max(maxRow_, row);
+      minCol_ = std::min(minCol_, column);
+      maxCol_ = std::max(maxCol_, column);
+    }
+  }
 }
 
 void RootWTable::setContent(int row, int column, int number) {
-  // std::cerr << "setContent("<<row<<", "<<column<<", "<<number<<")"<<endl; // debug
-  stringstream myNum_;
-  myNum_.clear();
-  myNum_ << dec << number;
-  tableContent_[make_pair(row, column)] = myNum_.str();
+  setContent(row, column, to_string(number));
 }
 
 void RootWTable::setContent(int row, int column, double number, int precision) {
   // std::cerr << "setContent("<<row<<", "<<column<<", "<<number<<")"<<endl; // debug
   stringstream myNum_;
-  myNum_.clear();
   myNum_ << dec << fixed << setprecision(precision) << number;
-  tableContent_[make_pair(row, column)] = myNum_.str();
+  setContent(row, column, myNum_.str());
+}
+
+void RootWTable::setContent(const rootWTableContent& newContent) {
+  // the new content replaces the former one, the colors are kept
+  for (vector<Cell>& cellRow : cells_) {
+    for (Cell& myCell : cellRow) {
+      myCell.content.clear();
+      myCell.filled = false;
+    }
+  }
+  minRow_ = minCol_ = 0;
+  maxRow_ = maxCol_ = -1;
+  for (const auto& entry : newContent) setContent(entry.first.first, entry.first.second, entry.second);
 }
 
 pair<int, int> RootWTable::addContent(string myContent) {
@@ -188,13 +253,37 @@ RootWImage::RootWImage(TCanvas& myCanvas, int witdh, int height, string relative
 }
 
 RootWImage::~RootWImage() {
+  // The files still queued for this image can no longer be printed
+  for (vector<RenderJob>::iterator it = renderQueue_.begin(); it != renderQueue_.end(); ) {
+    if (it->image == this) it = renderQueue_.erase(it);
+    else ++it;
+  }
   if (myCanvas_) delete myCanvas_;
 }
 
 void RootWImage::setDefaultExtensions() {
-   //addExtension("C");
-   addExtension("pdf");
-   addExtension("root");
+  for (vector<string>::const_iterator it = defaultExtensions_.begin(); it != defaultExtensions_.end(); ++it) addExtension(*it);
+}
+
+/**
+ * Chooses the formats the images created from now on are saved in, besides the PNG ones
+ * @param formats The comma separated list of the file extensions, e.g. "pdf,root" (empty for PNG only)
+ * @return False, leaving the formats unchanged, if one of them is not allowed
+ */
+bool RootWImage::setDefaultFormats(const string& formats) {
+  vector<string> extensions;
+  stringstream formatStream(formats);
+  string extension;
+  while (getline(formatStream, extension, ',')) {
+    if (extension.empty() || extension == "png") continue;
+    if (extension.find("|") != string::npos || string(DEFAULTALLOWEDEXTENSIONS).find("|"+extension+"|") == string::npos) {
+      cerr << "Image format '" << extension << "' is not allowed: it must be one of " << DEFAULTALLOWEDEXTENSIONS << endl;
+      return false;
+    }
+    if (find(extensions.begin(), extensions.end(), extension) == extensions.end()) extensions.push_back(extension);
+  }
+  defaultExtensions_ = extensions;
+  return true;
 }
 
 void RootWImage::setComment(string newComment) {
@@ -294,21 +383,28 @@ string RootWImage::saveFiles(int smallWidth, int smallHeight) {
   string smallCanvasCompleteFileName = targetDirectory_+"/"+smallCanvasFileName;
   string largeCanvasCompleteFileName = targetDirectory_+"/"+largeCanvasFileBaseName + ".png";
 
-  gErrorIgnoreLevel = 1500;
-  myCanvas_->cd();
-  myCanvas_->SetCanvasSize(canW, canH);
-  // std::cerr << "Saving " << largeCanvasCompleteFileName << std::endl; // debug
-  myCanvas_->Print(smallCanvasCompleteFileName.c_str());
-  myCanvas_->SetCanvasSize(zoomedWidth_, zoomedHeight_);
-  myCanvas_->Print(largeCanvasCompleteFileName.c_str());
+  // The files are only printed when the render queue is drained: the canvas name is
+  // recorded here, as a later saveFiles() renames the canvas
+  RenderJob job;
+  job.image = this;
+  job.canvasName = canvasName;
+  job.smallCanvasWidth = canW;
+  job.smallCanvasHeight = canH;
+  job.largeCanvasWidth = zoomedWidth_;
+  job.largeCanvasHeight = zoomedHeight_;
+  job.smallFileName = smallCanvasCompleteFileName;
+  job.largeFileNames.push_back(largeCanvasCompleteFileName);
+  if (lazyFormats_ && !fileTypeV_.empty()) job.lazyFileName = targetDirectory_ + "/" + LAZYCANVASFILE;
 
   string fileTypeList;
   for (vector<string>::iterator it=fileTypeV_.begin(); it!=fileTypeV_.end(); ++it) {
-    largeCanvasCompleteFileName = targetDirectory_+"/"+largeCanvasFileBaseName + "." + (*it);
-    myCanvas_->Print(largeCanvasCompleteFileName.c_str());
+    if (job.lazyFileName.empty()) job.largeFileNames.push_back(targetDirectory_+"/"+largeCanvasFileBaseName + "." + (*it));
     if (it!=fileTypeV_.begin()) fileTypeList+="|";
     fileTypeList+=(*it);
   }
+  job.lazyFormats = fileTypeList;
+  job.skipPrint = false;
+  renderQueue_.push_back(job);
   
   thisText << "<img class='wleftzoom' width='"<< imgW<<"' height='"<<imgH<<"' src='"<< relativeHtmlDirectory_ << "/" << smallCanvasFileName <<"' alt='"<< comment_ <<"' onclick=\"popupDiv('" << relativeHtmlDirectory_ << "/" << largeCanvasFileBaseName << "', "<< zoomedWidth_<<", "<< zoomedHeight_ << " , '"<< comment_ << "','"<<fileTypeList << "');\" />";
   
@@ -318,6 +414,184 @@ string RootWImage::saveFiles(int smallWidth, int smallHeight) {
   return thisText.str();
 }
 
+/**
+ * Prints the files of a queued saveFiles() call from the canvas of the image
+ * @param job The names and the canvas sizes of the files
+ */
+void RootWImage::render(const RenderJob& job) {
+  if (job.skipPrint) return;
+  gErrorIgnoreLevel = 1500;
+  myCanvas_->SetName(job.canvasName.c_str());
+  myCanvas_->cd();
+  myCanvas_->SetCanvasSize(job.smallCanvasWidth, job.smallCanvasHeight);
+  myCanvas_->Print(job.smallFileName.c_str());
+  myCanvas_->SetCanvasSize(job.largeCanvasWidth, job.largeCanvasHeight);
+  for (vector<string>::const_iterator it = job.largeFileNames.begin(); it != job.largeFileNames.end(); ++it) {
+    myCanvas_->Print(it->c_str());
+  }
+}
+
+/**
+ * Leaves out the files of the queued saveFiles() calls from the given one on, which are up to date:
+ * their canvases are still written for the formats rendered on demand, as that file is recreated
+ * @param firstJob The number of files queued before the first call to skip
+ */
+void RootWImage::skipQueuedPrints(size_t firstJob) {
+  for (size_t i = firstJob; i < renderQueue_.size(); i++) renderQueue_[i].skipPrint = true;
+}
+
+/**
+ * Writes the canvases of the images whose formats other than PNG are rendered on demand to
+ * their ROOT file, with the list of all the formats found (as "pdf|root"). The file is
+ * recreated the first time, and updated when the images of more pages are written later on
+ * @param jobs The queued files
+ * @return True if the files could be written
+ */
+bool RootWImage::writeLazyCanvases(const vector<RenderJob>& jobs) {
+  map<string, TFile*> canvasFiles;
+  map<string, string> fileFormats;
+  bool result = true;
+  TDirectory* currentDirectory = gDirectory;
+  for (vector<RenderJob>::const_iterator it = jobs.begin(); it != jobs.end(); ++it) {
+    if (it->lazyFileName.empty()) continue;
+    TFile*& canvasFile = canvasFiles[it->lazyFileName];
+    if (!canvasFile) {
+      bool started = lazyFilesStarted_.count(it->lazyFileName);
+      canvasFile = new TFile(it->lazyFileName.c_str(), started ? "UPDATE" : "RECREATE");
+      if (canvasFile->IsZombie()) {
+        cerr << "Could not create " << it->lazyFileName << ": the images will lack their formats other than PNG" << endl;
+        result = false;
+      } else if (started) {
+        TNamed* oldFormats = dynamic_cast<TNamed*>(canvasFile->Get(LAZYFORMATSNAME));
+        if (oldFormats) fileFormats[it->lazyFileName] = oldFormats->GetTitle();
+      }
+      lazyFilesStarted_.insert(it->lazyFileName);
+    }
+    if (canvasFile->IsZombie()) continue;
+    string& formats = fileFormats[it->lazyFileName];
+    stringstream formatStream(it->lazyFormats);
+    string format;
+    while (getline(formatStream, format, '|')) {
+      if (("|" + formats + "|").find("|" + format + "|") == string::npos) formats += (formats.empty() ? "" : "|") + format;
+    }
+    canvasFile->cd();
+    it->image->myCanvas_->SetName(it->canvasName.c_str());
+    it->image->myCanvas_->SetCanvasSize(it->largeCanvasWidth, it->largeCanvasHeight);
+    it->image->myCanvas_->Write(it->canvasName.c_str(), TObject::kOverwrite);
+  }
+  for (map<string, TFile*>::iterator it = canvasFiles.begin(); it != canvasFiles.end(); ++it) {
+    if (!it->second->IsZombie()) {
+      it->second->cd();
+      TNamed(LAZYFORMATSNAME, fileFormats[it->first].c_str()).Write(LAZYFORMATSNAME, TObject::kOverwrite);
+      it->second->Close();
+    }
+    delete it->second;
+  }
+  if (currentDirectory) currentDirectory->cd();
+  return result;
+}
+
+/**
+ * Prints the image files queued by saveFiles() since the last call, and empties the queue.
+ * ROOT graphics are not thread-safe, so the files are shared among forked worker processes,
+ * each printing from its own copy of the canvases and of the ROOT state; the images
+ * take turns among the workers, as the cost of a canvas depends on what it shows.
+ * The canvases of the formats rendered on demand are written beforehand, by this process.
+ * The workers started earlier by startRenderingQueued() are waited for too.
+ * @param numProcesses The number of worker processes; the files are printed by this process if it is 1 or less
+ * @return True if all the files could be written and all the workers succeeded
+ */
+bool RootWImage::renderQueued(int numProcesses) {
+  vector<RenderJob> jobs;
+  jobs.swap(renderQueue_);
+  bool result = writeLazyCanvases(jobs);
+  vector<pid_t> workers;
+  if (std::min<int>(numProcesses, jobs.size()) <= 1) {
+    for (vector<RenderJob>::const_iterator it = jobs.begin(); it != jobs.end(); ++it) it->image->render(*it);
+  } else forkRenderers(jobs, numProcesses, workers);
+  result = waitRenderers(workers) && result;
+  result = waitRendering() && result;
+  return result;
+}
+
+/**
+ * Starts printing the image files queued by saveFiles() since the last call, and empties the
+ * queue, as renderQueued() does but without waiting for the files: the worker processes
+ * print them while this process goes on, and renderQueued() or waitRendering() collect them.
+ * As the workers print from their own copy of the canvases, the images may change meanwhile.
+ * @param numProcesses The number of worker processes; one is started at least
+ * @return False if the canvases of the formats rendered on demand could not be written
+ */
+bool RootWImage::startRenderingQueued(int numProcesses) {
+  vector<RenderJob> jobs;
+  jobs.swap(renderQueue_);
+  bool result = writeLazyCanvases(jobs);
+  forkRenderers(jobs, std::max(numProcesses, 1), backgroundRenderers_);
+  return result;
+}
+
+/**
+ * Waits for the worker processes started by startRenderingQueued()
+ * @return True if all of them succeeded
+ */
+bool RootWImage::waitRendering() {
+  bool result = waitRenderers(backgroundRenderers_);
+  backgroundRenderers_.clear();
+  return result;
+}
+
+/**
+ * Shares the given files among forked worker processes, and prints those of the workers
+ * that could not be started
+ * @param jobs The files to print
+ * @param numProcesses The number of worker processes, at most one per file
+ * @param workers The identifiers of the worker processes started are added to it
+ */
+void RootWImage::forkRenderers(const vector<RenderJob>& jobs, int numProcesses, vector<pid_t>& workers) {
+  int numWorkers = std::min<int>(numProcesses, jobs.size());
+  if (numWorkers < 1) return;
+  cout << flush; cerr << flush; // or the children would write the buffered text again
+  int numStarted = 0;
+  for (int iWorker = 0; iWorker < numWorkers; iWorker++) {
+    pid_t pid = fork();
+    if (pid == 0) {
+      int exitStatus = 0;
+      try {
+        for (size_t i = iWorker; i < jobs.size(); i += numWorkers) jobs[i].image->render(jobs[i]);
+      } catch (...) {
+        exitStatus = 1;
+      }
+      cout << flush; cerr << flush;
+      _exit(exitStatus); // skipping the exit handlers of ROOT, which belong to the parent
+    } else if (pid < 0) {
+      cerr << "Could not start an image rendering process: its images are rendered serially" << endl;
+      break;
+    }
+    workers.push_back(pid);
+    numStarted++;
+  }
+  // The images of the workers that did not start are left to this process
+  for (size_t i = 0; i < jobs.size(); i++) {
+    if (int(i % numWorkers) >= numStarted) jobs[i].image->render(jobs[i]);
+  }
+}
+
+/**
+ * Waits for the given worker processes
+ * @return True if all of them succeeded
+ */
+bool RootWImage::waitRenderers(const vector<pid_t>& workers) {
+  bool result = true;
+  for (vector<pid_t>::const_iterator it = workers.begin(); it != workers.end(); ++it) {
+    int status;
+    if (waitpid(*it, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      cerr << "An image rendering process failed: some of the image files may be missing" << endl;
+      result = false;
+    }
+  }
+  return result;
+}
+
 ostream& RootWImage::dump(ostream& output) {
   output << myText_[lastSize_];
   return output;
@@ -536,6 +810,9 @@ ostream& RootWContent::dump(ostream& output) {
         cout << "WARNING: this should never happen. contact the author immediately!" << endl;
       }
     }
+    if (myItem->isTable()) {
+      if (RootWTable* myTable = dynamic_cast<RootWTable*>(myItem)) myTable->setTargetDirectory(targetDirectory_);
+    }
     if (myItem->isFile()) {
       if ( (myFile=dynamic_cast<RootWFile*>(myItem))) { // CUIDADO This is not good OOP for God's sake!!!
         myFile->setTargetDirectory(targetDirectory_);
@@ -677,6 +954,8 @@ RootWSite::RootWSite() {
   revision_="";
   targetDirectory_ = ".";
   //styleDirectory_ = ".";
+  numThreads_ = 1;
+  renderAhead_ = false;
 }
 
 RootWSite::RootWSite(string title) {
@@ -688,6 +967,8 @@ RootWSite::RootWSite(string title) {
   revision_="";
   targetDirectory_ = ".";
   //styleDirectory_ = ".";
+  numThreads_ = 1;
+  renderAhead_ = false;
 }
 
 RootWSite::RootWSite(string title, string comment) {
@@ -699,6 +980,8 @@ RootWSite::RootWSite(string title, string comment) {
   revision_="";
   targetDirectory_ = ".";
   //styleDirectory_ = ".";
+  numThreads_ = 1;
+  renderAhead_ = false;
 }
 
 RootWSite::~RootWSite() {
@@ -756,6 +1039,8 @@ void RootWSite::addPage(RootWPage* newPage, int relevance /* = least_relevant */
     pageList_.insert(beforeThis, newPage);
   }
   newPage->setSite(this);
+  if (newPage->getInputTag().empty()) newPage->setInputTag(inputTag_);
+  newPages_.push_back(newPage);
 }
 
 RootWPage& RootWSite::addPage(string newTitle, int relevance /* = least_relevant */ ) {
@@ -867,13 +1152,24 @@ ostream& RootWSite::dumpHeader(ostream& output, RootWPage* thisPage) {
   
 }
 
-bool RootWSite::makeSite(bool verbose) {
-  ofstream myPageFile;
-  RootWPage* myPage;
-  string myPageFileName;
-  //string targetStyleDirectory = targetDirectory_ + "/style";
-
+/**
+ * Lists what every page shows of the whole site, in its header and footer, so that
+ * a page is written again whenever another page is added, renamed or changes its alert
+ * @return The text of the list
+ */
+string RootWSite::structureKey() {
+  ostringstream key;
+  key << title_ << "\n" << comment_ << "\n" << commentLink_ << "\n" << programName_ << "\n" << programSite_ << "\n" << revision_ << "\n";
+  if (renderAhead_) key << "rendered ahead\n"; // the images are named in another order
+  for (vector<string>::const_iterator it = authorList_.begin(); it != authorList_.end(); ++it) key << *it << "\n";
+  for (vector<RootWPage*>::const_iterator it = pageList_.begin(); it != pageList_.end(); ++it) {
+    key << (*it)->getTitle() << " " << (*it)->getAddress() << " " << (*it)->getAlert() << "\n";
+  }
+  return key.str();
+}
 
+// Creates the target directory if it does not exist yet
+bool RootWSite::prepareTargetDirectory() {
   // Check if the directory already exists
   if (boost::filesystem::exists( targetDirectory_ )) {
     if (! boost::filesystem::is_directory(targetDirectory_) ) {
@@ -887,6 +1183,61 @@ bool RootWSite::makeSite(bool verbose) {
       return false;
     }
   }
+  return true;
+}
+
+/**
+ * Dumps the pages added since the last call, when the site renders its images ahead, and starts
+ * printing their images in the background while the pages still to come are being filled.
+ * The text of the images is kept: makeSite() writes the pages with the images printed here.
+ * As the page reuse of makeSite() depends on the whole site, these pages are never reused.
+ * @return False if the target directory could not be created or the canvases could not be written
+ */
+bool RootWSite::renderNewPages() {
+  vector<RootWPage*> pages;
+  pages.swap(newPages_);
+  if (!renderAhead_ || pages.empty()) return true;
+  if (!prepareTargetDirectory()) return false;
+  for (vector<RootWPage*>::iterator it = pages.begin(); it != pages.end(); ++it) {
+    (*it)->setTargetDirectory(targetDirectory_);
+    ostringstream discarded;
+    (*it)->dump(discarded);
+  }
+  return RootWImage::startRenderingQueued(numThreads_);
+}
+
+/**
+ * Writes the text of the pages to their files, in as many threads as the site renders its images with
+ * @param pageFiles The name of every page file, with its text
+ */
+void RootWSite::writePages(const vector<pair<string, string> >& pageFiles) {
+  vector<char> failed(pageFiles.size(), false);
+  atomic<size_t> next(0);
+  auto writer = [&]() {
+    for (size_t i = next++; i < pageFiles.size(); i = next++) {
+      ofstream pageFile(pageFiles[i].first.c_str(), ios::out);
+      pageFile << pageFiles[i].second;
+      pageFile.close();
+      failed[i] = !pageFile;
+    }
+  };
+  vector<thread> threads;
+  for (int i = 1; i < numThreads_ && i < int(pageFiles.size()); i++) threads.push_back(thread(writer));
+  writer();
+  for (auto& t : threads) t.join();
+  for (size_t i = 0; i < pageFiles.size(); i++) {
+    if (failed[i]) cerr << "Warning: RootWSite::makeSite() could not write " << pageFiles[i].first << endl;
+  }
+}
+
+bool RootWSite::makeSite(bool verbose) {
+  vector<pair<string, string> > pageFiles;
+  RootWPage* myPage;
+  string myPageFileName;
+  //string targetStyleDirectory = targetDirectory_ + "/style";
+
+  if (!prepareTargetDirectory()) return false;
+  newPages_.clear();
   
   // Recreate the style symlink
   //if (boost::filesystem::exists( targetStyleDirectory )) {
@@ -894,19 +1245,53 @@ bool RootWSite::makeSite(bool verbose) {
   //}
   //boost::filesystem::create_symlink(styleDirectory_, targetStyleDirectory);
   
+  // The pages written last time with the same inputs, tagged by addPage(), are only dumped
+  // for the names of their images to be the same, while their files are left in place
+  string inputsFileName = targetDirectory_ + "/" + PAGEINPUTSFILE;
+  map<string, string> oldInputKeys, inputKeys;
+  ifstream oldInputsFile(inputsFileName.c_str());
+  string address, inputKey;
+  while (oldInputsFile >> address >> inputKey) oldInputKeys[address] = inputKey;
+  oldInputsFile.close();
+  string siteKey = structureKey();
+
   vector<RootWPage*>::iterator it;
+  int numUnchanged = 0;
   for (it=pageList_.begin(); it!=pageList_.end(); it++) {
     myPage = (*it);
     if (verbose) std::cout << " " << myPage->getTitle() << std::flush;
     myPageFileName = targetDirectory_+"/"+myPage->getAddress();
-    myPageFile.open(myPageFileName.c_str(), ios::out);
     myPage->setTargetDirectory(targetDirectory_);
-    myPage->dump(myPageFile);
-    myPageFile.close();
+    if (!myPage->getInputTag().empty()) {
+      ostringstream key;
+      key << std::hex << std::hash<string>()(siteKey + "\n" + myPage->getTitle() + "\n" + myPage->getInputTag());
+      inputKeys[myPage->getAddress()] = key.str();
+      if (oldInputKeys[myPage->getAddress()] == key.str() && boost::filesystem::exists(myPageFileName)) {
+        size_t firstJob = RootWImage::queuedJobs();
+        ostringstream discarded;
+        myPage->dump(discarded);
+        RootWImage::skipQueuedPrints(firstJob);
+        numUnchanged++;
+        continue;
+      }
+    }
+    // The dump itself stays in order, as it numbers the images and tables of the site
+    ostringstream pageText;
+    myPage->dump(pageText);
+    pageFiles.push_back(make_pair(myPageFileName, pageText.str()));
   }
   if (verbose) std::cout << " ";
-
-  return true;
+  if (numUnchanged) std::cout << numUnchanged << " of the " << pageList_.size() << " pages were up to date" << std::endl;
+  writePages(pageFiles);
+
+  // The pages only refer to the image files, which are printed now
+  bool result = RootWImage::renderQueued(numThreads_);
+  // A page is only known to be up to date once its images are
+  ofstream inputsFile(inputsFileName.c_str(), ios::out);
+  if (result) {
+    for (map<string, string>::const_iterator itKey = inputKeys.begin(); itKey != inputKeys.end(); ++itKey) inputsFile << itKey->first << " " << itKey->second << endl;
+  }
+  return result;
 }
 
 //*******************************************//
@@ -967,10 +1352,62 @@ ostream& RootWTextFile::dump(ostream& output) {
 };
 
 
+//*******************************************//
+// RootWStreamFile                           //
+//*******************************************//
+
+ostream& RootWStreamFile::dump(ostream& output) {
+  if (fileName_=="") {
+    cerr << "Warning: RootWStreamFile::dump() was called without prior setting the destination file name" << endl;
+    return output;
+  }
+
+  static const size_t bufferSize = 1 << 20;
+  std::vector<char> buffer(bufferSize);
+  std::ofstream outputFile;
+  outputFile.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+  string destinationFileName = targetDirectory_ +"/" + fileName_;
+  outputFile.open(destinationFileName.c_str(), binary_ ? ios::out | ios::binary : ios::out);
+  if (!outputFile) {
+    cerr << "Warning: RootWStreamFile::dump() could not open " << destinationFileName << endl;
+    return output;
+  }
+  writer_(outputFile);
+  if (!binary_) outputFile << endl; // as a RootWTextFile ends
+  outputFile.close();
+
+  output << "<b>" << description_ << ":</b> <a href=\""
+         << fileName_ << "\">"
+         << fileName_ << "</a></tt><br/>";
+  return output;
+};
+
+
 //*******************************************//
 // RootWBinaryFile                           //
 //*******************************************//
 
+/**
+ * Puts a file in the site as a hard link to the original, so that the same file shown by several
+ * sites or runs is stored once, or as a copy where the site is on another file system.
+ * Nothing is done if the destination already is the original, or a copy of it not older than it.
+ * @param originalFileName The file to show
+ * @param destinationFileName Where the site shows it
+ */
+void RootWBinaryFile::placeFile(const string& originalFileName, const string& destinationFileName) {
+  namespace bfs = boost::filesystem;
+  if (bfs::exists(destinationFileName)) {
+    if (bfs::equivalent(originalFileName, destinationFileName)) return;
+    if (bfs::is_regular_file(destinationFileName) && bfs::hard_link_count(destinationFileName) == 1 &&
+        bfs::file_size(destinationFileName) == bfs::file_size(originalFileName) &&
+        bfs::last_write_time(destinationFileName) >= bfs::last_write_time(originalFileName)) return;
+    bfs::remove(destinationFileName);
+  }
+  boost::system::error_code linkError;
+  bfs::create_hard_link(originalFileName, destinationFileName, linkError);
+  if (linkError) bfs::copy_file(originalFileName, destinationFileName);
+}
+
 ostream& RootWBinaryFile::dump(ostream& output) {
   if (originalFileName_=="") {
     cerr << "Warning: RootWBinaryFile::dump() was called without prior setting the original file name" << endl;
@@ -985,9 +1422,7 @@ ostream& RootWBinaryFile::dump(ostream& output) {
 
   if (boost::filesystem::exists(originalFileName_) && originalFileName_ != destinationFileName) { // CUIDADO: naive control on copy on itself. it only matches the strings, not taking into account relative paths and symlinks
     try {
-      if (boost::filesystem::exists(destinationFileName))
-        boost::filesystem::remove(destinationFileName);
-      boost::filesystem::copy_file(originalFileName_, destinationFileName);
+      placeFile(originalFileName_, destinationFileName);
     } catch (boost::filesystem::filesystem_error e) {
       cerr << e.what() << endl;
       return output;
@@ -1027,11 +1462,10 @@ ostream& RootWBinaryFileList::dump(ostream& output) {
     //  if (!boost::filesystem::exists(destinationFileName)) boost::filesystem::create_directory(destinationFileName);
     //});
     destinationFileName += "/" + fn; //path.back();
-    if (boost::filesystem::exists(*it) && *it != destinationFileName) { // CUIDADO: naive control on copy on itself. 
+    const string& originalFileName = *it++;
+    if (boost::filesystem::exists(originalFileName) && originalFileName != destinationFileName) { // CUIDADO: naive control on copy on itself. 
       try {
-        if (boost::filesystem::exists(destinationFileName))
-          boost::filesystem::remove(destinationFileName);
-        boost::filesystem::copy_file(*it++, destinationFileName);
+        RootWBinaryFile::placeFile(originalFileName, destinationFileName);
       } catch (boost::filesystem::filesystem_error e) {
         cerr << e.what() << endl;
         return output;
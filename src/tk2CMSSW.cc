@@ -5,6 +5,9 @@
 
 #include <SvnRevision.h>
 #include <tk2CMSSW.h>
+#include <TaskPool.h>
+#include <StopWatch.h>
+#include <chrono>
 
 namespace insur {
     // public
@@ -15,7 +18,8 @@ namespace insur {
      * <i>Extractor</i> and <i>XMLWriter</i>, respectively. This function deals mainly with the file system and makes sure
      * that the generated output files go where they are supposed to go. The user may specify the name of a subdirectory for the
      * output files. If that directory exists, all of its contents will be overwritten by the new files. If no name is given, a default is
-     * used instead.
+     * used instead. The hashes of the inputs are kept next to that directory: an export with the same inputs as the last one is
+     * skipped, and one where only the materials changed only writes the files that depend on them again.
      * @mt A refernce to the global material table
      * @mb A reference to an existing material budget that serves as input to the translation
      * @outsubdir A string with the name of a subfolder for the output; empty by default.
@@ -28,9 +32,24 @@ namespace insur {
         if(outpath.at(outpath.size() - 1) != '/') outpath = outpath + "/";
         std::string tmppath = xmlpath + "/" + xml_tmppath + "/";
 
+        // the output is not written again if its inputs are those it was last written from; if only the materials changed,
+        // only the files which depend on them are
+        std::string manifestFile = outpath.substr(0, outpath.size() - 1) + xml_manifest_suffix;
+        Manifest inputs = exportInputs(xmlpath, wt);
+        Manifest previous = readManifest(manifestFile);
+        bool known = !configFiles_.empty() && !materialFingerprint_.empty() && bfs::exists(outpath);
+        if (known && previous == inputs) {
+            std::cout << "CMSSW XML output in " << outpath << " is up to date with its inputs, it is not written again" << std::endl;
+            return;
+        }
+        bool materialsOnly = known && previous["geometry"] == inputs["geometry"] && previous["templates"] == inputs["templates"];
+
         // analyse tracker system and build up collection of elements, composites, hierarchy, shapes, positions, algorithms and topology
         // ex is an instance of Extractor class
-        ex.analyse(mt, mb, data, wt);
+        {
+            scopeTaskClock("Extractor::analyse");
+            ex.analyse(mt, mb, data, wt);
+        }
 
         std::stringstream extendedHeaderStream;
         std::stringstream simpleHeaderStream;
@@ -39,99 +58,79 @@ namespace insur {
         wr.setExtendedHeader(extendedHeaderStream.str());
         wr.setSimpleHeader(simpleHeaderStream.str());
         
-        // translate collected information to XML and write to buffers
-        std::ifstream instream;
-        std::ofstream outstream;
+        // translate collected information to XML and write it to the files: they only read the collected information, so
+        // each is written by a task of its own, with its own buffer
+        struct OutputFile {
+            std::string templatePath, outputName; // the template of the tracker file is optional
+            bool templateRequired, materialDependent;
+            std::string openError, writeError, written;
+            std::function<void(std::ifstream&, std::ofstream&)> write;
+            double wallSeconds, cpuSeconds; // of the writing, by the thread it was given to
+        };
+        std::vector<OutputFile> files;
+        if (!wt) {
+            files.push_back({ xmlpath + "/" + xml_pixbarfile, xml_pixbarfile, true, false,
+                              "Error opening one of the pixbar files.", "Error writing to pixbar file.", "CMSSW modified pixel barrel has been written to ",
+                              [&](std::ifstream& in, std::ofstream& out) { wr.pixbar(data.shapes, in, out); } });
+            files.push_back({ xmlpath + "/" + xml_pixfwdfile, xml_pixfwdfile, true, false,
+                              "Error opening one of the pixfwdn files.", "Error writing to pixfwd file.", "CMSSW modified pixel endcap has been written to ",
+                              [&](std::ifstream& in, std::ofstream& out) { wr.pixfwd(data.shapes, in, out); } });
+        }
+        files.push_back({ xmlpath + "/" + xml_trackervolumefile, wt ? xml_newtrackerfile : xml_trackerfile, false, true,
+                          "Error opening tracker file for writing.", "Error writing to tracker file.", "CMSSW tracker geometry output has been written to ",
+                          [&](std::ifstream& in, std::ofstream& out) { wr.tracker(data, out, in, wt); } });
+        files.push_back({ xmlpath + "/" + (wt ? xml_newtopologyfile : xml_topologyfile), xml_topologyfile, true, false,
+                          "Error opening one of the topology files.", "Error writing to topology file.", "CMSSW topology output has been written to ",
+                          [&](std::ifstream& in, std::ofstream& out) { wr.topology(data.specs, in, out); } });
+        files.push_back({ xmlpath + "/" + xml_prodcutsfile, xml_prodcutsfile, true, false,
+                          "Error opening one of the prodcuts files.", "Error writing to prodcuts file.", "CMSSW prodcuts output has been written to ",
+                          [&](std::ifstream& in, std::ofstream& out) { wr.prodcuts(data.specs, in, out); } });
+        files.push_back({ xmlpath + "/" + xml_trackersensfile, xml_trackersensfile, true, false,
+                          "Error opening one of the trackersens files.", "Error writing trackersens to file.", "CMSSW sensor surface output has been written to ",
+                          [&](std::ifstream& in, std::ofstream& out) { wr.trackersens(data.specs, in, out); } });
+        files.push_back({ xmlpath + "/" + (wt ? xml_newrecomatfile : xml_recomatfile), xml_recomatfile, true, true,
+                          "Error opening one of the recomaterial files.", "Error writing recomaterial to file.", "CMSSW reco material output has been written to ",
+                          [&](std::ifstream& in, std::ofstream& out) { wr.recomaterial(data.specs, data.lrilength, in, out, wt); } });
+        // the files which do not depend on the materials are taken over from the previous output, if they are there
+        std::vector<bool> kept(files.size(), false);
+        for (unsigned int i = 0; i < files.size(); i++) kept[i] = materialsOnly && !files[i].materialDependent && bfs::exists(outpath + files[i].outputName);
         try {
+            if (bfs::exists(manifestFile)) bfs::remove(manifestFile); // until the new output is complete
             if (bfs::exists(outpath)) bfs::rename(outpath, tmppath);
             bfs::create_directory(outpath);
 
-            if (!wt) {
-                instream.open((xmlpath + "/" + xml_pixbarfile).c_str());
-                outstream.open((outpath + xml_pixbarfile).c_str());
-                if (instream.fail() || outstream.fail()) throw std::runtime_error("Error opening one of the pixbar files.");
-                //writeSimpleHeader(outstream);
-                wr.pixbar(data.shapes, instream, outstream);
-                if (outstream.fail()) throw std::runtime_error("Error writing to pixbar file.");
-                instream.close();
-                instream.clear();
+            scopeTaskClock("XMLWriter output files");
+            TaskPool::instance()->run("XML output files", files.size(), [&](int i) {
+                OutputFile& file = files.at(i);
+                if (kept[i]) {
+                    bfs::copy_file(tmppath + file.outputName, outpath + file.outputName);
+                    return;
+                }
+                std::ifstream instream(file.templatePath.c_str());
+                std::ofstream outstream;
+                std::vector<char> outbuffer(xml_output_buffer_size); // the XML goes straight to the file, in large writes
+                outstream.rdbuf()->pubsetbuf(&outbuffer[0], outbuffer.size());
+                outstream.open((outpath + file.outputName).c_str());
+                if ((file.templateRequired && instream.fail()) || outstream.fail()) throw std::runtime_error(file.openError);
+                std::chrono::steady_clock::time_point wallStart = std::chrono::steady_clock::now();
+                double cpuStart = StopWatch::threadCpuSeconds();
+                file.write(instream, outstream);
+                file.cpuSeconds = StopWatch::threadCpuSeconds() - cpuStart;
+                file.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
                 outstream.close();
-                outstream.clear();
-                std::cout << "CMSSW modified pixel barrel has been written to " << outpath << xml_pixbarfile << std::endl;
-
-                instream.open((xmlpath + "/" + xml_pixfwdfile).c_str());
-                outstream.open((outpath + xml_pixfwdfile).c_str());
-                if (instream.fail() || outstream.fail()) throw std::runtime_error("Error opening one of the pixfwdn files.");
-                //writeSimpleHeader(outstream);
-                wr.pixfwd(data.shapes, instream, outstream);
-                if (outstream.fail()) throw std::runtime_error("Error writing to pixfwd file.");
-                instream.close();
-                instream.clear();
-                outstream.close();
-                outstream.clear();
-                std::cout << "CMSSW modified pixel endcap has been written to " << outpath << xml_pixfwdfile << std::endl;
+                if (outstream.fail()) throw std::runtime_error(file.writeError);
+            }, ex.numThreads());
+            // the sections are timed by the threads writing them, and recorded in the order of the files
+            for (unsigned int i = 0; i < files.size(); i++) {
+                if (!kept[i]) StopWatch::instance()->addTask("XMLWriter " + files[i].outputName, files[i].wallSeconds, files[i].cpuSeconds);
+            }
+            for (unsigned int i = 0; i < files.size(); i++) {
+                if (kept[i]) std::cout << "The materials only changed: " << outpath << files[i].outputName << " has been kept" << std::endl;
+                else std::cout << files[i].written << outpath << files[i].outputName << std::endl;
             }
-            if (wt) outstream.open((outpath + xml_newtrackerfile).c_str());
-            else outstream.open((outpath + xml_trackerfile).c_str());
-            if (outstream.fail()) throw std::runtime_error("Error opening tracker file for writing.");
-            std::ifstream trackerVolumeTemplate((xmlpath + "/" + xml_trackervolumefile).c_str());
-            wr.tracker(data, outstream, trackerVolumeTemplate, wt);
-            if (outstream.fail()) throw std::runtime_error("Error writing to tracker file.");
-            outstream.close();
-            outstream.clear();
-            std::cout << "CMSSW tracker geometry output has been written to " << outpath << (wt ? xml_newtrackerfile : xml_trackerfile) << std::endl;
-
-            if (wt) instream.open((xmlpath + "/" + xml_newtopologyfile).c_str());
-            else instream.open((xmlpath + "/" + xml_topologyfile).c_str());
-            outstream.open((outpath + xml_topologyfile).c_str());
-            if (instream.fail() || outstream.fail()) throw std::runtime_error("Error opening one of the topology files.");
-            //writeSimpleHeader(outstream);
-            wr.topology(data.specs, instream, outstream);
-            if (outstream.fail()) throw std::runtime_error("Error writing to topology file.");
-            instream.close();
-            instream.clear();
-            outstream.close();
-            outstream.clear();
-            std::cout << "CMSSW topology output has been written to " << outpath << xml_topologyfile << std::endl;
-
-            instream.open((xmlpath + "/" + xml_prodcutsfile).c_str());
-            outstream.open((outpath + xml_prodcutsfile).c_str());
-            if (instream.fail() || outstream.fail()) throw std::runtime_error("Error opening one of the prodcuts files.");
-            //writeSimpleHeader(outstream);
-            wr.prodcuts(data.specs, instream, outstream);
-            if (outstream.fail()) throw std::runtime_error("Error writing to prodcuts file.");
-            instream.close();
-            instream.clear();
-            outstream.close();
-            outstream.clear();
-            std::cout << "CMSSW prodcuts output has been written to " << outpath << xml_prodcutsfile << std::endl;
-
-            instream.open((xmlpath + "/" + xml_trackersensfile).c_str());
-            outstream.open((outpath + xml_trackersensfile).c_str());
-            if (instream.fail() || outstream.fail()) throw std::runtime_error("Error opening one of the trackersens files.");
-            //writeSimpleHeader(outstream);
-            wr.trackersens(data.specs, instream, outstream);
-            if (outstream.fail()) throw std::runtime_error("Error writing trackersens to file.");
-            instream.close();
-            instream.clear();
-            outstream.close();
-            outstream.clear();
-            std::cout << "CMSSW sensor surface output has been written to " << outpath << xml_trackersensfile << std::endl;
-
-            if (wt) instream.open((xmlpath + "/" + xml_newrecomatfile).c_str());
-            else instream.open((xmlpath + "/" + xml_recomatfile).c_str());
-            outstream.open((outpath + xml_recomatfile).c_str());
-            if (instream.fail() || outstream.fail()) throw std::runtime_error("Error opening one of the recomaterial files.");
-            //writeSimpleHeader(outstream);
-            wr.recomaterial(data.specs, data.lrilength, instream, outstream, wt);
-            if (outstream.fail()) throw std::runtime_error("Error writing recomaterial to file.");
-            instream.close();
-            instream.clear();
-            outstream.close();
-            outstream.clear();
-            std::cout << "CMSSW reco material output has been written to " << outpath << xml_recomatfile << std::endl;
 
             bfs::remove_all(tmppath);
+            writeManifest(manifestFile, inputs);
         }
         catch (std::runtime_error& e) {
             std::cerr << "Error writing files: " << e.what() << std::endl;
@@ -142,6 +141,74 @@ namespace insur {
     }
     
     // private
+    /**
+     * This identifies what an export is written from: the geometry (the configuration files, with all their includes, and
+     * the revision of the program), the materials (the material table and the inputs set with <i>materialFingerprint()</i>)
+     * and the templates of the output files.
+     * @param xmlpath The directory of the templates
+     * @param wt The flag of the translation, which changes the templates and the output
+     * @return The hash of each kind of input
+     */
+    tk2CMSSW::Manifest tk2CMSSW::exportInputs(const std::string& xmlpath, bool wt) const {
+        Manifest inputs;
+        std::ostringstream geometry;
+        for (const ConfigFile& file : configFiles_) geometry << file.name << '\n' << file.content << '\n';
+        geometry << SvnRevision::revisionNumber << (wt ? " wt" : "");
+        std::ostringstream hash;
+        hash << std::hex << std::hash<std::string>()(geometry.str());
+        inputs["geometry"] = hash.str();
+        inputs["materials"] = fileFingerprint(mainConfiguration.getMattabDirectory() + "/" + default_mattabfile) + " " + materialFingerprint_;
+        std::string templates;
+        for (const std::string& name : { xml_pixbarfile, xml_pixfwdfile, xml_trackervolumefile, wt ? xml_newtopologyfile : xml_topologyfile,
+                                         xml_prodcutsfile, xml_trackersensfile, wt ? xml_newrecomatfile : xml_recomatfile }) {
+            templates += fileFingerprint(xmlpath + "/" + name) + " ";
+        }
+        inputs["templates"] = templates;
+        return inputs;
+    }
+
+    /**
+     * This reads the inputs an export was last written from.
+     * @param fileName The manifest next to the output directory
+     * @return The hash of each kind of input, none if there is no manifest
+     */
+    tk2CMSSW::Manifest tk2CMSSW::readManifest(const std::string& fileName) const {
+        Manifest inputs;
+        std::ifstream in(fileName.c_str());
+        std::string line;
+        while (std::getline(in, line)) {
+            size_t separator = line.find(' ');
+            if (separator != std::string::npos) inputs[line.substr(0, separator)] = line.substr(separator + 1);
+        }
+        return inputs;
+    }
+
+    /**
+     * This records the inputs an export was written from, one kind per line.
+     * @param fileName The manifest next to the output directory
+     * @param inputs The hash of each kind of input
+     */
+    void tk2CMSSW::writeManifest(const std::string& fileName, const Manifest& inputs) const {
+        std::ofstream out(fileName.c_str());
+        for (const auto& input : inputs) out << input.first << " " << input.second << std::endl;
+        if (out.fail()) std::cerr << "Error writing the manifest " << fileName << ": the next export will be complete" << std::endl;
+    }
+
+    /**
+     * This identifies the content of a file.
+     * @param fileName The name of the file
+     * @return The hash of the content, in hex, or "missing" if the file cannot be read
+     */
+    std::string tk2CMSSW::fileFingerprint(const std::string& fileName) {
+        std::ifstream file(fileName.c_str());
+        if (!file) return "missing";
+        std::ostringstream content;
+        content << file.rdbuf();
+        std::ostringstream fingerprint;
+        fingerprint << std::hex << std::hash<std::string>()(content.str());
+        return fingerprint.str();
+    }
+
     /**
      * This prints the contents of the internal CMSSWBundle collection; used for debugging.
      */
@@ -0,0 +1,210 @@
+/**
+ * @file tkbench.cpp
+ * @brief This is the benchmark program for the analysis hot paths of tklayout, run on a fixed reference layout
+ *
+ * Each benchmark prints one line made of space separated key=value pairs, e.g.
+ * <pre>bench=checkTrackHits items=1000 unit=tracks seconds=0.52 rate=1923.1 modules_per_s=2.9e+07</pre>
+ * so that the results of two revisions can be compared (or plotted) with a plain text tool.
+ * The times are wall clock times, the random numbers are drawn from a fixed seed.
+ */
+
+#include <boost/program_options.hpp>
+#include <stdlib.h>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include <Squid.h>
+#include <PtErrorAdapter.h>
+#include <hit.hh>
+#include "StopWatch.h"
+
+namespace po = boost::program_options;
+
+namespace {
+
+  typedef std::chrono::steady_clock BenchClock;
+
+  double secondsSince(const BenchClock::time_point& start) {
+    return std::chrono::duration<double>(BenchClock::now() - start).count();
+  }
+
+  /**
+   * Print the result of a benchmark as a single line of key=value pairs
+   * @param name The name of the benchmark
+   * @param items The number of items processed
+   * @param unit What the items are (tracks, modules, points...)
+   * @param seconds The time the benchmark took
+   * @param moduleChecks The number of track-module tests performed, if any, to report the modules/s too
+   */
+  void report(const std::string& name, long items, const std::string& unit, double seconds, long moduleChecks = 0) {
+    std::cout << "bench=" << name << " items=" << items << " unit=" << unit << " seconds=" << seconds
+              << " rate=" << (seconds > 0 ? items/seconds : 0.);
+    if (moduleChecks > 0) std::cout << " modules_per_s=" << (seconds > 0 ? moduleChecks/seconds : 0.);
+    std::cout << std::endl;
+  }
+
+  struct BenchDirection {
+    double eta, theta, phi;
+    XYZVector direction;
+  };
+
+  std::vector<BenchDirection> drawDirections(int n, double maxEta, unsigned int seed) {
+    std::mt19937 engine(seed);
+    std::uniform_real_distribution<double> etaDist(-maxEta, maxEta), phiDist(0., 2*M_PI);
+    std::vector<BenchDirection> result(n);
+    for (BenchDirection& d : result) {
+      d.eta = etaDist(engine);
+      d.phi = phiDist(engine);
+      d.theta = 2*atan(exp(-d.eta));
+      d.direction = XYZVector(sin(d.theta)*cos(d.phi), sin(d.theta)*sin(d.phi), cos(d.theta));
+    }
+    return result;
+  }
+
+}
+
+int main(int argc, char* argv[]) {
+  std::string usage("Usage: ");
+  usage += argv[0];
+  usage += " <geometry file> [options]";
+  std::string basename;
+  int tracks, geomtracks, mattracks, threads;
+  unsigned int seed;
+
+  po::options_description shown("Benchmark options");
+  shown.add_options()
+    ("help,h", "Display this help message.")
+    ("tracks", po::value<int>(&tracks)->default_value(2000), "N. of tracks for the micro-benchmarks.")
+    ("geometry-tracks,n", po::value<int>(&geomtracks)->default_value(1000), "N. of tracks for the geometry analysis pass.")
+    ("material-tracks,N", po::value<int>(&mattracks)->default_value(100), "N. of tracks for the material analysis pass.")
+    ("threads,j", po::value<int>(&threads)->default_value(1), "N. of threads of the analysis passes.")
+    ("randseed", po::value<unsigned int>(&seed)->default_value(0xcafebabe), "Set the random seed of the benchmark tracks.")
+    ("no-material", "Skip the material budget build and analysis.")
+    ;
+  po::options_description hidden;
+  hidden.add_options()("base-name", po::value<std::string>(&basename));
+  po::positional_options_description posopt;
+  posopt.add("base-name", 1);
+  po::options_description mainopt;
+  mainopt.add(shown).add(hidden);
+
+  po::variables_map vm;
+  try {
+    po::store(po::command_line_parser(argc, argv).options(mainopt).positional(posopt).run(), vm);
+    po::notify(vm);
+    if (tracks < 1) throw po::invalid_option_value("tracks");
+    if (geomtracks < 1) throw po::invalid_option_value("geometry-tracks");
+    if (mattracks < 1) throw po::invalid_option_value("material-tracks");
+    if (threads < 1) throw po::invalid_option_value("threads");
+    if (!vm.count("base-name") && !vm.count("help")) throw po::error("Missing geometry file");
+  } catch(po::error e) {
+    std::cerr << "\nERROR: " << e.what() << std::endl << std::endl;
+    std::cout << usage << std::endl << shown << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (vm.count("help")) {
+    std::cout << usage << std::endl << shown << std::endl;
+    return 0;
+  }
+
+  // Only the benchmark lines go to the standard output
+  StopWatch::instance()->setVerbosity(0, false);
+
+  insur::Squid squid;
+  squid.setCommandLine(argc, argv);
+  squid.setGeometryFile(basename);
+  squid.setNumThreads(threads);
+
+  BenchClock::time_point start = BenchClock::now();
+  if (!squid.buildTracker()) return EXIT_FAILURE;
+  const Tracker& tracker = *squid.tracker();
+  const Tracker::Modules& modules = tracker.modules();
+  report("buildTracker", modules.size(), "modules", secondsSince(start));
+
+  std::vector<BenchDirection> directions = drawDirections(tracks, 2.5, seed);
+  XYZVector origin;
+
+  // Sensor hit tests, every track against every module, the way the brute force geometry scan does
+  std::vector<std::vector<std::pair<Module*, std::pair<XYZVector, HitType> > > > trackHits(directions.size());
+  start = BenchClock::now();
+  for (size_t i = 0; i < directions.size(); i++) {
+    for (Module* m : modules) {
+      std::pair<XYZVector, HitType> h = m->checkTrackHits(origin, directions[i].direction);
+      if (h.second != NONE) trackHits[i].push_back(std::make_pair(m, h));
+    }
+  }
+  report("checkTrackHits", directions.size(), "tracks", secondsSince(start), directions.size()*modules.size());
+
+  long intersections = 0;
+  start = BenchClock::now();
+  for (const BenchDirection& d : directions) {
+    for (const Module* m : modules) if (m->basePoly().isLineIntersecting(origin, d.direction)) intersections++;
+  }
+  report("isLineIntersecting", directions.size(), "tracks", secondsSince(start), directions.size()*modules.size());
+
+  // The same straight tracks with their active hits, errors computed for a handful of momenta
+  std::vector<double> momenta = { 1., 2., 5., 10., 100. };
+  std::vector<Track> fitTracks;
+  for (size_t i = 0; i < directions.size(); i++) {
+    Track track;
+    track.setTheta(directions[i].theta);
+    track.setPhi(directions[i].phi);
+    for (const auto& mh : trackHits[i]) track.addHit(Hit(mh.second.first.R(), mh.first, mh.second.second));
+    track.sort();
+    if (track.nActiveHits(true) > 2) fitTracks.push_back(std::move(track));
+  }
+  start = BenchClock::now();
+  for (const Track& track : fitTracks) track.computeErrors(momenta);
+  report("computeErrors", fitTracks.size()*momenta.size(), "tracks", secondsSince(start));
+
+  // Irradiation lookups at the module centres, one at a time and in a batch
+  const IrradiationMapsManager& irradiation = squid.simParms()->irradiationMapsManager();
+  std::vector<double> zs, rhos;
+  for (const Module* m : modules) {
+    zs.push_back(m->center().Z());
+    rhos.push_back(m->center().Rho());
+  }
+  std::vector<double> fluences(zs.size());
+  double fluenceSum = 0;
+  start = BenchClock::now();
+  for (size_t i = 0; i < zs.size(); i++) fluenceSum += irradiation.calculateIrradiationPower(std::make_pair(zs[i], rhos[i]));
+  report("calculateIrradiation", zs.size(), "points", secondsSince(start));
+  start = BenchClock::now();
+  irradiation.calculateIrradiationPower(zs.data(), rhos.data(), fluences.data(), zs.size());
+  report("calculateIrradiationBatch", zs.size(), "points", secondsSince(start));
+
+  long probabilities = 0;
+  double probabilitySum = 0;
+  start = BenchClock::now();
+  for (const Module* m : modules) {
+    if (m->dsDistance() <= 0) continue;
+    PtErrorAdapter pterr(*m);
+    for (double pt : momenta) {
+      probabilitySum += pterr.getTriggerProbability(pt);
+      probabilities++;
+    }
+  }
+  report("getTriggerProbability", probabilities, "modules", secondsSince(start));
+
+  start = BenchClock::now();
+  if (!squid.pureAnalyzeGeometry(geomtracks)) return EXIT_FAILURE;
+  report("pureAnalyzeGeometry", geomtracks, "tracks", secondsSince(start));
+
+  if (!vm.count("no-material")) {
+    start = BenchClock::now();
+    if (!squid.buildMaterials(false) || !squid.createMaterialBudget(false)) return EXIT_FAILURE;
+    report("buildMaterials", modules.size(), "modules", secondsSince(start));
+
+    start = BenchClock::now();
+    if (!squid.pureAnalyzeMaterialBudget(mattracks, true, false)) return EXIT_FAILURE;
+    report("pureAnalyzeMaterialBudget", mattracks, "tracks", secondsSince(start));
+  }
+
+  // Keeps the results of the loops above alive, and gives a quick sanity check between revisions
+  std::cout << "checksum intersections=" << intersections << " fits=" << fitTracks.size()
+            << " fluence=" << fluenceSum << " probability=" << probabilitySum << std::endl;
+
+  return 0;
+}
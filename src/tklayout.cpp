@@ -1,22 +1,216 @@
 #include <boost/program_options.hpp> 
+#include <boost/algorithm/string/replace.hpp>
 #include <stdlib.h>
+#include <fstream>
+#include <functional>
 #include <iostream>
+#include <map>
+#include <set>
 #include <string>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
 #include <Squid.h>
+#include <PathCounters.h>
+#include <TaskPool.h>
+#include <StopWatch.h>
+#include <ProgressMeter.h>
+#include <RunEstimate.h>
+#include <LayoutComparison.h>
 #include "SvnRevision.h"
 
 namespace po = boost::program_options;
 
+namespace {
+
+  // The name of a layout of a batch, for its log and report files
+  std::string layoutName(const std::string& geometryFile) {
+    return boost::filesystem::path(geometryFile).stem().string();
+  }
+
+  // A report file of a batch, named after the layout: perf.json becomes perf-<layout>.json
+  std::string layoutFileName(const std::string& fileName, const std::string& geometryFile) {
+    boost::filesystem::path path(fileName);
+    return (path.parent_path() / (path.stem().string() + "-" + layoutName(geometryFile) + path.extension().string())).string();
+  }
+
+  /**
+   * Read the geometry files of a batch
+   * @param fileName The name of the list, with one geometry file per line; empty lines and lines starting with '#' are skipped
+   * @param layouts The list the geometry files are appended to
+   * @return True if the list could be read and is not empty
+   */
+  bool readBatchFile(const std::string& fileName, std::vector<std::string>& layouts) {
+    std::ifstream batchStream(fileName.c_str());
+    if (!batchStream) {
+      logERROR("Could not open the batch file " + fileName);
+      return false;
+    }
+    std::string line;
+    while (std::getline(batchStream, line)) {
+      line = trim(line);
+      if (!line.empty() && line[0] != '#') layouts.push_back(line);
+    }
+    if (layouts.empty()) logERROR("The batch file " + fileName + " lists no geometry file");
+    return !layouts.empty();
+  }
+
+  /**
+   * Write the geometry files of a parameter sweep, next to their template so that the includes are found the same way.
+   * Every combination of the values of the parameters gives a file, where each @name@ of the template is replaced by
+   * a value of the parameter 'name'; it is named after the template and the values, e.g. tracker_layers-5_pitch-90.cfg
+   * @param templateFile The geometry file used as a template
+   * @param sweeps The parameters, as name=value1,value2,...
+   * @param layouts The list the geometry files are appended to
+   * @return True if the sweeps could be parsed and the files written
+   */
+  bool makeSweepLayouts(const std::string& templateFile, const std::vector<std::string>& sweeps, std::vector<std::string>& layouts) {
+    std::ifstream templateStream(templateFile.c_str());
+    if (!templateStream) {
+      logERROR("Could not open the sweep template " + templateFile);
+      return false;
+    }
+    std::string templateText((std::istreambuf_iterator<char>(templateStream)), std::istreambuf_iterator<char>());
+    std::vector<std::pair<std::string, std::vector<std::string> > > parameters;
+    for (const std::string& sweep : sweeps) {
+      auto assignment = split(sweep, "=");
+      std::vector<std::string> values = assignment.size() == 2 ? split(assignment[1], ",") : std::vector<std::string>();
+      if (assignment.size() != 2 || trim(assignment[0]).empty() || values.empty()) {
+        logERROR("Malformed sweep '" + sweep + "': expected name=value1,value2,...");
+        return false;
+      }
+      std::string name = trim(assignment[0]);
+      if (templateText.find("@" + name + "@") == std::string::npos) logWARNING("The sweep template " + templateFile + " has no @" + name + "@ to replace");
+      parameters.push_back(std::make_pair(name, values));
+    }
+
+    boost::filesystem::path templatePath(templateFile);
+    std::vector<size_t> index(parameters.size(), 0);
+    for (bool more = true; more; ) {
+      std::string text = templateText, suffix;
+      for (size_t i = 0; i < parameters.size(); i++) {
+        const std::string& value = trim(parameters[i].second[index[i]]);
+        text = boost::algorithm::replace_all_copy(text, "@" + parameters[i].first + "@", value);
+        suffix += "_" + parameters[i].first + "-" + value;
+      }
+      std::string layoutFile = (templatePath.parent_path() / (templatePath.stem().string() + suffix + templatePath.extension().string())).string();
+      std::ofstream layoutStream(layoutFile.c_str());
+      if (!(layoutStream << text)) {
+        logERROR("Could not write the sweep layout " + layoutFile);
+        return false;
+      }
+      layouts.push_back(layoutFile);
+      // next combination, the last parameter changing fastest
+      more = false;
+      for (size_t i = parameters.size(); i-- > 0; ) {
+        if (++index[i] < parameters[i].second.size()) { more = true; break; }
+        index[i] = 0;
+      }
+    }
+    return true;
+  }
+
+  // Read the inputs which are the same for all the layouts of a batch before forking them, so that they all share them:
+  // they are read concurrently
+  void preloadSharedInputs() {
+    mainConfigHandler::instance().getConfiguration();
+    for (std::future<void>& load : insur::Squid::loadSharedInputs()) load.get();
+  }
+
+  /**
+   * Build, before forking the layouts of a batch, the stages most of them have in common, so that they inherit them:
+   * among the layouts, the one whose trackers are shared by the most others is built, up to its materials or its
+   * material budget if the layouts need them. Each layout then keeps the trackers (and their materials) whose key is
+   * unchanged and only builds the others, e.g. a sweep of a pixel parameter routes the materials of the outer tracker once.
+   * @param squid The squid the stages are built in
+   * @param layouts The geometry files
+   * @param materials Whether the layouts need the materials
+   * @param materialBudget Whether the layouts need the material budget
+   * @param setupSquid The setup of the squid for a layout, returning false on errors
+   */
+  void buildSharedStages(insur::Squid& squid, const std::vector<std::string>& layouts, bool materials, bool materialBudget,
+                         const std::function<bool(insur::Squid&, const std::string&)>& setupSquid) {
+    std::vector<std::map<std::string, std::size_t> > keys(layouts.size());
+    std::map<std::pair<std::string, std::size_t>, int> sharing; // number of layouts a tracker is built the same in
+    for (size_t i = 0; i < layouts.size(); i++) {
+      if (!squid.stageKeys(layouts[i], keys[i])) return;
+      for (const auto& key : keys[i]) sharing[key]++;
+    }
+    size_t reference = 0;
+    int shared = 0;
+    for (size_t i = 0; i < layouts.size(); i++) {
+      int score = 0;
+      for (const auto& key : keys[i]) score += sharing[key] - 1;
+      if (score > shared) { reference = i; shared = score; }
+    }
+    if (!shared) return; // nothing in common
+    std::cout << "Building the stages shared with the other layouts from " << layouts[reference] << std::endl;
+    if (!setupSquid(squid, layouts[reference]) || !squid.buildTracker() ||
+        (materials && !squid.buildMaterials()) || (materialBudget && !squid.createMaterialBudget()))
+      logWARNING("The shared stages could not be built from " + layouts[reference] + ": every layout builds its own");
+  }
+
+  /**
+   * Process the layouts of a batch, each in a process of its own forked from this one, at most a given number at a time.
+   * When several run at the same time, the output of each goes to <layout>.log in the current directory.
+   * @param layouts The geometry files
+   * @param jobs The maximum number of layouts processed at the same time
+   * @param runLayout The pipeline of one layout, returning the exit status
+   * @return EXIT_SUCCESS if all the layouts succeeded, EXIT_FAILURE otherwise
+   */
+  int runBatch(const std::vector<std::string>& layouts, int jobs, const std::function<int(const std::string&)>& runLayout) {
+    std::map<pid_t, std::string> running;
+    int failures = 0, done = 0;
+    auto waitOne = [&]() {
+      int status;
+      pid_t pid = wait(&status);
+      if (pid < 0) return;
+      bool success = WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS;
+      if (!success) failures++;
+      std::cout << "[" << ++done << "/" << layouts.size() << "] " << running[pid] << (success ? " done" : " FAILED")
+                << (jobs > 1 ? " (log in " + layoutName(running[pid]) + ".log)" : "") << std::endl;
+      running.erase(pid);
+    };
+    for (const std::string& layout : layouts) {
+      while ((int)running.size() >= jobs) waitOne();
+      std::cout << std::flush;
+      std::cerr << std::flush;
+      pid_t pid = fork();
+      if (pid == 0) {
+        if (jobs > 1) {
+          std::string logFile = layoutName(layout) + ".log";
+          if (!freopen(logFile.c_str(), "w", stdout) || dup2(fileno(stdout), fileno(stderr)) < 0) _exit(EXIT_FAILURE);
+        }
+        exit(runLayout(layout));
+      } else if (pid < 0) {
+        logERROR("Could not start a process for the layout " + layout);
+        failures++;
+        done++;
+        continue;
+      }
+      running[pid] = layout;
+    }
+    while (!running.empty()) waitOne();
+    if (failures) std::cerr << failures << " of the " << layouts.size() << " layouts failed" << std::endl;
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+  }
+
+}
+
 int main(int argc, char* argv[]) {
   std::string usage("Usage: ");
   usage += argv[0];
   usage += " <geometry file> [options]";
-  int geomtracks, mattracks;
+  int geomtracks, mattracks, resolutionbins;
   //std::vector<int> tracksim;
   int verbosity;
   int randseed; 
+  int threads, processes;
+  int jobs;
+  double geomprecision, geompt, checkpointminutes, progressseconds;
+  std::vector<std::string> sweeps, shardfiles;
 
-  std::string basename, optfile, xmldir, htmldir;
+  std::string basename, optfile, xmldir, htmldir, powerscan, pileupscan, readoutwhatif, geomregion, geomindex, perffile, tracefile, whatiffile, imageformats, rastermaps, batchfile, shard, checkpointfile, trackcachefile, timebudget, resultsfile, resultscompression, resultsjson, trackrecords, progressfile;
   
   po::options_description shown("Analysis options");
   shown.add_options()
@@ -24,22 +218,69 @@ int main(int argc, char* argv[]) {
     ("opt-file", po::value<std::string>(&optfile)->implicit_value(""), "Specify an option file to parse program options from, in addition to the command line")
     ("geometry-tracks,n", po::value<int>(&geomtracks)->default_value(100), "N. of tracks for geometry calculations.")
     ("material-tracks,N", po::value<int>(&mattracks)->default_value(100), "N. of tracks for material calculations.")
+    ("geometry-region", po::value<std::string>(&geomregion), "Only shoot the geometry tracks in a region of interest,\ne.g. eta=0:1.5,phi=0:0.785 (phi in rad)")
+    ("geometry-index", po::value<std::string>(&geomindex), "Size of the lookup of the modules a geometry track may\nhit, e.g. z=4,bins=2: the number of slices of the track\norigins, and of (eta, phi) bins per slice relative to\nthe number of modules (default z=1,bins=1).")
+    ("geometry-precision", po::value<double>(&geomprecision), "Stop shooting the geometry tracks once the relative error\nof every bin of the coverage profile is below this value;\n'n' is then the maximum number of tracks.")
+    ("time-budget", po::value<std::string>(&timebudget), "Give the track scans this many seconds rather than a\nnumber of tracks: shared evenly among the geometry and\nmaterial scans, or per scan as geometry=S,material=S.\nThe tracks shot are reported on the info page.")
+    ("geometry-pt", po::value<double>(&geompt), "Shoot the geometry tracks as charged particles of this\npt [GeV/c], which follow their helix in the field\n(alternately of either charge) instead of straight lines.")
+    ("quasi-random", "Shoot the geometry and material tracks along a Halton\nlow-discrepancy sequence of directions, instead of\nrandom ones.")
+    ("phi-symmetry", "Shoot the material tracks within the smallest phi\nperiod the modules repeat with, instead of all around.")
+    ("resolution-bins", po::value<int>(&resolutionbins)->default_value(0), "Average the points of the resolution plots in this\nmany eta bins, instead of keeping one point per track\n(0: one point per track).")
+    ("single-pass", "Let the resolution and trigger scans take the hits of\nthe material tracks instead of shooting their own, so\nthat the hits of each track are looked for once.")
+    ("stratified-eta", "Shoot the geometry tracks in equal eta slices, with\nthe same number of tracks in each slice.")
     ("power,p", "Report irradiated power analysis.")
+    ("power-scan", po::value<std::string>(&powerscan), "Also report the irradiated power over a grid of\noperating points, e.g. temp=-30:-10:5,lumi=1000:4000:500\n(parameters: lumi, temp, voltage; implies 'p')")
     ("bandwidth,b", "Report base bandwidth analysis.")
     ("bandwidth-cpu,B", "Report multi-cpu bandwidth analysis.\n\t(implies 'b')")
+    ("pileup-scan", po::value<std::string>(&pileupscan), "Also report the bandwidth and the trigger rates at\nthese pile-ups, in one pass, e.g. 140,200,250\n(implies 'b')")
+    ("readout-whatif", po::value<std::string>(&readoutwhatif), "Also report the bandwidth and the trigger rates for the\nvariants of this file, without building the tracker again:\nlines 'variant name' start a variant, lines 'moduleType\nproperty value' change the trigger window or the header\nor payload bits of a type.")
     ("material,m", "Report materials and weights analyses.")
+    ("material-whatif", po::value<std::string>(&whatiffile), "Report the material budget reweighted with the changes of\nthis file, without routing the materials again: lines\n'name density rad_length int_length' replace a material,\nlines 'component name factor' scale its masses (implies 'm')")
     ("resolution,r", "Report resolution analysis.")
+    ("fast-resolution", "Estimate the resolutions of 'resolution' analytically,\nfrom the radii, material and resolutions of the\nlayers and disks, instead of fitting tracks: for\nscreening layouts (implies 'r').")
     ("trigger,t", "Report base trigger analysis.")
     ("trigger-ext,T", "Report extended trigger analysis.\n\t(implies 't')")
     ("debug-services,d", "Service routing debug page")
     ("all,a", "Report all analyses, except extended\ntrigger and debug page. (implies all other relevant\nreport options)")
     ("graph,g", "Build and report neighbour graph.")
     ("xml", po::value<std::string>(&xmldir)->implicit_value(""), "Produce XML output files for materials.\nOptional arg specifies the subdirectory\nof the output directory (chosen via inst\nscript) where to create XML files.\nIf not supplied, the config file name (minus extension)\nwill be used as subdir.")
+    ("image-formats", po::value<std::string>(&imageformats)->default_value("pdf,root"), "Formats the plots of the website are saved in,\nbesides PNG (comma separated; empty for PNG only).")
+    ("lazy-image-formats", "Only render the PNG plots of the website: the other\nformats are kept as canvases in canvases.root and\nrendered on demand with bin/renderimages.")
+    ("pipeline-reports", "Render the plots of each report in the background as\nsoon as it is made, while the next analyses run,\nrather than all of them when the website is written.")
+    ("raster-maps", po::value<std::string>(&rastermaps)->default_value("auto"), "Draw the module maps of values as a raster instead\nof one outline per module: auto (for big layouts),\nalways or never.")
     ("html-dir", po::value<std::string>(&htmldir), "Override the default html output dir\n(equal to the tracker name in the main\ncfg file) with the one specified.")
     ("verbosity", po::value<int>(&verbosity)->default_value(1), "Levels of details in the program's output (overridden by the option 'quiet').")
     ("quiet", "No output is produced, except the required messages (equivalent to verbosity 0, overrides the option 'verbosity')")
-    ("performance", "Outputs the CPU time needed for each computing step (overrides the option 'quiet').")
+    ("performance", "Outputs the wall clock and CPU time needed for each computing step (overrides the option 'quiet'),\nthe use of the threads by each parallel stage and the heap memory held by each subsystem.")
+    ("performance-file", po::value<std::string>(&perffile), "Also write the time, peak memory and heap allocations\nof each computing step to this file, as JSON if its\nname ends by .json and as CSV otherwise.")
+    ("progress", "Print the progress of the long track scans (tracks\ndone, tracks/s, time left and resident memory)\nevery 'progress-interval' seconds.")
+    ("progress-file", po::value<std::string>(&progressfile), "Rewrite this file with the progress of the running\ntrack scan as JSON, every 'progress-interval' seconds.")
+    ("progress-interval", po::value<double>(&progressseconds)->default_value(10), "Seconds between two progress reports of a track scan.")
+    ("counters", "Print the hot path counters and timers at exit\n(needs a build with 'make COUNTERS=1').")
+    ("trace-file", po::value<std::string>(&tracefile), "Write the timed scopes of the hot paths to this file,\nin the Chrome trace-event format (needs a build with\n'make COUNTERS=1').")
     ("randseed", po::value<int>(&randseed)->default_value(0xcafebabe), "Set the random seed\nIf explicitly set to 0, seed is random")
+    ("batch", po::value<std::string>(&batchfile), "Process each geometry file listed in this file (one per\nline) instead of the geometry file, each with the\nsame options and in a process of its own.")
+    ("sweep", po::value<std::vector<std::string> >(&sweeps)->composing(), "Process the geometry file as a template, once per\nvalue: name=value1,value2,... replaces @name@.\nRepeat it to sweep all the combinations.")
+    ("compare", "Shoot the same geometry and material tracks through\neach layout of the batch or sweep, and compare each\nlayout with the first track by track, writing\n<first>_vs_<layout>.root (needs a fixed 'randseed' and\nthe eta range of 'geometry-region').")
+    ("jobs", po::value<int>(&jobs)->default_value(1), "N. of layouts of a batch or sweep processed at the\nsame time (each logging to <layout>.log if more than 1).")
+    ("shard", po::value<std::string>(&shard), "Only scan the material budget with shard i/N of the\nmaterial tracks, writing the scan to\n<layout>_shard-<i>of<N>.root for a later --merge;\ntakes the material options of the merge.")
+    ("merge", po::value<std::vector<std::string> >(&shardfiles)->multitoken(), "Take the material budget scans from the files of\nall the shards, instead of shooting the material\ntracks, and report as usual.")
+    ("checkpoint", po::value<std::string>(&checkpointfile), "Checkpoint the material budget scan to this file as it\ngoes, for an interrupted run to be resumed.")
+    ("checkpoint-interval", po::value<double>(&checkpointminutes)->default_value(15), "Minutes between two checkpoints of the material\nbudget scan.")
+    ("resume", "Resume the material budget scan from its checkpoint,\nif there is one: the result is the one of an\nuninterrupted run (needs 'checkpoint').")
+    ("track-cache", po::value<std::string>(&trackcachefile), "Keep the hits of the resolution tracks in this file,\nfor a later run to compute the resolutions again from\nthem with 'reuse-track-cache'.")
+    ("reuse-track-cache", "Take the hits of the resolution tracks from the\n'track-cache' file if it holds the tracks of this\nlayout, only computing their resolutions (with the\nmomenta, efficiencies and IP constraint of this run):\nthe material budget is then scanned for its report\nonly.")
+    ("results-file", po::value<std::string>(&resultsfile), "Also write the coverage histograms of the geometry scan\nand the material budget scans to this ROOT file.")
+    ("results-json", po::value<std::string>(&resultsjson), "Also write the coverage, the radiation and interaction\nlengths per eta bin, the bandwidth and the power tables\nof the analyses run to this JSON file.")
+    ("no-site", "Only run the analyses, without making the website or\nany plot: the results go to 'results-json' and\n'results-file'.")
+    ("track-records", po::value<std::string>(&trackrecords), "Also write a record of each material and resolution\ntrack (eta, phi, z0, radiation and interaction length,\nhits and the errors at each momentum) to the trees of\nthis ROOT file, as the scans go.")
+    ("results-compression", po::value<std::string>(&resultscompression)->default_value("zlib:1"), "Compression of the results file: zlib:L, lzma:L or\nlz4:L with L from 0 (none) to 9.")
+    ("estimate", "Only estimate the wall time, CPU time and peak memory\nof the run on this machine, from the builds and from\nscans of a few tracks, instead of making the reports.")
+    ("threads,j", po::value<int>(&threads)->default_value(1), "N. of threads the track scans, the tracker build, the module analyses, the service routing, the XML extraction and the website images are split across (at most the CPUs available to the process).")
+    ("processes", po::value<int>(&processes)->default_value(1), "N. of worker processes the material tracks are shot in,\neach forked after the material budget is built, with a\nshard of the tracks and its share of the 'threads'.")
+    ("numa", "Pin the threads to the NUMA nodes, in blocks, and give\nthe threads of each node their own copy of the tables the\ntracks are tested against; the performance report gives\nthe tasks of each node.")
+    ("single-precision-hits", "Test the tracks against the sensors in single precision\nfirst, and in double precision only where they may hit:\nthe hits are the same.")
+    ("brute-force-hits", "Check every module of each layer and every inactive element\nfor material track hits, instead of using the (eta, phi) module\nindex and the eta index of the inactive surfaces.")
     ;
 
     
@@ -57,6 +298,9 @@ int main(int argc, char* argv[]) {
     ("charge", po::value<std::string>(), "Particle charge")
     ("instance-id", po::value<std::string>(), "Id of the program instance, to tag the output file with")
     ("tracks-dir", po::value<std::string>(), "Override the default tracksim output dir.\nIf not supplied, the files will be saved in\nthe working dir")
+    ("phi-sectors", po::value<std::string>(), "N. of phi sectors the modules are bucketed in\nfor the tracksim hit search (default 64)")
+    ("tracks-compression", po::value<std::string>(), "Compression level of the tracksim output file (0-9, default 1)")
+    ("tracks-basket-size", po::value<std::string>(), "Basket size in bytes of the branches of the tracksim\noutput tree. If not supplied, the ROOT default is used")
     ;
 
   po::options_description otheropt("Other options");
@@ -90,7 +334,39 @@ int main(int argc, char* argv[]) {
 
     if (geomtracks < 1) throw po::invalid_option_value("geometry-tracks");
     if (mattracks < 1) throw po::invalid_option_value("material-tracks");
-    if (!vm.count("base-name") && !vm.count("help") && !vm.count("version")) throw po::error("Missing geometry file"); 
+    if (threads < 1) throw po::invalid_option_value("threads");
+    if (processes < 1) throw po::invalid_option_value("processes");
+    if (processes > 1 && (vm.count("shard") || vm.count("merge") || vm.count("checkpoint") || vm.count("time-budget")))
+      throw po::error("The worker processes shoot all the material tracks at once: 'processes' cannot be combined with 'shard', 'merge', 'checkpoint' or 'time-budget'");
+    if (processes > 1 && (vm.count("material-whatif") || vm.count("single-pass") || vm.count("compare") || vm.count("track-records")))
+      throw po::error("The worker processes only send their material budget scans back, not their tracks: 'processes' cannot be combined with 'material-whatif', 'single-pass', 'compare' or 'track-records'");
+    if (jobs < 1) throw po::invalid_option_value("jobs");
+    if (vm.count("batch") && vm.count("sweep")) throw po::error("The options 'batch' and 'sweep' cannot be combined");
+    if (vm.count("shard") && vm.count("merge")) throw po::error("The options 'shard' and 'merge' cannot be combined");
+    if ((vm.count("shard") || vm.count("merge")) && (vm.count("batch") || vm.count("sweep"))) throw po::error("The material shards are for a single layout: they cannot be combined with 'batch' or 'sweep'");
+    if ((vm.count("shard") || vm.count("merge")) && vm.count("material-whatif")) throw po::error("The material shards cannot be reweighted: 'material-whatif' needs a whole material scan");
+    if ((vm.count("shard") || vm.count("merge")) && randseed == 0) throw po::error("The material shards need a fixed random seed, for all of them to shoot the tracks of the same scan");
+    if (vm.count("shard") && (vm.count("tracksim") || !(vm.count("all") || vm.count("material") || vm.count("resolution")))) throw po::error("The option 'shard' needs the material budget: add 'material', 'resolution' or 'all'");
+    if (vm.count("resume") && !vm.count("checkpoint")) throw po::error("The option 'resume' needs the 'checkpoint' file to resume from");
+    if (vm.count("checkpoint") && (vm.count("batch") || vm.count("sweep") || vm.count("merge"))) throw po::error("The checkpoints are for the material scan of a single layout: 'checkpoint' cannot be combined with 'batch', 'sweep' or 'merge'");
+    if (vm.count("checkpoint") && (vm.count("material-whatif") || vm.count("single-pass"))) throw po::error("The material tracks kept by 'material-whatif' and 'single-pass' are not checkpointed: they cannot be combined with 'checkpoint'");
+    if (vm.count("checkpoint") && randseed == 0) throw po::error("The checkpoints need a fixed random seed, for the resumed run to shoot the tracks of the same scan");
+    if (checkpointminutes < 0) throw po::invalid_option_value("checkpoint-interval");
+    if (vm.count("reuse-track-cache") && !vm.count("track-cache")) throw po::error("The option 'reuse-track-cache' needs the 'track-cache' file to take the hits from");
+    if (vm.count("track-cache") && (vm.count("batch") || vm.count("sweep") || vm.count("shard") || vm.count("time-budget")))
+      throw po::error("The track cache is for the resolution tracks of a single layout: 'track-cache' cannot be combined with 'batch', 'sweep', 'shard' or 'time-budget'");
+    if (vm.count("reuse-track-cache") && randseed == 0) throw po::error("The track cache needs a fixed random seed, for the run reusing it to take the same tracks");
+    if (progressseconds <= 0) throw po::invalid_option_value("progress-interval");
+    if (vm.count("compare") && !(vm.count("batch") || vm.count("sweep"))) throw po::error("The option 'compare' compares the layouts of a 'batch' or 'sweep'");
+    if (vm.count("compare") && randseed == 0) throw po::error("The option 'compare' needs a fixed random seed, for the layouts to shoot the same tracks");
+    if (vm.count("compare") && (!vm.count("geometry-region") || geomregion.find("eta=") == std::string::npos)) throw po::error("The option 'compare' needs the eta range of 'geometry-region', for the geometry tracks not to depend on the extent of each layout");
+    if (vm.count("compare") && (vm.count("phi-symmetry") || vm.count("time-budget") || vm.count("tracksim"))) throw po::error("The tracks of 'phi-symmetry' and 'time-budget' depend on the layout: they cannot be combined with 'compare', nor can 'tracksim'");
+    if (vm.count("time-budget") && (vm.count("shard") || vm.count("merge") || vm.count("checkpoint"))) throw po::error("The number of tracks of a time budget depends on the run: 'time-budget' cannot be combined with 'shard', 'merge' or 'checkpoint'");
+    if (vm.count("estimate") && (vm.count("batch") || vm.count("sweep") || vm.count("shard") || vm.count("merge") || vm.count("checkpoint") || vm.count("time-budget") || vm.count("tracksim")))
+      throw po::error("The option 'estimate' estimates the analyses of a single layout with a number of tracks: it cannot be combined with 'batch', 'sweep', 'shard', 'merge', 'checkpoint', 'time-budget' or 'tracksim'");
+    if (vm.count("geometry-precision") && geomprecision <= 0) throw po::invalid_option_value("geometry-precision");
+    if (vm.count("geometry-pt") && geompt <= 0) throw po::invalid_option_value("geometry-pt");
+    if (!vm.count("base-name") && !vm.count("batch") && !vm.count("help") && !vm.count("version")) throw po::error("Missing geometry file"); 
 
   } catch(po::error e) {
     std::cerr << "\nERROR: " << e.what() << std::endl << std::endl;
@@ -108,8 +384,8 @@ int main(int argc, char* argv[]) {
     return 0;
   }
 
-  insur::Squid squid;
-  squid.setCommandLine(argc, argv);
+  bool batch = vm.count("batch") || vm.count("sweep");
+
   bool verboseMaterial = false;
   unsigned int verboseWatch = verbosity;
   if (vm.count("quiet")) verboseWatch=0;
@@ -119,68 +395,211 @@ int main(int argc, char* argv[]) {
   }
   StopWatch::instance()->setVerbosity(verboseWatch, performanceWatch);
 
-  squid.setGeometryFile(basename);
-  if (htmldir != "") squid.setHtmlDir(htmldir);
-
-
-
-    // The tracker (and possibly pixel) must be build in any case
-  if (!squid.buildTracker()) return EXIT_FAILURE;
-
+  if ((vm.count("counters") || vm.count("trace-file")) && !PathCounters::compiledIn())
+    logWARNING("The hot path counters were not compiled in: rebuild with 'make COUNTERS=1' to use --counters or --trace-file");
+  PathCounters::instance()->setTracing(vm.count("trace-file"));
+
+  // The options of the squid for one layout
+  auto setupSquid = [&](insur::Squid& squid, const std::string& geometryFile) -> bool {
+    squid.setCommandLine(argc, argv);
+    squid.setGeometryFile(geometryFile);
+    ProgressMeter::configure(progressseconds, vm.count("progress"), vm.count("progress-file") ? (batch ? layoutFileName(progressfile, geometryFile) : progressfile) : "");
+    if (htmldir != "" && !batch) squid.setHtmlDir(htmldir);
+    squid.useModuleHitIndex(!vm.count("brute-force-hits"));
+    squid.useSinglePrecisionHits(vm.count("single-precision-hits"));
+    squid.setNumThreads(threads);
+    squid.setNumaPinning(vm.count("numa"));
+    squid.setWorkerProcesses(processes);
+    squid.setRandomSeed(randseed);
+    if (vm.count("power-scan") && !squid.setPowerScan(powerscan)) return false;
+    if (vm.count("pileup-scan") && !squid.setPileupScan(pileupscan)) return false;
+    if (vm.count("readout-whatif") && !squid.setReadoutWhatIf(readoutwhatif)) return false;
+    if (!squid.setImageFormats(imageformats, vm.count("lazy-image-formats"))) return false;
+    squid.setPipelinedReports(vm.count("pipeline-reports"));
+    if (!squid.setRasterMaps(rastermaps)) return false;
+    if (vm.count("geometry-region") && !squid.setGeometryTrackRegion(geomregion)) return false;
+    if (vm.count("geometry-index") && !squid.setGeometryIndex(geomindex)) return false;
+    squid.stratifyGeometryTracks(vm.count("stratified-eta"));
+    squid.setQuasiRandomTracks(vm.count("quasi-random"));
+    squid.setSinglePassScan(vm.count("single-pass"));
+    squid.setPhiSymmetry(vm.count("phi-symmetry"));
+    squid.setResolutionGraphBins(resolutionbins);
+    squid.setFastResolution(vm.count("fast-resolution"));
+    if (vm.count("geometry-precision")) squid.setGeometryTrackPrecision(geomprecision);
+    if (vm.count("time-budget")) {
+      std::vector<std::string> budgeted;
+      if (!vm.count("tracksim")) budgeted.push_back("geometry");
+      if (!vm.count("tracksim") && (vm.count("all") || vm.count("material") || vm.count("material-whatif") || vm.count("resolution"))) budgeted.push_back("material");
+      if (!squid.setTimeBudget(timebudget, budgeted)) return false;
+    }
+    if (vm.count("geometry-pt")) squid.setGeometryTrackPt(geompt);
+    if (vm.count("material-whatif") && !squid.setMaterialWhatIf(whatiffile)) return false;
+    if (vm.count("shard") && !squid.setMaterialTrackShard(shard)) return false;
+    if (vm.count("merge")) squid.setMaterialShardFiles(shardfiles);
+    if (vm.count("checkpoint")) squid.setMaterialCheckpoint(checkpointfile, checkpointminutes, vm.count("resume"));
+    if (vm.count("track-cache")) squid.setTrackHitCache(trackcachefile, vm.count("reuse-track-cache"));
+    squid.recordTrackSamples(vm.count("compare"));
+    if (!squid.setResultsCompression(resultscompression)) return false;
+    if (vm.count("track-records") && !squid.writeTrackRecords(batch ? layoutFileName(trackrecords, geometryFile) : trackrecords)) return false;
+    return true;
+  };
+
+  bool site = !vm.count("no-site");
+  // The stages the requested reports pull, with the stages they take their inputs from: the others are not run
+  typedef insur::Squid::Stage Stage;
+  bool materialReport = vm.count("all") || vm.count("material") || vm.count("material-whatif");
+  std::set<Stage> wantedStages = { insur::Squid::TrackerStage };
   if (!vm.count("tracksim")) {
-    // The tracker should pick the types here but in case it does not,
-    // we can still write something
-    if (!squid.pureAnalyzeGeometry(geomtracks)) return EXIT_FAILURE;
-
-
-    if ((vm.count("all") || vm.count("bandwidth") || vm.count("bandwidth-cpu")) && !squid.reportBandwidthSite()) return EXIT_FAILURE;
-    if ((vm.count("all") || vm.count("bandwidth-cpu")) && (!squid.reportTriggerProcessorsSite()) ) return EXIT_FAILURE;
-    if ((vm.count("all") || vm.count("power")) && (!squid.reportPowerSite()) ) return EXIT_FAILURE;
-
-    // If we need to have the material model, then we build it
-    if ( vm.count("all") || vm.count("material") || vm.count("resolution") || vm.count("graph") || vm.count("xml") ) {
-      //if (squid.buildInactiveSurfaces(verboseMaterial) && squid.createMaterialBudget(verboseMaterial)) {
-      if (squid.buildMaterials(verboseMaterial) && squid.createMaterialBudget(verboseMaterial)) {
-      //if (squid.createMaterialBudget(verboseMaterial)) {
-        if ( vm.count("all") || vm.count("material") || vm.count("resolution") ) {
-          if (!squid.pureAnalyzeMaterialBudget(mattracks, vm.count("all") || vm.count("resolution"))) return EXIT_FAILURE;
-          if ((vm.count("all") || vm.count("material"))  && !squid.reportMaterialBudgetSite()) return EXIT_FAILURE;
-          if ((vm.count("all") || vm.count("resolution"))  && !squid.reportResolutionSite()) return EXIT_FAILURE;	  
+    if (site || vm.count("results-file") || vm.count("compare")) wantedStages.insert(insur::Squid::GeometryScanStage); // the geometry pages are in every site
+    if (vm.count("all") || vm.count("bandwidth") || vm.count("bandwidth-cpu") || vm.count("pileup-scan") || vm.count("readout-whatif")) wantedStages.insert(insur::Squid::BandwidthStage);
+    if (vm.count("all") || vm.count("power") || vm.count("power-scan")) wantedStages.insert(insur::Squid::PowerStage);
+    if (materialReport || vm.count("shard")) wantedStages.insert(insur::Squid::MaterialScanStage);
+    if (vm.count("all") || vm.count("resolution") || vm.count("fast-resolution")) {
+      wantedStages.insert(insur::Squid::ResolutionStage);
+      // the resolution tracks are those of the material scan, when they are shared
+      if (vm.count("single-pass")) wantedStages.insert(insur::Squid::MaterialScanStage);
+    }
+    if (vm.count("graph")) wantedStages.insert(insur::Squid::MaterialsStage);
+    if (vm.count("xml")) wantedStages.insert(insur::Squid::MaterialBudgetStage);
+    if (vm.count("all") || vm.count("trigger") || vm.count("trigger-ext")) wantedStages.insert(insur::Squid::TriggerStage);
+  }
+  std::set<Stage> stages = insur::Squid::requiredStages(wantedStages);
+  auto needs = [&](Stage stage) { return stages.count(stage) > 0; };
+  std::string stageNames;
+  for (Stage stage : stages) stageNames += (stageNames.empty() ? "" : ", ") + insur::Squid::stageDeclaration(stage).name;
+  logINFO("Stages run: " + stageNames);
+
+  // The whole pipeline of one layout
+  auto runLayout = [&](insur::Squid& squid, const std::string& geometryFile) -> int {
+    if (!setupSquid(squid, geometryFile)) return EXIT_FAILURE;
+    squid.prefetchInputs();
+
+      // The tracker (and possibly pixel) must be build in any case
+    if (!squid.buildTracker()) return EXIT_FAILURE;
+
+    // A shard of the material scan is merged, and reported, by another run
+    if (vm.count("shard")) {
+      std::string shardFile = layoutName(geometryFile) + "_shard-" + boost::algorithm::replace_all_copy(shard, "/", "of") + ".root";
+      if (!squid.buildMaterials(verboseMaterial) || !squid.createMaterialBudget(verboseMaterial) ||
+          !squid.pureAnalyzeMaterialBudget(mattracks, false, vm.count("all") || vm.count("material"), true) ||
+          !squid.writeMaterialShard(shardFile)) return EXIT_FAILURE;
+      std::cout << std::endl << "Wrote the material scan of shard " << shard << " to " << shardFile << std::endl;
+      return EXIT_SUCCESS;
+    }
+
+    if (!vm.count("tracksim")) {
+      // The tracker should pick the types here but in case it does not,
+      // we can still write something
+      if (needs(insur::Squid::GeometryScanStage) && !squid.pureAnalyzeGeometry(geomtracks)) return EXIT_FAILURE;
+
+
+      if (needs(insur::Squid::BandwidthStage) && !(site ? squid.reportBandwidthSite() : squid.pureAnalyzeBandwidth())) return EXIT_FAILURE;
+      if (site && (vm.count("all") || vm.count("bandwidth-cpu")) && (!squid.reportTriggerProcessorsSite()) ) return EXIT_FAILURE;
+      if (needs(insur::Squid::PowerStage) && !(site ? squid.reportPowerSite() : squid.pureAnalyzePower())) return EXIT_FAILURE;
+
+      // If we need to have the material model, then we build it, up to the material budget if needed
+      if (needs(insur::Squid::MaterialsStage)) {
+        if (squid.buildMaterials(verboseMaterial) && (!needs(insur::Squid::MaterialBudgetStage) || squid.createMaterialBudget(verboseMaterial))) {
+          if (needs(insur::Squid::MaterialScanStage) || needs(insur::Squid::ResolutionStage)) {
+            if (!squid.pureAnalyzeMaterialBudget(mattracks, needs(insur::Squid::ResolutionStage), materialReport, needs(insur::Squid::MaterialScanStage))) return EXIT_FAILURE;
+            if (site && materialReport && !squid.reportMaterialBudgetSite()) return EXIT_FAILURE;
+            if (site && needs(insur::Squid::ResolutionStage) && !squid.reportResolutionSite()) return EXIT_FAILURE;
+          }
+          if (site && vm.count("graph") && !squid.reportNeighbourGraphSite()) return EXIT_FAILURE;
+          if (vm.count("xml") && !squid.translateFullSystemToXML(xmldir)) return (EXIT_FAILURE);
         }
-        if (vm.count("graph") && !squid.reportNeighbourGraphSite()) return EXIT_FAILURE;
-        if (vm.count("xml") && !squid.translateFullSystemToXML(xmldir)) return (EXIT_FAILURE);
       }
-    }
+      if (vm.count("track-records") && !squid.closeTrackRecords()) return EXIT_FAILURE;
+      if (vm.count("results-file") && !squid.writeResults(batch ? layoutFileName(resultsfile, geometryFile) : resultsfile)) return EXIT_FAILURE;
+      if (vm.count("compare") && !squid.writeTrackSamples(layoutName(geometryFile) + "_samples.root")) return EXIT_FAILURE;
 
-    if ((vm.count("all") || vm.count("trigger") || vm.count("trigger-ext")) &&
-        ( !squid.analyzeTriggerEfficiency(mattracks, vm.count("trigger-ext")) || !squid.reportTriggerPerformanceSite(vm.count("trigger-ext"))) ) return EXIT_FAILURE;
+      if (needs(insur::Squid::TriggerStage) &&
+          ( !squid.analyzeTriggerEfficiency(mattracks, vm.count("trigger-ext")) || (site && !squid.reportTriggerPerformanceSite(vm.count("trigger-ext")))) ) return EXIT_FAILURE;
 
+      if (vm.count("results-json") && !squid.writeResultsJson(batch ? layoutFileName(resultsjson, geometryFile) : resultsjson)) return EXIT_FAILURE;
 
-    if (!squid.reportGeometrySite()) return EXIT_FAILURE;
-    if (!squid.additionalInfoSite()) return EXIT_FAILURE;
-    if (!squid.makeSite()) return EXIT_FAILURE;
+      if (site) {
+        if (!squid.reportGeometrySite()) return EXIT_FAILURE;
+        if (!squid.additionalInfoSite()) return EXIT_FAILURE;
+        if (!squid.makeSite()) return EXIT_FAILURE;
+      }
 
-  } else {
-    //if (tracksim.size() < 1 || tracksim.size > 2) {
-    //  std::cerr << "Wrong number of parameters. Syntax: --tracksim <num events> <num tracks/ev>" << std::endl;
-    //  std::cerr << "                                    --tracksim parameterfile" << std::endl;
-    //  std::cerr << "                                    --tracksim \"key1 = value1; key2 = value2 ...\"" << std::endl;
-    //  return EXIT_FAILURE;
-   // }
-    if (!squid.pureAnalyzeGeometry(geomtracks)) return EXIT_FAILURE;
+    } else {
+      //if (tracksim.size() < 1 || tracksim.size > 2) {
+      //  std::cerr << "Wrong number of parameters. Syntax: --tracksim <num events> <num tracks/ev>" << std::endl;
+      //  std::cerr << "                                    --tracksim parameterfile" << std::endl;
+      //  std::cerr << "                                    --tracksim \"key1 = value1; key2 = value2 ...\"" << std::endl;
+      //  return EXIT_FAILURE;
+     // }
+      if (!squid.pureAnalyzeGeometry(geomtracks)) return EXIT_FAILURE;
   
-//    if (tracksim.size() == 2) {
-//      vmtracks.insert(std::make_pair("num-events", po::variable_value(boost::any(tracksim[0]), false)));
-//      vmtracks.insert(std::make_pair("num-tracks", po::variable_value(boost::any(tracksim[1]), false)));
-//    }
-    squid.simulateTracks(vm, randseed);
-
-    //if (tracksim.size() == 2) { squid.simulateTracks(str2any<long int>(tracksim[0]), str2any<long int>(tracksim[1]), randseed, "", ""); }
-    //else if (tracksim.size() == 1 && tracksim[0].at(0)=="\"") { squid.simulateTracks(0, 0, randseed, "", trim(tracksim[0], " \"")); }
-    //else { squid.simulateTracks(0, 0, randseed, tracksim[0], ""); }
+  //    if (tracksim.size() == 2) {
+  //      vmtracks.insert(std::make_pair("num-events", po::variable_value(boost::any(tracksim[0]), false)));
+  //      vmtracks.insert(std::make_pair("num-tracks", po::variable_value(boost::any(tracksim[1]), false)));
+  //    }
+      squid.simulateTracks(vm, randseed);
+
+      //if (tracksim.size() == 2) { squid.simulateTracks(str2any<long int>(tracksim[0]), str2any<long int>(tracksim[1]), randseed, "", ""); }
+      //else if (tracksim.size() == 1 && tracksim[0].at(0)=="\"") { squid.simulateTracks(0, 0, randseed, "", trim(tracksim[0], " \"")); }
+      //else { squid.simulateTracks(0, 0, randseed, tracksim[0], ""); }
+    }
+
+    if (vm.count("performance-file") && !StopWatch::instance()->writeReport(batch ? layoutFileName(perffile, geometryFile) : perffile)) return EXIT_FAILURE;
+    if (vm.count("counters")) std::cout << std::endl << PathCounters::instance()->report();
+    if (vm.count("performance")) std::cout << std::endl << TaskPool::instance()->report() << std::endl << StopWatch::memoryReport();
+    if (vm.count("trace-file") && !PathCounters::instance()->writeTrace(batch ? layoutFileName(tracefile, geometryFile) : tracefile)) return EXIT_FAILURE;
+
+    return EXIT_SUCCESS;
+  };
+
+  // The cost of the analyses of one layout, projected from its builds and from scans of a few tracks
+  auto estimateLayout = [&](insur::Squid& squid, const std::string& geometryFile) -> int {
+    if (!setupSquid(squid, geometryFile)) return EXIT_FAILURE;
+    RunEstimate estimate;
+    if (!estimate.measure("tracker build", [&]() { return squid.buildTracker(); })) return EXIT_FAILURE;
+    if (needs(insur::Squid::GeometryScanStage) &&
+        !estimate.measureScaling("geometry scan", geomtracks, RunEstimate::calibrationTracks(geomtracks, 1000),
+                                 [&](int tracks) { return squid.pureAnalyzeGeometry(tracks); })) return EXIT_FAILURE;
+    if (needs(insur::Squid::MaterialsStage) && !estimate.measure("materials", [&]() { return squid.buildMaterials(verboseMaterial); })) return EXIT_FAILURE;
+    if (needs(insur::Squid::MaterialBudgetStage)) {
+      if (!estimate.measure("material budget", [&]() { return squid.createMaterialBudget(verboseMaterial); })) return EXIT_FAILURE;
+      if ((needs(insur::Squid::MaterialScanStage) || needs(insur::Squid::ResolutionStage)) &&
+          !estimate.measureScaling(needs(insur::Squid::MaterialScanStage) ? "material scan" : "resolution", mattracks, RunEstimate::calibrationTracks(mattracks, 256), [&](int tracks) {
+            return squid.pureAnalyzeMaterialBudget(tracks, needs(insur::Squid::ResolutionStage), materialReport, needs(insur::Squid::MaterialScanStage));
+          })) return EXIT_FAILURE;
+    }
+    if (needs(insur::Squid::TriggerStage) &&
+        !estimate.measureScaling("trigger efficiency", mattracks, RunEstimate::calibrationTracks(mattracks, 64),
+                                 [&](int tracks) { return squid.analyzeTriggerEfficiency(tracks, vm.count("trigger-ext")); })) return EXIT_FAILURE;
+    std::cout << std::endl << std::endl << estimate.report();
+    return EXIT_SUCCESS;
+  };
+
+  if (!batch) {
+    insur::Squid squid;
+    return vm.count("estimate") ? estimateLayout(squid, basename) : runLayout(squid, basename);
   }
 
-  return EXIT_SUCCESS;
+  std::vector<std::string> layouts;
+  if (vm.count("batch") && !readBatchFile(batchfile, layouts)) return EXIT_FAILURE;
+  if (vm.count("sweep") && !makeSweepLayouts(basename, sweeps, layouts)) return EXIT_FAILURE;
+  if (htmldir != "") logWARNING("--html-dir is ignored by a batch: each layout gets the directory of its geometry file name");
+  preloadSharedInputs();
+  insur::Squid shared;
+  buildSharedStages(shared, layouts, needs(insur::Squid::MaterialsStage), needs(insur::Squid::MaterialBudgetStage), setupSquid);
+  finishPrefetches(); // the layouts are forked with the files read ahead, not with the threads reading them
+  int status = runBatch(layouts, jobs, [&](const std::string& layout) { return runLayout(shared, layout); });
+  if (status != EXIT_SUCCESS || !vm.count("compare")) return status;
+
+  // Each layout against the first, track by track
+  insur::LayoutComparison comparison;
+  std::string reference = layoutName(layouts.front());
+  for (std::size_t i = 1; i < layouts.size(); i++) {
+    std::string layout = layoutName(layouts[i]);
+    std::cout << std::endl;
+    if (!comparison.compare(reference + "_samples.root", layout + "_samples.root", reference + "_vs_" + layout + ".root", std::cout)) status = EXIT_FAILURE;
+  }
+  return status;
 }
 
 
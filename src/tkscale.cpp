@@ -0,0 +1,356 @@
+/**
+ * @file tkscale.cpp
+ * @brief This is the end-to-end scaling benchmark of tklayout, run on a set of reference layouts
+ *
+ * Each layout is run at each of the track counts and thread counts given, every run in a process of its own, so that
+ * its peak memory is its own. A run builds the tracker and its materials and runs the analyses, and gives the time
+ * of each step (their sum being the total time of the run), the tracks per second of the track scans and the peak
+ * resident memory. The runs are printed as they finish, one line of space separated key=value pairs each, then as a
+ * table with the speedup and the efficiency of each run over the run of the same layout and tracks on the fewest
+ * threads. They can also be written to a CSV file,
+ * and compared with the CSV file of another revision: the runs slower than in it by more than the tolerance are
+ * reported as regressions, and make the program fail.
+ */
+
+#include <boost/algorithm/string.hpp>
+#include <boost/program_options.hpp>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <Squid.h>
+#include "StopWatch.h"
+#include "SvnRevision.h"
+
+namespace po = boost::program_options;
+
+namespace {
+
+  typedef std::chrono::steady_clock BenchClock;
+
+  double secondsSince(const BenchClock::time_point& start) {
+    return std::chrono::duration<double>(BenchClock::now() - start).count();
+  }
+
+  // The steps of a run, in the order they are made
+  const std::vector<std::string> stepNames = { "build", "materials", "geometry", "material", "trigger", "bandwidth", "power" };
+
+  /**
+   * @struct ScaleRun
+   * @brief The results of one layout at one track count and one thread count
+   */
+  struct ScaleRun {
+    std::string layout, revision;
+    int tracks, threads;
+    bool ok;
+    std::map<std::string, double> seconds; // by step
+    double totalSeconds;
+    double peakRssMb;
+  };
+
+  std::vector<int> parseCounts(const std::string& list, const std::string& option) {
+    std::vector<std::string> items;
+    boost::split(items, list, boost::is_any_of(","), boost::token_compress_on);
+    std::vector<int> counts;
+    for (const std::string& item : items) {
+      if (item.empty()) continue;
+      int count = atoi(item.c_str());
+      if (count < 1) throw po::invalid_option_value(option);
+      counts.push_back(count);
+    }
+    if (counts.empty()) throw po::invalid_option_value(option);
+    return counts;
+  }
+
+  std::string layoutName(const std::string& geometryFile) {
+    std::string name = geometryFile;
+    size_t slash = name.find_last_of('/');
+    if (slash != std::string::npos) name = name.substr(slash + 1);
+    size_t dot = name.find_last_of('.');
+    return dot != std::string::npos && dot > 0 ? name.substr(0, dot) : name;
+  }
+
+  /**
+   * Run the steps of a layout, in the calling process
+   * @param geometryFile The geometry file of the layout
+   * @param tracks The number of tracks of the track scans
+   * @param threads The number of threads
+   * @param seed The random seed of the tracks
+   * @param seconds Filled with the time of each step
+   * @return True if all the steps succeeded
+   */
+  bool runSteps(const std::string& geometryFile, int tracks, int threads, int seed, std::map<std::string, double>& seconds) {
+    insur::Squid squid;
+    squid.setGeometryFile(geometryFile);
+    squid.setNumThreads(threads);
+    squid.setRandomSeed(seed);
+
+    BenchClock::time_point start = BenchClock::now();
+    if (!squid.buildTracker()) return false;
+    seconds["build"] = secondsSince(start);
+    start = BenchClock::now();
+    if (!squid.buildMaterials(false) || !squid.createMaterialBudget(false)) return false;
+    seconds["materials"] = secondsSince(start);
+    start = BenchClock::now();
+    if (!squid.pureAnalyzeGeometry(tracks)) return false;
+    seconds["geometry"] = secondsSince(start);
+    start = BenchClock::now();
+    if (!squid.pureAnalyzeMaterialBudget(tracks, true, false)) return false;
+    seconds["material"] = secondsSince(start);
+    start = BenchClock::now();
+    if (!squid.analyzeTriggerEfficiency(tracks, false)) return false;
+    seconds["trigger"] = secondsSince(start);
+    start = BenchClock::now();
+    if (!squid.pureAnalyzeBandwidth()) return false;
+    seconds["bandwidth"] = secondsSince(start);
+    start = BenchClock::now();
+    if (!squid.pureAnalyzePower()) return false;
+    seconds["power"] = secondsSince(start);
+    return true;
+  }
+
+  /**
+   * Run a layout in a process of its own, which gives its results back through a pipe
+   * @param geometryFile The geometry file of the layout
+   * @param tracks The number of tracks of the track scans
+   * @param threads The number of threads
+   * @param seed The random seed of the tracks
+   * @param verbose Whether the output of the run is shown
+   * @return The results of the run
+   */
+  ScaleRun runLayout(const std::string& geometryFile, int tracks, int threads, int seed, bool verbose) {
+    ScaleRun run = { layoutName(geometryFile), SvnRevision::revisionNumber, tracks, threads, false, {}, 0, 0 };
+    int fds[2];
+    if (pipe(fds) != 0) return run;
+    std::cout << std::flush;
+    std::cerr << std::flush;
+    pid_t pid = fork();
+    if (pid == 0) {
+      close(fds[0]);
+      if (!verbose && (!freopen("/dev/null", "w", stdout) || dup2(fileno(stdout), fileno(stderr)) < 0)) _exit(EXIT_FAILURE);
+      StopWatch::instance()->setVerbosity(verbose ? 1 : 0, verbose);
+      std::map<std::string, double> seconds;
+      bool ok = runSteps(geometryFile, tracks, threads, seed, seconds);
+      struct rusage usage;
+      getrusage(RUSAGE_SELF, &usage);
+      std::ostringstream result;
+      result << (ok ? 1 : 0) << " " << usage.ru_maxrss;
+      for (const std::string& step : stepNames) result << " " << (seconds.count(step) ? seconds[step] : -1.);
+      std::string text = result.str();
+      bool written = write(fds[1], text.data(), text.size()) == (ssize_t)text.size();
+      close(fds[1]);
+      _exit(ok && written ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+    close(fds[1]);
+    if (pid < 0) {
+      close(fds[0]);
+      return run;
+    }
+    std::string text;
+    char buffer[256];
+    ssize_t n;
+    while ((n = read(fds[0], buffer, sizeof(buffer))) > 0) text.append(buffer, n);
+    close(fds[0]);
+    int status;
+    waitpid(pid, &status, 0);
+    std::istringstream result(text);
+    int ok = 0;
+    long peakRssKb = 0;
+    if (!(result >> ok >> peakRssKb)) return run;
+    for (const std::string& step : stepNames) {
+      double s;
+      if (result >> s && s >= 0) {
+        run.seconds[step] = s;
+        run.totalSeconds += s;
+      }
+    }
+    run.ok = ok && WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS;
+    run.peakRssMb = peakRssKb / 1024.;
+    return run;
+  }
+
+  double stepSeconds(const ScaleRun& run, const std::string& step) {
+    auto it = run.seconds.find(step);
+    return it != run.seconds.end() ? it->second : 0;
+  }
+
+  std::string runKey(const std::string& layout, int tracks, int threads) {
+    return layout + "," + std::to_string(tracks) + "," + std::to_string(threads);
+  }
+
+  void printRun(const ScaleRun& run) {
+    std::cout << "scale=" << run.layout << " tracks=" << run.tracks << " threads=" << run.threads << " ok=" << run.ok;
+    for (const std::string& step : stepNames) if (run.seconds.count(step)) std::cout << " " << step << "_s=" << stepSeconds(run, step);
+    std::cout << " total_s=" << run.totalSeconds << " peak_rss_mb=" << run.peakRssMb << std::endl;
+  }
+
+  std::string csvHeader() {
+    std::string header = "layout,tracks,threads,revision,ok";
+    for (const std::string& step : stepNames) header += "," + step + "_s";
+    return header + ",total_s,geometry_tracks_per_s,material_tracks_per_s,peak_rss_mb";
+  }
+
+  std::string csvLine(const ScaleRun& run) {
+    std::ostringstream line;
+    line << run.layout << "," << run.tracks << "," << run.threads << "," << run.revision << "," << (run.ok ? 1 : 0);
+    for (const std::string& step : stepNames) line << "," << stepSeconds(run, step);
+    double geometry = stepSeconds(run, "geometry"), material = stepSeconds(run, "material");
+    line << "," << run.totalSeconds << "," << (geometry > 0 ? run.tracks / geometry : 0.)
+         << "," << (material > 0 ? run.tracks / material : 0.) << "," << run.peakRssMb;
+    return line.str();
+  }
+
+  /**
+   * Read the total time of the runs of a CSV file written by this program
+   * @param fileName The name of the file
+   * @param totals Filled with the total time of each successful run, by layout, tracks and threads
+   * @return False if the file could not be read
+   */
+  bool readBaseline(const std::string& fileName, std::map<std::string, double>& totals) {
+    std::ifstream in(fileName.c_str());
+    if (!in) return false;
+    std::string line;
+    if (!std::getline(in, line)) return false;
+    std::vector<std::string> header;
+    boost::split(header, line, boost::is_any_of(","));
+    int totalColumn = -1;
+    for (size_t i = 0; i < header.size(); i++) if (header[i] == "total_s") totalColumn = i;
+    if (totalColumn < 0) return false;
+    while (std::getline(in, line)) {
+      std::vector<std::string> fields;
+      boost::split(fields, line, boost::is_any_of(","));
+      if ((int)fields.size() <= totalColumn || fields[4] != "1") continue;
+      totals[fields[0] + "," + fields[1] + "," + fields[2]] = atof(fields[totalColumn].c_str());
+    }
+    return true;
+  }
+
+}
+
+int main(int argc, char* argv[]) {
+  std::string usage("Usage: ");
+  usage += argv[0];
+  usage += " <geometry files> [options]";
+  std::vector<std::string> layouts;
+  std::string trackList, threadList, outputFile, baselineFile;
+  int seed;
+  double tolerance;
+
+  po::options_description shown("Scaling benchmark options");
+  shown.add_options()
+    ("help,h", "Display this help message.")
+    ("tracks", po::value<std::string>(&trackList)->default_value("100,1000"), "The numbers of tracks of the track scans (comma separated).")
+    ("threads,j", po::value<std::string>(&threadList)->default_value("1,2,4"), "The numbers of threads (comma separated).")
+    ("randseed", po::value<int>(&seed)->default_value(0xcafebabe), "Set the random seed of the tracks.")
+    ("output", po::value<std::string>(&outputFile), "Write the runs to this CSV file.")
+    ("baseline", po::value<std::string>(&baselineFile), "Compare the runs with those of this CSV file, written by\nanother revision, and fail on a regression.")
+    ("tolerance", po::value<double>(&tolerance)->default_value(0.1), "The fraction a run can be slower than in the baseline\nwithout being a regression.")
+    ("verbose", "Show the output of the runs.")
+    ;
+  po::options_description hidden;
+  hidden.add_options()("layouts", po::value<std::vector<std::string> >(&layouts)->composing());
+  po::positional_options_description posopt;
+  posopt.add("layouts", -1);
+  po::options_description mainopt;
+  mainopt.add(shown).add(hidden);
+
+  po::variables_map vm;
+  std::vector<int> trackCounts, threadCounts;
+  try {
+    po::store(po::command_line_parser(argc, argv).options(mainopt).positional(posopt).run(), vm);
+    po::notify(vm);
+    trackCounts = parseCounts(trackList, "tracks");
+    threadCounts = parseCounts(threadList, "threads");
+    if (tolerance < 0) throw po::invalid_option_value("tolerance");
+    if (layouts.empty() && !vm.count("help")) throw po::error("Missing geometry files");
+  } catch(po::error e) {
+    std::cerr << "\nERROR: " << e.what() << std::endl << std::endl;
+    std::cout << usage << std::endl << shown << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (vm.count("help")) {
+    std::cout << usage << std::endl << shown << std::endl;
+    return 0;
+  }
+
+  std::map<std::string, double> baseline;
+  if (vm.count("baseline") && !readBaseline(baselineFile, baseline)) {
+    std::cerr << "Could not read the baseline " << baselineFile << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::vector<ScaleRun> runs;
+  for (const std::string& layout : layouts) {
+    for (int tracks : trackCounts) {
+      for (int threads : threadCounts) {
+        runs.push_back(runLayout(layout, tracks, threads, seed, vm.count("verbose")));
+        printRun(runs.back());
+      }
+    }
+  }
+
+  // The report, each run against the one of its layout and tracks on the fewest threads
+  std::map<std::string, const ScaleRun*> reference;
+  for (const ScaleRun& run : runs) {
+    if (!run.ok) continue;
+    std::string key = run.layout + "," + std::to_string(run.tracks);
+    if (!reference.count(key) || run.threads < reference[key]->threads) reference[key] = &run;
+  }
+  int regressions = 0;
+  std::cout << std::endl << "Scaling report (revision " << SvnRevision::revisionNumber << ")" << std::endl;
+  std::cout << std::left << std::setw(40) << "layout" << std::right << std::setw(8) << "tracks" << std::setw(8) << "threads"
+            << std::setw(10) << "build [s]" << std::setw(12) << "total [s]" << std::setw(12) << "geom trk/s" << std::setw(12) << "mat trk/s"
+            << std::setw(10) << "speedup" << std::setw(12) << "efficiency" << std::setw(12) << "peak [MB]";
+  if (!baseline.empty()) std::cout << std::setw(12) << "vs base";
+  std::cout << std::endl;
+  for (const ScaleRun& run : runs) {
+    std::cout << std::left << std::setw(40) << run.layout << std::right << std::setw(8) << run.tracks << std::setw(8) << run.threads;
+    if (!run.ok) {
+      std::cout << "  FAILED" << std::endl;
+      continue;
+    }
+    const ScaleRun& ref = *reference[run.layout + "," + std::to_string(run.tracks)];
+    double speedup = run.totalSeconds > 0 ? ref.totalSeconds / run.totalSeconds : 0;
+    double geometry = stepSeconds(run, "geometry"), material = stepSeconds(run, "material");
+    std::cout << std::fixed << std::setprecision(2) << std::setw(10) << stepSeconds(run, "build") << std::setw(12) << run.totalSeconds
+              << std::setprecision(1) << std::setw(12) << (geometry > 0 ? run.tracks / geometry : 0.) << std::setw(12) << (material > 0 ? run.tracks / material : 0.)
+              << std::setprecision(2) << std::setw(10) << speedup << std::setprecision(1) << std::setw(11) << 100 * speedup * ref.threads / run.threads << "%"
+              << std::setprecision(1) << std::setw(12) << run.peakRssMb;
+    auto base = baseline.find(runKey(run.layout, run.tracks, run.threads));
+    if (base != baseline.end() && base->second > 0) {
+      double change = run.totalSeconds / base->second - 1;
+      std::cout << std::setw(11) << std::showpos << 100 * change << "%" << std::noshowpos;
+      if (change > tolerance) {
+        std::cout << " REGRESSION";
+        regressions++;
+      }
+    }
+    std::cout << std::endl;
+  }
+
+  if (vm.count("output")) {
+    std::ofstream out(outputFile.c_str());
+    out << csvHeader() << std::endl;
+    for (const ScaleRun& run : runs) out << csvLine(run) << std::endl;
+    if (!out) {
+      std::cerr << "Could not write the scaling report " << outputFile << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  for (const ScaleRun& run : runs) if (!run.ok) return EXIT_FAILURE;
+  if (regressions) {
+    std::cout << regressions << " run" << (regressions > 1 ? "s are" : " is") << " slower than in the baseline by more than " << 100 * tolerance << "%" << std::endl;
+    return EXIT_FAILURE;
+  }
+  return 0;
+}
@@ -1,214 +1,184 @@
 // Standard c++ libraries
 #include <cstdlib>
+#include <cmath>
 #include <iostream>
-#include <cstring>
+#include <fstream>
 #include <vector>
-#include <sstream>
 #include <string>
 #include <cstdio>
+#include <thread>
+#include <algorithm>
+#include <stdexcept>
 
 // BOOST
 #include <boost/program_options.hpp>
+#include <boost/algorithm/string.hpp>
 
 // Private libraries
 #include <ptError.h>
-#include <module.hh>
 
 using namespace std;
 namespace po = boost::program_options;
 
-void syntax(char* programName) {
-  //void syntax(char* po::options_description& visible, char* programName) {
-  std::cout << "Syntax: " << programName << endl
-            << " [Barrel|Endcap]" << std::endl
-            << " mod_d_start mod_d_stop mod_d_step" << std::endl
-            << " pitch strip_l mod_z mod_r window efficient_pt"<< std::endl;
-  std::cout << "Pt units : GeV/c" << std::endl;
-  std::cout << "Pitch    : micrometers" << std::endl;
-  std::cout << "mod_*    : millimeters" << std::endl;
-  std::cout << "window   : number of strips" << std::endl;
-  //std::cout << "And then the show: " << visible << std::endl;
-}
-
-enum { Momentum, Distance };
-
-int main(int argc, char*argv[]) {
-  cout << "# Tuning Thinkness" << endl;
-  if (argc!=11) {
-    syntax(argv[0]);
-    return -1;
-  }
-
-  int ModuleType;
-  if (strcmp(argv[1], "Barrel")==0) {
-    ModuleType = Module::Barrel;
-    std::cout << "# Module type = Barrel" << std::endl;
-  } else if (strcmp(argv[1], "Endcap")==0) {
-    ModuleType = Module::Endcap;
-    std::cout << "# Module type = Endcap" << std::endl;
-  } else {
-    syntax(argv[0]);
-    return 0;
+/**
+ * A point of the parameter scan, with the results computed for it
+ */
+struct ScanPoint {
+  int type;
+  double pitch, strip_l, mod_z, mod_r, window, mod_d; // pitch in mm
+  double p_cut, eff_1, inef_pt, pt_1, pt_90, geom_ineff;
+};
+
+/**
+ * The values of a scanned parameter, given as "a,b,c" or as a range "start:stop:step" (stop excluded)
+ */
+vector<double> parseValues(const string& name, const string& text) {
+  vector<double> result;
+  vector<string> items;
+  boost::split(items, text, boost::is_any_of(","));
+  for (const string& item : items) {
+    vector<string> range;
+    boost::split(range, item, boost::is_any_of(":"));
+    try {
+      if (range.size()==1) result.push_back(stod(range[0]));
+      else if (range.size()==3) {
+        double start = stod(range[0]), stop = stod(range[1]), step = stod(range[2]);
+        if (step<=0) throw invalid_argument("step");
+        for (int i=0; start+i*step<stop-step*1E-9; ++i) result.push_back(start+i*step);
+      } else throw invalid_argument("range");
+    } catch (const logic_error&) {
+      throw invalid_argument("Cannot read the values of " + name + " from '" + item + "'");
+    }
   }
+  return result;
+}
 
-  double start = atof(argv[2]);
-  double stop = atof(argv[3]);
-  double step = atof(argv[4]);
-
-  double pitch = atof(argv[5])/1000.;
-  double strip_l = atof(argv[6]);
-  double mod_z = atof(argv[7]);
-  double mod_r = atof(argv[8]);
-  double window = atof(argv[9]);
-  double efficient_pt = atof(argv[10]);
-
+/**
+ * Compute the points from first to last: the probabilities at 1 GeV/c and at the efficient pt are taken for
+ * the whole chunk at once, the searches of pt(1%) and pt(90%) point by point
+ */
+void scanChunk(vector<ScanPoint>& points, size_t first, size_t last, double efficientPt, bool fastErf) {
+  size_t n = last - first;
+  vector<double> cuts(2*n), values(2*n), errors(2*n), probabilities(2*n), efficiencies(n);
   ptError myError;
-  myError.setModuleType(ModuleType);
-  myError.setPitch(pitch);
-  myError.setStripLength(strip_l);
-  myError.setZ(mod_z);
-  myError.setR(mod_r);
-
-  double p;
-  double curvature, cur_error;
-  double p_cut; //, cur_cut;  
- 
-  double mod_d; 
-
-  double theta = atan(mod_r/mod_z);
-  cout << "# eta = " << -1 * log(tan(theta/2)) << endl;
-  cout << "mod_d p_cut eff_1 inef_"<< efficient_pt << " pt(1%) pt(90%) geom_ineff" << endl;
-  for (mod_d=start; mod_d<stop; mod_d+=step) {
-    myError.setDistance(mod_d);
-    
-    p_cut = myError.stripsToP(window/2.);
-    //cur_cut = 1/p_cut;
-
-    //cout << mod_d << " "
-    //     << p_cut << " ";
-    printf("%.2f %.2f ", mod_d, p_cut);
-
-    p = 1;
-    curvature = 1 / p;
-    cur_error = myError.computeError(p) * curvature;
-    //cout << 100 * myError.probabilityInside(cur_cut, curvature, cur_error) * myError.geometricEfficiency() << " ";
-    printf("%.2f ", 100 * myError.probabilityInside(1/p_cut, curvature, cur_error) * myError.geometricEfficiency());
-
-    p = efficient_pt;
-    curvature = 1 / p;
-    cur_error = myError.computeError(p) * curvature;
-    //cout << 100-100 * myError.probabilityInside(cur_cut, curvature, cur_error) * myError.geometricEfficiency() << " ";
-    printf("%.2f ",100-100 * myError.probabilityInside(1/p_cut, curvature, cur_error) * myError.geometricEfficiency());
-
-    double myValue;
-    myValue = myError.find_probability(0.01, p_cut);
-    //std::cout << 1/myValue << " ";
-    printf("%.2f ", myValue);
-    myValue = myError.find_probability(0.90, p_cut);
-    //std::cout << 1/myValue;
-    printf("%.2f ", myValue);
-
-
-    myValue = 100*(1-myError.geometricEfficiency());
-    printf("%.2f ", myValue);
-    std::cout << std::endl;
+  myError.setZCorrelation(SAMESEGMENT);
+  myError.setTilt(0);
+  myError.setMaterial(RILength());
+  for (size_t i=0; i<n; ++i) {
+    ScanPoint& point = points[first+i];
+    myError.setModuleType(point.type);
+    myError.setPitch(point.pitch);
+    myError.setStripLength(point.strip_l);
+    myError.setHeight(point.strip_l);
+    myError.setZ(point.mod_z);
+    myError.setR(point.mod_r);
+    myError.setDistance(point.mod_d);
+    myError.setEffectiveDistance(point.mod_d);
+
+    point.p_cut = myError.stripsToP(point.window/2.);
+    efficiencies[i] = myError.geometricEfficiency();
+    point.geom_ineff = 100*(1-efficiencies[i]);
+    cuts[2*i] = cuts[2*i+1] = 1/point.p_cut;
+    values[2*i] = 1;
+    errors[2*i] = myError.computeError(1);
+    values[2*i+1] = 1/efficientPt;
+    errors[2*i+1] = myError.computeError(efficientPt)/efficientPt;
+    point.pt_1 = myError.findPtAtProbability(0.01, point.p_cut, efficiencies[i]);
+    point.pt_90 = myError.findPtAtProbability(0.90, point.p_cut, efficiencies[i]);
+  }
+  ptError::probabilityInside(2*n, cuts.data(), values.data(), errors.data(), probabilities.data(), fastErf);
+  for (size_t i=0; i<n; ++i) {
+    points[first+i].eff_1 = 100*probabilities[2*i]*efficiencies[i];
+    points[first+i].inef_pt = 100-100*probabilities[2*i+1]*efficiencies[i];
   }
-
-  return(0);
 }
 
-/*
-
-int main(int ac, char* av[]) {
+int main(int argc, char* argv[]) {
+  string types, pitches, stripLengths, zs, rs, windows, distances, outputName;
+  double efficientPt;
+  unsigned int threads;
+
+  po::options_description options("Options (each scanned parameter takes a list a,b,c or a range start:stop:step)");
+  options.add_options()
+    ("help,h", "produce help message")
+    ("type,t", po::value<string>(&types)->default_value("Barrel"), "module types: Barrel, Endcap or Barrel,Endcap")
+    ("pitch,p", po::value<string>(&pitches)->default_value("90"), "strip pitch [um]")
+    ("strip,s", po::value<string>(&stripLengths)->default_value("23.2"), "strip length [mm]")
+    ("z,z", po::value<string>(&zs)->default_value("954"), "module z [mm]")
+    ("r,r", po::value<string>(&rs)->default_value("348"), "module r [mm]")
+    ("window,w", po::value<string>(&windows)->default_value("3"), "trigger window [strips]")
+    ("distance,d", po::value<string>(&distances)->default_value("0.5:4:0.1"), "sensor spacing [mm]")
+    ("efficient-pt,e", po::value<double>(&efficientPt)->default_value(2), "pt [GeV/c] whose inefficiency is reported")
+    ("threads,j", po::value<unsigned int>(&threads)->default_value(max(1u, thread::hardware_concurrency())), "number of threads")
+    ("output,o", po::value<string>(&outputName), "output file (default: standard output)")
+    ("fast-erf,f", "use an approximate erf (absolute error below 1.5E-7) for the probabilities at 1 GeV/c and at the efficient pt")
+    ;
+
+  po::variables_map vm;
+  vector<int> moduleTypes;
+  vector<double> pitchV, stripV, zV, rV, windowV, distanceV;
   try {
-    // Declare the variables later used in the parameter scan
-    std::cout << "Syntax: " << programName << endl
-	      << " [Barrel|Endcap]" << std::endl
-	      << " mod_d_start mod_d_stop mod_d_step" << std::endl
-	      << " pitch strip_l mod_z mod_r window"<< std::endl;
-    std::cout << "Pt units : GeV/c" << std::endl;
-    std::cout << "Pitch    : micrometers" << std::endl;
-    std::cout << "mod_*    : millimeters" << std::endl;
-    std::cout << "window   : number of strips" << std::endl;
-    std::cout << "And then the show: " << visible << std::endl;
-    
-    string ModuleType = "Barrel";
-    double pitch = 90;     // micrometers
-    double strip_l = 23.2; // mm
-    double mod_z = 954;    // mm
-    double mod_r = 348;    // mm
-    double mod_d = 1.3;    // mm
-    double window = 3;     // number of strips
-    double ptCut;
-
-    // Declare a group of options that will be
-    // allowed only on command line
-    po::options_description generic("Generic");
-    generic.add_options()
-      ("help", "produce help message")
-      ;
-
-    // Declare optional options
-    po::options_description optional("Material plot");
-    optional.add_options()
-      ("trackerOnly,t", "takes only into account the outer tracker")
-      ("maxRange,r", po::value<double>(&range), "sets the vertical range for the material plot")
-      ("output,o", po::value<string>(&outputName), "output file name (.png will be added)")
-      ;
-
-    // Create the command line option set
-    po::options_description cmdline_options;
-    cmdline_options.add(generic).add(optional);
-
-    // Create the list to be shown
-    po::options_description visible("Options");
-    visible.add(generic).add(optional);
-
-    // Actually read the options from command line
-    po::variables_map vm;
-    store(po::command_line_parser(ac, av).
-	  options(cmdline_options).run(), vm);
-    notify(vm);
-
-    // List the options
+    po::store(po::command_line_parser(argc, argv).options(options).run(), vm);
+    po::notify(vm);
     if (vm.count("help")) {
-      printUsage(visible, av[0]);
+      cout << "Syntax: " << argv[0] << " [options]" << endl << options << endl;
       return 0;
     }
-    
-    bool usePixel = (vm.count("trackerOnly")==0);
-    int myColor;
-
-    // Look into the input-file list
-    if (vm.count("input-file")) {
-      string dirName;
-      prepareCanvas();
-      Palette::skipColors(100);
-      Palette::prepare(fileV.size(), 210, 0.6,.6);
-      for (unsigned int iMat=0 ; iMat<fileV.size(); ++iMat) {
-	dirName = (mainConfiguration.getLayoutDirectory()
-		   + "/" + fileV.at(iMat));
-	cerr << dirName << endl; // debug
-	myColor = Palette::color(iMat);
-	plotMaterial(dirName, myColor, usePixel, fileV.at(iMat));
-      }
-      if (lastPixel) {
-	myLegend->AddEntry(lastPixel, "pixel", "F");
-      }
-      //Palette::prepare(10, 210, 0.9, 0.4);
-      printCanvas(outputName);
-    } else {
-      cout << "Error: at least a layout name should be given" << endl << endl;
-
-      printUsage(visible, av[0]);
-      return -1;
+    vector<string> typeNames;
+    boost::split(typeNames, types, boost::is_any_of(","));
+    for (const string& typeName : typeNames) {
+      if (typeName=="Barrel") moduleTypes.push_back(BARREL);
+      else if (typeName=="Endcap") moduleTypes.push_back(ENDCAP);
+      else throw invalid_argument("Unknown module type '" + typeName + "'");
     }
+    pitchV = parseValues("pitch", pitches);
+    stripV = parseValues("strip", stripLengths);
+    zV = parseValues("z", zs);
+    rV = parseValues("r", rs);
+    windowV = parseValues("window", windows);
+    distanceV = parseValues("distance", distances);
+  } catch (const exception& e) {
+    cerr << e.what() << endl << options << endl;
+    return 1;
+  }
 
-  } catch(exception& e) {
-    cout << e.what() << endl;
+  // Enumerate the whole grid first, so that it can be split evenly across the threads
+  vector<ScanPoint> points;
+  points.reserve(moduleTypes.size()*pitchV.size()*stripV.size()*zV.size()*rV.size()*windowV.size()*distanceV.size());
+  for (int type : moduleTypes)
+    for (double pitch : pitchV)
+      for (double strip_l : stripV)
+        for (double mod_z : zV)
+          for (double mod_r : rV)
+            for (double window : windowV)
+              for (double mod_d : distanceV) {
+                ScanPoint point = ScanPoint();
+                point.type = type; point.pitch = pitch/1000.; point.strip_l = strip_l;
+                point.mod_z = mod_z; point.mod_r = mod_r; point.window = window; point.mod_d = mod_d;
+                points.push_back(point);
+              }
+
+  threads = max(1u, min<unsigned int>(threads, points.size()));
+  vector<thread> workers;
+  size_t chunk = (points.size() + threads - 1) / threads;
+  for (size_t first = 0; first < points.size(); first += chunk) {
+    workers.push_back(thread(scanChunk, ref(points), first, min(first+chunk, points.size()), efficientPt, vm.count("fast-erf")>0));
+  }
+  for (thread& worker : workers) worker.join();
+
+  FILE* output = stdout;
+  if (vm.count("output") && !(output = fopen(outputName.c_str(), "w"))) {
+    cerr << "Cannot open " << outputName << endl;
     return 1;
   }
+  fprintf(output, "# Tuning the pt modules: %lu points\n", (unsigned long)points.size());
+  fprintf(output, "type pitch strip_l z r window mod_d p_cut eff_1 inef_%g pt(1%%) pt(90%%) geom_ineff\n", efficientPt);
+  for (const ScanPoint& point : points) {
+    fprintf(output, "%s %.0f %.2f %.0f %.0f %.1f %.2f %.2f %.2f %.2f %.2f %.2f %.2f\n",
+            point.type==BARREL ? "Barrel" : "Endcap", point.pitch*1000, point.strip_l, point.mod_z, point.mod_r, point.window,
+            point.mod_d, point.p_cut, point.eff_1, point.inef_pt, point.pt_1, point.pt_90, point.geom_ineff);
+  }
+  if (output!=stdout) fclose(output);
+
   return 0;
 }
-  
-*/
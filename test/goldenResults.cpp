@@ -0,0 +1,233 @@
+/**
+ * @file goldenResults.cpp
+ * @brief This is the regression test of the accelerated paths of the analyses against the reference ones
+ *
+ * Each layout is analysed once on the reference paths (brute force hit search in double precision, on one thread)
+ * and once more with each accelerated path switched on, with the same tracks. The hits of every module, the material
+ * sums along eta and the resolution graphs of each accelerated run are compared with those of the reference run:
+ * the hits have to be the same, the values have to agree within the tolerance (relative to the largest reference
+ * value of their series). The irradiation of the modules is also looked up one at a time and in a batch. Each check
+ * prints one line of space separated key=value pairs, and the program fails if any of them does.
+ */
+
+#include <boost/program_options.hpp>
+#include <stdlib.h>
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <TGraph.h>
+#include <Squid.h>
+#include "StopWatch.h"
+
+namespace po = boost::program_options;
+
+namespace {
+
+  /**
+   * @struct GoldenResults
+   * @brief What the comparisons are made on, from one run of a layout
+   */
+  struct GoldenResults {
+    std::vector<double> moduleHits; // in the order of the modules of the tracker
+    std::vector<double> hitProfile;
+    std::vector<double> radiationLength, interactionLength;
+    std::vector<double> resolutions; // the points of all the resolution graphs, one after the other
+  };
+
+  /**
+   * @struct AcceleratedPath
+   * @brief A fast path of the analyses, with how it is switched on
+   */
+  struct AcceleratedPath {
+    std::string name;
+    std::function<void(insur::Squid&, int)> enable;
+  };
+
+  void appendBins(const TH1& histo, std::vector<double>& values) {
+    for (int i = 1; i <= histo.GetNbinsX(); i++) values.push_back(histo.GetBinContent(i));
+  }
+
+  void appendGraphs(const std::map<int, TGraph>& graphs, std::vector<double>& values) {
+    for (const auto& graph : graphs) {
+      for (int i = 0; i < graph.second.GetN(); i++) values.push_back(graph.second.GetY()[i]);
+    }
+  }
+
+  /**
+   * Analyse a layout
+   * @param geometryFile The geometry file of the layout
+   * @param tracks The number of tracks of the scans
+   * @param seed The random seed of the tracks
+   * @param setup Switches on the paths of the run
+   * @param results Filled with the results of the run
+   * @return True if all the steps succeeded
+   */
+  bool analyse(const std::string& geometryFile, int tracks, int seed, const std::function<void(insur::Squid&)>& setup, GoldenResults& results) {
+    insur::Squid squid;
+    squid.setGeometryFile(geometryFile);
+    squid.setRandomSeed(seed);
+    squid.useModuleHitIndex(false);
+    squid.useSinglePrecisionHits(false);
+    squid.setNumThreads(1);
+    setup(squid);
+    if (!squid.buildTracker() || !squid.buildMaterials(false) || !squid.createMaterialBudget(false)) return false;
+    if (!squid.pureAnalyzeGeometry(tracks) || !squid.pureAnalyzeMaterialBudget(tracks, true, false)) return false;
+
+    Analyzer& analyzer = squid.analyzer();
+    for (const Module* m : squid.tracker()->modules()) results.moduleHits.push_back(analyzer.moduleHits(m));
+    appendBins(analyzer.getTotalEtaProfile(), results.hitProfile);
+    appendBins(analyzer.getHistoGlobalR(), results.radiationLength);
+    appendBins(analyzer.getHistoGlobalI(), results.interactionLength);
+    for (bool ideal : { false, true }) {
+      appendGraphs(analyzer.getRhoGraphs(ideal, false), results.resolutions);
+      appendGraphs(analyzer.getPhiGraphs(ideal, false), results.resolutions);
+      appendGraphs(analyzer.getDGraphs(ideal, false), results.resolutions);
+      appendGraphs(analyzer.getCtgThetaGraphs(ideal, false), results.resolutions);
+      appendGraphs(analyzer.getZ0Graphs(ideal, false), results.resolutions);
+      appendGraphs(analyzer.getPGraphs(ideal, false), results.resolutions);
+    }
+    return true;
+  }
+
+  /**
+   * Compare two series of values and print the result of the check
+   * @param layout The name of the layout
+   * @param path The name of the accelerated path
+   * @param check The name of the series
+   * @param reference The values of the reference path
+   * @param accelerated The values of the accelerated path
+   * @param tolerance The largest difference allowed, relative to the largest reference value; 0 for equal values
+   * @return True if the values agree
+   */
+  bool compare(const std::string& layout, const std::string& path, const std::string& check,
+               const std::vector<double>& reference, const std::vector<double>& accelerated, double tolerance) {
+    double scale = 0, worst = 0;
+    for (double value : reference) scale = std::max(scale, std::fabs(value));
+    bool ok = reference.size() == accelerated.size();
+    for (size_t i = 0; ok && i < reference.size(); i++) {
+      double difference = std::fabs(reference[i] - accelerated[i]);
+      if (!(difference <= tolerance * scale)) ok = false; // a NaN fails too
+      worst = std::max(worst, scale > 0 ? difference / scale : difference);
+    }
+    std::cout << "golden=" << layout << " path=" << path << " check=" << check << " values=" << reference.size()
+              << " worst=" << worst << " tolerance=" << tolerance << " ok=" << ok << std::endl;
+    return ok;
+  }
+
+  std::string layoutName(const std::string& geometryFile) {
+    std::string name = geometryFile;
+    size_t slash = name.find_last_of('/');
+    if (slash != std::string::npos) name = name.substr(slash + 1);
+    size_t dot = name.find_last_of('.');
+    return dot != std::string::npos && dot > 0 ? name.substr(0, dot) : name;
+  }
+
+  /**
+   * Look the irradiation of the modules up one at a time and in a batch
+   * @param geometryFile The geometry file of the layout
+   * @param tolerance The relative difference allowed
+   * @return True if the lookups agree
+   */
+  bool checkIrradiation(const std::string& geometryFile, double tolerance) {
+    insur::Squid squid;
+    squid.setGeometryFile(geometryFile);
+    if (!squid.buildTracker()) return false;
+    const IrradiationMapsManager& irradiation = squid.simParms()->irradiationMapsManager();
+    std::vector<double> zs, rhos, single, batch;
+    for (const Module* m : squid.tracker()->modules()) {
+      zs.push_back(m->center().Z());
+      rhos.push_back(m->center().Rho());
+      single.push_back(irradiation.calculateIrradiationPower(std::make_pair(zs.back(), rhos.back())));
+    }
+    batch.resize(zs.size());
+    irradiation.calculateIrradiationPower(zs.data(), rhos.data(), batch.data(), zs.size());
+    return compare(layoutName(geometryFile), "irradiation batch", "fluence", single, batch, tolerance);
+  }
+
+}
+
+int main(int argc, char* argv[]) {
+  std::string usage("Usage: ");
+  usage += argv[0];
+  usage += " <geometry files> [options]";
+  std::vector<std::string> layouts;
+  int tracks, threads, seed;
+  double tolerance;
+
+  po::options_description shown("Golden results options");
+  shown.add_options()
+    ("help,h", "Display this help message.")
+    ("tracks", po::value<int>(&tracks)->default_value(200), "N. of tracks of the geometry and material scans.")
+    ("threads,j", po::value<int>(&threads)->default_value(4), "N. of threads of the multithreaded path.")
+    ("randseed", po::value<int>(&seed)->default_value(0xcafebabe), "Set the random seed of the tracks.")
+    ("tolerance", po::value<double>(&tolerance)->default_value(1e-9), "The difference allowed between the values of the\nreference and the accelerated paths, relative to the\nlargest reference value of their series.")
+    ;
+  po::options_description hidden;
+  hidden.add_options()("layouts", po::value<std::vector<std::string> >(&layouts)->composing());
+  po::positional_options_description posopt;
+  posopt.add("layouts", -1);
+  po::options_description mainopt;
+  mainopt.add(shown).add(hidden);
+
+  po::variables_map vm;
+  try {
+    po::store(po::command_line_parser(argc, argv).options(mainopt).positional(posopt).run(), vm);
+    po::notify(vm);
+    if (tracks < 1) throw po::invalid_option_value("tracks");
+    if (threads < 2) throw po::invalid_option_value("threads");
+    if (tolerance < 0) throw po::invalid_option_value("tolerance");
+    if (layouts.empty() && !vm.count("help")) throw po::error("Missing geometry files");
+  } catch(po::error e) {
+    std::cerr << "\nERROR: " << e.what() << std::endl << std::endl;
+    std::cout << usage << std::endl << shown << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (vm.count("help")) {
+    std::cout << usage << std::endl << shown << std::endl;
+    return 0;
+  }
+
+  // Only the result lines go to the standard output
+  StopWatch::instance()->setVerbosity(0, false);
+
+  std::vector<AcceleratedPath> paths = {
+    { "hit index", [](insur::Squid& squid, int) { squid.useModuleHitIndex(true); } },
+    { "single precision", [](insur::Squid& squid, int) { squid.useSinglePrecisionHits(true); } },
+    { "threads", [](insur::Squid& squid, int n) { squid.setNumThreads(n); } },
+    { "all", [](insur::Squid& squid, int n) { squid.useModuleHitIndex(true); squid.useSinglePrecisionHits(true); squid.setNumThreads(n); } }
+  };
+
+  int failures = 0;
+  for (const std::string& layout : layouts) {
+    std::string name = layoutName(layout);
+    GoldenResults reference;
+    if (!analyse(layout, tracks, seed, [](insur::Squid&) {}, reference)) {
+      std::cout << "golden=" << name << " path=reference ok=0" << std::endl;
+      failures++;
+      continue;
+    }
+    for (const AcceleratedPath& path : paths) {
+      GoldenResults accelerated;
+      if (!analyse(layout, tracks, seed, [&](insur::Squid& squid) { path.enable(squid, threads); }, accelerated)) {
+        std::cout << "golden=" << name << " path=" << path.name << " ok=0" << std::endl;
+        failures++;
+        continue;
+      }
+      if (!compare(name, path.name, "module hits", reference.moduleHits, accelerated.moduleHits, 0)) failures++;
+      if (!compare(name, path.name, "hit profile", reference.hitProfile, accelerated.hitProfile, tolerance)) failures++;
+      if (!compare(name, path.name, "radiation length", reference.radiationLength, accelerated.radiationLength, tolerance)) failures++;
+      if (!compare(name, path.name, "interaction length", reference.interactionLength, accelerated.interactionLength, tolerance)) failures++;
+      if (!compare(name, path.name, "resolutions", reference.resolutions, accelerated.resolutions, tolerance)) failures++;
+    }
+    if (!checkIrradiation(layout, tolerance)) failures++;
+  }
+
+  if (failures) {
+    std::cout << failures << " check" << (failures > 1 ? "s" : "") << " failed" << std::endl;
+    return EXIT_FAILURE;
+  }
+  return 0;
+}